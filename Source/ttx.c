@@ -13,6 +13,48 @@ static const char *stack_cookie = "$STACK: 4096\n";
 /* Forward declaration for cleanup stack access */
 static struct CleanupStack *g_ttxStack = NULL;
 
+/* Files up to this size are read in one go when a dormant session wakes */
+#define WAKE_SYNC_LOAD_BYTES 32768
+
+/* Libraries opened the first time a feature needs them, indexed by TTX_LIB_* */
+struct LazyLibrary {
+    STRPTR name;
+    ULONG version;
+    struct Library **base;
+    BOOL tried;                  /* Open was attempted (a missing library is not searched for again) */
+};
+
+static struct LazyLibrary g_lazyLibraries[TTX_LIB_COUNT] = {
+    {"asl.library", 36L, (struct Library **)&AslBase, FALSE},
+    {"commodities.library", 0L, (struct Library **)&CxBase, FALSE},
+    {"icon.library", 39L, (struct Library **)&IconBase, FALSE},
+    {"workbench.library", 36L, (struct Library **)&WorkbenchBase, FALSE},
+    {"rexxsyslib.library", 36L, (struct Library **)&RexxSysBase, FALSE}
+};
+
+/* Open an optional library on first use - returns its base, or NULL if it is not available */
+struct Library *TTX_NeedLibrary(ULONG which)
+{
+    struct LazyLibrary *lib = NULL;
+    
+    if (which >= TTX_LIB_COUNT) {
+        return NULL;
+    }
+    lib = &g_lazyLibraries[which];
+    if (!lib->tried) {
+        lib->tried = TRUE;
+        /* Tracked on the default cleanup stack like the libraries opened at startup */
+        *lib->base = openLibrary(lib->name, lib->version);
+        if (*lib->base) {
+            Printf("[INIT] TTX_NeedLibrary: %s=%lx\n", lib->name, (ULONG)*lib->base);
+        } else {
+            Printf("[INIT] TTX_NeedLibrary: WARN (%s optional, not found)\n", lib->name);
+            SetIoErr(0);
+        }
+    }
+    return *lib->base;
+}
+
 /* Initialize required libraries */
 BOOL TTX_InitLibraries(struct CleanupStack *stack)
 {
@@ -46,32 +88,6 @@ BOOL TTX_InitLibraries(struct CleanupStack *stack)
     }
     Printf("[INIT] TTX_InitLibraries: graphics.library=%lx\n", (ULONG)GfxBase);
     
-    IconBase = openLibrary("icon.library", 39L);
-    if (!IconBase) {
-        Printf("[INIT] TTX_InitLibraries: FAIL (icon.library)\n");
-        SetIoErr(ERROR_OBJECT_NOT_FOUND);
-        return FALSE;
-    }
-    Printf("[INIT] TTX_InitLibraries: icon.library=%lx\n", (ULONG)IconBase);
-    
-    WorkbenchBase = openLibrary("workbench.library", 36L);
-    if (!WorkbenchBase) {
-        /* Workbench library is optional - app icon support won't work without it */
-        Printf("[INIT] TTX_InitLibraries: WARN (workbench.library optional, not found)\n");
-        SetIoErr(ERROR_OBJECT_NOT_FOUND);
-    } else {
-        Printf("[INIT] TTX_InitLibraries: workbench.library=%lx\n", (ULONG)WorkbenchBase);
-    }
-    
-    CxBase = openLibrary("commodities.library", 0L);
-    if (!CxBase) {
-        /* Commodities is optional for single-instance, but preferred */
-        Printf("[INIT] TTX_InitLibraries: WARN (commodities.library optional, not found)\n");
-        SetIoErr(ERROR_OBJECT_NOT_FOUND);
-    } else {
-        Printf("[INIT] TTX_InitLibraries: commodities.library=%lx\n", (ULONG)CxBase);
-    }
-    
     /* Open keymap.library for MapRawKey */
     KeymapBase = openLibrary("keymap.library", 0L);
     if (!KeymapBase) {
@@ -82,16 +98,7 @@ BOOL TTX_InitLibraries(struct CleanupStack *stack)
     }
     Printf("[INIT] TTX_InitLibraries: keymap.library=%lx\n", (ULONG)KeymapBase);
     
-    /* Open asl.library for file requesters */
-    AslBase = openLibrary("asl.library", 36L);
-    if (!AslBase) {
-        /* ASL library is optional - file requesters won't work without it */
-        Printf("[INIT] TTX_InitLibraries: WARN (asl.library optional, not found)\n");
-        SetIoErr(ERROR_OBJECT_NOT_FOUND);
-    } else {
-        Printf("[INIT] TTX_InitLibraries: asl.library=%lx\n", (ULONG)AslBase);
-    }
-    
+    /* ASL, commodities, app icon and ARexx libraries open on first use - see TTX_NeedLibrary */
     Printf("[INIT] TTX_InitLibraries: SUCCESS\n");
     return TRUE;
 }
@@ -337,6 +344,11 @@ BOOL TTX_ParseToolTypes(STRPTR *fileName, struct WBStartup *wbMsg, struct Cleanu
     
     *fileName = NULL;
     
+    /* Tooltypes are the one startup path that needs icon.library */
+    if (!TTX_NeedLibrary(TTX_LIB_ICON)) {
+        return FALSE;
+    }
+    
     /* Get icon for this program using cleanup stack */
     /* Clear IoErr() before GetDiskObject to ensure clean state */
     SetIoErr(0);
@@ -398,7 +410,8 @@ BOOL TTX_ParseToolTypes(STRPTR *fileName, struct WBStartup *wbMsg, struct Cleanu
 }
 
 /* Check if another instance is already running */
-BOOL TTX_CheckExistingInstance(STRPTR fileName)
+/* Files go over as one message - a single file as TTX_MSG_OPEN_FILE, which older instances understand too */
+BOOL TTX_CheckExistingInstance(STRPTR *fileNames)
 {
     struct MsgPort *existingPort = NULL;
     BOOL result = FALSE;
@@ -416,8 +429,10 @@ BOOL TTX_CheckExistingInstance(STRPTR fileName)
     if (existingPort) {
         /* Another instance is running, send message to it */
         /* Use global cleanup stack for inter-instance messages */
-        if (fileName) {
-            result = TTX_SendToExistingInstance(g_ttxStack, TTX_MSG_OPEN_FILE, fileName);
+        if (fileNames && fileNames[0] && fileNames[1]) {
+            result = TTX_SendBatchToExistingInstance(g_ttxStack, fileNames);
+        } else if (fileNames && fileNames[0]) {
+            result = TTX_SendToExistingInstance(g_ttxStack, TTX_MSG_OPEN_FILE, fileNames[0]);
         } else {
             result = TTX_SendToExistingInstance(g_ttxStack, TTX_MSG_OPEN_NEW, NULL);
         }
@@ -470,6 +485,8 @@ BOOL TTX_SendToExistingInstance(struct CleanupStack *stack, ULONG msgType, STRPT
     msg->type = msgType;
     msg->fileName = NULL;
     msg->fileNameLen = fileNameLen;
+    msg->fileNames = NULL;
+    msg->fileCount = 0;
     
     /* Allocate and copy filename if provided */
     if (fileName && fileNameLen > 0) {
@@ -502,6 +519,195 @@ BOOL TTX_SendToExistingInstance(struct CleanupStack *stack, ULONG msgType, STRPT
     return result;
 }
 
+/* Send all files to the existing instance in one message */
+/* Message, name vector and names share one allocation, so the receiver frees it with one FreeVec() */
+BOOL TTX_SendBatchToExistingInstance(struct CleanupStack *stack, STRPTR *fileNames)
+{
+    struct MsgPort *existingPort = NULL;
+    struct TTXMessage *msg = NULL;
+    STRPTR *vector = NULL;
+    STRPTR text = NULL;
+    ULONG count = 0;
+    ULONG textSize = 0;
+    ULONG len = 0;
+    ULONG i = 0;
+    UBYTE fullPath[512];
+    
+    if (!stack || !fileNames) {
+        return FALSE;
+    }
+    
+    /* Size the block - names are expanded since the receiver has a different current directory */
+    for (count = 0; fileNames[count]; count++) {
+        TTX_ExpandFileName(fileNames[count], fullPath, sizeof(fullPath));
+        for (len = 0; fullPath[len] != '\0'; len++) {
+        }
+        textSize += len + 1;
+    }
+    if (count == 0) {
+        return FALSE;
+    }
+    
+    msg = (struct TTXMessage *)allocVec(sizeof(struct TTXMessage) + (count + 1) * sizeof(STRPTR) + textSize, MEMF_CLEAR);
+    if (!msg) {
+        return FALSE;
+    }
+    Printf("[INIT] TTX_SendBatchToExistingInstance: allocated msg=%lx (%lu files)\n", (ULONG)msg, count);
+    
+    vector = (STRPTR *)(msg + 1);
+    text = (STRPTR)(vector + count + 1);
+    for (i = 0; i < count; i++) {
+        TTX_ExpandFileName(fileNames[i], fullPath, sizeof(fullPath));
+        for (len = 0; fullPath[len] != '\0'; len++) {
+        }
+        CopyMem(fullPath, text, len);
+        text[len] = '\0';
+        vector[i] = text;
+        text += len + 1;
+    }
+    vector[count] = NULL;
+    
+    msg->msg.mn_Node.ln_Type = NT_MESSAGE;
+    msg->msg.mn_Length = sizeof(struct TTXMessage);
+    msg->msg.mn_ReplyPort = NULL;
+    msg->type = TTX_MSG_OPEN_BATCH;
+    msg->fileName = NULL;
+    msg->fileNameLen = 0;
+    msg->fileNames = vector;
+    msg->fileCount = count;
+    
+    /* Port may have gone while we were building the message */
+    Forbid();
+    existingPort = FindPort(TTX_MESSAGE_PORT_NAME);
+    if (existingPort) {
+        PutMsg(existingPort, (struct Message *)msg);
+    }
+    Permit();
+    
+    if (!existingPort) {
+        freeVec(msg);
+        return FALSE;
+    }
+    /* Receiver owns the message now */
+    UntrackResource(msg);
+    return TRUE;
+}
+
+/* Make a file name absolute (relative to our current directory) */
+VOID TTX_ExpandFileName(STRPTR fileName, STRPTR buffer, ULONG bufferSize)
+{
+    BPTR lock = 0;
+    BOOL done = FALSE;
+    
+    buffer[0] = '\0';
+    SetIoErr(0);
+    
+    /* Existing file - ask the file system for its full name */
+    lock = Lock(fileName, SHARED_LOCK);
+    if (lock) {
+        done = (BOOL)NameFromLock(lock, buffer, bufferSize);
+        UnLock(lock);
+    }
+    
+    /* New file - join the current directory and the name */
+    if (!done) {
+        lock = Lock("", SHARED_LOCK);
+        if (lock) {
+            done = (BOOL)(NameFromLock(lock, buffer, bufferSize) && AddPart(buffer, fileName, bufferSize));
+            UnLock(lock);
+        }
+    }
+    
+    if (!done) {
+        Strncpy(buffer, fileName, bufferSize);
+    }
+    SetIoErr(0);
+}
+
+/* Open a set of files: a window for the first one now, the rest queued to become dormant sessions */
+VOID TTX_OpenFiles(struct TTXApplication *app, STRPTR *fileNames, ULONG count)
+{
+    ULONG i = 0;
+    
+    if (!app || !fileNames || count == 0) {
+        return;
+    }
+    
+    Printf("[EVENT] TTX_OpenFiles: %lu files\n", count);
+    TTX_CreateSession(app, fileNames[0]);
+    for (i = 1; i < count; i++) {
+        /* Without an idle timer nothing would drain the queue */
+        if (!TTX_IdleSignal(app) || !TTX_QueueOpenFile(app, fileNames[i])) {
+            TTX_CreateDormantSession(app, fileNames[i]);
+        }
+    }
+}
+
+/* Queue a file to be opened later */
+BOOL TTX_QueueOpenFile(struct TTXApplication *app, STRPTR fileName)
+{
+    struct PendingOpen *pending = NULL;
+    ULONG len = 0;
+    
+    while (fileName[len] != '\0') {
+        len++;
+    }
+    
+    /* Node and name in one allocation */
+    pending = (struct PendingOpen *)allocVec(sizeof(struct PendingOpen) + len + 1, MEMF_CLEAR);
+    if (!pending) {
+        return FALSE;
+    }
+    pending->fileName = (STRPTR)(pending + 1);
+    CopyMem(fileName, pending->fileName, len);
+    pending->fileName[len] = '\0';
+    
+    if (app->openQueueTail) {
+        app->openQueueTail->next = pending;
+    } else {
+        app->openQueue = pending;
+    }
+    app->openQueueTail = pending;
+    app->openQueueCount++;
+    return TRUE;
+}
+
+/* Turn the next queued file into a dormant session - returns TRUE while more are waiting */
+BOOL TTX_OpenNextQueued(struct TTXApplication *app)
+{
+    struct PendingOpen *pending = NULL;
+    
+    pending = app->openQueue;
+    if (!pending) {
+        return FALSE;
+    }
+    app->openQueue = pending->next;
+    if (!app->openQueue) {
+        app->openQueueTail = NULL;
+    }
+    app->openQueueCount--;
+    
+    Printf("[EVENT] TTX_OpenNextQueued: %s (%lu left)\n", pending->fileName, app->openQueueCount);
+    TTX_CreateDormantSession(app, pending->fileName);
+    freeVec(pending);
+    
+    return (BOOL)(app->openQueue != NULL);
+}
+
+/* Drop files still waiting to be opened */
+VOID TTX_FreeOpenQueue(struct TTXApplication *app)
+{
+    struct PendingOpen *pending = NULL;
+    
+    while (app->openQueue) {
+        pending = app->openQueue->next;
+        freeVec(app->openQueue);
+        app->openQueue = pending;
+    }
+    app->openQueueTail = NULL;
+    app->openQueueCount = 0;
+}
+
 /* Setup message port for single-instance operation */
 BOOL TTX_SetupMessagePort(struct TTXApplication *app)
 {
@@ -562,7 +768,7 @@ BOOL TTX_SetupCommodity(struct TTXApplication *app)
     BOOL result = FALSE;
     
     Printf("[INIT] TTX_SetupCommodity: START\n");
-    if (!app || !CxBase) {
+    if (!app || !TTX_NeedLibrary(TTX_LIB_COMMODITIES)) {
         Printf("[INIT] TTX_SetupCommodity: FAIL (app=%lx, CxBase=%lx)\n", (ULONG)app, (ULONG)CxBase);
         return FALSE;
     }
@@ -645,13 +851,12 @@ VOID TTX_RemoveCommodity(struct TTXApplication *app)
 BOOL TTX_SetupAppIcon(struct TTXApplication *app)
 {
     Printf("[INIT] TTX_SetupAppIcon: START\n");
-    if (!app || !WorkbenchBase || !IconBase) {
-        Printf("[INIT] TTX_SetupAppIcon: FAIL (app=%lx, WorkbenchBase=%lx, IconBase=%lx)\n", 
-               (ULONG)app, (ULONG)WorkbenchBase, (ULONG)IconBase);
+    if (!app) {
+        Printf("[INIT] TTX_SetupAppIcon: FAIL (app=NULL)\n");
         return FALSE;
     }
     
-    /* App icon will be created when iconifying, not at startup */
+    /* App icon (and workbench/icon.library) will be set up when iconifying, not at startup */
     /* Just initialize the fields */
     app->appIconPort = NULL;
     app->appIcon = NULL;
@@ -937,6 +1142,8 @@ VOID TTX_DoIconify(struct TTXApplication *app, BOOL iconify)
     if (iconify && !app->iconified) {
         /* Iconify: Close all windows, create app icon */
         Printf("[ICONIFY] TTX_DoIconify: iconifying application\n");
+        TTX_NeedLibrary(TTX_LIB_ICON);
+        TTX_NeedLibrary(TTX_LIB_WORKBENCH);
         
         /* Save window state and close all windows but keep sessions alive */
         session = app->sessions;
@@ -963,7 +1170,7 @@ VOID TTX_DoIconify(struct TTXApplication *app, BOOL iconify)
                 /* Reopen windows on failure */
                 session = app->sessions;
                 while (session) {
-                    if (!session->window) {
+                    if (!session->window && !session->dormant) {
                         /* TODO: Reopen window - for now just mark as needing reopen */
                     }
                     session = session->next;
@@ -1012,7 +1219,7 @@ VOID TTX_DoIconify(struct TTXApplication *app, BOOL iconify)
             /* Reopen windows on failure */
             session = app->sessions;
             while (session) {
-                if (!session->window) {
+                if (!session->window && !session->dormant) {
                     TTX_RestoreWindow(app, session);
                 }
                 session = session->next;
@@ -1025,7 +1232,7 @@ VOID TTX_DoIconify(struct TTXApplication *app, BOOL iconify)
             /* Reopen windows on failure */
             session = app->sessions;
             while (session) {
-                if (!session->window) {
+                if (!session->window && !session->dormant) {
                     TTX_RestoreWindow(app, session);
                 }
                 session = session->next;
@@ -1055,7 +1262,7 @@ VOID TTX_DoIconify(struct TTXApplication *app, BOOL iconify)
             /* Reopen windows */
             session = app->sessions;
             while (session) {
-                if (!session->window) {
+                if (!session->window && !session->dormant) {
                     TTX_RestoreWindow(app, session);
                 }
                 session = session->next;
@@ -1099,16 +1306,15 @@ VOID TTX_DoIconify(struct TTXApplication *app, BOOL iconify)
         /* Reopen all windows */
         session = app->sessions;
         while (session) {
-            if (!session->window) {
+            if (!session->window && !session->dormant) {
                 Printf("[ICONIFY] TTX_DoIconify: restoring window for session %lu\n", session->sessionID);
                 if (!TTX_RestoreWindow(app, session)) {
                     Printf("[ICONIFY] TTX_DoIconify: WARN (failed to restore window for session %lu)\n", session->sessionID);
                 } else {
                     /* Refresh display after restoring window */
                     if (session->buffer) {
-                        RenderText(session->window, session->buffer);
-                        UpdateCursor(session->window, session->buffer);
-                        UpdateScrollBars(session);
+                        TTX_LayoutViews(session);
+                        TTX_RenderViews(session);
                     }
                 }
             }
@@ -1194,28 +1400,11 @@ VOID TTX_ProcessAppIcon(struct TTXApplication *app)
     }
 }
 
-/* Create a new session (window) */
-BOOL TTX_CreateSession(struct TTXApplication *app, STRPTR fileName)
+/* Initialize a new session's IDs, window defaults, file name, file metadata and title */
+VOID TTX_InitSessionState(struct TTXApplication *app, struct Session *session, STRPTR fileName)
 {
-    struct Session *session = NULL;
-    struct Screen *screen = NULL;
     STRPTR titleText = NULL;
     ULONG titleLen = 0;
-    BOOL result = FALSE;
-    
-    Printf("[INIT] TTX_CreateSession: START (fileName=%s)\n", fileName ? fileName : (STRPTR)"(null)");
-    if (!app || !app->cleanupStack) {
-        Printf("[INIT] TTX_CreateSession: FAIL (app=%lx, stack=%lx)\n", (ULONG)app, app ? (ULONG)app->cleanupStack : 0);
-        return FALSE;
-    }
-    
-    /* Allocate session structure on global cleanup stack */
-    session = (struct Session *)allocVec(sizeof(struct Session), MEMF_CLEAR);
-    if (!session) {
-        Printf("[INIT] TTX_CreateSession: FAIL (allocVec session failed)\n");
-        return FALSE;
-    }
-    Printf("[INIT] TTX_CreateSession: session=%lx\n", (ULONG)session);
     
     /* Initialize session */
     session->sessionID = app->nextSessionID++;
@@ -1237,7 +1426,7 @@ BOOL TTX_CreateSession(struct TTXApplication *app, STRPTR fileName)
     session->windowState.innerWidth = 600;  /* Default size */
     session->windowState.innerHeight = 400;
     session->windowState.flags = WFLG_DRAGBAR | WFLG_DEPTHGADGET | WFLG_SIZEGADGET | WFLG_CLOSEGADGET | WFLG_ACTIVATE | WFLG_SMART_REFRESH | WFLG_NEWLOOKMENUS | WFLG_REPORTMOUSE;
-    session->windowState.idcmpFlags = IDCMP_CLOSEWINDOW | IDCMP_VANILLAKEY | IDCMP_RAWKEY | IDCMP_REFRESHWINDOW | IDCMP_NEWSIZE | IDCMP_MOUSEBUTTONS | IDCMP_MOUSEMOVE | IDCMP_MENUPICK | IDCMP_IDCMPUPDATE;
+    session->windowState.idcmpFlags = IDCMP_CLOSEWINDOW | IDCMP_RAWKEY | IDCMP_REFRESHWINDOW | IDCMP_NEWSIZE | IDCMP_MOUSEBUTTONS | IDCMP_MOUSEMOVE | IDCMP_MENUPICK | IDCMP_IDCMPUPDATE;
     session->windowState.title = NULL;
     session->windowState.screenTitle = NULL;
     session->windowState.pubScreenName = NULL;
@@ -1255,21 +1444,6 @@ BOOL TTX_CreateSession(struct TTXApplication *app, STRPTR fileName)
     session->docState.fileSize = 0;
     session->docState.fileExists = FALSE;
     
-    /* Allocate and initialize text buffer using global cleanup stack */
-    session->buffer = (struct TextBuffer *)allocVec(sizeof(struct TextBuffer), MEMF_CLEAR);
-    if (!session->buffer) {
-        Printf("[INIT] TTX_CreateSession: FAIL (allocVec buffer failed)\n");
-        freeVec(session);
-        return FALSE;
-    }
-    Printf("[INIT] TTX_CreateSession: buffer=%lx\n", (ULONG)session->buffer);
-    
-    if (!InitTextBuffer(session->buffer, app->cleanupStack)) {
-        Printf("[INIT] TTX_CreateSession: FAIL (InitTextBuffer failed)\n");
-        freeVec(session);
-        return FALSE;
-    }
-    
     /* Copy filename if provided */
     if (fileName) {
         titleLen = 0;
@@ -1279,7 +1453,7 @@ BOOL TTX_CreateSession(struct TTXApplication *app, STRPTR fileName)
         if (titleLen > 0) {
             session->docState.fileName = (STRPTR)allocVec(titleLen + 1, MEMF_CLEAR);
             if (session->docState.fileName) {
-                Printf("[INIT] TTX_CreateSession: allocated fileName=%lx\n", (ULONG)session->docState.fileName);
+                Printf("[INIT] TTX_InitSessionState: allocated fileName=%lx\n", (ULONG)session->docState.fileName);
                 CopyMem(fileName, session->docState.fileName, titleLen);
                 session->docState.fileName[titleLen] = '\0';
                 /* Check if file exists and get its size */
@@ -1322,7 +1496,7 @@ BOOL TTX_CreateSession(struct TTXApplication *app, STRPTR fileName)
     
     titleText = (STRPTR)allocVec(titleLen + 20, MEMF_CLEAR);
     if (titleText) {
-        Printf("[INIT] TTX_CreateSession: allocated titleText=%lx\n", (ULONG)titleText);
+        Printf("[INIT] TTX_InitSessionState: allocated titleText=%lx\n", (ULONG)titleText);
         if (session->docState.fileName) {
             CopyMem(session->docState.fileName, titleText, titleLen);
             titleText[titleLen] = '\0';
@@ -1340,6 +1514,46 @@ BOOL TTX_CreateSession(struct TTXApplication *app, STRPTR fileName)
         CopyMem("TTX", session->windowState.screenTitle, 3);
         session->windowState.screenTitle[3] = '\0';
     }
+}
+
+/* Create a new session (window) */
+BOOL TTX_CreateSession(struct TTXApplication *app, STRPTR fileName)
+{
+    struct Session *session = NULL;
+    struct Screen *screen = NULL;
+    BOOL result = FALSE;
+    
+    Printf("[INIT] TTX_CreateSession: START (fileName=%s)\n", fileName ? fileName : (STRPTR)"(null)");
+    if (!app || !app->cleanupStack) {
+        Printf("[INIT] TTX_CreateSession: FAIL (app=%lx, stack=%lx)\n", (ULONG)app, app ? (ULONG)app->cleanupStack : 0);
+        return FALSE;
+    }
+    
+    /* Allocate session structure on global cleanup stack */
+    session = (struct Session *)allocVec(sizeof(struct Session), MEMF_CLEAR);
+    if (!session) {
+        Printf("[INIT] TTX_CreateSession: FAIL (allocVec session failed)\n");
+        return FALSE;
+    }
+    Printf("[INIT] TTX_CreateSession: session=%lx\n", (ULONG)session);
+    
+    /* Initialize IDs, window defaults and document metadata */
+    TTX_InitSessionState(app, session, fileName);
+    
+    /* Allocate and initialize text buffer using global cleanup stack */
+    session->buffer = (struct TextBuffer *)allocVec(sizeof(struct TextBuffer), MEMF_CLEAR);
+    if (!session->buffer) {
+        Printf("[INIT] TTX_CreateSession: FAIL (allocVec buffer failed)\n");
+        freeVec(session);
+        return FALSE;
+    }
+    Printf("[INIT] TTX_CreateSession: buffer=%lx\n", (ULONG)session->buffer);
+    
+    if (!InitTextBuffer(session->buffer, app->cleanupStack)) {
+        Printf("[INIT] TTX_CreateSession: FAIL (InitTextBuffer failed)\n");
+        freeVec(session);
+        return FALSE;
+    }
     
     /* Lock public screen (temporary, doesn't need tracking) */
     screen = LockPubScreen((STRPTR)"Workbench");
@@ -1486,10 +1700,10 @@ BOOL TTX_CreateSession(struct TTXApplication *app, STRPTR fileName)
                 ULONG maxLineLen = 0;
                 ULONG i = 0;
                 
-                if (session->buffer->lines && session->buffer->lineCount > 0) {
-                    for (i = 0; i < session->buffer->lineCount; i++) {
-                        if (session->buffer->lines[i].length > maxLineLen) {
-                            maxLineLen = session->buffer->lines[i].length;
+                if (session->buffer->doc && session->buffer->doc->lines && session->buffer->doc->lineCount > 0) {
+                    for (i = 0; i < session->buffer->doc->lineCount; i++) {
+                        if (session->buffer->doc->lines[i].length > maxLineLen) {
+                            maxLineLen = session->buffer->doc->lines[i].length;
                         }
                     }
                 }
@@ -1571,9 +1785,20 @@ BOOL TTX_CreateSession(struct TTXApplication *app, STRPTR fileName)
     }
     
     /* Load file if filename provided */
+    /* If another session already has the file open, attach to its document instead of loading a copy */
     if (session->docState.fileName && session->buffer) {
-        if (!LoadFile(session->docState.fileName, session->buffer, app->cleanupStack)) {
+        struct TextDocument *sharedDoc = NULL;
+
+        sharedDoc = FindDocument(session->docState.fileName);
+        if (sharedDoc) {
+            Printf("[INIT] TTX_CreateSession: sharing document=%lx (refCount=%lu)\n", (ULONG)sharedDoc, sharedDoc->refCount);
+            DetachDocument(session->buffer, app->cleanupStack);
+            AttachDocument(session->buffer, sharedDoc);
+            session->docState.modified = sharedDoc->modified;
+        } else if (!LoadFile(session->docState.fileName, session->buffer, app->cleanupStack)) {
             /* File load failed, but keep empty buffer */
+        } else {
+            SetDocumentFileName(session->buffer->doc, session->docState.fileName);
         }
     }
     
@@ -1606,58 +1831,266 @@ BOOL TTX_CreateSession(struct TTXApplication *app, STRPTR fileName)
     return result;
 }
 
-/* Destroy a session */
-VOID TTX_DestroySession(struct TTXApplication *app, struct Session *session)
+/* Create a dormant session - path and file metadata only; buffer and window come when it is activated */
+BOOL TTX_CreateDormantSession(struct TTXApplication *app, STRPTR fileName)
 {
-    struct IntuiMessage *imsg = NULL;
-    
-    Printf("[CLEANUP] TTX_DestroySession: START (session=%lx, sessionID=%lu)\n", (ULONG)session, session ? session->sessionID : 0);
-    if (!app || !session) {
-        Printf("[CLEANUP] TTX_DestroySession: DONE (app=%lx, session=%lx)\n", (ULONG)app, (ULONG)session);
-        return;
-    }
+    struct Session *session = NULL;
     
-    /* Remove from session list */
-    if (session->prev) {
-        session->prev->next = session->next;
-    } else {
-        app->sessions = session->next;
+    Printf("[INIT] TTX_CreateDormantSession: START (fileName=%s)\n", fileName ? fileName : (STRPTR)"(null)");
+    if (!app || !app->cleanupStack || !fileName) {
+        Printf("[INIT] TTX_CreateDormantSession: FAIL (app=%lx, fileName=%lx)\n", (ULONG)app, (ULONG)fileName);
+        return FALSE;
     }
     
-    if (session->next) {
-        session->next->prev = session->prev;
+    session = (struct Session *)allocVec(sizeof(struct Session), MEMF_CLEAR);
+    if (!session) {
+        Printf("[INIT] TTX_CreateDormantSession: FAIL (allocVec session failed)\n");
+        return FALSE;
     }
     
-    /* Clean up any pending messages before closing window */
-    /* Note: We check for INVALID_RESOURCE to avoid accessing freed windows */
-    if (session->window && session->window != INVALID_RESOURCE && session->window->UserPort) {
-        while ((imsg = (struct IntuiMessage *)GetMsg(session->window->UserPort)) != NULL) {
-            ReplyMsg((struct Message *)imsg);
-        }
-    }
+    TTX_InitSessionState(app, session, fileName);
+    session->dormant = TRUE;
+    session->loader = NULL;
     
-    /* Update active session BEFORE freeing session structure */
-    if (app->activeSession == session) {
-        app->activeSession = app->sessions;
+    /* Add to session list - the active session stays what it was */
+    session->prev = NULL;
+    session->next = app->sessions;
+    if (app->sessions) {
+        app->sessions->prev = session;
     }
+    app->sessions = session;
+    app->sessionCount++;
     
-    /* Decrement session count BEFORE freeing */
-    app->sessionCount--;
+    Printf("[INIT] TTX_CreateDormantSession: SUCCESS (sessionID=%lu)\n", session->sessionID);
+    return TRUE;
+}
+
+/* Materialize a dormant session: buffer now, window if not iconified, file text over idle slices */
+BOOL TTX_WakeSession(struct TTXApplication *app, struct Session *session)
+{
+    struct TextDocument *sharedDoc = NULL;
+    struct FileLoader *loader = NULL;
     
-    /* Free menu strip BEFORE window closes (window must still be valid for ClearMenuStrip) */
-    /* The menu is tracked on the global cleanup stack, but we need to free it manually */
-    if (session) {
-        TTX_FreeMenuStrip(session);
+    if (!app || !session) {
+        return FALSE;
     }
-    
-    /* Free text buffer - all resources are tracked on global cleanup stack */
-    if (session->buffer && app->cleanupStack) {
-        FreeTextBuffer(session->buffer, app->cleanupStack);
+    if (!session->dormant) {
+        return TRUE;
     }
     
-    /* Mark window as invalid after cleanup stack handles it */
-    if (session->window && session->window != INVALID_RESOURCE) {
-        session->window = INVALID_RESOURCE;
+    Printf("[INIT] TTX_WakeSession: START (sessionID=%lu, file=%s, size=%lu)\n", session->sessionID,
+           session->docState.fileName ? session->docState.fileName : (STRPTR)"(null)", session->docState.fileSize);
+    
+    session->buffer = (struct TextBuffer *)allocVec(sizeof(struct TextBuffer), MEMF_CLEAR);
+    if (!session->buffer) {
+        Printf("[INIT] TTX_WakeSession: FAIL (allocVec buffer failed)\n");
+        return FALSE;
+    }
+    if (!InitTextBuffer(session->buffer, app->cleanupStack)) {
+        Printf("[INIT] TTX_WakeSession: FAIL (InitTextBuffer failed)\n");
+        freeVec(session->buffer);
+        session->buffer = NULL;
+        return FALSE;
+    }
+    session->dormant = FALSE;
+    
+    /* Same file open elsewhere: share it; otherwise show the document while it fills in */
+    if (session->docState.fileName) {
+        sharedDoc = FindDocument(session->docState.fileName);
+        if (sharedDoc) {
+            Printf("[INIT] TTX_WakeSession: sharing document=%lx\n", (ULONG)sharedDoc);
+            DetachDocument(session->buffer, app->cleanupStack);
+            AttachDocument(session->buffer, sharedDoc);
+            session->docState.modified = sharedDoc->modified;
+        } else if (!session->docState.fileExists) {
+            SetDocumentFileName(session->buffer->doc, session->docState.fileName);
+        } else {
+            loader = BeginLoadFile(session->docState.fileName, app->cleanupStack);
+            if (loader) {
+                DetachDocument(session->buffer, app->cleanupStack);
+                AttachDocument(session->buffer, loader->doc);
+                session->loader = loader;
+                /* Nothing may edit or save a half-read file */
+                session->loadReadOnly = session->docState.readOnly;
+                session->docState.readOnly = TRUE;
+                if (session->docState.fileSize <= WAKE_SYNC_LOAD_BYTES || !TTX_IdleSignal(app)) {
+                    while (TTX_ContinueSessionLoad(app, session, 0xFFFFFFFFUL)) {
+                        /* Small file (or no idle timer) - read it in one go */
+                    }
+                }
+            } else {
+                Printf("[INIT] TTX_WakeSession: WARN (BeginLoadFile failed, continuing with empty buffer)\n");
+            }
+        }
+    }
+    
+    /* Window on demand - an iconified application reopens it together with the others */
+    if (!app->iconified) {
+        if (!TTX_RestoreWindow(app, session)) {
+            Printf("[INIT] TTX_WakeSession: WARN (RestoreWindow failed)\n");
+        } else {
+            CalculateMaxScroll(session->buffer, session->window);
+            UpdateScrollBars(session);
+            RenderText(session->window, session->buffer);
+            UpdateCursor(session->window, session->buffer);
+        }
+    }
+    
+    Printf("[INIT] TTX_WakeSession: SUCCESS (window=%lx, loading=%s)\n", (ULONG)session->window,
+           session->loader ? "YES" : "NO");
+    return TRUE;
+}
+
+/* Read the next lines of a session's file - returns TRUE while more are left */
+BOOL TTX_ContinueSessionLoad(struct TTXApplication *app, struct Session *session, ULONG maxLines)
+{
+    struct TextDocument *doc = NULL;
+    struct TextBuffer *view = NULL;
+    ULONG oldLineCount = 0;
+    BOOL more = FALSE;
+    
+    if (!app || !session || !session->loader) {
+        return FALSE;
+    }
+    
+    doc = session->loader->doc;
+    oldLineCount = doc->lineCount;
+    more = ContinueLoadFile(session->loader, maxLines);
+    
+    /* New lines for the idle statistics and compaction, and for the views */
+    doc->changeCount++;
+    if (doc->lineCount > oldLineCount) {
+        IdleLinesChanged(doc, (oldLineCount > 0) ? oldLineCount - 1 : DOC_CHANGE_ALL,
+                         (LONG)(doc->lineCount - oldLineCount));
+    }
+    for (view = doc->views; view; view = view->nextView) {
+        view->docChanged = TRUE;
+        if (oldLineCount <= ViewLineAfterRows(view, view->scrollY, view->pageH)) {
+            view->needsFullRedraw = TRUE;
+        }
+    }
+    
+    if (!more) {
+        TTX_EndSessionLoad(app, session);
+    }
+    return more;
+}
+
+/* Finish a session's file load once the whole file is in */
+VOID TTX_EndSessionLoad(struct TTXApplication *app, struct Session *session)
+{
+    struct TextDocument *doc = NULL;
+    
+    if (!app || !session || !session->loader) {
+        return;
+    }
+    
+    doc = session->loader->doc;
+    if (EndLoadFile(session->loader)) {
+        session->docState.readOnly = session->loadReadOnly;
+        if (session->docState.fileName && session->buffer && session->buffer->doc == doc) {
+            SetDocumentFileName(doc, session->docState.fileName);
+        }
+        Printf("[EVENT] TTX_EndSessionLoad: loaded %lu lines (sessionID=%lu)\n", doc->lineCount, session->sessionID);
+    } else {
+        /* Saving the part that fit would truncate the file - leave it read-only */
+        Printf("[EVENT] TTX_EndSessionLoad: WARN (out of memory after %lu lines, read-only)\n", doc->lineCount);
+    }
+    session->loader = NULL;
+}
+
+/* Stop a session's file load early - the part read so far is about to be discarded */
+VOID TTX_AbortSessionLoad(struct Session *session)
+{
+    if (!session || !session->loader) {
+        return;
+    }
+    
+    Printf("[CLEANUP] TTX_AbortSessionLoad: sessionID=%lu\n", session->sessionID);
+    EndLoadFile(session->loader);
+    session->loader = NULL;
+    session->docState.readOnly = session->loadReadOnly;
+}
+
+/* Bring a session to the front, waking it first if it is dormant */
+BOOL TTX_ActivateSession(struct TTXApplication *app, struct Session *session)
+{
+    if (!app || !session) {
+        return FALSE;
+    }
+    
+    if (session->dormant && !TTX_WakeSession(app, session)) {
+        return FALSE;
+    }
+    if (!session->window) {
+        return FALSE;
+    }
+    
+    WindowToFront(session->window);
+    ActivateWindow(session->window);
+    app->activeSession = session;
+    return TRUE;
+}
+
+/* Destroy a session */
+VOID TTX_DestroySession(struct TTXApplication *app, struct Session *session)
+{
+    struct IntuiMessage *imsg = NULL;
+    
+    Printf("[CLEANUP] TTX_DestroySession: START (session=%lx, sessionID=%lu)\n", (ULONG)session, session ? session->sessionID : 0);
+    if (!app || !session) {
+        Printf("[CLEANUP] TTX_DestroySession: DONE (app=%lx, session=%lx)\n", (ULONG)app, (ULONG)session);
+        return;
+    }
+    
+    /* Remove from session list */
+    if (session->prev) {
+        session->prev->next = session->next;
+    } else {
+        app->sessions = session->next;
+    }
+    
+    if (session->next) {
+        session->next->prev = session->prev;
+    }
+    
+    /* Clean up any pending messages before closing window */
+    /* Note: We check for INVALID_RESOURCE to avoid accessing freed windows */
+    if (session->window && session->window != INVALID_RESOURCE && session->window->UserPort) {
+        while ((imsg = (struct IntuiMessage *)GetMsg(session->window->UserPort)) != NULL) {
+            ReplyMsg((struct Message *)imsg);
+        }
+    }
+    
+    /* Update active session BEFORE freeing session structure - dormant sessions have no buffer to act on */
+    if (app->activeSession == session) {
+        app->activeSession = app->sessions;
+        while (app->activeSession && app->activeSession->dormant) {
+            app->activeSession = app->activeSession->next;
+        }
+    }
+    
+    /* Decrement session count BEFORE freeing */
+    app->sessionCount--;
+    
+    /* Free menu strip BEFORE window closes (window must still be valid for ClearMenuStrip) */
+    /* The menu is tracked on the global cleanup stack, but we need to free it manually */
+    if (session) {
+        TTX_FreeMenuStrip(session);
+    }
+    
+    /* Free text buffer - all resources are tracked on global cleanup stack */
+    TTX_AbortSessionLoad(session);
+    if (session->otherView && app->cleanupStack) {
+        TTX_UnsplitSession(app, session);
+    }
+    if (session->buffer && app->cleanupStack) {
+        FreeTextBuffer(session->buffer, app->cleanupStack);
+    }
+    
+    /* Mark window as invalid after cleanup stack handles it */
+    if (session->window && session->window != INVALID_RESOURCE) {
+        session->window = INVALID_RESOURCE;
     }
     
     /* Free session structure from global cleanup stack */
@@ -1709,6 +2142,10 @@ BOOL TTX_HandleCommodityMessage(struct TTXApplication *app, struct Message *msg)
                             TTX_CreateSession(app, NULL);
                             break;
                             
+                        case TTX_MSG_OPEN_BATCH:
+                            TTX_OpenFiles(app, ttxMsg->fileNames, ttxMsg->fileCount);
+                            break;
+                            
                         case TTX_MSG_QUIT:
                             app->running = FALSE;
                             break;
@@ -1798,6 +2235,7 @@ BOOL TTX_HandleCommodityMessage(struct TTXApplication *app, struct Message *msg)
 BOOL TTX_HandleIntuitionMessage(struct TTXApplication *app, struct IntuiMessage *imsg)
 {
     struct Session *session = NULL;
+    struct TTXKeyBinding *keyBinding = NULL;
     BOOL result = FALSE;
     
     if (!app || !imsg) {
@@ -1985,16 +2423,25 @@ BOOL TTX_HandleIntuitionMessage(struct TTXApplication *app, struct IntuiMessage
                 }
                 
                 if (isButtonPress || isButtonRelease) {
+                    /* Clicking into the inactive pane of a split window activates it */
+                    if (isButtonPress && session->otherView &&
+                        TTX_ViewAtPoint(session, imsg->MouseY) == session->otherView) {
+                        struct TextBuffer *previous = session->buffer;
+                        session->buffer = session->otherView;
+                        session->otherView = previous;
+                        RenderText(session->window, previous);  /* Remove its cursor */
+                    }
+                    
                     /* Convert mouse coordinates to cursor position */
                     MouseToCursor(session->buffer, session->window, imsg->MouseX, imsg->MouseY, &newCursorX, &newCursorY);
                     
                     /* Update cursor position */
-                    if (session->buffer && session->buffer->lines && newCursorY < session->buffer->lineCount) {
+                    if (session->buffer && session->buffer->doc && session->buffer->doc->lines && newCursorY < session->buffer->doc->lineCount) {
                         session->buffer->cursorY = newCursorY;
-                        if (newCursorX <= session->buffer->lines[newCursorY].length) {
+                        if (newCursorX <= session->buffer->doc->lines[newCursorY].length) {
                             session->buffer->cursorX = newCursorX;
                         } else {
-                            session->buffer->cursorX = session->buffer->lines[newCursorY].length;
+                            session->buffer->cursorX = session->buffer->doc->lines[newCursorY].length;
                         }
                     }
                     
@@ -2003,9 +2450,12 @@ BOOL TTX_HandleIntuitionMessage(struct TTXApplication *app, struct IntuiMessage
                         session->mouseSelecting = TRUE;
                         session->selectStartX = session->buffer->cursorX;
                         session->selectStartY = session->buffer->cursorY;
+                        /* Dragging with Alt held marks a column block */
+                        session->selectColumn = (BOOL)((imsg->Qualifier & (IEQUALIFIER_LALT | IEQUALIFIER_RALT)) != 0);
                         /* Set marking start */
                         SetMarking(session->buffer, session->selectStartY, session->selectStartX, 
                                   session->selectStartY, session->selectStartX);
+                        session->buffer->marking.column = session->selectColumn;
                         Printf("[EVENT] IDCMP_MOUSEBUTTONS: selection started at (%lu,%lu)\n", 
                                session->selectStartX, session->selectStartY);
                     } else if (isButtonRelease) {
@@ -2014,6 +2464,7 @@ BOOL TTX_HandleIntuitionMessage(struct TTXApplication *app, struct IntuiMessage
                             /* Update marking end */
                             SetMarking(session->buffer, session->selectStartY, session->selectStartX,
                                       session->buffer->cursorY, session->buffer->cursorX);
+                            session->buffer->marking.column = session->selectColumn;
                             session->mouseSelecting = FALSE;
                             Printf("[EVENT] IDCMP_MOUSEBUTTONS: selection ended at (%lu,%lu)\n",
                                    session->buffer->cursorX, session->buffer->cursorY);
@@ -2040,18 +2491,19 @@ BOOL TTX_HandleIntuitionMessage(struct TTXApplication *app, struct IntuiMessage
                 MouseToCursor(session->buffer, session->window, imsg->MouseX, imsg->MouseY, &newCursorX, &newCursorY);
                 
                 /* Update cursor position */
-                if (session->buffer && session->buffer->lines && newCursorY < session->buffer->lineCount) {
+                if (session->buffer && session->buffer->doc && session->buffer->doc->lines && newCursorY < session->buffer->doc->lineCount) {
                     session->buffer->cursorY = newCursorY;
-                    if (newCursorX <= session->buffer->lines[newCursorY].length) {
+                    if (newCursorX <= session->buffer->doc->lines[newCursorY].length) {
                         session->buffer->cursorX = newCursorX;
                     } else {
-                        session->buffer->cursorX = session->buffer->lines[newCursorY].length;
+                        session->buffer->cursorX = session->buffer->doc->lines[newCursorY].length;
                     }
                 }
                 
                 /* Update marking end */
                 SetMarking(session->buffer, session->selectStartY, session->selectStartX,
                           session->buffer->cursorY, session->buffer->cursorX);
+                session->buffer->marking.column = session->selectColumn;
                 
                 /* Scroll if cursor moved outside visible area */
                 ScrollToCursor(session->buffer, session->window);
@@ -2062,8 +2514,20 @@ BOOL TTX_HandleIntuitionMessage(struct TTXApplication *app, struct IntuiMessage
             }
                     break;
                     
-                case IDCMP_VANILLAKEY:
                 case IDCMP_RAWKEY:
+            /* Bound keys: one table lookup and one call through the resolved command */
+            if (!app->keyMap) {
+                TTX_BuildKeyMap(app);
+            }
+            if (session->buffer && app->keyMap && imsg->Code < DFN_RAWKEY_COUNT) {
+                keyBinding = app->keyMap->keys[app->keyMap->qualifierRow[imsg->Qualifier & 0xFF]][imsg->Code];
+                if (keyBinding) {
+                    /* The command may close the window - the session is not touched after it */
+                    TTX_RunCommand(app, session, keyBinding->command, keyBinding->args, keyBinding->argCount);
+                    result = TRUE;
+                    break;
+                }
+            }
             if (session->buffer && !session->docState.readOnly) {
                 UBYTE keyCode = imsg->Code;
                 ULONG qualifiers = imsg->Qualifier;
@@ -2073,210 +2537,101 @@ BOOL TTX_HandleIntuitionMessage(struct TTXApplication *app, struct IntuiMessage
                 struct KeyMap *keymap = NULL;
                 BOOL processed = FALSE;
                 
-                /* Handle VANILLAKEY first - these are already converted by Intuition */
-                if (imsg->Class == IDCMP_VANILLAKEY) {
-                    /* Filter out arrow keys that might come as VANILLAKEY */
-                    /* Arrow keys should be handled as RAWKEY, but some systems might send them as VANILLAKEY */
-                    if (keyCode == 0x1C || keyCode == 0x1D || keyCode == 0x1E || keyCode == 0x1F) {
-                        /* Arrow keys as VANILLAKEY - ignore, they should come as RAWKEY */
-                        processed = TRUE;
-                    } else if ((keyCode >= 27 && keyCode <= 126) || (keyCode >= 128 && keyCode <= 255)) {
-                        /* Printable character - insert directly */
-                        InsertChar(session->buffer, keyCode, session->cleanupStack);
-                        CalculateMaxScroll(session->buffer, session->window);
-                        ScrollToCursor(session->buffer, session->window);
-                        UpdateScrollBars(session);
-                        RenderText(session->window, session->buffer);
-                        UpdateCursor(session->window, session->buffer);
-                        processed = TRUE;
-                    } else if (keyCode == 0x08) {
-                        /* Backspace */
-                        DeleteChar(session->buffer, session->cleanupStack);
-                        CalculateMaxScroll(session->buffer, session->window);
-                        ScrollToCursor(session->buffer, session->window);
-                        UpdateScrollBars(session);
-                        RenderText(session->window, session->buffer);
-                        UpdateCursor(session->window, session->buffer);
-                        processed = TRUE;
-                    } else if (keyCode == 0x7F) {
-                        /* Delete key (forward delete) */
-                        DeleteForward(session->buffer, session->cleanupStack);
-                        CalculateMaxScroll(session->buffer, session->window);
-                        ScrollToCursor(session->buffer, session->window);
-                        UpdateScrollBars(session);
-                        RenderText(session->window, session->buffer);
-                        UpdateCursor(session->window, session->buffer);
-                        processed = TRUE;
-                    } else if (keyCode == 0x0A || keyCode == 0x0D) {
-                        /* Enter/Return */
-                        InsertNewline(session->buffer, session->cleanupStack);
-                        CalculateMaxScroll(session->buffer, session->window);
-                        ScrollToCursor(session->buffer, session->window);
-                        UpdateScrollBars(session);
-                        RenderText(session->window, session->buffer);
-                        UpdateCursor(session->window, session->buffer);
-                        processed = TRUE;
-                    } else if (keyCode == 0x1B) {
-                        /* Escape = Quit (close window) */
-                        TTX_DestroySession(app, session);
-                        result = TRUE;
-                        break;
-                    } else if (keyCode == 0x45 && (qualifiers & IEQUALIFIER_CONTROL)) {
-                        /* Ctrl+E = Save */
-                        if (session->docState.fileName && session->buffer && app->cleanupStack) {
-                            if (SaveFile(session->docState.fileName, session->buffer, app->cleanupStack)) {
-                                session->docState.modified = FALSE;
-                                session->buffer->modified = FALSE;
-                            }
-                        }
-                        processed = TRUE;
-                    }
-                } else if (imsg->Class == IDCMP_RAWKEY) {
-                    /* RAWKEY needs conversion via keymap */
-                    /* Filter out modifier keys and mouse buttons */
-                    /* Check for key release (bit 7 set) */
-                    if (keyCode & 0x80) {
-                        /* Key release - ignore */
-                        result = TRUE;
-                        break;
-                    }
-                    
-                    /* Filter out modifier keys */
-                    if (keyCode >= 0x60 && keyCode <= 0x67) {
-                        /* Shift, Ctrl, Alt, etc. - ignore */
-                        result = TRUE;
-                        break;
-                    }
-                    
-                    /* Filter out mouse buttons */
-                    if (keyCode >= 0x68 && keyCode <= 0x6A) {
-                        /* Mouse buttons - ignore */
-                        result = TRUE;
-                        break;
+                /* Every key comes as RAWKEY (no VANILLAKEY) so bindings see the raw code */
+                /* RAWKEY needs conversion via keymap */
+                /* Filter out modifier keys and mouse buttons */
+                /* Check for key release (bit 7 set) */
+                if (keyCode & 0x80) {
+                    /* Key release - ignore */
+                    result = TRUE;
+                    break;
+                }
+                
+                /* Filter out modifier keys */
+                if (keyCode >= 0x60 && keyCode <= 0x67) {
+                    /* Shift, Ctrl, Alt, etc. - ignore */
+                    result = TRUE;
+                    break;
+                }
+                
+                /* Filter out mouse buttons */
+                if (keyCode >= 0x68 && keyCode <= 0x6A) {
+                    /* Mouse buttons - ignore */
+                    result = TRUE;
+                    break;
+                }
+                
+                /* Everything not bound above is typed text - convert it using the keymap */
+                /* Get default keymap for conversion */
+                if (KeymapBase) {
+                    keymap = AskKeyMapDefault();
+                }
+                
+                if (keymap) {
+                    /* MapRawKey requires an InputEvent structure */
+                    /* Follow the API doc example from keymap.doc */
+                    ievent.ie_Class = IECLASS_RAWKEY;
+                    ievent.ie_SubClass = 0;
+                    ievent.ie_Code = keyCode;
+                    ievent.ie_Qualifier = qualifiers & ~(IEQUALIFIER_CAPSLOCK | IEQUALIFIER_RELATIVEMOUSE);
+                    /* Recover dead key codes & qualifiers from IAddress */
+                    /* As per API doc: ie.ie_EventAddress = (APTR *) *((ULONG *)im->IAddress); */
+                    if (imsg->IAddress) {
+                        ievent.ie_EventAddress = (APTR) *((ULONG *)imsg->IAddress);
+                    } else {
+                        ievent.ie_EventAddress = NULL;
                     }
                     
-                    /* Handle special keys first (before keymap conversion) */
-                    /* Arrow keys: 0x4F=Left, 0x4E=Right, 0x4C=Up, 0x4D=Down (Amiga raw key codes) */
-                    if (keyCode == 0x4F) {
-                        /* Left arrow */
-                        if (session->buffer && session->buffer->lines) {
-                            if (session->buffer->cursorX > 0) {
-                                session->buffer->cursorX--;
-                            } else if (session->buffer->cursorY > 0 && session->buffer->cursorY - 1 < session->buffer->lineCount) {
-                                session->buffer->cursorY--;
-                                session->buffer->cursorX = session->buffer->lines[session->buffer->cursorY].length;
-                            }
-                        }
-                        ScrollToCursor(session->buffer, session->window);
-                        UpdateScrollBars(session);
-                        RenderText(session->window, session->buffer);
-                        UpdateCursor(session->window, session->buffer);
-                        processed = TRUE;
-                    } else if (keyCode == 0x4E) {
-                        /* Right arrow */
-                        if (session->buffer && session->buffer->lines && session->buffer->cursorY < session->buffer->lineCount) {
-                            if (session->buffer->cursorX < session->buffer->lines[session->buffer->cursorY].length) {
-                                session->buffer->cursorX++;
-                            } else if (session->buffer->cursorY < session->buffer->lineCount - 1) {
-                                session->buffer->cursorY++;
-                                session->buffer->cursorX = 0;
+                    /* Use MapRawKey from keymap.library */
+                    /* MapRawKey returns WORD: number of characters, or -1 for buffer overflow */
+                    chars = MapRawKey(&ievent, charBuffer, sizeof(charBuffer) - 1, keymap);
+                    if (chars > 0 && chars < (WORD)(sizeof(charBuffer) - 1)) {
+                        /* Successfully converted - insert characters */
+                        charBuffer[chars] = '\0';
+                        /* Insert each character from the conversion */
+                        if (session->buffer->caretCount > 0) {
+                            /* Multiple carets - keep the text characters, insert them at every caret at once */
+                            ULONG i = 0;
+                            ULONG kept = 0;
+                            for (i = 0; i < (ULONG)chars; i++) {
+                                if ((charBuffer[i] >= 0x20 && charBuffer[i] < 0x7F) || charBuffer[i] >= 0xA0 || charBuffer[i] == 0x09) {
+                                    charBuffer[kept++] = charBuffer[i];
+                                    RecordMacroChar(app, charBuffer[i]);
+                                } else if (charBuffer[i] == 0x0A || charBuffer[i] == 0x0D) {
+                                    charBuffer[kept++] = '\n';
+                                    RecordMacroChar(app, '\n');
+                                }
                             }
-                        }
-                        ScrollToCursor(session->buffer, session->window);
-                        UpdateScrollBars(session);
-                        RenderText(session->window, session->buffer);
-                        UpdateCursor(session->window, session->buffer);
-                        processed = TRUE;
-                    } else if (keyCode == 0x4C) {
-                        /* Up arrow */
-                        if (session->buffer && session->buffer->lines && session->buffer->cursorY > 0) {
-                            session->buffer->cursorY--;
-                            if (session->buffer->cursorY < session->buffer->lineCount && session->buffer->cursorX > session->buffer->lines[session->buffer->cursorY].length) {
-                                session->buffer->cursorX = session->buffer->lines[session->buffer->cursorY].length;
+                            if (kept > 0) {
+                                CaretInsertText(session->buffer, (STRPTR)charBuffer, kept, session->cleanupStack);
                             }
-                        }
-                        ScrollToCursor(session->buffer, session->window);
-                        UpdateScrollBars(session);
-                        RenderText(session->window, session->buffer);
-                        UpdateCursor(session->window, session->buffer);
-                        processed = TRUE;
-                    } else if (keyCode == 0x4D) {
-                        /* Down arrow */
-                        if (session->buffer && session->buffer->lines && session->buffer->cursorY < session->buffer->lineCount - 1) {
-                            session->buffer->cursorY++;
-                            if (session->buffer->cursorY < session->buffer->lineCount && session->buffer->cursorX > session->buffer->lines[session->buffer->cursorY].length) {
-                                session->buffer->cursorX = session->buffer->lines[session->buffer->cursorY].length;
+                        } else {
+                            ULONG i = 0;
+                            for (i = 0; i < (ULONG)chars; i++) {
+                                if ((charBuffer[i] >= 0x20 && charBuffer[i] < 0x7F) || charBuffer[i] >= 0xA0 || charBuffer[i] == 0x09) {
+                                    /* Printable character (or Tab, which has no binding of its own) */
+                                    InsertChar(session->buffer, charBuffer[i], session->cleanupStack);
+                                    RecordMacroChar(app, charBuffer[i]);
+                                } else if (charBuffer[i] == 0x0A || charBuffer[i] == 0x0D) {
+                                    /* Newline */
+                                    InsertNewline(session->buffer, session->cleanupStack);
+                                    RecordMacroChar(app, '\n');
+                                }
                             }
                         }
+                        CalculateMaxScroll(session->buffer, session->window);
                         ScrollToCursor(session->buffer, session->window);
                         UpdateScrollBars(session);
                         RenderText(session->window, session->buffer);
                         UpdateCursor(session->window, session->buffer);
                         processed = TRUE;
-                    } else if (keyCode == 0x46) {
-                        /* Delete key (raw key code) */
-                        DeleteForward(session->buffer, session->cleanupStack);
-                        ScrollToCursor(session->buffer, session->window);
-                        UpdateScrollBars(session);
-                        RenderText(session->window, session->buffer);
-                        UpdateCursor(session->window, session->buffer);
-                        processed = TRUE;
-                    } else {
-                        /* Convert raw key to character using keymap */
-                        /* Get default keymap for conversion */
-                        if (KeymapBase) {
-                            keymap = AskKeyMapDefault();
-                        }
-                        
-                        if (keymap) {
-                            /* MapRawKey requires an InputEvent structure */
-                            /* Follow the API doc example from keymap.doc */
-                            ievent.ie_Class = IECLASS_RAWKEY;
-                            ievent.ie_SubClass = 0;
-                            ievent.ie_Code = keyCode;
-                            ievent.ie_Qualifier = qualifiers & ~(IEQUALIFIER_CAPSLOCK | IEQUALIFIER_RELATIVEMOUSE);
-                            /* Recover dead key codes & qualifiers from IAddress */
-                            /* As per API doc: ie.ie_EventAddress = (APTR *) *((ULONG *)im->IAddress); */
-                            if (imsg->IAddress) {
-                                ievent.ie_EventAddress = (APTR) *((ULONG *)imsg->IAddress);
-                            } else {
-                                ievent.ie_EventAddress = NULL;
-                            }
-                            
-                            /* Use MapRawKey from keymap.library */
-                            /* MapRawKey returns WORD: number of characters, or -1 for buffer overflow */
-                            chars = MapRawKey(&ievent, charBuffer, sizeof(charBuffer) - 1, keymap);
-                            if (chars > 0 && chars < (WORD)(sizeof(charBuffer) - 1)) {
-                                /* Successfully converted - insert characters */
-                                charBuffer[chars] = '\0';
-                                /* Insert each character from the conversion */
-                                {
-                                    ULONG i = 0;
-                                    for (i = 0; i < (ULONG)chars; i++) {
-                                        if (charBuffer[i] >= 0x20 && charBuffer[i] < 0x7F) {
-                                            /* Printable ASCII character */
-                                            InsertChar(session->buffer, charBuffer[i], session->cleanupStack);
-                                        } else if (charBuffer[i] == 0x0A || charBuffer[i] == 0x0D) {
-                                            /* Newline */
-                                            InsertNewline(session->buffer, session->cleanupStack);
-                                        }
-                                    }
-                                }
-                                CalculateMaxScroll(session->buffer, session->window);
-                                ScrollToCursor(session->buffer, session->window);
-                                UpdateScrollBars(session);
-                                RenderText(session->window, session->buffer);
-                                UpdateCursor(session->window, session->buffer);
-                                processed = TRUE;
-                            }
-                            /* If chars == -1, buffer overflow occurred - ignore this key */
-                            /* If chars == 0, no characters generated - ignore this key */
-                        }
                     }
+                    /* If chars == -1, buffer overflow occurred - ignore this key */
+                    /* If chars == 0, no characters generated - ignore this key */
                 }
                 
                 if (processed) {
-                    session->docState.modified = session->buffer->modified;
+                    session->docState.modified = session->buffer->doc->modified;
                 }
             }
             result = TRUE;
@@ -2285,8 +2640,7 @@ BOOL TTX_HandleIntuitionMessage(struct TTXApplication *app, struct IntuiMessage
                 case IDCMP_REFRESHWINDOW:
             if (session->buffer) {
                 BeginRefresh(session->window);
-                RenderText(session->window, session->buffer);
-                UpdateCursor(session->window, session->buffer);
+                TTX_RenderViews(session);
                 EndRefresh(session->window, TRUE);
             }
             result = TRUE;
@@ -2318,11 +2672,10 @@ BOOL TTX_HandleIntuitionMessage(struct TTXApplication *app, struct IntuiMessage
                     }
                     /* Recalculate max scroll values and update scroll bars */
                     if (session->buffer) {
+                        TTX_LayoutViews(session);  /* Split panes share the new height */
                         CalculateMaxScroll(session->buffer, session->window);
                         ScrollToCursor(session->buffer, session->window);  /* ScrollToCursor may change scroll position */
-                        UpdateScrollBars(session);  /* Update scroll bars after scroll position may have changed */
-                        RenderText(session->window, session->buffer);
-                        UpdateCursor(session->window, session->buffer);
+                        TTX_RenderViews(session);  /* Updates scroll bars after scroll position may have changed */
                     }
                     result = TRUE;
                     break;
@@ -2346,6 +2699,8 @@ BOOL TTX_HandleIntuitionMessage(struct TTXApplication *app, struct IntuiMessage
                                 if (session->buffer->scrollYShift > 0) {
                                     newScrollY <<= session->buffer->scrollYShift;
                                 }
+                                /* The scroller counts rows - hidden folds take none, wrapped lines several */
+                                newScrollY = ViewRowToLine(session->buffer, newScrollY);
                                 /* Clamp to valid range */
                                 if (newScrollY > session->buffer->maxScrollY) {
                                     newScrollY = session->buffer->maxScrollY;
@@ -2406,21 +2761,11 @@ BOOL TTX_HandleIntuitionMessage(struct TTXApplication *app, struct IntuiMessage
     return result;
 }
 
-/* Main event loop */
-VOID TTX_EventLoop(struct TTXApplication *app)
+/* Build the signal mask the event loop waits on */
+VOID TTX_BuildSignalMask(struct TTXApplication *app)
 {
-    struct Message *msg = NULL;
-    struct IntuiMessage *imsg = NULL;
-    ULONG signals = 0;
     struct Session *session = NULL;
-    struct Session *nextSession = NULL;
-    struct TTXMessage *ttxMsg = NULL;
-    
-    if (!app) {
-        return;
-    }
     
-    /* Build signal mask */
     app->sigmask = (1UL << app->appPort->mp_SigBit);
     if (app->brokerPort) {
         app->sigmask |= (1UL << app->brokerPort->mp_SigBit);
@@ -2428,44 +2773,49 @@ VOID TTX_EventLoop(struct TTXApplication *app)
     if (app->appIconPort) {
         app->sigmask |= (1UL << app->appIconPort->mp_SigBit);
     }
-    if (app->sessions) {
-        session = app->sessions;
-        while (session) {
-            if (session->window) {
-                app->sigmask |= (1UL << session->window->UserPort->mp_SigBit);
-            }
-            session = session->next;
+    app->sigmask |= TTX_RexxSignal(app);
+    for (session = app->sessions; session; session = session->next) {
+        if (session->window) {
+            app->sigmask |= (1UL << session->window->UserPort->mp_SigBit);
         }
     }
+    app->sigmask |= TTX_IdleSignal(app);
     app->sigmask |= SIGBREAKF_CTRL_C;
+}
+
+/* Main event loop */
+VOID TTX_EventLoop(struct TTXApplication *app)
+{
+    struct Message *msg = NULL;
+    struct IntuiMessage *imsg = NULL;
+    ULONG signals = 0;
+    struct Session *session = NULL;
+    struct Session *nextSession = NULL;
+    struct TTXMessage *ttxMsg = NULL;
     
-    app->running = TRUE;
+    if (!app) {
+        return;
+    }
     
+    app->running = TRUE;
+    TTX_StartupPhase(app, "ready");
+
+    /* Queued files and the deferred commodity only run from the idle timer - start it now
+     * rather than on the first input (with no window open there may never be any) */
+    if (app->openQueue || !app->commodityTried) {
+        TTX_ScheduleIdle(app);
+    }
+
     while (app->running) {
         /* Process deferred iconification first */
         if (app->iconifyDeferred) {
             app->iconifyDeferred = FALSE;
             TTX_DoIconify(app, app->iconifyState);
-            /* Rebuild signal mask after iconification (windows may have changed) */
-            app->sigmask = (1UL << app->appPort->mp_SigBit);
-            if (app->brokerPort) {
-                app->sigmask |= (1UL << app->brokerPort->mp_SigBit);
-            }
-            if (app->appIconPort) {
-                app->sigmask |= (1UL << app->appIconPort->mp_SigBit);
-            }
-            if (app->sessions) {
-                session = app->sessions;
-                while (session) {
-                    if (session->window) {
-                        app->sigmask |= (1UL << session->window->UserPort->mp_SigBit);
-                    }
-                    session = session->next;
-                }
-            }
-            app->sigmask |= SIGBREAKF_CTRL_C;
         }
         
+        /* Rebuild signal mask every round - sessions open and close at any time */
+        TTX_BuildSignalMask(app);
+        
         Printf("[EVENT] Waiting for signals (mask=0x%08lx)\n", app->sigmask);
         signals = Wait(app->sigmask);
         Printf("[EVENT] Wait returned: signals=0x%08lx\n", signals);
@@ -2477,6 +2827,11 @@ VOID TTX_EventLoop(struct TTXApplication *app)
             break;
         }
         
+        /* Idle timer fired - run background jobs (they yield to pending input) */
+        if (signals & TTX_IdleSignal(app)) {
+            TTX_RunIdleJobs(app);
+        }
+        
         /* Check broker port (commodity messages from Exchange) */
         if (app->brokerPort && (signals & (1UL << app->brokerPort->mp_SigBit))) {
             while ((msg = GetMsg(app->brokerPort)) != NULL) {
@@ -2502,6 +2857,9 @@ VOID TTX_EventLoop(struct TTXApplication *app)
                     case TTX_MSG_OPEN_NEW:
                         TTX_CreateSession(app, NULL);
                         break;
+                    case TTX_MSG_OPEN_BATCH:
+                        TTX_OpenFiles(app, ttxMsg->fileNames, ttxMsg->fileCount);
+                        break;
                     case TTX_MSG_QUIT:
                         app->running = FALSE;
                         break;
@@ -2521,6 +2879,11 @@ VOID TTX_EventLoop(struct TTXApplication *app)
             }
         }
         
+        /* Check ARexx host port (commands from scripts) */
+        if (signals & TTX_RexxSignal(app)) {
+            TTX_HandleRexxMessages(app);
+        }
+        
         /* Check session windows */
         if (app->sessions) {
             session = app->sessions;
@@ -2545,14 +2908,95 @@ VOID TTX_EventLoop(struct TTXApplication *app)
         } else {
             Printf("[EVENT] No sessions to check\n");
         }
-        
-        /* Exit if no sessions left (unless in background mode) */
-        if (app->sessionCount == 0 && !app->backgroundMode) {
+
+        /* Repaint other views of documents edited in this round */
+        TTX_RefreshDocumentViews(app);
+
+        /* Input arrived - background jobs wait until it has been quiet for a while */
+        if (signals & ~TTX_IdleSignal(app)) {
+            TTX_ScheduleIdle(app);
+        }
+
+        /* Last window closed while dormant documents remain - bring up the first of them */
+        if (!app->iconified) {
+            struct Session *dormantSession = NULL;
+            BOOL anyWindow = FALSE;
+            
+            for (session = app->sessions; session; session = session->next) {
+                if (session->window) {
+                    anyWindow = TRUE;
+                } else if (session->dormant && !dormantSession) {
+                    dormantSession = session;
+                }
+            }
+            if (!anyWindow && dormantSession && !TTX_ActivateSession(app, dormantSession)) {
+                TTX_DestroySession(app, dormantSession);
+            }
+        }
+
+        /* Exit if no sessions left (unless in background mode or files are still queued) */
+        if (app->sessionCount == 0 && !app->backgroundMode && !app->openQueue) {
             app->running = FALSE;
         }
     }
 }
 
+/* Milliseconds from one E-Clock reading to a later one - the full 64-bit difference, divided
+ * a bit at a time as there is no 64-bit arithmetic to hand */
+static ULONG EClockMillis(struct EClockVal *from, struct EClockVal *to, ULONG ticksPerMilli)
+{
+    ULONG hi = to->ev_hi - from->ev_hi - ((to->ev_lo < from->ev_lo) ? 1 : 0);
+    ULONG lo = to->ev_lo - from->ev_lo;
+    ULONG remainder = hi;
+    ULONG quotient = 0;
+    ULONG carry = 0;
+    LONG bit = 0;
+    
+    if (hi >= ticksPerMilli) {
+        return 0xFFFFFFFFUL;  /* More than fits in the result */
+    }
+    for (bit = 31; bit >= 0; bit--) {
+        carry = remainder >> 31;
+        remainder = (remainder << 1) | ((lo >> bit) & 1);
+        if (carry || remainder >= ticksPerMilli) {
+            remainder -= ticksPerMilli;
+            quotient |= 1UL << bit;
+        }
+    }
+    return quotient;
+}
+
+/* Report the time spent in a startup phase - NULL starts the clock, "ready" ends the report */
+VOID TTX_StartupPhase(struct TTXApplication *app, STRPTR phase)
+{
+    struct EClockVal now;
+    ULONG ticksPerMilli = 0;
+    
+    if (!app || !TimerBase || app->startupTimed) {
+        return;
+    }
+    
+    if (!phase) {
+        app->eclockRate = ReadEClock(&app->startClock);
+        app->phaseClock = app->startClock;
+        return;
+    }
+    if (app->eclockRate < 1000) {
+        return;
+    }
+    
+    ReadEClock(&now);
+    ticksPerMilli = app->eclockRate / 1000;
+    Printf("[TIME] %s: %lu ms (total %lu ms)\n", phase,
+           EClockMillis(&app->phaseClock, &now, ticksPerMilli),
+           EClockMillis(&app->startClock, &now, ticksPerMilli));
+    app->phaseClock = now;
+    
+    if (Stricmp(phase, "ready") == 0) {
+        app->startupTimed = TRUE;
+    }
+}
+
 /* Initialize application */
 BOOL TTX_Init(struct TTXApplication *app)
 {
@@ -2578,24 +3022,34 @@ BOOL TTX_Init(struct TTXApplication *app)
     g_ttxStack = app->cleanupStack;
     Printf("[INIT] TTX_Init: using default cleanup stack\n");
     
+    /* Setup idle timer for background jobs - first, as it also clocks the startup phases */
+    if (!TTX_SetupIdleTimer(app)) {
+        /* Background jobs just never run without it */
+    }
+    TTX_StartupPhase(app, NULL);
+    
     /* Initialize libraries */
     if (!TTX_InitLibraries(app->cleanupStack)) {
         /* Don't delete default stack - it will be cleaned up by _STD_SeisoCleanup() */
+        TTX_RemoveIdleTimer(app);
         app->cleanupStack = NULL;
         g_ttxStack = NULL;
         return FALSE;
     }
+    TTX_StartupPhase(app, "libraries");
     
     /* Setup message port */
     if (!TTX_SetupMessagePort(app)) {
         /* Don't delete default stack - it will be cleaned up by _STD_SeisoCleanup() */
+        TTX_RemoveIdleTimer(app);
         app->cleanupStack = NULL;
         g_ttxStack = NULL;
         return FALSE;
     }
     
-    /* Setup commodity if available */
-    if (CxBase) {
+    /* Setup commodity - deferred to the first idle moment when there is an idle timer */
+    if (!TTX_IdleSignal(app)) {
+        app->commodityTried = TRUE;
         if (!TTX_SetupCommodity(app)) {
             /* Commodity setup failed, but continue anyway */
             /* The app can still work without commodities */
@@ -2603,13 +3057,12 @@ BOOL TTX_Init(struct TTXApplication *app)
     }
     
     /* Setup app icon support (for iconification) */
-    if (WorkbenchBase && IconBase) {
-        if (!TTX_SetupAppIcon(app)) {
-            /* App icon setup failed, but continue anyway */
-            /* The app can still work without iconification */
-        }
+    if (!TTX_SetupAppIcon(app)) {
+        /* App icon setup failed, but continue anyway */
+        /* The app can still work without iconification */
     }
     
+    TTX_StartupPhase(app, "init");
     Printf("[INIT] TTX_Init: SUCCESS\n");
     return TRUE;
 }
@@ -2628,16 +3081,39 @@ VOID TTX_Cleanup(struct TTXApplication *app)
     /* Remove app icon before destroying sessions */
     TTX_RemoveAppIcon(app);
     
+    /* Stop background jobs before their documents go away */
+    TTX_RemoveIdleTimer(app);
+    TTX_FreeOpenQueue(app);
+    
     /* Destroy all sessions */
     Printf("[CLEANUP] TTX_Cleanup: destroying %lu sessions\n", app->sessionCount);
     while (app->sessions) {
         TTX_DestroySession(app, app->sessions);
     }
     
+    /* Free syntax highlighting rules */
+    SetSyntaxRules(NULL);
+    
+    /* Free the key bindings and the definitions they point into (the menu strips are gone with their windows) */
+    TTX_FreeKeyMap(app);
+    SetDefinitions(NULL);
+    
+    /* Free the keyboard macros */
+    FreeMacro(app->recording);
+    app->recording = NULL;
+    FreeMacro(app->macro);
+    app->macro = NULL;
+    
+    /* Free the clip ring */
+    FreeClipRing(app);
+    
     /* Clean up any pending messages from app port before stack cleanup */
     /* Note: The port itself is tracked on cleanup stack and will be cleaned up automatically */
     /* According to Exec message docs: ALL messages received via GetMsg() must be replied to with ReplyMsg() */
     /* The sender is responsible for freeing the message after receiving the reply */
+    /* Turn away ARexx commands that arrived too late to run */
+    TTX_CleanupRexxPort(app);
+    
     if (app->appPort) {
         Printf("[CLEANUP] TTX_Cleanup: cleaning pending messages from appPort\n");
         while ((msg = GetMsg(app->appPort)) != NULL) {
@@ -2712,27 +3188,40 @@ VOID TTX_Cleanup(struct TTXApplication *app)
 /* Calculate maximum scroll values based on buffer content and window size */
 VOID CalculateMaxScroll(struct TextBuffer *buffer, struct Window *window)
 {
-    ULONG i = 0;
     ULONG maxLineLen = 0;
     ULONG lineHeight = 0;
     ULONG visibleLines = 0;
+    ULONG rowCount = 0;
     
     if (!buffer || !window || !window->RPort) {
         return;
     }
     
-    /* Calculate visible lines (pageH) */
+    if (InEditBatch()) {
+        /* Longest line would be rescanned after every edit - done once the edit batch ends */
+        return;
+    }
+    
+    /* A wrapped view lays its lines out for the pane's width first */
+    ReflowView(buffer, window);
+    
+    /* Calculate visible lines (pageH) - the view's pane in a split window */
     lineHeight = GetLineHeight(window->RPort);
     if (lineHeight > 0) {
-        visibleLines = (window->Height - window->BorderTop - window->BorderBottom) / lineHeight;
+        ULONG viewTop = 0;
+        ULONG viewBottom = 0;
+        GetViewBounds(buffer, window, &viewTop, &viewBottom);
+        visibleLines = (viewBottom - viewTop) / lineHeight;
         buffer->pageH = visibleLines;
     } else {
         buffer->pageH = 0;
     }
     
-    /* Calculate maximum vertical scroll (maxScrollY) */
-    if (buffer->lineCount > buffer->pageH) {
-        buffer->maxScrollY = buffer->lineCount - buffer->pageH;
+    /* Calculate maximum vertical scroll (maxScrollY) - the first line starting a page above the last row */
+    /* Hidden folds take no rows and wrapped lines several, so this is counted in rows */
+    rowCount = GetViewRowCount(buffer);
+    if (rowCount > buffer->pageH) {
+        buffer->maxScrollY = ViewLineAfterRows(buffer, 0, rowCount - buffer->pageH);
     } else {
         buffer->maxScrollY = 0;
     }
@@ -2768,15 +3257,9 @@ VOID CalculateMaxScroll(struct TextBuffer *buffer, struct Window *window)
         }
     }
     
-    /* Calculate maximum line length for horizontal scrolling */
-    maxLineLen = 0;
-    if (buffer->lines && buffer->lineCount > 0) {
-        for (i = 0; i < buffer->lineCount; i++) {
-            if (buffer->lines[i].length > maxLineLen) {
-                maxLineLen = buffer->lines[i].length;
-            }
-        }
-    }
+    /* Calculate maximum line length for horizontal scrolling (cached in the document) */
+    /* A wrapped view never scrolls sideways */
+    maxLineLen = buffer->wrap ? 0 : GetDocumentMaxLineLength(buffer->doc);
     
     /* Calculate maximum horizontal scroll (maxScrollX) */
     if (maxLineLen > buffer->pageW) {
@@ -2812,13 +3295,19 @@ VOID UpdateScrollBars(struct Session *session)
         return;
     }
     
+    if (InEditBatch()) {
+        /* Updated once the edit batch ends */
+        return;
+    }
+    
     /* Update vertical scroll bar */
     gadget = session->vertPropGadget;
     if (gadget) {
-        /* For scroller: total = total lines, visible = visible lines, top = scroll position */
-        total = session->buffer->lineCount;
+        /* For scroller: total = total rows, visible = visible lines, top = row of the scroll position */
+        /* (a row is a line, unless folds are hidden or lines wrapped) */
+        total = GetViewRowCount(session->buffer);
         visible = session->buffer->pageH;
-        top = session->buffer->scrollY;
+        top = ViewLineToRow(session->buffer, session->buffer->scrollY);
         
         /* Scale down if total exceeds propgclass limit (0xFFFF) */
         scaledTotal = total;
@@ -2866,17 +3355,9 @@ VOID UpdateScrollBars(struct Session *session)
     /* Update horizontal scroll bar */
     gadget = session->horizPropGadget;
     if (gadget) {
-        /* Calculate maximum line length for horizontal scrolling */
-        ULONG maxLineLen = 0;
-        ULONG i = 0;
-        
-        if (session->buffer->lines && session->buffer->lineCount > 0) {
-            for (i = 0; i < session->buffer->lineCount; i++) {
-                if (session->buffer->lines[i].length > maxLineLen) {
-                    maxLineLen = session->buffer->lines[i].length;
-                }
-            }
-        }
+        /* Calculate maximum line length for horizontal scrolling (cached in the document) */
+        /* A wrapped view shows every line whole - nothing to scroll to */
+        ULONG maxLineLen = session->buffer->wrap ? 0 : GetDocumentMaxLineLength(session->buffer->doc);
         
         /* For scroller: total = max line length, visible = visible characters, top = scroll position */
         total = maxLineLen;
@@ -2927,6 +3408,187 @@ VOID UpdateScrollBars(struct Session *session)
     }
 }
 
+/* ============================================================================
+ * Split Views
+ * ============================================================================ */
+
+/* Height in pixels of the bar drawn between the panes of a split window */
+#define SPLIT_DIVIDER_HEIGHT 2
+
+/* Split the session's window into two panes showing the same document */
+/* The new pane only holds view state - lines, glyph widths and layout are shared */
+BOOL TTX_SplitSession(struct TTXApplication *app, struct Session *session)
+{
+    struct TextBuffer *view = NULL;
+    ULONG lineHeight = 0;
+    ULONG textHeight = 0;
+    
+    if (!app || !session || !session->buffer || !session->buffer->doc) {
+        return FALSE;
+    }
+    if (session->otherView) {
+        return TRUE;  /* Already split */
+    }
+    
+    /* Both panes must be able to show at least one line */
+    if (session->window && session->window != INVALID_RESOURCE) {
+        lineHeight = GetLineHeight(session->window->RPort);
+        textHeight = session->window->Height - session->window->BorderTop - session->window->BorderBottom;
+        if (textHeight < 2 * lineHeight + SPLIT_DIVIDER_HEIGHT) {
+            Printf("[CMD] TTX_SplitSession: FAIL (window too small)\n");
+            return FALSE;
+        }
+    }
+    
+    view = (struct TextBuffer *)allocVec(sizeof(struct TextBuffer), MEMF_CLEAR);
+    if (!view) {
+        Printf("[CMD] TTX_SplitSession: FAIL (allocVec view failed)\n");
+        return FALSE;
+    }
+    
+    /* New pane starts at the same place as the current one */
+    view->cursorX = session->buffer->cursorX;
+    view->cursorY = session->buffer->cursorY;
+    view->scrollX = session->buffer->scrollX;
+    view->scrollY = session->buffer->scrollY;
+    view->leftMargin = session->buffer->leftMargin;
+    view->marking.enabled = FALSE;
+    view->superBitMap = NULL;
+    view->viewTop = session->buffer->viewTop;
+    AttachDocument(view, session->buffer->doc);
+    if (session->buffer->wrap) {
+        SetWrap(view, (session->window != INVALID_RESOURCE) ? session->window : NULL, TRUE);
+    }
+    
+    session->otherView = view;
+    TTX_LayoutViews(session);
+    Printf("[CMD] TTX_SplitSession: SUCCESS (view=%lx, doc=%lx)\n", (ULONG)view, (ULONG)view->doc);
+    return TRUE;
+}
+
+/* Close the inactive pane and give the whole window back to the active one */
+VOID TTX_UnsplitSession(struct TTXApplication *app, struct Session *session)
+{
+    if (!app || !session || !session->otherView) {
+        return;
+    }
+    
+    FreeTextBuffer(session->otherView, app->cleanupStack);
+    freeVec(session->otherView);
+    session->otherView = NULL;
+    TTX_LayoutViews(session);
+    Printf("[CMD] TTX_UnsplitSession: SUCCESS\n");
+}
+
+/* Divide the window's text area between the panes (upper pane gets the upper half) */
+VOID TTX_LayoutViews(struct Session *session)
+{
+    struct TextBuffer *upper = NULL;
+    struct TextBuffer *lower = NULL;
+    ULONG lineHeight = 0;
+    ULONG textHeight = 0;
+    ULONG upperHeight = 0;
+    
+    if (!session || !session->buffer) {
+        return;
+    }
+    
+    if (!session->otherView) {
+        session->buffer->viewTop = 0;
+        session->buffer->viewHeight = 0;
+        session->buffer->needsFullRedraw = TRUE;
+        return;
+    }
+    
+    /* Panes keep their order - the active pane is on top after a fresh split */
+    if (session->buffer->viewTop <= session->otherView->viewTop) {
+        upper = session->buffer;
+        lower = session->otherView;
+    } else {
+        upper = session->otherView;
+        lower = session->buffer;
+    }
+    
+    if (!session->window || session->window == INVALID_RESOURCE) {
+        return;  /* Laid out again when the window reopens */
+    }
+    
+    lineHeight = GetLineHeight(session->window->RPort);
+    textHeight = session->window->Height - session->window->BorderTop - session->window->BorderBottom;
+    
+    /* Upper pane holds a whole number of lines */
+    if (textHeight > SPLIT_DIVIDER_HEIGHT) {
+        upperHeight = (textHeight - SPLIT_DIVIDER_HEIGHT) / 2;
+    }
+    if (lineHeight > 0) {
+        upperHeight = (upperHeight / lineHeight) * lineHeight;
+        if (upperHeight < lineHeight) {
+            upperHeight = lineHeight;
+        }
+    }
+    
+    upper->viewTop = 0;
+    upper->viewHeight = upperHeight;
+    lower->viewTop = upperHeight + SPLIT_DIVIDER_HEIGHT;
+    lower->viewHeight = 0;
+    upper->needsFullRedraw = TRUE;
+    lower->needsFullRedraw = TRUE;
+}
+
+/* Recalculate and redraw every pane of the session's window, cursor in the active one */
+VOID TTX_RenderViews(struct Session *session)
+{
+    struct Window *window = NULL;
+    struct RastPort *rp = NULL;
+    
+    if (!session || !session->buffer || !session->window || session->window == INVALID_RESOURCE) {
+        return;
+    }
+    window = session->window;
+    rp = window->RPort;
+    
+    if (session->otherView) {
+        ULONG upperHeight = 0;
+        ULONG dividerY = 0;
+        
+        CalculateMaxScroll(session->otherView, window);
+        RenderText(window, session->otherView);
+        
+        /* Divider sits below the upper pane */
+        upperHeight = (session->buffer->viewTop < session->otherView->viewTop) ?
+                      session->buffer->viewHeight : session->otherView->viewHeight;
+        dividerY = window->BorderTop + upperHeight;
+        if (dividerY + SPLIT_DIVIDER_HEIGHT <= (ULONG)(window->Height - window->BorderBottom)) {
+            SetAPen(rp, 1);
+            SetDrMd(rp, JAM1);
+            RectFill(rp, window->BorderLeft, dividerY,
+                     window->Width - window->BorderRight - 1, dividerY + SPLIT_DIVIDER_HEIGHT - 1);
+        }
+    }
+    
+    CalculateMaxScroll(session->buffer, window);
+    UpdateScrollBars(session);
+    RenderText(window, session->buffer);
+    UpdateCursor(window, session->buffer);
+}
+
+/* Find the pane under a window Y coordinate (the active pane if not split) */
+struct TextBuffer *TTX_ViewAtPoint(struct Session *session, LONG mouseY)
+{
+    ULONG top = 0;
+    ULONG bottom = 0;
+    
+    if (!session || !session->otherView || !session->window || mouseY < 0) {
+        return session ? session->buffer : NULL;
+    }
+    
+    GetViewBounds(session->otherView, session->window, &top, &bottom);
+    if ((ULONG)mouseY >= top && (ULONG)mouseY < bottom) {
+        return session->otherView;
+    }
+    return session->buffer;
+}
+
 /* Show usage information */
 VOID TTX_ShowUsage(VOID)
 {
@@ -3057,6 +3719,8 @@ int main(int argc, char *argv[])
         }
     }
     
+    TTX_StartupPhase(&app, "arguments");
+    
     /* Handle UNLOAD first */
     if (parseResult && ttxArgs.unload) {
         /* TODO: Implement unload from background */
@@ -3091,7 +3755,7 @@ int main(int argc, char *argv[])
     if (parseResult) {
         if (ttxArgs.files && ttxArgs.files[0]) {
             /* We have files - check for existing instance */
-            if (TTX_CheckExistingInstance(ttxArgs.files[0])) {
+            if (TTX_CheckExistingInstance(ttxArgs.files)) {
                 /* Message sent to existing instance, exit */
                 if (rda && app.cleanupStack) {
                     freeArgs(rda);
@@ -3124,18 +3788,30 @@ int main(int argc, char *argv[])
         Printf("[INIT] main: WARN (TTX_AddMessagePort failed, continuing anyway)\n");
     }
     
+    /* ARexx host port - TTX works without it if the name is taken */
+    TTX_SetupRexxPort(&app);
+    TTX_StartupPhase(&app, "instance check");
+    
+    /* Restore documents with unsaved changes from a crashed run */
+    TTX_RecoverJournals(&app);
+    TTX_StartupPhase(&app, "recovery");
+    
     /* Create sessions for files (only if BACKGROUND not set) */
-    if (parseResult && ttxArgs.files) {
-        files = ttxArgs.files;
+    /* The first file opens now; the rest become dormant sessions once the event loop runs */
+    if (parseResult && ttxArgs.files && ttxArgs.files[0]) {
+        if (!TTX_CreateSession(&app, ttxArgs.files[0])) {
+            LONG errorCode = IoErr();
+            if (errorCode != 0) {
+                PrintFault(errorCode, "TTX");
+                /* Clear error code after displaying */
+                SetIoErr(0);
+            }
+            result = RETURN_FAIL;
+        }
+        files = &ttxArgs.files[1];
         while (*files) {
-            if (!TTX_CreateSession(&app, *files)) {
-                LONG errorCode = IoErr();
-                if (errorCode != 0) {
-                    PrintFault(errorCode, "TTX");
-                    /* Clear error code after displaying */
-                    SetIoErr(0);
-                }
-                result = RETURN_FAIL;
+            if (!TTX_IdleSignal(&app) || !TTX_QueueOpenFile(&app, *files)) {
+                TTX_CreateDormantSession(&app, *files);
             }
             files++;
         }
@@ -3154,6 +3830,8 @@ int main(int argc, char *argv[])
         }
     }
     
+    TTX_StartupPhase(&app, "sessions");
+    
     /* Free parsed arguments */
     if (rda && app.cleanupStack) {
         freeArgs(rda);
@@ -3161,7 +3839,7 @@ int main(int argc, char *argv[])
     }
     
     /* Run event loop if we have sessions */
-    if (app.sessionCount > 0) {
+    if (app.sessionCount > 0 || app.openQueue) {
         TTX_EventLoop(&app);
     }
     
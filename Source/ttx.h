@@ -12,6 +12,7 @@
 #include <exec/execbase.h>
 #include <exec/ports.h>
 #include <dos/dos.h>
+#include <dos/dosextens.h>
 #include <intuition/intuition.h>
 #include <intuition/intuitionbase.h>
 #include <intuition/gadgetclass.h>
@@ -30,8 +31,12 @@
 #include <libraries/gadtools.h>
 #include <libraries/asl.h>
 #include <devices/inputevent.h>
+#include <devices/timer.h>
+#include <devices/clipboard.h>
 #include <devices/keymap.h>
 #include <libraries/keymap.h>
+#include <rexx/storage.h>
+#include <rexx/errors.h>
 #include <proto/exec.h>
 #include <proto/dos.h>
 #include <proto/intuition.h>
@@ -45,6 +50,7 @@
 #include <proto/asl.h>
 #include <proto/commodities.h>
 #include <proto/keymap.h>
+#include <proto/timer.h>
 #include <proto/gadtools.h>
 #include "seiso.h"
 
@@ -61,14 +67,29 @@ extern struct Library *WorkbenchBase;
 extern struct Library *CxBase;
 extern struct Library *KeymapBase;
 extern struct Library *AslBase;
+extern struct Device *TimerBase;
+
+/* Optional libraries opened on first use (TTX_NeedLibrary) */
+#define TTX_LIB_ASL 0
+#define TTX_LIB_COMMODITIES 1
+#define TTX_LIB_ICON 2
+#define TTX_LIB_WORKBENCH 3
+#define TTX_LIB_REXXSYS 4
+#define TTX_LIB_COUNT 5
 
 /* Message port name for single-instance communication */
 #define TTX_MESSAGE_PORT_NAME "TTX.1"
 
+/* ARexx host port name (ADDRESS TTX) */
+#define TTX_REXX_PORT_NAME "TTX"
+/* Default byte budget of the ARexx macro cache (SetARexxCache) */
+#define TTX_REXX_CACHE_DEFAULT 16384
+
 /* Message types for inter-instance communication */
 #define TTX_MSG_OPEN_FILE 1
 #define TTX_MSG_OPEN_NEW   2
 #define TTX_MSG_QUIT       3
+#define TTX_MSG_OPEN_BATCH 4   /* fileNames/fileCount - first file opens at once, the rest are queued */
 
 /* Message structure for inter-instance communication */
 struct TTXMessage {
@@ -76,6 +97,14 @@ struct TTXMessage {
     ULONG type;
     STRPTR fileName;
     ULONG fileNameLen;
+    STRPTR *fileNames;      /* TTX_MSG_OPEN_BATCH: NULL-terminated vector of full paths */
+    ULONG fileCount;
+};
+
+/* File waiting to be opened by the idle scheduler */
+struct PendingOpen {
+    struct PendingOpen *next;
+    STRPTR fileName;        /* Stored right after the node */
 };
 
 /* Text buffer structures */
@@ -86,6 +115,121 @@ struct TextLine {
     STRPTR text;
     ULONG length;
     ULONG allocated;
+    UBYTE lexState;    /* Syntax lexer state at the end of the line */
+    UBYTE lexFlags;    /* LEX_FLAG_* - whether lexState can be trusted */
+};
+
+/* TextLine lexFlags */
+#define LEX_FLAG_KNOWN 0x01   /* lexState has been computed */
+#define LEX_FLAG_DIRTY 0x02   /* Line or the state it starts in changed since */
+
+/* Syntax lexer states carried from one line to the next */
+#define LEX_STATE_NORMAL  0
+#define LEX_STATE_COMMENT 1   /* Inside a block comment */
+
+/* Syntax token classes (index into SyntaxRules pens) */
+#define SYNTAX_TOKEN_TEXT    0
+#define SYNTAX_TOKEN_KEYWORD 1
+#define SYNTAX_TOKEN_COMMENT 2
+#define SYNTAX_TOKEN_STRING  3
+#define SYNTAX_TOKEN_NUMBER  4
+#define SYNTAX_TOKEN_COUNT   5
+
+#define SYNTAX_HASH_SIZE 64   /* Keyword hash buckets */
+#define SYNTAX_DELIM_MAX 4    /* Longest comment delimiter */
+
+/* Syntax keyword (hash chain entry) */
+struct SyntaxKeyword {
+    struct SyntaxKeyword *next;
+    STRPTR text;
+    ULONG length;
+};
+
+/* Syntax highlighting rules (from the SYNTAX section of a .dfn file) */
+struct SyntaxRules {
+    struct SyntaxKeyword *keywords[SYNTAX_HASH_SIZE];
+    ULONG keywordCount;
+    UBYTE lineComment[SYNTAX_DELIM_MAX + 1];  /* Comment to end of line (empty = none) */
+    UBYTE blockStart[SYNTAX_DELIM_MAX + 1];   /* Block comment start (empty = none) */
+    UBYTE blockEnd[SYNTAX_DELIM_MAX + 1];     /* Block comment end */
+    UBYTE quoteChars[SYNTAX_DELIM_MAX + 1];   /* Characters that open and close strings */
+    UBYTE escapeChar;                         /* Escapes a quote inside a string (0 = none) */
+    BOOL ignoreCase;                          /* Keywords match case-insensitively */
+    UBYTE pens[SYNTAX_TOKEN_COUNT];           /* Pen for each token class */
+    BOOL packed;                              /* Keywords live in this same allocation (compiled cache) */
+};
+
+/* Command bound to a key, mouse button or hotkey (from a .dfn file) */
+struct DFNBinding {
+    STRPTR command;                           /* Command name */
+    STRPTR *args;                             /* Command arguments (may be NULL) */
+    ULONG argCount;                           /* Number of arguments */
+};
+
+/* Key table rows: qualifier bits (either key of a left/right pair counts) */
+#define DFN_QUAL_SHIFT   1
+#define DFN_QUAL_ALT     2
+#define DFN_QUAL_CTRL    4
+#define DFN_QUAL_AMIGA   8
+#define DFN_QUAL_COMBOS  16
+#define DFN_RAWKEY_COUNT 128                  /* Raw key codes - mouse buttons are 0x68-0x6A */
+
+/* Command table entry - the handle a name resolves to */
+struct TTXApplication;
+struct Session;
+struct TTXCommand {
+    STRPTR name;
+    BOOL (*handler)(struct TTXApplication *app, struct Session *session, STRPTR *args, ULONG argCount);
+};
+
+/* Key binding with its command already resolved */
+struct TTXKeyBinding {
+    struct TTXCommand *command;
+    STRPTR *args;                             /* Arguments (point into the definitions) */
+    ULONG argCount;
+};
+
+/* Compiled keymap - a keystroke is one lookup in keys[] and one call */
+struct TTXKeyMap {
+    UBYTE qualifierRow[256];                  /* Low byte of an IntuiMessage qualifier -> keys[] row */
+    struct TTXKeyBinding *keys[DFN_QUAL_COMBOS][DFN_RAWKEY_COUNT];
+    struct TTXKeyBinding *bindings;           /* Storage for every entry */
+    ULONG bindingCount;
+};
+
+/* Recorded keyboard macro - bytecode laid out in ttx_macro.c */
+struct TTXMacro {
+    UBYTE *code;                              /* Bytecode, always ended by an end opcode */
+    ULONG length;                             /* Bytes in use (not counting the end opcode) */
+    ULONG size;                               /* Bytes allocated */
+    ULONG textRun;                            /* Offset of the text run still being added to */
+    BOOL failed;                              /* Ran out of memory while recording */
+};
+
+/* Clip ring (see ttx_clip.c) */
+#define TTX_CLIP_RING     8    /* Clips kept by the ring */
+#define TTX_CLIP_NAME_MAX 32   /* Longest clip name (with its NUL) */
+
+/* Piece of clip text - owned by its ClipText and never changed */
+struct ClipPiece {
+    struct ClipPiece *next;
+    UBYTE *text;
+    ULONG length;
+    BOOL lineBreak;                           /* A newline follows the text */
+};
+
+/* Text of a clip - immutable once built, so slots and pastes share it; freed with its last reference */
+struct ClipText {
+    ULONG refCount;
+    ULONG length;                             /* Bytes including line breaks */
+    struct ClipPiece *pieces;
+    struct ClipPiece *lastPiece;
+};
+
+/* One slot of the clip ring */
+struct ClipSlot {
+    UBYTE name[TTX_CLIP_NAME_MAX];            /* Empty if unnamed */
+    struct ClipText *text;                    /* NULL if the slot is free */
 };
 
 /* Text selection/marking structure */
@@ -95,12 +239,217 @@ struct TextMarking {
     ULONG startX;                /* X position of start */
     ULONG stopY;                 /* Line where marking ends */
     ULONG stopX;                 /* X position of stop */
+    BOOL column;                 /* Column block - columns startX to stopX of every line startY to stopY */
 };
 
-struct TextBuffer {
+/* A caret edited along with the cursor (see ttx_caret.c) */
+struct Caret {
+    ULONG y;                     /* Line */
+    ULONG x;                     /* Column */
+};
+
+struct TextBuffer;
+
+#define JOURNAL_PATH_MAX 128
+
+/* Crash-recovery journal of a modified document (see ttx_journal.c) */
+struct DocJournal {
+    UBYTE path[JOURNAL_PATH_MAX];      /* Journal file */
+    UBYTE tempPath[JOURNAL_PATH_MAX];  /* Snapshot being written */
+    BPTR file;                   /* Journal open for appending (0 if journaling failed) */
+    ULONG fileSize;              /* Bytes in the journal file */
+    ULONG logBytes;              /* Bytes of records after the base */
+    ULONG baseBytes;             /* Size of what the records apply to (file or snapshot) */
+    UBYTE *pending;              /* Records not yet written */
+    ULONG pendingLen;
+    ULONG lastRecord;            /* Offset in pending of an in-place record the next edit may replace */
+    ULONG lastLine;              /* First line that record holds */
+    ULONG lastCount;             /* Lines it holds */
+    BOOL unsynced;               /* Written but not yet flushed by the file system */
+    BOOL stale;                  /* An edit went unlogged - records wait for a snapshot of the document */
+    BPTR snapFile;               /* Snapshot being written (0 if none) */
+    ULONG snapRecord;            /* Offset of the snapshot record header */
+    ULONG snapLine;              /* Next line to add to the snapshot */
+    ULONG snapSize;              /* Payload bytes of the snapshot record so far */
+    ULONG snapSum;               /* Checksum of the snapshot record so far */
+    ULONG snapChangeCount;       /* changeCount the snapshot is of */
+};
+
+/* Marker kinds */
+#define MARKER_BOOKMARK 1            /* Numbered bookmark (id 1-TTX_BOOKMARKS) */
+#define MARKER_AUTOMARK 2            /* Where the cursor was before the last jump */
+#define MARKER_CHANGE 3              /* Where the document was last edited */
+#define MARKER_FOLD 4                /* Anchor of a fold */
+#define TTX_BOOKMARKS 10
+/* Column of a marker whose line was deleted - the end of the line it moved onto */
+#define MARKER_EOL 0xFFFFFFFFUL
+
+/* A document position that follows edits - a node of the document's marker tree (see ttx_marker.c) */
+struct Marker {
+    struct Marker *left;         /* Markers before this one */
+    struct Marker *right;        /* Markers after this one */
+    struct Marker *parent;
+    ULONG priority;              /* Heap order that keeps the tree balanced */
+    ULONG y;                     /* Line */
+    ULONG x;                     /* Column (MARKER_EOL: end of the line) */
+    LONG shift;                  /* Pending for the markers below: lines to add */
+    BOOL collapse;               /* Pending for the markers below: move to the end of collapseY first */
+    ULONG collapseY;
+    UWORD kind;                  /* MARKER_... */
+    UWORD id;                    /* Bookmark number, fold number, ... */
+};
+
+/* Lines that can be hidden behind their first line - a node of two trees (see ttx_fold.c) */
+struct Fold {
+    struct Fold *left;           /* Interval tree of every fold, by first line */
+    struct Fold *right;
+    struct Fold *parent;
+    struct Fold *reach;          /* Fold of this subtree whose last line is furthest down */
+    struct Fold *spanLeft;       /* Span tree - hidden folds not inside another hidden fold */
+    struct Fold *spanRight;
+    struct Fold *spanParent;
+    struct Fold *next;           /* Folds an edit emptied, about to be removed */
+    ULONG priority;              /* Heap order that keeps both trees balanced */
+    ULONG spanLines;             /* Lines this span hides */
+    ULONG spanTotal;             /* Lines the spans of this subtree hide */
+    struct Marker *start;        /* First line - stays in view */
+    struct Marker *end;          /* Last line */
+    BOOL hidden;
+    BOOL span;                   /* In the span tree */
+};
+
+/* Bracket kinds an index keeps depths of: (), [] and {} */
+#define BRACKET_KINDS 3
+/* Lines summarized together - a chunk grows and shrinks with edits and is split when it doubles */
+#define BRACKET_CHUNK_LINES 128
+
+/* Bracket depth across a run of text, for one kind of bracket */
+struct BracketSum {
+    LONG net;                    /* Opening minus closing brackets */
+    LONG low;                    /* Lowest depth reached from the start (0 or less) */
+};
+
+/* Summary of a chunk of lines - or of a run of chunks, inside the index tree */
+struct BracketNode {
+    ULONG lines;
+    struct BracketSum sum[BRACKET_KINDS];
+    ULONG words;                 /* Words and characters (less line breaks), for document statistics */
+    ULONG chars;
+};
+
+/* Bracket depth index of a document (see ttx_bracket.c) */
+struct BracketIndex {
+    struct BracketNode *nodes;   /* Tree - node n has children 2n and 2n+1, chunk i is node leafCount+i */
+    UBYTE *dirty;                /* Chunks whose summary is stale */
+    ULONG chunkCount;            /* Chunks in use */
+    ULONG leafCount;             /* Room for chunks - a power of two */
+    ULONG dirtyCount;
+    ULONG scanFrom;              /* No chunk before it is stale - where rescanning at idle time goes on */
+    BOOL reshape;                /* A chunk emptied or grew too long - cut them again before the next search */
+};
+
+/* Lines the edits of an open edit batch changed - first-last in the numbering after them */
+struct LineSpan {
+    BOOL changed;                /* Any edit yet */
+    ULONG first;                 /* DOC_CHANGE_ALL: the whole document */
+    ULONG last;
+    LONG delta;                  /* Lines they added (>0) or removed (<0) */
+};
+
+/* Lines a wrap index sums together - a chunk grows and shrinks with edits and is cut again when it doubles */
+#define WRAP_CHUNK_LINES 128
+/* A line's entry in a wrap index */
+#define WRAP_ROWS 0x3FFF             /* Rows the line wraps to (a longer line is cut off) */
+#define WRAP_HIDDEN 0x4000           /* A hidden fold takes the line off the view - it counts no rows */
+#define WRAP_STALE 0x8000            /* Rows only estimated from the line's length - not measured yet */
+
+/* Lines and rows of a chunk of lines - or of a run of chunks, inside the wrap tree */
+struct WrapNode {
+    ULONG lines;
+    ULONG rows;
+};
+
+/* Soft wrap layout of a view (see ttx_wrap.c) */
+struct WrapIndex {
+    UWORD *lines;                /* Entry per line */
+    ULONG lineCount;             /* Lines laid out */
+    ULONG lineMax;               /* Room for entries */
+    struct WrapNode *nodes;      /* Tree - node n has children 2n and 2n+1, chunk i is node leafCount+i */
+    ULONG chunkCount;            /* Chunks in use */
+    ULONG leafCount;             /* Room for chunks - a power of two */
+    struct TextFont *font;       /* Font and pixel width the lines are wrapped for */
+    ULONG width;
+    ULONG charWidth;             /* Glyph width estimates go by */
+    ULONG staleCount;            /* Lines still to measure */
+    ULONG sweepLine;             /* Where measuring at idle time goes on */
+    struct LineSpan batch;       /* Lines changed in the open edit batch - laid out when it ends */
+};
+
+/* Paragraph formatting (see ttx_format.c) */
+#define FORMAT_WIDTH 72              /* Columns lines are formatted to unless a command gives a width */
+#define FORMAT_MAX_WIDTH 4096
+#define FORMAT_FILL 0                /* As many words on each line as fit - ragged right */
+#define FORMAT_JUSTIFY 1             /* Filled, then spaces widened to meet the width */
+#define FORMAT_CENTER 2              /* Each line trimmed and centered - not broken again */
+#define FORMAT_BALANCED 0x100        /* Break for even line lengths over the paragraph (fill and justify) */
+
+/* Tab stops Conv2Spaces/Conv2Tabs go by unless the command gives a size */
+#define TAB_SIZE 8
+#define TAB_MAX_SIZE 64
+
+/* Shared document - line storage that one or more views (TextBuffers) attach to */
+/* Sessions opening the same file share one TextDocument; each keeps its own cursor/scroll/marking */
+struct TextDocument {
+    struct TextDocument *next;   /* Next document in global document list */
     struct TextLine *lines;
     ULONG lineCount;
     ULONG maxLines;
+    BOOL modified;
+    ULONG refCount;              /* Number of attached views */
+    struct TextBuffer *views;    /* Attached views (linked via TextBuffer->nextView) */
+    STRPTR fileName;             /* File the document was loaded from (key for sharing, or NULL) */
+    ULONG changeCount;           /* Incremented on every edit (for change detection) */
+    /* Line layout cache - shared by every view of the document */
+    BOOL layoutValid;            /* maxLineLength/maxLineIndex are up to date */
+    ULONG maxLineLength;         /* Length of the longest line (for horizontal scrolling) */
+    ULONG maxLineIndex;          /* Line holding maxLineLength */
+    ULONG lexDirtyFrom;          /* Lines above this have trusted lexer states */
+    /* Statistics gathered by the idle scheduler (summed in the bracket index) */
+    BOOL statsValid;             /* statsWords/statsChars match changeCount statsChangeCount */
+    ULONG statsWords;
+    ULONG statsChars;
+    ULONG statsChangeCount;      /* changeCount the counts are for */
+    /* Line buffer compaction by the idle scheduler */
+    struct LineSpan compact;     /* Lines edited or read in since the last pass */
+    ULONG compactLine;           /* Next line to compact */
+    struct DocJournal *journal;  /* Crash-recovery journal (NULL while unmodified) */
+    struct LineSpan batch;       /* Lines changed in the open edit batch - not yet journaled */
+    /* Positions that follow edits (see ttx_marker.c) */
+    struct Marker *markers;      /* Root of the marker tree */
+    struct Marker *bookmarks[TTX_BOOKMARKS];
+    struct Marker *automark;
+    struct Marker *lastChange;
+    /* Folds (see ttx_fold.c) */
+    struct Fold *folds;          /* Root of the interval tree of folds */
+    struct Fold *spans;          /* Root of the tree of hidden spans (NULL: every line shows) */
+    struct BracketIndex *brackets; /* Built by the first bracket search (see ttx_bracket.c) */
+};
+
+/* Incremental file reader - a large file can come in over several idle slices */
+struct FileLoader {
+    BPTR file;                   /* Open file (NULL once the end was reached) */
+    struct TextDocument *doc;    /* Document the lines are read into */
+    ULONG lineCount;             /* Lines read so far */
+    BOOL failed;                 /* Ran out of memory - doc holds what was read before */
+};
+
+/* Line range value meaning "the whole document changed" */
+#define DOC_CHANGE_ALL 0xFFFFFFFFUL
+
+struct TextBuffer {
+    struct TextDocument *doc;    /* Shared document this view displays (never NULL once initialized) */
+    struct TextBuffer *nextView; /* Next view attached to the same document */
+    BOOL docChanged;             /* Set when another view changed the document - repaint pending */
     ULONG cursorX;
     ULONG cursorY;
     ULONG scrollX;
@@ -112,7 +461,6 @@ struct TextBuffer {
     ULONG maxScrollY;  /* Maximum vertical scroll position (in lines) */
     SHORT scrollXShift;  /* Scaling shift factor for horizontal scroll (for values > 0xFFFF) */
     SHORT scrollYShift;  /* Scaling shift factor for vertical scroll (for values > 0xFFFF) */
-    BOOL modified;
     struct TextMarking marking;  /* Text selection/marking */
     /* Graphics v39+ features for optimized rendering */
     struct BitMap *superBitMap;  /* Super bitmap for off-screen rendering (larger than window) */
@@ -121,6 +469,20 @@ struct TextBuffer {
     ULONG lastScrollX;            /* Last scroll X position for delta scrolling */
     ULONG lastScrollY;            /* Last scroll Y position for delta scrolling */
     BOOL needsFullRedraw;         /* Flag to force full redraw (e.g., after resize) */
+    /* Pane geometry when the window is split into several views */
+    ULONG viewTop;                /* Pane top in pixels below the window's top border */
+    ULONG viewHeight;             /* Pane height in pixels (0 = down to the bottom border) */
+    ULONG dirtyStart;             /* First visible line left stale by another view's edit */
+    ULONG dirtyEnd;               /* Line after the last stale line (dirtyStart == dirtyEnd: none) */
+    /* Scratch space for text that is not contiguous in line storage (GetBlockSpan) */
+    UBYTE *scratch;
+    ULONG scratchSize;
+    /* Carets besides the cursor, sorted by line then column (see ttx_caret.c) */
+    struct Caret *carets;
+    ULONG caretCount;
+    ULONG caretMax;
+    /* Soft wrap layout (NULL: long lines run off to the right) */
+    struct WrapIndex *wrap;
 };
 
 /* Forward declarations */
@@ -181,11 +543,16 @@ struct Session {
     struct WindowState windowState;     /* Window creation parameters (for restoration) */
     /* Document state - file and buffer */
     struct DocumentState docState;      /* Document metadata */
-    struct TextBuffer *buffer;          /* Text buffer (always present, even when window closed) */
+    struct TextBuffer *buffer;          /* Text buffer (present unless dormant, even when window closed) */
+    struct TextBuffer *otherView;       /* Inactive pane of a split window (NULL if not split) */
+    BOOL dormant;                       /* Only path and metadata so far - no buffer, no window */
+    struct FileLoader *loader;          /* File still coming in over idle slices (NULL when loaded) */
+    BOOL loadReadOnly;                  /* docState.readOnly to restore once loader is done */
     /* Mouse selection state */
     BOOL mouseSelecting;                /* TRUE if mouse button is down and we're selecting */
     ULONG selectStartX;                 /* Selection start X position */
     ULONG selectStartY;                 /* Selection start Y position */
+    BOOL selectColumn;                  /* Alt was held when the selection started - a column block */
 };
 
 /* Prop gadget IDs */
@@ -215,6 +582,43 @@ struct TTXApplication {
     BOOL iconified;               /* TRUE if application is iconified */
     BOOL iconifyDeferred;         /* Defer iconification to main loop */
     BOOL iconifyState;            /* Desired iconification state */
+    /* Files queued by a batch open */
+    struct PendingOpen *openQueue;
+    struct PendingOpen *openQueueTail;
+    ULONG openQueueCount;
+    /* Idle-time background jobs (timer.device) */
+    struct MsgPort *idlePort;     /* Reply port for the idle timer */
+    struct timerequest *idleTimer; /* Idle timer request */
+    BOOL idleTimerOpen;           /* timer.device is open on idleTimer */
+    BOOL idleTimerPending;        /* idleTimer has been sent and not yet returned */
+    ULONG idleJobIndex;           /* Next job to get a slice (round robin) */
+    BOOL commodityTried;          /* Deferred commodity registration has been attempted */
+    /* Startup phase timing (E-clock from timer.device) */
+    struct EClockVal startClock;  /* When TTX_Init started */
+    struct EClockVal phaseClock;  /* When the last startup phase ended */
+    ULONG eclockRate;             /* E-clock ticks per second (0 = not timing) */
+    BOOL startupTimed;            /* All startup phases have been reported */
+    struct TTXKeyMap *keyMap;     /* Compiled key bindings (built on the first keystroke) */
+    /* Keyboard macros */
+    struct TTXMacro *macro;       /* Macro PlayMacro runs (NULL if none) */
+    struct TTXMacro *recording;   /* Macro being recorded (NULL if not recording) */
+    BOOL macroPlaying;            /* A macro is being played back */
+    /* Clip ring shared by every session */
+    struct ClipSlot clipRing[TTX_CLIP_RING];
+    ULONG clipHead;               /* Slot of the most recent clip */
+    /* ARexx host */
+    struct MsgPort *rexxPort;     /* Public ARexx host port (NULL if another program owns the name) */
+    STRPTR result;                /* Result of the last command (resultBuffer or text it refers to) */
+    ULONG resultLength;
+    STRPTR resultBuffer;          /* Copied results (reused from command to command) */
+    ULONG resultSize;             /* Bytes allocated for resultBuffer */
+    BOOL resultSet;               /* The last command left a result */
+    ULONG rexxPending;            /* Scripts we started that have not replied yet */
+    struct RexxCacheEntry *rexxCache;     /* Cached macro files, most recently used first */
+    struct RexxCacheEntry *rexxCacheTail; /* Least recently used */
+    ULONG rexxCacheCount;
+    ULONG rexxCacheBytes;         /* Bytes held by the cache */
+    ULONG rexxCacheBudget;        /* Most bytes the cache may hold (0 = no caching) */
 };
 
 /* Forward declarations */
@@ -222,6 +626,8 @@ BOOL TTX_Init(struct TTXApplication *app);
 VOID TTX_Cleanup(struct TTXApplication *app);
 BOOL TTX_InitLibraries(struct CleanupStack *stack);
 VOID TTX_CleanupLibraries(VOID);
+struct Library *TTX_NeedLibrary(ULONG which);
+VOID TTX_StartupPhase(struct TTXApplication *app, STRPTR phase);
 BOOL TTX_SetupMessagePort(struct TTXApplication *app);
 BOOL TTX_AddMessagePort(struct TTXApplication *app);
 VOID TTX_RemoveMessagePort(struct TTXApplication *app);
@@ -229,16 +635,36 @@ BOOL TTX_SetupCommodity(struct TTXApplication *app);
 VOID TTX_RemoveCommodity(struct TTXApplication *app);
 BOOL TTX_ParseArguments(struct TTXArgs *args, struct CleanupStack *stack);
 BOOL TTX_ParseToolTypes(STRPTR *fileName, struct WBStartup *wbMsg, struct CleanupStack *stack);
-BOOL TTX_CheckExistingInstance(STRPTR fileName);
+BOOL TTX_CheckExistingInstance(STRPTR *fileNames);
 BOOL TTX_SendToExistingInstance(struct CleanupStack *stack, ULONG msgType, STRPTR fileName);
+BOOL TTX_SendBatchToExistingInstance(struct CleanupStack *stack, STRPTR *fileNames);
+VOID TTX_ExpandFileName(STRPTR fileName, STRPTR buffer, ULONG bufferSize);
+VOID TTX_OpenFiles(struct TTXApplication *app, STRPTR *fileNames, ULONG count);
+BOOL TTX_QueueOpenFile(struct TTXApplication *app, STRPTR fileName);
+BOOL TTX_OpenNextQueued(struct TTXApplication *app);
+VOID TTX_FreeOpenQueue(struct TTXApplication *app);
 BOOL TTX_CreateSession(struct TTXApplication *app, STRPTR fileName);
+VOID TTX_InitSessionState(struct TTXApplication *app, struct Session *session, STRPTR fileName);
+BOOL TTX_CreateDormantSession(struct TTXApplication *app, STRPTR fileName);
+BOOL TTX_WakeSession(struct TTXApplication *app, struct Session *session);
+BOOL TTX_ContinueSessionLoad(struct TTXApplication *app, struct Session *session, ULONG maxLines);
+VOID TTX_EndSessionLoad(struct TTXApplication *app, struct Session *session);
+VOID TTX_AbortSessionLoad(struct Session *session);
+BOOL TTX_ActivateSession(struct TTXApplication *app, struct Session *session);
 VOID TTX_DestroySession(struct TTXApplication *app, struct Session *session);
+VOID TTX_BuildSignalMask(struct TTXApplication *app);
 VOID TTX_EventLoop(struct TTXApplication *app);
 BOOL TTX_HandleCommodityMessage(struct TTXApplication *app, struct Message *msg);
 BOOL TTX_HandleIntuitionMessage(struct TTXApplication *app, struct IntuiMessage *imsg);
 BOOL TTX_CreateMenuStrip(struct Session *session);
 VOID TTX_FreeMenuStrip(struct Session *session);
 BOOL TTX_HandleCommand(struct TTXApplication *app, struct Session *session, STRPTR command, STRPTR *args, ULONG argCount);
+struct TTXCommand *TTX_FindCommand(STRPTR command);
+BOOL TTX_RunCommand(struct TTXApplication *app, struct Session *session, struct TTXCommand *command, STRPTR *args, ULONG argCount);
+ULONG TTX_CommandIndex(struct TTXCommand *command);
+struct TTXCommand *TTX_GetCommand(ULONG index);
+BOOL TTX_BuildKeyMap(struct TTXApplication *app);
+VOID TTX_FreeKeyMap(struct TTXApplication *app);
 BOOL TTX_HandleMenuPick(struct TTXApplication *app, struct Session *session, ULONG menuNumber, ULONG itemNumber);
 VOID TTX_ShowUsage(VOID);
 VOID TTX_Iconify(struct TTXApplication *app, BOOL iconify);
@@ -291,6 +717,7 @@ BOOL TTX_Cmd_CopyBlk(struct TTXApplication *app, struct Session *session, STRPTR
 BOOL TTX_Cmd_CutBlk(struct TTXApplication *app, struct Session *session, STRPTR *args, ULONG argCount);
 BOOL TTX_Cmd_DeleteBlk(struct TTXApplication *app, struct Session *session, STRPTR *args, ULONG argCount);
 BOOL TTX_Cmd_EncryptBlk(struct TTXApplication *app, struct Session *session, STRPTR *args, ULONG argCount);
+BOOL TTX_Cmd_FillBlk(struct TTXApplication *app, struct Session *session, STRPTR *args, ULONG argCount);
 BOOL TTX_Cmd_GetBlk(struct TTXApplication *app, struct Session *session, STRPTR *args, ULONG argCount);
 BOOL TTX_Cmd_GetBlkInfo(struct TTXApplication *app, struct Session *session, STRPTR *args, ULONG argCount);
 BOOL TTX_Cmd_MarkBlk(struct TTXApplication *app, struct Session *session, STRPTR *args, ULONG argCount);
@@ -337,6 +764,7 @@ BOOL TTX_Cmd_MoveBookmark(struct TTXApplication *app, struct Session *session, S
 BOOL TTX_Cmd_SetBookmark(struct TTXApplication *app, struct Session *session, STRPTR *args, ULONG argCount);
 /* Editing commands */
 BOOL TTX_Cmd_Delete(struct TTXApplication *app, struct Session *session, STRPTR *args, ULONG argCount);
+BOOL TTX_Cmd_DeleteForward(struct TTXApplication *app, struct Session *session, STRPTR *args, ULONG argCount);
 BOOL TTX_Cmd_DeleteEOL(struct TTXApplication *app, struct Session *session, STRPTR *args, ULONG argCount);
 BOOL TTX_Cmd_DeleteEOW(struct TTXApplication *app, struct Session *session, STRPTR *args, ULONG argCount);
 BOOL TTX_Cmd_DeleteLine(struct TTXApplication *app, struct Session *session, STRPTR *args, ULONG argCount);
@@ -353,6 +781,10 @@ BOOL TTX_Cmd_Text(struct TTXApplication *app, struct Session *session, STRPTR *a
 BOOL TTX_Cmd_ToggleCharCase(struct TTXApplication *app, struct Session *session, STRPTR *args, ULONG argCount);
 BOOL TTX_Cmd_UndeleteLine(struct TTXApplication *app, struct Session *session, STRPTR *args, ULONG argCount);
 BOOL TTX_Cmd_UndoLine(struct TTXApplication *app, struct Session *session, STRPTR *args, ULONG argCount);
+/* Caret commands */
+BOOL TTX_Cmd_AddCaret(struct TTXApplication *app, struct Session *session, STRPTR *args, ULONG argCount);
+BOOL TTX_Cmd_AddCarets(struct TTXApplication *app, struct Session *session, STRPTR *args, ULONG argCount);
+BOOL TTX_Cmd_ClearCarets(struct TTXApplication *app, struct Session *session, STRPTR *args, ULONG argCount);
 /* Word-level editing commands */
 BOOL TTX_Cmd_CompleteTemplate(struct TTXApplication *app, struct Session *session, STRPTR *args, ULONG argCount);
 BOOL TTX_Cmd_CorrectWord(struct TTXApplication *app, struct Session *session, STRPTR *args, ULONG argCount);
@@ -434,6 +866,9 @@ BOOL TTX_Cmd_Quit(struct TTXApplication *app, struct Session *session, STRPTR *a
 BOOL InitTextBuffer(struct TextBuffer *buffer, struct CleanupStack *stack);
 VOID FreeTextBuffer(struct TextBuffer *buffer, struct CleanupStack *stack);
 BOOL LoadFile(STRPTR fileName, struct TextBuffer *buffer, struct CleanupStack *stack);
+struct FileLoader *BeginLoadFile(STRPTR fileName, struct CleanupStack *stack);
+BOOL ContinueLoadFile(struct FileLoader *loader, ULONG maxLines);
+BOOL EndLoadFile(struct FileLoader *loader);
 BOOL SaveFile(STRPTR fileName, struct TextBuffer *buffer, struct CleanupStack *stack);
 BOOL InsertChar(struct TextBuffer *buffer, UBYTE ch, struct CleanupStack *stack);
 BOOL DeleteChar(struct TextBuffer *buffer, struct CleanupStack *stack);
@@ -445,12 +880,82 @@ VOID FreeSuperBitMap(struct TextBuffer *buffer);
 VOID RenderText(struct Window *window, struct TextBuffer *buffer);
 VOID UpdateCursor(struct Window *window, struct TextBuffer *buffer);
 VOID ScrollToCursor(struct TextBuffer *buffer, struct Window *window);
+VOID GetViewBounds(struct TextBuffer *buffer, struct Window *window, ULONG *top, ULONG *bottom);
 /* Block operations */
 STRPTR GetBlock(struct TextBuffer *buffer, struct CleanupStack *stack);
+BOOL GetBlockSpan(struct TextBuffer *buffer, STRPTR *text, ULONG *length);
+BOOL GetBlockBounds(struct TextBuffer *buffer, ULONG *startY, ULONG *startX, ULONG *stopY, ULONG *stopX);
+VOID GetBlockLineRange(struct TextBuffer *buffer, ULONG y, ULONG startY, ULONG startX, ULONG stopY, ULONG stopX,
+                       ULONG *fromX, ULONG *toX);
 BOOL DeleteBlock(struct TextBuffer *buffer, struct CleanupStack *stack);
 VOID MarkAllBlock(struct TextBuffer *buffer);
 VOID SetMarking(struct TextBuffer *buffer, ULONG startY, ULONG startX, ULONG stopY, ULONG stopX);
 VOID ClearMarking(struct TextBuffer *buffer);
+/* Markers */
+struct Marker *AddMarker(struct TextDocument *doc, ULONG y, ULONG x, UWORD kind, UWORD id);
+VOID RemoveMarker(struct TextDocument *doc, struct Marker *marker);
+VOID MoveMarker(struct TextDocument *doc, struct Marker *marker, ULONG y, ULONG x);
+VOID GetMarkerPosition(struct TextDocument *doc, struct Marker *marker, ULONG *y, ULONG *x);
+BOOL SetDocMark(struct TextDocument *doc, struct Marker **mark, UWORD kind, UWORD id, ULONG y, ULONG x);
+VOID ClearDocMark(struct TextDocument *doc, struct Marker **mark);
+VOID ShiftMarkers(struct TextDocument *doc, ULONG lineY, LONG lineDelta);
+VOID FreeMarkers(struct TextDocument *doc);
+/* Folds */
+struct Fold *MakeFold(struct TextBuffer *buffer, ULONG startY, ULONG endY);
+VOID UnmakeFold(struct TextBuffer *buffer, struct Fold *fold);
+VOID UnmakeFolds(struct TextBuffer *buffer, ULONG startY, ULONG endY);
+VOID SetFoldHidden(struct TextBuffer *buffer, struct Fold *fold, BOOL hidden);
+VOID SetFoldsHidden(struct TextBuffer *buffer, ULONG startY, ULONG endY, BOOL hidden);
+struct Fold *GetFoldAt(struct TextDocument *doc, ULONG y);
+struct Fold *GetHiddenFoldAt(struct TextDocument *doc, ULONG y);
+VOID GetFoldLines(struct TextDocument *doc, struct Fold *fold, ULONG *startY, ULONG *endY);
+VOID RevealLine(struct TextBuffer *buffer, ULONG y);
+BOOL IsLineHidden(struct TextDocument *doc, ULONG y);
+ULONG LineToRow(struct TextDocument *doc, ULONG y);
+ULONG RowToLine(struct TextDocument *doc, ULONG row);
+ULONG GetRowCount(struct TextDocument *doc);
+ULONG LineAfterRows(struct TextDocument *doc, ULONG y, ULONG rows);
+VOID FoldLinesChanged(struct TextDocument *doc, ULONG lineY, LONG lineDelta);
+VOID FreeFolds(struct TextDocument *doc);
+/* Bracket matching */
+BOOL FindMatchingBracket(struct TextDocument *doc, ULONG y, ULONG x, ULONG *matchY, ULONG *matchX);
+VOID BracketLinesChanged(struct TextDocument *doc, ULONG lineY, LONG lineDelta);
+VOID FreeBracketIndex(struct TextDocument *doc);
+BOOL UpdateBracketIndex(struct TextDocument *doc, ULONG maxChunks);
+BOOL GetDocumentCounts(struct TextDocument *doc, ULONG *words, ULONG *chars);
+/* Soft wrap */
+BOOL SetWrap(struct TextBuffer *buffer, struct Window *window, BOOL wrap);
+VOID ReflowView(struct TextBuffer *buffer, struct Window *window);
+BOOL ReflowSlice(struct TextBuffer *buffer, struct Window *window, ULONG maxLines);
+ULONG GetWrapBreak(struct RastPort *rp, struct TextLine *line, ULONG start, ULONG width);
+ULONG GetWrapRowOf(struct TextBuffer *buffer, struct RastPort *rp, ULONG y, ULONG x, ULONG *rowStart);
+ULONG GetWrapRowStart(struct TextBuffer *buffer, struct RastPort *rp, ULONG y, ULONG row, ULONG *rowEnd);
+ULONG GetLineRows(struct TextBuffer *buffer, ULONG y);
+ULONG ViewLineToRow(struct TextBuffer *buffer, ULONG y);
+ULONG ViewRowToLine(struct TextBuffer *buffer, ULONG row);
+ULONG GetViewRowCount(struct TextBuffer *buffer);
+ULONG ViewLineAfterRows(struct TextBuffer *buffer, ULONG y, ULONG rows);
+VOID WrapLinesChanged(struct TextBuffer *buffer, ULONG lineY, LONG lineDelta);
+VOID WrapFoldsChanged(struct TextBuffer *buffer, ULONG startY, ULONG endY);
+VOID WrapBatchEnded(struct TextBuffer *buffer);
+VOID FreeWrap(struct TextBuffer *buffer);
+/* Paragraph formatting */
+BOOL GetParagraphLines(struct TextBuffer *buffer, ULONG y, ULONG *startY, ULONG *stopY);
+BOOL FormatLines(struct TextBuffer *buffer, ULONG startY, ULONG stopY, ULONG width, ULONG mode,
+                 struct CleanupStack *stack);
+/* Multiple carets */
+BOOL AddCaret(struct TextBuffer *buffer, ULONG y, ULONG x);
+BOOL RemoveCaret(struct TextBuffer *buffer, ULONG y, ULONG x);
+ULONG AddBlockCarets(struct TextBuffer *buffer);
+VOID ClearCarets(struct TextBuffer *buffer);
+VOID FreeCarets(struct TextBuffer *buffer);
+BOOL CaretInsertText(struct TextBuffer *buffer, STRPTR text, ULONG length, struct CleanupStack *stack);
+BOOL CaretDeleteChar(struct TextBuffer *buffer, BOOL forward, struct CleanupStack *stack);
+/* Column blocks */
+BOOL InsertColumnText(struct TextBuffer *buffer, STRPTR text, ULONG length, ULONG column, struct CleanupStack *stack);
+BOOL NextColumnLine(struct TextBuffer *buffer, ULONG column, struct CleanupStack *stack);
+BOOL FillBlock(struct TextBuffer *buffer, UBYTE ch, struct CleanupStack *stack);
+BOOL ShiftColumnBlock(struct TextBuffer *buffer, LONG shift, struct CleanupStack *stack);
 /* Word navigation */
 BOOL MoveNextWord(struct TextBuffer *buffer);
 BOOL MovePrevWord(struct TextBuffer *buffer);
@@ -462,6 +967,12 @@ ULONG GetCharWidth(struct RastPort *rp, UBYTE ch);
 ULONG GetLineHeight(struct RastPort *rp);
 VOID UpdateScrollBars(struct Session *session);
 VOID CalculateMaxScroll(struct TextBuffer *buffer, struct Window *window);
+/* Split views */
+BOOL TTX_SplitSession(struct TTXApplication *app, struct Session *session);
+VOID TTX_UnsplitSession(struct TTXApplication *app, struct Session *session);
+VOID TTX_LayoutViews(struct Session *session);
+VOID TTX_RenderViews(struct Session *session);
+struct TextBuffer *TTX_ViewAtPoint(struct Session *session, LONG mouseY);
 /* Delete operations */
 BOOL DeleteEOL(struct TextBuffer *buffer, struct CleanupStack *stack);
 BOOL DeleteEOW(struct TextBuffer *buffer, struct CleanupStack *stack);
@@ -470,13 +981,18 @@ BOOL DeleteSOW(struct TextBuffer *buffer, struct CleanupStack *stack);
 BOOL DeleteLine(struct TextBuffer *buffer, struct CleanupStack *stack);
 /* Text insertion operations */
 BOOL InsertText(struct TextBuffer *buffer, STRPTR text, struct CleanupStack *stack);
+BOOL InsertSpan(struct TextBuffer *buffer, STRPTR text, ULONG length, struct CleanupStack *stack);
+BOOL GrowLine(struct TextLine *line, ULONG size);
 UBYTE GetCharAtCursor(struct TextBuffer *buffer);
 STRPTR GetCurrentLine(struct TextBuffer *buffer, struct CleanupStack *stack);
+BOOL GetLineSpan(struct TextBuffer *buffer, ULONG line, STRPTR *text, ULONG *length);
+UBYTE *GetScratch(struct TextBuffer *buffer, ULONG size);
 BOOL SetCharAtCursor(struct TextBuffer *buffer, UBYTE ch, struct CleanupStack *stack);
 BOOL SwapChars(struct TextBuffer *buffer, struct CleanupStack *stack);
 BOOL ToggleCharCase(struct TextBuffer *buffer, struct CleanupStack *stack);
 /* Word operations */
 STRPTR GetWordAtCursor(struct TextBuffer *buffer, struct CleanupStack *stack);
+BOOL GetWordSpan(struct TextBuffer *buffer, STRPTR *text, ULONG *length);
 BOOL ReplaceWordAtCursor(struct TextBuffer *buffer, STRPTR newWord, struct CleanupStack *stack);
 /* Case conversion operations */
 BOOL ConvertToUpper(struct TextBuffer *buffer, struct CleanupStack *stack);
@@ -484,13 +1000,103 @@ BOOL ConvertToLower(struct TextBuffer *buffer, struct CleanupStack *stack);
 /* Indentation operations */
 BOOL ShiftLeft(struct TextBuffer *buffer, struct CleanupStack *stack);
 BOOL ShiftRight(struct TextBuffer *buffer, struct CleanupStack *stack);
-BOOL ConvertTabsToSpaces(struct TextBuffer *buffer, struct CleanupStack *stack);
-BOOL ConvertSpacesToTabs(struct TextBuffer *buffer, struct CleanupStack *stack);
+BOOL ConvertTabsToSpaces(struct TextBuffer *buffer, ULONG tabSize, struct CleanupStack *stack);
+BOOL ConvertSpacesToTabs(struct TextBuffer *buffer, ULONG tabSize, struct CleanupStack *stack);
+
+/* Shared document functions */
+struct TextDocument *CreateDocument(struct CleanupStack *stack);
+struct TextDocument *FindDocument(STRPTR fileName);
+BOOL SetDocumentFileName(struct TextDocument *doc, STRPTR fileName);
+VOID AttachDocument(struct TextBuffer *buffer, struct TextDocument *doc);
+VOID DetachDocument(struct TextBuffer *buffer, struct CleanupStack *stack);
+VOID FreeDocument(struct TextDocument *doc, struct CleanupStack *stack);
+VOID DocumentChanged(struct TextBuffer *buffer, ULONG lineY, LONG lineDelta);
+ULONG GetDocumentMaxLineLength(struct TextDocument *doc);
+VOID TTX_RefreshDocumentViews(struct TTXApplication *app);
+VOID TTX_RepaintSessions(struct TTXApplication *app);
+VOID BeginEditBatch(VOID);
+VOID EndEditBatch(VOID);
+BOOL InEditBatch(VOID);
+VOID AddLineSpan(struct LineSpan *span, ULONG lineY, LONG lineDelta);
+
+/* Idle scheduler functions */
+BOOL TTX_SetupIdleTimer(struct TTXApplication *app);
+VOID TTX_RemoveIdleTimer(struct TTXApplication *app);
+ULONG TTX_IdleSignal(struct TTXApplication *app);
+VOID TTX_ScheduleIdle(struct TTXApplication *app);
+VOID TTX_RunIdleJobs(struct TTXApplication *app);
+VOID IdleLinesChanged(struct TextDocument *doc, ULONG lineY, LONG lineDelta);
+
+/* Crash-recovery journal functions */
+VOID JournalChange(struct TextDocument *doc, ULONG lineY, LONG lineDelta);
+VOID JournalLines(struct TextDocument *doc, ULONG lineY, ULONG removed, ULONG inserted);
+VOID JournalDiscard(struct TextDocument *doc);
+BOOL JournalIdle(struct TextDocument *doc);
+ULONG TTX_RecoverJournals(struct TTXApplication *app);
+
+/* Keyboard macro functions */
+struct TTXMacro *CreateMacro(VOID);
+VOID FreeMacro(struct TTXMacro *macro);
+BOOL AddMacroCommand(struct TTXMacro *macro, ULONG index, STRPTR *args, ULONG argCount);
+BOOL AddMacroText(struct TTXMacro *macro, UBYTE *text, ULONG length);
+VOID RecordMacroCommand(struct TTXApplication *app, struct TTXCommand *command, STRPTR *args, ULONG argCount);
+VOID RecordMacroChar(struct TTXApplication *app, UBYTE ch);
+ULONG PlayMacro(struct TTXApplication *app, struct Session *session, struct TTXMacro *macro, ULONG repeat);
+BOOL SaveMacro(struct TTXMacro *macro, STRPTR fileName);
+struct TTXMacro *LoadMacro(STRPTR fileName);
+
+/* Clipboard functions */
+BOOL CopyBlockToClip(struct TextBuffer *buffer, ULONG unit);
+BOOL PasteClipToBuffer(struct TextBuffer *buffer, ULONG unit, BOOL vertical, struct CleanupStack *stack);
+BOOL FileToClip(STRPTR fileName, ULONG unit);
+BOOL ClipToFile(ULONG unit, STRPTR fileName);
+struct ClipText *CopyBlockText(struct TextBuffer *buffer);
+struct ClipText *CutBlockText(struct TextBuffer *buffer, struct CleanupStack *stack);
+VOID ReleaseClipText(struct ClipText *text);
+BOOL PasteClipText(struct TextBuffer *buffer, struct ClipText *text, BOOL vertical, struct CleanupStack *stack);
+BOOL ClipTextToClip(struct ClipText *text, ULONG unit, struct TextBuffer *buffer);
+VOID PushClip(struct TTXApplication *app, STRPTR name, struct ClipText *text);
+struct ClipText *FindClip(struct TTXApplication *app, STRPTR which);
+VOID FreeClipRing(struct TTXApplication *app);
+
+/* ARexx host functions */
+BOOL TTX_SetupRexxPort(struct TTXApplication *app);
+VOID TTX_CleanupRexxPort(struct TTXApplication *app);
+ULONG TTX_RexxSignal(struct TTXApplication *app);
+VOID TTX_HandleRexxMessages(struct TTXApplication *app);
+BOOL TTX_SetResult(struct TTXApplication *app, STRPTR text, ULONG length);
+BOOL TTX_SetResultString(struct TTXApplication *app, STRPTR text);
+BOOL TTX_SetResultNumber(struct TTXApplication *app, ULONG value);
+BOOL TTX_SetResultRef(struct TTXApplication *app, STRPTR text, ULONG length);
+VOID TTX_ClearResult(struct TTXApplication *app);
+BOOL TTX_ExecRexxMacro(struct TTXApplication *app, STRPTR fileName);
+BOOL TTX_ExecRexxString(struct TTXApplication *app, STRPTR text);
+VOID TTX_SetRexxCacheSize(struct TTXApplication *app, ULONG budget);
+VOID TTX_FlushRexxCache(struct TTXApplication *app);
+
+/* Syntax highlighting functions */
+struct SyntaxRules *CreateSyntaxRules(VOID);
+VOID FreeSyntaxRules(struct SyntaxRules *rules);
+BOOL AddSyntaxKeyword(struct SyntaxRules *rules, STRPTR word);
+VOID SetSyntaxRules(struct SyntaxRules *rules);
+struct SyntaxRules *GetSyntaxRules(VOID);
+VOID SyntaxLinesChanged(struct TextDocument *doc, ULONG lineY, LONG lineDelta);
+VOID HighlightLines(struct TextDocument *doc, ULONG firstLine, ULONG endLine);
+BOOL LexAhead(struct TextDocument *doc, ULONG maxLines);
+VOID DrawHighlightedText(struct RastPort *rp, struct TextDocument *doc, ULONG lineY, ULONG start, ULONG count, ULONG x, ULONG baseY);
 
 /* Definition file parser */
 struct DFNFile;
 struct DFNFile *ParseDFNFile(STRPTR fileName, struct CleanupStack *stack);
 VOID FreeDFNFile(struct DFNFile *dfn);
 struct NewMenu *ConvertDFNToNewMenu(struct DFNFile *dfn, ULONG *outCount);
+struct SyntaxRules *TakeDFNSyntaxRules(struct DFNFile *dfn);
+VOID SetDefinitions(struct DFNFile *dfn);
+struct DFNFile *GetDefinitions(VOID);
+struct DFNBinding *GetDFNKey(struct DFNFile *dfn, ULONG row, ULONG code);
+struct DFNBinding *GetDFNHotKey(struct DFNFile *dfn, ULONG index, STRPTR *description);
+STRPTR FindDFNTemplate(struct DFNFile *dfn, STRPTR abbrev, ULONG length);
+BOOL IsDFNWord(struct DFNFile *dfn, STRPTR word, ULONG length);
+STRPTR FindDFNLink(struct DFNFile *dfn, STRPTR name);
 
 #endif /* TTX_H */
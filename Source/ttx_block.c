@@ -10,6 +10,7 @@
 /* Forward declarations */
 static BOOL IsWordSeparator(UBYTE c);
 static VOID NormalizeMarking(struct TextMarking *marking);
+static BOOL DeleteColumnBlock(struct TextBuffer *buffer, ULONG startY, ULONG left, ULONG stopY, ULONG right);
 
 /* Check if character is a word separator */
 /* Word separators: space, tab, newline, and punctuation */
@@ -38,6 +39,21 @@ static VOID NormalizeMarking(struct TextMarking *marking)
         return;
     }
     
+    /* A column block's corners are ordered one axis at a time */
+    if (marking->column) {
+        if (marking->stopY < marking->startY) {
+            tempY = marking->startY;
+            marking->startY = marking->stopY;
+            marking->stopY = tempY;
+        }
+        if (marking->stopX < marking->startX) {
+            tempX = marking->startX;
+            marking->startX = marking->stopX;
+            marking->stopX = tempX;
+        }
+        return;
+    }
+    
     /* If stop is before start, swap them */
     if (marking->stopY < marking->startY ||
         (marking->stopY == marking->startY && marking->stopX < marking->startX)) {
@@ -54,124 +70,143 @@ static VOID NormalizeMarking(struct TextMarking *marking)
  * Block Operations
  * ============================================================================ */
 
-/* Get selected text block */
+/* Get selected text block (a copy the caller frees) */
 STRPTR GetBlock(struct TextBuffer *buffer, struct CleanupStack *stack)
 {
-    ULONG startY = 0;
-    ULONG startX = 0;
-    ULONG stopY = 0;
-    ULONG stopX = 0;
-    ULONG totalLen = 0;
-    ULONG i = 0;
-    ULONG lineLen = 0;
+    STRPTR text = NULL;
     STRPTR result = NULL;
-    STRPTR ptr = NULL;
+    ULONG totalLen = 0;
     
-    if (!buffer || !stack || !buffer->marking.enabled) {
+    if (!buffer || !stack || !GetBlockSpan(buffer, &text, &totalLen) || totalLen == 0) {
+        return NULL;
+    }
+    
+    /* Allocate memory for result (add 1 for null terminator) */
+    result = (STRPTR)allocVec(totalLen + 1, MEMF_CLEAR);
+    if (!result) {
         return NULL;
     }
     
+    CopyMem(text, result, totalLen);
+    result[totalLen] = '\0';
+    
+    return result;
+}
+
+/* Selection in order and clipped to the document (columns within their lines, except for
+ * a column block whose columns apply to every line - see GetBlockLineRange) */
+BOOL GetBlockBounds(struct TextBuffer *buffer, ULONG *startY, ULONG *startX, ULONG *stopY, ULONG *stopX)
+{
+    struct TextLine *lines = NULL;
+    
+    if (!buffer || !buffer->doc || !buffer->marking.enabled) {
+        return FALSE;
+    }
+    
     /* Normalize marking */
     NormalizeMarking(&buffer->marking);
-    startY = buffer->marking.startY;
-    startX = buffer->marking.startX;
-    stopY = buffer->marking.stopY;
-    stopX = buffer->marking.stopX;
+    lines = buffer->doc->lines;
+    if (buffer->marking.startY >= buffer->doc->lineCount) {
+        return FALSE;
+    }
     
-    /* Calculate total length needed */
-    if (startY == stopY) {
-        /* Single line selection */
-        if (stopX > startX && startY < buffer->lineCount) {
-            lineLen = buffer->lines[startY].length;
-            if (stopX > lineLen) {
-                stopX = lineLen;
-            }
-            if (startX < lineLen) {
-                totalLen = stopX - startX;
-            }
-        }
-    } else {
-        /* Multi-line selection */
-        /* First line */
-        if (startY < buffer->lineCount) {
-            lineLen = buffer->lines[startY].length;
-            if (startX < lineLen) {
-                totalLen += lineLen - startX;
-            }
-        }
-        /* Middle lines */
-        for (i = startY + 1; i < stopY && i < buffer->lineCount; i++) {
-            totalLen += buffer->lines[i].length;
-        }
-        /* Last line */
-        if (stopY < buffer->lineCount) {
-            lineLen = buffer->lines[stopY].length;
-            if (stopX > lineLen) {
-                stopX = lineLen;
-            }
-            totalLen += stopX;
+    *startY = buffer->marking.startY;
+    *startX = buffer->marking.startX;
+    *stopY = buffer->marking.stopY;
+    *stopX = buffer->marking.stopX;
+    if (*stopY >= buffer->doc->lineCount) {
+        *stopY = buffer->doc->lineCount - 1;
+        if (!buffer->marking.column) {
+            *stopX = lines[*stopY].length;
         }
     }
-    
-    if (totalLen == 0) {
-        return NULL;
+    if (buffer->marking.column) {
+        return TRUE;
+    }
+    if (*startX > lines[*startY].length) {
+        *startX = lines[*startY].length;
     }
+    if (*stopX > lines[*stopY].length) {
+        *stopX = lines[*stopY].length;
+    }
+    return TRUE;
+}
+
+/* Columns of line y that lie in a block given by GetBlockBounds (fromX == toX: none) */
+VOID GetBlockLineRange(struct TextBuffer *buffer, ULONG y, ULONG startY, ULONG startX, ULONG stopY, ULONG stopX,
+                       ULONG *fromX, ULONG *toX)
+{
+    ULONG length = buffer->doc->lines[y].length;
     
-    /* Allocate memory for result (add 1 for null terminator) */
-    result = (STRPTR)allocVec(totalLen + 1, MEMF_CLEAR);
-    if (!result) {
-        return NULL;
+    if (buffer->marking.column) {
+        *fromX = startX;
+        *toX = stopX;
+    } else {
+        *fromX = (y == startY) ? startX : 0;
+        *toX = (y == stopY) ? stopX : length;
     }
+    if (*toX > length) {
+        *toX = length;
+    }
+    if (*fromX > *toX) {
+        *fromX = *toX;
+    }
+}
+
+/* Selected text without copying where it can be avoided - a selection within one line is
+ * returned in place in the line storage, one spanning lines is gathered (with a newline
+ * between lines) into the view's scratch space in a single pass. Either way the text is
+ * valid until the document or the selection changes, and is not NUL-terminated. */
+BOOL GetBlockSpan(struct TextBuffer *buffer, STRPTR *text, ULONG *length)
+{
+    struct TextLine *lines = NULL;
+    UBYTE *scratch = NULL;
+    ULONG startY = 0;
+    ULONG startX = 0;
+    ULONG stopY = 0;
+    ULONG stopX = 0;
+    ULONG used = 0;
+    ULONG i = 0;
+    ULONG fromX = 0;
+    ULONG toX = 0;
     
-    ptr = result;
+    if (!text || !length || !GetBlockBounds(buffer, &startY, &startX, &stopY, &stopX)) {
+        return FALSE;
+    }
+    lines = buffer->doc->lines;
     
-    /* Copy selected text */
+    /* Single line selection - the line storage already holds it */
     if (startY == stopY) {
-        /* Single line selection */
-        if (startY < buffer->lineCount && startX < buffer->lines[startY].length) {
-            lineLen = stopX - startX;
-            if (lineLen > buffer->lines[startY].length - startX) {
-                lineLen = buffer->lines[startY].length - startX;
-            }
-            if (lineLen > 0) {
-                CopyMem(&buffer->lines[startY].text[startX], ptr, lineLen);
-                ptr += lineLen;
-            }
+        GetBlockLineRange(buffer, startY, startY, startX, stopY, stopX, &fromX, &toX);
+        if (fromX >= toX) {
+            *text = "";
+            *length = 0;
+        } else {
+            *text = &lines[startY].text[fromX];
+            *length = toX - fromX;
         }
-    } else {
-        /* Multi-line selection */
-        /* First line */
-        if (startY < buffer->lineCount) {
-            lineLen = buffer->lines[startY].length;
-            if (startX < lineLen) {
-                ULONG copyLen = lineLen - startX;
-                CopyMem(&buffer->lines[startY].text[startX], ptr, copyLen);
-                ptr += copyLen;
-            }
+        return TRUE;
+    }
+    
+    /* Multi-line selection - one pass, growing the scratch space as it goes */
+    for (i = startY; i <= stopY; i++) {
+        GetBlockLineRange(buffer, i, startY, startX, stopY, stopX, &fromX, &toX);
+        scratch = GetScratch(buffer, used + (toX - fromX) + 1);
+        if (!scratch) {
+            return FALSE;
         }
-        /* Middle lines */
-        for (i = startY + 1; i < stopY && i < buffer->lineCount; i++) {
-            lineLen = buffer->lines[i].length;
-            CopyMem(buffer->lines[i].text, ptr, lineLen);
-            ptr += lineLen;
-        }
-        /* Last line */
-        if (stopY < buffer->lineCount) {
-            lineLen = buffer->lines[stopY].length;
-            if (stopX > lineLen) {
-                stopX = lineLen;
-            }
-            if (stopX > 0) {
-                CopyMem(buffer->lines[stopY].text, ptr, stopX);
-                ptr += stopX;
-            }
+        if (toX > fromX) {
+            CopyMem(&lines[i].text[fromX], &scratch[used], toX - fromX);
+            used += toX - fromX;
+        }
+        if (i < stopY) {
+            scratch[used++] = '\n';
         }
     }
     
-    /* Null terminate */
-    *ptr = '\0';
-    
-    return result;
+    *text = (STRPTR)buffer->scratch;
+    *length = used;
+    return TRUE;
 }
 
 /* Delete selected block */
@@ -190,6 +225,14 @@ BOOL DeleteBlock(struct TextBuffer *buffer, struct CleanupStack *stack)
         return FALSE;
     }
     
+    /* A column block comes out of each line in place */
+    if (buffer->marking.column) {
+        if (!GetBlockBounds(buffer, &startY, &startX, &stopY, &stopX)) {
+            return FALSE;
+        }
+        return DeleteColumnBlock(buffer, startY, startX, stopY, stopX);
+    }
+    
     /* Normalize marking */
     NormalizeMarking(&buffer->marking);
     startY = buffer->marking.startY;
@@ -197,13 +240,13 @@ BOOL DeleteBlock(struct TextBuffer *buffer, struct CleanupStack *stack)
     stopY = buffer->marking.stopY;
     stopX = buffer->marking.stopX;
     
-    if (startY >= buffer->lineCount || stopY >= buffer->lineCount) {
+    if (startY >= buffer->doc->lineCount || stopY >= buffer->doc->lineCount) {
         return FALSE;
     }
     
     if (startY == stopY) {
         /* Single line deletion */
-        lineLen = buffer->lines[startY].length;
+        lineLen = buffer->doc->lines[startY].length;
         if (stopX > lineLen) {
             stopX = lineLen;
         }
@@ -224,19 +267,19 @@ BOOL DeleteBlock(struct TextBuffer *buffer, struct CleanupStack *stack)
         
         /* Copy before selection */
         if (startX > 0) {
-            CopyMem(buffer->lines[startY].text, newText, startX);
+            CopyMem(buffer->doc->lines[startY].text, newText, startX);
         }
         
         /* Copy after selection */
         if (stopX < lineLen) {
-            CopyMem(&buffer->lines[startY].text[stopX], &newText[startX], lineLen - stopX);
+            CopyMem(&buffer->doc->lines[startY].text[stopX], &newText[startX], lineLen - stopX);
         }
         
         /* Replace line text */
-        freeVec(buffer->lines[startY].text);
-        buffer->lines[startY].text = newText;
-        buffer->lines[startY].length = newLen;
-        buffer->lines[startY].allocated = newLen + 1;
+        freeVec(buffer->doc->lines[startY].text);
+        buffer->doc->lines[startY].text = newText;
+        buffer->doc->lines[startY].length = newLen;
+        buffer->doc->lines[startY].allocated = newLen + 1;
         
         /* Move cursor to start of deletion */
         buffer->cursorX = startX;
@@ -244,28 +287,28 @@ BOOL DeleteBlock(struct TextBuffer *buffer, struct CleanupStack *stack)
     } else {
         /* Multi-line deletion */
         /* Modify first line */
-        lineLen = buffer->lines[startY].length;
+        lineLen = buffer->doc->lines[startY].length;
         if (startX < lineLen) {
             newLen = startX;
             newText = (STRPTR)allocVec(newLen + 1, MEMF_CLEAR);
             if (newText) {
                 if (startX > 0) {
-                    CopyMem(buffer->lines[startY].text, newText, startX);
+                    CopyMem(buffer->doc->lines[startY].text, newText, startX);
                 }
-                freeVec(buffer->lines[startY].text);
-                buffer->lines[startY].text = newText;
-                buffer->lines[startY].length = newLen;
-                buffer->lines[startY].allocated = newLen + 1;
+                freeVec(buffer->doc->lines[startY].text);
+                buffer->doc->lines[startY].text = newText;
+                buffer->doc->lines[startY].length = newLen;
+                buffer->doc->lines[startY].allocated = newLen + 1;
             }
         }
         
-        /* Append last line to first line if needed */
-        if (stopY < buffer->lineCount) {
+        /* Append the rest of the last line (after the selection) to the first line */
+        if (stopY < buffer->doc->lineCount) {
             ULONG appendLen;
-            lineLen = buffer->lines[startY].length;
-            appendLen = buffer->lines[stopY].length;
-            if (stopX < appendLen) {
-                appendLen = stopX;
+            lineLen = buffer->doc->lines[startY].length;
+            appendLen = 0;
+            if (stopX < buffer->doc->lines[stopY].length) {
+                appendLen = buffer->doc->lines[stopY].length - stopX;
             }
             if (appendLen > 0) {
                 ULONG newTotalLen;
@@ -273,33 +316,33 @@ BOOL DeleteBlock(struct TextBuffer *buffer, struct CleanupStack *stack)
                 newText = (STRPTR)allocVec(newTotalLen + 1, MEMF_CLEAR);
                 if (newText) {
                     if (lineLen > 0) {
-                        CopyMem(buffer->lines[startY].text, newText, lineLen);
+                        CopyMem(buffer->doc->lines[startY].text, newText, lineLen);
                     }
-                    CopyMem(buffer->lines[stopY].text, &newText[lineLen], appendLen);
-                    freeVec(buffer->lines[startY].text);
-                    buffer->lines[startY].text = newText;
-                    buffer->lines[startY].length = newTotalLen;
-                    buffer->lines[startY].allocated = newTotalLen + 1;
+                    CopyMem(&buffer->doc->lines[stopY].text[stopX], &newText[lineLen], appendLen);
+                    freeVec(buffer->doc->lines[startY].text);
+                    buffer->doc->lines[startY].text = newText;
+                    buffer->doc->lines[startY].length = newTotalLen;
+                    buffer->doc->lines[startY].allocated = newTotalLen + 1;
                 }
             }
         }
         
         /* Delete middle lines */
-        for (i = startY + 1; i <= stopY && i < buffer->lineCount; i++) {
-            if (buffer->lines[i].text) {
-                freeVec(buffer->lines[i].text);
-                buffer->lines[i].text = NULL;
-                buffer->lines[i].length = 0;
+        for (i = startY + 1; i <= stopY && i < buffer->doc->lineCount; i++) {
+            if (buffer->doc->lines[i].text) {
+                freeVec(buffer->doc->lines[i].text);
+                buffer->doc->lines[i].text = NULL;
+                buffer->doc->lines[i].length = 0;
             }
         }
         
         /* Shift remaining lines up */
-        for (i = stopY + 1; i < buffer->lineCount; i++) {
-            buffer->lines[startY + 1 + (i - stopY - 1)] = buffer->lines[i];
+        for (i = stopY + 1; i < buffer->doc->lineCount; i++) {
+            buffer->doc->lines[startY + 1 + (i - stopY - 1)] = buffer->doc->lines[i];
         }
         
         /* Update line count */
-        buffer->lineCount -= (stopY - startY);
+        buffer->doc->lineCount -= (stopY - startY);
         
         /* Move cursor to start of deletion */
         buffer->cursorX = startX;
@@ -308,7 +351,7 @@ BOOL DeleteBlock(struct TextBuffer *buffer, struct CleanupStack *stack)
     
     /* Clear marking */
     buffer->marking.enabled = FALSE;
-    buffer->modified = TRUE;
+    DocumentChanged(buffer, startY, -(LONG)(stopY - startY));
     
     return TRUE;
 }
@@ -321,11 +364,12 @@ VOID MarkAllBlock(struct TextBuffer *buffer)
     }
     
     buffer->marking.enabled = TRUE;
+    buffer->marking.column = FALSE;
     buffer->marking.startY = 0;
     buffer->marking.startX = 0;
-    if (buffer->lineCount > 0) {
-        buffer->marking.stopY = buffer->lineCount - 1;
-        buffer->marking.stopX = buffer->lines[buffer->lineCount - 1].length;
+    if (buffer->doc->lineCount > 0) {
+        buffer->marking.stopY = buffer->doc->lineCount - 1;
+        buffer->marking.stopX = buffer->doc->lines[buffer->doc->lineCount - 1].length;
     } else {
         buffer->marking.stopY = 0;
         buffer->marking.stopX = 0;
@@ -340,6 +384,7 @@ VOID SetMarking(struct TextBuffer *buffer, ULONG startY, ULONG startX, ULONG sto
     }
     
     buffer->marking.enabled = TRUE;
+    buffer->marking.column = FALSE;
     buffer->marking.startY = startY;
     buffer->marking.startX = startX;
     buffer->marking.stopY = stopY;
@@ -356,6 +401,255 @@ VOID ClearMarking(struct TextBuffer *buffer)
     buffer->marking.enabled = FALSE;
 }
 
+/* ============================================================================
+ * Column Blocks
+ * ============================================================================ */
+
+/* A column block (marking.column) covers columns startX to stopX of every line from startY
+ * to stopY. Each operation below makes one pass over those lines, working in the line storage
+ * in place - a line is only reallocated when it has to grow past what it has allocated - and
+ * the whole pass is one edit batch, so layout and the journal are updated once. */
+
+/* Take columns left to right out of lines startY to stopY, closing each line up in place */
+static BOOL DeleteColumnBlock(struct TextBuffer *buffer, ULONG startY, ULONG left, ULONG stopY, ULONG right)
+{
+    struct TextLine *line = NULL;
+    ULONG fromX = 0;
+    ULONG toX = 0;
+    ULONG width = 0;
+    ULONG i = 0;
+    ULONG j = 0;
+    
+    BeginEditBatch();
+    for (i = startY; i <= stopY; i++) {
+        GetBlockLineRange(buffer, i, startY, left, stopY, right, &fromX, &toX);
+        if (toX > fromX) {
+            line = &buffer->doc->lines[i];
+            width = toX - fromX;
+            for (j = toX; j < line->length; j++) {
+                line->text[j - width] = line->text[j];
+            }
+            line->length -= width;
+            line->text[line->length] = '\0';
+            DocumentChanged(buffer, i, 0);
+        }
+    }
+    EndEditBatch();
+    
+    buffer->cursorY = startY;
+    buffer->cursorX = left;
+    if (buffer->cursorX > buffer->doc->lines[startY].length) {
+        buffer->cursorX = buffer->doc->lines[startY].length;
+    }
+    buffer->marking.enabled = FALSE;
+    return TRUE;
+}
+
+/* Insert text as a column: each of its lines goes in at the cursor column of the next line
+ * down (see NextColumnLine), padding a line out with spaces if it ends short of the column */
+BOOL InsertColumnText(struct TextBuffer *buffer, STRPTR text, ULONG length, ULONG column, struct CleanupStack *stack)
+{
+    struct TextLine *line = NULL;
+    ULONG run = 0;
+    ULONG pos = 0;
+    ULONG at = 0;
+    ULONG i = 0;
+    
+    if (!buffer || !buffer->doc || !buffer->doc->lines || !text || !stack) {
+        return FALSE;
+    }
+    
+    while (pos < length) {
+        if (text[pos] == '\n') {
+            if (!NextColumnLine(buffer, column, stack)) {
+                return FALSE;
+            }
+            pos++;
+            continue;
+        }
+        
+        /* The run up to the next newline */
+        run = 0;
+        while (pos + run < length && text[pos + run] != '\n') {
+            run++;
+        }
+        
+        if (buffer->cursorY >= buffer->doc->lineCount) {
+            return FALSE;
+        }
+        line = &buffer->doc->lines[buffer->cursorY];
+        at = buffer->cursorX;
+        if (!GrowLine(line, ((line->length > at) ? line->length : at) + run + 1)) {
+            return FALSE;
+        }
+        
+        if (line->length > at) {
+            /* Shift the rest of the line right - copy backwards for overlapping memory */
+            for (i = line->length; i > at; i--) {
+                line->text[i - 1 + run] = line->text[i - 1];
+            }
+        } else {
+            for (i = line->length; i < at; i++) {
+                line->text[i] = ' ';
+            }
+            line->length = at;
+        }
+        CopyMem(&text[pos], &line->text[at], run);
+        line->length += run;
+        line->text[line->length] = '\0';
+        buffer->cursorX += run;
+        DocumentChanged(buffer, buffer->cursorY, 0);
+        pos += run;
+    }
+    
+    return TRUE;
+}
+
+/* Move a column paste to column on the next line, adding a line when it runs off the end */
+BOOL NextColumnLine(struct TextBuffer *buffer, ULONG column, struct CleanupStack *stack)
+{
+    if (!buffer || !buffer->doc || buffer->doc->lineCount == 0) {
+        return FALSE;
+    }
+    
+    if (buffer->cursorY + 1 >= buffer->doc->lineCount) {
+        buffer->cursorY = buffer->doc->lineCount - 1;
+        buffer->cursorX = buffer->doc->lines[buffer->cursorY].length;
+        if (!InsertNewline(buffer, stack)) {
+            return FALSE;
+        }
+    } else {
+        buffer->cursorY++;
+    }
+    
+    /* May be past the end of the line - InsertColumnText pads up to it */
+    buffer->cursorX = column;
+    return TRUE;
+}
+
+/* Overwrite the block with ch - a column block is filled out to its right edge on every line */
+BOOL FillBlock(struct TextBuffer *buffer, UBYTE ch, struct CleanupStack *stack)
+{
+    struct TextLine *line = NULL;
+    ULONG startY = 0;
+    ULONG startX = 0;
+    ULONG stopY = 0;
+    ULONG stopX = 0;
+    ULONG fromX = 0;
+    ULONG toX = 0;
+    ULONG i = 0;
+    ULONG j = 0;
+    BOOL ok = TRUE;
+    
+    if (!stack || !GetBlockBounds(buffer, &startY, &startX, &stopY, &stopX)) {
+        return FALSE;
+    }
+    
+    BeginEditBatch();
+    for (i = startY; ok && i <= stopY; i++) {
+        line = &buffer->doc->lines[i];
+        if (buffer->marking.column && line->length < stopX) {
+            if (!GrowLine(line, stopX + 1)) {
+                ok = FALSE;
+                break;
+            }
+            for (j = line->length; j < startX; j++) {
+                line->text[j] = ' ';
+            }
+            line->length = stopX;
+            line->text[stopX] = '\0';
+        }
+        GetBlockLineRange(buffer, i, startY, startX, stopY, stopX, &fromX, &toX);
+        for (j = fromX; j < toX; j++) {
+            line->text[j] = (char)ch;
+        }
+        if (toX > fromX) {
+            DocumentChanged(buffer, i, 0);
+        }
+    }
+    EndEditBatch();
+    
+    return ok;
+}
+
+/* Move a column block and the text right of it along its lines: shift > 0 opens that many
+ * spaces at its left edge, shift < 0 takes out up to that many blanks just left of it.
+ * The marking follows the text (by the least any line moved left). */
+BOOL ShiftColumnBlock(struct TextBuffer *buffer, LONG shift, struct CleanupStack *stack)
+{
+    struct TextLine *line = NULL;
+    ULONG startY = 0;
+    ULONG left = 0;
+    ULONG stopY = 0;
+    ULONG right = 0;
+    ULONG count = 0;
+    ULONG gap = 0;
+    ULONG moved = 0;
+    ULONG i = 0;
+    ULONG j = 0;
+    BOOL ok = TRUE;
+    
+    if (!stack || !buffer || !buffer->marking.column || shift == 0 ||
+        !GetBlockBounds(buffer, &startY, &left, &stopY, &right)) {
+        return FALSE;
+    }
+    count = (shift > 0) ? (ULONG)shift : (ULONG)-shift;
+    moved = count;
+    
+    BeginEditBatch();
+    for (i = startY; ok && i <= stopY; i++) {
+        line = &buffer->doc->lines[i];
+        if (line->length <= left) {
+            /* Nothing at or beyond the block on this line */
+            continue;
+        }
+        if (shift > 0) {
+            if (!GrowLine(line, line->length + count + 1)) {
+                ok = FALSE;
+                break;
+            }
+            for (j = line->length; j > left; j--) {
+                line->text[j - 1 + count] = line->text[j - 1];
+            }
+            for (j = left; j < left + count; j++) {
+                line->text[j] = ' ';
+            }
+            line->length += count;
+        } else {
+            gap = 0;
+            while (gap < count && gap < left &&
+                   (line->text[left - gap - 1] == ' ' || line->text[left - gap - 1] == '\t')) {
+                gap++;
+            }
+            if (gap < moved) {
+                moved = gap;
+            }
+            if (gap == 0) {
+                continue;
+            }
+            for (j = left; j < line->length; j++) {
+                line->text[j - gap] = line->text[j];
+            }
+            line->length -= gap;
+        }
+        line->text[line->length] = '\0';
+        DocumentChanged(buffer, i, 0);
+    }
+    EndEditBatch();
+    
+    if (shift > 0) {
+        buffer->marking.startX = left + count;
+        buffer->marking.stopX = right + count;
+    } else {
+        if (moved > left) {
+            moved = left;
+        }
+        buffer->marking.startX = left - moved;
+        buffer->marking.stopX = right - moved;
+    }
+    return ok;
+}
+
 /* ============================================================================
  * Word Navigation
  * ============================================================================ */
@@ -365,33 +659,33 @@ BOOL MoveNextWord(struct TextBuffer *buffer)
 {
     ULONG lineLen = 0;
     
-    if (!buffer || buffer->cursorY >= buffer->lineCount) {
+    if (!buffer || buffer->cursorY >= buffer->doc->lineCount) {
         return FALSE;
     }
     
-    lineLen = buffer->lines[buffer->cursorY].length;
+    lineLen = buffer->doc->lines[buffer->cursorY].length;
     
     /* Skip current word if we're in the middle of one */
     while (buffer->cursorX < lineLen && 
-           !IsWordSeparator(buffer->lines[buffer->cursorY].text[buffer->cursorX])) {
+           !IsWordSeparator(buffer->doc->lines[buffer->cursorY].text[buffer->cursorX])) {
         buffer->cursorX++;
     }
     
     /* Skip separators */
     while (buffer->cursorX < lineLen && 
-           IsWordSeparator(buffer->lines[buffer->cursorY].text[buffer->cursorX])) {
+           IsWordSeparator(buffer->doc->lines[buffer->cursorY].text[buffer->cursorX])) {
         buffer->cursorX++;
     }
     
     /* If we reached end of line, move to next line */
     if (buffer->cursorX >= lineLen) {
-        if (buffer->cursorY + 1 < buffer->lineCount) {
+        if (buffer->cursorY + 1 < buffer->doc->lineCount) {
             buffer->cursorY++;
             buffer->cursorX = 0;
             /* Skip separators on new line */
-            lineLen = buffer->lines[buffer->cursorY].length;
+            lineLen = buffer->doc->lines[buffer->cursorY].length;
             while (buffer->cursorX < lineLen && 
-                   IsWordSeparator(buffer->lines[buffer->cursorY].text[buffer->cursorX])) {
+                   IsWordSeparator(buffer->doc->lines[buffer->cursorY].text[buffer->cursorX])) {
                 buffer->cursorX++;
             }
         } else {
@@ -409,17 +703,17 @@ BOOL MovePrevWord(struct TextBuffer *buffer)
     ULONG lineLen = 0;
     BOOL moved = FALSE;
     
-    if (!buffer || buffer->cursorY >= buffer->lineCount) {
+    if (!buffer || buffer->cursorY >= buffer->doc->lineCount) {
         return FALSE;
     }
     
-    lineLen = buffer->lines[buffer->cursorY].length;
+    lineLen = buffer->doc->lines[buffer->cursorY].length;
     
     /* If at start of line, move to previous line */
     if (buffer->cursorX == 0) {
         if (buffer->cursorY > 0) {
             buffer->cursorY--;
-            lineLen = buffer->lines[buffer->cursorY].length;
+            lineLen = buffer->doc->lines[buffer->cursorY].length;
             buffer->cursorX = lineLen;
             moved = TRUE;
         } else {
@@ -430,34 +724,34 @@ BOOL MovePrevWord(struct TextBuffer *buffer)
     
     /* Skip separators going backwards */
     while (buffer->cursorX > 0 && 
-           IsWordSeparator(buffer->lines[buffer->cursorY].text[buffer->cursorX - 1])) {
+           IsWordSeparator(buffer->doc->lines[buffer->cursorY].text[buffer->cursorX - 1])) {
         buffer->cursorX--;
         moved = TRUE;
     }
     
     /* Skip word characters going backwards */
     while (buffer->cursorX > 0 && 
-           !IsWordSeparator(buffer->lines[buffer->cursorY].text[buffer->cursorX - 1])) {
+           !IsWordSeparator(buffer->doc->lines[buffer->cursorY].text[buffer->cursorX - 1])) {
         buffer->cursorX--;
         moved = TRUE;
     }
     
     /* If we moved to previous line and are at a separator, try again */
     if (moved && buffer->cursorX > 0 && 
-        IsWordSeparator(buffer->lines[buffer->cursorY].text[buffer->cursorX - 1])) {
+        IsWordSeparator(buffer->doc->lines[buffer->cursorY].text[buffer->cursorX - 1])) {
         /* Continue searching on previous line */
         if (buffer->cursorY > 0) {
             buffer->cursorY--;
-            lineLen = buffer->lines[buffer->cursorY].length;
+            lineLen = buffer->doc->lines[buffer->cursorY].length;
             buffer->cursorX = lineLen;
             /* Skip separators */
             while (buffer->cursorX > 0 && 
-                   IsWordSeparator(buffer->lines[buffer->cursorY].text[buffer->cursorX - 1])) {
+                   IsWordSeparator(buffer->doc->lines[buffer->cursorY].text[buffer->cursorX - 1])) {
                 buffer->cursorX--;
             }
             /* Skip word */
             while (buffer->cursorX > 0 && 
-                   !IsWordSeparator(buffer->lines[buffer->cursorY].text[buffer->cursorX - 1])) {
+                   !IsWordSeparator(buffer->doc->lines[buffer->cursorY].text[buffer->cursorX - 1])) {
                 buffer->cursorX--;
             }
         }
@@ -469,18 +763,18 @@ BOOL MovePrevWord(struct TextBuffer *buffer)
 /* Move to end of line */
 BOOL MoveEndOfLine(struct TextBuffer *buffer)
 {
-    if (!buffer || buffer->cursorY >= buffer->lineCount) {
+    if (!buffer || buffer->cursorY >= buffer->doc->lineCount) {
         return FALSE;
     }
     
-    buffer->cursorX = buffer->lines[buffer->cursorY].length;
+    buffer->cursorX = buffer->doc->lines[buffer->cursorY].length;
     return TRUE;
 }
 
 /* Move to start of line */
 BOOL MoveStartOfLine(struct TextBuffer *buffer)
 {
-    if (!buffer || buffer->cursorY >= buffer->lineCount) {
+    if (!buffer || buffer->cursorY >= buffer->doc->lineCount) {
         return FALSE;
     }
     
@@ -493,27 +787,27 @@ BOOL MoveEndOfWord(struct TextBuffer *buffer)
 {
     ULONG lineLen = 0;
     
-    if (!buffer || buffer->cursorY >= buffer->lineCount) {
+    if (!buffer || buffer->cursorY >= buffer->doc->lineCount) {
         return FALSE;
     }
     
-    lineLen = buffer->lines[buffer->cursorY].length;
+    lineLen = buffer->doc->lines[buffer->cursorY].length;
     
     /* If we're in a word, move to end of it */
     if (buffer->cursorX < lineLen && 
-        !IsWordSeparator(buffer->lines[buffer->cursorY].text[buffer->cursorX])) {
+        !IsWordSeparator(buffer->doc->lines[buffer->cursorY].text[buffer->cursorX])) {
         while (buffer->cursorX < lineLen && 
-               !IsWordSeparator(buffer->lines[buffer->cursorY].text[buffer->cursorX])) {
+               !IsWordSeparator(buffer->doc->lines[buffer->cursorY].text[buffer->cursorX])) {
             buffer->cursorX++;
         }
     } else {
         /* We're at a separator, move to next word start then end */
         while (buffer->cursorX < lineLen && 
-               IsWordSeparator(buffer->lines[buffer->cursorY].text[buffer->cursorX])) {
+               IsWordSeparator(buffer->doc->lines[buffer->cursorY].text[buffer->cursorX])) {
             buffer->cursorX++;
         }
         while (buffer->cursorX < lineLen && 
-               !IsWordSeparator(buffer->lines[buffer->cursorY].text[buffer->cursorX])) {
+               !IsWordSeparator(buffer->doc->lines[buffer->cursorY].text[buffer->cursorX])) {
             buffer->cursorX++;
         }
     }
@@ -521,22 +815,56 @@ BOOL MoveEndOfWord(struct TextBuffer *buffer)
     return TRUE;
 }
 
+/* Word the cursor is in or just after, in place in its line - valid until the document
+ * changes, and not NUL-terminated */
+BOOL GetWordSpan(struct TextBuffer *buffer, STRPTR *text, ULONG *length)
+{
+    STRPTR lineText = NULL;
+    ULONG lineLen = 0;
+    ULONG startX = 0;
+    ULONG endX = 0;
+    
+    if (!buffer || buffer->cursorY >= buffer->doc->lineCount || !text || !length) {
+        return FALSE;
+    }
+    
+    lineText = buffer->doc->lines[buffer->cursorY].text;
+    lineLen = buffer->doc->lines[buffer->cursorY].length;
+    startX = buffer->cursorX < lineLen ? buffer->cursorX : lineLen;
+    endX = startX;
+    
+    while (startX > 0 && !IsWordSeparator((UBYTE)lineText[startX - 1])) {
+        startX--;
+    }
+    while (endX < lineLen && !IsWordSeparator((UBYTE)lineText[endX])) {
+        endX++;
+    }
+    
+    if (startX >= endX) {
+        return FALSE;  /* Not on a word */
+    }
+    
+    *text = &lineText[startX];
+    *length = endX - startX;
+    return TRUE;
+}
+
 /* Move to start of word */
 BOOL MoveStartOfWord(struct TextBuffer *buffer)
 {
     ULONG lineLen = 0;
     
-    if (!buffer || buffer->cursorY >= buffer->lineCount) {
+    if (!buffer || buffer->cursorY >= buffer->doc->lineCount) {
         return FALSE;
     }
     
-    lineLen = buffer->lines[buffer->cursorY].length;
+    lineLen = buffer->doc->lines[buffer->cursorY].length;
     
     /* If at start of line, move to previous line */
     if (buffer->cursorX == 0) {
         if (buffer->cursorY > 0) {
             buffer->cursorY--;
-            lineLen = buffer->lines[buffer->cursorY].length;
+            lineLen = buffer->doc->lines[buffer->cursorY].length;
             buffer->cursorX = lineLen;
         } else {
             return FALSE;
@@ -545,13 +873,13 @@ BOOL MoveStartOfWord(struct TextBuffer *buffer)
     
     /* Skip separators going backwards */
     while (buffer->cursorX > 0 && 
-           IsWordSeparator(buffer->lines[buffer->cursorY].text[buffer->cursorX - 1])) {
+           IsWordSeparator(buffer->doc->lines[buffer->cursorY].text[buffer->cursorX - 1])) {
         buffer->cursorX--;
     }
     
     /* Skip word characters going backwards */
     while (buffer->cursorX > 0 && 
-           !IsWordSeparator(buffer->lines[buffer->cursorY].text[buffer->cursorX - 1])) {
+           !IsWordSeparator(buffer->doc->lines[buffer->cursorY].text[buffer->cursorX - 1])) {
         buffer->cursorX--;
     }
     
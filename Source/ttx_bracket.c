@@ -0,0 +1,625 @@
+/*
+ * TTX - Bracket Matching
+ *
+ * Copyright (c) 2025 amigazen project
+ * Licensed under BSD 2-Clause License
+ *
+ * Finding the bracket that matches another means counting depth across all
+ * the text in between, which on a large file can be most of it. Instead the
+ * lines are cut into chunks, and each chunk keeps, for each kind of bracket,
+ * its net depth and the lowest depth reached inside it. A chunk whose lowest
+ * depth cannot bring the count to zero holds no match and is passed over
+ * whole, by adding its net depth.
+ *
+ * The chunk summaries are the leaves of a segment tree, where every node
+ * sums the two below it, so the first chunk holding the match is found in
+ * O(log n) and only that chunk is scanned. An edit only marks the chunks it
+ * touched - it grows or shrinks the chunk it was in - and they are rescanned
+ * before the next search. Chunks that emptied or grew too long are cut again
+ * then, keeping the summaries of the others.
+ *
+ * The index is built by the first search in a document, or ahead of it at
+ * idle time, when stale chunks are also rescanned a few at a time. Brackets
+ * are counted wherever they are, inside strings and comments too.
+ *
+ * The same scan counts each chunk's words and characters, so the document
+ * statistics are read off the root of the tree rather than counted again
+ * over the whole text after every edit.
+ */
+
+#include "ttx.h"
+
+/* Brackets by kind */
+static const UBYTE g_bracketOpen[BRACKET_KINDS] = { '(', '[', '{' };
+static const UBYTE g_bracketClose[BRACKET_KINDS] = { ')', ']', '}' };
+
+/* Forward declarations */
+static BOOL PrepareBracketIndex(struct TextDocument *doc);
+static BOOL ShapeBracketIndex(struct TextDocument *doc);
+static BOOL ScanStaleChunks(struct TextDocument *doc, ULONG maxChunks);
+static BOOL ReshapeBracketIndex(struct TextDocument *doc);
+static BOOL AllocBracketTree(struct BracketIndex *index, ULONG chunkCount);
+static VOID ScanBracketChunk(struct TextDocument *doc, ULONG startY, ULONG lines, struct BracketNode *node);
+static VOID UpdateBracketPath(struct BracketIndex *index, ULONG chunk);
+static VOID JoinBracketNodes(struct BracketNode *node, struct BracketNode *left, struct BracketNode *right);
+static ULONG FindBracketChunk(struct BracketIndex *index, ULONG y, ULONG *startY);
+static ULONG GetBracketChunkStart(struct BracketIndex *index, ULONG chunk);
+static LONG FindChunkAfter(struct BracketIndex *index, ULONG chunk, UWORD kind, LONG *depth);
+static LONG FindChunkBefore(struct BracketIndex *index, ULONG chunk, UWORD kind, LONG *depth);
+static BOOL ScanForward(struct TextDocument *doc, UWORD kind, ULONG y, ULONG x, ULONG endY,
+                        LONG *depth, ULONG *matchY, ULONG *matchX);
+static BOOL ScanBackward(struct TextDocument *doc, UWORD kind, ULONG y, ULONG x, ULONG startY,
+                         LONG *depth, ULONG *matchY, ULONG *matchX);
+
+/* ============================================================================
+ * Bracket Matching
+ * ============================================================================ */
+
+/* Find the bracket matching the one at (y, x) - FALSE if that is no bracket or it has no match */
+BOOL FindMatchingBracket(struct TextDocument *doc, ULONG y, ULONG x, ULONG *matchY, ULONG *matchX)
+{
+    struct BracketIndex *index = NULL;
+    struct TextLine *line = NULL;
+    UWORD kind = 0;
+    BOOL opening = FALSE;
+    LONG depth = 1;  /* Brackets left to match, counting this one */
+    LONG chunk = 0;
+    ULONG chunkStart = 0;
+    ULONG chunkLines = 0;
+
+    if (!doc || !doc->lines || y >= doc->lineCount) {
+        return FALSE;
+    }
+    line = &doc->lines[y];
+    if (x >= line->length) {
+        return FALSE;
+    }
+    for (kind = 0; kind < BRACKET_KINDS; kind++) {
+        if (line->text[x] == g_bracketOpen[kind]) {
+            opening = TRUE;
+            break;
+        }
+        if (line->text[x] == g_bracketClose[kind]) {
+            break;
+        }
+    }
+    if (kind == BRACKET_KINDS) {
+        return FALSE;
+    }
+
+    if (!PrepareBracketIndex(doc)) {
+        /* No memory for the index - walk the text */
+        if (opening) {
+            return ScanForward(doc, kind, y, x + 1, doc->lineCount, &depth, matchY, matchX);
+        }
+        return ScanBackward(doc, kind, y, x, 0, &depth, matchY, matchX);
+    }
+    index = doc->brackets;
+
+    /* The rest of the bracket's own chunk, then straight to the chunk the match is in */
+    chunk = (LONG)FindBracketChunk(index, y, &chunkStart);
+    if (opening) {
+        chunkLines = index->nodes[index->leafCount + chunk].lines;
+        if (ScanForward(doc, kind, y, x + 1, chunkStart + chunkLines, &depth, matchY, matchX)) {
+            return TRUE;
+        }
+        chunk = FindChunkAfter(index, (ULONG)chunk, kind, &depth);
+        if (chunk < 0) {
+            return FALSE;
+        }
+        chunkStart = GetBracketChunkStart(index, (ULONG)chunk);
+        chunkLines = index->nodes[index->leafCount + chunk].lines;
+        return ScanForward(doc, kind, chunkStart, 0, chunkStart + chunkLines, &depth, matchY, matchX);
+    }
+
+    if (ScanBackward(doc, kind, y, x, chunkStart, &depth, matchY, matchX)) {
+        return TRUE;
+    }
+    chunk = FindChunkBefore(index, (ULONG)chunk, kind, &depth);
+    if (chunk < 0) {
+        return FALSE;
+    }
+    chunkStart = GetBracketChunkStart(index, (ULONG)chunk);
+    chunkLines = index->nodes[index->leafCount + chunk].lines;
+    y = chunkStart + chunkLines - 1;
+    return ScanBackward(doc, kind, y, doc->lines[y].length, chunkStart, &depth, matchY, matchX);
+}
+
+/* Follow lineDelta lines inserted (>0) or removed (<0) after lineY - only the chunks they touch go stale */
+VOID BracketLinesChanged(struct TextDocument *doc, ULONG lineY, LONG lineDelta)
+{
+    struct BracketIndex *index = doc ? doc->brackets : NULL;
+    struct BracketNode *leaf = NULL;
+    ULONG chunk = 0;
+    ULONG chunkStart = 0;
+    ULONG removed = 0;
+    ULONG taken = 0;
+
+    if (!index) {
+        return;
+    }
+    if (lineY == DOC_CHANGE_ALL || lineY >= index->nodes[1].lines) {
+        /* Built again by the next search */
+        FreeBracketIndex(doc);
+        return;
+    }
+
+    chunk = FindBracketChunk(index, lineY, &chunkStart);
+    if (chunk < index->scanFrom) {
+        index->scanFrom = chunk;
+    }
+    leaf = &index->nodes[index->leafCount + chunk];
+    if (lineDelta >= 0) {
+        leaf->lines += (ULONG)lineDelta;
+        if (leaf->lines > 2 * BRACKET_CHUNK_LINES) {
+            index->reshape = TRUE;
+        }
+    } else {
+        /* Lines after lineY in its own chunk first, then whole or leading parts of the next ones */
+        removed = (ULONG)(-lineDelta);
+        taken = chunkStart + leaf->lines - (lineY + 1);
+        if (taken > removed) {
+            taken = removed;
+        }
+        leaf->lines -= taken;
+        removed -= taken;
+        while (removed > 0 && chunk + 1 < index->chunkCount) {
+            if (!index->dirty[chunk]) {
+                index->dirty[chunk] = TRUE;
+                index->dirtyCount++;
+            }
+            UpdateBracketPath(index, chunk);
+            chunk++;
+            leaf = &index->nodes[index->leafCount + chunk];
+            taken = (leaf->lines < removed) ? leaf->lines : removed;
+            leaf->lines -= taken;
+            removed -= taken;
+            if (leaf->lines == 0) {
+                index->reshape = TRUE;
+            }
+        }
+    }
+    if (!index->dirty[chunk]) {
+        index->dirty[chunk] = TRUE;
+        index->dirtyCount++;
+    }
+    UpdateBracketPath(index, chunk);
+}
+
+/* Build a document's index, or rescan up to maxChunks of its stale chunks, so that the next
+ * search need not - TRUE while more are left */
+BOOL UpdateBracketIndex(struct TextDocument *doc, ULONG maxChunks)
+{
+    if (!doc || !doc->lines || doc->lineCount == 0) {
+        return FALSE;
+    }
+    if (!ShapeBracketIndex(doc)) {
+        return FALSE;
+    }
+    return ScanStaleChunks(doc, maxChunks);
+}
+
+/* Words and characters of a document, summed in its index - FALSE unless the index is up to date */
+BOOL GetDocumentCounts(struct TextDocument *doc, ULONG *words, ULONG *chars)
+{
+    struct BracketIndex *index = doc ? doc->brackets : NULL;
+
+    if (!index || index->reshape || index->dirtyCount > 0 || index->nodes[1].lines != doc->lineCount) {
+        return FALSE;
+    }
+    *words = index->nodes[1].words;
+    /* A line break after every line but the last */
+    *chars = index->nodes[1].chars + doc->lineCount - 1;
+    return TRUE;
+}
+
+/* Free a document's bracket index */
+VOID FreeBracketIndex(struct TextDocument *doc)
+{
+    if (!doc || !doc->brackets) {
+        return;
+    }
+    if (doc->brackets->nodes) {
+        freeVec(doc->brackets->nodes);
+    }
+    if (doc->brackets->dirty) {
+        freeVec(doc->brackets->dirty);
+    }
+    freeVec(doc->brackets);
+    doc->brackets = NULL;
+}
+
+/* ============================================================================
+ * Index
+ * ============================================================================ */
+
+/* Build the index, or bring it up to date - FALSE if out of memory */
+static BOOL PrepareBracketIndex(struct TextDocument *doc)
+{
+    if (!ShapeBracketIndex(doc)) {
+        return FALSE;
+    }
+    ScanStaleChunks(doc, doc->brackets->chunkCount);
+    return TRUE;
+}
+
+/* Make the index, every chunk stale, or cut up its chunks again - FALSE if out of memory */
+static BOOL ShapeBracketIndex(struct TextDocument *doc)
+{
+    struct BracketIndex *index = doc->brackets;
+    ULONG chunk = 0;
+    ULONG chunkCount = 0;
+
+    /* Lines came in without an edit (a file still loading) - start again */
+    if (index && index->nodes[1].lines != doc->lineCount) {
+        FreeBracketIndex(doc);
+        index = NULL;
+    }
+
+    if (!index) {
+        index = (struct BracketIndex *)allocVec(sizeof(struct BracketIndex), MEMF_CLEAR);
+        if (!index) {
+            return FALSE;
+        }
+        chunkCount = (doc->lineCount + BRACKET_CHUNK_LINES - 1) / BRACKET_CHUNK_LINES;
+        if (!AllocBracketTree(index, chunkCount)) {
+            freeVec(index);
+            return FALSE;
+        }
+        for (chunk = 0; chunk < chunkCount; chunk++) {
+            index->nodes[index->leafCount + chunk].lines = BRACKET_CHUNK_LINES;
+            index->dirty[chunk] = TRUE;
+        }
+        index->nodes[index->leafCount + chunkCount - 1].lines = doc->lineCount - (chunkCount - 1) * BRACKET_CHUNK_LINES;
+        index->chunkCount = chunkCount;
+        index->dirtyCount = chunkCount;
+        /* Line counts up the tree now - the chunks may be scanned over several calls */
+        for (chunk = index->leafCount - 1; chunk >= 1; chunk--) {
+            JoinBracketNodes(&index->nodes[chunk], &index->nodes[2 * chunk], &index->nodes[2 * chunk + 1]);
+        }
+        doc->brackets = index;
+    } else if (index->reshape && !ReshapeBracketIndex(doc)) {
+        FreeBracketIndex(doc);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/* Rescan up to maxChunks stale chunks, on from where the last rescan stopped - TRUE while more are left */
+static BOOL ScanStaleChunks(struct TextDocument *doc, ULONG maxChunks)
+{
+    struct BracketIndex *index = doc->brackets;
+    struct BracketNode *leaf = NULL;
+    ULONG chunk = index->scanFrom;
+    ULONG startY = 0;
+    ULONG scanned = 0;
+
+    if (index->dirtyCount == 0 || chunk >= index->chunkCount) {
+        return FALSE;
+    }
+    startY = GetBracketChunkStart(index, chunk);
+    for (; chunk < index->chunkCount && index->dirtyCount > 0; chunk++) {
+        leaf = &index->nodes[index->leafCount + chunk];
+        if (index->dirty[chunk]) {
+            if (scanned == maxChunks) {
+                break;
+            }
+            ScanBracketChunk(doc, startY, leaf->lines, leaf);
+            index->dirty[chunk] = FALSE;
+            index->dirtyCount--;
+            UpdateBracketPath(index, chunk);
+            scanned++;
+        }
+        startY += leaf->lines;
+    }
+    index->scanFrom = chunk;
+    return (BOOL)(index->dirtyCount > 0);
+}
+
+/* Drop the chunks that emptied and cut up those grown too long - the others keep their summaries */
+static BOOL ReshapeBracketIndex(struct TextDocument *doc)
+{
+    struct BracketIndex *index = doc->brackets;
+    struct BracketIndex shaped;
+    struct BracketNode *leaf = NULL;
+    ULONG chunk = 0;
+    ULONG count = 0;
+    ULONG lines = 0;
+    ULONG i = 0;
+
+    for (chunk = 0; chunk < index->chunkCount; chunk++) {
+        lines = index->nodes[index->leafCount + chunk].lines;
+        if (lines > 2 * BRACKET_CHUNK_LINES) {
+            count += (lines + BRACKET_CHUNK_LINES - 1) / BRACKET_CHUNK_LINES;
+        } else if (lines > 0) {
+            count++;
+        }
+    }
+    if (count == 0) {
+        count = 1;
+    }
+
+    shaped = *index;
+    if (!AllocBracketTree(&shaped, count)) {
+        return FALSE;
+    }
+    shaped.chunkCount = 0;
+    shaped.dirtyCount = 0;
+    shaped.scanFrom = 0;
+    for (chunk = 0; chunk < index->chunkCount; chunk++) {
+        leaf = &index->nodes[index->leafCount + chunk];
+        if (leaf->lines == 0) {
+            continue;
+        }
+        if (leaf->lines <= 2 * BRACKET_CHUNK_LINES) {
+            shaped.nodes[shaped.leafCount + shaped.chunkCount] = *leaf;
+            shaped.dirty[shaped.chunkCount] = index->dirty[chunk];
+            shaped.chunkCount++;
+            continue;
+        }
+        for (lines = leaf->lines; lines > 0; lines -= i) {
+            i = (lines < BRACKET_CHUNK_LINES) ? lines : BRACKET_CHUNK_LINES;
+            shaped.nodes[shaped.leafCount + shaped.chunkCount].lines = i;
+            shaped.dirty[shaped.chunkCount] = TRUE;
+            shaped.chunkCount++;
+        }
+    }
+    for (chunk = 0; chunk < shaped.chunkCount; chunk++) {
+        if (shaped.dirty[chunk]) {
+            shaped.dirtyCount++;
+        }
+    }
+    for (i = shaped.leafCount - 1; i >= 1; i--) {
+        JoinBracketNodes(&shaped.nodes[i], &shaped.nodes[2 * i], &shaped.nodes[2 * i + 1]);
+    }
+    shaped.reshape = FALSE;
+
+    freeVec(index->nodes);
+    freeVec(index->dirty);
+    *index = shaped;
+    return TRUE;
+}
+
+/* Room for a tree of chunkCount chunks, all empty */
+static BOOL AllocBracketTree(struct BracketIndex *index, ULONG chunkCount)
+{
+    ULONG leafCount = 1;
+
+    while (leafCount < chunkCount) {
+        leafCount <<= 1;
+    }
+    index->nodes = (struct BracketNode *)allocVec(2 * leafCount * sizeof(struct BracketNode), MEMF_CLEAR);
+    index->dirty = (UBYTE *)allocVec(leafCount, MEMF_CLEAR);
+    if (!index->nodes || !index->dirty) {
+        if (index->nodes) {
+            freeVec(index->nodes);
+        }
+        if (index->dirty) {
+            freeVec(index->dirty);
+        }
+        index->nodes = NULL;
+        index->dirty = NULL;
+        return FALSE;
+    }
+    index->leafCount = leafCount;
+    return TRUE;
+}
+
+/* Count the brackets of a chunk of lines */
+static VOID ScanBracketChunk(struct TextDocument *doc, ULONG startY, ULONG lines, struct BracketNode *node)
+{
+    struct TextLine *line = NULL;
+    ULONG y = 0;
+    ULONG x = 0;
+    UWORD kind = 0;
+    UBYTE ch = 0;
+    BOOL inWord = FALSE;
+
+    for (kind = 0; kind < BRACKET_KINDS; kind++) {
+        node->sum[kind].net = 0;
+        node->sum[kind].low = 0;
+    }
+    node->words = 0;
+    node->chars = 0;
+    for (y = startY; y < startY + lines && y < doc->lineCount; y++) {
+        line = &doc->lines[y];
+        node->chars += line->length;
+        inWord = FALSE;
+        for (x = 0; x < line->length; x++) {
+            ch = (UBYTE)line->text[x];
+            if (ch == ' ' || ch == '\t') {
+                inWord = FALSE;
+            } else if (!inWord) {
+                inWord = TRUE;
+                node->words++;
+            }
+            switch (ch) {
+                case '(': node->sum[0].net++; break;
+                case '[': node->sum[1].net++; break;
+                case '{': node->sum[2].net++; break;
+                case ')': kind = 0; goto closing;
+                case ']': kind = 1; goto closing;
+                case '}': kind = 2; goto closing;
+                default: break;
+            }
+            continue;
+        closing:
+            node->sum[kind].net--;
+            if (node->sum[kind].net < node->sum[kind].low) {
+                node->sum[kind].low = node->sum[kind].net;
+            }
+        }
+    }
+}
+
+/* Sum a chunk again into every node above it */
+static VOID UpdateBracketPath(struct BracketIndex *index, ULONG chunk)
+{
+    ULONG node = (index->leafCount + chunk) >> 1;
+
+    for (; node >= 1; node >>= 1) {
+        JoinBracketNodes(&index->nodes[node], &index->nodes[2 * node], &index->nodes[2 * node + 1]);
+    }
+}
+
+/* Summary of left followed by right */
+static VOID JoinBracketNodes(struct BracketNode *node, struct BracketNode *left, struct BracketNode *right)
+{
+    UWORD kind = 0;
+    LONG low = 0;
+
+    node->lines = left->lines + right->lines;
+    node->words = left->words + right->words;
+    node->chars = left->chars + right->chars;
+    for (kind = 0; kind < BRACKET_KINDS; kind++) {
+        low = left->sum[kind].net + right->sum[kind].low;
+        node->sum[kind].low = (left->sum[kind].low < low) ? left->sum[kind].low : low;
+        node->sum[kind].net = left->sum[kind].net + right->sum[kind].net;
+    }
+}
+
+/* Chunk holding line y, and the line it starts at */
+static ULONG FindBracketChunk(struct BracketIndex *index, ULONG y, ULONG *startY)
+{
+    ULONG node = 1;
+
+    *startY = 0;
+    while (node < index->leafCount) {
+        if (y < *startY + index->nodes[2 * node].lines) {
+            node = 2 * node;
+        } else {
+            *startY += index->nodes[2 * node].lines;
+            node = 2 * node + 1;
+        }
+    }
+    return node - index->leafCount;
+}
+
+/* Line a chunk starts at */
+static ULONG GetBracketChunkStart(struct BracketIndex *index, ULONG chunk)
+{
+    ULONG node = index->leafCount + chunk;
+    ULONG startY = 0;
+
+    for (; node > 1; node >>= 1) {
+        if (node & 1) {
+            startY += index->nodes[node - 1].lines;
+        }
+    }
+    return startY;
+}
+
+/* First chunk after the given one in which depth falls to zero - -1 if there is none */
+static LONG FindChunkAfter(struct BracketIndex *index, ULONG chunk, UWORD kind, LONG *depth)
+{
+    struct BracketNode *nodes = index->nodes;
+    ULONG node = index->leafCount + chunk;
+
+    /* Up until a subtree to the right holds it, passing over the rest */
+    for (; node > 1; node >>= 1) {
+        if ((node & 1) == 0) {
+            if (*depth + nodes[node + 1].sum[kind].low <= 0) {
+                break;
+            }
+            *depth += nodes[node + 1].sum[kind].net;
+        }
+    }
+    if (node <= 1) {
+        return -1;
+    }
+
+    /* Down to the first chunk of it that does */
+    for (node = node + 1; node < index->leafCount; ) {
+        if (*depth + nodes[2 * node].sum[kind].low <= 0) {
+            node = 2 * node;
+        } else {
+            *depth += nodes[2 * node].sum[kind].net;
+            node = 2 * node + 1;
+        }
+    }
+    return (LONG)(node - index->leafCount);
+}
+
+/* Last chunk before the given one in which depth, counted backwards, falls to zero - -1 if there is none */
+static LONG FindChunkBefore(struct BracketIndex *index, ULONG chunk, UWORD kind, LONG *depth)
+{
+    struct BracketNode *nodes = index->nodes;
+    ULONG node = index->leafCount + chunk;
+
+    /* Backwards, a run reaches down by its net depth less its lowest */
+    for (; node > 1; node >>= 1) {
+        if (node & 1) {
+            if (*depth <= nodes[node - 1].sum[kind].net - nodes[node - 1].sum[kind].low) {
+                break;
+            }
+            *depth -= nodes[node - 1].sum[kind].net;
+        }
+    }
+    if (node <= 1) {
+        return -1;
+    }
+
+    for (node = node - 1; node < index->leafCount; ) {
+        if (*depth <= nodes[2 * node + 1].sum[kind].net - nodes[2 * node + 1].sum[kind].low) {
+            node = 2 * node + 1;
+        } else {
+            *depth -= nodes[2 * node + 1].sum[kind].net;
+            node = 2 * node;
+        }
+    }
+    return (LONG)(node - index->leafCount);
+}
+
+/* ============================================================================
+ * Text Scans
+ * ============================================================================ */
+
+/* Count brackets from (y, x) up to line endY - TRUE once depth falls to zero */
+static BOOL ScanForward(struct TextDocument *doc, UWORD kind, ULONG y, ULONG x, ULONG endY,
+                        LONG *depth, ULONG *matchY, ULONG *matchX)
+{
+    struct TextLine *line = NULL;
+
+    if (endY > doc->lineCount) {
+        endY = doc->lineCount;
+    }
+    for (; y < endY; y++, x = 0) {
+        line = &doc->lines[y];
+        for (; x < line->length; x++) {
+            if ((UBYTE)line->text[x] == g_bracketOpen[kind]) {
+                (*depth)++;
+            } else if ((UBYTE)line->text[x] == g_bracketClose[kind] && --(*depth) == 0) {
+                *matchY = y;
+                *matchX = x;
+                return TRUE;
+            }
+        }
+    }
+    return FALSE;
+}
+
+/* Count brackets backwards from before (y, x) down to line startY - TRUE once depth falls to zero */
+static BOOL ScanBackward(struct TextDocument *doc, UWORD kind, ULONG y, ULONG x, ULONG startY,
+                         LONG *depth, ULONG *matchY, ULONG *matchX)
+{
+    struct TextLine *line = NULL;
+
+    for (;;) {
+        line = &doc->lines[y];
+        while (x > 0) {
+            x--;
+            if ((UBYTE)line->text[x] == g_bracketClose[kind]) {
+                (*depth)++;
+            } else if ((UBYTE)line->text[x] == g_bracketOpen[kind] && --(*depth) == 0) {
+                *matchY = y;
+                *matchX = x;
+                return TRUE;
+            }
+        }
+        if (y <= startY) {
+            return FALSE;
+        }
+        y--;
+        x = doc->lines[y].length;
+    }
+}
@@ -0,0 +1,732 @@
+/*
+ * TTX - Multiple Carets
+ *
+ * Copyright (c) 2025 amigazen project
+ * Licensed under BSD 2-Clause License
+ *
+ * A view can have carets besides its cursor, kept in buffer->carets sorted by
+ * line then column. Typing, deleting and pasting then happen at the cursor and
+ * at every caret, as one edit made in one ordered pass over the document:
+ *
+ * - The cursor is merged into the sorted carets for the length of the edit.
+ * - Each line with carets on it is rewritten once. Its text is moved a
+ *   segment at a time (from the end of the line when inserting, from the
+ *   start when deleting), and each caret's new column follows from how much
+ *   has been inserted or removed before it on the line.
+ * - Edits that add or remove lines build the new line array as they go,
+ *   numbering lines from the running count of lines added or removed above
+ *   them, rather than shifting the rest of the document once per caret.
+ *
+ * The whole pass is one edit batch, so layout and the journal are brought up
+ * to date once however many carets there are.
+ */
+
+#include "ttx.h"
+
+/* Not a column - marks a caret whose line is to be joined to the line above */
+#define CARET_JOIN 0xFFFFFFFFUL
+
+/* Forward declarations */
+static BOOL GrowCarets(struct TextBuffer *buffer, ULONG count);
+static ULONG FindCaretSlot(struct TextBuffer *buffer, ULONG y, ULONG x);
+static BOOL GatherCarets(struct TextBuffer *buffer, ULONG *mainCaret);
+static VOID ScatterCarets(struct TextBuffer *buffer, ULONG mainCaret);
+static BOOL InsertAtCarets(struct TextBuffer *buffer, STRPTR text, ULONG length);
+static BOOL SplitAtCarets(struct TextBuffer *buffer, STRPTR text, ULONG length);
+static BOOL DeleteAtCarets(struct TextBuffer *buffer);
+
+/* ============================================================================
+ * Caret List
+ * ============================================================================ */
+
+/* Add a caret in its place in the list - FALSE if there is one there already or no memory */
+BOOL AddCaret(struct TextBuffer *buffer, ULONG y, ULONG x)
+{
+    ULONG slot = 0;
+    ULONG i = 0;
+
+    if (!buffer || !buffer->doc || y >= buffer->doc->lineCount) {
+        return FALSE;
+    }
+    if (x > buffer->doc->lines[y].length) {
+        x = buffer->doc->lines[y].length;
+    }
+
+    slot = FindCaretSlot(buffer, y, x);
+    if (slot < buffer->caretCount && buffer->carets[slot].y == y && buffer->carets[slot].x == x) {
+        return FALSE;
+    }
+    if (!GrowCarets(buffer, buffer->caretCount + 1)) {
+        return FALSE;
+    }
+
+    /* Carets are usually added top to bottom, so this seldom moves any */
+    for (i = buffer->caretCount; i > slot; i--) {
+        buffer->carets[i] = buffer->carets[i - 1];
+    }
+    buffer->carets[slot].y = y;
+    buffer->carets[slot].x = x;
+    buffer->caretCount++;
+    return TRUE;
+}
+
+/* Remove the caret at a position - FALSE if there is none there */
+BOOL RemoveCaret(struct TextBuffer *buffer, ULONG y, ULONG x)
+{
+    ULONG slot = 0;
+    ULONG i = 0;
+
+    if (!buffer || buffer->caretCount == 0) {
+        return FALSE;
+    }
+
+    slot = FindCaretSlot(buffer, y, x);
+    if (slot >= buffer->caretCount || buffer->carets[slot].y != y || buffer->carets[slot].x != x) {
+        return FALSE;
+    }
+    for (i = slot + 1; i < buffer->caretCount; i++) {
+        buffer->carets[i - 1] = buffer->carets[i];
+    }
+    buffer->caretCount--;
+    return TRUE;
+}
+
+/* A caret on every line of the block after its first, where the cursor goes - at a column
+ * block's left edge, otherwise at the cursor's column. Returns how many carets were added. */
+ULONG AddBlockCarets(struct TextBuffer *buffer)
+{
+    ULONG startY = 0;
+    ULONG startX = 0;
+    ULONG stopY = 0;
+    ULONG stopX = 0;
+    ULONG column = 0;
+    ULONG added = 0;
+    ULONG i = 0;
+
+    if (!GetBlockBounds(buffer, &startY, &startX, &stopY, &stopX)) {
+        return 0;
+    }
+    column = buffer->marking.column ? startX : buffer->cursorX;
+
+    /* Room for them all at once */
+    if (!GrowCarets(buffer, buffer->caretCount + (stopY - startY))) {
+        return 0;
+    }
+
+    buffer->cursorY = startY;
+    buffer->cursorX = column;
+    if (buffer->cursorX > buffer->doc->lines[startY].length) {
+        buffer->cursorX = buffer->doc->lines[startY].length;
+    }
+    for (i = startY + 1; i <= stopY; i++) {
+        if (AddCaret(buffer, i, column)) {
+            added++;
+        }
+    }
+    buffer->marking.enabled = FALSE;
+    return added;
+}
+
+/* Drop every caret (the list's memory is kept for the next ones) */
+VOID ClearCarets(struct TextBuffer *buffer)
+{
+    if (buffer) {
+        buffer->caretCount = 0;
+    }
+}
+
+/* Free the caret list of a view */
+VOID FreeCarets(struct TextBuffer *buffer)
+{
+    if (!buffer) {
+        return;
+    }
+    if (buffer->carets) {
+        freeVec(buffer->carets);
+        buffer->carets = NULL;
+    }
+    buffer->caretCount = 0;
+    buffer->caretMax = 0;
+}
+
+/* ============================================================================
+ * Editing at Every Caret
+ * ============================================================================ */
+
+/* Insert text at the cursor and every caret, leaving each after what it inserted */
+BOOL CaretInsertText(struct TextBuffer *buffer, STRPTR text, ULONG length, struct CleanupStack *stack)
+{
+    ULONG mainCaret = 0;
+    ULONG i = 0;
+    BOOL ok = FALSE;
+
+    if (!buffer || !buffer->doc || !buffer->doc->lines || !text || !stack) {
+        return FALSE;
+    }
+    if (length == 0) {
+        return TRUE;
+    }
+    if (!GatherCarets(buffer, &mainCaret)) {
+        return FALSE;
+    }
+
+    for (i = 0; i < length && text[i] != '\n'; i++) {
+    }
+
+    BeginEditBatch();
+    ok = (i < length) ? SplitAtCarets(buffer, text, length) : InsertAtCarets(buffer, text, length);
+    EndEditBatch();
+
+    ScatterCarets(buffer, mainCaret);
+    return ok;
+}
+
+/* Delete a character at the cursor and every caret - the one before each (joining a line to
+ * the one above at its start), or with forward the one after each (joining the next line on
+ * at its end) */
+BOOL CaretDeleteChar(struct TextBuffer *buffer, BOOL forward, struct CleanupStack *stack)
+{
+    struct TextLine *lines = NULL;
+    struct Caret *caret = NULL;
+    ULONG mainCaret = 0;
+    ULONG lastLine = 0;
+    ULONG i = 0;
+    BOOL atEnd = FALSE;
+    BOOL ok = FALSE;
+
+    if (!buffer || !buffer->doc || !buffer->doc->lines || !stack) {
+        return FALSE;
+    }
+    if (!GatherCarets(buffer, &mainCaret)) {
+        return FALSE;
+    }
+    lines = buffer->doc->lines;
+    lastLine = buffer->doc->lineCount - 1;
+
+    if (forward) {
+        /* At the end of the document there is nothing after - that caret (always the last)
+         * sits out the pass and is put back at the end of the document */
+        caret = &buffer->carets[buffer->caretCount - 1];
+        if (caret->y == lastLine && caret->x == lines[lastLine].length) {
+            atEnd = TRUE;
+            buffer->caretCount--;
+        }
+        /* Deleting forward from a place is deleting back from one further on - this keeps
+         * the carets in order, and deleting back leaves each where deleting forward would */
+        for (i = 0; i < buffer->caretCount; i++) {
+            caret = &buffer->carets[i];
+            if (caret->x < lines[caret->y].length) {
+                caret->x++;
+            } else {
+                caret->y++;
+                caret->x = 0;
+            }
+        }
+    }
+
+    BeginEditBatch();
+    ok = DeleteAtCarets(buffer);
+    EndEditBatch();
+
+    if (atEnd) {
+        lastLine = buffer->doc->lineCount - 1;
+        caret = &buffer->carets[buffer->caretCount++];
+        caret->y = lastLine;
+        caret->x = buffer->doc->lines[lastLine].length;
+    }
+    ScatterCarets(buffer, mainCaret);
+    return ok;
+}
+
+/* ============================================================================
+ * Passes
+ * ============================================================================ */
+
+/* Text without newlines at every caret - each line with carets on it is moved up once,
+ * from its end, a segment per caret */
+static BOOL InsertAtCarets(struct TextBuffer *buffer, STRPTR text, ULONG length)
+{
+    struct TextLine *line = NULL;
+    struct Caret *carets = buffer->carets;
+    ULONG first = 0;
+    ULONG next = 0;
+    ULONG end = 0;
+    ULONG at = 0;
+    ULONG shift = 0;
+    ULONG c = 0;
+    ULONG i = 0;
+
+    for (first = 0; first < buffer->caretCount; first = next) {
+        /* Carets first to next - 1 are on this line */
+        for (next = first + 1; next < buffer->caretCount && carets[next].y == carets[first].y; next++) {
+        }
+        line = &buffer->doc->lines[carets[first].y];
+        if (!GrowLine(line, line->length + (next - first) * length + 1)) {
+            return FALSE;
+        }
+
+        /* Last caret first: its tail moves furthest, then each earlier segment a copy less */
+        end = line->length;
+        for (c = next; c > first; c--) {
+            at = carets[c - 1].x;
+            shift = (c - first) * length;
+            for (i = end; i > at; i--) {
+                line->text[i - 1 + shift] = line->text[i - 1];
+            }
+            CopyMem(text, &line->text[at + shift - length], length);
+            carets[c - 1].x = at + shift;
+            end = at;
+        }
+        line->length += (next - first) * length;
+        line->text[line->length] = '\0';
+        DocumentChanged(buffer, carets[first].y, 0);
+    }
+
+    return TRUE;
+}
+
+/* Text with newlines at every caret - the line array is rebuilt in one pass with every
+ * caret's lines in place. All new line text is allocated before anything is changed. */
+static BOOL SplitAtCarets(struct TextBuffer *buffer, STRPTR text, ULONG length)
+{
+    struct TextDocument *doc = buffer->doc;
+    struct TextLine *newLines = NULL;
+    struct TextLine *line = NULL;
+    struct TextLine *out = NULL;
+    struct Caret *carets = buffer->carets;
+    ULONG breaks = 0;
+    ULONG headLength = 0;
+    ULONG tailStart = 0;
+    ULONG tailLength = 0;
+    ULONG newCount = 0;
+    ULONG newMax = 0;
+    ULONG first = 0;
+    ULONG next = 0;
+    ULONG base = 0;
+    ULONG slot = 0;
+    ULONG runStart = 0;
+    ULONG size = 0;
+    ULONG rest = 0;
+    ULONG pos = 0;
+    ULONG c = 0;
+    ULONG m = 0;
+    ULONG y = 0;
+    BOOL ok = TRUE;
+
+    /* The text is a head, breaks - 1 whole lines, and a tail */
+    for (pos = 0; pos < length; pos++) {
+        if (text[pos] == '\n') {
+            if (breaks == 0) {
+                headLength = pos;
+            }
+            breaks++;
+            tailStart = pos + 1;
+        }
+    }
+    tailLength = length - tailStart;
+
+    newCount = doc->lineCount + breaks * buffer->caretCount;
+    newMax = doc->maxLines ? doc->maxLines : newCount;
+    while (newMax < newCount) {
+        newMax *= 2;
+    }
+    newLines = (struct TextLine *)allocVec(newMax * sizeof(struct TextLine), MEMF_CLEAR);
+    if (!newLines) {
+        return FALSE;
+    }
+
+    /* Allocate every new line where it will go - a line with carets on it becomes the lines
+     * from base on, with each caret's breaks lines after its part */
+    base = 0;
+    for (first = 0; ok && first < buffer->caretCount; first = next) {
+        for (next = first + 1; next < buffer->caretCount && carets[next].y == carets[first].y; next++) {
+        }
+        line = &doc->lines[carets[first].y];
+        base = carets[first].y + first * breaks;
+        size = carets[first].x + headLength;
+        if (!GrowLine(line, ((line->length > size) ? line->length : size) + 1)) {
+            ok = FALSE;
+            break;
+        }
+        for (c = first; ok && c < next; c++) {
+            slot = base + (c - first) * breaks;
+            runStart = headLength + 1;
+            for (m = 1; m <= breaks; m++) {
+                if (m < breaks) {
+                    /* A whole line of the text */
+                    for (pos = runStart; text[pos] != '\n'; pos++) {
+                    }
+                    size = pos - runStart;
+                    runStart = pos + 1;
+                } else {
+                    /* The tail, the line from this caret to the next, and the head again */
+                    rest = ((c + 1 < next) ? carets[c + 1].x : line->length) - carets[c].x;
+                    size = tailLength + rest + ((c + 1 < next) ? headLength : 0);
+                }
+                out = &newLines[slot + m];
+                out->allocated = size + 256;
+                out->text = (STRPTR)allocVec(out->allocated, MEMF_CLEAR);
+                if (!out->text) {
+                    ok = FALSE;
+                    break;
+                }
+            }
+        }
+    }
+    if (!ok) {
+        for (slot = 0; slot < newCount; slot++) {
+            if (newLines[slot].text) {
+                freeVec(newLines[slot].text);
+            }
+        }
+        freeVec(newLines);
+        return FALSE;
+    }
+
+    /* Fill them in, moving the untouched lines across as they are */
+    first = 0;
+    base = 0;
+    for (y = 0; y < doc->lineCount; y++) {
+        line = &doc->lines[y];
+        if (first >= buffer->caretCount || carets[first].y != y) {
+            newLines[base++] = *line;
+            continue;
+        }
+        for (next = first + 1; next < buffer->caretCount && carets[next].y == y; next++) {
+        }
+
+        for (c = first; c < next; c++) {
+            slot = base + (c - first) * breaks;
+            runStart = headLength + 1;
+            for (m = 1; m < breaks; m++) {
+                for (pos = runStart; text[pos] != '\n'; pos++) {
+                }
+                out = &newLines[slot + m];
+                CopyMem(&text[runStart], out->text, pos - runStart);
+                out->length = pos - runStart;
+                runStart = pos + 1;
+            }
+            out = &newLines[slot + breaks];
+            rest = ((c + 1 < next) ? carets[c + 1].x : line->length) - carets[c].x;
+            CopyMem(&text[tailStart], out->text, tailLength);
+            CopyMem(&line->text[carets[c].x], &out->text[tailLength], rest);
+            out->length = tailLength + rest;
+            if (c + 1 < next) {
+                CopyMem(text, &out->text[out->length], headLength);
+                out->length += headLength;
+            }
+            out->text[out->length] = '\0';
+        }
+
+        /* The line itself keeps what was before its first caret, and takes the head */
+        CopyMem(text, &line->text[carets[first].x], headLength);
+        line->length = carets[first].x + headLength;
+        line->text[line->length] = '\0';
+        newLines[base] = *line;
+
+        /* Each caret ends after the tail, at the start of its last new line */
+        for (c = first; c < next; c++) {
+            carets[c].y = base + (c - first + 1) * breaks;
+            carets[c].x = tailLength;
+        }
+        base += (next - first) * breaks + 1;
+        first = next;
+    }
+
+    freeVec(doc->lines);
+    doc->lines = newLines;
+    doc->lineCount = newCount;
+    doc->maxLines = newMax;
+
+    /* In document order, the lines of all the carets on a line came in after it */
+    for (first = 0; first < buffer->caretCount; first = next) {
+        for (next = first + 1; next < buffer->caretCount &&
+             carets[next].y == carets[first].y + (next - first) * breaks; next++) {
+        }
+        DocumentChanged(buffer, carets[first].y - breaks, (LONG)((next - first) * breaks));
+    }
+    return TRUE;
+}
+
+/* Delete the character before every caret - a caret at the start of a line joins it to the
+ * line above. Characters within lines go first, each line closed up once from the start;
+ * then the line array is closed up once over the joined lines, and the views told of them
+ * once it is whole again. */
+static BOOL DeleteAtCarets(struct TextBuffer *buffer)
+{
+    struct TextDocument *doc = buffer->doc;
+    struct TextLine *line = NULL;
+    struct TextLine *head = NULL;
+    struct Caret *carets = buffer->carets;
+    ULONG *joinedTo = NULL;
+    ULONG joinCount = 0;
+    ULONG headY = 0;
+    ULONG joinedY = 0;
+    ULONG need = 0;
+    ULONG first = 0;
+    ULONG next = 0;
+    ULONG removed = 0;
+    ULONG dst = 0;
+    ULONG from = 0;
+    ULONG offset = 0;
+    ULONG out = 0;
+    ULONG c = 0;
+    ULONG y = 0;
+    BOOL joins = FALSE;
+
+    /* Grow each line that others are joined onto first, so nothing fails half done */
+    for (c = 0; c < buffer->caretCount; c++) {
+        if (carets[c].x != 0 || carets[c].y == 0) {
+            continue;
+        }
+        y = carets[c].y;
+        if (joins && joinedY + 1 == y) {
+            need += doc->lines[y].length;
+        } else {
+            if (joins && !GrowLine(&doc->lines[headY], need + 1)) {
+                return FALSE;
+            }
+            headY = y - 1;
+            need = doc->lines[headY].length + doc->lines[y].length;
+        }
+        joinedY = y;
+        joins = TRUE;
+        joinCount++;
+    }
+    if (joins && !GrowLine(&doc->lines[headY], need + 1)) {
+        return FALSE;
+    }
+    /* Where each joined line went, to report once the array is closed up */
+    if (joins) {
+        joinedTo = (ULONG *)allocVec(joinCount * sizeof(ULONG), 0);
+        if (!joinedTo) {
+            return FALSE;
+        }
+    }
+
+    /* Characters before carets within their lines */
+    for (first = 0; first < buffer->caretCount; first = next) {
+        for (next = first + 1; next < buffer->caretCount && carets[next].y == carets[first].y; next++) {
+        }
+        line = &doc->lines[carets[first].y];
+        removed = 0;
+        for (c = first; c < next; c++) {
+            if (carets[c].x == 0) {
+                if (carets[c].y > 0) {
+                    carets[c].x = CARET_JOIN;
+                }
+                continue;
+            }
+            if (removed > 0) {
+                /* Close up the run between the last deleted character and this one */
+                for (; from < carets[c].x - 1; from++) {
+                    line->text[dst++] = line->text[from];
+                }
+            } else {
+                dst = carets[c].x - 1;
+            }
+            from = carets[c].x;
+            removed++;
+            carets[c].x -= removed;
+        }
+        if (removed > 0) {
+            for (; from < line->length; from++) {
+                line->text[dst++] = line->text[from];
+            }
+            line->length -= removed;
+            line->text[line->length] = '\0';
+            DocumentChanged(buffer, carets[first].y, 0);
+        }
+    }
+    if (!joins) {
+        return TRUE;
+    }
+
+    /* Joined lines - the array closes up over them in one pass */
+    c = 0;
+    out = 0;
+    joinCount = 0;
+    for (y = 0; y < doc->lineCount; y++) {
+        line = &doc->lines[y];
+        if (c < buffer->caretCount && carets[c].y == y && carets[c].x == CARET_JOIN) {
+            head = &doc->lines[out - 1];
+            offset = head->length;
+            if (line->length > 0) {
+                CopyMem(line->text, &head->text[offset], line->length);
+            }
+            head->length += line->length;
+            head->text[head->length] = '\0';
+            if (line->text) {
+                freeVec(line->text);
+            }
+            for (; c < buffer->caretCount && carets[c].y == y; c++) {
+                carets[c].x = (carets[c].x == CARET_JOIN) ? offset : carets[c].x + offset;
+                carets[c].y = out - 1;
+            }
+            joinedTo[joinCount++] = out - 1;
+            continue;
+        }
+
+        doc->lines[out] = *line;
+        for (; c < buffer->caretCount && carets[c].y == y; c++) {
+            carets[c].y = out;
+        }
+        out++;
+    }
+    doc->lineCount = out;
+
+    /* In document order, the lines joined onto each line are gone from after it */
+    for (first = 0; first < joinCount; first = next) {
+        for (next = first + 1; next < joinCount && joinedTo[next] == joinedTo[first]; next++) {
+        }
+        DocumentChanged(buffer, joinedTo[first], -(LONG)(next - first));
+    }
+    freeVec(joinedTo);
+
+    return TRUE;
+}
+
+/* ============================================================================
+ * Helpers
+ * ============================================================================ */
+
+/* Room for count carets, doubling the list as it fills */
+static BOOL GrowCarets(struct TextBuffer *buffer, ULONG count)
+{
+    struct Caret *carets = NULL;
+    ULONG newMax = 0;
+
+    if (count <= buffer->caretMax) {
+        return TRUE;
+    }
+    newMax = buffer->caretMax ? buffer->caretMax * 2 : 16;
+    while (newMax < count) {
+        newMax *= 2;
+    }
+    carets = (struct Caret *)allocVec(newMax * sizeof(struct Caret), 0);
+    if (!carets) {
+        return FALSE;
+    }
+    if (buffer->carets) {
+        if (buffer->caretCount > 0) {
+            CopyMem(buffer->carets, carets, buffer->caretCount * sizeof(struct Caret));
+        }
+        freeVec(buffer->carets);
+    }
+    buffer->carets = carets;
+    buffer->caretMax = newMax;
+    return TRUE;
+}
+
+/* Index of the first caret at or after a position (caretCount if there is none) */
+static ULONG FindCaretSlot(struct TextBuffer *buffer, ULONG y, ULONG x)
+{
+    ULONG low = 0;
+    ULONG high = buffer->caretCount;
+    ULONG middle = 0;
+
+    while (low < high) {
+        middle = (low + high) / 2;
+        if (buffer->carets[middle].y < y || (buffer->carets[middle].y == y && buffer->carets[middle].x < x)) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+/* Merge the cursor into the carets for an edit, *mainCaret being its place among them.
+ * Edits made through other views can leave carets past the end of their lines, or out of
+ * order where the lines they were on were removed - they are put right first, at the cost
+ * of one look at each caret when there is nothing to do. Carets that meet are merged. */
+static BOOL GatherCarets(struct TextBuffer *buffer, ULONG *mainCaret)
+{
+    struct TextLine *lines = buffer->doc->lines;
+    struct Caret *caret = NULL;
+    struct Caret moved;
+    ULONG lastLine = buffer->doc->lineCount - 1;
+    ULONG used = 0;
+    ULONG slot = 0;
+    ULONG i = 0;
+    ULONG j = 0;
+
+    for (i = 0; i < buffer->caretCount; i++) {
+        caret = &buffer->carets[i];
+        if (caret->y > lastLine) {
+            caret->y = lastLine;
+            caret->x = lines[lastLine].length;
+        } else if (caret->x > lines[caret->y].length) {
+            caret->x = lines[caret->y].length;
+        }
+        /* Insertion sort - only a caret out of place moves */
+        moved = *caret;
+        for (j = i; j > 0 && (buffer->carets[j - 1].y > moved.y ||
+                              (buffer->carets[j - 1].y == moved.y && buffer->carets[j - 1].x > moved.x)); j--) {
+            buffer->carets[j] = buffer->carets[j - 1];
+        }
+        buffer->carets[j] = moved;
+    }
+    for (i = 0; i < buffer->caretCount; i++) {
+        caret = &buffer->carets[i];
+        if (used > 0 && buffer->carets[used - 1].y == caret->y && buffer->carets[used - 1].x == caret->x) {
+            continue;
+        }
+        buffer->carets[used++] = *caret;
+    }
+    buffer->caretCount = used;
+
+    if (buffer->cursorY > lastLine) {
+        buffer->cursorY = lastLine;
+    }
+    if (buffer->cursorX > lines[buffer->cursorY].length) {
+        buffer->cursorX = lines[buffer->cursorY].length;
+    }
+    if (!GrowCarets(buffer, buffer->caretCount + 1)) {
+        return FALSE;
+    }
+
+    /* A caret under the cursor is the cursor */
+    slot = FindCaretSlot(buffer, buffer->cursorY, buffer->cursorX);
+    if (slot >= buffer->caretCount ||
+        buffer->carets[slot].y != buffer->cursorY || buffer->carets[slot].x != buffer->cursorX) {
+        for (i = buffer->caretCount; i > slot; i--) {
+            buffer->carets[i] = buffer->carets[i - 1];
+        }
+        buffer->carets[slot].y = buffer->cursorY;
+        buffer->carets[slot].x = buffer->cursorX;
+        buffer->caretCount++;
+    }
+    *mainCaret = slot;
+    return TRUE;
+}
+
+/* Take the cursor back out of the carets after an edit, merging carets the edit brought
+ * together */
+static VOID ScatterCarets(struct TextBuffer *buffer, ULONG mainCaret)
+{
+    ULONG mainSlot = 0;
+    ULONG used = 0;
+    ULONG i = 0;
+
+    for (i = 0; i < buffer->caretCount; i++) {
+        if (used > 0 && buffer->carets[used - 1].y == buffer->carets[i].y &&
+            buffer->carets[used - 1].x == buffer->carets[i].x) {
+            if (i == mainCaret) {
+                mainSlot = used - 1;
+            }
+            continue;
+        }
+        if (i == mainCaret) {
+            mainSlot = used;
+        }
+        buffer->carets[used++] = buffer->carets[i];
+    }
+
+    buffer->cursorY = buffer->carets[mainSlot].y;
+    buffer->cursorX = buffer->carets[mainSlot].x;
+    for (i = mainSlot + 1; i < used; i++) {
+        buffer->carets[i - 1] = buffer->carets[i];
+    }
+    buffer->caretCount = used - 1;
+}
@@ -0,0 +1,957 @@
+/*
+ * TTX - Clipboard
+ *
+ * Copyright (c) 2025 amigazen project
+ * Licensed under BSD 2-Clause License
+ *
+ * Text goes to and from clipboard.device as an IFF FTXT form:
+ *
+ *     FORM <size> FTXT CHRS <length> <text> [pad]
+ *
+ * Nothing is flattened on the way. A copy works out the length of the
+ * selection from the line lengths, writes the headers, then writes the text
+ * line by line - short lines are gathered in the view's scratch space so the
+ * device is not called per line, long ones are written straight from line
+ * storage. A paste reads every CHRS chunk of the clip a piece at a time and
+ * inserts each piece at the cursor as it arrives. So the largest buffer either
+ * way is CLIP_CHUNK bytes, whatever the size of the text. The exception is a
+ * paste with more than one caret: the text goes in at every caret in a single
+ * pass over the document, so it is read whole into the scratch space first.
+ *
+ * The clip ring keeps the last TTX_CLIP_RING clips for every session, some
+ * of them named. A clip's text is a list of pieces that never change once the
+ * clip is built, counted by reference, so a clip is shared rather than copied
+ * and bytes are only copied when it is pasted into a document. Cutting moves
+ * the removed lines into the clip as pieces - only the partial first and last
+ * lines are copied - so it costs the same whatever the size of the block (a
+ * column block takes part of every line, so cutting one copies it instead).
+ * Copying has to take a copy, as the lines stay in the document and go on
+ * being edited; it is made in CLIP_PIECE sized pieces.
+ */
+
+#include "ttx.h"
+
+#define CLIP_CHUNK  4096   /* Bytes moved per device or file call */
+#define CLIP_PIECE  16384  /* Most bytes in a piece of copied clip text */
+
+#define CLIP_FORM   0x464F524DUL  /* 'FORM' */
+#define CLIP_FTXT   0x46545854UL  /* 'FTXT' */
+#define CLIP_CHRS   0x43485253UL  /* 'CHRS' */
+
+/* An open clipboard unit and where the next read or write goes */
+struct ClipStream {
+    struct MsgPort *port;
+    struct IOClipReq *io;
+    BOOL deviceOpen;
+    ULONG offset;
+};
+
+/* Clip text being copied out of a document */
+struct ClipBuilder {
+    struct ClipText *text;
+    ULONG room;    /* Bytes free in the last piece */
+    ULONG left;    /* Bytes still to come */
+};
+
+/* Forward declarations */
+static BOOL OpenClipStream(struct ClipStream *clip, ULONG unit);
+static VOID CloseClipStream(struct ClipStream *clip);
+static BOOL WriteClip(struct ClipStream *clip, APTR data, ULONG length);
+static LONG ReadClip(struct ClipStream *clip, APTR data, ULONG length);
+static BOOL BeginClipWrite(struct ClipStream *clip, ULONG textLength);
+static BOOL EndClipWrite(struct ClipStream *clip, ULONG textLength, BOOL ok);
+static LONG NextClipText(struct ClipStream *clip, ULONG *formEnd);
+static VOID EndClipRead(struct ClipStream *clip);
+static ULONG GetBlockLength(struct TextBuffer *buffer, ULONG startY, ULONG startX, ULONG stopY, ULONG stopX);
+static VOID EndColumnPaste(struct TextBuffer *buffer);
+static BOOL PutClipRun(struct ClipStream *clip, UBYTE *stage, ULONG *staged, UBYTE *text, ULONG length);
+static struct ClipText *NewClipText(VOID);
+static struct ClipPiece *AddClipPiece(struct ClipText *text, UBYTE *bytes, ULONG length, ULONG size, BOOL lineBreak);
+static BOOL AddClipBytes(struct ClipBuilder *builder, UBYTE *bytes, ULONG length);
+static BOOL SameClipName(STRPTR a, STRPTR b);
+
+/* ============================================================================
+ * Block and Clipboard
+ * ============================================================================ */
+
+/* Write the selection to a clipboard unit, straight from line storage */
+BOOL CopyBlockToClip(struct TextBuffer *buffer, ULONG unit)
+{
+    struct ClipStream clip;
+    struct TextLine *lines = NULL;
+    UBYTE *stage = NULL;
+    ULONG startY = 0;
+    ULONG startX = 0;
+    ULONG stopY = 0;
+    ULONG stopX = 0;
+    ULONG textLength = 0;
+    ULONG staged = 0;
+    ULONG fromX = 0;
+    ULONG toX = 0;
+    ULONG i = 0;
+    BOOL ok = TRUE;
+
+    if (!GetBlockBounds(buffer, &startY, &startX, &stopY, &stopX)) {
+        return FALSE;
+    }
+    lines = buffer->doc->lines;
+    textLength = GetBlockLength(buffer, startY, startX, stopY, stopX);
+
+    stage = GetScratch(buffer, CLIP_CHUNK);
+    if (!stage) {
+        return FALSE;
+    }
+    if (!OpenClipStream(&clip, unit)) {
+        return FALSE;
+    }
+
+    ok = BeginClipWrite(&clip, textLength);
+    for (i = startY; ok && i <= stopY; i++) {
+        GetBlockLineRange(buffer, i, startY, startX, stopY, stopX, &fromX, &toX);
+        if (toX > fromX) {
+            ok = PutClipRun(&clip, stage, &staged, (UBYTE *)&lines[i].text[fromX], toX - fromX);
+        }
+        if (ok && i < stopY) {
+            ok = PutClipRun(&clip, stage, &staged, (UBYTE *)"\n", 1);
+        }
+    }
+    if (ok && staged > 0) {
+        ok = WriteClip(&clip, stage, staged);
+    }
+    ok = EndClipWrite(&clip, textLength, ok);
+
+    CloseClipStream(&clip);
+    Printf("[CLIP] CopyBlockToClip: %s (%lu bytes, unit %lu)\n", ok ? "SUCCESS" : "FAIL", textLength, unit);
+    return ok;
+}
+
+/* Insert the text of a clipboard unit at the cursor, a piece at a time (vertical: as a column) */
+BOOL PasteClipToBuffer(struct TextBuffer *buffer, ULONG unit, BOOL vertical, struct CleanupStack *stack)
+{
+    struct ClipStream clip;
+    UBYTE *piece = NULL;
+    ULONG formEnd = 0;
+    ULONG total = 0;
+    ULONG column = 0;
+    LONG length = 0;
+    LONG actual = 0;
+    BOOL ok = TRUE;
+    BOOL found = FALSE;
+
+    if (!buffer || !stack) {
+        return FALSE;
+    }
+    piece = GetScratch(buffer, CLIP_CHUNK);
+    if (!piece) {
+        return FALSE;
+    }
+    if (!OpenClipStream(&clip, unit)) {
+        return FALSE;
+    }
+
+    if (buffer->caretCount > 0 && !vertical) {
+        /* Multiple carets - read it all, then insert it at every caret in one pass */
+        while (ok && (length = NextClipText(&clip, &formEnd)) >= 0) {
+            found = TRUE;
+            while (ok && length > 0) {
+                piece = GetScratch(buffer, total + CLIP_CHUNK);
+                if (!piece) {
+                    ok = FALSE;
+                    break;
+                }
+                actual = ReadClip(&clip, piece + total, (ULONG)length < CLIP_CHUNK ? (ULONG)length : CLIP_CHUNK);
+                if (actual <= 0) {
+                    ok = FALSE;
+                    break;
+                }
+                length -= actual;
+                total += (ULONG)actual;
+            }
+        }
+        if (ok && total > 0) {
+            ok = CaretInsertText(buffer, (STRPTR)buffer->scratch, total, stack);
+        }
+        EndClipRead(&clip);
+        CloseClipStream(&clip);
+        Printf("[CLIP] PasteClipToBuffer: %s (%lu bytes, unit %lu, %lu carets)\n", (ok && found) ? "SUCCESS" : "FAIL", total, unit, buffer->caretCount + 1);
+        return (BOOL)(ok && found);
+    }
+
+    /* One layout and journal update for the whole paste */
+    column = buffer->cursorX;
+    BeginEditBatch();
+    while (ok && (length = NextClipText(&clip, &formEnd)) >= 0) {
+        found = TRUE;
+        while (ok && length > 0) {
+            actual = ReadClip(&clip, piece, (ULONG)length < CLIP_CHUNK ? (ULONG)length : CLIP_CHUNK);
+            if (actual <= 0) {
+                ok = FALSE;
+                break;
+            }
+            if (vertical) {
+                ok = InsertColumnText(buffer, (STRPTR)piece, (ULONG)actual, column, stack);
+            } else {
+                ok = InsertSpan(buffer, (STRPTR)piece, (ULONG)actual, stack);
+            }
+            length -= actual;
+            total += (ULONG)actual;
+        }
+    }
+    EndEditBatch();
+    if (vertical) {
+        EndColumnPaste(buffer);
+    }
+
+    EndClipRead(&clip);
+    CloseClipStream(&clip);
+    Printf("[CLIP] PasteClipToBuffer: %s (%lu bytes, unit %lu)\n", (ok && found) ? "SUCCESS" : "FAIL", total, unit);
+    return (BOOL)(ok && found);
+}
+
+/* Write clip text to a clipboard unit (buffer lends its scratch space, or NULL) */
+BOOL ClipTextToClip(struct ClipText *text, ULONG unit, struct TextBuffer *buffer)
+{
+    struct ClipStream clip;
+    struct ClipPiece *piece = NULL;
+    UBYTE *stage = NULL;
+    ULONG staged = 0;
+    BOOL ok = TRUE;
+
+    if (!text) {
+        return FALSE;
+    }
+    stage = buffer ? GetScratch(buffer, CLIP_CHUNK) : (UBYTE *)allocVec(CLIP_CHUNK, 0);
+    if (!stage) {
+        return FALSE;
+    }
+    if (!OpenClipStream(&clip, unit)) {
+        if (!buffer) {
+            freeVec(stage);
+        }
+        return FALSE;
+    }
+
+    ok = BeginClipWrite(&clip, text->length);
+    for (piece = text->pieces; ok && piece; piece = piece->next) {
+        ok = PutClipRun(&clip, stage, &staged, piece->text, piece->length);
+        if (ok && piece->lineBreak) {
+            ok = PutClipRun(&clip, stage, &staged, (UBYTE *)"\n", 1);
+        }
+    }
+    if (ok && staged > 0) {
+        ok = WriteClip(&clip, stage, staged);
+    }
+    ok = EndClipWrite(&clip, text->length, ok);
+
+    CloseClipStream(&clip);
+    if (!buffer) {
+        freeVec(stage);
+    }
+    Printf("[CLIP] ClipTextToClip: %s (%lu bytes, unit %lu)\n", ok ? "SUCCESS" : "FAIL", text->length, unit);
+    return ok;
+}
+
+/* ============================================================================
+ * Files and Clipboard
+ * ============================================================================ */
+
+/* Put the contents of a file on a clipboard unit as text */
+BOOL FileToClip(STRPTR fileName, ULONG unit)
+{
+    struct ClipStream clip;
+    struct FileInfoBlock *fib = NULL;
+    UBYTE *piece = NULL;
+    BPTR file = 0;
+    ULONG textLength = 0;
+    ULONG left = 0;
+    LONG actual = 0;
+    BOOL ok = FALSE;
+
+    if (!fileName) {
+        return FALSE;
+    }
+
+    file = Open(fileName, MODE_OLDFILE);
+    if (!file) {
+        Printf("[CLIP] FileToClip: FAIL (could not open '%s')\n", fileName);
+        return FALSE;
+    }
+    fib = (struct FileInfoBlock *)allocVec(sizeof(struct FileInfoBlock), MEMF_CLEAR);
+    if (fib && ExamineFH(file, fib)) {
+        textLength = (ULONG)fib->fib_Size;
+        ok = TRUE;
+    }
+    if (fib) {
+        freeVec(fib);
+    }
+    piece = ok ? (UBYTE *)allocVec(CLIP_CHUNK, 0) : NULL;
+    if (!piece || !OpenClipStream(&clip, unit)) {
+        if (piece) {
+            freeVec(piece);
+        }
+        Close(file);
+        return FALSE;
+    }
+
+    ok = BeginClipWrite(&clip, textLength);
+    left = textLength;
+    while (ok && left > 0) {
+        actual = Read(file, piece, left < CLIP_CHUNK ? left : CLIP_CHUNK);
+        if (actual <= 0) {
+            ok = FALSE;
+            break;
+        }
+        ok = WriteClip(&clip, piece, (ULONG)actual);
+        left -= (ULONG)actual;
+    }
+    ok = EndClipWrite(&clip, textLength, ok);
+
+    CloseClipStream(&clip);
+    freeVec(piece);
+    Close(file);
+    Printf("[CLIP] FileToClip: %s ('%s', %lu bytes, unit %lu)\n", ok ? "SUCCESS" : "FAIL", fileName, textLength, unit);
+    return ok;
+}
+
+/* Write the text of a clipboard unit to a file (or a device such as PRT:) */
+BOOL ClipToFile(ULONG unit, STRPTR fileName)
+{
+    struct ClipStream clip;
+    UBYTE *piece = NULL;
+    BPTR file = 0;
+    ULONG formEnd = 0;
+    ULONG total = 0;
+    LONG length = 0;
+    LONG actual = 0;
+    BOOL ok = TRUE;
+    BOOL found = FALSE;
+
+    if (!fileName) {
+        return FALSE;
+    }
+
+    piece = (UBYTE *)allocVec(CLIP_CHUNK, 0);
+    if (!piece) {
+        return FALSE;
+    }
+    if (!OpenClipStream(&clip, unit)) {
+        freeVec(piece);
+        return FALSE;
+    }
+    file = Open(fileName, MODE_NEWFILE);
+    if (!file) {
+        Printf("[CLIP] ClipToFile: FAIL (could not open '%s')\n", fileName);
+        ok = FALSE;
+    }
+
+    while (ok && (length = NextClipText(&clip, &formEnd)) >= 0) {
+        found = TRUE;
+        while (ok && length > 0) {
+            actual = ReadClip(&clip, piece, (ULONG)length < CLIP_CHUNK ? (ULONG)length : CLIP_CHUNK);
+            if (actual <= 0 || Write(file, piece, actual) != actual) {
+                ok = FALSE;
+                break;
+            }
+            length -= actual;
+            total += (ULONG)actual;
+        }
+    }
+
+    EndClipRead(&clip);
+    CloseClipStream(&clip);
+    if (file) {
+        Close(file);
+    }
+    freeVec(piece);
+    Printf("[CLIP] ClipToFile: %s ('%s', %lu bytes, unit %lu)\n", (ok && found) ? "SUCCESS" : "FAIL", fileName, total, unit);
+    return (BOOL)(ok && found);
+}
+
+/* ============================================================================
+ * Clip Text
+ * ============================================================================ */
+
+/* Copy the selection into new clip text (one reference, held by the caller) */
+struct ClipText *CopyBlockText(struct TextBuffer *buffer)
+{
+    struct ClipBuilder builder;
+    struct TextLine *lines = NULL;
+    ULONG startY = 0;
+    ULONG startX = 0;
+    ULONG stopY = 0;
+    ULONG stopX = 0;
+    ULONG fromX = 0;
+    ULONG toX = 0;
+    ULONG i = 0;
+    BOOL ok = TRUE;
+
+    if (!GetBlockBounds(buffer, &startY, &startX, &stopY, &stopX)) {
+        return NULL;
+    }
+    lines = buffer->doc->lines;
+
+    builder.text = NewClipText();
+    if (!builder.text) {
+        return NULL;
+    }
+    builder.room = 0;
+    builder.left = GetBlockLength(buffer, startY, startX, stopY, stopX);
+
+    for (i = startY; ok && i <= stopY; i++) {
+        GetBlockLineRange(buffer, i, startY, startX, stopY, stopX, &fromX, &toX);
+        if (toX > fromX) {
+            ok = AddClipBytes(&builder, (UBYTE *)&lines[i].text[fromX], toX - fromX);
+        }
+        if (ok && i < stopY) {
+            ok = AddClipBytes(&builder, (UBYTE *)"\n", 1);
+        }
+    }
+
+    if (!ok) {
+        ReleaseClipText(builder.text);
+        return NULL;
+    }
+    return builder.text;
+}
+
+/* Delete the selection, moving its whole lines into new clip text rather than copying them */
+struct ClipText *CutBlockText(struct TextBuffer *buffer, struct CleanupStack *stack)
+{
+    struct ClipText *text = NULL;
+    struct ClipPiece *piece = NULL;
+    struct TextLine *lines = NULL;
+    ULONG startY = 0;
+    ULONG startX = 0;
+    ULONG stopY = 0;
+    ULONG stopX = 0;
+    ULONG i = 0;
+    BOOL ok = TRUE;
+
+    if (!stack || !GetBlockBounds(buffer, &startY, &startX, &stopY, &stopX)) {
+        return NULL;
+    }
+    lines = buffer->doc->lines;
+
+    /* A column block only takes part of each line, so it is copied out */
+    if (buffer->marking.column) {
+        text = CopyBlockText(buffer);
+        if (text && !DeleteBlock(buffer, stack)) {
+            ReleaseClipText(text);
+            text = NULL;
+        }
+        return text;
+    }
+
+    /* DeleteBlock must take out exactly the lines the clip is given */
+    buffer->marking.startY = startY;
+    buffer->marking.startX = startX;
+    buffer->marking.stopY = stopY;
+    buffer->marking.stopX = stopX;
+
+    text = NewClipText();
+    if (!text) {
+        return NULL;
+    }
+
+    if (startY == stopY) {
+        ok = AddClipPiece(text, (UBYTE *)&lines[startY].text[startX], stopX - startX, stopX - startX, FALSE) != NULL;
+    } else {
+        /* The partial first and last lines are copied */
+        ok = AddClipPiece(text, (UBYTE *)&lines[startY].text[startX], lines[startY].length - startX,
+                          lines[startY].length - startX, TRUE) != NULL;
+        /* Lines in between change hands - DeleteBlock finds them already empty */
+        for (i = startY + 1; ok && i < stopY; i++) {
+            if (!lines[i].text) {
+                ok = AddClipPiece(text, NULL, 0, 0, TRUE) != NULL;
+                continue;
+            }
+            piece = AddClipPiece(text, NULL, 0, 0, TRUE);
+            if (!piece) {
+                ok = FALSE;
+                break;
+            }
+            piece->text = (UBYTE *)lines[i].text;
+            piece->length = lines[i].length;
+            text->length += lines[i].length;
+            lines[i].text = NULL;
+            lines[i].length = 0;
+            lines[i].allocated = 0;
+        }
+        if (ok) {
+            ok = AddClipPiece(text, (UBYTE *)lines[stopY].text, stopX, stopX, FALSE) != NULL;
+        }
+    }
+
+    if (!ok) {
+        /* Give the lines back before the clip goes */
+        piece = text->pieces ? text->pieces->next : NULL;
+        for (i = startY + 1; piece && i < stopY; i++, piece = piece->next) {
+            if (piece->text && piece->text != (UBYTE *)(piece + 1)) {
+                lines[i].text = (STRPTR)piece->text;
+                lines[i].length = piece->length;
+                lines[i].allocated = piece->length + 1;
+                piece->text = NULL;
+            }
+        }
+        ReleaseClipText(text);
+        return NULL;
+    }
+
+    if (!DeleteBlock(buffer, stack)) {
+        ReleaseClipText(text);
+        return NULL;
+    }
+    return text;
+}
+
+/* Drop a reference to clip text, freeing it with the last one */
+VOID ReleaseClipText(struct ClipText *text)
+{
+    struct ClipPiece *piece = NULL;
+    struct ClipPiece *next = NULL;
+
+    if (!text || --text->refCount > 0) {
+        return;
+    }
+    for (piece = text->pieces; piece; piece = next) {
+        next = piece->next;
+        /* Copied bytes sit after the piece; moved lines are separate */
+        if (piece->text && piece->text != (UBYTE *)(piece + 1)) {
+            freeVec(piece->text);
+        }
+        freeVec(piece);
+    }
+    freeVec(text);
+}
+
+/* Insert clip text at the cursor (vertical: as a column) - the only place its bytes are copied */
+BOOL PasteClipText(struct TextBuffer *buffer, struct ClipText *text, BOOL vertical, struct CleanupStack *stack)
+{
+    struct ClipPiece *piece = NULL;
+    UBYTE *flat = NULL;
+    ULONG column = 0;
+    ULONG used = 0;
+    BOOL ok = TRUE;
+
+    if (!buffer || !text || !stack) {
+        return FALSE;
+    }
+
+    if (buffer->caretCount > 0 && !vertical) {
+        /* Multiple carets - flatten the pieces, then insert them at every caret in one pass */
+        for (piece = text->pieces; piece; piece = piece->next) {
+            used += piece->length + (piece->lineBreak ? 1 : 0);
+        }
+        if (used == 0) {
+            return TRUE;
+        }
+        flat = GetScratch(buffer, used);
+        if (!flat) {
+            return FALSE;
+        }
+        used = 0;
+        for (piece = text->pieces; piece; piece = piece->next) {
+            if (piece->length > 0) {
+                CopyMem(piece->text, &flat[used], piece->length);
+                used += piece->length;
+            }
+            if (piece->lineBreak) {
+                flat[used++] = '\n';
+            }
+        }
+        return CaretInsertText(buffer, (STRPTR)flat, used, stack);
+    }
+
+    /* One layout and journal update for the whole paste */
+    column = buffer->cursorX;
+    BeginEditBatch();
+    for (piece = text->pieces; ok && piece; piece = piece->next) {
+        if (piece->length > 0) {
+            if (vertical) {
+                ok = InsertColumnText(buffer, (STRPTR)piece->text, piece->length, column, stack);
+            } else {
+                ok = InsertSpan(buffer, (STRPTR)piece->text, piece->length, stack);
+            }
+        }
+        if (ok && piece->lineBreak) {
+            ok = vertical ? NextColumnLine(buffer, column, stack) : InsertNewline(buffer, stack);
+        }
+    }
+    EndEditBatch();
+    if (vertical) {
+        EndColumnPaste(buffer);
+    }
+
+    return ok;
+}
+
+static struct ClipText *NewClipText(VOID)
+{
+    struct ClipText *text = NULL;
+
+    text = (struct ClipText *)allocVec(sizeof(struct ClipText), MEMF_CLEAR);
+    if (text) {
+        text->refCount = 1;
+    }
+    return text;
+}
+
+/* Add a piece with room for size bytes after it, holding length of them copied from bytes */
+static struct ClipPiece *AddClipPiece(struct ClipText *text, UBYTE *bytes, ULONG length, ULONG size, BOOL lineBreak)
+{
+    struct ClipPiece *piece = NULL;
+
+    piece = (struct ClipPiece *)allocVec(sizeof(struct ClipPiece) + size, 0);
+    if (!piece) {
+        return NULL;
+    }
+    piece->next = NULL;
+    piece->text = (UBYTE *)(piece + 1);
+    piece->length = length;
+    piece->lineBreak = lineBreak;
+    if (length > 0) {
+        CopyMem(bytes, piece->text, length);
+    }
+
+    if (text->lastPiece) {
+        text->lastPiece->next = piece;
+    } else {
+        text->pieces = piece;
+    }
+    text->lastPiece = piece;
+    text->length += length + (lineBreak ? 1 : 0);
+    return piece;
+}
+
+/* Add bytes to a copy, filling each piece before starting the next */
+static BOOL AddClipBytes(struct ClipBuilder *builder, UBYTE *bytes, ULONG length)
+{
+    struct ClipPiece *piece = NULL;
+    ULONG count = 0;
+
+    while (length > 0) {
+        if (builder->room == 0) {
+            builder->room = (builder->left < CLIP_PIECE) ? builder->left : CLIP_PIECE;
+            if (builder->room < length && builder->room < CLIP_PIECE) {
+                builder->room = length;
+            }
+            if (!AddClipPiece(builder->text, NULL, 0, builder->room, FALSE)) {
+                builder->room = 0;
+                return FALSE;
+            }
+        }
+        piece = builder->text->lastPiece;
+        count = (length < builder->room) ? length : builder->room;
+        CopyMem(bytes, &piece->text[piece->length], count);
+        piece->length += count;
+        builder->text->length += count;
+        builder->room -= count;
+        builder->left = (builder->left > count) ? builder->left - count : 0;
+        bytes += count;
+        length -= count;
+    }
+    return TRUE;
+}
+
+/* ============================================================================
+ * Clip Ring
+ * ============================================================================ */
+
+/* Keep clip text in the ring, taking over the caller's reference - a named clip replaces the
+ * one of the same name, anything else becomes the most recent and pushes out the oldest */
+VOID PushClip(struct TTXApplication *app, STRPTR name, struct ClipText *text)
+{
+    struct ClipSlot *slot = NULL;
+    ULONG i = 0;
+
+    if (!app || !text) {
+        ReleaseClipText(text);
+        return;
+    }
+
+    if (name && name[0] != '\0') {
+        for (i = 0; i < TTX_CLIP_RING; i++) {
+            if (app->clipRing[i].text && SameClipName((STRPTR)app->clipRing[i].name, name)) {
+                slot = &app->clipRing[i];
+                break;
+            }
+        }
+    }
+    if (!slot) {
+        app->clipHead = (app->clipHead + TTX_CLIP_RING - 1) % TTX_CLIP_RING;
+        slot = &app->clipRing[app->clipHead];
+    }
+
+    ReleaseClipText(slot->text);
+    slot->text = text;
+    slot->name[0] = '\0';
+    for (i = 0; name && name[i] != '\0' && i < TTX_CLIP_NAME_MAX - 1; i++) {
+        slot->name[i] = (UBYTE)name[i];
+    }
+    slot->name[i] = '\0';
+    Printf("[CLIP] PushClip: %lu bytes in slot %lu%s%s\n", text->length, (ULONG)(slot - app->clipRing),
+           slot->name[0] ? " as " : "", slot->name);
+}
+
+/* Clip text by name, or by position when which is a number (1 is the most recent, as is
+ * NULL); the ring keeps the reference - NULL if there is no such clip */
+struct ClipText *FindClip(struct TTXApplication *app, STRPTR which)
+{
+    LONG position = 0;
+    ULONG i = 0;
+
+    if (!app) {
+        return NULL;
+    }
+
+    if (!which || which[0] == '\0') {
+        position = 1;
+    } else if (StrToLong(which, &position) <= 0) {
+        for (i = 0; i < TTX_CLIP_RING; i++) {
+            if (app->clipRing[i].text && SameClipName((STRPTR)app->clipRing[i].name, which)) {
+                return app->clipRing[i].text;
+            }
+        }
+        return NULL;
+    }
+
+    if (position < 1 || position > TTX_CLIP_RING) {
+        return NULL;
+    }
+    return app->clipRing[(app->clipHead + (ULONG)position - 1) % TTX_CLIP_RING].text;
+}
+
+/* Empty the ring */
+VOID FreeClipRing(struct TTXApplication *app)
+{
+    ULONG i = 0;
+
+    if (!app) {
+        return;
+    }
+    for (i = 0; i < TTX_CLIP_RING; i++) {
+        ReleaseClipText(app->clipRing[i].text);
+        app->clipRing[i].text = NULL;
+        app->clipRing[i].name[0] = '\0';
+    }
+    app->clipHead = 0;
+}
+
+/* Clip names compare without regard to case */
+static BOOL SameClipName(STRPTR a, STRPTR b)
+{
+    ULONG i = 0;
+    UBYTE ca = 0;
+    UBYTE cb = 0;
+
+    for (i = 0; i < TTX_CLIP_NAME_MAX - 1; i++) {
+        ca = (UBYTE)a[i];
+        cb = (UBYTE)b[i];
+        if (ca >= 'a' && ca <= 'z') {
+            ca = (UBYTE)(ca - 'a' + 'A');
+        }
+        if (cb >= 'a' && cb <= 'z') {
+            cb = (UBYTE)(cb - 'a' + 'A');
+        }
+        if (ca != cb) {
+            return FALSE;
+        }
+        if (ca == '\0') {
+            break;
+        }
+    }
+    return TRUE;
+}
+
+/* ============================================================================
+ * Clipboard Device
+ * ============================================================================ */
+
+/* Open a clipboard unit */
+static BOOL OpenClipStream(struct ClipStream *clip, ULONG unit)
+{
+    clip->port = NULL;
+    clip->io = NULL;
+    clip->deviceOpen = FALSE;
+    clip->offset = 0;
+
+    clip->port = createMsgPort();
+    if (!clip->port) {
+        return FALSE;
+    }
+    clip->io = (struct IOClipReq *)CreateIORequest(clip->port, sizeof(struct IOClipReq));
+    if (!clip->io) {
+        CloseClipStream(clip);
+        return FALSE;
+    }
+    if (OpenDevice("clipboard.device", unit, (struct IORequest *)clip->io, 0) != 0) {
+        Printf("[CLIP] OpenClipStream: FAIL (OpenDevice clipboard.device unit %lu failed)\n", unit);
+        CloseClipStream(clip);
+        return FALSE;
+    }
+    clip->deviceOpen = TRUE;
+    return TRUE;
+}
+
+static VOID CloseClipStream(struct ClipStream *clip)
+{
+    if (clip->deviceOpen) {
+        CloseDevice((struct IORequest *)clip->io);
+        clip->deviceOpen = FALSE;
+    }
+    if (clip->io) {
+        DeleteIORequest((struct IORequest *)clip->io);
+        clip->io = NULL;
+    }
+    if (clip->port) {
+        deleteMsgPort(clip->port);
+        clip->port = NULL;
+    }
+}
+
+/* Write at the current offset */
+static BOOL WriteClip(struct ClipStream *clip, APTR data, ULONG length)
+{
+    clip->io->io_Command = CMD_WRITE;
+    clip->io->io_Data = (STRPTR)data;
+    clip->io->io_Length = length;
+    clip->io->io_Offset = clip->offset;
+    if (DoIO((struct IORequest *)clip->io) != 0 || clip->io->io_Actual != length) {
+        return FALSE;
+    }
+    clip->offset += length;
+    return TRUE;
+}
+
+/* Read at the current offset; returns the bytes read (0 at the end of the clip, -1 on error) */
+static LONG ReadClip(struct ClipStream *clip, APTR data, ULONG length)
+{
+    clip->io->io_Command = CMD_READ;
+    clip->io->io_Data = (STRPTR)data;
+    clip->io->io_Length = length;
+    clip->io->io_Offset = clip->offset;
+    if (DoIO((struct IORequest *)clip->io) != 0) {
+        return -1;
+    }
+    clip->offset += clip->io->io_Actual;
+    return (LONG)clip->io->io_Actual;
+}
+
+/* Start a new clip holding textLength bytes of text */
+static BOOL BeginClipWrite(struct ClipStream *clip, ULONG textLength)
+{
+    ULONG header[5];
+
+    header[0] = CLIP_FORM;
+    header[1] = 12 + textLength + (textLength & 1);  /* FTXT, CHRS header, text, pad */
+    header[2] = CLIP_FTXT;
+    header[3] = CLIP_CHRS;
+    header[4] = textLength;
+
+    clip->io->io_ClipID = 0;
+    clip->offset = 0;
+    return WriteClip(clip, header, sizeof(header));
+}
+
+/* Pad the text and tell the device the clip is complete (it must hear this even after a failure) */
+static BOOL EndClipWrite(struct ClipStream *clip, ULONG textLength, BOOL ok)
+{
+    UBYTE pad = 0;
+
+    if (ok && (textLength & 1)) {
+        ok = WriteClip(clip, &pad, 1);
+    }
+    clip->io->io_Command = CMD_UPDATE;
+    clip->io->io_Length = 0;
+    if (DoIO((struct IORequest *)clip->io) != 0) {
+        ok = FALSE;
+    }
+    return ok;
+}
+
+/* Move to the text of the next CHRS chunk of the clip; returns its length, or -1 when there
+ * is none (on the first call, also if the clip is not FTXT) */
+static LONG NextClipText(struct ClipStream *clip, ULONG *formEnd)
+{
+    ULONG header[3];
+    ULONG size = 0;
+
+    if (clip->offset == 0) {
+        clip->io->io_ClipID = 0;
+        if (ReadClip(clip, header, 12) != 12 || header[0] != CLIP_FORM || header[2] != CLIP_FTXT) {
+            return -1;
+        }
+        *formEnd = 8 + header[1];
+    }
+
+    /* A CHRS chunk whose text was not all read leaves the offset mid-chunk - chunks start even */
+    clip->offset = (clip->offset + 1) & ~1UL;
+    while (clip->offset + 8 <= *formEnd) {
+        if (ReadClip(clip, header, 8) != 8) {
+            return -1;
+        }
+        size = header[1];
+        if (header[0] == CLIP_CHRS) {
+            return (LONG)size;
+        }
+        /* Skip other chunks (FONS and the like) */
+        clip->offset += size + (size & 1);
+    }
+    return -1;
+}
+
+/* Read past the end of the clip so the device knows the read is finished */
+static VOID EndClipRead(struct ClipStream *clip)
+{
+    UBYTE rest[16];
+
+    while (ReadClip(clip, rest, sizeof(rest)) > 0) {
+        /* Nothing to do with the rest */
+    }
+}
+
+/* Queue bytes for the clip - gathered in stage, or written in place when they fill it */
+static BOOL PutClipRun(struct ClipStream *clip, UBYTE *stage, ULONG *staged, UBYTE *text, ULONG length)
+{
+    if (length > 0 && *staged + length > CLIP_CHUNK) {
+        /* Flush what is gathered; a long run then goes out in place */
+        if (*staged > 0) {
+            if (!WriteClip(clip, stage, *staged)) {
+                return FALSE;
+            }
+            *staged = 0;
+        }
+        if (length >= CLIP_CHUNK) {
+            return WriteClip(clip, text, length);
+        }
+    }
+    if (length > 0) {
+        CopyMem(text, &stage[*staged], length);
+        *staged += length;
+    }
+    return TRUE;
+}
+
+/* Bytes of text in a selection, with a newline between lines */
+static ULONG GetBlockLength(struct TextBuffer *buffer, ULONG startY, ULONG startX, ULONG stopY, ULONG stopX)
+{
+    ULONG length = stopY - startY;
+    ULONG fromX = 0;
+    ULONG toX = 0;
+    ULONG i = 0;
+
+    for (i = startY; i <= stopY; i++) {
+        GetBlockLineRange(buffer, i, startY, startX, stopY, stopX, &fromX, &toX);
+        length += toX - fromX;
+    }
+    return length;
+}
+
+/* A column paste can leave the cursor past the end of the line it finished on */
+static VOID EndColumnPaste(struct TextBuffer *buffer)
+{
+    if (buffer->cursorY < buffer->doc->lineCount &&
+        buffer->cursorX > buffer->doc->lines[buffer->cursorY].length) {
+        buffer->cursorX = buffer->doc->lines[buffer->cursorY].length;
+    }
+}
@@ -21,376 +21,434 @@ static VOID cleanupFileRequester(APTR resource)
     }
 }
 
-/* Command dispatcher - maps command names to handler functions */
-BOOL TTX_HandleCommand(struct TTXApplication *app, struct Session *session, STRPTR command, STRPTR *args, ULONG argCount)
-{
-    if (!app || !session || !command) {
-        return FALSE;
-    }
-    
-    Printf("[CMD] TTX_HandleCommand: command='%s' (argCount=%lu)\n", command, argCount);
-    
+/* Command table - resolved once by name, then called through the entry */
+static struct TTXCommand g_commands[] = {
     /* Document commands */
-    if (Stricmp(command, "ActivateLastDoc") == 0) {
-        return TTX_Cmd_ActivateLastDoc(app, session, args, argCount);
-    } else if (Stricmp(command, "ActivateNextDoc") == 0) {
-        return TTX_Cmd_ActivateNextDoc(app, session, args, argCount);
-    } else if (Stricmp(command, "ActivatePrevDoc") == 0) {
-        return TTX_Cmd_ActivatePrevDoc(app, session, args, argCount);
-    } else if (Stricmp(command, "CloseDoc") == 0) {
-        return TTX_Cmd_CloseDoc(app, session, args, argCount);
-    } else if (Stricmp(command, "OpenDoc") == 0) {
-        return TTX_Cmd_OpenDoc(app, session, args, argCount);
-    }
+    {"ActivateLastDoc", TTX_Cmd_ActivateLastDoc},
+    {"ActivateNextDoc", TTX_Cmd_ActivateNextDoc},
+    {"ActivatePrevDoc", TTX_Cmd_ActivatePrevDoc},
+    {"CloseDoc", TTX_Cmd_CloseDoc},
+    {"OpenDoc", TTX_Cmd_OpenDoc},
+    
     /* Display/Window commands */
-    else if (Stricmp(command, "ActivateWindow") == 0) {
-        return TTX_Cmd_ActivateWindow(app, session, args, argCount);
-    } else if (Stricmp(command, "BeepScreen") == 0) {
-        return TTX_Cmd_BeepScreen(app, session, args, argCount);
-    } else if (Stricmp(command, "CloseRequester") == 0) {
-        return TTX_Cmd_CloseRequester(app, session, args, argCount);
-    } else if (Stricmp(command, "ControlWindow") == 0) {
-        return TTX_Cmd_ControlWindow(app, session, args, argCount);
-    } else if (Stricmp(command, "GetCursor") == 0) {
-        return TTX_Cmd_GetCursor(app, session, args, argCount);
-    } else if (Stricmp(command, "GetScreenInfo") == 0) {
-        return TTX_Cmd_GetScreenInfo(app, session, args, argCount);
-    } else if (Stricmp(command, "GetWindowInfo") == 0) {
-        return TTX_Cmd_GetWindowInfo(app, session, args, argCount);
-    } else if (Stricmp(command, "IconifyWindow") == 0) {
-        return TTX_Cmd_IconifyWindow(app, session, args, argCount);
-    } else if (Stricmp(command, "MoveSizeWindow") == 0) {
-        return TTX_Cmd_MoveSizeWindow(app, session, args, argCount);
-    } else if (Stricmp(command, "MoveWindow") == 0) {
-        return TTX_Cmd_MoveWindow(app, session, args, argCount);
-    } else if (Stricmp(command, "OpenRequester") == 0) {
-        return TTX_Cmd_OpenRequester(app, session, args, argCount);
-    } else if (Stricmp(command, "RemakeScreen") == 0) {
-        return TTX_Cmd_RemakeScreen(app, session, args, argCount);
-    } else if (Stricmp(command, "Screen2Back") == 0) {
-        return TTX_Cmd_Screen2Back(app, session, args, argCount);
-    } else if (Stricmp(command, "Screen2Front") == 0) {
-        return TTX_Cmd_Screen2Front(app, session, args, argCount);
-    } else if (Stricmp(command, "SetCursor") == 0) {
-        return TTX_Cmd_SetCursor(app, session, args, argCount);
-    } else if (Stricmp(command, "SetStatusBar") == 0) {
-        return TTX_Cmd_SetStatusBar(app, session, args, argCount);
-    } else if (Stricmp(command, "SizeWindow") == 0) {
-        return TTX_Cmd_SizeWindow(app, session, args, argCount);
-    } else if (Stricmp(command, "UsurpWindow") == 0) {
-        return TTX_Cmd_UsurpWindow(app, session, args, argCount);
-    } else if (Stricmp(command, "Window2Back") == 0) {
-        return TTX_Cmd_Window2Back(app, session, args, argCount);
-    } else if (Stricmp(command, "Window2Front") == 0) {
-        return TTX_Cmd_Window2Front(app, session, args, argCount);
-    }
+    {"ActivateWindow", TTX_Cmd_ActivateWindow},
+    {"BeepScreen", TTX_Cmd_BeepScreen},
+    {"CloseRequester", TTX_Cmd_CloseRequester},
+    {"ControlWindow", TTX_Cmd_ControlWindow},
+    {"GetCursor", TTX_Cmd_GetCursor},
+    {"GetScreenInfo", TTX_Cmd_GetScreenInfo},
+    {"GetWindowInfo", TTX_Cmd_GetWindowInfo},
+    {"IconifyWindow", TTX_Cmd_IconifyWindow},
+    {"MoveSizeWindow", TTX_Cmd_MoveSizeWindow},
+    {"MoveWindow", TTX_Cmd_MoveWindow},
+    {"OpenRequester", TTX_Cmd_OpenRequester},
+    {"RemakeScreen", TTX_Cmd_RemakeScreen},
+    {"Screen2Back", TTX_Cmd_Screen2Back},
+    {"Screen2Front", TTX_Cmd_Screen2Front},
+    {"SetCursor", TTX_Cmd_SetCursor},
+    {"SetStatusBar", TTX_Cmd_SetStatusBar},
+    {"SizeWindow", TTX_Cmd_SizeWindow},
+    {"UsurpWindow", TTX_Cmd_UsurpWindow},
+    {"Window2Back", TTX_Cmd_Window2Back},
+    {"Window2Front", TTX_Cmd_Window2Front},
+    
     /* View commands */
-    else if (Stricmp(command, "CenterView") == 0) {
-        return TTX_Cmd_CenterView(app, session, args, argCount);
-    } else if (Stricmp(command, "GetViewInfo") == 0) {
-        return TTX_Cmd_GetViewInfo(app, session, args, argCount);
-    } else if (Stricmp(command, "ScrollView") == 0) {
-        return TTX_Cmd_ScrollView(app, session, args, argCount);
-    } else if (Stricmp(command, "SizeView") == 0) {
-        return TTX_Cmd_SizeView(app, session, args, argCount);
-    } else if (Stricmp(command, "SplitView") == 0) {
-        return TTX_Cmd_SplitView(app, session, args, argCount);
-    } else if (Stricmp(command, "SwapViews") == 0) {
-        return TTX_Cmd_SwapViews(app, session, args, argCount);
-    } else if (Stricmp(command, "SwitchView") == 0) {
-        return TTX_Cmd_SwitchView(app, session, args, argCount);
-    } else if (Stricmp(command, "UpdateView") == 0) {
-        return TTX_Cmd_UpdateView(app, session, args, argCount);
-    }
+    {"CenterView", TTX_Cmd_CenterView},
+    {"GetViewInfo", TTX_Cmd_GetViewInfo},
+    {"ScrollView", TTX_Cmd_ScrollView},
+    {"SizeView", TTX_Cmd_SizeView},
+    {"SplitView", TTX_Cmd_SplitView},
+    {"SwapViews", TTX_Cmd_SwapViews},
+    {"SwitchView", TTX_Cmd_SwitchView},
+    {"UpdateView", TTX_Cmd_UpdateView},
+    
     /* Selection block commands */
-    else if (Stricmp(command, "CopyBlk") == 0) {
-        return TTX_Cmd_CopyBlk(app, session, args, argCount);
-    } else if (Stricmp(command, "CutBlk") == 0) {
-        return TTX_Cmd_CutBlk(app, session, args, argCount);
-    } else if (Stricmp(command, "DeleteBlk") == 0) {
-        return TTX_Cmd_DeleteBlk(app, session, args, argCount);
-    } else if (Stricmp(command, "EncryptBlk") == 0) {
-        return TTX_Cmd_EncryptBlk(app, session, args, argCount);
-    } else if (Stricmp(command, "GetBlk") == 0) {
-        return TTX_Cmd_GetBlk(app, session, args, argCount);
-    } else if (Stricmp(command, "GetBlkInfo") == 0) {
-        return TTX_Cmd_GetBlkInfo(app, session, args, argCount);
-    } else if (Stricmp(command, "MarkBlk") == 0) {
-        return TTX_Cmd_MarkBlk(app, session, args, argCount);
-    }
+    {"CopyBlk", TTX_Cmd_CopyBlk},
+    {"CutBlk", TTX_Cmd_CutBlk},
+    {"DeleteBlk", TTX_Cmd_DeleteBlk},
+    {"EncryptBlk", TTX_Cmd_EncryptBlk},
+    {"FillBlk", TTX_Cmd_FillBlk},
+    {"GetBlk", TTX_Cmd_GetBlk},
+    {"GetBlkInfo", TTX_Cmd_GetBlkInfo},
+    {"MarkBlk", TTX_Cmd_MarkBlk},
+    
     /* Clipboard commands */
-    else if (Stricmp(command, "OpenClip") == 0) {
-        return TTX_Cmd_OpenClip(app, session, args, argCount);
-    } else if (Stricmp(command, "PasteClip") == 0) {
-        return TTX_Cmd_PasteClip(app, session, args, argCount);
-    } else if (Stricmp(command, "PrintClip") == 0) {
-        return TTX_Cmd_PrintClip(app, session, args, argCount);
-    } else if (Stricmp(command, "SaveClip") == 0) {
-        return TTX_Cmd_SaveClip(app, session, args, argCount);
-    }
+    {"OpenClip", TTX_Cmd_OpenClip},
+    {"PasteClip", TTX_Cmd_PasteClip},
+    {"PrintClip", TTX_Cmd_PrintClip},
+    {"SaveClip", TTX_Cmd_SaveClip},
+    
     /* File commands */
-    else if (Stricmp(command, "ClearFile") == 0) {
-        return TTX_Cmd_ClearFile(app, session, args, argCount);
-    } else if (Stricmp(command, "GetFileInfo") == 0) {
-        return TTX_Cmd_GetFileInfo(app, session, args, argCount);
-    } else if (Stricmp(command, "GetFilePath") == 0) {
-        return TTX_Cmd_GetFilePath(app, session, args, argCount);
-    } else if (Stricmp(command, "InsertFile") == 0) {
-        return TTX_Cmd_InsertFile(app, session, args, argCount);
-    } else if (Stricmp(command, "OpenFile") == 0) {
-        return TTX_Cmd_OpenFile(app, session, args, argCount);
-    } else if (Stricmp(command, "PrintFile") == 0) {
-        return TTX_Cmd_PrintFile(app, session, args, argCount);
-    } else if (Stricmp(command, "SaveFile") == 0) {
-        return TTX_Cmd_SaveFile(app, session, args, argCount);
-    } else if (Stricmp(command, "SaveFileAs") == 0) {
-        return TTX_Cmd_SaveFileAs(app, session, args, argCount);
-    } else if (Stricmp(command, "SetFilePath") == 0) {
-        return TTX_Cmd_SetFilePath(app, session, args, argCount);
-    }
+    {"ClearFile", TTX_Cmd_ClearFile},
+    {"GetFileInfo", TTX_Cmd_GetFileInfo},
+    {"GetFilePath", TTX_Cmd_GetFilePath},
+    {"InsertFile", TTX_Cmd_InsertFile},
+    {"OpenFile", TTX_Cmd_OpenFile},
+    {"PrintFile", TTX_Cmd_PrintFile},
+    {"SaveFile", TTX_Cmd_SaveFile},
+    {"SaveFileAs", TTX_Cmd_SaveFileAs},
+    {"SetFilePath", TTX_Cmd_SetFilePath},
+    
     /* Cursor position commands */
-    else if (Stricmp(command, "Find") == 0) {
-        return TTX_Cmd_Find(app, session, args, argCount);
-    } else if (Stricmp(command, "GetCursorPos") == 0) {
-        return TTX_Cmd_GetCursorPos(app, session, args, argCount);
-    } else if (Stricmp(command, "Move") == 0) {
-        return TTX_Cmd_Move(app, session, args, argCount);
-    } else if (Stricmp(command, "MoveChar") == 0) {
-        return TTX_Cmd_MoveChar(app, session, args, argCount);
-    } else if (Stricmp(command, "MoveDown") == 0) {
-        return TTX_Cmd_MoveDown(app, session, args, argCount);
-    } else if (Stricmp(command, "MoveDownScr") == 0) {
-        return TTX_Cmd_MoveDownScr(app, session, args, argCount);
-    } else if (Stricmp(command, "MoveEOF") == 0) {
-        return TTX_Cmd_MoveEOF(app, session, args, argCount);
-    } else if (Stricmp(command, "MoveEOL") == 0) {
-        return TTX_Cmd_MoveEOL(app, session, args, argCount);
-    } else if (Stricmp(command, "MoveLastChange") == 0) {
-        return TTX_Cmd_MoveLastChange(app, session, args, argCount);
-    } else if (Stricmp(command, "MoveLeft") == 0) {
-        return TTX_Cmd_MoveLeft(app, session, args, argCount);
-    } else if (Stricmp(command, "MoveMatchBkt") == 0) {
-        return TTX_Cmd_MoveMatchBkt(app, session, args, argCount);
-    } else if (Stricmp(command, "MoveNextTabStop") == 0) {
-        return TTX_Cmd_MoveNextTabStop(app, session, args, argCount);
-    } else if (Stricmp(command, "MoveNextWord") == 0) {
-        return TTX_Cmd_MoveNextWord(app, session, args, argCount);
-    } else if (Stricmp(command, "MovePrevTabStop") == 0) {
-        return TTX_Cmd_MovePrevTabStop(app, session, args, argCount);
-    } else if (Stricmp(command, "MovePrevWord") == 0) {
-        return TTX_Cmd_MovePrevWord(app, session, args, argCount);
-    } else if (Stricmp(command, "MoveRight") == 0) {
-        return TTX_Cmd_MoveRight(app, session, args, argCount);
-    } else if (Stricmp(command, "MoveSOF") == 0) {
-        return TTX_Cmd_MoveSOF(app, session, args, argCount);
-    } else if (Stricmp(command, "MoveSOL") == 0) {
-        return TTX_Cmd_MoveSOL(app, session, args, argCount);
-    } else if (Stricmp(command, "MoveUp") == 0) {
-        return TTX_Cmd_MoveUp(app, session, args, argCount);
-    } else if (Stricmp(command, "MoveUpScr") == 0) {
-        return TTX_Cmd_MoveUpScr(app, session, args, argCount);
-    }
+    {"Find", TTX_Cmd_Find},
+    {"GetCursorPos", TTX_Cmd_GetCursorPos},
+    {"Move", TTX_Cmd_Move},
+    {"MoveChar", TTX_Cmd_MoveChar},
+    {"MoveDown", TTX_Cmd_MoveDown},
+    {"MoveDownScr", TTX_Cmd_MoveDownScr},
+    {"MoveEOF", TTX_Cmd_MoveEOF},
+    {"MoveEOL", TTX_Cmd_MoveEOL},
+    {"MoveLastChange", TTX_Cmd_MoveLastChange},
+    {"MoveLeft", TTX_Cmd_MoveLeft},
+    {"MoveMatchBkt", TTX_Cmd_MoveMatchBkt},
+    {"MoveNextTabStop", TTX_Cmd_MoveNextTabStop},
+    {"MoveNextWord", TTX_Cmd_MoveNextWord},
+    {"MovePrevTabStop", TTX_Cmd_MovePrevTabStop},
+    {"MovePrevWord", TTX_Cmd_MovePrevWord},
+    {"MoveRight", TTX_Cmd_MoveRight},
+    {"MoveSOF", TTX_Cmd_MoveSOF},
+    {"MoveSOL", TTX_Cmd_MoveSOL},
+    {"MoveUp", TTX_Cmd_MoveUp},
+    {"MoveUpScr", TTX_Cmd_MoveUpScr},
+    
     /* Bookmark commands */
-    else if (Stricmp(command, "ClearBookmark") == 0) {
-        return TTX_Cmd_ClearBookmark(app, session, args, argCount);
-    } else if (Stricmp(command, "MoveAutomark") == 0) {
-        return TTX_Cmd_MoveAutomark(app, session, args, argCount);
-    } else if (Stricmp(command, "MoveBookmark") == 0) {
-        return TTX_Cmd_MoveBookmark(app, session, args, argCount);
-    } else if (Stricmp(command, "SetBookmark") == 0) {
-        return TTX_Cmd_SetBookmark(app, session, args, argCount);
-    }
+    {"ClearBookmark", TTX_Cmd_ClearBookmark},
+    {"MoveAutomark", TTX_Cmd_MoveAutomark},
+    {"MoveBookmark", TTX_Cmd_MoveBookmark},
+    {"SetBookmark", TTX_Cmd_SetBookmark},
+    
     /* Editing commands */
-    else if (Stricmp(command, "Delete") == 0) {
-        return TTX_Cmd_Delete(app, session, args, argCount);
-    } else if (Stricmp(command, "DeleteEOL") == 0) {
-        return TTX_Cmd_DeleteEOL(app, session, args, argCount);
-    } else if (Stricmp(command, "DeleteEOW") == 0) {
-        return TTX_Cmd_DeleteEOW(app, session, args, argCount);
-    } else if (Stricmp(command, "DeleteLine") == 0) {
-        return TTX_Cmd_DeleteLine(app, session, args, argCount);
-    } else if (Stricmp(command, "DeleteSOL") == 0) {
-        return TTX_Cmd_DeleteSOL(app, session, args, argCount);
-    } else if (Stricmp(command, "DeleteSOW") == 0) {
-        return TTX_Cmd_DeleteSOW(app, session, args, argCount);
-    } else if (Stricmp(command, "FindChange") == 0) {
-        return TTX_Cmd_FindChange(app, session, args, argCount);
-    } else if (Stricmp(command, "GetChar") == 0) {
-        return TTX_Cmd_GetChar(app, session, args, argCount);
-    } else if (Stricmp(command, "GetLine") == 0) {
-        return TTX_Cmd_GetLine(app, session, args, argCount);
-    } else if (Stricmp(command, "Insert") == 0) {
-        return TTX_Cmd_Insert(app, session, args, argCount);
-    } else if (Stricmp(command, "InsertLine") == 0) {
-        return TTX_Cmd_InsertLine(app, session, args, argCount);
-    } else if (Stricmp(command, "SetChar") == 0) {
-        return TTX_Cmd_SetChar(app, session, args, argCount);
-    } else if (Stricmp(command, "SwapChars") == 0) {
-        return TTX_Cmd_SwapChars(app, session, args, argCount);
-    } else if (Stricmp(command, "Text") == 0) {
-        return TTX_Cmd_Text(app, session, args, argCount);
-    } else if (Stricmp(command, "ToggleCharCase") == 0) {
-        return TTX_Cmd_ToggleCharCase(app, session, args, argCount);
-    } else if (Stricmp(command, "UndeleteLine") == 0) {
-        return TTX_Cmd_UndeleteLine(app, session, args, argCount);
-    } else if (Stricmp(command, "UndoLine") == 0) {
-        return TTX_Cmd_UndoLine(app, session, args, argCount);
-    }
+    {"Delete", TTX_Cmd_Delete},
+    {"DeleteForward", TTX_Cmd_DeleteForward},
+    {"DeleteEOL", TTX_Cmd_DeleteEOL},
+    {"DeleteEOW", TTX_Cmd_DeleteEOW},
+    {"DeleteLine", TTX_Cmd_DeleteLine},
+    {"DeleteSOL", TTX_Cmd_DeleteSOL},
+    {"DeleteSOW", TTX_Cmd_DeleteSOW},
+    {"FindChange", TTX_Cmd_FindChange},
+    {"GetChar", TTX_Cmd_GetChar},
+    {"GetLine", TTX_Cmd_GetLine},
+    {"Insert", TTX_Cmd_Insert},
+    {"InsertLine", TTX_Cmd_InsertLine},
+    {"SetChar", TTX_Cmd_SetChar},
+    {"SwapChars", TTX_Cmd_SwapChars},
+    {"Text", TTX_Cmd_Text},
+    {"ToggleCharCase", TTX_Cmd_ToggleCharCase},
+    {"UndeleteLine", TTX_Cmd_UndeleteLine},
+    {"UndoLine", TTX_Cmd_UndoLine},
+    
+    /* Caret commands */
+    {"AddCaret", TTX_Cmd_AddCaret},
+    {"AddCarets", TTX_Cmd_AddCarets},
+    {"ClearCarets", TTX_Cmd_ClearCarets},
+    
     /* Word-level editing commands */
-    else if (Stricmp(command, "CompleteTemplate") == 0) {
-        return TTX_Cmd_CompleteTemplate(app, session, args, argCount);
-    } else if (Stricmp(command, "CorrectWord") == 0) {
-        return TTX_Cmd_CorrectWord(app, session, args, argCount);
-    } else if (Stricmp(command, "CorrectWordCase") == 0) {
-        return TTX_Cmd_CorrectWordCase(app, session, args, argCount);
-    } else if (Stricmp(command, "GetWord") == 0) {
-        return TTX_Cmd_GetWord(app, session, args, argCount);
-    } else if (Stricmp(command, "ReplaceWord") == 0) {
-        return TTX_Cmd_ReplaceWord(app, session, args, argCount);
-    }
+    {"CompleteTemplate", TTX_Cmd_CompleteTemplate},
+    {"CorrectWord", TTX_Cmd_CorrectWord},
+    {"CorrectWordCase", TTX_Cmd_CorrectWordCase},
+    {"GetWord", TTX_Cmd_GetWord},
+    {"ReplaceWord", TTX_Cmd_ReplaceWord},
+    
     /* Formatting commands */
-    else if (Stricmp(command, "Center") == 0) {
-        return TTX_Cmd_Center(app, session, args, argCount);
-    } else if (Stricmp(command, "Conv2Lower") == 0) {
-        return TTX_Cmd_Conv2Lower(app, session, args, argCount);
-    } else if (Stricmp(command, "Conv2Spaces") == 0) {
-        return TTX_Cmd_Conv2Spaces(app, session, args, argCount);
-    } else if (Stricmp(command, "Conv2Tabs") == 0) {
-        return TTX_Cmd_Conv2Tabs(app, session, args, argCount);
-    } else if (Stricmp(command, "Conv2Upper") == 0) {
-        return TTX_Cmd_Conv2Upper(app, session, args, argCount);
-    } else if (Stricmp(command, "FormatParagraph") == 0) {
-        return TTX_Cmd_FormatParagraph(app, session, args, argCount);
-    } else if (Stricmp(command, "Justify") == 0) {
-        return TTX_Cmd_Justify(app, session, args, argCount);
-    } else if (Stricmp(command, "ShiftLeft") == 0) {
-        return TTX_Cmd_ShiftLeft(app, session, args, argCount);
-    } else if (Stricmp(command, "ShiftRight") == 0) {
-        return TTX_Cmd_ShiftRight(app, session, args, argCount);
-    }
+    {"Center", TTX_Cmd_Center},
+    {"Conv2Lower", TTX_Cmd_Conv2Lower},
+    {"Conv2Spaces", TTX_Cmd_Conv2Spaces},
+    {"Conv2Tabs", TTX_Cmd_Conv2Tabs},
+    {"Conv2Upper", TTX_Cmd_Conv2Upper},
+    {"FormatParagraph", TTX_Cmd_FormatParagraph},
+    {"Justify", TTX_Cmd_Justify},
+    {"ShiftLeft", TTX_Cmd_ShiftLeft},
+    {"ShiftRight", TTX_Cmd_ShiftRight},
+    
     /* Fold commands */
-    else if (Stricmp(command, "HideFold") == 0) {
-        return TTX_Cmd_HideFold(app, session, args, argCount);
-    } else if (Stricmp(command, "MakeFold") == 0) {
-        return TTX_Cmd_MakeFold(app, session, args, argCount);
-    } else if (Stricmp(command, "ShowFold") == 0) {
-        return TTX_Cmd_ShowFold(app, session, args, argCount);
-    } else if (Stricmp(command, "ToggleFold") == 0) {
-        return TTX_Cmd_ToggleFold(app, session, args, argCount);
-    } else if (Stricmp(command, "UnmakeFold") == 0) {
-        return TTX_Cmd_UnmakeFold(app, session, args, argCount);
-    }
+    {"HideFold", TTX_Cmd_HideFold},
+    {"MakeFold", TTX_Cmd_MakeFold},
+    {"ShowFold", TTX_Cmd_ShowFold},
+    {"ToggleFold", TTX_Cmd_ToggleFold},
+    {"UnmakeFold", TTX_Cmd_UnmakeFold},
+    
     /* Macro commands */
-    else if (Stricmp(command, "EndMacro") == 0) {
-        return TTX_Cmd_EndMacro(app, session, args, argCount);
-    } else if (Stricmp(command, "ExecARexxMacro") == 0) {
-        return TTX_Cmd_ExecARexxMacro(app, session, args, argCount);
-    } else if (Stricmp(command, "ExecARexxString") == 0) {
-        return TTX_Cmd_ExecARexxString(app, session, args, argCount);
-    } else if (Stricmp(command, "FlushARexxCache") == 0) {
-        return TTX_Cmd_FlushARexxCache(app, session, args, argCount);
-    } else if (Stricmp(command, "GetARexxCache") == 0) {
-        return TTX_Cmd_GetARexxCache(app, session, args, argCount);
-    } else if (Stricmp(command, "GetMacroInfo") == 0) {
-        return TTX_Cmd_GetMacroInfo(app, session, args, argCount);
-    } else if (Stricmp(command, "OpenMacro") == 0) {
-        return TTX_Cmd_OpenMacro(app, session, args, argCount);
-    } else if (Stricmp(command, "PlayMacro") == 0) {
-        return TTX_Cmd_PlayMacro(app, session, args, argCount);
-    } else if (Stricmp(command, "RecordMacro") == 0) {
-        return TTX_Cmd_RecordMacro(app, session, args, argCount);
-    } else if (Stricmp(command, "SaveMacro") == 0) {
-        return TTX_Cmd_SaveMacro(app, session, args, argCount);
-    } else if (Stricmp(command, "SetARexxCache") == 0) {
-        return TTX_Cmd_SetARexxCache(app, session, args, argCount);
-    }
+    {"EndMacro", TTX_Cmd_EndMacro},
+    {"ExecARexxMacro", TTX_Cmd_ExecARexxMacro},
+    {"ExecARexxString", TTX_Cmd_ExecARexxString},
+    {"FlushARexxCache", TTX_Cmd_FlushARexxCache},
+    {"GetARexxCache", TTX_Cmd_GetARexxCache},
+    {"GetMacroInfo", TTX_Cmd_GetMacroInfo},
+    {"OpenMacro", TTX_Cmd_OpenMacro},
+    {"PlayMacro", TTX_Cmd_PlayMacro},
+    {"RecordMacro", TTX_Cmd_RecordMacro},
+    {"SaveMacro", TTX_Cmd_SaveMacro},
+    {"SetARexxCache", TTX_Cmd_SetARexxCache},
+    
     /* External tool commands */
-    else if (Stricmp(command, "ExecTool") == 0) {
-        return TTX_Cmd_ExecTool(app, session, args, argCount);
-    }
+    {"ExecTool", TTX_Cmd_ExecTool},
+    
     /* Configuration commands */
-    else if (Stricmp(command, "GetPrefs") == 0) {
-        return TTX_Cmd_GetPrefs(app, session, args, argCount);
-    } else if (Stricmp(command, "OpenDefinitions") == 0) {
-        return TTX_Cmd_OpenDefinitions(app, session, args, argCount);
-    } else if (Stricmp(command, "OpenPrefs") == 0) {
-        return TTX_Cmd_OpenPrefs(app, session, args, argCount);
-    } else if (Stricmp(command, "SaveDefPrefs") == 0) {
-        return TTX_Cmd_SaveDefPrefs(app, session, args, argCount);
-    } else if (Stricmp(command, "SavePrefs") == 0) {
-        return TTX_Cmd_SavePrefs(app, session, args, argCount);
-    } else if (Stricmp(command, "SetPrefs") == 0) {
-        return TTX_Cmd_SetPrefs(app, session, args, argCount);
-    }
+    {"GetPrefs", TTX_Cmd_GetPrefs},
+    {"OpenDefinitions", TTX_Cmd_OpenDefinitions},
+    {"OpenPrefs", TTX_Cmd_OpenPrefs},
+    {"SaveDefPrefs", TTX_Cmd_SaveDefPrefs},
+    {"SavePrefs", TTX_Cmd_SavePrefs},
+    {"SetPrefs", TTX_Cmd_SetPrefs},
+    
     /* ARexx input commands */
-    else if (Stricmp(command, "RequestBool") == 0) {
-        return TTX_Cmd_RequestBool(app, session, args, argCount);
-    } else if (Stricmp(command, "RequestChoice") == 0) {
-        return TTX_Cmd_RequestChoice(app, session, args, argCount);
-    } else if (Stricmp(command, "RequestFile") == 0) {
-        return TTX_Cmd_RequestFile(app, session, args, argCount);
-    } else if (Stricmp(command, "RequestNum") == 0) {
-        return TTX_Cmd_RequestNum(app, session, args, argCount);
-    } else if (Stricmp(command, "RequestStr") == 0) {
-        return TTX_Cmd_RequestStr(app, session, args, argCount);
-    }
+    {"RequestBool", TTX_Cmd_RequestBool},
+    {"RequestChoice", TTX_Cmd_RequestChoice},
+    {"RequestFile", TTX_Cmd_RequestFile},
+    {"RequestNum", TTX_Cmd_RequestNum},
+    {"RequestStr", TTX_Cmd_RequestStr},
+    
     /* ARexx control commands */
-    else if (Stricmp(command, "GetBackground") == 0) {
-        return TTX_Cmd_GetBackground(app, session, args, argCount);
-    } else if (Stricmp(command, "GetCurrentDir") == 0) {
-        return TTX_Cmd_GetCurrentDir(app, session, args, argCount);
-    } else if (Stricmp(command, "GetDocuments") == 0) {
-        return TTX_Cmd_GetDocuments(app, session, args, argCount);
-    } else if (Stricmp(command, "GetErrorInfo") == 0) {
-        return TTX_Cmd_GetErrorInfo(app, session, args, argCount);
-    } else if (Stricmp(command, "GetLockInfo") == 0) {
-        return TTX_Cmd_GetLockInfo(app, session, args, argCount);
-    } else if (Stricmp(command, "GetPort") == 0) {
-        return TTX_Cmd_GetPort(app, session, args, argCount);
-    } else if (Stricmp(command, "GetPriority") == 0) {
-        return TTX_Cmd_GetPriority(app, session, args, argCount);
-    } else if (Stricmp(command, "GetReadOnly") == 0) {
-        return TTX_Cmd_GetReadOnly(app, session, args, argCount);
-    } else if (Stricmp(command, "GetVersion") == 0) {
-        return TTX_Cmd_GetVersion(app, session, args, argCount);
-    } else if (Stricmp(command, "SetBackground") == 0) {
-        return TTX_Cmd_SetBackground(app, session, args, argCount);
-    } else if (Stricmp(command, "SetCurrentDir") == 0) {
-        return TTX_Cmd_SetCurrentDir(app, session, args, argCount);
-    } else if (Stricmp(command, "SetDisplayLock") == 0) {
-        return TTX_Cmd_SetDisplayLock(app, session, args, argCount);
-    } else if (Stricmp(command, "SetInputLock") == 0) {
-        return TTX_Cmd_SetInputLock(app, session, args, argCount);
-    } else if (Stricmp(command, "SetMeta") == 0) {
-        return TTX_Cmd_SetMeta(app, session, args, argCount);
-    } else if (Stricmp(command, "SetMeta2") == 0) {
-        return TTX_Cmd_SetMeta2(app, session, args, argCount);
-    } else if (Stricmp(command, "SetMode") == 0) {
-        return TTX_Cmd_SetMode(app, session, args, argCount);
-    } else if (Stricmp(command, "SetMode2") == 0) {
-        return TTX_Cmd_SetMode2(app, session, args, argCount);
-    } else if (Stricmp(command, "SetPriority") == 0) {
-        return TTX_Cmd_SetPriority(app, session, args, argCount);
-    } else if (Stricmp(command, "SetQuoteMode") == 0) {
-        return TTX_Cmd_SetQuoteMode(app, session, args, argCount);
-    } else if (Stricmp(command, "SetReadOnly") == 0) {
-        return TTX_Cmd_SetReadOnly(app, session, args, argCount);
-    }
+    {"GetBackground", TTX_Cmd_GetBackground},
+    {"GetCurrentDir", TTX_Cmd_GetCurrentDir},
+    {"GetDocuments", TTX_Cmd_GetDocuments},
+    {"GetErrorInfo", TTX_Cmd_GetErrorInfo},
+    {"GetLockInfo", TTX_Cmd_GetLockInfo},
+    {"GetPort", TTX_Cmd_GetPort},
+    {"GetPriority", TTX_Cmd_GetPriority},
+    {"GetReadOnly", TTX_Cmd_GetReadOnly},
+    {"GetVersion", TTX_Cmd_GetVersion},
+    {"SetBackground", TTX_Cmd_SetBackground},
+    {"SetCurrentDir", TTX_Cmd_SetCurrentDir},
+    {"SetDisplayLock", TTX_Cmd_SetDisplayLock},
+    {"SetInputLock", TTX_Cmd_SetInputLock},
+    {"SetMeta", TTX_Cmd_SetMeta},
+    {"SetMeta2", TTX_Cmd_SetMeta2},
+    {"SetMode", TTX_Cmd_SetMode},
+    {"SetMode2", TTX_Cmd_SetMode2},
+    {"SetPriority", TTX_Cmd_SetPriority},
+    {"SetQuoteMode", TTX_Cmd_SetQuoteMode},
+    {"SetReadOnly", TTX_Cmd_SetReadOnly},
+    
     /* Helper commands */
-    else if (Stricmp(command, "Help") == 0) {
-        return TTX_Cmd_Help(app, session, args, argCount);
-    } else if (Stricmp(command, "Illegal") == 0) {
-        return TTX_Cmd_Illegal(app, session, args, argCount);
-    } else if (Stricmp(command, "NOP") == 0) {
-        return TTX_Cmd_NOP(app, session, args, argCount);
-    } else if (Stricmp(command, "Iconify") == 0) {
-        return TTX_Cmd_Iconify(app, session, args, argCount);
-    } else if (Stricmp(command, "Quit") == 0) {
-        return TTX_Cmd_Quit(app, session, args, argCount);
-    } else {
+    {"Help", TTX_Cmd_Help},
+    {"Illegal", TTX_Cmd_Illegal},
+    {"NOP", TTX_Cmd_NOP},
+    {"Iconify", TTX_Cmd_Iconify},
+    {"Quit", TTX_Cmd_Quit},
+    {NULL, NULL}
+};
+
+/* Look a command up by name (NULL if there is no such command) */
+struct TTXCommand *TTX_FindCommand(STRPTR command)
+{
+    ULONG i = 0;
+    
+    if (!command) {
+        return NULL;
+    }
+    
+    for (i = 0; g_commands[i].name; i++) {
+        if (Stricmp(command, g_commands[i].name) == 0) {
+            return &g_commands[i];
+        }
+    }
+    
+    return NULL;
+}
+
+/* Command dispatcher - maps command names to handler functions */
+BOOL TTX_HandleCommand(struct TTXApplication *app, struct Session *session, STRPTR command, STRPTR *args, ULONG argCount)
+{
+    struct TTXCommand *handle = NULL;
+    
+    if (!app || !session || !command) {
+        return FALSE;
+    }
+    
+    Printf("[CMD] TTX_HandleCommand: command='%s' (argCount=%lu)\n", command, argCount);
+    
+    handle = TTX_FindCommand(command);
+    if (!handle) {
         Printf("[CMD] TTX_HandleCommand: unknown command '%s'\n", command);
         return FALSE;
     }
+    
+    return TTX_RunCommand(app, session, handle, args, argCount);
+}
+
+/* Run a resolved command - keys, menus and names all end up here, so this is where macros record */
+BOOL TTX_RunCommand(struct TTXApplication *app, struct Session *session, struct TTXCommand *command, STRPTR *args, ULONG argCount)
+{
+    BOOL result = FALSE;
+    
+    if (!app || !session || !command) {
+        return FALSE;
+    }
+    
+    /* A command that failed is left out of a recording - playback would stop at it every time */
+    result = command->handler(app, session, args, argCount);
+    if (result) {
+        RecordMacroCommand(app, command, args, argCount);
+    }
+    return result;
+}
+
+/* Position of a command in the table (what recorded macros store instead of the name) */
+ULONG TTX_CommandIndex(struct TTXCommand *command)
+{
+    return (ULONG)(command - g_commands);
+}
+
+/* Command at a table position (NULL if out of range) */
+struct TTXCommand *TTX_GetCommand(ULONG index)
+{
+    if (index >= sizeof(g_commands) / sizeof(g_commands[0]) - 1) {
+        return NULL;
+    }
+    
+    return &g_commands[index];
+}
+
+/* ============================================================================
+ * Key Bindings
+ * ============================================================================ */
+
+/* Built-in keys - the KEYBOARD section of the definitions can rebind any of them */
+#define TTX_KEY_ANY_QUALIFIER 0xFF   /* Bound in every row not otherwise bound */
+static struct TTXDefaultKey {
+    UBYTE code;
+    UBYTE row;
+    STRPTR command;
+} g_defaultKeys[] = {
+    {0x4F, TTX_KEY_ANY_QUALIFIER, "MoveLeft"},
+    {0x4E, TTX_KEY_ANY_QUALIFIER, "MoveRight"},
+    {0x4C, TTX_KEY_ANY_QUALIFIER, "MoveUp"},
+    {0x4D, TTX_KEY_ANY_QUALIFIER, "MoveDown"},
+    {0x41, TTX_KEY_ANY_QUALIFIER, "Delete"},
+    {0x46, TTX_KEY_ANY_QUALIFIER, "DeleteForward"},
+    {0x45, TTX_KEY_ANY_QUALIFIER, "CloseDoc"},
+    {0x12, DFN_QUAL_CTRL, "SaveFile"},
+    {0, 0, NULL}
+};
+
+/* Compile the key bindings: definitions first, built-in keys in the slots left over */
+BOOL TTX_BuildKeyMap(struct TTXApplication *app)
+{
+    struct TTXKeyMap *keyMap = NULL;
+    struct DFNFile *dfn = NULL;
+    struct DFNBinding *dfnBinding = NULL;
+    struct TTXCommand *command = NULL;
+    struct TTXKeyBinding *binding = NULL;
+    ULONG pass = 0;
+    ULONG count = 0;
+    ULONG row = 0;
+    ULONG code = 0;
+    ULONG i = 0;
+    
+    if (!app) {
+        return FALSE;
+    }
+    
+    TTX_FreeKeyMap(app);
+    
+    keyMap = (struct TTXKeyMap *)allocVec(sizeof(struct TTXKeyMap), MEMF_CLEAR);
+    if (!keyMap) {
+        Printf("[INIT] TTX_BuildKeyMap: FAIL (no memory)\n");
+        return FALSE;
+    }
+    
+    /* Qualifier byte to row, so a keystroke needs no qualifier tests */
+    for (i = 0; i < 256; i++) {
+        row = 0;
+        if (i & (IEQUALIFIER_LSHIFT | IEQUALIFIER_RSHIFT)) {
+            row |= DFN_QUAL_SHIFT;
+        }
+        if (i & (IEQUALIFIER_LALT | IEQUALIFIER_RALT)) {
+            row |= DFN_QUAL_ALT;
+        }
+        if (i & IEQUALIFIER_CONTROL) {
+            row |= DFN_QUAL_CTRL;
+        }
+        if (i & (IEQUALIFIER_LCOMMAND | IEQUALIFIER_RCOMMAND)) {
+            row |= DFN_QUAL_AMIGA;
+        }
+        keyMap->qualifierRow[i] = (UBYTE)row;
+    }
+    
+    /* First pass counts the slots that resolve, second fills them */
+    dfn = GetDefinitions();
+    for (pass = 0; pass < 2; pass++) {
+        if (pass == 1) {
+            if (count == 0) {
+                break;
+            }
+            keyMap->bindings = (struct TTXKeyBinding *)allocVec(count * sizeof(struct TTXKeyBinding), MEMF_CLEAR);
+            if (!keyMap->bindings) {
+                Printf("[INIT] TTX_BuildKeyMap: FAIL (no memory for %lu bindings)\n", count);
+                freeVec(keyMap);
+                return FALSE;
+            }
+        }
+        count = 0;
+        
+        for (row = 0; row < DFN_QUAL_COMBOS; row++) {
+            for (code = 0; code < DFN_RAWKEY_COUNT; code++) {
+                dfnBinding = GetDFNKey(dfn, row, code);
+                if (!dfnBinding) {
+                    continue;
+                }
+                command = TTX_FindCommand(dfnBinding->command);
+                if (!command) {
+                    if (pass == 0) {
+                        Printf("[INIT] TTX_BuildKeyMap: WARN (unknown command '%s')\n", dfnBinding->command);
+                    }
+                    continue;
+                }
+                if (pass == 1) {
+                    binding = &keyMap->bindings[count];
+                    binding->command = command;
+                    binding->args = dfnBinding->args;
+                    binding->argCount = dfnBinding->argCount;
+                    keyMap->keys[row][code] = binding;
+                }
+                count++;
+            }
+        }
+        
+        for (i = 0; g_defaultKeys[i].command; i++) {
+            command = TTX_FindCommand(g_defaultKeys[i].command);
+            if (!command) {
+                continue;
+            }
+            for (row = 0; row < DFN_QUAL_COMBOS; row++) {
+                if (g_defaultKeys[i].row != TTX_KEY_ANY_QUALIFIER && g_defaultKeys[i].row != row) {
+                    continue;
+                }
+                /* Keys the definitions bound to a known command are taken */
+                code = g_defaultKeys[i].code;
+                dfnBinding = GetDFNKey(dfn, row, code);
+                if (dfnBinding && TTX_FindCommand(dfnBinding->command)) {
+                    continue;
+                }
+                if (pass == 1) {
+                    binding = &keyMap->bindings[count];
+                    binding->command = command;
+                    keyMap->keys[row][code] = binding;
+                }
+                count++;
+            }
+        }
+    }
+    
+    keyMap->bindingCount = count;
+    app->keyMap = keyMap;
+    Printf("[INIT] TTX_BuildKeyMap: SUCCESS (%lu bindings)\n", count);
+    return TRUE;
+}
+
+/* Free the compiled key bindings */
+VOID TTX_FreeKeyMap(struct TTXApplication *app)
+{
+    if (!app || !app->keyMap) {
+        return;
+    }
+    
+    if (app->keyMap->bindings) {
+        freeVec(app->keyMap->bindings);
+    }
+    freeVec(app->keyMap);
+    app->keyMap = NULL;
 }
 
 /* Handle menu pick - convert menu/item numbers to command */
@@ -461,6 +519,9 @@ static BOOL GetCommandFromMenuPick(ULONG menuNumber, ULONG itemNumber, STRPTR *o
             case 4: *outCommand = "DeleteBlk"; break;
             case 6: *outCommand = "MarkBlk"; if (outArgs && outArgCount) { outArgs[0] = "Vertical"; *outArgCount = 1; } break;
             case 7: *outCommand = "PasteClip"; if (outArgs && outArgCount) { outArgs[0] = "Vertical"; *outArgCount = 1; } break;
+            case 9: *outCommand = "OpenClip"; break;
+            case 10: *outCommand = "SaveClip"; break;
+            case 11: *outCommand = "PrintClip"; break;
             default: return FALSE;
         }
         return TRUE;
@@ -546,7 +607,37 @@ static BOOL GetCommandFromMenuPick(ULONG menuNumber, ULONG itemNumber, STRPTR *o
         }
         return TRUE;
     }
-    /* Menu 4: Macros, Menu 5: Folds, Menu 6: Extras, Menu 7: Prefs - TODO */
+    /* Menu 4: Macros */
+    else if (extractedMenu == 4) {
+        switch (extractedItem) {
+            case 0: *outCommand = "RecordMacro"; break;
+            case 1: *outCommand = "EndMacro"; break;
+            case 2: *outCommand = "PlayMacro"; break;
+            case 5: *outCommand = "OpenMacro"; break;
+            case 6: *outCommand = "SaveMacro"; break;
+            case 8: *outCommand = "ExecARexxMacro"; break;
+            default: return FALSE;
+        }
+        return TRUE;
+    }
+    /* Menu 5: Folds */
+    else if (extractedMenu == 5) {
+        switch (extractedItem) {
+            case 0: *outCommand = "MakeFold"; break;
+            case 3: *outCommand = "ShowFold"; break;
+            case 4: *outCommand = "ShowFold"; if (outArgs && outArgCount) { outArgs[0] = "Nested"; *outArgCount = 1; } break;
+            case 5: *outCommand = "ShowFold"; if (outArgs && outArgCount) { outArgs[0] = "All"; *outArgCount = 1; } break;
+            case 7: *outCommand = "HideFold"; break;
+            case 8: *outCommand = "HideFold"; if (outArgs && outArgCount) { outArgs[0] = "Nested"; *outArgCount = 1; } break;
+            case 9: *outCommand = "HideFold"; if (outArgs && outArgCount) { outArgs[0] = "All"; *outArgCount = 1; } break;
+            case 11: *outCommand = "UnmakeFold"; break;
+            case 12: *outCommand = "UnmakeFold"; if (outArgs && outArgCount) { outArgs[0] = "Nested"; *outArgCount = 1; } break;
+            case 13: *outCommand = "UnmakeFold"; if (outArgs && outArgCount) { outArgs[0] = "All"; *outArgCount = 1; } break;
+            default: return FALSE;
+        }
+        return TRUE;
+    }
+    /* Menu 6: Extras, Menu 7: Prefs - TODO */
     else {
         return FALSE;
     }
@@ -594,7 +685,9 @@ BOOL TTX_HandleMenuPick(struct TTXApplication *app, struct Session *session, ULO
                         Stricmp(args[i], "Info") == 0 ||
                         Stricmp(args[i], "Find") == 0 ||
                         Stricmp(args[i], "FindChange") == 0 ||
-                        Stricmp(args[i], "Vertical") == 0) {
+                        Stricmp(args[i], "Vertical") == 0 ||
+                        Stricmp(args[i], "Nested") == 0 ||
+                        Stricmp(args[i], "All") == 0) {
                         isConstant = TRUE;
                     }
                     if (!isConstant) {
@@ -788,15 +881,22 @@ BOOL TTX_CreateMenuStrip(struct Session *session)
     
     Printf("[MENU] TTX_CreateMenuStrip: START\n");
     
+    /* Definitions are loaded once and shared by every window (menu labels point into them) */
+    dfn = GetDefinitions();
+    
     /* Try to load .dfn file from various locations */
-    for (i = 0; dfnPaths[i] != NULL; i++) {
+    for (i = 0; !dfn && dfnPaths[i] != NULL; i++) {
         dfn = ParseDFNFile(dfnPaths[i], session->cleanupStack);
         if (dfn) {
             Printf("[MENU] TTX_CreateMenuStrip: loaded DFN from '%s'\n", dfnPaths[i]);
-            useDFN = TRUE;
-            break;
+            SetDefinitions(dfn);
+            /* First definitions file seen sets up syntax highlighting for all documents */
+            if (!GetSyntaxRules()) {
+                SetSyntaxRules(TakeDFNSyntaxRules(dfn));
+            }
         }
     }
+    useDFN = (BOOL)(dfn != NULL);
     
     if (useDFN && dfn) {
         /* Convert DFN to NewMenu array */
@@ -808,12 +908,11 @@ BOOL TTX_CreateMenuStrip(struct Session *session)
             if (!menuStrip) {
                 Printf("[MENU] TTX_CreateMenuStrip: FAIL (CreateMenus from DFN failed)\n");
                 freeVec(dfnMenu);
-                FreeDFNFile(dfn);
+                dfnMenu = NULL;
                 useDFN = FALSE; /* Fall back to hardcoded menu */
             }
         } else {
             Printf("[MENU] TTX_CreateMenuStrip: WARN (failed to convert DFN to NewMenu)\n");
-            FreeDFNFile(dfn);
             useDFN = FALSE; /* Fall back to hardcoded menu */
         }
     }
@@ -873,14 +972,9 @@ BOOL TTX_CreateMenuStrip(struct Session *session)
     /* Free visual info (no longer needed after LayoutMenus) */
     FreeVisualInfo(visInfo);
     
-    /* Free DFN data if we used it */
-    if (useDFN) {
-        if (dfnMenu) {
-            freeVec(dfnMenu);
-        }
-        if (dfn) {
-            FreeDFNFile(dfn);
-        }
+    /* Free the NewMenu array if we used it (the definitions stay loaded) */
+    if (dfnMenu) {
+        freeVec(dfnMenu);
     }
     
     Printf("[MENU] TTX_CreateMenuStrip: SUCCESS\n");
@@ -939,7 +1033,7 @@ static STRPTR TTX_ShowFileRequester(struct TTXApplication *app, struct Session *
     struct Window *window = NULL;
     struct TagItem tags[11];
     
-    if (!app || !app->cleanupStack || !AslBase) {
+    if (!app || !app->cleanupStack || !TTX_NeedLibrary(TTX_LIB_ASL)) {
         Printf("[ASL] TTX_ShowFileRequester: FAIL (ASL library not available)\n");
         return NULL;
     }
@@ -1066,7 +1160,7 @@ static STRPTR TTX_ShowSaveFileRequester(struct TTXApplication *app, struct Sessi
     struct Window *window = NULL;
     struct TagItem tags[11];
     
-    if (!app || !app->cleanupStack || !AslBase) {
+    if (!app || !app->cleanupStack || !TTX_NeedLibrary(TTX_LIB_ASL)) {
         Printf("[ASL] TTX_ShowSaveFileRequester: FAIL (ASL library not available)\n");
         return NULL;
     }
@@ -1203,7 +1297,7 @@ BOOL TTX_Cmd_OpenFile(struct TTXApplication *app, struct Session *session, STRPT
     
     if (!fileName) {
         /* No filename provided - show file requester */
-        if (!AslBase) {
+        if (!TTX_NeedLibrary(TTX_LIB_ASL)) {
             Printf("[CMD] TTX_Cmd_OpenFile: FAIL (ASL library not available)\n");
             return FALSE;
         }
@@ -1252,7 +1346,9 @@ BOOL TTX_Cmd_OpenFile(struct TTXApplication *app, struct Session *session, STRPT
         }
     }
     
-    /* Clear existing buffer and load new file */
+    /* Clear existing buffer and load new file - a split pane would keep showing the old document */
+    TTX_AbortSessionLoad(session);
+    TTX_UnsplitSession(app, session);
     FreeTextBuffer(session->buffer, app->cleanupStack);
     if (!InitTextBuffer(session->buffer, app->cleanupStack)) {
         Printf("[CMD] TTX_Cmd_OpenFile: FAIL (InitTextBuffer failed)\n");
@@ -1262,10 +1358,21 @@ BOOL TTX_Cmd_OpenFile(struct TTXApplication *app, struct Session *session, STRPT
         return FALSE;
     }
     
-    /* Load file into buffer */
-    if (!LoadFile(fileName, session->buffer, app->cleanupStack)) {
-        Printf("[CMD] TTX_Cmd_OpenFile: WARN (LoadFile failed, continuing with empty buffer)\n");
-        /* Continue with empty buffer - file might not exist yet */
+    /* Load file into buffer - attach to an already open document for the same file if there is one */
+    {
+        struct TextDocument *sharedDoc = FindDocument(fileName);
+
+        if (sharedDoc) {
+            Printf("[CMD] TTX_Cmd_OpenFile: sharing document=%lx\n", (ULONG)sharedDoc);
+            DetachDocument(session->buffer, app->cleanupStack);
+            AttachDocument(session->buffer, sharedDoc);
+        } else if (!LoadFile(fileName, session->buffer, app->cleanupStack)) {
+            Printf("[CMD] TTX_Cmd_OpenFile: WARN (LoadFile failed, continuing with empty buffer)\n");
+            /* Continue with empty buffer - file might not exist yet */
+        } else {
+            SetDocumentFileName(session->buffer->doc, fileName);
+        }
+        session->docState.modified = session->buffer->doc->modified;
     }
     
     /* Free old filename if we had one */
@@ -1331,6 +1438,7 @@ BOOL TTX_Cmd_OpenDoc(struct TTXApplication *app, struct Session *session, STRPTR
 {
     BOOL useFileReq = FALSE;
     STRPTR selectedFile = NULL;
+    struct Session *dormantSession = NULL;
     BOOL result = FALSE;
     
     if (args && argCount > 0 && Stricmp(args[0], "FileReq") == 0) {
@@ -1339,7 +1447,7 @@ BOOL TTX_Cmd_OpenDoc(struct TTXApplication *app, struct Session *session, STRPTR
     
     if (useFileReq) {
         /* Open with file requester */
-        if (!AslBase) {
+        if (!TTX_NeedLibrary(TTX_LIB_ASL)) {
             Printf("[CMD] TTX_Cmd_OpenDoc: FAIL (ASL library not available)\n");
             return FALSE;
         }
@@ -1351,8 +1459,18 @@ BOOL TTX_Cmd_OpenDoc(struct TTXApplication *app, struct Session *session, STRPTR
             return FALSE;
         }
         
-        /* Open file in new session */
-        result = TTX_CreateSession(app, selectedFile);
+        /* Wake the file's dormant session if it has one, otherwise open it in a new session */
+        for (dormantSession = app->sessions; dormantSession; dormantSession = dormantSession->next) {
+            if (dormantSession->dormant && dormantSession->docState.fileName &&
+                Stricmp(dormantSession->docState.fileName, selectedFile) == 0) {
+                break;
+            }
+        }
+        if (dormantSession) {
+            result = TTX_ActivateSession(app, dormantSession);
+        } else {
+            result = TTX_CreateSession(app, selectedFile);
+        }
         
         /* Free selected file path */
         if (selectedFile && app->cleanupStack) {
@@ -1387,7 +1505,7 @@ BOOL TTX_Cmd_InsertFile(struct TTXApplication *app, struct Session *session, STR
     
     if (!fileName) {
         /* No filename provided - show file requester */
-        if (!AslBase) {
+        if (!TTX_NeedLibrary(TTX_LIB_ASL)) {
             Printf("[CMD] TTX_Cmd_InsertFile: FAIL (ASL library not available)\n");
             return FALSE;
         }
@@ -1433,7 +1551,7 @@ BOOL TTX_Cmd_InsertFile(struct TTXApplication *app, struct Session *session, STR
     }
     
     /* Insert all lines from temp buffer at cursor */
-    for (i = 0; i < tempBuffer->lineCount; i++) {
+    for (i = 0; i < tempBuffer->doc->lineCount; i++) {
         if (i > 0) {
             /* Insert newline for each line after first */
             if (!InsertNewline(session->buffer, session->cleanupStack)) {
@@ -1442,9 +1560,9 @@ BOOL TTX_Cmd_InsertFile(struct TTXApplication *app, struct Session *session, STR
         }
         
         /* Insert line text */
-        if (tempBuffer->lines[i].text && tempBuffer->lines[i].length > 0) {
-            for (j = 0; j < tempBuffer->lines[i].length; j++) {
-                if (!InsertChar(session->buffer, (UBYTE)tempBuffer->lines[i].text[j], session->cleanupStack)) {
+        if (tempBuffer->doc->lines[i].text && tempBuffer->doc->lines[i].length > 0) {
+            for (j = 0; j < tempBuffer->doc->lines[i].length; j++) {
+                if (!InsertChar(session->buffer, (UBYTE)tempBuffer->doc->lines[i].text[j], session->cleanupStack)) {
                     break;
                 }
             }
@@ -1470,7 +1588,7 @@ BOOL TTX_Cmd_InsertFile(struct TTXApplication *app, struct Session *session, STR
     UpdateScrollBars(session);
     RenderText(session->window, session->buffer);
     UpdateCursor(session->window, session->buffer);
-    session->docState.modified = session->buffer->modified;
+    session->docState.modified = session->buffer->doc->modified;
     
     Printf("[CMD] TTX_Cmd_InsertFile: SUCCESS\n");
     return TRUE;
@@ -1478,7 +1596,8 @@ BOOL TTX_Cmd_InsertFile(struct TTXApplication *app, struct Session *session, STR
 
 BOOL TTX_Cmd_SaveFile(struct TTXApplication *app, struct Session *session, STRPTR *args, ULONG argCount)
 {
-    if (!session || !session->buffer) {
+    /* A file still being read in would be saved truncated */
+    if (!session || !session->buffer || session->loader) {
         return FALSE;
     }
     
@@ -1489,7 +1608,7 @@ BOOL TTX_Cmd_SaveFile(struct TTXApplication *app, struct Session *session, STRPT
     
     if (SaveFile(session->docState.fileName, session->buffer, app->cleanupStack)) {
         session->docState.modified = FALSE;
-        session->buffer->modified = FALSE;
+        session->buffer->doc->modified = FALSE;
         Printf("[CMD] TTX_Cmd_SaveFile: SUCCESS\n");
         return TRUE;
     } else {
@@ -1519,6 +1638,10 @@ BOOL TTX_Cmd_SaveFileAs(struct TTXApplication *app, struct Session *session, STR
                (ULONG)app, (ULONG)session, session ? (ULONG)session->buffer : 0);
         return FALSE;
     }
+    if (session->loader) {
+        Printf("[CMD] TTX_Cmd_SaveFileAs: FAIL (file still loading)\n");
+        return FALSE;
+    }
     
     /* Check if filename provided in args */
     if (args && argCount > 0 && args[0]) {
@@ -1530,7 +1653,7 @@ BOOL TTX_Cmd_SaveFileAs(struct TTXApplication *app, struct Session *session, STR
     
     /* If no filename provided, show file requester */
     if (!fileName) {
-        if (!AslBase) {
+        if (!TTX_NeedLibrary(TTX_LIB_ASL)) {
             Printf("[CMD] TTX_Cmd_SaveFileAs: FAIL (ASL library not available)\n");
             return FALSE;
         }
@@ -1634,7 +1757,8 @@ BOOL TTX_Cmd_SaveFileAs(struct TTXApplication *app, struct Session *session, STR
     /* Save file */
     if (SaveFile(session->docState.fileName, session->buffer, app->cleanupStack)) {
         session->docState.modified = FALSE;
-        session->buffer->modified = FALSE;
+        session->buffer->doc->modified = FALSE;
+        SetDocumentFileName(session->buffer->doc, session->docState.fileName);
         result = TRUE;
         Printf("[CMD] TTX_Cmd_SaveFileAs: SUCCESS (saved to '%s')\n", session->docState.fileName);
         
@@ -1683,22 +1807,22 @@ BOOL TTX_Cmd_ClearFile(struct TTXApplication *app, struct Session *session, STRP
     }
     
     /* Clear all lines except first empty line */
-    for (i = 1; i < session->buffer->lineCount; i++) {
-        if (session->buffer->lines[i].text) {
-            freeVec(session->buffer->lines[i].text);
-            session->buffer->lines[i].text = NULL;
+    for (i = 1; i < session->buffer->doc->lineCount; i++) {
+        if (session->buffer->doc->lines[i].text) {
+            freeVec(session->buffer->doc->lines[i].text);
+            session->buffer->doc->lines[i].text = NULL;
         }
     }
-    session->buffer->lineCount = 1;
-    session->buffer->lines[0].length = 0;
-    if (session->buffer->lines[0].text) {
-        session->buffer->lines[0].text[0] = '\0';
+    session->buffer->doc->lineCount = 1;
+    session->buffer->doc->lines[0].length = 0;
+    if (session->buffer->doc->lines[0].text) {
+        session->buffer->doc->lines[0].text[0] = '\0';
     }
     session->buffer->cursorX = 0;
     session->buffer->cursorY = 0;
     session->buffer->scrollX = 0;
     session->buffer->scrollY = 0;
-    session->buffer->modified = TRUE;
+    DocumentChanged(session->buffer, DOC_CHANGE_ALL, 0);
     session->docState.modified = TRUE;
     
     /* Force full redraw */
@@ -1817,6 +1941,11 @@ BOOL TTX_Cmd_SetReadOnly(struct TTXApplication *app, struct Session *session, ST
     if (!session) {
         return FALSE;
     }
+    /* A file still being read in stays locked until the loader is done with it */
+    if (session->loader) {
+        Printf("[CMD] TTX_Cmd_SetReadOnly: FAIL (file still loading)\n");
+        return FALSE;
+    }
     if (args && argCount > 0 && Stricmp(args[0], "Toggle") == 0) {
         toggle = TRUE;
     }
@@ -2011,10 +2140,8 @@ BOOL TTX_Cmd_Illegal(struct TTXApplication *app, struct Session *session, STRPTR
 
 BOOL TTX_Cmd_GetVersion(struct TTXApplication *app, struct Session *session, STRPTR *args, ULONG argCount)
 {
-    /* Return version string - for ARexx compatibility, would return in RESULT */
-    /* For now, just print it */
     Printf("[CMD] TTX_Cmd_GetVersion: version='TTX 3.0'\n");
-    return TRUE;
+    return TTX_SetResultString(app, "TTX 3.0");
 }
 
 BOOL TTX_Cmd_GetReadOnly(struct TTXApplication *app, struct Session *session, STRPTR *args, ULONG argCount)
@@ -2023,9 +2150,8 @@ BOOL TTX_Cmd_GetReadOnly(struct TTXApplication *app, struct Session *session, ST
         return FALSE;
     }
     
-    /* Return read-only state - for ARexx compatibility, would return in RESULT */
     Printf("[CMD] TTX_Cmd_GetReadOnly: readOnly=%s\n", session->docState.readOnly ? "TRUE" : "FALSE");
-    return TRUE;
+    return TTX_SetResultString(app, session->docState.readOnly ? "ON" : "OFF");
 }
 
 /* ============================================================================
@@ -2043,10 +2169,8 @@ BOOL TTX_Cmd_ActivateLastDoc(struct TTXApplication *app, struct Session *session
     /* Find last activated session (for now, just use first session) */
     /* TODO: Track activation order */
     lastSession = app->sessions;
-    if (lastSession && lastSession->window) {
-        WindowToFront(lastSession->window);
-        ActivateWindow(lastSession->window);
-        app->activeSession = lastSession;
+    /* A dormant session gets its buffer and window now */
+    if (lastSession && TTX_ActivateSession(app, lastSession)) {
         Printf("[CMD] TTX_Cmd_ActivateLastDoc: SUCCESS\n");
         return TRUE;
     }
@@ -2070,10 +2194,8 @@ BOOL TTX_Cmd_ActivateNextDoc(struct TTXApplication *app, struct Session *session
         nextSession = app->sessions;
     }
     
-    if (nextSession && nextSession->window) {
-        WindowToFront(nextSession->window);
-        ActivateWindow(nextSession->window);
-        app->activeSession = nextSession;
+    /* A dormant session gets its buffer and window now */
+    if (nextSession && TTX_ActivateSession(app, nextSession)) {
         Printf("[CMD] TTX_Cmd_ActivateNextDoc: SUCCESS\n");
         return TRUE;
     }
@@ -2102,10 +2224,8 @@ BOOL TTX_Cmd_ActivatePrevDoc(struct TTXApplication *app, struct Session *session
         prevSession = currentSession;
     }
     
-    if (prevSession && prevSession->window) {
-        WindowToFront(prevSession->window);
-        ActivateWindow(prevSession->window);
-        app->activeSession = prevSession;
+    /* A dormant session gets its buffer and window now */
+    if (prevSession && TTX_ActivateSession(app, prevSession)) {
         Printf("[CMD] TTX_Cmd_ActivatePrevDoc: SUCCESS\n");
         return TRUE;
     }
@@ -2433,23 +2553,70 @@ BOOL TTX_Cmd_SizeView(struct TTXApplication *app, struct Session *session, STRPT
 
 BOOL TTX_Cmd_SplitView(struct TTXApplication *app, struct Session *session, STRPTR *args, ULONG argCount)
 {
-    /* TODO: Implement view splitting */
-    Printf("[CMD] TTX_Cmd_SplitView: not yet implemented\n");
-    return FALSE;
+    BOOL toggle = FALSE;
+    
+    if (!app || !session || !session->buffer) {
+        return FALSE;
+    }
+    if (args && argCount > 0 && Stricmp(args[0], "Toggle") == 0) {
+        toggle = TRUE;
+    }
+    
+    if (toggle && session->otherView) {
+        TTX_UnsplitSession(app, session);
+    } else if (!TTX_SplitSession(app, session)) {
+        Printf("[CMD] TTX_Cmd_SplitView: FAIL\n");
+        return FALSE;
+    }
+    
+    TTX_RenderViews(session);
+    Printf("[CMD] TTX_Cmd_SplitView: SUCCESS (split=%ld)\n", session->otherView ? 1L : 0L);
+    return TRUE;
 }
 
 BOOL TTX_Cmd_SwapViews(struct TTXApplication *app, struct Session *session, STRPTR *args, ULONG argCount)
 {
-    /* TODO: Implement view swapping */
-    Printf("[CMD] TTX_Cmd_SwapViews: not yet implemented\n");
-    return FALSE;
+    struct TextBuffer *upper = NULL;
+    struct TextBuffer *lower = NULL;
+    
+    if (!session || !session->buffer || !session->otherView) {
+        return FALSE;
+    }
+    
+    /* Exchange the pane positions - each view keeps its cursor and scroll position */
+    if (session->buffer->viewTop < session->otherView->viewTop) {
+        upper = session->buffer;
+        lower = session->otherView;
+    } else {
+        upper = session->otherView;
+        lower = session->buffer;
+    }
+    upper->viewTop = lower->viewTop;
+    lower->viewTop = 0;
+    TTX_LayoutViews(session);
+    
+    TTX_RenderViews(session);
+    Printf("[CMD] TTX_Cmd_SwapViews: SUCCESS\n");
+    return TRUE;
 }
 
 BOOL TTX_Cmd_SwitchView(struct TTXApplication *app, struct Session *session, STRPTR *args, ULONG argCount)
 {
-    /* TODO: Implement view switching */
-    Printf("[CMD] TTX_Cmd_SwitchView: not yet implemented\n");
-    return FALSE;
+    struct TextBuffer *previous = NULL;
+    
+    if (!session || !session->buffer || !session->otherView) {
+        return FALSE;
+    }
+    
+    /* Make the other pane the one editing commands and scroll bars act on */
+    previous = session->buffer;
+    session->buffer = session->otherView;
+    session->otherView = previous;
+    session->mouseSelecting = FALSE;
+    
+    TTX_RenderViews(session);
+    Printf("[CMD] TTX_Cmd_SwitchView: SUCCESS (view=%lx)\n", (ULONG)session->buffer);
+    return TRUE;
 }
 
 BOOL TTX_Cmd_UpdateView(struct TTXApplication *app, struct Session *session, STRPTR *args, ULONG argCount)
@@ -2470,34 +2637,80 @@ BOOL TTX_Cmd_UpdateView(struct TTXApplication *app, struct Session *session, STR
  * Selection Block Commands (stubs)
  * ============================================================================ */
 
+/* Clipboard unit given as a numeric argument (PRIMARY_CLIP if there is none) */
+static ULONG GetClipUnit(STRPTR *args, ULONG argCount)
+{
+    LONG unit = 0;
+    ULONG i = 0;
+    
+    for (i = 0; args && i < argCount; i++) {
+        if (args[i] && StrToLong(args[i], &unit) > 0 && unit >= 0 && unit <= 255) {
+            return (ULONG)unit;
+        }
+    }
+    return PRIMARY_CLIP;
+}
+
+/* CLIP [name] among the arguments - use the clip ring rather than the clipboard */
+static BOOL GetClipRingArg(STRPTR *args, ULONG argCount, STRPTR *name)
+{
+    ULONG i = 0;
+    
+    *name = NULL;
+    for (i = 0; args && i < argCount; i++) {
+        if (args[i] && Stricmp(args[i], "CLIP") == 0) {
+            if (i + 1 < argCount) {
+                *name = args[i + 1];
+            }
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+/* VERTICAL among the arguments - the block is a column */
+static BOOL GetVerticalArg(STRPTR *args, ULONG argCount)
+{
+    ULONG i = 0;
+    
+    for (i = 0; args && i < argCount; i++) {
+        if (args[i] && Stricmp(args[i], "Vertical") == 0) {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
 BOOL TTX_Cmd_CopyBlk(struct TTXApplication *app, struct Session *session, STRPTR *args, ULONG argCount)
 {
-    STRPTR blockText = NULL;
+    struct ClipText *text = NULL;
+    STRPTR clipName = NULL;
     
     if (!session || !session->buffer || !session->buffer->marking.enabled) {
         Printf("[CMD] TTX_Cmd_CopyBlk: FAIL (no selection)\n");
         return FALSE;
     }
     
-    /* Get selected text */
-    blockText = GetBlock(session->buffer, session->cleanupStack);
-    if (!blockText) {
-        Printf("[CMD] TTX_Cmd_CopyBlk: FAIL (GetBlock failed)\n");
+    if (GetClipRingArg(args, argCount, &clipName)) {
+        text = CopyBlockText(session->buffer);
+        if (!text) {
+            Printf("[CMD] TTX_Cmd_CopyBlk: FAIL (CopyBlockText failed)\n");
+            return FALSE;
+        }
+        PushClip(app, clipName, text);
+    } else if (!CopyBlockToClip(session->buffer, GetClipUnit(args, argCount))) {
+        Printf("[CMD] TTX_Cmd_CopyBlk: FAIL (CopyBlockToClip failed)\n");
         return FALSE;
     }
     
-    /* TODO: Copy to clipboard - for now just print */
-    Printf("[CMD] TTX_Cmd_CopyBlk: SUCCESS (text='%s')\n", blockText);
-    
-    /* Free block text */
-    freeVec(blockText);
-    
+    Printf("[CMD] TTX_Cmd_CopyBlk: SUCCESS\n");
     return TRUE;
 }
 
 BOOL TTX_Cmd_CutBlk(struct TTXApplication *app, struct Session *session, STRPTR *args, ULONG argCount)
 {
-    STRPTR blockText = NULL;
+    struct ClipText *text = NULL;
+    STRPTR clipName = NULL;
     
     if (!session || !session->buffer || session->docState.readOnly) {
         return FALSE;
@@ -2508,25 +2721,17 @@ BOOL TTX_Cmd_CutBlk(struct TTXApplication *app, struct Session *session, STRPTR
         return FALSE;
     }
     
-    /* Get selected text */
-    blockText = GetBlock(session->buffer, session->cleanupStack);
-    if (!blockText) {
-        Printf("[CMD] TTX_Cmd_CutBlk: FAIL (GetBlock failed)\n");
+    /* The block's lines move into the clip ring, which always keeps what was cut */
+    text = CutBlockText(session->buffer, session->cleanupStack);
+    if (!text) {
+        Printf("[CMD] TTX_Cmd_CutBlk: FAIL (CutBlockText failed)\n");
         return FALSE;
     }
-    
-    /* TODO: Copy to clipboard - for now just print */
-    Printf("[CMD] TTX_Cmd_CutBlk: SUCCESS (text='%s')\n", blockText);
-    
-    /* Delete the block */
-    if (!DeleteBlock(session->buffer, session->cleanupStack)) {
-        freeVec(blockText);
-        Printf("[CMD] TTX_Cmd_CutBlk: FAIL (DeleteBlock failed)\n");
-        return FALSE;
+    if (!GetClipRingArg(args, argCount, &clipName) &&
+        !ClipTextToClip(text, GetClipUnit(args, argCount), session->buffer)) {
+        Printf("[CMD] TTX_Cmd_CutBlk: WARN (clipboard write failed, block kept in the clip ring)\n");
     }
-    
-    /* Free block text */
-    freeVec(blockText);
+    PushClip(app, clipName, text);
     
     /* Update display */
     CalculateMaxScroll(session->buffer, session->window);
@@ -2534,7 +2739,7 @@ BOOL TTX_Cmd_CutBlk(struct TTXApplication *app, struct Session *session, STRPTR
     UpdateScrollBars(session);
     RenderText(session->window, session->buffer);
     UpdateCursor(session->window, session->buffer);
-    session->docState.modified = session->buffer->modified;
+    session->docState.modified = session->buffer->doc->modified;
     
     Printf("[CMD] TTX_Cmd_CutBlk: SUCCESS\n");
     return TRUE;
@@ -2563,7 +2768,7 @@ BOOL TTX_Cmd_DeleteBlk(struct TTXApplication *app, struct Session *session, STRP
     UpdateScrollBars(session);
     RenderText(session->window, session->buffer);
     UpdateCursor(session->window, session->buffer);
-    session->docState.modified = session->buffer->modified;
+    session->docState.modified = session->buffer->doc->modified;
     
     Printf("[CMD] TTX_Cmd_DeleteBlk: SUCCESS\n");
     return TRUE;
@@ -2576,28 +2781,85 @@ BOOL TTX_Cmd_EncryptBlk(struct TTXApplication *app, struct Session *session, STR
     return FALSE;
 }
 
-BOOL TTX_Cmd_GetBlk(struct TTXApplication *app, struct Session *session, STRPTR *args, ULONG argCount)
-{
-    /* TODO: Return block text for ARexx */
-    Printf("[CMD] TTX_Cmd_GetBlk: not yet implemented\n");
-    return FALSE;
-}
-
-BOOL TTX_Cmd_GetBlkInfo(struct TTXApplication *app, struct Session *session, STRPTR *args, ULONG argCount)
-{
-    /* TODO: Return block info for ARexx */
-    Printf("[CMD] TTX_Cmd_GetBlkInfo: not yet implemented\n");
-    return FALSE;
-}
-
-BOOL TTX_Cmd_MarkBlk(struct TTXApplication *app, struct Session *session, STRPTR *args, ULONG argCount)
+BOOL TTX_Cmd_FillBlk(struct TTXApplication *app, struct Session *session, STRPTR *args, ULONG argCount)
 {
-    if (!session || !session->buffer) {
+    UBYTE fill = ' ';
+    
+    if (!session || !session->buffer || session->docState.readOnly) {
+        return FALSE;
+    }
+    
+    if (!session->buffer->marking.enabled) {
+        Printf("[CMD] TTX_Cmd_FillBlk: FAIL (no selection)\n");
+        return FALSE;
+    }
+    
+    /* Fill character (a space if none is given) */
+    if (args && argCount > 0 && args[0] && args[0][0]) {
+        fill = (UBYTE)args[0][0];
+    }
+    
+    if (!FillBlock(session->buffer, fill, session->cleanupStack)) {
+        Printf("[CMD] TTX_Cmd_FillBlk: FAIL (FillBlock failed)\n");
+        return FALSE;
+    }
+    
+    /* Update display */
+    CalculateMaxScroll(session->buffer, session->window);
+    UpdateScrollBars(session);
+    RenderText(session->window, session->buffer);
+    UpdateCursor(session->window, session->buffer);
+    session->docState.modified = session->buffer->doc->modified;
+    
+    Printf("[CMD] TTX_Cmd_FillBlk: SUCCESS\n");
+    return TRUE;
+}
+
+BOOL TTX_Cmd_GetBlk(struct TTXApplication *app, struct Session *session, STRPTR *args, ULONG argCount)
+{
+    STRPTR blockText = NULL;
+    ULONG blockLength = 0;
+    
+    if (!session || !session->buffer || !session->buffer->marking.enabled) {
+        return FALSE;
+    }
+    
+    if (!GetBlockSpan(session->buffer, &blockText, &blockLength)) {
+        return FALSE;
+    }
+    
+    return TTX_SetResultRef(app, blockText, blockLength);
+}
+
+BOOL TTX_Cmd_GetBlkInfo(struct TTXApplication *app, struct Session *session, STRPTR *args, ULONG argCount)
+{
+    /* TODO: Return block info for ARexx */
+    Printf("[CMD] TTX_Cmd_GetBlkInfo: not yet implemented\n");
+    return FALSE;
+}
+
+BOOL TTX_Cmd_MarkBlk(struct TTXApplication *app, struct Session *session, STRPTR *args, ULONG argCount)
+{
+    struct TextBuffer *buffer = NULL;
+    
+    if (!session || !session->buffer) {
         return FALSE;
     }
+    buffer = session->buffer;
     
-    /* Mark all text */
-    MarkAllBlock(session->buffer);
+    if (GetVerticalArg(args, argCount)) {
+        /* Column block - the first MarkBlk VERTICAL anchors a corner at the cursor, later ones move the other corner to it */
+        if (buffer->marking.enabled && buffer->marking.column) {
+            buffer->marking.stopY = buffer->cursorY;
+            buffer->marking.stopX = buffer->cursorX;
+        } else {
+            SetMarking(buffer, buffer->cursorY, buffer->cursorX, buffer->cursorY, buffer->cursorX);
+            buffer->marking.column = TRUE;
+        }
+    } else {
+        /* Mark all text */
+        MarkAllBlock(buffer);
+    }
     
     /* Update display to show selection */
     RenderText(session->window, session->buffer);
@@ -2608,35 +2870,112 @@ BOOL TTX_Cmd_MarkBlk(struct TTXApplication *app, struct Session *session, STRPTR
 }
 
 /* ============================================================================
- * Clipboard Commands (stubs)
+ * Clipboard Commands
  * ============================================================================ */
 
 BOOL TTX_Cmd_OpenClip(struct TTXApplication *app, struct Session *session, STRPTR *args, ULONG argCount)
 {
-    /* TODO: Implement clipboard opening */
-    Printf("[CMD] TTX_Cmd_OpenClip: not yet implemented\n");
-    return FALSE;
+    STRPTR fileName = NULL;
+    STRPTR selectedFile = NULL;
+    BOOL result = FALSE;
+    
+    if (!app || !session) {
+        return FALSE;
+    }
+    
+    /* A file name and an optional clipboard unit */
+    if (args && argCount > 0 && args[0]) {
+        fileName = args[0];
+    } else {
+        selectedFile = TTX_ShowFileRequester(app, session, NULL, NULL);
+        if (!selectedFile) {
+            Printf("[CMD] TTX_Cmd_OpenClip: cancelled or failed\n");
+            return FALSE;
+        }
+        fileName = selectedFile;
+    }
+    
+    result = FileToClip(fileName, (argCount > 1) ? GetClipUnit(&args[1], argCount - 1) : PRIMARY_CLIP);
+    
+    if (selectedFile) {
+        freeVec(selectedFile);
+    }
+    
+    return result;
 }
 
 BOOL TTX_Cmd_PasteClip(struct TTXApplication *app, struct Session *session, STRPTR *args, ULONG argCount)
 {
-    /* TODO: Implement clipboard pasting */
-    Printf("[CMD] TTX_Cmd_PasteClip: not yet implemented\n");
-    return FALSE;
+    struct ClipText *text = NULL;
+    STRPTR clipName = NULL;
+    BOOL vertical = FALSE;
+    BOOL result = FALSE;
+    
+    if (!session || !session->buffer || session->docState.readOnly) {
+        return FALSE;
+    }
+    
+    /* VERTICAL pastes each line of the clip at the cursor column of successive lines */
+    vertical = GetVerticalArg(args, argCount);
+    
+    /* CLIP [name or position] pastes from the clip ring */
+    if (GetClipRingArg(args, argCount, &clipName)) {
+        text = FindClip(app, clipName);
+        result = text ? PasteClipText(session->buffer, text, vertical, session->cleanupStack) : FALSE;
+    } else {
+        result = PasteClipToBuffer(session->buffer, GetClipUnit(args, argCount), vertical, session->cleanupStack);
+    }
+    if (!result) {
+        Printf("[CMD] TTX_Cmd_PasteClip: FAIL (nothing pasted)\n");
+        return FALSE;
+    }
+    
+    /* Update display */
+    CalculateMaxScroll(session->buffer, session->window);
+    ScrollToCursor(session->buffer, session->window);
+    UpdateScrollBars(session);
+    RenderText(session->window, session->buffer);
+    UpdateCursor(session->window, session->buffer);
+    session->docState.modified = session->buffer->doc->modified;
+    
+    Printf("[CMD] TTX_Cmd_PasteClip: SUCCESS\n");
+    return TRUE;
 }
 
 BOOL TTX_Cmd_PrintClip(struct TTXApplication *app, struct Session *session, STRPTR *args, ULONG argCount)
 {
-    /* TODO: Implement clipboard printing */
-    Printf("[CMD] TTX_Cmd_PrintClip: not yet implemented\n");
-    return FALSE;
+    return ClipToFile(GetClipUnit(args, argCount), "PRT:");
 }
 
 BOOL TTX_Cmd_SaveClip(struct TTXApplication *app, struct Session *session, STRPTR *args, ULONG argCount)
 {
-    /* TODO: Implement clipboard saving */
-    Printf("[CMD] TTX_Cmd_SaveClip: not yet implemented\n");
-    return FALSE;
+    STRPTR fileName = NULL;
+    STRPTR selectedFile = NULL;
+    BOOL result = FALSE;
+    
+    if (!app || !session) {
+        return FALSE;
+    }
+    
+    /* A file name and an optional clipboard unit */
+    if (args && argCount > 0 && args[0]) {
+        fileName = args[0];
+    } else {
+        selectedFile = TTX_ShowSaveFileRequester(app, session, NULL, NULL);
+        if (!selectedFile) {
+            Printf("[CMD] TTX_Cmd_SaveClip: cancelled or failed\n");
+            return FALSE;
+        }
+        fileName = selectedFile;
+    }
+    
+    result = ClipToFile((argCount > 1) ? GetClipUnit(&args[1], argCount - 1) : PRIMARY_CLIP, fileName);
+    
+    if (selectedFile) {
+        freeVec(selectedFile);
+    }
+    
+    return result;
 }
 
 /* ============================================================================
@@ -2668,6 +3007,41 @@ BOOL TTX_Cmd_SetFilePath(struct TTXApplication *app, struct Session *session, ST
  * Cursor Position Commands (stubs)
  * ============================================================================ */
 
+/* Bookmark number given as an argument (1 if there is none, 0 if it is out of range) */
+static ULONG GetBookmarkArg(STRPTR *args, ULONG argCount)
+{
+    LONG number = 1;
+    
+    if (args && argCount > 0 && args[0]) {
+        if (StrToLong(args[0], &number) <= 0 || number < 1 || number > TTX_BOOKMARKS) {
+            return 0;
+        }
+    }
+    return (ULONG)number;
+}
+
+/* Move the cursor to a marker, leaving the automark where it was */
+static BOOL JumpToMarker(struct Session *session, struct Marker *marker)
+{
+    struct TextBuffer *buffer = session->buffer;
+    ULONG y = 0;
+    ULONG x = 0;
+    
+    /* Where the marker is before the automark moves - it may be the automark */
+    GetMarkerPosition(buffer->doc, marker, &y, &x);
+    if (!SetDocMark(buffer->doc, &buffer->doc->automark, MARKER_AUTOMARK, 0, buffer->cursorY, buffer->cursorX)) {
+        return FALSE;
+    }
+    
+    buffer->cursorY = y;
+    buffer->cursorX = x;
+    ScrollToCursor(buffer, session->window);
+    UpdateScrollBars(session);
+    RenderText(session->window, buffer);
+    UpdateCursor(session->window, buffer);
+    return TRUE;
+}
+
 BOOL TTX_Cmd_Find(struct TTXApplication *app, struct Session *session, STRPTR *args, ULONG argCount)
 {
     /* TODO: Implement find/search */
@@ -2717,6 +3091,7 @@ BOOL TTX_Cmd_MoveDown(struct TTXApplication *app, struct Session *session, STRPT
 {
     LONG count = 1;
     ULONG i = 0;
+    ULONG nextY = 0;
     
     if (!session || !session->buffer) {
         return FALSE;
@@ -2728,11 +3103,15 @@ BOOL TTX_Cmd_MoveDown(struct TTXApplication *app, struct Session *session, STRPT
         count = 1;
     }
     
-    /* Move cursor down by count lines */
-    for (i = 0; i < (ULONG)count && session->buffer->cursorY < session->buffer->lineCount - 1; i++) {
-        session->buffer->cursorY++;
-        if (session->buffer->cursorX > session->buffer->lines[session->buffer->cursorY].length) {
-            session->buffer->cursorX = session->buffer->lines[session->buffer->cursorY].length;
+    /* Move cursor down by count lines - the lines of a hidden fold count as none */
+    for (i = 0; i < (ULONG)count; i++) {
+        nextY = LineAfterRows(session->buffer->doc, session->buffer->cursorY, 1);
+        if (nextY >= session->buffer->doc->lineCount) {
+            break;
+        }
+        session->buffer->cursorY = nextY;
+        if (session->buffer->cursorX > session->buffer->doc->lines[session->buffer->cursorY].length) {
+            session->buffer->cursorX = session->buffer->doc->lines[session->buffer->cursorY].length;
         }
     }
     
@@ -2757,14 +3136,14 @@ BOOL TTX_Cmd_MoveDownScr(struct TTXApplication *app, struct Session *session, ST
         pageH = 20;  /* Default if not calculated */
     }
     
-    /* Move cursor down by screen height */
-    session->buffer->cursorY += pageH;
-    if (session->buffer->cursorY >= session->buffer->lineCount) {
-        session->buffer->cursorY = session->buffer->lineCount - 1;
+    /* Move cursor down by screen height - counted in rows, so hidden folds are passed over and wrapped lines count whole */
+    session->buffer->cursorY = ViewLineAfterRows(session->buffer, session->buffer->cursorY, pageH);
+    if (session->buffer->cursorY >= session->buffer->doc->lineCount) {
+        session->buffer->cursorY = ViewRowToLine(session->buffer, GetViewRowCount(session->buffer) - 1);
     }
     
-    if (session->buffer->cursorX > session->buffer->lines[session->buffer->cursorY].length) {
-        session->buffer->cursorX = session->buffer->lines[session->buffer->cursorY].length;
+    if (session->buffer->cursorX > session->buffer->doc->lines[session->buffer->cursorY].length) {
+        session->buffer->cursorX = session->buffer->doc->lines[session->buffer->cursorY].length;
     }
     
     ScrollToCursor(session->buffer, session->window);
@@ -2782,9 +3161,9 @@ BOOL TTX_Cmd_MoveEOF(struct TTXApplication *app, struct Session *session, STRPTR
     }
     
     /* Move to end of file */
-    if (session->buffer->lineCount > 0) {
-        session->buffer->cursorY = session->buffer->lineCount - 1;
-        session->buffer->cursorX = session->buffer->lines[session->buffer->cursorY].length;
+    if (session->buffer->doc->lineCount > 0) {
+        session->buffer->cursorY = session->buffer->doc->lineCount - 1;
+        session->buffer->cursorX = session->buffer->doc->lines[session->buffer->cursorY].length;
         ScrollToCursor(session->buffer, session->window);
         UpdateScrollBars(session);
         RenderText(session->window, session->buffer);
@@ -2817,9 +3196,20 @@ BOOL TTX_Cmd_MoveEOL(struct TTXApplication *app, struct Session *session, STRPTR
 
 BOOL TTX_Cmd_MoveLastChange(struct TTXApplication *app, struct Session *session, STRPTR *args, ULONG argCount)
 {
-    /* TODO: Move to last change position */
-    Printf("[CMD] TTX_Cmd_MoveLastChange: not yet implemented\n");
-    return FALSE;
+    if (!session || !session->buffer || !session->buffer->doc) {
+        return FALSE;
+    }
+    
+    if (!session->buffer->doc->lastChange) {
+        Printf("[CMD] TTX_Cmd_MoveLastChange: FAIL (no change yet)\n");
+        return FALSE;
+    }
+    
+    if (!JumpToMarker(session, session->buffer->doc->lastChange)) {
+        return FALSE;
+    }
+    Printf("[CMD] TTX_Cmd_MoveLastChange: SUCCESS\n");
+    return TRUE;
 }
 
 BOOL TTX_Cmd_MoveLeft(struct TTXApplication *app, struct Session *session, STRPTR *args, ULONG argCount)
@@ -2842,8 +3232,9 @@ BOOL TTX_Cmd_MoveLeft(struct TTXApplication *app, struct Session *session, STRPT
         if (session->buffer->cursorX > 0) {
             session->buffer->cursorX--;
         } else if (session->buffer->cursorY > 0) {
-            session->buffer->cursorY--;
-            session->buffer->cursorX = session->buffer->lines[session->buffer->cursorY].length;
+            /* End of the line above - over any hidden fold */
+            session->buffer->cursorY = RowToLine(session->buffer->doc, LineToRow(session->buffer->doc, session->buffer->cursorY) - 1);
+            session->buffer->cursorX = session->buffer->doc->lines[session->buffer->cursorY].length;
         } else {
             break;
         }
@@ -2859,9 +3250,31 @@ BOOL TTX_Cmd_MoveLeft(struct TTXApplication *app, struct Session *session, STRPT
 
 BOOL TTX_Cmd_MoveMatchBkt(struct TTXApplication *app, struct Session *session, STRPTR *args, ULONG argCount)
 {
-    /* TODO: Move to matching bracket */
-    Printf("[CMD] TTX_Cmd_MoveMatchBkt: not yet implemented\n");
-    return FALSE;
+    struct TextBuffer *buffer = NULL;
+    ULONG matchY = 0;
+    ULONG matchX = 0;
+    
+    if (!session || !session->buffer || !session->buffer->doc) {
+        return FALSE;
+    }
+    buffer = session->buffer;
+    
+    /* The bracket under the cursor, else the one just before it */
+    if (!FindMatchingBracket(buffer->doc, buffer->cursorY, buffer->cursorX, &matchY, &matchX) &&
+        (buffer->cursorX == 0 ||
+         !FindMatchingBracket(buffer->doc, buffer->cursorY, buffer->cursorX - 1, &matchY, &matchX))) {
+        Printf("[CMD] TTX_Cmd_MoveMatchBkt: FAIL (no bracket at the cursor, or it has no match)\n");
+        return FALSE;
+    }
+    
+    buffer->cursorY = matchY;
+    buffer->cursorX = matchX;
+    ScrollToCursor(buffer, session->window);
+    UpdateScrollBars(session);
+    RenderText(session->window, buffer);
+    UpdateCursor(session->window, buffer);
+    Printf("[CMD] TTX_Cmd_MoveMatchBkt: SUCCESS (%lu,%lu)\n", matchY, matchX);
+    return TRUE;
 }
 
 BOOL TTX_Cmd_MoveNextTabStop(struct TTXApplication *app, struct Session *session, STRPTR *args, ULONG argCount)
@@ -2933,11 +3346,12 @@ BOOL TTX_Cmd_MoveRight(struct TTXApplication *app, struct Session *session, STRP
     
     /* Move cursor right by count characters */
     for (i = 0; i < (ULONG)count; i++) {
-        if (session->buffer->cursorY < session->buffer->lineCount) {
-            if (session->buffer->cursorX < session->buffer->lines[session->buffer->cursorY].length) {
+        if (session->buffer->cursorY < session->buffer->doc->lineCount) {
+            if (session->buffer->cursorX < session->buffer->doc->lines[session->buffer->cursorY].length) {
                 session->buffer->cursorX++;
-            } else if (session->buffer->cursorY < session->buffer->lineCount - 1) {
-                session->buffer->cursorY++;
+            } else if (LineAfterRows(session->buffer->doc, session->buffer->cursorY, 1) < session->buffer->doc->lineCount) {
+                /* Start of the line below - over any hidden fold */
+                session->buffer->cursorY = LineAfterRows(session->buffer->doc, session->buffer->cursorY, 1);
                 session->buffer->cursorX = 0;
             } else {
                 break;
@@ -3006,11 +3420,11 @@ BOOL TTX_Cmd_MoveUp(struct TTXApplication *app, struct Session *session, STRPTR
         count = 1;
     }
     
-    /* Move cursor up by count lines */
+    /* Move cursor up by count lines - the lines of a hidden fold count as none */
     for (i = 0; i < (ULONG)count && session->buffer->cursorY > 0; i++) {
-        session->buffer->cursorY--;
-        if (session->buffer->cursorX > session->buffer->lines[session->buffer->cursorY].length) {
-            session->buffer->cursorX = session->buffer->lines[session->buffer->cursorY].length;
+        session->buffer->cursorY = RowToLine(session->buffer->doc, LineToRow(session->buffer->doc, session->buffer->cursorY) - 1);
+        if (session->buffer->cursorX > session->buffer->doc->lines[session->buffer->cursorY].length) {
+            session->buffer->cursorX = session->buffer->doc->lines[session->buffer->cursorY].length;
         }
     }
     
@@ -3025,6 +3439,7 @@ BOOL TTX_Cmd_MoveUp(struct TTXApplication *app, struct Session *session, STRPTR
 BOOL TTX_Cmd_MoveUpScr(struct TTXApplication *app, struct Session *session, STRPTR *args, ULONG argCount)
 {
     ULONG pageH = 0;
+    ULONG row = 0;
     
     if (!session || !session->buffer) {
         return FALSE;
@@ -3035,15 +3450,16 @@ BOOL TTX_Cmd_MoveUpScr(struct TTXApplication *app, struct Session *session, STRP
         pageH = 20;  /* Default if not calculated */
     }
     
-    /* Move cursor up by screen height */
-    if (session->buffer->cursorY >= pageH) {
-        session->buffer->cursorY -= pageH;
+    /* Move cursor up by screen height - counted in rows, so hidden folds are passed over and wrapped lines count whole */
+    row = ViewLineToRow(session->buffer, session->buffer->cursorY);
+    if (row >= pageH) {
+        session->buffer->cursorY = ViewRowToLine(session->buffer, row - pageH);
     } else {
         session->buffer->cursorY = 0;
     }
     
-    if (session->buffer->cursorX > session->buffer->lines[session->buffer->cursorY].length) {
-        session->buffer->cursorX = session->buffer->lines[session->buffer->cursorY].length;
+    if (session->buffer->cursorX > session->buffer->doc->lines[session->buffer->cursorY].length) {
+        session->buffer->cursorX = session->buffer->doc->lines[session->buffer->cursorY].length;
     }
     
     ScrollToCursor(session->buffer, session->window);
@@ -3055,35 +3471,102 @@ BOOL TTX_Cmd_MoveUpScr(struct TTXApplication *app, struct Session *session, STRP
 }
 
 /* ============================================================================
- * Bookmark Commands (stubs)
+ * Bookmark Commands
  * ============================================================================ */
 
 BOOL TTX_Cmd_ClearBookmark(struct TTXApplication *app, struct Session *session, STRPTR *args, ULONG argCount)
 {
-    /* TODO: Implement bookmark clearing */
-    Printf("[CMD] TTX_Cmd_ClearBookmark: not yet implemented\n");
-    return FALSE;
+    struct TextDocument *doc = NULL;
+    ULONG number = 0;
+    ULONG i = 0;
+    
+    if (!session || !session->buffer || !session->buffer->doc) {
+        return FALSE;
+    }
+    doc = session->buffer->doc;
+    
+    if (!args || argCount == 0 || !args[0]) {
+        /* No number - clear them all */
+        for (i = 0; i < TTX_BOOKMARKS; i++) {
+            ClearDocMark(doc, &doc->bookmarks[i]);
+        }
+        Printf("[CMD] TTX_Cmd_ClearBookmark: SUCCESS (all)\n");
+        return TRUE;
+    }
+    
+    number = GetBookmarkArg(args, argCount);
+    if (number == 0) {
+        Printf("[CMD] TTX_Cmd_ClearBookmark: FAIL (no bookmark %s)\n", args[0]);
+        return FALSE;
+    }
+    ClearDocMark(doc, &doc->bookmarks[number - 1]);
+    Printf("[CMD] TTX_Cmd_ClearBookmark: SUCCESS (%lu)\n", number);
+    return TRUE;
 }
 
 BOOL TTX_Cmd_MoveAutomark(struct TTXApplication *app, struct Session *session, STRPTR *args, ULONG argCount)
 {
-    /* TODO: Move to automatic bookmark */
-    Printf("[CMD] TTX_Cmd_MoveAutomark: not yet implemented\n");
-    return FALSE;
+    if (!session || !session->buffer || !session->buffer->doc) {
+        return FALSE;
+    }
+    
+    if (!session->buffer->doc->automark) {
+        Printf("[CMD] TTX_Cmd_MoveAutomark: FAIL (no automark)\n");
+        return FALSE;
+    }
+    
+    /* The automark takes the cursor position, so a second jump comes back */
+    if (!JumpToMarker(session, session->buffer->doc->automark)) {
+        return FALSE;
+    }
+    Printf("[CMD] TTX_Cmd_MoveAutomark: SUCCESS\n");
+    return TRUE;
 }
 
 BOOL TTX_Cmd_MoveBookmark(struct TTXApplication *app, struct Session *session, STRPTR *args, ULONG argCount)
 {
-    /* TODO: Move to bookmark */
-    Printf("[CMD] TTX_Cmd_MoveBookmark: not yet implemented\n");
-    return FALSE;
+    ULONG number = 0;
+    
+    if (!session || !session->buffer || !session->buffer->doc) {
+        return FALSE;
+    }
+    
+    number = GetBookmarkArg(args, argCount);
+    if (number == 0 || !session->buffer->doc->bookmarks[number - 1]) {
+        Printf("[CMD] TTX_Cmd_MoveBookmark: FAIL (bookmark not set)\n");
+        return FALSE;
+    }
+    
+    if (!JumpToMarker(session, session->buffer->doc->bookmarks[number - 1])) {
+        return FALSE;
+    }
+    Printf("[CMD] TTX_Cmd_MoveBookmark: SUCCESS (%lu)\n", number);
+    return TRUE;
 }
 
 BOOL TTX_Cmd_SetBookmark(struct TTXApplication *app, struct Session *session, STRPTR *args, ULONG argCount)
 {
-    /* TODO: Set bookmark */
-    Printf("[CMD] TTX_Cmd_SetBookmark: not yet implemented\n");
-    return FALSE;
+    struct TextBuffer *buffer = NULL;
+    ULONG number = 0;
+    
+    if (!session || !session->buffer || !session->buffer->doc) {
+        return FALSE;
+    }
+    buffer = session->buffer;
+    
+    number = GetBookmarkArg(args, argCount);
+    if (number == 0) {
+        Printf("[CMD] TTX_Cmd_SetBookmark: FAIL (bookmarks are 1-%lu)\n", (ULONG)TTX_BOOKMARKS);
+        return FALSE;
+    }
+    
+    if (!SetDocMark(buffer->doc, &buffer->doc->bookmarks[number - 1], MARKER_BOOKMARK, (UWORD)number,
+                    buffer->cursorY, buffer->cursorX)) {
+        Printf("[CMD] TTX_Cmd_SetBookmark: FAIL (out of memory)\n");
+        return FALSE;
+    }
+    Printf("[CMD] TTX_Cmd_SetBookmark: SUCCESS (%lu at %lu,%lu)\n", number, buffer->cursorY, buffer->cursorX);
+    return TRUE;
 }
 
 /* ============================================================================
@@ -3092,18 +3575,25 @@ BOOL TTX_Cmd_SetBookmark(struct TTXApplication *app, struct Session *session, ST
 
 BOOL TTX_Cmd_Delete(struct TTXApplication *app, struct Session *session, STRPTR *args, ULONG argCount)
 {
+    BOOL deleted = FALSE;
+    
     /* Delete character at cursor (backspace) */
     if (!session || !session->buffer || session->docState.readOnly) {
         return FALSE;
     }
     
-    if (DeleteChar(session->buffer, session->cleanupStack)) {
+    if (session->buffer->caretCount > 0) {
+        deleted = CaretDeleteChar(session->buffer, FALSE, session->cleanupStack);
+    } else {
+        deleted = DeleteChar(session->buffer, session->cleanupStack);
+    }
+    if (deleted) {
         CalculateMaxScroll(session->buffer, session->window);
         ScrollToCursor(session->buffer, session->window);
         UpdateScrollBars(session);
         RenderText(session->window, session->buffer);
         UpdateCursor(session->window, session->buffer);
-        session->docState.modified = session->buffer->modified;
+        session->docState.modified = session->buffer->doc->modified;
         Printf("[CMD] TTX_Cmd_Delete: SUCCESS\n");
         return TRUE;
     }
@@ -3111,6 +3601,34 @@ BOOL TTX_Cmd_Delete(struct TTXApplication *app, struct Session *session, STRPTR
     return FALSE;
 }
 
+BOOL TTX_Cmd_DeleteForward(struct TTXApplication *app, struct Session *session, STRPTR *args, ULONG argCount)
+{
+    BOOL deleted = FALSE;
+    
+    /* Delete character under cursor (Del key) */
+    if (!session || !session->buffer || session->docState.readOnly) {
+        return FALSE;
+    }
+    
+    if (session->buffer->caretCount > 0) {
+        deleted = CaretDeleteChar(session->buffer, TRUE, session->cleanupStack);
+    } else {
+        deleted = DeleteForward(session->buffer, session->cleanupStack);
+    }
+    if (deleted) {
+        CalculateMaxScroll(session->buffer, session->window);
+        ScrollToCursor(session->buffer, session->window);
+        UpdateScrollBars(session);
+        RenderText(session->window, session->buffer);
+        UpdateCursor(session->window, session->buffer);
+        session->docState.modified = session->buffer->doc->modified;
+        Printf("[CMD] TTX_Cmd_DeleteForward: SUCCESS\n");
+        return TRUE;
+    }
+    
+    return FALSE;
+}
+
 BOOL TTX_Cmd_DeleteEOL(struct TTXApplication *app, struct Session *session, STRPTR *args, ULONG argCount)
 {
     if (!session || !session->buffer || session->docState.readOnly) {
@@ -3123,7 +3641,7 @@ BOOL TTX_Cmd_DeleteEOL(struct TTXApplication *app, struct Session *session, STRP
         UpdateScrollBars(session);
         RenderText(session->window, session->buffer);
         UpdateCursor(session->window, session->buffer);
-        session->docState.modified = session->buffer->modified;
+        session->docState.modified = session->buffer->doc->modified;
         Printf("[CMD] TTX_Cmd_DeleteEOL: SUCCESS\n");
         return TRUE;
     }
@@ -3143,7 +3661,7 @@ BOOL TTX_Cmd_DeleteEOW(struct TTXApplication *app, struct Session *session, STRP
         UpdateScrollBars(session);
         RenderText(session->window, session->buffer);
         UpdateCursor(session->window, session->buffer);
-        session->docState.modified = session->buffer->modified;
+        session->docState.modified = session->buffer->doc->modified;
         Printf("[CMD] TTX_Cmd_DeleteEOW: SUCCESS\n");
         return TRUE;
     }
@@ -3163,7 +3681,7 @@ BOOL TTX_Cmd_DeleteLine(struct TTXApplication *app, struct Session *session, STR
         UpdateScrollBars(session);
         RenderText(session->window, session->buffer);
         UpdateCursor(session->window, session->buffer);
-        session->docState.modified = session->buffer->modified;
+        session->docState.modified = session->buffer->doc->modified;
         Printf("[CMD] TTX_Cmd_DeleteLine: SUCCESS\n");
         return TRUE;
     }
@@ -3183,7 +3701,7 @@ BOOL TTX_Cmd_DeleteSOL(struct TTXApplication *app, struct Session *session, STRP
         UpdateScrollBars(session);
         RenderText(session->window, session->buffer);
         UpdateCursor(session->window, session->buffer);
-        session->docState.modified = session->buffer->modified;
+        session->docState.modified = session->buffer->doc->modified;
         Printf("[CMD] TTX_Cmd_DeleteSOL: SUCCESS\n");
         return TRUE;
     }
@@ -3203,7 +3721,7 @@ BOOL TTX_Cmd_DeleteSOW(struct TTXApplication *app, struct Session *session, STRP
         UpdateScrollBars(session);
         RenderText(session->window, session->buffer);
         UpdateCursor(session->window, session->buffer);
-        session->docState.modified = session->buffer->modified;
+        session->docState.modified = session->buffer->doc->modified;
         Printf("[CMD] TTX_Cmd_DeleteSOW: SUCCESS\n");
         return TRUE;
     }
@@ -3235,36 +3753,44 @@ BOOL TTX_Cmd_GetChar(struct TTXApplication *app, struct Session *session, STRPTR
 BOOL TTX_Cmd_GetLine(struct TTXApplication *app, struct Session *session, STRPTR *args, ULONG argCount)
 {
     STRPTR lineText = NULL;
+    ULONG lineLength = 0;
     
     if (!session || !session->buffer) {
         return FALSE;
     }
     
-    lineText = GetCurrentLine(session->buffer, session->cleanupStack);
-    if (lineText) {
-        Printf("[CMD] TTX_Cmd_GetLine: line='%s'\n", lineText);
-        /* TODO: Return to ARexx via RESULT */
-        freeVec(lineText);
-        return TRUE;
+    if (!GetLineSpan(session->buffer, session->buffer->cursorY, &lineText, &lineLength)) {
+        return FALSE;
     }
     
-    return FALSE;
+    return TTX_SetResultRef(app, lineText, lineLength);
 }
 
 BOOL TTX_Cmd_Insert(struct TTXApplication *app, struct Session *session, STRPTR *args, ULONG argCount)
 {
+    BOOL inserted = FALSE;
+    
     if (!session || !session->buffer || session->docState.readOnly) {
         return FALSE;
     }
     
     if (args && argCount > 0 && args[0]) {
-        if (InsertText(session->buffer, args[0], session->cleanupStack)) {
+        if (session->buffer->caretCount > 0) {
+            ULONG len = 0;
+            while (args[0][len] != '\0') {
+                len++;
+            }
+            inserted = CaretInsertText(session->buffer, args[0], len, session->cleanupStack);
+        } else {
+            inserted = InsertText(session->buffer, args[0], session->cleanupStack);
+        }
+        if (inserted) {
             CalculateMaxScroll(session->buffer, session->window);
             ScrollToCursor(session->buffer, session->window);
             UpdateScrollBars(session);
             RenderText(session->window, session->buffer);
             UpdateCursor(session->window, session->buffer);
-            session->docState.modified = session->buffer->modified;
+            session->docState.modified = session->buffer->doc->modified;
             Printf("[CMD] TTX_Cmd_Insert: SUCCESS\n");
             return TRUE;
         }
@@ -3275,18 +3801,25 @@ BOOL TTX_Cmd_Insert(struct TTXApplication *app, struct Session *session, STRPTR
 
 BOOL TTX_Cmd_InsertLine(struct TTXApplication *app, struct Session *session, STRPTR *args, ULONG argCount)
 {
+    BOOL inserted = FALSE;
+    
     if (!session || !session->buffer || session->docState.readOnly) {
         return FALSE;
     }
     
-    /* Insert newline at cursor */
-    if (InsertNewline(session->buffer, session->cleanupStack)) {
+    /* Insert newline at cursor - and at every other caret */
+    if (session->buffer->caretCount > 0) {
+        inserted = CaretInsertText(session->buffer, "\n", 1, session->cleanupStack);
+    } else {
+        inserted = InsertNewline(session->buffer, session->cleanupStack);
+    }
+    if (inserted) {
         CalculateMaxScroll(session->buffer, session->window);
         ScrollToCursor(session->buffer, session->window);
         UpdateScrollBars(session);
         RenderText(session->window, session->buffer);
         UpdateCursor(session->window, session->buffer);
-        session->docState.modified = session->buffer->modified;
+        session->docState.modified = session->buffer->doc->modified;
         Printf("[CMD] TTX_Cmd_InsertLine: SUCCESS\n");
         return TRUE;
     }
@@ -3310,7 +3843,7 @@ BOOL TTX_Cmd_SetChar(struct TTXApplication *app, struct Session *session, STRPTR
             UpdateScrollBars(session);
             RenderText(session->window, session->buffer);
             UpdateCursor(session->window, session->buffer);
-            session->docState.modified = session->buffer->modified;
+            session->docState.modified = session->buffer->doc->modified;
             Printf("[CMD] TTX_Cmd_SetChar: SUCCESS\n");
             return TRUE;
         }
@@ -3331,7 +3864,7 @@ BOOL TTX_Cmd_SwapChars(struct TTXApplication *app, struct Session *session, STRP
         UpdateScrollBars(session);
         RenderText(session->window, session->buffer);
         UpdateCursor(session->window, session->buffer);
-        session->docState.modified = session->buffer->modified;
+        session->docState.modified = session->buffer->doc->modified;
         Printf("[CMD] TTX_Cmd_SwapChars: SUCCESS\n");
         return TRUE;
     }
@@ -3357,7 +3890,7 @@ BOOL TTX_Cmd_ToggleCharCase(struct TTXApplication *app, struct Session *session,
         UpdateScrollBars(session);
         RenderText(session->window, session->buffer);
         UpdateCursor(session->window, session->buffer);
-        session->docState.modified = session->buffer->modified;
+        session->docState.modified = session->buffer->doc->modified;
         Printf("[CMD] TTX_Cmd_ToggleCharCase: SUCCESS\n");
         return TRUE;
     }
@@ -3380,23 +3913,114 @@ BOOL TTX_Cmd_UndoLine(struct TTXApplication *app, struct Session *session, STRPT
 }
 
 /* ============================================================================
- * Word-Level Editing Commands (stubs)
+ * Caret Commands
  * ============================================================================ */
 
-BOOL TTX_Cmd_CompleteTemplate(struct TTXApplication *app, struct Session *session, STRPTR *args, ULONG argCount)
+BOOL TTX_Cmd_AddCaret(struct TTXApplication *app, struct Session *session, STRPTR *args, ULONG argCount)
 {
-    /* TODO: Implement template completion */
-    Printf("[CMD] TTX_Cmd_CompleteTemplate: not yet implemented\n");
-    return FALSE;
+    struct TextBuffer *buffer = NULL;
+    
+    if (!session || !session->buffer) {
+        return FALSE;
+    }
+    buffer = session->buffer;
+    
+    /* Toggle: a caret already at the cursor is dropped, otherwise one is left there */
+    if (!RemoveCaret(buffer, buffer->cursorY, buffer->cursorX) &&
+        !AddCaret(buffer, buffer->cursorY, buffer->cursorX)) {
+        Printf("[CMD] TTX_Cmd_AddCaret: FAIL (AddCaret failed)\n");
+        return FALSE;
+    }
+    
+    RenderText(session->window, buffer);
+    UpdateCursor(session->window, buffer);
+    Printf("[CMD] TTX_Cmd_AddCaret: SUCCESS (%lu carets)\n", buffer->caretCount);
+    return TRUE;
 }
 
-BOOL TTX_Cmd_CorrectWord(struct TTXApplication *app, struct Session *session, STRPTR *args, ULONG argCount)
+BOOL TTX_Cmd_AddCarets(struct TTXApplication *app, struct Session *session, STRPTR *args, ULONG argCount)
 {
-    /* TODO: Implement word correction */
-    Printf("[CMD] TTX_Cmd_CorrectWord: not yet implemented\n");
-    return FALSE;
-}
-
+    ULONG added = 0;
+    
+    if (!session || !session->buffer) {
+        return FALSE;
+    }
+    
+    if (!session->buffer->marking.enabled) {
+        Printf("[CMD] TTX_Cmd_AddCarets: FAIL (no selection)\n");
+        return FALSE;
+    }
+    
+    /* A caret on each line of the block - the block itself is dropped */
+    added = AddBlockCarets(session->buffer);
+    
+    ScrollToCursor(session->buffer, session->window);
+    UpdateScrollBars(session);
+    RenderText(session->window, session->buffer);
+    UpdateCursor(session->window, session->buffer);
+    Printf("[CMD] TTX_Cmd_AddCarets: SUCCESS (%lu added)\n", added);
+    return TRUE;
+}
+
+BOOL TTX_Cmd_ClearCarets(struct TTXApplication *app, struct Session *session, STRPTR *args, ULONG argCount)
+{
+    if (!session || !session->buffer) {
+        return FALSE;
+    }
+    
+    ClearCarets(session->buffer);
+    RenderText(session->window, session->buffer);
+    UpdateCursor(session->window, session->buffer);
+    Printf("[CMD] TTX_Cmd_ClearCarets: SUCCESS\n");
+    return TRUE;
+}
+
+/* ============================================================================
+ * Word-Level Editing Commands (stubs)
+ * ============================================================================ */
+
+BOOL TTX_Cmd_CompleteTemplate(struct TTXApplication *app, struct Session *session, STRPTR *args, ULONG argCount)
+{
+    STRPTR word = NULL;
+    STRPTR text = NULL;
+    ULONG length = 0;
+    
+    if (!session || !session->buffer || session->docState.readOnly) {
+        return FALSE;
+    }
+    
+    /* The word at the cursor is the abbreviation - the TEMPLATES trie gives its text */
+    if (!GetWordSpan(session->buffer, &word, &length)) {
+        return FALSE;
+    }
+    text = FindDFNTemplate(GetDefinitions(), word, length);
+    if (!text) {
+        Printf("[CMD] TTX_Cmd_CompleteTemplate: no template for word at cursor\n");
+        return FALSE;
+    }
+    
+    if (ReplaceWordAtCursor(session->buffer, "", session->cleanupStack)) {
+        InsertText(session->buffer, text, session->cleanupStack);
+        CalculateMaxScroll(session->buffer, session->window);
+        ScrollToCursor(session->buffer, session->window);
+        UpdateScrollBars(session);
+        RenderText(session->window, session->buffer);
+        UpdateCursor(session->window, session->buffer);
+        session->docState.modified = session->buffer->doc->modified;
+        Printf("[CMD] TTX_Cmd_CompleteTemplate: SUCCESS\n");
+        return TRUE;
+    }
+    
+    return FALSE;
+}
+
+BOOL TTX_Cmd_CorrectWord(struct TTXApplication *app, struct Session *session, STRPTR *args, ULONG argCount)
+{
+    /* TODO: Implement word correction */
+    Printf("[CMD] TTX_Cmd_CorrectWord: not yet implemented\n");
+    return FALSE;
+}
+
 BOOL TTX_Cmd_CorrectWordCase(struct TTXApplication *app, struct Session *session, STRPTR *args, ULONG argCount)
 {
     /* TODO: Implement word case correction */
@@ -3407,20 +4031,17 @@ BOOL TTX_Cmd_CorrectWordCase(struct TTXApplication *app, struct Session *session
 BOOL TTX_Cmd_GetWord(struct TTXApplication *app, struct Session *session, STRPTR *args, ULONG argCount)
 {
     STRPTR word = NULL;
+    ULONG wordLength = 0;
     
     if (!session || !session->buffer) {
         return FALSE;
     }
     
-    word = GetWordAtCursor(session->buffer, session->cleanupStack);
-    if (word) {
-        Printf("[CMD] TTX_Cmd_GetWord: word='%s'\n", word);
-        /* TODO: Return to ARexx via RESULT */
-        freeVec(word);
-        return TRUE;
+    if (!GetWordSpan(session->buffer, &word, &wordLength)) {
+        return FALSE;
     }
     
-    return FALSE;
+    return TTX_SetResultRef(app, word, wordLength);
 }
 
 BOOL TTX_Cmd_ReplaceWord(struct TTXApplication *app, struct Session *session, STRPTR *args, ULONG argCount)
@@ -3436,7 +4057,7 @@ BOOL TTX_Cmd_ReplaceWord(struct TTXApplication *app, struct Session *session, ST
             UpdateScrollBars(session);
             RenderText(session->window, session->buffer);
             UpdateCursor(session->window, session->buffer);
-            session->docState.modified = session->buffer->modified;
+            session->docState.modified = session->buffer->doc->modified;
             Printf("[CMD] TTX_Cmd_ReplaceWord: SUCCESS\n");
             return TRUE;
         }
@@ -3446,14 +4067,81 @@ BOOL TTX_Cmd_ReplaceWord(struct TTXApplication *app, struct Session *session, ST
 }
 
 /* ============================================================================
- * Formatting Commands (stubs)
+ * Formatting Commands
  * ============================================================================ */
 
+/* A width and BALANCED among the arguments - FALSE if a width is out of range */
+static BOOL GetFormatArgs(STRPTR *args, ULONG argCount, ULONG *width, ULONG *mode)
+{
+    LONG number = 0;
+    ULONG i = 0;
+    
+    for (i = 0; args && i < argCount; i++) {
+        if (!args[i]) {
+            continue;
+        }
+        if (Stricmp(args[i], "Balanced") == 0) {
+            *mode |= FORMAT_BALANCED;
+        } else if (StrToLong(args[i], &number) > 0) {
+            if (number < 1 || number > FORMAT_MAX_WIDTH) {
+                return FALSE;
+            }
+            *width = (ULONG)number;
+        }
+    }
+    return TRUE;
+}
+
+/* Format the marked lines, or else the paragraph at the cursor (just its line when centering) */
+static BOOL FormatCommand(struct Session *session, STRPTR name, ULONG mode, STRPTR *args, ULONG argCount)
+{
+    struct TextBuffer *buffer = NULL;
+    ULONG width = FORMAT_WIDTH;
+    ULONG startY = 0;
+    ULONG startX = 0;
+    ULONG stopY = 0;
+    ULONG stopX = 0;
+    
+    if (!session || !session->buffer || !session->buffer->doc || session->docState.readOnly) {
+        return FALSE;
+    }
+    buffer = session->buffer;
+    
+    if (!GetFormatArgs(args, argCount, &width, &mode)) {
+        Printf("[CMD] %s: FAIL (width must be 1-%lu)\n", name, (ULONG)FORMAT_MAX_WIDTH);
+        return FALSE;
+    }
+    if (GetBlockBounds(buffer, &startY, &startX, &stopY, &stopX)) {
+        if (stopX == 0 && stopY > startY && !buffer->marking.column) {
+            /* Marked up to the start of a line - that line is not part of it */
+            stopY--;
+        }
+    } else if ((mode & ~FORMAT_BALANCED) == FORMAT_CENTER) {
+        startY = buffer->cursorY;
+        stopY = buffer->cursorY;
+    } else if (!GetParagraphLines(buffer, buffer->cursorY, &startY, &stopY)) {
+        Printf("[CMD] %s: FAIL (no paragraph at the cursor)\n", name);
+        return FALSE;
+    }
+    
+    if (!FormatLines(buffer, startY, stopY, width, mode, session->cleanupStack)) {
+        Printf("[CMD] %s: FAIL (out of memory)\n", name);
+        return FALSE;
+    }
+    
+    CalculateMaxScroll(buffer, session->window);
+    ScrollToCursor(buffer, session->window);
+    UpdateScrollBars(session);
+    RenderText(session->window, buffer);
+    UpdateCursor(session->window, buffer);
+    session->docState.modified = buffer->doc->modified;
+    Printf("[CMD] %s: SUCCESS (lines %lu-%lu, width %lu)\n", name, startY, stopY, width);
+    return TRUE;
+}
+
 BOOL TTX_Cmd_Center(struct TTXApplication *app, struct Session *session, STRPTR *args, ULONG argCount)
 {
-    /* TODO: Implement line/block centering */
-    Printf("[CMD] TTX_Cmd_Center: not yet implemented\n");
-    return FALSE;
+    return FormatCommand(session, "TTX_Cmd_Center", FORMAT_CENTER, args, argCount);
 }
 
 BOOL TTX_Cmd_Conv2Lower(struct TTXApplication *app, struct Session *session, STRPTR *args, ULONG argCount)
@@ -3470,7 +4158,7 @@ BOOL TTX_Cmd_Conv2Lower(struct TTXApplication *app, struct Session *session, STR
     if (ConvertToLower(session->buffer, session->cleanupStack)) {
         RenderText(session->window, session->buffer);
         UpdateCursor(session->window, session->buffer);
-        session->docState.modified = session->buffer->modified;
+        session->docState.modified = session->buffer->doc->modified;
         Printf("[CMD] TTX_Cmd_Conv2Lower: SUCCESS\n");
         return TRUE;
     }
@@ -3478,19 +4166,42 @@ BOOL TTX_Cmd_Conv2Lower(struct TTXApplication *app, struct Session *session, STR
     return FALSE;
 }
 
+/* A tab size among the arguments - FALSE if it is out of range */
+static BOOL GetTabSizeArg(STRPTR *args, ULONG argCount, ULONG *tabSize)
+{
+    LONG number = 0;
+    ULONG i = 0;
+    
+    for (i = 0; args && i < argCount; i++) {
+        if (args[i] && StrToLong(args[i], &number) > 0) {
+            if (number < 1 || number > TAB_MAX_SIZE) {
+                return FALSE;
+            }
+            *tabSize = (ULONG)number;
+        }
+    }
+    return TRUE;
+}
+
 BOOL TTX_Cmd_Conv2Spaces(struct TTXApplication *app, struct Session *session, STRPTR *args, ULONG argCount)
 {
+    ULONG tabSize = TAB_SIZE;
+    
     if (!session || !session->buffer || session->docState.readOnly) {
         return FALSE;
     }
     
-    if (ConvertTabsToSpaces(session->buffer, session->cleanupStack)) {
+    if (!GetTabSizeArg(args, argCount, &tabSize)) {
+        Printf("[CMD] TTX_Cmd_Conv2Spaces: FAIL (tab size must be 1-%lu)\n", (ULONG)TAB_MAX_SIZE);
+        return FALSE;
+    }
+    if (ConvertTabsToSpaces(session->buffer, tabSize, session->cleanupStack)) {
         CalculateMaxScroll(session->buffer, session->window);
         ScrollToCursor(session->buffer, session->window);
         UpdateScrollBars(session);
         RenderText(session->window, session->buffer);
         UpdateCursor(session->window, session->buffer);
-        session->docState.modified = session->buffer->modified;
+        session->docState.modified = session->buffer->doc->modified;
         Printf("[CMD] TTX_Cmd_Conv2Spaces: SUCCESS\n");
         return TRUE;
     }
@@ -3500,22 +4211,28 @@ BOOL TTX_Cmd_Conv2Spaces(struct TTXApplication *app, struct Session *session, ST
 
 BOOL TTX_Cmd_Conv2Tabs(struct TTXApplication *app, struct Session *session, STRPTR *args, ULONG argCount)
 {
+    ULONG tabSize = TAB_SIZE;
+    
     if (!session || !session->buffer || session->docState.readOnly) {
         return FALSE;
     }
     
-    if (ConvertSpacesToTabs(session->buffer, session->cleanupStack)) {
+    if (!GetTabSizeArg(args, argCount, &tabSize)) {
+        Printf("[CMD] TTX_Cmd_Conv2Tabs: FAIL (tab size must be 1-%lu)\n", (ULONG)TAB_MAX_SIZE);
+        return FALSE;
+    }
+    if (ConvertSpacesToTabs(session->buffer, tabSize, session->cleanupStack)) {
         CalculateMaxScroll(session->buffer, session->window);
         ScrollToCursor(session->buffer, session->window);
         UpdateScrollBars(session);
         RenderText(session->window, session->buffer);
         UpdateCursor(session->window, session->buffer);
-        session->docState.modified = session->buffer->modified;
+        session->docState.modified = session->buffer->doc->modified;
         Printf("[CMD] TTX_Cmd_Conv2Tabs: SUCCESS\n");
         return TRUE;
     }
     
-    Printf("[CMD] TTX_Cmd_Conv2Tabs: not yet fully implemented\n");
+    Printf("[CMD] TTX_Cmd_Conv2Tabs: FAIL\n");
     return FALSE;
 }
 
@@ -3533,7 +4250,7 @@ BOOL TTX_Cmd_Conv2Upper(struct TTXApplication *app, struct Session *session, STR
     if (ConvertToUpper(session->buffer, session->cleanupStack)) {
         RenderText(session->window, session->buffer);
         UpdateCursor(session->window, session->buffer);
-        session->docState.modified = session->buffer->modified;
+        session->docState.modified = session->buffer->doc->modified;
         Printf("[CMD] TTX_Cmd_Conv2Upper: SUCCESS\n");
         return TRUE;
     }
@@ -3543,16 +4260,12 @@ BOOL TTX_Cmd_Conv2Upper(struct TTXApplication *app, struct Session *session, STR
 
 BOOL TTX_Cmd_FormatParagraph(struct TTXApplication *app, struct Session *session, STRPTR *args, ULONG argCount)
 {
-    /* TODO: Implement paragraph formatting */
-    Printf("[CMD] TTX_Cmd_FormatParagraph: not yet implemented\n");
-    return FALSE;
+    return FormatCommand(session, "TTX_Cmd_FormatParagraph", FORMAT_FILL, args, argCount);
 }
 
 BOOL TTX_Cmd_Justify(struct TTXApplication *app, struct Session *session, STRPTR *args, ULONG argCount)
 {
-    /* TODO: Implement text justification */
-    Printf("[CMD] TTX_Cmd_Justify: not yet implemented\n");
-    return FALSE;
+    return FormatCommand(session, "TTX_Cmd_Justify", FORMAT_JUSTIFY, args, argCount);
 }
 
 BOOL TTX_Cmd_ShiftLeft(struct TTXApplication *app, struct Session *session, STRPTR *args, ULONG argCount)
@@ -3567,7 +4280,7 @@ BOOL TTX_Cmd_ShiftLeft(struct TTXApplication *app, struct Session *session, STRP
         UpdateScrollBars(session);
         RenderText(session->window, session->buffer);
         UpdateCursor(session->window, session->buffer);
-        session->docState.modified = session->buffer->modified;
+        session->docState.modified = session->buffer->doc->modified;
         Printf("[CMD] TTX_Cmd_ShiftLeft: SUCCESS\n");
         return TRUE;
     }
@@ -3587,7 +4300,7 @@ BOOL TTX_Cmd_ShiftRight(struct TTXApplication *app, struct Session *session, STR
         UpdateScrollBars(session);
         RenderText(session->window, session->buffer);
         UpdateCursor(session->window, session->buffer);
-        session->docState.modified = session->buffer->modified;
+        session->docState.modified = session->buffer->doc->modified;
         Printf("[CMD] TTX_Cmd_ShiftRight: SUCCESS\n");
         return TRUE;
     }
@@ -3596,81 +4309,310 @@ BOOL TTX_Cmd_ShiftRight(struct TTXApplication *app, struct Session *session, STR
 }
 
 /* ============================================================================
- * Fold Commands (stubs)
+ * Fold Commands
  * ============================================================================ */
 
-BOOL TTX_Cmd_HideFold(struct TTXApplication *app, struct Session *session, STRPTR *args, ULONG argCount)
+/* NESTED or ALL among the arguments - the lines of the fold at the cursor, or the whole document */
+static BOOL GetFoldScopeArg(struct TextBuffer *buffer, STRPTR *args, ULONG argCount, struct Fold *fold,
+                            ULONG *startY, ULONG *endY)
 {
-    /* TODO: Implement fold hiding */
-    Printf("[CMD] TTX_Cmd_HideFold: not yet implemented\n");
+    ULONG i = 0;
+    
+    for (i = 0; args && i < argCount; i++) {
+        if (args[i] && Stricmp(args[i], "All") == 0) {
+            *startY = 0;
+            *endY = buffer->doc->lineCount - 1;
+            return TRUE;
+        }
+        if (args[i] && Stricmp(args[i], "Nested") == 0 && fold) {
+            GetFoldLines(buffer->doc, fold, startY, endY);
+            return TRUE;
+        }
+    }
     return FALSE;
 }
 
+/* Lines hidden or shown - the view scrolls in rows */
+static VOID ShowFoldChange(struct Session *session)
+{
+    CalculateMaxScroll(session->buffer, session->window);
+    ScrollToCursor(session->buffer, session->window);
+    UpdateScrollBars(session);
+    RenderText(session->window, session->buffer);
+    UpdateCursor(session->window, session->buffer);
+}
+
+BOOL TTX_Cmd_HideFold(struct TTXApplication *app, struct Session *session, STRPTR *args, ULONG argCount)
+{
+    struct TextBuffer *buffer = NULL;
+    struct Fold *fold = NULL;
+    ULONG startY = 0;
+    ULONG endY = 0;
+    
+    if (!session || !session->buffer || !session->buffer->doc) {
+        return FALSE;
+    }
+    buffer = session->buffer;
+    
+    fold = GetFoldAt(buffer->doc, buffer->cursorY);
+    if (GetFoldScopeArg(buffer, args, argCount, fold, &startY, &endY)) {
+        SetFoldsHidden(buffer, startY, endY, TRUE);
+    } else if (fold) {
+        SetFoldHidden(buffer, fold, TRUE);
+    } else {
+        Printf("[CMD] TTX_Cmd_HideFold: FAIL (no fold at the cursor)\n");
+        return FALSE;
+    }
+    
+    ShowFoldChange(session);
+    Printf("[CMD] TTX_Cmd_HideFold: SUCCESS\n");
+    return TRUE;
+}
+
 BOOL TTX_Cmd_MakeFold(struct TTXApplication *app, struct Session *session, STRPTR *args, ULONG argCount)
 {
-    /* TODO: Implement fold creation */
-    Printf("[CMD] TTX_Cmd_MakeFold: not yet implemented\n");
-    return FALSE;
+    struct TextBuffer *buffer = NULL;
+    ULONG startY = 0;
+    ULONG startX = 0;
+    ULONG stopY = 0;
+    ULONG stopX = 0;
+    
+    if (!session || !session->buffer || !session->buffer->doc) {
+        return FALSE;
+    }
+    buffer = session->buffer;
+    
+    /* The lines of the marked block */
+    if (!GetBlockBounds(buffer, &startY, &startX, &stopY, &stopX)) {
+        Printf("[CMD] TTX_Cmd_MakeFold: FAIL (no block marked)\n");
+        return FALSE;
+    }
+    if (stopX == 0 && stopY > startY && !buffer->marking.column) {
+        /* Marked up to the start of a line - that line is not part of it */
+        stopY--;
+    }
+    
+    if (!MakeFold(buffer, startY, stopY)) {
+        Printf("[CMD] TTX_Cmd_MakeFold: FAIL (lines %lu-%lu are not two or more lines clear of other folds)\n",
+               startY, stopY);
+        return FALSE;
+    }
+    ClearMarking(buffer);
+    
+    ShowFoldChange(session);
+    Printf("[CMD] TTX_Cmd_MakeFold: SUCCESS (lines %lu-%lu)\n", startY, stopY);
+    return TRUE;
 }
 
 BOOL TTX_Cmd_ShowFold(struct TTXApplication *app, struct Session *session, STRPTR *args, ULONG argCount)
 {
-    /* TODO: Implement fold showing */
-    Printf("[CMD] TTX_Cmd_ShowFold: not yet implemented\n");
-    return FALSE;
+    struct TextBuffer *buffer = NULL;
+    struct Fold *fold = NULL;
+    ULONG startY = 0;
+    ULONG endY = 0;
+    
+    if (!session || !session->buffer || !session->buffer->doc) {
+        return FALSE;
+    }
+    buffer = session->buffer;
+    
+    /* The fold hidden behind the cursor line, else the one around it */
+    fold = GetHiddenFoldAt(buffer->doc, buffer->cursorY);
+    if (!fold) {
+        fold = GetFoldAt(buffer->doc, buffer->cursorY);
+    }
+    if (GetFoldScopeArg(buffer, args, argCount, fold, &startY, &endY)) {
+        SetFoldsHidden(buffer, startY, endY, FALSE);
+    } else if (fold && fold->hidden) {
+        SetFoldHidden(buffer, fold, FALSE);
+    } else {
+        Printf("[CMD] TTX_Cmd_ShowFold: FAIL (no hidden fold at the cursor)\n");
+        return FALSE;
+    }
+    
+    ShowFoldChange(session);
+    Printf("[CMD] TTX_Cmd_ShowFold: SUCCESS\n");
+    return TRUE;
 }
 
 BOOL TTX_Cmd_ToggleFold(struct TTXApplication *app, struct Session *session, STRPTR *args, ULONG argCount)
 {
-    /* TODO: Implement fold toggling */
-    Printf("[CMD] TTX_Cmd_ToggleFold: not yet implemented\n");
-    return FALSE;
+    struct TextBuffer *buffer = NULL;
+    struct Fold *fold = NULL;
+    
+    if (!session || !session->buffer || !session->buffer->doc) {
+        return FALSE;
+    }
+    buffer = session->buffer;
+    
+    fold = GetHiddenFoldAt(buffer->doc, buffer->cursorY);
+    if (fold) {
+        SetFoldHidden(buffer, fold, FALSE);
+    } else {
+        fold = GetFoldAt(buffer->doc, buffer->cursorY);
+        if (!fold) {
+            Printf("[CMD] TTX_Cmd_ToggleFold: FAIL (no fold at the cursor)\n");
+            return FALSE;
+        }
+        SetFoldHidden(buffer, fold, TRUE);
+    }
+    
+    ShowFoldChange(session);
+    Printf("[CMD] TTX_Cmd_ToggleFold: SUCCESS (%s)\n", fold->hidden ? "hidden" : "shown");
+    return TRUE;
 }
 
 BOOL TTX_Cmd_UnmakeFold(struct TTXApplication *app, struct Session *session, STRPTR *args, ULONG argCount)
 {
-    /* TODO: Implement fold removal */
-    Printf("[CMD] TTX_Cmd_UnmakeFold: not yet implemented\n");
-    return FALSE;
+    struct TextBuffer *buffer = NULL;
+    struct Fold *fold = NULL;
+    ULONG startY = 0;
+    ULONG endY = 0;
+    
+    if (!session || !session->buffer || !session->buffer->doc) {
+        return FALSE;
+    }
+    buffer = session->buffer;
+    
+    fold = GetHiddenFoldAt(buffer->doc, buffer->cursorY);
+    if (!fold) {
+        fold = GetFoldAt(buffer->doc, buffer->cursorY);
+    }
+    if (GetFoldScopeArg(buffer, args, argCount, fold, &startY, &endY)) {
+        UnmakeFolds(buffer, startY, endY);
+    } else if (fold) {
+        UnmakeFold(buffer, fold);
+    } else {
+        Printf("[CMD] TTX_Cmd_UnmakeFold: FAIL (no fold at the cursor)\n");
+        return FALSE;
+    }
+    
+    ShowFoldChange(session);
+    Printf("[CMD] TTX_Cmd_UnmakeFold: SUCCESS\n");
+    return TRUE;
 }
 
 /* ============================================================================
- * Macro Commands (stubs)
+ * Macro Commands
  * ============================================================================ */
 
 BOOL TTX_Cmd_EndMacro(struct TTXApplication *app, struct Session *session, STRPTR *args, ULONG argCount)
 {
-    /* TODO: End macro recording */
-    Printf("[CMD] TTX_Cmd_EndMacro: not yet implemented\n");
-    return FALSE;
+    struct TTXMacro *macro = NULL;
+    
+    if (!app) {
+        return FALSE;
+    }
+    if (!app->recording) {
+        Printf("[CMD] TTX_Cmd_EndMacro: FAIL (not recording)\n");
+        return FALSE;
+    }
+    
+    macro = app->recording;
+    app->recording = NULL;
+    if (macro->failed) {
+        Printf("[CMD] TTX_Cmd_EndMacro: FAIL (out of memory while recording)\n");
+        FreeMacro(macro);
+        return FALSE;
+    }
+    
+    /* The new recording replaces the macro PlayMacro runs */
+    FreeMacro(app->macro);
+    app->macro = macro;
+    Printf("[CMD] TTX_Cmd_EndMacro: SUCCESS (%lu bytes)\n", macro->length);
+    return TRUE;
 }
 
 BOOL TTX_Cmd_ExecARexxMacro(struct TTXApplication *app, struct Session *session, STRPTR *args, ULONG argCount)
 {
-    /* TODO: Execute ARexx macro */
-    Printf("[CMD] TTX_Cmd_ExecARexxMacro: not yet implemented\n");
-    return FALSE;
+    STRPTR fileName = NULL;
+    STRPTR selectedFile = NULL;
+    BOOL result = FALSE;
+    
+    if (!app) {
+        return FALSE;
+    }
+    
+    if (args && argCount > 0 && args[0]) {
+        fileName = args[0];
+    } else {
+        if (!session) {
+            return FALSE;
+        }
+        selectedFile = TTX_ShowFileRequester(app, session, NULL, NULL);
+        if (!selectedFile) {
+            Printf("[CMD] TTX_Cmd_ExecARexxMacro: cancelled or failed\n");
+            return FALSE;
+        }
+        fileName = selectedFile;
+    }
+    
+    result = TTX_ExecRexxMacro(app, fileName);
+    
+    if (selectedFile) {
+        freeVec(selectedFile);
+    }
+    
+    return result;
 }
 
 BOOL TTX_Cmd_ExecARexxString(struct TTXApplication *app, struct Session *session, STRPTR *args, ULONG argCount)
 {
-    /* TODO: Execute ARexx string */
-    Printf("[CMD] TTX_Cmd_ExecARexxString: not yet implemented\n");
-    return FALSE;
+    STRPTR text = NULL;
+    ULONG length = 0;
+    ULONG pos = 0;
+    ULONG i = 0;
+    BOOL result = FALSE;
+    
+    if (!app || !args || argCount == 0) {
+        return FALSE;
+    }
+    
+    /* The arguments were split on spaces - put the line back together */
+    for (i = 0; i < argCount; i++) {
+        while (args[i][pos] != '\0') {
+            pos++;
+        }
+        length += pos + 1;
+        pos = 0;
+    }
+    text = (STRPTR)allocVec(length, MEMF_CLEAR);
+    if (!text) {
+        return FALSE;
+    }
+    for (i = 0; i < argCount; i++) {
+        if (i > 0) {
+            text[pos++] = ' ';
+        }
+        length = 0;
+        while (args[i][length] != '\0') {
+            text[pos++] = args[i][length++];
+        }
+    }
+    
+    result = TTX_ExecRexxString(app, text);
+    freeVec(text);
+    return result;
 }
 
 BOOL TTX_Cmd_FlushARexxCache(struct TTXApplication *app, struct Session *session, STRPTR *args, ULONG argCount)
 {
-    /* TODO: Flush ARexx macro cache */
-    Printf("[CMD] TTX_Cmd_FlushARexxCache: not yet implemented\n");
-    return FALSE;
+    if (!app) {
+        return FALSE;
+    }
+    
+    TTX_FlushRexxCache(app);
+    return TRUE;
 }
 
 BOOL TTX_Cmd_GetARexxCache(struct TTXApplication *app, struct Session *session, STRPTR *args, ULONG argCount)
 {
-    /* TODO: Get ARexx cache state */
-    Printf("[CMD] TTX_Cmd_GetARexxCache: not yet implemented\n");
-    return FALSE;
+    if (!app) {
+        return FALSE;
+    }
+    
+    Printf("[CMD] TTX_Cmd_GetARexxCache: %lu of %lu bytes in %lu macro(s)\n", app->rexxCacheBytes, app->rexxCacheBudget, app->rexxCacheCount);
+    return TTX_SetResultNumber(app, app->rexxCacheBudget);
 }
 
 BOOL TTX_Cmd_GetMacroInfo(struct TTXApplication *app, struct Session *session, STRPTR *args, ULONG argCount)
@@ -3682,37 +4624,147 @@ BOOL TTX_Cmd_GetMacroInfo(struct TTXApplication *app, struct Session *session, S
 
 BOOL TTX_Cmd_OpenMacro(struct TTXApplication *app, struct Session *session, STRPTR *args, ULONG argCount)
 {
-    /* TODO: Open macro file */
-    Printf("[CMD] TTX_Cmd_OpenMacro: not yet implemented\n");
-    return FALSE;
+    STRPTR fileName = NULL;
+    STRPTR selectedFile = NULL;
+    struct TTXMacro *macro = NULL;
+    
+    if (!app || !session) {
+        return FALSE;
+    }
+    
+    if (args && argCount > 0 && args[0]) {
+        fileName = args[0];
+    } else {
+        selectedFile = TTX_ShowFileRequester(app, session, NULL, NULL);
+        if (!selectedFile) {
+            Printf("[CMD] TTX_Cmd_OpenMacro: cancelled or failed\n");
+            return FALSE;
+        }
+        fileName = selectedFile;
+    }
+    
+    macro = LoadMacro(fileName);
+    if (macro) {
+        FreeMacro(app->macro);
+        app->macro = macro;
+        Printf("[CMD] TTX_Cmd_OpenMacro: SUCCESS (loaded '%s')\n", fileName);
+    } else {
+        Printf("[CMD] TTX_Cmd_OpenMacro: FAIL (could not load '%s')\n", fileName);
+    }
+    
+    if (selectedFile) {
+        freeVec(selectedFile);
+    }
+    
+    return (BOOL)(macro != NULL);
 }
 
 BOOL TTX_Cmd_PlayMacro(struct TTXApplication *app, struct Session *session, STRPTR *args, ULONG argCount)
 {
-    /* TODO: Play recorded macro */
-    Printf("[CMD] TTX_Cmd_PlayMacro: not yet implemented\n");
-    return FALSE;
+    LONG repeat = 1;
+    ULONG played = 0;
+    
+    if (!app || !session || !session->buffer) {
+        return FALSE;
+    }
+    if (app->recording || app->macroPlaying) {
+        Printf("[CMD] TTX_Cmd_PlayMacro: FAIL (macro is being recorded or played)\n");
+        return FALSE;
+    }
+    if (!app->macro) {
+        Printf("[CMD] TTX_Cmd_PlayMacro: FAIL (no macro)\n");
+        return FALSE;
+    }
+    
+    /* Optional repeat count */
+    if (args && argCount > 0 && args[0]) {
+        if (StrToLong(args[0], &repeat) < 0 || repeat < 1) {
+            repeat = 1;
+        }
+    }
+    
+    played = PlayMacro(app, session, app->macro, (ULONG)repeat);
+    Printf("[CMD] TTX_Cmd_PlayMacro: played %lu of %ld\n", played, repeat);
+    return (BOOL)(played > 0);
 }
 
 BOOL TTX_Cmd_RecordMacro(struct TTXApplication *app, struct Session *session, STRPTR *args, ULONG argCount)
 {
-    /* TODO: Start macro recording */
-    Printf("[CMD] TTX_Cmd_RecordMacro: not yet implemented\n");
-    return FALSE;
+    if (!app) {
+        return FALSE;
+    }
+    if (app->macroPlaying) {
+        Printf("[CMD] TTX_Cmd_RecordMacro: FAIL (macro is being played)\n");
+        return FALSE;
+    }
+    
+    /* Recording again starts over */
+    FreeMacro(app->recording);
+    app->recording = CreateMacro();
+    if (!app->recording) {
+        Printf("[CMD] TTX_Cmd_RecordMacro: FAIL (out of memory)\n");
+        return FALSE;
+    }
+    
+    Printf("[CMD] TTX_Cmd_RecordMacro: SUCCESS\n");
+    return TRUE;
 }
 
 BOOL TTX_Cmd_SaveMacro(struct TTXApplication *app, struct Session *session, STRPTR *args, ULONG argCount)
 {
-    /* TODO: Save recorded macro */
-    Printf("[CMD] TTX_Cmd_SaveMacro: not yet implemented\n");
-    return FALSE;
+    STRPTR fileName = NULL;
+    STRPTR selectedFile = NULL;
+    BOOL result = FALSE;
+    
+    if (!app || !session) {
+        return FALSE;
+    }
+    if (!app->macro) {
+        Printf("[CMD] TTX_Cmd_SaveMacro: FAIL (no macro)\n");
+        return FALSE;
+    }
+    
+    if (args && argCount > 0 && args[0]) {
+        fileName = args[0];
+    } else {
+        selectedFile = TTX_ShowSaveFileRequester(app, session, NULL, NULL);
+        if (!selectedFile) {
+            Printf("[CMD] TTX_Cmd_SaveMacro: cancelled or failed\n");
+            return FALSE;
+        }
+        fileName = selectedFile;
+    }
+    
+    result = SaveMacro(app->macro, fileName);
+    if (result) {
+        Printf("[CMD] TTX_Cmd_SaveMacro: SUCCESS (saved to '%s')\n", fileName);
+    } else {
+        Printf("[CMD] TTX_Cmd_SaveMacro: FAIL (could not write '%s')\n", fileName);
+    }
+    
+    if (selectedFile) {
+        freeVec(selectedFile);
+    }
+    
+    return result;
 }
 
 BOOL TTX_Cmd_SetARexxCache(struct TTXApplication *app, struct Session *session, STRPTR *args, ULONG argCount)
 {
-    /* TODO: Set ARexx cache state */
-    Printf("[CMD] TTX_Cmd_SetARexxCache: not yet implemented\n");
-    return FALSE;
+    LONG budget = 0;
+    
+    if (!app || !args || argCount == 0 || !args[0]) {
+        return FALSE;
+    }
+    
+    /* Size of the macro cache in bytes - 0 turns caching off */
+    if (StrToLong(args[0], &budget) <= 0 || budget < 0) {
+        Printf("[CMD] TTX_Cmd_SetARexxCache: FAIL (bad size '%s')\n", args[0]);
+        return FALSE;
+    }
+    
+    TTX_SetRexxCacheSize(app, (ULONG)budget);
+    return TRUE;
 }
 
 /* ============================================================================
@@ -3852,9 +4904,11 @@ BOOL TTX_Cmd_GetLockInfo(struct TTXApplication *app, struct Session *session, ST
 
 BOOL TTX_Cmd_GetPort(struct TTXApplication *app, struct Session *session, STRPTR *args, ULONG argCount)
 {
-    /* TODO: Return ARexx port name for ARexx */
-    Printf("[CMD] TTX_Cmd_GetPort: not yet implemented\n");
-    return FALSE;
+    if (!app || !app->rexxPort) {
+        return FALSE;
+    }
+    
+    return TTX_SetResultString(app, TTX_REXX_PORT_NAME);
 }
 
 BOOL TTX_Cmd_GetPriority(struct TTXApplication *app, struct Session *session, STRPTR *args, ULONG argCount)
@@ -3908,9 +4962,43 @@ BOOL TTX_Cmd_SetMeta2(struct TTXApplication *app, struct Session *session, STRPT
 
 BOOL TTX_Cmd_SetMode(struct TTXApplication *app, struct Session *session, STRPTR *args, ULONG argCount)
 {
-    /* TODO: Set editing mode */
-    Printf("[CMD] TTX_Cmd_SetMode: not yet implemented\n");
-    return FALSE;
+    struct Window *window = NULL;
+    BOOL on = FALSE;
+    
+    if (!app || !session || !session->buffer) {
+        return FALSE;
+    }
+    /* SoftWrap [On|Off|Toggle] - no value toggles */
+    if (!args || argCount == 0 || Stricmp(args[0], "SoftWrap") != 0) {
+        Printf("[CMD] TTX_Cmd_SetMode: FAIL (unknown mode)\n");
+        return FALSE;
+    }
+    if (argCount > 1 && Stricmp(args[1], "On") == 0) {
+        on = TRUE;
+    } else if (argCount > 1 && Stricmp(args[1], "Off") == 0) {
+        on = FALSE;
+    } else {
+        on = session->buffer->wrap ? FALSE : TRUE;
+    }
+    
+    window = (session->window != INVALID_RESOURCE) ? session->window : NULL;
+    if (!SetWrap(session->buffer, window, on) ||
+        (session->otherView && !SetWrap(session->otherView, window, on))) {
+        Printf("[CMD] TTX_Cmd_SetMode: FAIL (out of memory)\n");
+        return FALSE;
+    }
+    
+    if (window) {
+        if (session->otherView) {
+            CalculateMaxScroll(session->otherView, window);
+            ScrollToCursor(session->otherView, window);
+        }
+        CalculateMaxScroll(session->buffer, window);
+        ScrollToCursor(session->buffer, window);
+        TTX_RenderViews(session);
+    }
+    Printf("[CMD] TTX_Cmd_SetMode: SUCCESS (softwrap=%ld)\n", on ? 1L : 0L);
+    return TRUE;
 }
 
 BOOL TTX_Cmd_SetMode2(struct TTXApplication *app, struct Session *session, STRPTR *args, ULONG argCount)
@@ -6,6 +6,10 @@
  *
  * Parses TurboText .dfn files to extract menu definitions, keyboard shortcuts,
  * and other configuration data.
+ *
+ * The file is read in a single pass; each line goes to the parser of the
+ * section it is in, and each section is built straight into the structure
+ * it is looked up through (key table, tries, hash table).
  */
 
 #include "ttx.h"
@@ -37,10 +41,151 @@ struct DFNMenu {
     struct DFNMenu *next;    /* Next menu in list */
 };
 
+/* KEYBOARD and MOUSE_BUTTONS bindings, indexed directly by qualifiers and raw key */
+struct DFNKeyTable {
+    struct DFNBinding *keys[DFN_QUAL_COMBOS][DFN_RAWKEY_COUNT];
+};
+
+/* HOT_KEYS entry - a commodity input description and the command it runs */
+struct DFNHotKey {
+    STRPTR description;      /* Commodity input description (allocated) */
+    struct DFNBinding *binding; /* Command to run (allocated) */
+    struct DFNHotKey *next;  /* Next hotkey in file order */
+};
+
+/* TEMPLATES and DICTIONARY trie node - siblings are the alternatives for one character */
+struct DFNTrieNode {
+    struct DFNTrieNode *child;   /* Alternatives for the next character */
+    struct DFNTrieNode *sibling; /* Next alternative for this character */
+    STRPTR value;            /* Template text (allocated, NULL for dictionary words) */
+    UBYTE ch;                /* Character of this node */
+    UBYTE end;               /* A key ends at this node */
+};
+
+/* LINKS entry */
+#define DFN_LINK_HASH_SIZE 32
+struct DFNLink {
+    STRPTR name;             /* Link name (allocated) */
+    STRPTR target;           /* What it links to (allocated) */
+    struct DFNLink *next;    /* Next link in the same hash bucket */
+};
+
 /* Definition file structure */
 struct DFNFile {
     struct DFNMenu *menus;   /* List of menus */
-    /* TODO: Add keyboard, hotkeys, mouse buttons, etc. */
+    struct SyntaxRules *syntax; /* Syntax highlighting rules (may be NULL) */
+    struct DFNKeyTable *keyTable; /* KEYBOARD and MOUSE_BUTTONS bindings (may be NULL) */
+    struct DFNHotKey *hotKeys;    /* HOT_KEYS in file order */
+    struct DFNTrieNode *templates;  /* TEMPLATES by abbreviation */
+    struct DFNTrieNode *dictionary; /* DICTIONARY words */
+    struct DFNLink *links[DFN_LINK_HASH_SIZE]; /* LINKS by name */
+    /* Set when loaded from a compiled cache - everything then lives in one allocation */
+    APTR image;              /* The cache file image holding this structure (NULL = parsed from text) */
+    ULONG syntaxSize;        /* Bytes of the packed syntax rules */
+    ULONG *syntaxRelocs;     /* Offsets of the pointer fields in the packed syntax rules */
+    ULONG syntaxRelocCount;
+};
+
+/* Compiled cache: header, definitions image, its relocations, syntax image, its relocations */
+/* Images hold offsets in place of pointers; the relocation tables list where they are */
+#define DFN_CACHE_MAGIC   0x54545844UL  /* 'TTXD' */
+#define DFN_CACHE_VERSION 2
+#define DFN_CACHE_HEADER_LONGS 15
+#define DFN_CACHE_MAX_BYTES (1024UL * 1024UL)
+#define DFN_CACHE_PATH_MAX 256
+
+/* Sections of a .dfn file */
+#define DFN_SECTION_NONE       0
+#define DFN_SECTION_MENUS      1
+#define DFN_SECTION_KEYBOARD   2
+#define DFN_SECTION_HOTKEYS    3
+#define DFN_SECTION_MOUSE      4
+#define DFN_SECTION_DICTIONARY 5
+#define DFN_SECTION_TEMPLATES  6
+#define DFN_SECTION_LINKS      7
+#define DFN_SECTION_SYNTAX     8
+
+/* Section markers (a # line closes the current section) */
+static struct DFNSectionMarker {
+    STRPTR marker;
+    ULONG length;
+    ULONG section;
+} dfnSections[] = {
+    {"MENUS:", 6, DFN_SECTION_MENUS},
+    {"KEYBOARD:", 9, DFN_SECTION_KEYBOARD},
+    {"HOT_KEYS:", 9, DFN_SECTION_HOTKEYS},
+    {"MOUSE_BUTTONS:", 14, DFN_SECTION_MOUSE},
+    {"DICTIONARY:", 11, DFN_SECTION_DICTIONARY},
+    {"TEMPLATES:", 10, DFN_SECTION_TEMPLATES},
+    {"LINKS:", 6, DFN_SECTION_LINKS},
+    {"SYNTAX:", 7, DFN_SECTION_SYNTAX},
+    {NULL, 0, 0}
+};
+
+/* Qualifier prefixes of a key name, as in Ctrl-Shift-F1 */
+static struct DFNQualifierName {
+    STRPTR name;
+    ULONG length;
+    UBYTE bits;
+} dfnQualifierNames[] = {
+    {"Shift", 5, DFN_QUAL_SHIFT},
+    {"Alt", 3, DFN_QUAL_ALT},
+    {"Ctrl", 4, DFN_QUAL_CTRL},
+    {"Control", 7, DFN_QUAL_CTRL},
+    {"Amiga", 5, DFN_QUAL_AMIGA},
+    {NULL, 0, 0}
+};
+
+/* Keys known by name */
+static struct DFNKeyName {
+    STRPTR name;
+    UBYTE code;
+} dfnKeyNames[] = {
+    {"Space", 0x40}, {"Backspace", 0x41}, {"BS", 0x41}, {"Tab", 0x42},
+    {"Enter", 0x43}, {"Return", 0x44}, {"Esc", 0x45}, {"Escape", 0x45},
+    {"Del", 0x46}, {"Delete", 0x46}, {"Up", 0x4C}, {"Down", 0x4D},
+    {"Right", 0x4E}, {"Left", 0x4F}, {"F1", 0x50}, {"F2", 0x51},
+    {"F3", 0x52}, {"F4", 0x53}, {"F5", 0x54}, {"F6", 0x55},
+    {"F7", 0x56}, {"F8", 0x57}, {"F9", 0x58}, {"F10", 0x59},
+    {"Help", 0x5F}, {"LButton", 0x68}, {"RButton", 0x69}, {"MButton", 0x6A},
+    {NULL, 0}
+};
+
+/* Single-character keys: the main key rows in raw key order */
+static struct DFNKeyRow {
+    STRPTR chars;
+    UBYTE first;
+} dfnKeyRows[] = {
+    {"`1234567890-=\\", 0x00},
+    {"qwertyuiop[]", 0x10},
+    {"asdfghjkl;'", 0x20},
+    {"zxcvbnm,./", 0x31},
+    {NULL, 0}
+};
+
+/* State of the single pass over a .dfn file */
+struct DFNParser {
+    struct DFNFile *dfn;
+    ULONG section;           /* DFN_SECTION_* being read */
+    struct DFNMenu *currentMenu;
+    struct DFNMenuEntry *currentEntry;
+    struct DFNHotKey *lastHotKey;
+    ULONG keyCount;          /* Counts for the summary */
+    ULONG templateCount;
+    ULONG wordCount;
+    ULONG linkCount;
+    struct CleanupStack *stack;
+};
+
+/* Definitions in use (menus, keys, templates...) - shared by all windows */
+static struct DFNFile *g_definitions = NULL;
+
+/* Builds one image - run once with base NULL to size it, then again to fill it */
+struct DFNPacker {
+    UBYTE *base;             /* Image being filled (NULL while sizing) */
+    ULONG used;              /* Bytes laid out so far */
+    ULONG *relocs;           /* Relocation table being filled */
+    ULONG relocCount;        /* Pointer fields laid out so far */
 };
 
 /* Forward declarations */
@@ -49,8 +194,37 @@ static VOID FreeDFNMenu(struct DFNMenu *menu);
 static STRPTR SkipWhitespace(STRPTR line);
 static STRPTR ExtractQuotedString(STRPTR line, STRPTR *outStr, struct CleanupStack *stack);
 static STRPTR ExtractToken(STRPTR line, STRPTR *outStr, struct CleanupStack *stack);
+static STRPTR ExtractCommand(STRPTR line, STRPTR *command, STRPTR **args, ULONG *argCount, struct CleanupStack *stack);
 static BOOL ParseMenuLine(STRPTR line, struct DFNMenuEntry *entry, struct CleanupStack *stack);
-static BOOL ParseDFNMenus(BPTR fileHandle, struct DFNFile *dfn, struct CleanupStack *stack);
+static BOOL ParseMenuSectionLine(struct DFNParser *parser, STRPTR line);
+static STRPTR NextSyntaxToken(STRPTR line, UBYTE *token, ULONG tokenSize);
+static VOID ParseSyntaxLine(STRPTR line, struct SyntaxRules *rules);
+static VOID FreeDFNBinding(struct DFNBinding *binding);
+static VOID FreeDFNTrie(struct DFNTrieNode *node);
+static struct DFNBinding *ParseDFNBinding(STRPTR line, struct CleanupStack *stack);
+static BOOL ParseKeySpec(STRPTR spec, UBYTE *code, UBYTE *qualifiers);
+static BOOL ParseKeyLine(struct DFNParser *parser, STRPTR line);
+static BOOL ParseHotKeyLine(struct DFNParser *parser, STRPTR line);
+static struct DFNTrieNode *AddTrieKey(struct DFNTrieNode **root, STRPTR key, ULONG length);
+static struct DFNTrieNode *FindTrieKey(struct DFNTrieNode *root, STRPTR key, ULONG length);
+static BOOL ParseTemplateLine(struct DFNParser *parser, STRPTR line);
+static BOOL ParseDictionaryLine(struct DFNParser *parser, STRPTR line);
+static ULONG HashDFNName(STRPTR name);
+static BOOL ParseLinkLine(struct DFNParser *parser, STRPTR line);
+static BOOL ParseDFNLine(struct DFNParser *parser, STRPTR line);
+static ULONG PackAlloc(struct DFNPacker *p, ULONG size);
+static APTR PackAt(struct DFNPacker *p, ULONG offset);
+static VOID PackPointer(struct DFNPacker *p, APTR *field, ULONG target);
+static ULONG PackString(struct DFNPacker *p, STRPTR text);
+static ULONG PackBinding(struct DFNPacker *p, struct DFNBinding *binding);
+static ULONG PackTrie(struct DFNPacker *p, struct DFNTrieNode *node);
+static VOID PackDFNFile(struct DFNPacker *p, struct DFNFile *dfn);
+static VOID PackDFNSyntax(struct DFNPacker *p, struct SyntaxRules *rules);
+static BOOL GetDFNSourceStamp(STRPTR fileName, ULONG *stamp);
+static BOOL GetDFNCachePath(STRPTR fileName, STRPTR buffer, ULONG bufferSize);
+static BOOL RelocateDFNImage(UBYTE *image, ULONG size, ULONG *relocs, ULONG relocCount);
+static struct DFNFile *LoadDFNCache(STRPTR cachePath, ULONG *stamp);
+static VOID SaveDFNCache(struct DFNFile *dfn, STRPTR cachePath, ULONG *stamp);
 
 /* Free a menu entry and its allocated strings */
 static VOID FreeDFNMenuEntry(struct DFNMenuEntry *entry)
@@ -108,6 +282,45 @@ static VOID FreeDFNMenu(struct DFNMenu *menu)
     freeVec(menu);
 }
 
+/* Free a key/hotkey binding and its strings */
+static VOID FreeDFNBinding(struct DFNBinding *binding)
+{
+    ULONG i;
+    
+    if (!binding) {
+        return;
+    }
+    
+    if (binding->command) {
+        freeVec(binding->command);
+    }
+    if (binding->args) {
+        for (i = 0; i < binding->argCount; i++) {
+            if (binding->args[i]) {
+                freeVec(binding->args[i]);
+            }
+        }
+        freeVec(binding->args);
+    }
+    freeVec(binding);
+}
+
+/* Free a trie level and everything below it */
+static VOID FreeDFNTrie(struct DFNTrieNode *node)
+{
+    struct DFNTrieNode *nextNode;
+    
+    while (node) {
+        nextNode = node->sibling;
+        FreeDFNTrie(node->child);
+        if (node->value) {
+            freeVec(node->value);
+        }
+        freeVec(node);
+        node = nextNode;
+    }
+}
+
 /* Skip whitespace at the start of a line */
 static STRPTR SkipWhitespace(STRPTR line)
 {
@@ -220,13 +433,61 @@ static STRPTR ExtractToken(STRPTR line, STRPTR *outStr, struct CleanupStack *sta
     return end;
 }
 
+/* Extract a command name and its argument tokens, returning NULL if out of memory */
+static STRPTR ExtractCommand(STRPTR line, STRPTR *command, STRPTR **args, ULONG *argCount, struct CleanupStack *stack)
+{
+    STRPTR p;
+    STRPTR *newArgs;
+    
+    *command = NULL;
+    *args = NULL;
+    *argCount = 0;
+    
+    p = SkipWhitespace(line);
+    if (*p && *p != '\n' && *p != '\r') {
+        p = ExtractToken(p, command, stack);
+        if (!p) {
+            return NULL;
+        }
+    }
+    
+    while (*p && *p != '\n' && *p != '\r') {
+        p = SkipWhitespace(p);
+        if (!*p || *p == '\n' || *p == '\r') {
+            break;
+        }
+        
+        /* Expand args array */
+        newArgs = (STRPTR *)allocVec((*argCount + 1) * sizeof(STRPTR), MEMF_CLEAR);
+        if (!newArgs) {
+            return NULL;
+        }
+        
+        /* Copy existing args */
+        if (*args) {
+            CopyMem(*args, newArgs, *argCount * sizeof(STRPTR));
+            freeVec(*args);
+        }
+        *args = newArgs;
+        
+        /* Extract next argument */
+        p = ExtractToken(p, &newArgs[*argCount], stack);
+        if (!p) {
+            return NULL;
+        }
+        if (!newArgs[*argCount]) {
+            break;
+        }
+        (*argCount)++;
+    }
+    
+    return p;
+}
+
 /* Parse a single menu line (MENU, ITEM, SUB, BAR, SBAR) */
 static BOOL ParseMenuLine(STRPTR line, struct DFNMenuEntry *entry, struct CleanupStack *stack)
 {
     STRPTR p;
-    STRPTR token;
-    ULONG argIdx;
-    STRPTR *newArgs;
     
     if (!line || !entry) {
         return FALSE;
@@ -308,229 +569,1383 @@ static BOOL ParseMenuLine(STRPTR line, struct DFNMenuEntry *entry, struct Cleanu
             p = ExtractToken(p, &entry->shortcut, stack);
         }
         
-        /* Extract command (token) */
-        p = SkipWhitespace(p);
-        if (*p && *p != '\n' && *p != '\r') {
-            p = ExtractToken(p, &entry->command, stack);
-            /* command may be NULL if not present */
-        }
-        
-        /* Extract arguments (remaining tokens) */
-        argIdx = 0;
-        while (*p && *p != '\n' && *p != '\r') {
-            p = SkipWhitespace(p);
-            if (!*p || *p == '\n' || *p == '\r') {
-                break;
-            }
-            
-            /* Expand args array */
-            newArgs = (STRPTR *)allocVec((entry->argCount + 1) * sizeof(STRPTR), MEMF_CLEAR);
-            if (!newArgs) {
-                return FALSE;
-            }
-            
-            /* Copy existing args */
-            if (entry->args) {
-                CopyMem(entry->args, newArgs, entry->argCount * sizeof(STRPTR));
-                freeVec(entry->args);
-            }
-            
-            entry->args = newArgs;
-            
-            /* Extract next argument */
-            p = ExtractToken(p, &entry->args[argIdx], stack);
-            if (!entry->args[argIdx]) {
-                break;
-            }
-            
-            argIdx++;
-            entry->argCount = argIdx;
+        /* Extract command (token, may be absent) and arguments (remaining tokens) */
+        if (!ExtractCommand(p, &entry->command, &entry->args, &entry->argCount, stack)) {
+            return FALSE;
         }
     }
     
     return TRUE;
 }
 
-/* Parse MENUS section from a .dfn file */
-static BOOL ParseDFNMenus(BPTR fileHandle, struct DFNFile *dfn, struct CleanupStack *stack)
+/* Parse one line of the MENUS section into the current menu */
+static BOOL ParseMenuSectionLine(struct DFNParser *parser, STRPTR line)
 {
-    UBYTE lineBuffer[512];
-    STRPTR line;
-    ULONG lineLen;
-    BOOL inMenusSection = FALSE;
-    struct DFNMenu *currentMenu = NULL;
-    struct DFNMenuEntry *currentEntry = NULL;
     struct DFNMenuEntry *newEntry;
-    STRPTR p;
+    struct DFNMenu *menu;
     
-    if (!fileHandle || !dfn) {
+    newEntry = (struct DFNMenuEntry *)allocVec(sizeof(struct DFNMenuEntry), MEMF_CLEAR);
+    if (!newEntry) {
         return FALSE;
     }
     
-    dfn->menus = NULL;
+    if (!ParseMenuLine(line, newEntry, parser->stack)) {
+        FreeDFNMenuEntry(newEntry);
+        return TRUE; /* Skip invalid lines */
+    }
     
-    /* Read file line by line */
-    SetIoErr(0);
-    while (FGets(fileHandle, lineBuffer, sizeof(lineBuffer) - 1) != NULL) {
-        line = lineBuffer;
-        lineLen = 0;
-        
-        /* Calculate line length */
-        while (line[lineLen] != '\0' && line[lineLen] != '\n' && line[lineLen] != '\r' && lineLen < sizeof(lineBuffer) - 1) {
-            lineLen++;
+    /* Handle MENU entry - start new menu */
+    if (newEntry->type == DFN_ENTRY_MENU) {
+        menu = (struct DFNMenu *)allocVec(sizeof(struct DFNMenu), MEMF_CLEAR);
+        if (!menu) {
+            FreeDFNMenuEntry(newEntry);
+            return FALSE;
         }
         
-        /* Remove trailing newline */
-        if (lineLen > 0 && (line[lineLen - 1] == '\n' || line[lineLen - 1] == '\r')) {
-            lineLen--;
-            if (lineLen > 0 && line[lineLen - 1] == '\r') {
-                lineLen--;
-            }
-        }
-        line[lineLen] = '\0';
+        menu->name = newEntry->name;
+        newEntry->name = NULL; /* Transfer ownership */
         
-        /* Skip comments (C-style /* ... */) */
-        /* TODO: Handle comments properly */
+        /* Extract help node if present (stored in shortcut field for MENU entries) */
+        menu->helpNode = newEntry->shortcut;
+        newEntry->shortcut = NULL;
         
-        /* Check for section markers */
-        p = SkipWhitespace(line);
-        /* Use StrnCmp from locale.library for string comparison */
-        /* SC_ASCII (0) provides case-insensitive ASCII comparison */
-        if (StrnCmp(NULL, p, "MENUS:", 6, 0) == 0) {
-            inMenusSection = TRUE;
-            continue;
-        } else if (*p == '#' && inMenusSection) {
-            /* End of MENUS section */
-            break;
-        } else if (StrnCmp(NULL, p, "KEYBOARD:", 9, 0) == 0 || 
-                   StrnCmp(NULL, p, "HOT_KEYS:", 9, 0) == 0 ||
-                   StrnCmp(NULL, p, "MOUSE_BUTTONS:", 14, 0) == 0 ||
-                   StrnCmp(NULL, p, "DICTIONARY:", 11, 0) == 0 ||
-                   StrnCmp(NULL, p, "TEMPLATES:", 10, 0) == 0 ||
-                   StrnCmp(NULL, p, "LINKS:", 6, 0) == 0) {
-            /* Another section starts - end MENUS section */
-            if (inMenusSection) {
-                break;
+        menu->entries = NULL;
+        menu->next = parser->dfn->menus;
+        parser->dfn->menus = menu;
+        
+        FreeDFNMenuEntry(newEntry);
+        parser->currentMenu = menu;
+        parser->currentEntry = NULL;
+        return TRUE;
+    }
+    
+    /* Handle ITEM, SUB, BAR, SBAR entries - add to current menu */
+    if (parser->currentMenu) {
+        if (!parser->currentMenu->entries) {
+            parser->currentMenu->entries = newEntry;
+        } else {
+            parser->currentEntry->next = newEntry;
+        }
+        parser->currentEntry = newEntry;
+    } else {
+        /* Entry without a menu - skip it */
+        FreeDFNMenuEntry(newEntry);
+    }
+    
+    return TRUE;
+}
+
+/* Copy the next token of a SYNTAX line into token - "quoted" tokens may hold spaces */
+static STRPTR NextSyntaxToken(STRPTR line, UBYTE *token, ULONG tokenSize)
+{
+    ULONG len = 0;
+    STRPTR closeQuote = NULL;
+    
+    token[0] = '\0';
+    line = SkipWhitespace(line);
+    if (!line || !*line) {
+        return line;
+    }
+    
+    /* Quoted only if the quote is closed later on the line (a lone " is a token itself) */
+    if (*line == '"') {
+        closeQuote = line + 1;
+        while (*closeQuote && *closeQuote != '"') {
+            closeQuote++;
+        }
+        if (*closeQuote == '"' && closeQuote > line + 1) {
+            line++;
+            while (line < closeQuote && len < tokenSize - 1) {
+                token[len++] = *line++;
             }
-            continue;
+            token[len] = '\0';
+            return closeQuote + 1;
         }
-        
-        if (!inMenusSection) {
-            continue;
+    }
+    
+    while (*line && *line != ' ' && *line != '\t') {
+        if (len < tokenSize - 1) {
+            token[len++] = *line;
         }
-        
-        /* Parse menu line */
-        newEntry = (struct DFNMenuEntry *)allocVec(sizeof(struct DFNMenuEntry), MEMF_CLEAR);
-        if (!newEntry) {
-            return FALSE;
+        line++;
+    }
+    token[len] = '\0';
+    return line;
+}
+
+/* Parse one line of the SYNTAX section:
+ *   KEYWORDS word word ...       (may be repeated)
+ *   LINE_COMMENT //
+ *   BLOCK_COMMENT start end      (delimiters of at most 4 characters each)
+ *   QUOTES ' "
+ *   ESCAPE \
+ *   IGNORE_CASE
+ *   PEN KEYWORD|COMMENT|STRING|NUMBER|TEXT pen
+ */
+static VOID ParseSyntaxLine(STRPTR line, struct SyntaxRules *rules)
+{
+    UBYTE directive[32];
+    UBYTE token[64];
+    STRPTR p;
+    ULONG i;
+    ULONG len;
+    
+    p = NextSyntaxToken(line, directive, sizeof(directive));
+    if (directive[0] == '\0') {
+        return;
+    }
+    
+    if (Stricmp(directive, "KEYWORDS") == 0) {
+        for (;;) {
+            p = NextSyntaxToken(p, token, sizeof(token));
+            if (token[0] == '\0') {
+                break;
+            }
+            AddSyntaxKeyword(rules, token);
         }
-        
-        if (!ParseMenuLine(line, newEntry, stack)) {
-            freeVec(newEntry);
-            continue; /* Skip invalid lines */
+    } else if (Stricmp(directive, "LINE_COMMENT") == 0) {
+        p = NextSyntaxToken(p, token, SYNTAX_DELIM_MAX + 1);
+        CopyMem(token, rules->lineComment, SYNTAX_DELIM_MAX + 1);
+    } else if (Stricmp(directive, "BLOCK_COMMENT") == 0) {
+        p = NextSyntaxToken(p, token, SYNTAX_DELIM_MAX + 1);
+        CopyMem(token, rules->blockStart, SYNTAX_DELIM_MAX + 1);
+        p = NextSyntaxToken(p, token, SYNTAX_DELIM_MAX + 1);
+        CopyMem(token, rules->blockEnd, SYNTAX_DELIM_MAX + 1);
+        if (rules->blockEnd[0] == '\0') {
+            rules->blockStart[0] = '\0';  /* Unterminated comments would swallow the file */
         }
-        
-        /* Handle MENU entry - start new menu */
-        if (newEntry->type == DFN_ENTRY_MENU) {
-            currentMenu = (struct DFNMenu *)allocVec(sizeof(struct DFNMenu), MEMF_CLEAR);
-            if (!currentMenu) {
-                FreeDFNMenuEntry(newEntry);
-                return FALSE;
+    } else if (Stricmp(directive, "QUOTES") == 0) {
+        len = 0;
+        for (;;) {
+            p = NextSyntaxToken(p, token, sizeof(token));
+            if (token[0] == '\0') {
+                break;
             }
-            
-            currentMenu->name = newEntry->name;
-            newEntry->name = NULL; /* Transfer ownership */
-            
-            /* Extract help node if present (stored in shortcut field for MENU entries) */
-            if (newEntry->shortcut) {
-                currentMenu->helpNode = newEntry->shortcut;
-                newEntry->shortcut = NULL;
-            } else {
-                currentMenu->helpNode = NULL;
+            for (i = 0; token[i] != '\0' && len < SYNTAX_DELIM_MAX; i++) {
+                rules->quoteChars[len++] = token[i];
             }
-            
-            currentMenu->entries = NULL;
-            currentMenu->next = dfn->menus;
-            dfn->menus = currentMenu;
-            
-            FreeDFNMenuEntry(newEntry);
-            currentEntry = NULL;
-            continue;
         }
+        rules->quoteChars[len] = '\0';
+    } else if (Stricmp(directive, "ESCAPE") == 0) {
+        p = NextSyntaxToken(p, token, sizeof(token));
+        rules->escapeChar = token[0];
+    } else if (Stricmp(directive, "IGNORE_CASE") == 0) {
+        rules->ignoreCase = TRUE;
+    } else if (Stricmp(directive, "PEN") == 0) {
+        ULONG tokenClass = SYNTAX_TOKEN_COUNT;
+        ULONG pen = 0;
         
-        /* Handle ITEM, SUB, BAR, SBAR entries - add to current menu */
-        if (currentMenu) {
-            if (!currentMenu->entries) {
-                currentMenu->entries = newEntry;
-            } else {
-                currentEntry->next = newEntry;
-            }
-            currentEntry = newEntry;
-        } else {
-            /* Entry without a menu - skip it */
-            FreeDFNMenuEntry(newEntry);
+        p = NextSyntaxToken(p, token, sizeof(token));
+        if (Stricmp(token, "TEXT") == 0) {
+            tokenClass = SYNTAX_TOKEN_TEXT;
+        } else if (Stricmp(token, "KEYWORD") == 0) {
+            tokenClass = SYNTAX_TOKEN_KEYWORD;
+        } else if (Stricmp(token, "COMMENT") == 0) {
+            tokenClass = SYNTAX_TOKEN_COMMENT;
+        } else if (Stricmp(token, "STRING") == 0) {
+            tokenClass = SYNTAX_TOKEN_STRING;
+        } else if (Stricmp(token, "NUMBER") == 0) {
+            tokenClass = SYNTAX_TOKEN_NUMBER;
         }
+        p = NextSyntaxToken(p, token, sizeof(token));
+        for (i = 0; token[i] >= '0' && token[i] <= '9'; i++) {
+            pen = pen * 10 + (token[i] - '0');
+        }
+        if (tokenClass < SYNTAX_TOKEN_COUNT && i > 0 && pen < 256) {
+            rules->pens[tokenClass] = (UBYTE)pen;
+        }
+    } else {
+        Printf("[DFN] ParseSyntaxLine: unknown directive '%s'\n", directive);
     }
-    
-    return TRUE;
 }
 
-/* Parse a .dfn file and return a DFNFile structure */
-struct DFNFile *ParseDFNFile(STRPTR fileName, struct CleanupStack *stack)
+/* Parse a command name and arguments into a new binding (NULL if there is no command) */
+static struct DFNBinding *ParseDFNBinding(STRPTR line, struct CleanupStack *stack)
 {
-    BPTR fileHandle;
-    struct DFNFile *dfn;
+    struct DFNBinding *binding;
     
-    if (!fileName) {
+    binding = (struct DFNBinding *)allocVec(sizeof(struct DFNBinding), MEMF_CLEAR);
+    if (!binding) {
         return NULL;
     }
     
-    /* Open file */
-    fileHandle = Open(fileName, MODE_OLDFILE);
-    if (!fileHandle) {
-        Printf("[DFN] ParseDFNFile: failed to open '%s'\n", fileName);
+    if (!ExtractCommand(line, &binding->command, &binding->args, &binding->argCount, stack) || !binding->command) {
+        FreeDFNBinding(binding);
         return NULL;
     }
     
-    /* Allocate DFN structure */
-    dfn = (struct DFNFile *)allocVec(sizeof(struct DFNFile), MEMF_CLEAR);
-    if (!dfn) {
-        Close(fileHandle);
-        return NULL;
+    return binding;
+}
+
+/* Turn a key name such as Ctrl-Shift-F1, Alt-x or Amiga-LButton into a raw key and qualifiers */
+static BOOL ParseKeySpec(STRPTR spec, UBYTE *code, UBYTE *qualifiers)
+{
+    ULONG i;
+    ULONG j;
+    UBYTE ch;
+    BOOL matched;
+    
+    *qualifiers = 0;
+    
+    /* Qualifier prefixes, each followed by - or + */
+    do {
+        matched = FALSE;
+        for (i = 0; dfnQualifierNames[i].name; i++) {
+            if (StrnCmp(NULL, spec, dfnQualifierNames[i].name, dfnQualifierNames[i].length, 0) == 0 &&
+                (spec[dfnQualifierNames[i].length] == '-' || spec[dfnQualifierNames[i].length] == '+') &&
+                spec[dfnQualifierNames[i].length + 1] != '\0') {
+                *qualifiers |= dfnQualifierNames[i].bits;
+                spec += dfnQualifierNames[i].length + 1;
+                matched = TRUE;
+                break;
+            }
+        }
+    } while (matched);
+    
+    for (i = 0; dfnKeyNames[i].name; i++) {
+        if (Stricmp(spec, dfnKeyNames[i].name) == 0) {
+            *code = dfnKeyNames[i].code;
+            return TRUE;
+        }
     }
     
-    /* Parse MENUS section */
-    if (!ParseDFNMenus(fileHandle, dfn, stack)) {
-        Printf("[DFN] ParseDFNFile: failed to parse MENUS section\n");
-        FreeDFNFile(dfn);
-        Close(fileHandle);
-        return NULL;
+    /* A single character names the key it is printed on */
+    if (spec[0] != '\0' && spec[1] == '\0') {
+        ch = (UBYTE)spec[0];
+        if (ch >= 'A' && ch <= 'Z') {
+            ch += 'a' - 'A';
+        }
+        for (i = 0; dfnKeyRows[i].chars; i++) {
+            for (j = 0; dfnKeyRows[i].chars[j] != '\0'; j++) {
+                if ((UBYTE)dfnKeyRows[i].chars[j] == ch) {
+                    *code = (UBYTE)(dfnKeyRows[i].first + j);
+                    return TRUE;
+                }
+            }
+        }
     }
     
-    Close(fileHandle);
+    return FALSE;
+}
+
+/* Parse one line of the KEYBOARD or MOUSE_BUTTONS section:
+ *   Ctrl-A Command args...
+ *   "Shift-LButton" Command args...
+ */
+static BOOL ParseKeyLine(struct DFNParser *parser, STRPTR line)
+{
+    STRPTR spec = NULL;
+    STRPTR p;
+    struct DFNBinding *binding;
+    struct DFNBinding **slot;
+    UBYTE code = 0;
+    UBYTE qualifiers = 0;
     
-    Printf("[DFN] ParseDFNFile: successfully parsed '%s'\n", fileName);
-    return dfn;
+    if (*line == '"') {
+        p = ExtractQuotedString(line, &spec, parser->stack);
+    } else {
+        p = ExtractToken(line, &spec, parser->stack);
+    }
+    if (!p) {
+        return FALSE;
+    }
+    if (!spec) {
+        return TRUE;
+    }
+    
+    if (!ParseKeySpec(spec, &code, &qualifiers)) {
+        Printf("[DFN] ParseKeyLine: WARN (unknown key '%s')\n", spec);
+        freeVec(spec);
+        return TRUE;
+    }
+    freeVec(spec);
+    
+    binding = ParseDFNBinding(p, parser->stack);
+    if (!binding) {
+        return TRUE;
+    }
+    
+    if (!parser->dfn->keyTable) {
+        parser->dfn->keyTable = (struct DFNKeyTable *)allocVec(sizeof(struct DFNKeyTable), MEMF_CLEAR);
+        if (!parser->dfn->keyTable) {
+            FreeDFNBinding(binding);
+            return FALSE;
+        }
+    }
+    
+    /* A later line for the same key replaces the earlier one */
+    slot = &parser->dfn->keyTable->keys[qualifiers][code];
+    if (*slot) {
+        FreeDFNBinding(*slot);
+    } else {
+        parser->keyCount++;
+    }
+    *slot = binding;
+    return TRUE;
 }
 
-/* Free a DFNFile structure and all its data */
-VOID FreeDFNFile(struct DFNFile *dfn)
+/* Parse one line of the HOT_KEYS section:
+ *   "ctrl alt t" Command args...
+ */
+static BOOL ParseHotKeyLine(struct DFNParser *parser, STRPTR line)
 {
-    struct DFNMenu *menu;
-    struct DFNMenu *nextMenu;
+    STRPTR description = NULL;
+    STRPTR p;
+    struct DFNHotKey *hotKey;
     
-    if (!dfn) {
-        return;
+    p = ExtractQuotedString(line, &description, parser->stack);
+    if (!p) {
+        return FALSE;
+    }
+    if (!description) {
+        return TRUE;
     }
     
-    menu = dfn->menus;
-    while (menu) {
-        nextMenu = menu->next;
-        FreeDFNMenu(menu);
-        menu = nextMenu;
+    hotKey = (struct DFNHotKey *)allocVec(sizeof(struct DFNHotKey), MEMF_CLEAR);
+    if (!hotKey) {
+        freeVec(description);
+        return FALSE;
+    }
+    hotKey->description = description;
+    hotKey->binding = ParseDFNBinding(p, parser->stack);
+    if (!hotKey->binding) {
+        freeVec(description);
+        freeVec(hotKey);
+        return TRUE;
     }
     
-    freeVec(dfn);
+    /* Keep file order - the index of a hotkey is its commodity ID */
+    if (parser->lastHotKey) {
+        parser->lastHotKey->next = hotKey;
+    } else {
+        parser->dfn->hotKeys = hotKey;
+    }
+    parser->lastHotKey = hotKey;
+    return TRUE;
+}
+
+/* Add a key to a trie, returning the node it ends at (NULL if out of memory) */
+static struct DFNTrieNode *AddTrieKey(struct DFNTrieNode **root, STRPTR key, ULONG length)
+{
+    struct DFNTrieNode **level = root;
+    struct DFNTrieNode *node = NULL;
+    ULONG i;
+    
+    for (i = 0; i < length; i++) {
+        for (node = *level; node && node->ch != (UBYTE)key[i]; node = node->sibling) {
+        }
+        if (!node) {
+            node = (struct DFNTrieNode *)allocVec(sizeof(struct DFNTrieNode), MEMF_CLEAR);
+            if (!node) {
+                return NULL;
+            }
+            node->ch = (UBYTE)key[i];
+            node->sibling = *level;
+            *level = node;
+        }
+        level = &node->child;
+    }
+    
+    if (node) {
+        node->end = TRUE;
+    }
+    return node;
+}
+
+/* Find the node a key ends at (NULL if the trie does not hold it) */
+static struct DFNTrieNode *FindTrieKey(struct DFNTrieNode *root, STRPTR key, ULONG length)
+{
+    struct DFNTrieNode *level = root;
+    struct DFNTrieNode *node = NULL;
+    ULONG i;
+    
+    for (i = 0; i < length; i++) {
+        for (node = level; node && node->ch != (UBYTE)key[i]; node = node->sibling) {
+        }
+        if (!node) {
+            return NULL;
+        }
+        level = node->child;
+    }
+    
+    return (node && node->end) ? node : NULL;
+}
+
+/* Parse one line of the TEMPLATES section:
+ *   abbreviation "expansion text"    (\n and \t in the text stand for newline and tab)
+ */
+static BOOL ParseTemplateLine(struct DFNParser *parser, STRPTR line)
+{
+    STRPTR abbrev = NULL;
+    STRPTR text = NULL;
+    STRPTR p;
+    struct DFNTrieNode *node;
+    ULONG length = 0;
+    ULONG i;
+    ULONG j;
+    
+    p = ExtractToken(line, &abbrev, parser->stack);
+    if (!p) {
+        return FALSE;
+    }
+    if (!abbrev) {
+        return TRUE;
+    }
+    p = ExtractQuotedString(p, &text, parser->stack);
+    if (!p || !text) {
+        freeVec(abbrev);
+        return (BOOL)(p != NULL);
+    }
+    
+    /* Expand escapes in place */
+    for (i = 0, j = 0; text[i] != '\0'; i++, j++) {
+        if (text[i] == '\\' && text[i + 1] == 'n') {
+            text[j] = '\n';
+            i++;
+        } else if (text[i] == '\\' && text[i + 1] == 't') {
+            text[j] = '\t';
+            i++;
+        } else if (text[i] == '\\' && text[i + 1] == '\\') {
+            text[j] = '\\';
+            i++;
+        } else {
+            text[j] = text[i];
+        }
+    }
+    text[j] = '\0';
+    
+    while (abbrev[length] != '\0') {
+        length++;
+    }
+    node = AddTrieKey(&parser->dfn->templates, abbrev, length);
+    freeVec(abbrev);
+    if (!node) {
+        freeVec(text);
+        return FALSE;
+    }
+    
+    if (node->value) {
+        freeVec(node->value);
+    } else {
+        parser->templateCount++;
+    }
+    node->value = text;
+    return TRUE;
+}
+
+/* Parse one line of the DICTIONARY section: any number of words */
+static BOOL ParseDictionaryLine(struct DFNParser *parser, STRPTR line)
+{
+    STRPTR start;
+    struct DFNTrieNode *node;
+    
+    for (;;) {
+        line = SkipWhitespace(line);
+        if (!*line) {
+            break;
+        }
+        start = line;
+        while (*line && *line != ' ' && *line != '\t') {
+            line++;
+        }
+        
+        node = FindTrieKey(parser->dfn->dictionary, start, line - start);
+        if (!node) {
+            if (!AddTrieKey(&parser->dfn->dictionary, start, line - start)) {
+                return FALSE;
+            }
+            parser->wordCount++;
+        }
+    }
+    
+    return TRUE;
+}
+
+/* Hash a link name (case-insensitive) */
+static ULONG HashDFNName(STRPTR name)
+{
+    ULONG hash = 0;
+    UBYTE ch;
+    
+    while (*name) {
+        ch = (UBYTE)*name++;
+        if (ch >= 'A' && ch <= 'Z') {
+            ch += 'a' - 'A';
+        }
+        hash = hash * 31 + ch;
+    }
+    
+    return hash % DFN_LINK_HASH_SIZE;
+}
+
+/* Parse one line of the LINKS section:
+ *   name target       (target may be quoted)
+ */
+static BOOL ParseLinkLine(struct DFNParser *parser, STRPTR line)
+{
+    STRPTR name = NULL;
+    STRPTR target = NULL;
+    STRPTR p;
+    struct DFNLink *link;
+    ULONG bucket;
+    
+    p = ExtractToken(line, &name, parser->stack);
+    if (!p) {
+        return FALSE;
+    }
+    if (!name) {
+        return TRUE;
+    }
+    p = SkipWhitespace(p);
+    if (*p == '"') {
+        p = ExtractQuotedString(p, &target, parser->stack);
+    } else {
+        p = ExtractToken(p, &target, parser->stack);
+    }
+    if (!p || !target) {
+        freeVec(name);
+        return (BOOL)(p != NULL);
+    }
+    
+    /* A later line for the same name replaces the earlier one */
+    bucket = HashDFNName(name);
+    for (link = parser->dfn->links[bucket]; link; link = link->next) {
+        if (Stricmp(link->name, name) == 0) {
+            break;
+        }
+    }
+    if (link) {
+        freeVec(name);
+        freeVec(link->target);
+        link->target = target;
+        return TRUE;
+    }
+    
+    link = (struct DFNLink *)allocVec(sizeof(struct DFNLink), MEMF_CLEAR);
+    if (!link) {
+        freeVec(name);
+        freeVec(target);
+        return FALSE;
+    }
+    link->name = name;
+    link->target = target;
+    link->next = parser->dfn->links[bucket];
+    parser->dfn->links[bucket] = link;
+    parser->linkCount++;
+    return TRUE;
+}
+
+/* Hand one line to the parser of the section it is in (FALSE only when out of memory) */
+static BOOL ParseDFNLine(struct DFNParser *parser, STRPTR line)
+{
+    STRPTR p;
+    ULONG i;
+    
+    /* Skip comments (C-style) */
+    /* TODO: Handle comments properly */
+    
+    p = SkipWhitespace(line);
+    
+    /* Use StrnCmp from locale.library for string comparison */
+    /* SC_ASCII (0) provides case-insensitive ASCII comparison */
+    for (i = 0; dfnSections[i].marker; i++) {
+        if (StrnCmp(NULL, p, dfnSections[i].marker, dfnSections[i].length, 0) == 0) {
+            parser->section = dfnSections[i].section;
+            if (parser->section == DFN_SECTION_SYNTAX && !parser->dfn->syntax) {
+                /* Several SYNTAX sections add to the same rules */
+                parser->dfn->syntax = CreateSyntaxRules();
+                if (!parser->dfn->syntax) {
+                    Printf("[DFN] ParseDFNLine: WARN (no memory for SYNTAX rules)\n");
+                    parser->section = DFN_SECTION_NONE;
+                }
+            }
+            return TRUE;
+        }
+    }
+    
+    if (*p == '#') {
+        /* End of the current section */
+        parser->section = DFN_SECTION_NONE;
+        return TRUE;
+    }
+    if (*p == '\0') {
+        return TRUE;
+    }
+    
+    switch (parser->section) {
+        case DFN_SECTION_MENUS:
+            return ParseMenuSectionLine(parser, line);
+            
+        case DFN_SECTION_KEYBOARD:
+        case DFN_SECTION_MOUSE:
+            return ParseKeyLine(parser, p);
+            
+        case DFN_SECTION_HOTKEYS:
+            return ParseHotKeyLine(parser, p);
+            
+        case DFN_SECTION_TEMPLATES:
+            return ParseTemplateLine(parser, p);
+            
+        case DFN_SECTION_DICTIONARY:
+            return ParseDictionaryLine(parser, p);
+            
+        case DFN_SECTION_LINKS:
+            return ParseLinkLine(parser, p);
+            
+        case DFN_SECTION_SYNTAX:
+            ParseSyntaxLine(p, parser->dfn->syntax);
+            return TRUE;
+            
+        default:
+            return TRUE;
+    }
+}
+
+/* Hand the parsed syntax rules to the caller (the DFN no longer frees them) */
+struct SyntaxRules *TakeDFNSyntaxRules(struct DFNFile *dfn)
+{
+    struct SyntaxRules *rules = NULL;
+    ULONG delta = 0;
+    ULONG i = 0;
+    
+    if (!dfn) {
+        return NULL;
+    }
+    
+    /* Rules inside a cache image go with the image - move a copy out in one block */
+    if (dfn->image && dfn->syntax) {
+        rules = (struct SyntaxRules *)allocVec(dfn->syntaxSize, 0);
+        if (rules) {
+            CopyMem(dfn->syntax, rules, dfn->syntaxSize);
+            delta = (ULONG)rules - (ULONG)dfn->syntax;
+            for (i = 0; i < dfn->syntaxRelocCount; i++) {
+                *(ULONG *)((UBYTE *)rules + dfn->syntaxRelocs[i]) += delta;
+            }
+        }
+        dfn->syntax = NULL;
+        return rules;
+    }
+    
+    rules = dfn->syntax;
+    dfn->syntax = NULL;
+    return rules;
+}
+
+/* Parse a .dfn file and return a DFNFile structure */
+struct DFNFile *ParseDFNFile(STRPTR fileName, struct CleanupStack *stack)
+{
+    BPTR fileHandle;
+    struct DFNFile *dfn;
+    struct DFNParser parser;
+    UBYTE lineBuffer[512];
+    ULONG lineLen;
+    ULONG stamp[4];
+    UBYTE cachePath[DFN_CACHE_PATH_MAX];
+    BOOL cacheable = FALSE;
+    
+    if (!fileName) {
+        return NULL;
+    }
+    
+    /* A compiled cache made from this very version of the file skips the parse */
+    cacheable = (BOOL)(GetDFNSourceStamp(fileName, stamp) && GetDFNCachePath(fileName, cachePath, sizeof(cachePath)));
+    if (cacheable) {
+        dfn = LoadDFNCache(cachePath, stamp);
+        if (dfn) {
+            return dfn;
+        }
+    }
+    
+    /* Open file */
+    fileHandle = Open(fileName, MODE_OLDFILE);
+    if (!fileHandle) {
+        Printf("[DFN] ParseDFNFile: failed to open '%s'\n", fileName);
+        return NULL;
+    }
+    
+    /* Allocate DFN structure */
+    dfn = (struct DFNFile *)allocVec(sizeof(struct DFNFile), MEMF_CLEAR);
+    if (!dfn) {
+        Close(fileHandle);
+        return NULL;
+    }
+    
+    parser.dfn = dfn;
+    parser.section = DFN_SECTION_NONE;
+    parser.currentMenu = NULL;
+    parser.currentEntry = NULL;
+    parser.lastHotKey = NULL;
+    parser.keyCount = 0;
+    parser.templateCount = 0;
+    parser.wordCount = 0;
+    parser.linkCount = 0;
+    parser.stack = stack;
+    
+    /* One pass over the file - every section is built as its lines go by */
+    SetIoErr(0);
+    while (FGets(fileHandle, lineBuffer, sizeof(lineBuffer) - 1) != NULL) {
+        lineLen = 0;
+        
+        /* Calculate line length, dropping the newline */
+        while (lineBuffer[lineLen] != '\0' && lineBuffer[lineLen] != '\n' && lineBuffer[lineLen] != '\r' && lineLen < sizeof(lineBuffer) - 1) {
+            lineLen++;
+        }
+        lineBuffer[lineLen] = '\0';
+        
+        if (!ParseDFNLine(&parser, lineBuffer)) {
+            Printf("[DFN] ParseDFNFile: FAIL (out of memory)\n");
+            FreeDFNFile(dfn);
+            Close(fileHandle);
+            return NULL;
+        }
+    }
+    SetIoErr(0);
+    
+    Close(fileHandle);
+    
+    Printf("[DFN] ParseDFNFile: successfully parsed '%s' (%lu keys, %lu templates, %lu words, %lu links, %lu keywords)\n",
+           fileName, parser.keyCount, parser.templateCount, parser.wordCount, parser.linkCount,
+           dfn->syntax ? dfn->syntax->keywordCount : 0UL);
+    if (cacheable) {
+        SaveDFNCache(dfn, cachePath, stamp);
+    }
+    return dfn;
+}
+
+/* Free a DFNFile structure and all its data */
+VOID FreeDFNFile(struct DFNFile *dfn)
+{
+    struct DFNMenu *menu;
+    struct DFNMenu *nextMenu;
+    struct DFNHotKey *hotKey;
+    struct DFNHotKey *nextHotKey;
+    struct DFNLink *link;
+    struct DFNLink *nextLink;
+    ULONG i;
+    ULONG j;
+    
+    if (!dfn) {
+        return;
+    }
+    
+    /* A cache image holds the DFNFile itself and everything it points to */
+    if (dfn->image) {
+        freeVec(dfn->image);
+        return;
+    }
+    
+    menu = dfn->menus;
+    while (menu) {
+        nextMenu = menu->next;
+        FreeDFNMenu(menu);
+        menu = nextMenu;
+    }
+    
+    if (dfn->syntax) {
+        FreeSyntaxRules(dfn->syntax);
+        dfn->syntax = NULL;
+    }
+    
+    if (dfn->keyTable) {
+        for (i = 0; i < DFN_QUAL_COMBOS; i++) {
+            for (j = 0; j < DFN_RAWKEY_COUNT; j++) {
+                FreeDFNBinding(dfn->keyTable->keys[i][j]);
+            }
+        }
+        freeVec(dfn->keyTable);
+    }
+    
+    hotKey = dfn->hotKeys;
+    while (hotKey) {
+        nextHotKey = hotKey->next;
+        freeVec(hotKey->description);
+        FreeDFNBinding(hotKey->binding);
+        freeVec(hotKey);
+        hotKey = nextHotKey;
+    }
+    
+    FreeDFNTrie(dfn->templates);
+    FreeDFNTrie(dfn->dictionary);
+    
+    for (i = 0; i < DFN_LINK_HASH_SIZE; i++) {
+        link = dfn->links[i];
+        while (link) {
+            nextLink = link->next;
+            freeVec(link->name);
+            freeVec(link->target);
+            freeVec(link);
+            link = nextLink;
+        }
+    }
+    
+    freeVec(dfn);
+}
+
+/* Install the definitions shared by all windows, freeing the previous set */
+VOID SetDefinitions(struct DFNFile *dfn)
+{
+    if (g_definitions && g_definitions != dfn) {
+        FreeDFNFile(g_definitions);
+    }
+    g_definitions = dfn;
+}
+
+/* Definitions in use (NULL if none were loaded) */
+struct DFNFile *GetDefinitions(VOID)
+{
+    return g_definitions;
+}
+
+/* Binding of a key table slot (row = DFN_QUAL_* bits, code = raw key) */
+struct DFNBinding *GetDFNKey(struct DFNFile *dfn, ULONG row, ULONG code)
+{
+    if (!dfn || !dfn->keyTable || row >= DFN_QUAL_COMBOS || code >= DFN_RAWKEY_COUNT) {
+        return NULL;
+    }
+    
+    return dfn->keyTable->keys[row][code];
+}
+
+/* Hotkey number index (its commodity ID) and its input description */
+struct DFNBinding *GetDFNHotKey(struct DFNFile *dfn, ULONG index, STRPTR *description)
+{
+    struct DFNHotKey *hotKey = NULL;
+    
+    if (!dfn) {
+        return NULL;
+    }
+    
+    for (hotKey = dfn->hotKeys; hotKey && index > 0; hotKey = hotKey->next) {
+        index--;
+    }
+    if (!hotKey) {
+        return NULL;
+    }
+    
+    if (description) {
+        *description = hotKey->description;
+    }
+    return hotKey->binding;
+}
+
+/* Expansion of a template abbreviation (NULL if there is none) */
+STRPTR FindDFNTemplate(struct DFNFile *dfn, STRPTR abbrev, ULONG length)
+{
+    struct DFNTrieNode *node = NULL;
+    
+    if (!dfn || !abbrev || length == 0) {
+        return NULL;
+    }
+    
+    node = FindTrieKey(dfn->templates, abbrev, length);
+    return node ? node->value : NULL;
+}
+
+/* Check whether the dictionary holds a word (exact case) */
+BOOL IsDFNWord(struct DFNFile *dfn, STRPTR word, ULONG length)
+{
+    if (!dfn || !word || length == 0) {
+        return FALSE;
+    }
+    
+    return (BOOL)(FindTrieKey(dfn->dictionary, word, length) != NULL);
+}
+
+/* Target of a link (NULL if there is no such link) */
+STRPTR FindDFNLink(struct DFNFile *dfn, STRPTR name)
+{
+    struct DFNLink *link = NULL;
+    
+    if (!dfn || !name) {
+        return NULL;
+    }
+    
+    for (link = dfn->links[HashDFNName(name)]; link; link = link->next) {
+        if (Stricmp(link->name, name) == 0) {
+            return link->target;
+        }
+    }
+    
+    return NULL;
+}
+
+/* ============================================================================
+ * Compiled Cache
+ * ============================================================================ */
+
+/* Address of a pointer field in the image being filled (NULL while only sizing it) */
+#define PACK_FIELD(p, field) ((p)->base ? (APTR *)&(field) : (APTR *)NULL)
+
+/* Round an image offset up so structures stay longword aligned */
+static ULONG PackAlloc(struct DFNPacker *p, ULONG size)
+{
+    ULONG offset = 0;
+
+    offset = (p->used + 3) & ~3UL;
+    p->used = offset + size;
+    return offset;
+}
+
+/* Address of an image offset (NULL while sizing) */
+static APTR PackAt(struct DFNPacker *p, ULONG offset)
+{
+    return p->base ? (APTR)(p->base + offset) : NULL;
+}
+
+/* Store an image offset in a pointer field and note the field for relocation */
+static VOID PackPointer(struct DFNPacker *p, APTR *field, ULONG target)
+{
+    if (p->base && field) {
+        *field = (APTR)target;
+        p->relocs[p->relocCount] = (ULONG)((UBYTE *)field - p->base);
+    }
+    p->relocCount++;
+}
+
+/* Copy a string into the image */
+static ULONG PackString(struct DFNPacker *p, STRPTR text)
+{
+    ULONG length = 0;
+    ULONG offset = 0;
+
+    while (text[length] != '\0') {
+        length++;
+    }
+    offset = PackAlloc(p, length + 1);
+    if (p->base) {
+        CopyMem(text, p->base + offset, length + 1);
+    }
+    return offset;
+}
+
+/* Lay a binding out in the image, returning its offset */
+static ULONG PackBinding(struct DFNPacker *p, struct DFNBinding *binding)
+{
+    struct DFNBinding *packedBinding = NULL;
+    ULONG offset = 0;
+    ULONG argsOffset = 0;
+    ULONG i = 0;
+    
+    offset = PackAlloc(p, sizeof(struct DFNBinding));
+    packedBinding = (struct DFNBinding *)PackAt(p, offset);
+    if (packedBinding) {
+        packedBinding->argCount = binding->argCount;
+    }
+    PackPointer(p, PACK_FIELD(p, packedBinding->command), PackString(p, binding->command));
+    if (binding->args && binding->argCount > 0) {
+        argsOffset = PackAlloc(p, binding->argCount * sizeof(STRPTR));
+        PackPointer(p, PACK_FIELD(p, packedBinding->args), argsOffset);
+        for (i = 0; i < binding->argCount; i++) {
+            if (binding->args[i]) {
+                PackPointer(p, p->base ? (APTR *)(p->base + argsOffset + i * sizeof(STRPTR)) : NULL,
+                            PackString(p, binding->args[i]));
+            }
+        }
+    }
+    return offset;
+}
+
+/* Lay a trie level (and everything below it) out in the image, returning the offset of its first node */
+static ULONG PackTrie(struct DFNPacker *p, struct DFNTrieNode *node)
+{
+    struct DFNTrieNode *packedNode = NULL;
+    APTR *link = NULL;
+    ULONG first = 0;
+    ULONG offset = 0;
+    
+    for (; node; node = node->sibling) {
+        offset = PackAlloc(p, sizeof(struct DFNTrieNode));
+        if (first == 0) {
+            first = offset;   /* Offset 0 is the DFNFile, never a node */
+        } else {
+            PackPointer(p, link, offset);
+        }
+        packedNode = (struct DFNTrieNode *)PackAt(p, offset);
+        if (packedNode) {
+            packedNode->ch = node->ch;
+            packedNode->end = node->end;
+        }
+        if (node->value) {
+            PackPointer(p, PACK_FIELD(p, packedNode->value), PackString(p, node->value));
+        }
+        if (node->child) {
+            PackPointer(p, PACK_FIELD(p, packedNode->child), PackTrie(p, node->child));
+        }
+        link = PACK_FIELD(p, packedNode->sibling);
+    }
+    return first;
+}
+
+/* Lay everything but the syntax rules out in an image with the DFNFile at offset 0 */
+static VOID PackDFNFile(struct DFNPacker *p, struct DFNFile *dfn)
+{
+    struct DFNFile *packedDfn = NULL;
+    struct DFNKeyTable *packedTable = NULL;
+    struct DFNHotKey *hotKey = NULL;
+    struct DFNHotKey *packedHotKey = NULL;
+    struct DFNLink *dfnLink = NULL;
+    struct DFNLink *packedLink = NULL;
+    ULONG j = 0;
+    struct DFNMenu *menu = NULL;
+    struct DFNMenu *packedMenu = NULL;
+    struct DFNMenuEntry *entry = NULL;
+    struct DFNMenuEntry *packedEntry = NULL;
+    APTR *link = NULL;
+    APTR *entryLink = NULL;
+    ULONG offset = 0;
+    ULONG argsOffset = 0;
+    ULONG i = 0;
+
+    p->used = 0;
+    p->relocCount = 0;
+    PackAlloc(p, sizeof(struct DFNFile));
+    packedDfn = (struct DFNFile *)PackAt(p, 0);
+    link = PACK_FIELD(p, packedDfn->menus);
+
+    for (menu = dfn->menus; menu; menu = menu->next) {
+        offset = PackAlloc(p, sizeof(struct DFNMenu));
+        PackPointer(p, link, offset);
+        packedMenu = (struct DFNMenu *)PackAt(p, offset);
+        if (menu->name) {
+            PackPointer(p, PACK_FIELD(p, packedMenu->name), PackString(p, menu->name));
+        }
+        if (menu->helpNode) {
+            PackPointer(p, PACK_FIELD(p, packedMenu->helpNode), PackString(p, menu->helpNode));
+        }
+        link = PACK_FIELD(p, packedMenu->next);
+
+        entryLink = PACK_FIELD(p, packedMenu->entries);
+        for (entry = menu->entries; entry; entry = entry->next) {
+            offset = PackAlloc(p, sizeof(struct DFNMenuEntry));
+            PackPointer(p, entryLink, offset);
+            packedEntry = (struct DFNMenuEntry *)PackAt(p, offset);
+            if (packedEntry) {
+                packedEntry->type = entry->type;
+                packedEntry->argCount = entry->argCount;
+            }
+            if (entry->name) {
+                PackPointer(p, PACK_FIELD(p, packedEntry->name), PackString(p, entry->name));
+            }
+            if (entry->shortcut) {
+                PackPointer(p, PACK_FIELD(p, packedEntry->shortcut), PackString(p, entry->shortcut));
+            }
+            if (entry->command) {
+                PackPointer(p, PACK_FIELD(p, packedEntry->command), PackString(p, entry->command));
+            }
+            if (entry->args && entry->argCount > 0) {
+                argsOffset = PackAlloc(p, entry->argCount * sizeof(STRPTR));
+                PackPointer(p, PACK_FIELD(p, packedEntry->args), argsOffset);
+                for (i = 0; i < entry->argCount; i++) {
+                    if (entry->args[i]) {
+                        PackPointer(p, p->base ? (APTR *)(p->base + argsOffset + i * sizeof(STRPTR)) : NULL,
+                                    PackString(p, entry->args[i]));
+                    }
+                }
+            }
+            entryLink = PACK_FIELD(p, packedEntry->next);
+        }
+    }
+    
+    if (dfn->keyTable) {
+        offset = PackAlloc(p, sizeof(struct DFNKeyTable));
+        PackPointer(p, PACK_FIELD(p, packedDfn->keyTable), offset);
+        packedTable = (struct DFNKeyTable *)PackAt(p, offset);
+        for (i = 0; i < DFN_QUAL_COMBOS; i++) {
+            for (j = 0; j < DFN_RAWKEY_COUNT; j++) {
+                if (dfn->keyTable->keys[i][j]) {
+                    PackPointer(p, PACK_FIELD(p, packedTable->keys[i][j]), PackBinding(p, dfn->keyTable->keys[i][j]));
+                }
+            }
+        }
+    }
+    
+    link = PACK_FIELD(p, packedDfn->hotKeys);
+    for (hotKey = dfn->hotKeys; hotKey; hotKey = hotKey->next) {
+        offset = PackAlloc(p, sizeof(struct DFNHotKey));
+        PackPointer(p, link, offset);
+        packedHotKey = (struct DFNHotKey *)PackAt(p, offset);
+        PackPointer(p, PACK_FIELD(p, packedHotKey->description), PackString(p, hotKey->description));
+        PackPointer(p, PACK_FIELD(p, packedHotKey->binding), PackBinding(p, hotKey->binding));
+        link = PACK_FIELD(p, packedHotKey->next);
+    }
+    
+    if (dfn->templates) {
+        PackPointer(p, PACK_FIELD(p, packedDfn->templates), PackTrie(p, dfn->templates));
+    }
+    if (dfn->dictionary) {
+        PackPointer(p, PACK_FIELD(p, packedDfn->dictionary), PackTrie(p, dfn->dictionary));
+    }
+    
+    for (i = 0; i < DFN_LINK_HASH_SIZE; i++) {
+        link = PACK_FIELD(p, packedDfn->links[i]);
+        for (dfnLink = dfn->links[i]; dfnLink; dfnLink = dfnLink->next) {
+            offset = PackAlloc(p, sizeof(struct DFNLink));
+            PackPointer(p, link, offset);
+            packedLink = (struct DFNLink *)PackAt(p, offset);
+            PackPointer(p, PACK_FIELD(p, packedLink->name), PackString(p, dfnLink->name));
+            PackPointer(p, PACK_FIELD(p, packedLink->target), PackString(p, dfnLink->target));
+            link = PACK_FIELD(p, packedLink->next);
+        }
+    }
+}
+
+/* Lay syntax rules out in an image with the SyntaxRules at offset 0 */
+static VOID PackDFNSyntax(struct DFNPacker *p, struct SyntaxRules *rules)
+{
+    struct SyntaxRules *packedRules = NULL;
+    struct SyntaxKeyword *keyword = NULL;
+    struct SyntaxKeyword *packedKeyword = NULL;
+    APTR *link = NULL;
+    ULONG offset = 0;
+    ULONG i = 0;
+
+    p->used = 0;
+    p->relocCount = 0;
+    PackAlloc(p, sizeof(struct SyntaxRules));
+    packedRules = (struct SyntaxRules *)PackAt(p, 0);
+    if (packedRules) {
+        CopyMem(rules, packedRules, sizeof(struct SyntaxRules));
+        for (i = 0; i < SYNTAX_HASH_SIZE; i++) {
+            packedRules->keywords[i] = NULL;
+        }
+        packedRules->packed = TRUE;
+    }
+
+    for (i = 0; i < SYNTAX_HASH_SIZE; i++) {
+        link = PACK_FIELD(p, packedRules->keywords[i]);
+        for (keyword = rules->keywords[i]; keyword; keyword = keyword->next) {
+            offset = PackAlloc(p, sizeof(struct SyntaxKeyword));
+            PackPointer(p, link, offset);
+            packedKeyword = (struct SyntaxKeyword *)PackAt(p, offset);
+            if (packedKeyword) {
+                packedKeyword->length = keyword->length;
+            }
+            PackPointer(p, PACK_FIELD(p, packedKeyword->text), PackString(p, keyword->text));
+            link = PACK_FIELD(p, packedKeyword->next);
+        }
+    }
+}
+
+/* Size and date of a file as the cache key (stamp: size, days, minute, tick) */
+static BOOL GetDFNSourceStamp(STRPTR fileName, ULONG *stamp)
+{
+    BPTR lock = 0;
+    struct FileInfoBlock *fib = NULL;
+    BOOL result = FALSE;
+
+    lock = Lock(fileName, SHARED_LOCK);
+    if (!lock) {
+        SetIoErr(0);
+        return FALSE;
+    }
+    fib = (struct FileInfoBlock *)allocVec(sizeof(struct FileInfoBlock), MEMF_CLEAR);
+    if (fib && Examine(lock, fib)) {
+        stamp[0] = (ULONG)fib->fib_Size;
+        stamp[1] = (ULONG)fib->fib_Date.ds_Days;
+        stamp[2] = (ULONG)fib->fib_Date.ds_Minute;
+        stamp[3] = (ULONG)fib->fib_Date.ds_Tick;
+        result = TRUE;
+    }
+    if (fib) {
+        freeVec(fib);
+    }
+    UnLock(lock);
+    return result;
+}
+
+/* Cache file name: the source name with "c" appended (TTX.dfn -> TTX.dfnc) */
+static BOOL GetDFNCachePath(STRPTR fileName, STRPTR buffer, ULONG bufferSize)
+{
+    ULONG length = 0;
+
+    while (fileName[length] != '\0') {
+        length++;
+    }
+    if (length + 2 > bufferSize) {
+        return FALSE;
+    }
+    CopyMem(fileName, buffer, length);
+    buffer[length] = 'c';
+    buffer[length + 1] = '\0';
+    return TRUE;
+}
+
+/* Check that every relocation of an image lands inside it, then turn offsets into pointers */
+static BOOL RelocateDFNImage(UBYTE *image, ULONG size, ULONG *relocs, ULONG relocCount)
+{
+    ULONG *field = NULL;
+    ULONG i = 0;
+
+    for (i = 0; i < relocCount; i++) {
+        if (relocs[i] > size - sizeof(ULONG) || (relocs[i] & 1)) {
+            return FALSE;
+        }
+        field = (ULONG *)(image + relocs[i]);
+        if (*field >= size) {
+            return FALSE;
+        }
+    }
+    for (i = 0; i < relocCount; i++) {
+        field = (ULONG *)(image + relocs[i]);
+        *field += (ULONG)image;
+    }
+    return TRUE;
+}
+
+/* Load a compiled cache if it matches the source stamp - one Read() and a fix-up pass */
+static struct DFNFile *LoadDFNCache(STRPTR cachePath, ULONG *stamp)
+{
+    BPTR file = 0;
+    ULONG header[DFN_CACHE_HEADER_LONGS];
+    UBYTE *image = NULL;
+    ULONG fileSize = 0;
+    struct DFNFile *dfn = NULL;
+    LONG got = 0;
+
+    file = Open(cachePath, MODE_OLDFILE);
+    if (!file) {
+        SetIoErr(0);
+        return NULL;
+    }
+
+    /* The header gives the size of the whole file, which then comes in one Read() */
+    got = Read(file, header, sizeof(header));
+    if (got != (LONG)sizeof(header) || header[0] != DFN_CACHE_MAGIC || header[1] != DFN_CACHE_VERSION ||
+        header[2] != stamp[0] || header[3] != stamp[1] || header[4] != stamp[2] || header[5] != stamp[3]) {
+        Printf("[DFN] LoadDFNCache: stale or foreign cache '%s'\n", cachePath);
+        Close(file);
+        SetIoErr(0);
+        return NULL;
+    }
+    fileSize = header[6];
+    if (fileSize < sizeof(header) || fileSize > DFN_CACHE_MAX_BYTES) {
+        Close(file);
+        return NULL;
+    }
+    image = (UBYTE *)allocVec(fileSize, 0);
+    if (!image) {
+        Close(file);
+        return NULL;
+    }
+    CopyMem(header, image, sizeof(header));
+    got = Read(file, image + sizeof(header), fileSize - sizeof(header));
+    Close(file);
+    SetIoErr(0);
+    if (got != (LONG)(fileSize - sizeof(header))) {
+        Printf("[DFN] LoadDFNCache: truncated cache '%s'\n", cachePath);
+        freeVec(image);
+        return NULL;
+    }
+
+    /* header[7..10]: definitions image offset, size, reloc table offset, reloc count */
+    /* header[11..14]: the same for the syntax image (size 0 = no syntax rules) */
+    if (((header[7] | header[9] | header[11] | header[13]) & 3) != 0 ||
+        header[7] + header[8] > fileSize || header[8] < sizeof(struct DFNFile) ||
+        header[9] + header[10] * sizeof(ULONG) > fileSize ||
+        header[11] + header[12] > fileSize ||
+        header[13] + header[14] * sizeof(ULONG) > fileSize ||
+        (header[12] != 0 && header[12] < sizeof(struct SyntaxRules)) ||
+        !RelocateDFNImage(image + header[7], header[8], (ULONG *)(image + header[9]), header[10]) ||
+        (header[12] != 0 &&
+         !RelocateDFNImage(image + header[11], header[12], (ULONG *)(image + header[13]), header[14]))) {
+        Printf("[DFN] LoadDFNCache: corrupt cache '%s'\n", cachePath);
+        freeVec(image);
+        return NULL;
+    }
+
+    dfn = (struct DFNFile *)(image + header[7]);
+    dfn->image = image;
+    dfn->syntax = header[12] != 0 ? (struct SyntaxRules *)(image + header[11]) : NULL;
+    dfn->syntaxSize = header[12];
+    dfn->syntaxRelocs = (ULONG *)(image + header[13]);
+    dfn->syntaxRelocCount = header[14];
+
+    Printf("[DFN] LoadDFNCache: loaded '%s' (%lu bytes)\n", cachePath, fileSize);
+    return dfn;
+}
+
+/* Write a parsed definition file out as a compiled cache (a failure only costs the next start a parse) */
+static VOID SaveDFNCache(struct DFNFile *dfn, STRPTR cachePath, ULONG *stamp)
+{
+    struct DFNPacker dfnPack;
+    struct DFNPacker syntaxPack;
+    ULONG *header = NULL;
+    UBYTE *image = NULL;
+    ULONG fileSize = 0;
+    ULONG dfnOffset = 0;
+    ULONG dfnRelocOffset = 0;
+    ULONG syntaxOffset = 0;
+    ULONG syntaxRelocOffset = 0;
+    BPTR file = 0;
+    BOOL written = FALSE;
+
+    dfnPack.base = NULL;
+    dfnPack.relocs = NULL;
+    syntaxPack.base = NULL;
+    syntaxPack.relocs = NULL;
+    syntaxPack.used = 0;
+    syntaxPack.relocCount = 0;
+
+    /* Size both images first */
+    PackDFNFile(&dfnPack, dfn);
+    if (dfn->syntax) {
+        PackDFNSyntax(&syntaxPack, dfn->syntax);
+    }
+
+    dfnOffset = DFN_CACHE_HEADER_LONGS * sizeof(ULONG);
+    dfnRelocOffset = dfnOffset + ((dfnPack.used + 3) & ~3UL);
+    syntaxOffset = dfnRelocOffset + dfnPack.relocCount * sizeof(ULONG);
+    syntaxRelocOffset = syntaxOffset + ((syntaxPack.used + 3) & ~3UL);
+    fileSize = syntaxRelocOffset + syntaxPack.relocCount * sizeof(ULONG);
+    if (fileSize > DFN_CACHE_MAX_BYTES) {
+        return;
+    }
+
+    image = (UBYTE *)allocVec(fileSize, MEMF_CLEAR);
+    if (!image) {
+        return;
+    }
+
+    /* Now fill them in */
+    dfnPack.base = image + dfnOffset;
+    dfnPack.relocs = (ULONG *)(image + dfnRelocOffset);
+    PackDFNFile(&dfnPack, dfn);
+    if (dfn->syntax) {
+        syntaxPack.base = image + syntaxOffset;
+        syntaxPack.relocs = (ULONG *)(image + syntaxRelocOffset);
+        PackDFNSyntax(&syntaxPack, dfn->syntax);
+    }
+
+    header = (ULONG *)image;
+    header[0] = DFN_CACHE_MAGIC;
+    header[1] = DFN_CACHE_VERSION;
+    header[2] = stamp[0];
+    header[3] = stamp[1];
+    header[4] = stamp[2];
+    header[5] = stamp[3];
+    header[6] = fileSize;
+    header[7] = dfnOffset;
+    header[8] = dfnPack.used;
+    header[9] = dfnRelocOffset;
+    header[10] = dfnPack.relocCount;
+    header[11] = syntaxOffset;
+    header[12] = syntaxPack.used;
+    header[13] = syntaxRelocOffset;
+    header[14] = syntaxPack.relocCount;
+
+    file = Open(cachePath, MODE_NEWFILE);
+    if (file) {
+        written = (BOOL)(Write(file, image, fileSize) == (LONG)fileSize);
+        Close(file);
+        if (!written) {
+            /* A short cache would only be rejected - don't leave it behind */
+            DeleteFile(cachePath);
+        }
+    }
+    SetIoErr(0);
+    freeVec(image);
+
+    Printf("[DFN] SaveDFNCache: %s '%s' (%lu bytes)\n", written ? "wrote" : "could not write", cachePath, fileSize);
 }
 
 /* Count total number of NewMenu entries needed for a DFN menu structure */
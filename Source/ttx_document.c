@@ -0,0 +1,657 @@
+/*
+ * TTX - Shared Document Storage
+ *
+ * Copyright (c) 2025 amigazen project
+ * Licensed under BSD 2-Clause License
+ */
+
+#include "ttx.h"
+
+/* Initial number of line slots in a new document */
+#define DOC_INITIAL_LINES 1000
+
+/* All live documents, so sessions opening the same file can find and share them */
+static struct TextDocument *g_documentList = NULL;
+
+/* Nesting depth of open edit batches (0 = edits take effect one by one) */
+static ULONG g_editBatch = 0;
+
+/* Forward declarations */
+static VOID AdjustLineForChange(ULONG *y, ULONG lineY, LONG lineDelta);
+static VOID ClampViewToDocument(struct TextBuffer *view);
+static VOID UpdateLayoutForChange(struct TextDocument *doc, ULONG lineY, LONG lineDelta);
+static VOID InvalidateViewLines(struct TextBuffer *view, ULONG lineY, LONG lineDelta);
+static VOID RefreshView(struct Session *session, struct TextBuffer *view, BOOL active);
+
+/* ============================================================================
+ * Document Lifetime
+ * ============================================================================ */
+
+/* Create a document with a single empty line (not yet attached to any view) */
+struct TextDocument *CreateDocument(struct CleanupStack *stack)
+{
+    struct TextDocument *doc = NULL;
+
+    if (!stack) {
+        Printf("[INIT] CreateDocument: FAIL (stack=NULL)\n");
+        return NULL;
+    }
+
+    doc = (struct TextDocument *)allocVec(sizeof(struct TextDocument), MEMF_CLEAR);
+    if (!doc) {
+        Printf("[INIT] CreateDocument: FAIL (allocVec document failed)\n");
+        return NULL;
+    }
+
+    /* Allocate initial line array */
+    doc->maxLines = DOC_INITIAL_LINES;
+    doc->lines = (struct TextLine *)allocVec(doc->maxLines * sizeof(struct TextLine), MEMF_CLEAR);
+    if (!doc->lines) {
+        Printf("[INIT] CreateDocument: FAIL (allocVec lines failed)\n");
+        freeVec(doc);
+        return NULL;
+    }
+
+    /* Initialize first line */
+    doc->lines[0].allocated = 256;
+    doc->lines[0].text = (STRPTR)allocVec(doc->lines[0].allocated, MEMF_CLEAR);
+    if (!doc->lines[0].text) {
+        Printf("[INIT] CreateDocument: FAIL (allocVec line[0].text failed)\n");
+        freeVec(doc->lines);
+        freeVec(doc);
+        return NULL;
+    }
+    doc->lines[0].text[0] = '\0';
+    doc->lines[0].length = 0;
+
+    doc->lineCount = 1;
+    doc->modified = FALSE;
+    doc->refCount = 0;
+    doc->views = NULL;
+    doc->fileName = NULL;
+    doc->changeCount = 0;
+    doc->layoutValid = FALSE;
+    doc->maxLineLength = 0;
+    doc->maxLineIndex = 0;
+    doc->lexDirtyFrom = 0;
+    doc->statsValid = FALSE;
+    doc->statsChangeCount = 0;
+    /* Whatever is read in is compacted by the first pass */
+    doc->compact.changed = TRUE;
+    doc->compact.first = DOC_CHANGE_ALL;
+    doc->compactLine = 0;
+    doc->journal = NULL;
+
+    /* Add to document list */
+    doc->next = g_documentList;
+    g_documentList = doc;
+
+    Printf("[INIT] CreateDocument: SUCCESS (doc=%lx, lines=%lx)\n", (ULONG)doc, (ULONG)doc->lines);
+    return doc;
+}
+
+/* Free a document and all its lines (only valid once no views are attached) */
+VOID FreeDocument(struct TextDocument *doc, struct CleanupStack *stack)
+{
+    struct TextDocument **link = NULL;
+    ULONG i = 0;
+
+    if (!doc || !stack) {
+        return;
+    }
+
+    Printf("[CLEANUP] FreeDocument: START (doc=%lx, lines=%lu)\n", (ULONG)doc, doc->lineCount);
+
+    /* Closed without saving is a decision, not a crash - nothing to recover */
+    JournalDiscard(doc);
+
+    /* Remove from document list */
+    for (link = &g_documentList; *link; link = &(*link)->next) {
+        if (*link == doc) {
+            *link = doc->next;
+            break;
+        }
+    }
+
+    if (doc->lines) {
+        for (i = 0; i < doc->lineCount; i++) {
+            if (doc->lines[i].text) {
+                freeVec(doc->lines[i].text);
+                doc->lines[i].text = NULL;
+            }
+        }
+        freeVec(doc->lines);
+        doc->lines = NULL;
+    }
+
+    if (doc->fileName) {
+        freeVec(doc->fileName);
+        doc->fileName = NULL;
+    }
+
+    FreeFolds(doc);
+    FreeMarkers(doc);
+    FreeBracketIndex(doc);
+    freeVec(doc);
+    Printf("[CLEANUP] FreeDocument: DONE\n");
+}
+
+/* Find an open document for a file, so a second session can share it */
+struct TextDocument *FindDocument(STRPTR fileName)
+{
+    struct TextDocument *doc = NULL;
+    BPTR fileLock = 0;
+
+    if (!fileName || fileName[0] == '\0') {
+        return NULL;
+    }
+
+    /* Fast path - identical name */
+    for (doc = g_documentList; doc; doc = doc->next) {
+        if (doc->fileName && Stricmp(doc->fileName, fileName) == 0) {
+            return doc;
+        }
+    }
+
+    /* Same file under a different name (assign, relative path) - compare locks */
+    fileLock = Lock(fileName, SHARED_LOCK);
+    if (!fileLock) {
+        SetIoErr(0);
+        return NULL;
+    }
+    for (doc = g_documentList; doc; doc = doc->next) {
+        if (doc->fileName) {
+            BPTR docLock = Lock(doc->fileName, SHARED_LOCK);
+            if (docLock) {
+                LONG same = SameLock(fileLock, docLock);
+                UnLock(docLock);
+                if (same == LOCK_SAME) {
+                    break;
+                }
+            }
+        }
+    }
+    UnLock(fileLock);
+    SetIoErr(0);
+
+    return doc;
+}
+
+/* Record the file a document belongs to (copied) */
+BOOL SetDocumentFileName(struct TextDocument *doc, STRPTR fileName)
+{
+    STRPTR newName = NULL;
+    ULONG len = 0;
+
+    if (!doc) {
+        return FALSE;
+    }
+
+    if (fileName) {
+        while (fileName[len] != '\0') {
+            len++;
+        }
+        newName = (STRPTR)allocVec(len + 1, MEMF_CLEAR);
+        if (!newName) {
+            return FALSE;
+        }
+        CopyMem(fileName, newName, len);
+        newName[len] = '\0';
+    }
+
+    if (doc->fileName) {
+        freeVec(doc->fileName);
+    }
+    doc->fileName = newName;
+    return TRUE;
+}
+
+/* ============================================================================
+ * Views
+ * ============================================================================ */
+
+/* Attach a view to a document */
+VOID AttachDocument(struct TextBuffer *buffer, struct TextDocument *doc)
+{
+    if (!buffer || !doc) {
+        return;
+    }
+
+    buffer->doc = doc;
+    buffer->nextView = doc->views;
+    doc->views = buffer;
+    doc->refCount++;
+
+    /* The view may have been showing a different document */
+    ClampViewToDocument(buffer);
+    WrapLinesChanged(buffer, DOC_CHANGE_ALL, 0);
+    buffer->docChanged = FALSE;
+    buffer->needsFullRedraw = TRUE;
+}
+
+/* Detach a view from its document, freeing the document with its last view */
+VOID DetachDocument(struct TextBuffer *buffer, struct CleanupStack *stack)
+{
+    struct TextDocument *doc = NULL;
+    struct TextBuffer **link = NULL;
+
+    if (!buffer || !buffer->doc) {
+        return;
+    }
+
+    doc = buffer->doc;
+    for (link = &doc->views; *link; link = &(*link)->nextView) {
+        if (*link == buffer) {
+            *link = buffer->nextView;
+            break;
+        }
+    }
+    buffer->nextView = NULL;
+    buffer->doc = NULL;
+
+    if (doc->refCount > 0) {
+        doc->refCount--;
+    }
+    if (doc->refCount == 0) {
+        FreeDocument(doc, stack);
+    }
+}
+
+/* Shift a line position for a change at lineY that added/removed lineDelta lines after it */
+static VOID AdjustLineForChange(ULONG *y, ULONG lineY, LONG lineDelta)
+{
+    if (*y <= lineY || lineDelta == 0) {
+        return;
+    }
+    if (lineDelta > 0) {
+        *y += (ULONG)lineDelta;
+    } else if (*y - lineY <= (ULONG)(-lineDelta)) {
+        /* Position was inside the removed lines - collapse onto the change line */
+        *y = lineY;
+    } else {
+        *y -= (ULONG)(-lineDelta);
+    }
+}
+
+/* Keep a view's cursor, scroll and marking inside its document */
+static VOID ClampViewToDocument(struct TextBuffer *view)
+{
+    struct TextDocument *doc = view->doc;
+    ULONG lastLine = 0;
+
+    if (!doc || doc->lineCount == 0) {
+        return;
+    }
+    lastLine = doc->lineCount - 1;
+
+    if (view->cursorY > lastLine) {
+        view->cursorY = lastLine;
+    }
+    if (view->cursorX > doc->lines[view->cursorY].length) {
+        view->cursorX = doc->lines[view->cursorY].length;
+    }
+    if (view->scrollY > lastLine) {
+        view->scrollY = lastLine;
+    }
+    if (view->marking.enabled) {
+        if (view->marking.startY > lastLine || view->marking.stopY > lastLine) {
+            view->marking.enabled = FALSE;
+        }
+    }
+}
+
+/* Record an edit made through buffer and notify the other views of the document */
+/* lineY is the line the edit happened at; lineDelta lines were inserted (>0) or removed (<0) after it */
+/* lineY == DOC_CHANGE_ALL means the whole document was replaced */
+VOID DocumentChanged(struct TextBuffer *buffer, ULONG lineY, LONG lineDelta)
+{
+    struct TextDocument *doc = NULL;
+    struct TextBuffer *view = NULL;
+    ULONG i = 0;
+
+    if (!buffer || !buffer->doc) {
+        return;
+    }
+
+    doc = buffer->doc;
+    doc->modified = TRUE;
+    doc->changeCount++;
+    if (g_editBatch > 0) {
+        /* Longest line is rescanned and the journal written once, when the batch ends */
+        doc->layoutValid = FALSE;
+        AddLineSpan(&doc->batch, lineY, lineDelta);
+    } else {
+        UpdateLayoutForChange(doc, lineY, lineDelta);
+        JournalChange(doc, lineY, lineDelta);
+    }
+    SyntaxLinesChanged(doc, lineY, lineDelta);
+    BracketLinesChanged(doc, lineY, lineDelta);
+    IdleLinesChanged(doc, lineY, lineDelta);
+    if (lineY == DOC_CHANGE_ALL) {
+        /* Nothing left for a marker (or a fold) to point at */
+        FreeFolds(doc);
+        FreeMarkers(doc);
+    } else {
+        ShiftMarkers(doc, lineY, lineDelta);
+        FoldLinesChanged(doc, lineY, lineDelta);
+        SetDocMark(doc, &doc->lastChange, MARKER_CHANGE, 0, lineY,
+                   buffer->cursorY == lineY ? buffer->cursorX : 0);
+    }
+
+    for (view = doc->views; view; view = view->nextView) {
+        ULONG oldScrollY = 0;
+
+        WrapLinesChanged(view, lineY, lineDelta);
+        if (view == buffer) {
+            continue;
+        }
+        if (lineY == DOC_CHANGE_ALL) {
+            view->cursorX = 0;
+            view->cursorY = 0;
+            view->scrollX = 0;
+            view->scrollY = 0;
+            view->marking.enabled = FALSE;
+            view->caretCount = 0;
+            view->needsFullRedraw = TRUE;
+        } else if (lineDelta != 0) {
+            AdjustLineForChange(&view->cursorY, lineY, lineDelta);
+            AdjustLineForChange(&view->scrollY, lineY, lineDelta);
+            if (view->marking.enabled) {
+                AdjustLineForChange(&view->marking.startY, lineY, lineDelta);
+                AdjustLineForChange(&view->marking.stopY, lineY, lineDelta);
+            }
+            /* The next edit puts carets back in order and inside their lines */
+            for (i = 0; i < view->caretCount; i++) {
+                AdjustLineForChange(&view->carets[i].y, lineY, lineDelta);
+            }
+        }
+        oldScrollY = view->scrollY;
+        ClampViewToDocument(view);
+        if (view->scrollY != oldScrollY) {
+            view->needsFullRedraw = TRUE;
+        } else if (lineY != DOC_CHANGE_ALL) {
+            InvalidateViewLines(view, lineY, lineDelta);
+        }
+        view->docChanged = TRUE;
+    }
+}
+
+/* Mark the lines of a view that an edit at lineY made stale - lines the view does not show are left alone */
+static VOID InvalidateViewLines(struct TextBuffer *view, ULONG lineY, LONG lineDelta)
+{
+    ULONG firstLine = view->scrollY;
+    ULONG endLine = 0;
+    ULONG dirtyEnd = 0;
+
+    if (view->pageH == 0 || (view->wrap && view->wrap->batch.changed)) {
+        /* Never laid out, or its rows are only laid out when the edit batch ends */
+        view->needsFullRedraw = TRUE;
+        return;
+    }
+    endLine = ViewLineAfterRows(view, view->scrollY, view->pageH);
+    if (lineY < firstLine || lineY >= endLine) {
+        /* Edit is above the view (scroll position already followed it) or below it */
+        return;
+    }
+
+    /* A changed line count moves every line below the edit - so may a wrapped line's row count */
+    dirtyEnd = (lineDelta == 0 && !view->wrap) ? lineY + 1 : endLine;
+
+    if (view->dirtyStart == view->dirtyEnd) {
+        view->dirtyStart = lineY;
+        view->dirtyEnd = dirtyEnd;
+    } else {
+        if (lineY < view->dirtyStart) {
+            view->dirtyStart = lineY;
+        }
+        if (dirtyEnd > view->dirtyEnd) {
+            view->dirtyEnd = dirtyEnd;
+        }
+    }
+}
+
+/* ============================================================================
+ * Edit Batches
+ * ============================================================================ */
+
+/* Start coalescing edits - views are not painted until the outermost batch ends */
+VOID BeginEditBatch(VOID)
+{
+    g_editBatch++;
+}
+
+/* End a batch - the outermost one lays out and journals the lines each document had changed in it */
+VOID EndEditBatch(VOID)
+{
+    struct TextDocument *doc = NULL;
+    struct TextBuffer *view = NULL;
+    struct LineSpan *span = NULL;
+
+    if (g_editBatch == 0 || --g_editBatch > 0) {
+        return;
+    }
+
+    for (doc = g_documentList; doc; doc = doc->next) {
+        span = &doc->batch;
+        if (!span->changed) {
+            continue;
+        }
+        span->changed = FALSE;
+        for (view = doc->views; view; view = view->nextView) {
+            WrapBatchEnded(view);
+        }
+        /* A document saved inside the batch needs no journal */
+        if (!doc->modified) {
+            continue;
+        }
+        if (span->first == DOC_CHANGE_ALL) {
+            JournalChange(doc, DOC_CHANGE_ALL, 0);
+        } else {
+            /* The lines were first-(last - delta) before the batch */
+            JournalLines(doc, span->first, (ULONG)((LONG)(span->last - span->first) - span->delta),
+                         span->last - span->first);
+        }
+    }
+}
+
+/* Take an edit into the lines an open batch changed - one span, in the document's numbering
+ * as it is now, so lines the edit moved are followed. Lines it removed leave the span no
+ * smaller than the line the edit was at. */
+VOID AddLineSpan(struct LineSpan *span, ULONG lineY, LONG lineDelta)
+{
+    ULONG last = 0;
+
+    if (lineY == DOC_CHANGE_ALL || (span->changed && span->first == DOC_CHANGE_ALL)) {
+        span->first = DOC_CHANGE_ALL;
+        span->changed = TRUE;
+        return;
+    }
+
+    last = lineY + ((lineDelta > 0) ? (ULONG)lineDelta : 0);
+    if (!span->changed) {
+        span->first = lineY;
+        span->last = last;
+        span->delta = lineDelta;
+        span->changed = TRUE;
+        return;
+    }
+
+    if (span->last > lineY) {
+        if ((LONG)(span->last - lineY) + lineDelta > 0) {
+            span->last = (ULONG)((LONG)span->last + lineDelta);
+        } else {
+            span->last = lineY;
+        }
+    }
+    if (last > span->last) {
+        span->last = last;
+    }
+    if (lineY < span->first) {
+        span->first = lineY;
+    }
+    span->delta += lineDelta;
+}
+
+/* TRUE while edits are being coalesced (painting is left to whoever ends the batch) */
+BOOL InEditBatch(VOID)
+{
+    return (BOOL)(g_editBatch > 0);
+}
+
+/* ============================================================================
+ * Line Layout Cache
+ * ============================================================================ */
+
+/* Keep the longest-line cache in step with an edit, rescanning only when the longest line may have shrunk */
+static VOID UpdateLayoutForChange(struct TextDocument *doc, ULONG lineY, LONG lineDelta)
+{
+    ULONG i = 0;
+    ULONG lastLine = 0;
+
+    if (!doc->layoutValid) {
+        return;
+    }
+    if (lineY == DOC_CHANGE_ALL || lineY >= doc->lineCount) {
+        doc->layoutValid = FALSE;
+        return;
+    }
+
+    /* Follow the longest line if lines were inserted or removed above it */
+    if (doc->maxLineIndex > lineY && lineDelta != 0) {
+        if (lineDelta < 0 && doc->maxLineIndex - lineY <= (ULONG)(-lineDelta)) {
+            /* Longest line was removed */
+            doc->layoutValid = FALSE;
+            return;
+        }
+        doc->maxLineIndex = (ULONG)((LONG)doc->maxLineIndex + lineDelta);
+    }
+
+    /* Longest line was edited and got shorter */
+    if (doc->maxLineIndex == lineY && doc->lines[lineY].length < doc->maxLineLength) {
+        doc->layoutValid = FALSE;
+        return;
+    }
+
+    /* Changed and inserted lines may be the new longest */
+    lastLine = lineY;
+    if (lineDelta > 0) {
+        lastLine += (ULONG)lineDelta;
+    }
+    for (i = lineY; i <= lastLine && i < doc->lineCount; i++) {
+        if (doc->lines[i].length > doc->maxLineLength) {
+            doc->maxLineLength = doc->lines[i].length;
+            doc->maxLineIndex = i;
+        }
+    }
+}
+
+/* Length of the longest line, shared by all views and rescanned only after it was invalidated */
+ULONG GetDocumentMaxLineLength(struct TextDocument *doc)
+{
+    ULONG i = 0;
+
+    if (!doc || !doc->lines) {
+        return 0;
+    }
+
+    if (!doc->layoutValid) {
+        doc->maxLineLength = 0;
+        doc->maxLineIndex = 0;
+        for (i = 0; i < doc->lineCount; i++) {
+            if (doc->lines[i].length > doc->maxLineLength) {
+                doc->maxLineLength = doc->lines[i].length;
+                doc->maxLineIndex = i;
+            }
+        }
+        doc->layoutValid = TRUE;
+    }
+
+    return doc->maxLineLength;
+}
+
+/* ============================================================================
+ * View Refresh
+ * ============================================================================ */
+
+/* Repaint one view after another view changed its document - only stale lines are redrawn */
+static VOID RefreshView(struct Session *session, struct TextBuffer *view, BOOL active)
+{
+    ULONG oldScrollY = 0;
+
+    view->docChanged = FALSE;
+    if (!session->window || session->window == INVALID_RESOURCE) {
+        view->dirtyStart = 0;
+        view->dirtyEnd = 0;
+        return;
+    }
+
+    oldScrollY = view->scrollY;
+    CalculateMaxScroll(view, session->window);
+    if (view->scrollY != oldScrollY) {
+        view->needsFullRedraw = TRUE;
+    }
+    if (active) {
+        UpdateScrollBars(session);
+    }
+    if (view->needsFullRedraw || view->dirtyStart != view->dirtyEnd) {
+        RenderText(session->window, view);
+        if (active) {
+            UpdateCursor(session->window, view);
+        }
+    }
+}
+
+/* Repaint sessions whose document was changed through another view */
+VOID TTX_RefreshDocumentViews(struct TTXApplication *app)
+{
+    struct Session *session = NULL;
+
+    if (!app) {
+        return;
+    }
+
+    for (session = app->sessions; session; session = session->next) {
+        if (!session->buffer || !session->buffer->doc) {
+            continue;
+        }
+        /* Saving through one view clears modified for all of them */
+        session->docState.modified = session->buffer->doc->modified;
+        if (session->buffer->docChanged) {
+            RefreshView(session, session->buffer, TRUE);
+        }
+        if (session->otherView && session->otherView->docChanged) {
+            RefreshView(session, session->otherView, FALSE);
+        }
+    }
+}
+
+/* Paint every view once after an edit batch - the batch may have edited or moved any of them */
+VOID TTX_RepaintSessions(struct TTXApplication *app)
+{
+    struct Session *session = NULL;
+
+    if (!app) {
+        return;
+    }
+
+    for (session = app->sessions; session; session = session->next) {
+        if (!session->buffer) {
+            continue;
+        }
+        session->docState.modified = session->buffer->doc->modified;
+        if (!session->window || session->window == INVALID_RESOURCE) {
+            continue;
+        }
+        session->buffer->needsFullRedraw = TRUE;
+        session->buffer->docChanged = FALSE;
+        if (session->otherView) {
+            session->otherView->needsFullRedraw = TRUE;
+            session->otherView->docChanged = FALSE;
+            CalculateMaxScroll(session->otherView, session->window);
+            ScrollToCursor(session->otherView, session->window);
+        }
+        CalculateMaxScroll(session->buffer, session->window);
+        ScrollToCursor(session->buffer, session->window);
+        TTX_RenderViews(session);
+    }
+}
@@ -0,0 +1,860 @@
+/*
+ * TTX - Folds
+ *
+ * Copyright (c) 2025 amigazen project
+ * Licensed under BSD 2-Clause License
+ *
+ * A fold is a range of lines that can be hidden behind its first line. Folds
+ * nest but never overlap, and belong to the document, so every view of it
+ * shows the same folds. A fold's first and last lines are markers (see
+ * ttx_marker.c), so folds follow edits without being visited.
+ *
+ * Every fold is in an interval tree: a treap ordered by first line (of two
+ * folds with the same first line, the outer one first) where each fold also
+ * points at the fold of its subtree that reaches furthest down. That finds
+ * the folds around a line, or the folds inside a range, without looking at
+ * the others. Edits never reorder it - markers keep their order - and a
+ * pointer to the furthest fold stays right however the lines move.
+ *
+ * The hidden folds that are not inside another hidden fold are the spans:
+ * disjoint runs of hidden lines, each below the line it hides behind. They
+ * are in a second treap over the same nodes, where each span also counts
+ * the lines hidden by its subtree. Screen rows and lines map onto each other
+ * by walking down it, so that costs O(log n) in the number of spans, and
+ * hiding a fold costs the same however many lines it holds. With nothing
+ * hidden a row is simply a line.
+ */
+
+#include "ttx.h"
+
+/* Source of fold priorities */
+static ULONG g_foldSeed = 0x6C078965UL;
+
+/* Forward declarations */
+static ULONG FoldStart(struct TextDocument *doc, struct Fold *fold);
+static ULONG FoldEnd(struct TextDocument *doc, struct Fold *fold);
+static BOOL FoldConflicts(struct TextDocument *doc, struct Fold *node, ULONG y, ULONG startY, ULONG endY);
+static VOID FindShownFold(struct TextDocument *doc, struct Fold *node, ULONG y, struct Fold **found, BOOL *stop);
+static struct Fold *FindFoldIn(struct TextDocument *doc, struct Fold *node, ULONG startY, ULONG endY);
+static VOID HideFoldsIn(struct TextDocument *doc, struct Fold *node, ULONG startY, ULONG endY, BOOL hidden);
+static VOID FixFoldsAt(struct TextDocument *doc, struct Fold *node, ULONG y, struct Fold **empty);
+static VOID RemoveFold(struct TextDocument *doc, struct Fold *fold);
+static VOID FoldsChanged(struct TextBuffer *buffer, ULONG startY, ULONG endY);
+static VOID FreeFoldTree(struct TextDocument *doc, struct Fold *root);
+static VOID InsertFold(struct TextDocument *doc, struct Fold *fold, ULONG startY, ULONG endY);
+static VOID DetachFold(struct TextDocument *doc, struct Fold *fold);
+static VOID SplitFolds(struct TextDocument *doc, struct Fold *root, ULONG startY, ULONG endY,
+                       struct Fold **below, struct Fold **above);
+static struct Fold *MergeFolds(struct TextDocument *doc, struct Fold *a, struct Fold *b);
+static VOID LinkFold(struct TextDocument *doc, struct Fold *fold);
+static struct Fold *FindSpanAt(struct TextDocument *doc, ULONG y);
+static VOID UpdateSpans(struct TextDocument *doc, ULONG startY, ULONG endY);
+static VOID AddSpansIn(struct TextDocument *doc, struct Fold *node, ULONG startY, ULONG endY);
+static VOID AddSpan(struct TextDocument *doc, struct Fold *fold);
+static VOID RemoveSpan(struct TextDocument *doc, struct Fold *fold);
+static VOID DropSpans(struct Fold *root);
+static VOID SplitSpans(struct TextDocument *doc, struct Fold *root, ULONG y, struct Fold **below, struct Fold **above);
+static struct Fold *MergeSpans(struct Fold *a, struct Fold *b);
+static VOID LinkSpan(struct Fold *fold);
+
+/* ============================================================================
+ * Folds
+ * ============================================================================ */
+
+/* Fold lines startY-endY, hidden - NULL if they are not a range of their own
+ * (less than two lines, or overlapping another fold without nesting) or out of memory */
+struct Fold *MakeFold(struct TextBuffer *buffer, ULONG startY, ULONG endY)
+{
+    struct TextDocument *doc = NULL;
+    struct Fold *fold = NULL;
+
+    if (!buffer || !buffer->doc || startY >= endY || endY >= buffer->doc->lineCount) {
+        return NULL;
+    }
+    doc = buffer->doc;
+
+    /* A fold it would overlap holds one of its ends */
+    if (FoldConflicts(doc, doc->folds, startY, startY, endY) ||
+        FoldConflicts(doc, doc->folds, endY, startY, endY)) {
+        return NULL;
+    }
+
+    fold = (struct Fold *)allocVec(sizeof(struct Fold), MEMF_CLEAR);
+    if (!fold) {
+        return NULL;
+    }
+    fold->start = AddMarker(doc, startY, 0, MARKER_FOLD, 0);
+    fold->end = AddMarker(doc, endY, MARKER_EOL, MARKER_FOLD, 0);
+    if (!fold->start || !fold->end) {
+        RemoveMarker(doc, fold->start);
+        RemoveMarker(doc, fold->end);
+        freeVec(fold);
+        return NULL;
+    }
+    g_foldSeed = g_foldSeed * 1664525UL + 1013904223UL;
+    fold->priority = g_foldSeed;
+    InsertFold(doc, fold, startY, endY);
+
+    fold->hidden = TRUE;
+    UpdateSpans(doc, startY, endY);
+    FoldsChanged(buffer, startY, endY);
+    return fold;
+}
+
+/* Remove a fold - its lines show again, unless a fold around it is hidden */
+VOID UnmakeFold(struct TextBuffer *buffer, struct Fold *fold)
+{
+    struct TextDocument *doc = NULL;
+    ULONG startY = 0;
+    ULONG endY = 0;
+
+    if (!buffer || !buffer->doc || !fold) {
+        return;
+    }
+    doc = buffer->doc;
+    GetFoldLines(doc, fold, &startY, &endY);
+    fold->hidden = FALSE;
+    UpdateSpans(doc, startY, endY);
+    RemoveFold(doc, fold);
+    FoldsChanged(buffer, startY, endY);
+}
+
+/* Remove every fold inside lines startY-endY */
+VOID UnmakeFolds(struct TextBuffer *buffer, ULONG startY, ULONG endY)
+{
+    struct TextDocument *doc = NULL;
+    struct Fold *fold = NULL;
+
+    if (!buffer || !buffer->doc || !buffer->doc->folds) {
+        return;
+    }
+    doc = buffer->doc;
+    HideFoldsIn(doc, doc->folds, startY, endY, FALSE);
+    UpdateSpans(doc, startY, endY);
+    while ((fold = FindFoldIn(doc, doc->folds, startY, endY)) != NULL) {
+        RemoveFold(doc, fold);
+    }
+    FoldsChanged(buffer, startY, endY);
+}
+
+/* Hide or show one fold - the folds inside it keep their own state */
+VOID SetFoldHidden(struct TextBuffer *buffer, struct Fold *fold, BOOL hidden)
+{
+    ULONG startY = 0;
+    ULONG endY = 0;
+
+    if (!buffer || !buffer->doc || !fold || fold->hidden == hidden) {
+        return;
+    }
+    GetFoldLines(buffer->doc, fold, &startY, &endY);
+    fold->hidden = hidden;
+    UpdateSpans(buffer->doc, startY, endY);
+    FoldsChanged(buffer, startY, endY);
+}
+
+/* Hide or show every fold inside lines startY-endY */
+VOID SetFoldsHidden(struct TextBuffer *buffer, ULONG startY, ULONG endY, BOOL hidden)
+{
+    if (!buffer || !buffer->doc || !buffer->doc->folds) {
+        return;
+    }
+    HideFoldsIn(buffer->doc, buffer->doc->folds, startY, endY, hidden);
+    UpdateSpans(buffer->doc, startY, endY);
+    FoldsChanged(buffer, startY, endY);
+}
+
+/* Innermost fold around line y that shows its lines - NULL if there is none */
+struct Fold *GetFoldAt(struct TextDocument *doc, ULONG y)
+{
+    struct Fold *found = NULL;
+    BOOL stop = FALSE;
+
+    if (!doc) {
+        return NULL;
+    }
+    FindShownFold(doc, doc->folds, y, &found, &stop);
+    return found;
+}
+
+/* Outermost hidden fold behind line y - NULL if no lines hide behind it */
+struct Fold *GetHiddenFoldAt(struct TextDocument *doc, ULONG y)
+{
+    struct Fold *span = NULL;
+    ULONG startY = 0;
+
+    if (!doc) {
+        return NULL;
+    }
+    span = doc->spans;
+    while (span) {
+        startY = FoldStart(doc, span);
+        if (y == startY) {
+            return span;
+        }
+        span = (y < startY) ? span->spanLeft : span->spanRight;
+    }
+    return NULL;
+}
+
+/* First and last line of a fold */
+VOID GetFoldLines(struct TextDocument *doc, struct Fold *fold, ULONG *startY, ULONG *endY)
+{
+    *startY = FoldStart(doc, fold);
+    *endY = FoldEnd(doc, fold);
+}
+
+/* Show the folds that hide line y */
+VOID RevealLine(struct TextBuffer *buffer, ULONG y)
+{
+    struct Fold *span = NULL;
+    ULONG startY = 0;
+    ULONG endY = 0;
+    ULONG shownStart = 0;
+    ULONG shownEnd = 0;
+    BOOL changed = FALSE;
+
+    if (!buffer || !buffer->doc) {
+        return;
+    }
+    /* Each fold shown may leave a hidden one inside it around the line */
+    while ((span = FindSpanAt(buffer->doc, y)) != NULL) {
+        GetFoldLines(buffer->doc, span, &startY, &endY);
+        span->hidden = FALSE;
+        UpdateSpans(buffer->doc, startY, endY);
+        /* The first fold shown is the outermost - it holds the others */
+        if (!changed) {
+            shownStart = startY;
+            shownEnd = endY;
+        }
+        changed = TRUE;
+    }
+    if (changed) {
+        FoldsChanged(buffer, shownStart, shownEnd);
+    }
+}
+
+/* Is line y inside a hidden fold (below the line the fold hides behind)? */
+BOOL IsLineHidden(struct TextDocument *doc, ULONG y)
+{
+    if (!doc || !doc->spans) {
+        return FALSE;
+    }
+    return (BOOL)(FindSpanAt(doc, y) != NULL);
+}
+
+/* Screen row of line y counted from the top of the document - a hidden line has the row of its fold */
+ULONG LineToRow(struct TextDocument *doc, ULONG y)
+{
+    struct Fold *span = NULL;
+    ULONG hidden = 0;  /* Lines hidden by the spans before the subtree searched */
+    ULONG leftTotal = 0;
+    ULONG startY = 0;
+
+    if (!doc) {
+        return y;
+    }
+    span = doc->spans;
+    while (span) {
+        leftTotal = span->spanLeft ? span->spanLeft->spanTotal : 0;
+        startY = FoldStart(doc, span);
+        if (y <= startY) {
+            span = span->spanLeft;
+        } else if (y > startY + span->spanLines) {
+            hidden += leftTotal + span->spanLines;
+            span = span->spanRight;
+        } else {
+            return startY - hidden - leftTotal;
+        }
+    }
+    return y - hidden;
+}
+
+/* Line shown on a screen row counted from the top of the document */
+ULONG RowToLine(struct TextDocument *doc, ULONG row)
+{
+    struct Fold *span = NULL;
+    ULONG hidden = 0;  /* Lines hidden by the spans before the subtree searched */
+    ULONG leftTotal = 0;
+    ULONG y = 0;
+
+    if (!doc) {
+        return row;
+    }
+    span = doc->spans;
+    while (span) {
+        leftTotal = span->spanLeft ? span->spanLeft->spanTotal : 0;
+        if (row <= FoldStart(doc, span) - hidden - leftTotal) {
+            span = span->spanLeft;
+        } else {
+            hidden += leftTotal + span->spanLines;
+            span = span->spanRight;
+        }
+    }
+    y = row + hidden;
+    if (doc->lineCount > 0 && y >= doc->lineCount) {
+        y = doc->lineCount - 1;
+    }
+    return y;
+}
+
+/* Rows the document takes on screen */
+ULONG GetRowCount(struct TextDocument *doc)
+{
+    if (!doc) {
+        return 0;
+    }
+    return doc->lineCount - (doc->spans ? doc->spans->spanTotal : 0);
+}
+
+/* Line shown the given number of rows below line y - lineCount once that is past the end */
+ULONG LineAfterRows(struct TextDocument *doc, ULONG y, ULONG rows)
+{
+    ULONG row = 0;
+
+    if (!doc) {
+        return y + rows;
+    }
+    if (!doc->spans) {
+        return (y + rows < doc->lineCount) ? y + rows : doc->lineCount;
+    }
+    row = LineToRow(doc, y) + rows;
+    if (row >= GetRowCount(doc)) {
+        return doc->lineCount;
+    }
+    return RowToLine(doc, row);
+}
+
+/* Follow lineDelta lines inserted (>0) or removed (<0) after lineY - the markers have already moved,
+ * so only the folds around lineY changed length, and folds whose lines all went are removed */
+VOID FoldLinesChanged(struct TextDocument *doc, ULONG lineY, LONG lineDelta)
+{
+    struct Fold *empty = NULL;
+    struct Fold *next = NULL;
+
+    if (!doc || !doc->folds || lineDelta == 0 || lineY == DOC_CHANGE_ALL) {
+        return;
+    }
+    FixFoldsAt(doc, doc->folds, lineY, &empty);
+    while (empty) {
+        next = empty->next;
+        RemoveFold(doc, empty);
+        empty = next;
+    }
+}
+
+/* Free every fold of a document */
+VOID FreeFolds(struct TextDocument *doc)
+{
+    if (!doc) {
+        return;
+    }
+    FreeFoldTree(doc, doc->folds);
+    doc->folds = NULL;
+    doc->spans = NULL;
+}
+
+/* ============================================================================
+ * Fold Lookups
+ * ============================================================================ */
+
+static ULONG FoldStart(struct TextDocument *doc, struct Fold *fold)
+{
+    ULONG y = 0;
+    ULONG x = 0;
+
+    GetMarkerPosition(doc, fold->start, &y, &x);
+    return y;
+}
+
+static ULONG FoldEnd(struct TextDocument *doc, struct Fold *fold)
+{
+    ULONG y = 0;
+    ULONG x = 0;
+
+    GetMarkerPosition(doc, fold->end, &y, &x);
+    return y;
+}
+
+/* Does a fold around line y overlap lines startY-endY without nesting (or hold exactly them)? */
+static BOOL FoldConflicts(struct TextDocument *doc, struct Fold *node, ULONG y, ULONG startY, ULONG endY)
+{
+    ULONG foldStart = 0;
+    ULONG foldEnd = 0;
+
+    if (!node || FoldEnd(doc, node->reach) < y) {
+        return FALSE;
+    }
+    if (FoldConflicts(doc, node->left, y, startY, endY)) {
+        return TRUE;
+    }
+    foldStart = FoldStart(doc, node);
+    if (foldStart > y) {
+        return FALSE;
+    }
+    foldEnd = FoldEnd(doc, node);
+    if (foldEnd >= y) {
+        if ((foldStart == startY && foldEnd == endY) ||
+            !((foldStart <= startY && endY <= foldEnd) || (startY <= foldStart && foldEnd <= endY))) {
+            return TRUE;
+        }
+    }
+    return FoldConflicts(doc, node->right, y, startY, endY);
+}
+
+/* Walk the folds around line y outside in, up to the first hidden one */
+static VOID FindShownFold(struct TextDocument *doc, struct Fold *node, ULONG y, struct Fold **found, BOOL *stop)
+{
+    if (!node || *stop || FoldEnd(doc, node->reach) < y) {
+        return;
+    }
+    FindShownFold(doc, node->left, y, found, stop);
+    if (*stop || FoldStart(doc, node) > y) {
+        return;
+    }
+    if (FoldEnd(doc, node) >= y) {
+        if (node->hidden) {
+            /* Everything further in is hidden with it */
+            *stop = TRUE;
+            return;
+        }
+        *found = node;
+    }
+    FindShownFold(doc, node->right, y, found, stop);
+}
+
+/* First fold inside lines startY-endY */
+static struct Fold *FindFoldIn(struct TextDocument *doc, struct Fold *node, ULONG startY, ULONG endY)
+{
+    struct Fold *found = NULL;
+    ULONG foldStart = 0;
+
+    if (!node) {
+        return NULL;
+    }
+    foldStart = FoldStart(doc, node);
+    if (foldStart >= startY) {
+        found = FindFoldIn(doc, node->left, startY, endY);
+        if (found) {
+            return found;
+        }
+        if (foldStart <= endY && FoldEnd(doc, node) <= endY) {
+            return node;
+        }
+    }
+    if (foldStart <= endY) {
+        return FindFoldIn(doc, node->right, startY, endY);
+    }
+    return NULL;
+}
+
+/* Set the state of every fold inside lines startY-endY (the spans are left to the caller) */
+static VOID HideFoldsIn(struct TextDocument *doc, struct Fold *node, ULONG startY, ULONG endY, BOOL hidden)
+{
+    ULONG foldStart = 0;
+
+    if (!node) {
+        return;
+    }
+    foldStart = FoldStart(doc, node);
+    if (foldStart >= startY) {
+        HideFoldsIn(doc, node->left, startY, endY, hidden);
+        if (foldStart <= endY && FoldEnd(doc, node) <= endY) {
+            node->hidden = hidden;
+        }
+    }
+    if (foldStart <= endY) {
+        HideFoldsIn(doc, node->right, startY, endY, hidden);
+    }
+}
+
+/* Recount the spans around line y and list the folds left without lines */
+static VOID FixFoldsAt(struct TextDocument *doc, struct Fold *node, ULONG y, struct Fold **empty)
+{
+    ULONG foldStart = 0;
+    ULONG foldEnd = 0;
+    struct Fold *span = NULL;
+
+    if (!node || FoldEnd(doc, node->reach) < y) {
+        return;
+    }
+    FixFoldsAt(doc, node->left, y, empty);
+    foldStart = FoldStart(doc, node);
+    if (foldStart > y) {
+        return;
+    }
+    foldEnd = FoldEnd(doc, node);
+    if (foldEnd >= y) {
+        if (foldEnd <= foldStart) {
+            node->next = *empty;
+            *empty = node;
+        } else if (node->span && node->spanLines != foldEnd - foldStart) {
+            node->spanLines = foldEnd - foldStart;
+            for (span = node; span; span = span->spanParent) {
+                LinkSpan(span);
+            }
+        }
+    }
+    FixFoldsAt(doc, node->right, y, empty);
+}
+
+/* ============================================================================
+ * Fold Tree
+ * ============================================================================ */
+
+/* Take a fold out of both trees and free it with its markers - whatever it hid is shown */
+static VOID RemoveFold(struct TextDocument *doc, struct Fold *fold)
+{
+    if (fold->span) {
+        RemoveSpan(doc, fold);
+    }
+    DetachFold(doc, fold);
+    RemoveMarker(doc, fold->start);
+    RemoveMarker(doc, fold->end);
+    freeVec(fold);
+}
+
+/* Repaint every view of the document after folds in lines startY-endY changed, and move their
+ * cursors off lines that were just hidden */
+static VOID FoldsChanged(struct TextBuffer *buffer, ULONG startY, ULONG endY)
+{
+    struct TextDocument *doc = buffer->doc;
+    struct TextBuffer *view = NULL;
+
+    for (view = doc->views; view; view = view->nextView) {
+        if (IsLineHidden(doc, view->cursorY)) {
+            view->cursorY = RowToLine(doc, LineToRow(doc, view->cursorY));
+            if (view->cursorX > doc->lines[view->cursorY].length) {
+                view->cursorX = doc->lines[view->cursorY].length;
+            }
+        }
+        if (IsLineHidden(doc, view->scrollY)) {
+            view->scrollY = RowToLine(doc, LineToRow(doc, view->scrollY));
+        }
+        WrapFoldsChanged(view, startY, endY);
+        view->needsFullRedraw = TRUE;
+        if (view != buffer) {
+            view->docChanged = TRUE;
+        }
+    }
+}
+
+static VOID FreeFoldTree(struct TextDocument *doc, struct Fold *root)
+{
+    if (!root) {
+        return;
+    }
+    FreeFoldTree(doc, root->left);
+    FreeFoldTree(doc, root->right);
+    RemoveMarker(doc, root->start);
+    RemoveMarker(doc, root->end);
+    freeVec(root);
+}
+
+/* Add a fold in its place - after the folds around it */
+static VOID InsertFold(struct TextDocument *doc, struct Fold *fold, ULONG startY, ULONG endY)
+{
+    struct Fold *below = NULL;
+    struct Fold *above = NULL;
+
+    fold->left = NULL;
+    fold->right = NULL;
+    fold->parent = NULL;
+    fold->reach = fold;
+
+    SplitFolds(doc, doc->folds, startY, endY, &below, &above);
+    doc->folds = MergeFolds(doc, MergeFolds(doc, below, fold), above);
+}
+
+/* Take a fold out of the interval tree */
+static VOID DetachFold(struct TextDocument *doc, struct Fold *fold)
+{
+    struct Fold *parent = fold->parent;
+    struct Fold *rest = NULL;
+
+    rest = MergeFolds(doc, fold->left, fold->right);
+    if (rest) {
+        rest->parent = parent;
+    }
+    if (!parent) {
+        doc->folds = rest;
+    } else if (parent->left == fold) {
+        parent->left = rest;
+    } else {
+        parent->right = rest;
+    }
+    /* The folds above it may have reached furthest through it */
+    for (; parent; parent = parent->parent) {
+        LinkFold(doc, parent);
+    }
+    fold->left = NULL;
+    fold->right = NULL;
+    fold->parent = NULL;
+}
+
+/* Split a tree into the folds before one of lines startY-endY (and those around it) and the rest */
+static VOID SplitFolds(struct TextDocument *doc, struct Fold *root, ULONG startY, ULONG endY,
+                       struct Fold **below, struct Fold **above)
+{
+    ULONG foldStart = 0;
+
+    if (!root) {
+        *below = NULL;
+        *above = NULL;
+        return;
+    }
+
+    foldStart = FoldStart(doc, root);
+    if (foldStart < startY || (foldStart == startY && FoldEnd(doc, root) >= endY)) {
+        SplitFolds(doc, root->right, startY, endY, &root->right, above);
+        LinkFold(doc, root);
+        *below = root;
+    } else {
+        SplitFolds(doc, root->left, startY, endY, below, &root->left);
+        LinkFold(doc, root);
+        *above = root;
+    }
+    if (*below) {
+        (*below)->parent = NULL;
+    }
+    if (*above) {
+        (*above)->parent = NULL;
+    }
+}
+
+/* Join two trees, every fold of a before every fold of b */
+static struct Fold *MergeFolds(struct TextDocument *doc, struct Fold *a, struct Fold *b)
+{
+    struct Fold *root = NULL;
+
+    if (!a) {
+        root = b;
+    } else if (!b) {
+        root = a;
+    } else if (a->priority > b->priority) {
+        a->right = MergeFolds(doc, a->right, b);
+        LinkFold(doc, a);
+        root = a;
+    } else {
+        b->left = MergeFolds(doc, a, b->left);
+        LinkFold(doc, b);
+        root = b;
+    }
+    if (root) {
+        root->parent = NULL;
+    }
+    return root;
+}
+
+/* Point a fold's children back at it and find the furthest reach of its subtree */
+static VOID LinkFold(struct TextDocument *doc, struct Fold *fold)
+{
+    ULONG reachEnd = FoldEnd(doc, fold);
+
+    fold->reach = fold;
+    if (fold->left) {
+        fold->left->parent = fold;
+        if (FoldEnd(doc, fold->left->reach) > reachEnd) {
+            fold->reach = fold->left->reach;
+            reachEnd = FoldEnd(doc, fold->reach);
+        }
+    }
+    if (fold->right) {
+        fold->right->parent = fold;
+        if (FoldEnd(doc, fold->right->reach) > reachEnd) {
+            fold->reach = fold->right->reach;
+        }
+    }
+}
+
+/* ============================================================================
+ * Span Tree
+ * ============================================================================ */
+
+/* Span whose hidden lines hold line y - NULL if the line shows */
+static struct Fold *FindSpanAt(struct TextDocument *doc, ULONG y)
+{
+    struct Fold *span = doc->spans;
+    ULONG startY = 0;
+
+    while (span) {
+        startY = FoldStart(doc, span);
+        if (y <= startY) {
+            span = span->spanLeft;
+        } else if (y > startY + span->spanLines) {
+            span = span->spanRight;
+        } else {
+            return span;
+        }
+    }
+    return NULL;
+}
+
+/* Folds inside lines startY-endY changed state - replace the spans there */
+static VOID UpdateSpans(struct TextDocument *doc, ULONG startY, ULONG endY)
+{
+    struct Fold *span = NULL;
+    struct Fold *below = NULL;
+    struct Fold *inside = NULL;
+    struct Fold *above = NULL;
+
+    /* Inside a hidden fold that stays hidden - nothing more shows or hides */
+    span = FindSpanAt(doc, endY);
+    if (span && FoldStart(doc, span) < startY) {
+        return;
+    }
+
+    /* A span from endY on can only share its first line with the range */
+    SplitSpans(doc, doc->spans, startY, &below, &inside);
+    SplitSpans(doc, inside, endY, &inside, &above);
+    DropSpans(inside);
+    doc->spans = MergeSpans(below, above);
+    AddSpansIn(doc, doc->folds, startY, endY);
+}
+
+/* Make spans of the hidden folds starting on lines startY-endY that no span holds, in line order */
+static VOID AddSpansIn(struct TextDocument *doc, struct Fold *node, ULONG startY, ULONG endY)
+{
+    struct Fold *span = NULL;
+    ULONG foldStart = 0;
+    ULONG foldEnd = 0;
+
+    if (!node) {
+        return;
+    }
+    foldStart = FoldStart(doc, node);
+    if (foldStart >= startY) {
+        AddSpansIn(doc, node->left, startY, endY);
+        if (node->hidden && foldStart < endY) {
+            foldEnd = FoldEnd(doc, node);
+            /* Folds inside a span (one added before it, or one around the range) are hidden with it */
+            span = FindSpanAt(doc, foldEnd);
+            if (foldEnd > foldStart && (!span || FoldStart(doc, span) > foldStart)) {
+                AddSpan(doc, node);
+            }
+        }
+    }
+    if (foldStart < endY) {
+        AddSpansIn(doc, node->right, startY, endY);
+    }
+}
+
+static VOID AddSpan(struct TextDocument *doc, struct Fold *fold)
+{
+    struct Fold *below = NULL;
+    struct Fold *above = NULL;
+    ULONG startY = FoldStart(doc, fold);
+
+    fold->spanLeft = NULL;
+    fold->spanRight = NULL;
+    fold->spanParent = NULL;
+    fold->spanLines = FoldEnd(doc, fold) - startY;
+    fold->spanTotal = fold->spanLines;
+    fold->span = TRUE;
+
+    SplitSpans(doc, doc->spans, startY, &below, &above);
+    doc->spans = MergeSpans(MergeSpans(below, fold), above);
+}
+
+/* Take a span out of the span tree - its lines show */
+static VOID RemoveSpan(struct TextDocument *doc, struct Fold *fold)
+{
+    struct Fold *parent = fold->spanParent;
+    struct Fold *rest = NULL;
+
+    rest = MergeSpans(fold->spanLeft, fold->spanRight);
+    if (rest) {
+        rest->spanParent = parent;
+    }
+    if (!parent) {
+        doc->spans = rest;
+    } else if (parent->spanLeft == fold) {
+        parent->spanLeft = rest;
+    } else {
+        parent->spanRight = rest;
+    }
+    for (; parent; parent = parent->spanParent) {
+        LinkSpan(parent);
+    }
+    fold->spanLeft = NULL;
+    fold->spanRight = NULL;
+    fold->spanParent = NULL;
+    fold->span = FALSE;
+}
+
+/* Forget a tree of spans (the folds stay) */
+static VOID DropSpans(struct Fold *root)
+{
+    if (!root) {
+        return;
+    }
+    DropSpans(root->spanLeft);
+    DropSpans(root->spanRight);
+    root->spanLeft = NULL;
+    root->spanRight = NULL;
+    root->spanParent = NULL;
+    root->span = FALSE;
+}
+
+/* Split a tree into the spans starting before line y and the rest */
+static VOID SplitSpans(struct TextDocument *doc, struct Fold *root, ULONG y, struct Fold **below, struct Fold **above)
+{
+    if (!root) {
+        *below = NULL;
+        *above = NULL;
+        return;
+    }
+
+    if (FoldStart(doc, root) < y) {
+        SplitSpans(doc, root->spanRight, y, &root->spanRight, above);
+        LinkSpan(root);
+        *below = root;
+    } else {
+        SplitSpans(doc, root->spanLeft, y, below, &root->spanLeft);
+        LinkSpan(root);
+        *above = root;
+    }
+    if (*below) {
+        (*below)->spanParent = NULL;
+    }
+    if (*above) {
+        (*above)->spanParent = NULL;
+    }
+}
+
+/* Join two trees, every span of a before every span of b */
+static struct Fold *MergeSpans(struct Fold *a, struct Fold *b)
+{
+    struct Fold *root = NULL;
+
+    if (!a) {
+        root = b;
+    } else if (!b) {
+        root = a;
+    } else if (a->priority > b->priority) {
+        a->spanRight = MergeSpans(a->spanRight, b);
+        LinkSpan(a);
+        root = a;
+    } else {
+        b->spanLeft = MergeSpans(a, b->spanLeft);
+        LinkSpan(b);
+        root = b;
+    }
+    if (root) {
+        root->spanParent = NULL;
+    }
+    return root;
+}
+
+/* Point a span's children back at it and count the lines its subtree hides */
+static VOID LinkSpan(struct Fold *fold)
+{
+    fold->spanTotal = fold->spanLines;
+    if (fold->spanLeft) {
+        fold->spanLeft->spanParent = fold;
+        fold->spanTotal += fold->spanLeft->spanTotal;
+    }
+    if (fold->spanRight) {
+        fold->spanRight->spanParent = fold;
+        fold->spanTotal += fold->spanRight->spanTotal;
+    }
+}
@@ -0,0 +1,606 @@
+/*
+ * TTX - Paragraph Formatting
+ *
+ * Copyright (c) 2025 amigazen project
+ * Licensed under BSD 2-Clause License
+ *
+ * Filling, justifying and centering lines. A run of lines is formatted in
+ * one pass from top to bottom: each paragraph (lines up to a blank one) is
+ * taken apart into words, which point into the document's own text, and
+ * the new lines are built from them into a line array of their own. Only
+ * once every new line is built are they swapped in for the old ones, so a
+ * formatting that runs out of memory leaves the document as it was, and
+ * the lines below the run are moved once however many lines it adds or
+ * takes away.
+ *
+ * Lines are broken in one of two ways:
+ *
+ * - Filling takes as many words as fit on each line in turn.
+ * - Balanced breaking (FORMAT_BALANCED) picks the breaks that keep the
+ *   squares of the gaps left at the ends of the lines, last line aside,
+ *   smallest over the paragraph. The best way to break the words from
+ *   each word on is worked out from the last word back, and a line holds
+ *   no more words than fit in the width, so this too takes time in step
+ *   with the paragraph's length.
+ *
+ * A paragraph keeps the indentation of its first line, and its other lines
+ * take that of its second. Tabs count as one column, as they are drawn.
+ */
+
+#include "ttx.h"
+
+/* Cost of breaking no further - more than any paragraph adds up to */
+#define FORMAT_NO_COST 0xFFFFFFFFUL
+
+/* A word of the paragraph being formatted - its bytes stay in the document until the new lines go in */
+struct FormatWord {
+    STRPTR text;
+    ULONG length;
+    ULONG lineEnd;     /* Balanced breaking: the word after the line this word starts */
+    ULONG cost;        /* Balanced breaking: least cost of the lines from this word on */
+};
+
+/* New lines built so far, and the words of the paragraph at hand */
+struct FormatWork {
+    struct TextLine *lines;
+    ULONG lineCount;
+    ULONG lineMax;
+    struct FormatWord *words;
+    ULONG wordCount;
+    ULONG wordMax;
+    ULONG width;
+    ULONG mode;
+};
+
+/* Forward declarations */
+static BOOL IsBlankLine(struct TextLine *line);
+static ULONG GetIndent(struct TextLine *line);
+static BOOL FillParagraph(struct FormatWork *work, struct TextLine *lines, ULONG firstY, ULONG lastY);
+static BOOL CenterLine(struct FormatWork *work, struct TextLine *line);
+static BOOL AddFormatWord(struct FormatWork *work, STRPTR text, ULONG length);
+static VOID BalanceBreaks(struct FormatWork *work, ULONG firstWidth, ULONG width);
+static ULONG FillBreak(struct FormatWork *work, ULONG first, ULONG width);
+static BOOL EmitFormatLine(struct FormatWork *work, STRPTR indent, ULONG indentLength,
+                           ULONG first, ULONG end, ULONG width, BOOL justify);
+static struct TextLine *AddFormatLine(struct FormatWork *work, ULONG length);
+static BOOL SwapFormatLines(struct TextBuffer *buffer, ULONG startY, ULONG stopY, struct FormatWork *work);
+static BOOL SameFormatLine(struct TextLine *line, struct TextLine *other);
+static ULONG MapFormattedLine(ULONG y, ULONG stopY, ULONG newStopY);
+static VOID FreeFormatWork(struct FormatWork *work, BOOL freeLines);
+
+/* ============================================================================
+ * Formatting
+ * ============================================================================ */
+
+/* The lines of the paragraph around line y - FALSE if y is blank */
+BOOL GetParagraphLines(struct TextBuffer *buffer, ULONG y, ULONG *startY, ULONG *stopY)
+{
+    struct TextDocument *doc = NULL;
+
+    if (!buffer || !buffer->doc || y >= buffer->doc->lineCount || IsBlankLine(&buffer->doc->lines[y])) {
+        return FALSE;
+    }
+    doc = buffer->doc;
+
+    *startY = y;
+    while (*startY > 0 && !IsBlankLine(&doc->lines[*startY - 1])) {
+        (*startY)--;
+    }
+    *stopY = y;
+    while (*stopY + 1 < doc->lineCount && !IsBlankLine(&doc->lines[*stopY + 1])) {
+        (*stopY)++;
+    }
+    return TRUE;
+}
+
+/* Format lines startY-stopY to width columns (mode is FORMAT_FILL, FORMAT_JUSTIFY or FORMAT_CENTER,
+ * with FORMAT_BALANCED to break for even line lengths) - FALSE and nothing changed if out of memory */
+BOOL FormatLines(struct TextBuffer *buffer, ULONG startY, ULONG stopY, ULONG width, ULONG mode,
+                 struct CleanupStack *stack)
+{
+    struct TextDocument *doc = NULL;
+    struct FormatWork work;
+    ULONG next = 0;
+    ULONG y = 0;
+    BOOL ok = TRUE;
+
+    if (!buffer || !buffer->doc || !buffer->doc->lines || !stack || width == 0) {
+        return FALSE;
+    }
+    doc = buffer->doc;
+    if (stopY < startY) {
+        y = startY;
+        startY = stopY;
+        stopY = y;
+    }
+    if (startY >= doc->lineCount) {
+        return FALSE;
+    }
+    if (stopY >= doc->lineCount) {
+        stopY = doc->lineCount - 1;
+    }
+
+    work.lines = NULL;
+    work.lineCount = 0;
+    work.lineMax = 0;
+    work.words = NULL;
+    work.wordCount = 0;
+    work.wordMax = 0;
+    work.width = width;
+    work.mode = mode;
+
+    /* Blank lines go across as they are, and end paragraphs */
+    for (y = startY; ok && y <= stopY; y = next) {
+        next = y + 1;
+        if ((mode & ~FORMAT_BALANCED) == FORMAT_CENTER) {
+            ok = CenterLine(&work, &doc->lines[y]);
+        } else if (IsBlankLine(&doc->lines[y])) {
+            ok = EmitFormatLine(&work, doc->lines[y].text, doc->lines[y].length, 0, 0, 0, FALSE);
+        } else {
+            while (next <= stopY && !IsBlankLine(&doc->lines[next])) {
+                next++;
+            }
+            ok = FillParagraph(&work, doc->lines, y, next - 1);
+        }
+    }
+
+    if (ok) {
+        ok = SwapFormatLines(buffer, startY, stopY, &work);
+    }
+    FreeFormatWork(&work, !ok);
+    return ok;
+}
+
+/* ============================================================================
+ * Paragraphs
+ * ============================================================================ */
+
+/* Nothing but spaces and tabs on the line? */
+static BOOL IsBlankLine(struct TextLine *line)
+{
+    ULONG i = 0;
+
+    for (i = 0; i < line->length; i++) {
+        if (line->text[i] != ' ' && line->text[i] != '\t') {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+/* Columns of spaces and tabs a line starts with */
+static ULONG GetIndent(struct TextLine *line)
+{
+    ULONG i = 0;
+
+    while (i < line->length && (line->text[i] == ' ' || line->text[i] == '\t')) {
+        i++;
+    }
+    return i;
+}
+
+/* Break the words of lines firstY-lastY into new lines */
+static BOOL FillParagraph(struct FormatWork *work, struct TextLine *lines, ULONG firstY, ULONG lastY)
+{
+    struct TextLine *line = NULL;
+    struct TextLine *rest = &lines[(lastY > firstY) ? firstY + 1 : firstY];
+    ULONG firstIndent = GetIndent(&lines[firstY]);
+    ULONG restIndent = GetIndent(rest);
+    ULONG firstWidth = 1;
+    ULONG width = 1;
+    ULONG first = 0;
+    ULONG end = 0;
+    ULONG start = 0;
+    ULONG i = 0;
+    ULONG y = 0;
+    BOOL justify = (BOOL)((work->mode & ~FORMAT_BALANCED) == FORMAT_JUSTIFY);
+
+    work->wordCount = 0;
+    for (y = firstY; y <= lastY; y++) {
+        line = &lines[y];
+        i = 0;
+        while (i < line->length) {
+            while (i < line->length && (line->text[i] == ' ' || line->text[i] == '\t')) {
+                i++;
+            }
+            start = i;
+            while (i < line->length && line->text[i] != ' ' && line->text[i] != '\t') {
+                i++;
+            }
+            if (i > start && !AddFormatWord(work, &line->text[start], i - start)) {
+                return FALSE;
+            }
+        }
+    }
+
+    /* A line holds at least one word, however narrow the room left by the indentation */
+    if (work->width > firstIndent) {
+        firstWidth = work->width - firstIndent;
+    }
+    if (work->width > restIndent) {
+        width = work->width - restIndent;
+    }
+    if (work->mode & FORMAT_BALANCED) {
+        BalanceBreaks(work, firstWidth, width);
+    }
+
+    for (first = 0; first < work->wordCount; first = end) {
+        if (work->mode & FORMAT_BALANCED) {
+            end = work->words[first].lineEnd;
+        } else {
+            end = FillBreak(work, first, (first == 0) ? firstWidth : width);
+        }
+        /* The last line of a paragraph stays ragged */
+        if (!EmitFormatLine(work, (first == 0) ? lines[firstY].text : rest->text,
+                            (first == 0) ? firstIndent : restIndent,
+                            first, end, (first == 0) ? firstWidth : width,
+                            (BOOL)(justify && end < work->wordCount))) {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+/* Line with its spaces and tabs trimmed, centered in the width - left as it is if too long */
+static BOOL CenterLine(struct FormatWork *work, struct TextLine *line)
+{
+    struct TextLine *out = NULL;
+    ULONG start = GetIndent(line);
+    ULONG end = line->length;
+    ULONG pad = 0;
+    ULONG i = 0;
+
+    while (end > start && (line->text[end - 1] == ' ' || line->text[end - 1] == '\t')) {
+        end--;
+    }
+    if (end > start && work->width > end - start) {
+        pad = (work->width - (end - start)) / 2;
+    }
+
+    out = AddFormatLine(work, pad + end - start);
+    if (!out) {
+        return FALSE;
+    }
+    for (i = 0; i < pad; i++) {
+        out->text[i] = ' ';
+    }
+    if (end > start) {
+        CopyMem(&line->text[start], &out->text[pad], end - start);
+    }
+    return TRUE;
+}
+
+static BOOL AddFormatWord(struct FormatWork *work, STRPTR text, ULONG length)
+{
+    struct FormatWord *words = NULL;
+    ULONG wordMax = 0;
+
+    if (work->wordCount >= work->wordMax) {
+        wordMax = work->wordMax ? work->wordMax * 2 : 256;
+        words = (struct FormatWord *)allocVec(wordMax * sizeof(struct FormatWord), 0);
+        if (!words) {
+            return FALSE;
+        }
+        if (work->words) {
+            CopyMem(work->words, words, work->wordCount * sizeof(struct FormatWord));
+            freeVec(work->words);
+        }
+        work->words = words;
+        work->wordMax = wordMax;
+    }
+    work->words[work->wordCount].text = text;
+    work->words[work->wordCount].length = length;
+    work->wordCount++;
+    return TRUE;
+}
+
+/* ============================================================================
+ * Line Breaking
+ * ============================================================================ */
+
+/* Word after the last one that fits on a line of width columns starting with word first */
+static ULONG FillBreak(struct FormatWork *work, ULONG first, ULONG width)
+{
+    ULONG length = work->words[first].length;
+    ULONG end = first + 1;
+
+    while (end < work->wordCount && length + 1 + work->words[end].length <= width) {
+        length += 1 + work->words[end].length;
+        end++;
+    }
+    return end;
+}
+
+/* Set where each line starting at a word ends, for the least sum of squared gaps at the line ends -
+ * from the last word back, so the lines after a break are already settled */
+static VOID BalanceBreaks(struct FormatWork *work, ULONG firstWidth, ULONG width)
+{
+    struct FormatWord *words = work->words;
+    ULONG count = work->wordCount;
+    ULONG room = 0;
+    ULONG length = 0;
+    ULONG gap = 0;
+    ULONG cost = 0;
+    ULONG first = count;
+    ULONG end = 0;
+
+    while (first > 0) {
+        first--;
+        room = (first == 0) ? firstWidth : width;
+        words[first].cost = FORMAT_NO_COST;
+        words[first].lineEnd = first + 1;
+        length = 0;
+        for (end = first + 1; end <= count; end++) {
+            length += words[end - 1].length + ((end - 1 > first) ? 1 : 0);
+            if (length > room && end - 1 > first) {
+                break;
+            }
+            if (end == count) {
+                /* The last line is as short as it likes */
+                cost = 0;
+            } else {
+                gap = (room > length) ? room - length : 0;
+                cost = gap * gap;
+                if (words[end].cost > FORMAT_NO_COST - cost) {
+                    cost = FORMAT_NO_COST;
+                } else {
+                    cost += words[end].cost;
+                }
+            }
+            if (cost < words[first].cost || end == first + 1) {
+                words[first].cost = cost;
+                words[first].lineEnd = end;
+            }
+        }
+    }
+}
+
+/* Add a line of the indentation and words first to end-1 - one space apart, or spread over
+ * width columns when justified (the spare columns go to the left gaps on every other line,
+ * and to the right ones between, so they do not line up down the paragraph) */
+static BOOL EmitFormatLine(struct FormatWork *work, STRPTR indent, ULONG indentLength,
+                           ULONG first, ULONG end, ULONG width, BOOL justify)
+{
+    struct TextLine *out = NULL;
+    STRPTR text = NULL;
+    ULONG length = 0;
+    ULONG gaps = 0;
+    ULONG spare = 0;
+    ULONG each = 0;
+    ULONG extra = 0;
+    ULONG pos = 0;
+    ULONG w = 0;
+    ULONG i = 0;
+
+    for (w = first; w < end; w++) {
+        length += work->words[w].length + ((w > first) ? 1 : 0);
+    }
+    gaps = (end > first) ? end - first - 1 : 0;
+    if (justify && gaps > 0 && width > length) {
+        spare = width - length;
+        each = spare / gaps;
+        extra = spare % gaps;
+    }
+
+    out = AddFormatLine(work, indentLength + length + spare);
+    if (!out) {
+        return FALSE;
+    }
+    text = out->text;
+    if (indentLength > 0) {
+        CopyMem(indent, text, indentLength);
+    }
+    pos = indentLength;
+    for (w = first; w < end; w++) {
+        if (w > first) {
+            text[pos++] = ' ';
+            for (i = 0; i < each; i++) {
+                text[pos++] = ' ';
+            }
+            if ((work->lineCount & 1) ? (end - w <= extra) : (w - first <= extra)) {
+                text[pos++] = ' ';
+            }
+        }
+        CopyMem(work->words[w].text, &text[pos], work->words[w].length);
+        pos += work->words[w].length;
+    }
+    return TRUE;
+}
+
+/* ============================================================================
+ * New Lines
+ * ============================================================================ */
+
+/* Add a new line of length bytes (its NUL is written here, the bytes by the caller) */
+static struct TextLine *AddFormatLine(struct FormatWork *work, ULONG length)
+{
+    struct TextLine *lines = NULL;
+    struct TextLine *out = NULL;
+    ULONG lineMax = 0;
+
+    if (work->lineCount >= work->lineMax) {
+        lineMax = work->lineMax ? work->lineMax * 2 : 64;
+        lines = (struct TextLine *)allocVec(lineMax * sizeof(struct TextLine), MEMF_CLEAR);
+        if (!lines) {
+            return NULL;
+        }
+        if (work->lines) {
+            CopyMem(work->lines, lines, work->lineCount * sizeof(struct TextLine));
+            freeVec(work->lines);
+        }
+        work->lines = lines;
+        work->lineMax = lineMax;
+    }
+
+    out = &work->lines[work->lineCount];
+    out->text = (STRPTR)allocVec(length + 1, 0);
+    if (!out->text) {
+        return NULL;
+    }
+    out->length = length;
+    out->allocated = length + 1;
+    out->text[length] = '\0';
+    work->lineCount++;
+    return out;
+}
+
+/* Put the new lines in place of lines startY-stopY - lines the formatting left as they were, at
+ * either end, stay where they are, so only those between are swapped in (in a line array of
+ * their own), reported changed and journaled */
+static BOOL SwapFormatLines(struct TextBuffer *buffer, ULONG startY, ULONG stopY, struct FormatWork *work)
+{
+    struct TextDocument *doc = buffer->doc;
+    struct TextLine *newLines = NULL;
+    struct TextLine *lines = NULL;
+    ULONG oldCount = stopY - startY + 1;
+    ULONG formattedStopY = startY + work->lineCount - 1;
+    ULONG limit = (oldCount < work->lineCount) ? oldCount : work->lineCount;
+    ULONG head = 0;
+    ULONG tail = 0;
+    ULONG count = 0;
+    ULONG newCount = 0;
+    ULONG newMax = 0;
+    ULONG newStopY = 0;
+    ULONG rest = 0;
+    LONG lineDelta = 0;
+    ULONG y = 0;
+    ULONG i = 0;
+
+    for (head = 0; head < limit && SameFormatLine(&doc->lines[startY + head], &work->lines[head]); head++) {
+    }
+    if (head == oldCount && head == work->lineCount) {
+        /* Already formatted - nothing to put in */
+        for (i = 0; i < work->lineCount; i++) {
+            freeVec(work->lines[i].text);
+        }
+        if (buffer->cursorY >= startY && buffer->cursorY <= stopY) {
+            buffer->cursorY = stopY;
+            buffer->cursorX = doc->lines[stopY].length;
+        }
+        return TRUE;
+    }
+    /* At least one line either side, so the change has a line to be at */
+    if (head == limit) {
+        head--;
+    }
+    for (tail = 0; head + tail + 1 < limit &&
+         SameFormatLine(&doc->lines[stopY - tail], &work->lines[work->lineCount - 1 - tail]); tail++) {
+    }
+    for (i = 0; i < head; i++) {
+        freeVec(work->lines[i].text);
+    }
+    for (i = work->lineCount - tail; i < work->lineCount; i++) {
+        freeVec(work->lines[i].text);
+    }
+    lines = &work->lines[head];
+    count = work->lineCount - head - tail;
+    startY += head;
+    stopY -= tail;
+    oldCount = stopY - startY + 1;
+    newStopY = startY + count - 1;
+    lineDelta = (LONG)count - (LONG)oldCount;
+    newCount = doc->lineCount - oldCount + count;
+    newMax = doc->maxLines ? doc->maxLines : newCount;
+    rest = doc->lineCount - stopY - 1;
+
+    while (newMax < newCount) {
+        newMax *= 2;
+    }
+    newLines = (struct TextLine *)allocVec(newMax * sizeof(struct TextLine), MEMF_CLEAR);
+    if (!newLines) {
+        /* The lines at either end were freed above - the caller frees the rest */
+        work->lineCount = 0;
+        for (i = 0; i < count; i++) {
+            work->lines[work->lineCount++] = lines[i];
+        }
+        return FALSE;
+    }
+    if (startY > 0) {
+        CopyMem(doc->lines, newLines, startY * sizeof(struct TextLine));
+    }
+    CopyMem(lines, &newLines[startY], count * sizeof(struct TextLine));
+    if (rest > 0) {
+        CopyMem(&doc->lines[stopY + 1], &newLines[newStopY + 1], rest * sizeof(struct TextLine));
+    }
+    for (y = startY; y <= stopY; y++) {
+        if (doc->lines[y].text) {
+            freeVec(doc->lines[y].text);
+        }
+    }
+    freeVec(doc->lines);
+    doc->lines = newLines;
+    doc->lineCount = newCount;
+    doc->maxLines = newMax;
+
+    /* The view's own positions - the document moves those of its other views. The cursor goes
+     * to the end of the formatted lines if it was in them. */
+    if (buffer->cursorY >= startY - head && buffer->cursorY <= stopY + tail) {
+        buffer->cursorY = formattedStopY;
+        buffer->cursorX = doc->lines[formattedStopY].length;
+    } else {
+        buffer->cursorY = MapFormattedLine(buffer->cursorY, stopY, newStopY);
+    }
+    buffer->scrollY = MapFormattedLine(buffer->scrollY, stopY, newStopY);
+    if (buffer->marking.enabled) {
+        buffer->marking.startY = MapFormattedLine(buffer->marking.startY, stopY, newStopY);
+        buffer->marking.stopY = MapFormattedLine(buffer->marking.stopY, stopY, newStopY);
+        if (buffer->marking.startX > doc->lines[buffer->marking.startY].length) {
+            buffer->marking.startX = doc->lines[buffer->marking.startY].length;
+        }
+        if (buffer->marking.stopX > doc->lines[buffer->marking.stopY].length) {
+            buffer->marking.stopX = doc->lines[buffer->marking.stopY].length;
+        }
+    }
+    for (i = 0; i < buffer->caretCount; i++) {
+        buffer->carets[i].y = MapFormattedLine(buffer->carets[i].y, stopY, newStopY);
+    }
+
+    /* Lines came in or went after the first, and the rest of the new ones changed in place */
+    BeginEditBatch();
+    DocumentChanged(buffer, startY, lineDelta);
+    for (y = startY + 1 + ((lineDelta > 0) ? (ULONG)lineDelta : 0); y <= newStopY; y++) {
+        DocumentChanged(buffer, y, 0);
+    }
+    EndEditBatch();
+    return TRUE;
+}
+
+/* Same text in both lines? */
+static BOOL SameFormatLine(struct TextLine *line, struct TextLine *other)
+{
+    ULONG i = 0;
+
+    if (line->length != other->length) {
+        return FALSE;
+    }
+    for (i = 0; i < line->length && line->text[i] == other->text[i]; i++) {
+    }
+    return (BOOL)(i == line->length);
+}
+
+/* Where line y ends up - below the lines formatted it moves with them, inside them it stays put
+ * unless there are no longer that many */
+static ULONG MapFormattedLine(ULONG y, ULONG stopY, ULONG newStopY)
+{
+    if (y > stopY) {
+        return y - stopY + newStopY;
+    }
+    return (y > newStopY) ? newStopY : y;
+}
+
+static VOID FreeFormatWork(struct FormatWork *work, BOOL freeLines)
+{
+    ULONG i = 0;
+
+    if (work->lines) {
+        if (freeLines) {
+            for (i = 0; i < work->lineCount; i++) {
+                freeVec(work->lines[i].text);
+            }
+        }
+        freeVec(work->lines);
+    }
+    if (work->words) {
+        freeVec(work->words);
+    }
+}
@@ -0,0 +1,478 @@
+/*
+ * TTX - Idle-Time Background Jobs
+ *
+ * Copyright (c) 2025 amigazen project
+ * Licensed under BSD 2-Clause License
+ *
+ * A timer.device request wakes the event loop once input has been quiet for
+ * a moment. Jobs then run in short slices; before each slice the scheduler
+ * checks the input signals so a key press or message pre-empts the work.
+ */
+
+#include "ttx.h"
+
+/* Quiet time after the last input before jobs start */
+#define IDLE_DELAY_MICROS 250000
+
+/* Pause between batches while work is left, so other tasks get the CPU */
+#define IDLE_RESLICE_MICROS 20000
+
+/* Slices run per timer tick */
+#define IDLE_SLICES_PER_TICK 8
+
+/* Lines one slice of each job handles */
+#define IDLE_LOAD_LINES 400
+#define IDLE_LEX_LINES 500
+#define IDLE_COMPACT_LINES 500
+#define IDLE_WRAP_LINES 300
+
+/* Search index chunks one slice rescans */
+#define IDLE_INDEX_CHUNKS 8
+
+/* Unused space a line buffer may keep before compaction shrinks it */
+#define IDLE_COMPACT_SLACK 64
+
+/* timer.device base for ReadEClock (set while the idle timer is open) */
+struct Device *TimerBase = NULL;
+
+/* A job slice does a bounded piece of work and returns TRUE if more is left */
+struct IdleJob {
+    STRPTR name;
+    BOOL (*slice)(struct TTXApplication *app);
+};
+
+/* Forward declarations */
+static VOID StartIdleTimer(struct TTXApplication *app, ULONG micros);
+static VOID StopIdleTimer(struct TTXApplication *app);
+static BOOL IdleJournal(struct TTXApplication *app);
+static BOOL IdleCommodity(struct TTXApplication *app);
+static BOOL IdleLoadFiles(struct TTXApplication *app);
+static BOOL IdleOpenQueued(struct TTXApplication *app);
+static BOOL IdleLexAhead(struct TTXApplication *app);
+static BOOL IdleSearchIndex(struct TTXApplication *app);
+static BOOL IdleCountWords(struct TTXApplication *app);
+static BOOL IdleCompactLines(struct TTXApplication *app);
+static BOOL IdleReflow(struct TTXApplication *app);
+
+/* Jobs in round-robin order */
+static struct IdleJob g_idleJobs[] = {
+    {"Journal", IdleJournal},
+    {"Commodity", IdleCommodity},
+    {"LoadFiles", IdleLoadFiles},
+    {"OpenQueued", IdleOpenQueued},
+    {"LexAhead", IdleLexAhead},
+    {"SearchIndex", IdleSearchIndex},
+    {"CountWords", IdleCountWords},
+    {"CompactLines", IdleCompactLines},
+    {"Reflow", IdleReflow},
+    {NULL, NULL}
+};
+
+/* ============================================================================
+ * Timer
+ * ============================================================================ */
+
+/* Open timer.device for the idle timer (the editor works without it) */
+BOOL TTX_SetupIdleTimer(struct TTXApplication *app)
+{
+    Printf("[INIT] TTX_SetupIdleTimer: START\n");
+    if (!app) {
+        return FALSE;
+    }
+
+    app->idlePort = NULL;
+    app->idleTimer = NULL;
+    app->idleTimerOpen = FALSE;
+    app->idleTimerPending = FALSE;
+    app->idleJobIndex = 0;
+
+    app->idlePort = CreateMsgPort();
+    if (!app->idlePort) {
+        Printf("[INIT] TTX_SetupIdleTimer: FAIL (CreateMsgPort failed)\n");
+        return FALSE;
+    }
+
+    app->idleTimer = (struct timerequest *)CreateIORequest(app->idlePort, sizeof(struct timerequest));
+    if (!app->idleTimer) {
+        Printf("[INIT] TTX_SetupIdleTimer: FAIL (CreateIORequest failed)\n");
+        TTX_RemoveIdleTimer(app);
+        return FALSE;
+    }
+
+    if (OpenDevice(TIMERNAME, UNIT_VBLANK, (struct IORequest *)app->idleTimer, 0) != 0) {
+        Printf("[INIT] TTX_SetupIdleTimer: FAIL (OpenDevice timer.device failed)\n");
+        TTX_RemoveIdleTimer(app);
+        return FALSE;
+    }
+    app->idleTimerOpen = TRUE;
+    TimerBase = app->idleTimer->tr_node.io_Device;
+
+    Printf("[INIT] TTX_SetupIdleTimer: SUCCESS (sigbit=%lu)\n", (ULONG)app->idlePort->mp_SigBit);
+    return TRUE;
+}
+
+/* Abort the idle timer and close timer.device */
+VOID TTX_RemoveIdleTimer(struct TTXApplication *app)
+{
+    if (!app) {
+        return;
+    }
+
+    Printf("[CLEANUP] TTX_RemoveIdleTimer: START\n");
+    StopIdleTimer(app);
+    if (app->idleTimer) {
+        if (app->idleTimerOpen) {
+            CloseDevice((struct IORequest *)app->idleTimer);
+            app->idleTimerOpen = FALSE;
+            TimerBase = NULL;
+        }
+        DeleteIORequest((struct IORequest *)app->idleTimer);
+        app->idleTimer = NULL;
+    }
+    if (app->idlePort) {
+        DeleteMsgPort(app->idlePort);
+        app->idlePort = NULL;
+    }
+    Printf("[CLEANUP] TTX_RemoveIdleTimer: DONE\n");
+}
+
+/* Signal mask of the idle timer (0 if there is no timer) */
+ULONG TTX_IdleSignal(struct TTXApplication *app)
+{
+    if (!app || !app->idlePort || !app->idleTimerOpen) {
+        return 0;
+    }
+    return 1UL << app->idlePort->mp_SigBit;
+}
+
+static VOID StartIdleTimer(struct TTXApplication *app, ULONG micros)
+{
+    StopIdleTimer(app);
+
+    app->idleTimer->tr_node.io_Command = TR_ADDREQUEST;
+    app->idleTimer->tr_time.tv_secs = micros / 1000000;
+    app->idleTimer->tr_time.tv_micro = micros % 1000000;
+    SendIO((struct IORequest *)app->idleTimer);
+    app->idleTimerPending = TRUE;
+}
+
+static VOID StopIdleTimer(struct TTXApplication *app)
+{
+    if (!app->idleTimer || !app->idleTimerPending) {
+        return;
+    }
+    if (!CheckIO((struct IORequest *)app->idleTimer)) {
+        AbortIO((struct IORequest *)app->idleTimer);
+    }
+    WaitIO((struct IORequest *)app->idleTimer);
+    app->idleTimerPending = FALSE;
+}
+
+/* (Re)start the quiet period - called whenever input was handled */
+VOID TTX_ScheduleIdle(struct TTXApplication *app)
+{
+    if (!app || !app->idleTimerOpen) {
+        return;
+    }
+    StartIdleTimer(app, IDLE_DELAY_MICROS);
+}
+
+/* ============================================================================
+ * Scheduler
+ * ============================================================================ */
+
+/* Timer fired - run job slices until input arrives or every job is done */
+VOID TTX_RunIdleJobs(struct TTXApplication *app)
+{
+    ULONG inputSignals = 0;
+    ULONG jobCount = 0;
+    ULONG slices = 0;
+    ULONG idleJobs = 0;  /* Jobs in a row that had nothing to do */
+    struct IdleJob *job = NULL;
+
+    if (!app || !app->idleTimerOpen) {
+        return;
+    }
+
+    /* Collect the returned timer request */
+    if (app->idleTimerPending && CheckIO((struct IORequest *)app->idleTimer)) {
+        WaitIO((struct IORequest *)app->idleTimer);
+        app->idleTimerPending = FALSE;
+    }
+    if (app->idleTimerPending) {
+        return;  /* Stray signal */
+    }
+
+    for (jobCount = 0; g_idleJobs[jobCount].slice; jobCount++) {
+        /* Count jobs */
+    }
+    if (jobCount == 0) {
+        return;
+    }
+
+    inputSignals = app->sigmask & ~TTX_IdleSignal(app);
+
+    while (slices < IDLE_SLICES_PER_TICK && idleJobs < jobCount) {
+        /* Pre-empt at the slice boundary - the input handler restarts the quiet period */
+        if (SetSignal(0L, 0L) & inputSignals) {
+            Printf("[IDLE] TTX_RunIdleJobs: pre-empted by input after %lu slices\n", slices);
+            return;
+        }
+
+        if (app->idleJobIndex >= jobCount) {
+            app->idleJobIndex = 0;
+        }
+        job = &g_idleJobs[app->idleJobIndex];
+        app->idleJobIndex++;
+
+        if (job->slice(app)) {
+            idleJobs = 0;
+        } else {
+            idleJobs++;
+        }
+        slices++;
+    }
+
+    /* Come back shortly while any job still has work; otherwise sleep until the next input */
+    if (idleJobs < jobCount) {
+        StartIdleTimer(app, IDLE_RESLICE_MICROS);
+    }
+
+    /* Jobs may have changed what views show (e.g. lexer states) */
+    TTX_RefreshDocumentViews(app);
+}
+
+/* ============================================================================
+ * Jobs
+ * ============================================================================ */
+
+/* Write and flush crash-recovery journals, compacting those that grew large */
+static BOOL IdleJournal(struct TTXApplication *app)
+{
+    struct Session *session = NULL;
+
+    for (session = app->sessions; session; session = session->next) {
+        if (session->buffer && JournalIdle(session->buffer->doc)) {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+/* Register with Exchange once startup is over - nothing before then needs commodities.library */
+static BOOL IdleCommodity(struct TTXApplication *app)
+{
+    if (!app->commodityTried) {
+        app->commodityTried = TRUE;
+        TTX_SetupCommodity(app);
+    }
+    return FALSE;
+}
+
+/* Read more of a file whose session was woken from dormancy */
+static BOOL IdleLoadFiles(struct TTXApplication *app)
+{
+    struct Session *session = NULL;
+
+    for (session = app->sessions; session; session = session->next) {
+        if (session->loader) {
+            TTX_ContinueSessionLoad(app, session, IDLE_LOAD_LINES);
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+/* Turn one file left over from a batch open into a dormant session */
+static BOOL IdleOpenQueued(struct TTXApplication *app)
+{
+    if (!app->openQueue) {
+        return FALSE;
+    }
+    TTX_OpenNextQueued(app);
+    return TRUE;
+}
+
+/* Lex ahead of the views so scrolling down finds highlighting ready */
+static BOOL IdleLexAhead(struct TTXApplication *app)
+{
+    struct Session *session = NULL;
+    struct TextDocument *doc = NULL;
+    struct TextBuffer *view = NULL;
+    ULONG firstLine = 0;
+
+    if (!GetSyntaxRules()) {
+        return FALSE;
+    }
+
+    for (session = app->sessions; session; session = session->next) {
+        doc = session->buffer ? session->buffer->doc : NULL;
+        if (!doc || doc->lexDirtyFrom >= doc->lineCount) {
+            continue;
+        }
+
+        firstLine = doc->lexDirtyFrom;
+        LexAhead(doc, IDLE_LEX_LINES);
+
+        /* A view drawn from guessed states shows lines the sweep just corrected */
+        for (view = doc->views; view; view = view->nextView) {
+            if (view->scrollY < doc->lexDirtyFrom && ViewLineAfterRows(view, view->scrollY, view->pageH) > firstLine) {
+                view->needsFullRedraw = TRUE;
+                view->docChanged = TRUE;
+            }
+        }
+        return TRUE;
+    }
+    return FALSE;
+}
+
+/* Rescan the bracket index where edits left it stale, so a search and the statistics find it current */
+static BOOL IdleSearchIndex(struct TTXApplication *app)
+{
+    struct Session *session = NULL;
+    struct TextDocument *doc = NULL;
+
+    for (session = app->sessions; session; session = session->next) {
+        doc = session->buffer ? session->buffer->doc : NULL;
+        if (!doc || session->loader) {
+            continue;
+        }
+        if (UpdateBracketIndex(doc, IDLE_INDEX_CHUNKS)) {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+/* Take the document statistics from the search index once it has caught up with the edits */
+static BOOL IdleCountWords(struct TTXApplication *app)
+{
+    struct Session *session = NULL;
+    struct TextDocument *doc = NULL;
+    ULONG words = 0;
+    ULONG chars = 0;
+
+    for (session = app->sessions; session; session = session->next) {
+        doc = session->buffer ? session->buffer->doc : NULL;
+        if (!doc || (doc->statsValid && doc->statsChangeCount == doc->changeCount)) {
+            continue;
+        }
+        if (GetDocumentCounts(doc, &words, &chars)) {
+            doc->statsWords = words;
+            doc->statsChars = chars;
+            doc->statsValid = TRUE;
+            doc->statsChangeCount = doc->changeCount;
+        }
+    }
+    return FALSE;
+}
+
+/* Shrink line buffers that carry a lot of unused space (loaded lines get 256 spare bytes) */
+static BOOL IdleCompactLines(struct TTXApplication *app)
+{
+    struct Session *session = NULL;
+    struct TextDocument *doc = NULL;
+    struct TextBuffer *view = NULL;
+    struct TextLine *line = NULL;
+    STRPTR newText = NULL;
+    ULONG newAlloc = 0;
+    ULONG lastLine = 0;
+    ULONG stopLine = 0;
+    BOOL inUse = FALSE;
+
+    for (session = app->sessions; session; session = session->next) {
+        doc = session->buffer ? session->buffer->doc : NULL;
+        if (!doc || !doc->lines || !doc->compact.changed) {
+            continue;
+        }
+
+        /* Only lines edited or read in since the last pass, on from where the last slice stopped */
+        if (doc->compact.first == DOC_CHANGE_ALL) {
+            lastLine = doc->lineCount;
+        } else {
+            if (doc->compactLine < doc->compact.first) {
+                doc->compactLine = doc->compact.first;
+            }
+            lastLine = (doc->compact.last < doc->lineCount) ? doc->compact.last + 1 : doc->lineCount;
+        }
+        stopLine = doc->compactLine + IDLE_COMPACT_LINES;
+        if (stopLine > lastLine) {
+            stopLine = lastLine;
+        }
+        for (; doc->compactLine < stopLine; doc->compactLine++) {
+            line = &doc->lines[doc->compactLine];
+            if (!line->text || line->allocated <= line->length + 1 + IDLE_COMPACT_SLACK) {
+                continue;
+            }
+
+            /* Leave lines under a cursor alone - they are likely to grow again */
+            inUse = FALSE;
+            for (view = doc->views; view; view = view->nextView) {
+                if (view->cursorY == doc->compactLine) {
+                    inUse = TRUE;
+                    break;
+                }
+            }
+            if (inUse) {
+                continue;
+            }
+
+            newAlloc = (line->length + 1 + 15) & ~15UL;
+            newText = (STRPTR)allocVec(newAlloc, MEMF_CLEAR);
+            if (!newText) {
+                break;  /* Try again next slice */
+            }
+            if (line->length > 0) {
+                CopyMem(line->text, newText, line->length);
+            }
+            newText[line->length] = '\0';
+            freeVec(line->text);
+            line->text = newText;
+            line->allocated = newAlloc;
+        }
+
+        if (doc->compactLine >= lastLine) {
+            doc->compact.changed = FALSE;
+            doc->compactLine = 0;
+        }
+        return TRUE;
+    }
+    return FALSE;
+}
+
+/* Measure the lines of wrapped views that no view has shown since they went stale */
+static BOOL IdleReflow(struct TTXApplication *app)
+{
+    struct Session *session = NULL;
+    struct TextBuffer *view = NULL;
+    ULONG pane = 0;
+
+    for (session = app->sessions; session; session = session->next) {
+        if (!session->window || session->window == INVALID_RESOURCE) {
+            continue;
+        }
+        for (pane = 0; pane < 2; pane++) {
+            view = (pane == 0) ? session->buffer : session->otherView;
+            if (!view || !view->wrap || view->wrap->staleCount == 0) {
+                continue;
+            }
+            if (!ReflowSlice(view, session->window, IDLE_WRAP_LINES)) {
+                /* Every row counted - the scroll bars can show the real size */
+                view->docChanged = TRUE;
+            }
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+/* Lines of a document were edited or read in - compaction looks at them on its next pass */
+VOID IdleLinesChanged(struct TextDocument *doc, ULONG lineY, LONG lineDelta)
+{
+    AddLineSpan(&doc->compact, lineY, lineDelta);
+    if (lineY == DOC_CHANGE_ALL) {
+        doc->compactLine = 0;
+    } else if (lineY < doc->compactLine) {
+        doc->compactLine = lineY;
+    }
+}
@@ -0,0 +1,1027 @@
+/*
+ * TTX - Crash-Recovery Journal
+ *
+ * Copyright (c) 2025 amigazen project
+ * Licensed under BSD 2-Clause License
+ *
+ * Every modified document gets an append-only journal file. Each edit is
+ * logged as the new content of the lines it touched, so the journal never
+ * holds more than the edit itself. Records collect in memory and are written
+ * and flushed by the idle scheduler. Once the log outgrows its base, an idle
+ * job writes a snapshot of the document a slice at a time and swaps it in as
+ * the new journal - as it also does in place of logging an edit too large to
+ * write while the user waits. At startup, journals left behind by a crash are replayed
+ * into new sessions. A document's journal is deleted when it is saved or
+ * closed.
+ */
+
+#include "ttx.h"
+
+/* Where journals live - must survive a reboot, so not RAM: */
+#define JOURNAL_DIR "SYS:T/TTX-Recovery"
+
+#define JOURNAL_MAGIC   0x5454584AUL  /* 'TTXJ' */
+#define JOURNAL_VERSION 1
+
+/* What the records of a journal apply to */
+#define JOURNAL_BASE_EMPTY 0  /* An empty document (new file or snapshot follows) */
+#define JOURNAL_BASE_FILE  1  /* The named file, as it was when the journal was started */
+
+/* Record types */
+#define JREC_LINES 1  /* Line lineY replaced, removed lines after it deleted, inserted new lines after it */
+#define JREC_RESET 2  /* Whole document replaced */
+
+/* Header: magic, version, base kind, base size, base date (3 longs), name length */
+#define JOURNAL_HEADER_LONGS 8
+
+/* Records buffered in memory before they are written */
+#define JOURNAL_BUFFER_SIZE 8192
+
+/* Log size that triggers compaction (also must exceed the size of the base) */
+#define JOURNAL_COMPACT_SIZE (256UL * 1024UL)
+
+/* Lines one idle slice adds to a snapshot */
+#define JOURNAL_SNAPSHOT_LINES 1000
+
+/* Most lines one edit logs on the spot - a larger edit is left to a snapshot */
+#define JOURNAL_SYNC_LINES 1000
+
+#define JOURNAL_NO_RECORD 0xFFFFFFFFUL
+
+/* Journal file found at startup */
+struct JournalEntry {
+    struct JournalEntry *next;
+    UBYTE name[108];
+};
+
+/* Set while replaying so the replayed edits are not journaled again */
+static BOOL g_journalReplaying = FALSE;
+
+/* Makes journal names unique within one run */
+static ULONG g_journalSerial = 0;
+
+/* Forward declarations */
+static struct DocJournal *JournalCreate(struct TextDocument *doc);
+static VOID JournalFail(struct DocJournal *journal);
+static BOOL JournalWriteHeader(BPTR file, struct TextDocument *doc, ULONG baseKind, ULONG baseSize, struct DateStamp *baseDate, ULONG *written);
+static BOOL JournalPut(struct DocJournal *journal, APTR data, ULONG length);
+static BOOL JournalPutLong(struct DocJournal *journal, ULONG value);
+static BOOL JournalWritePending(struct DocJournal *journal);
+static VOID JournalFlush(struct DocJournal *journal);
+static ULONG JournalSum(ULONG sum, UBYTE *data, ULONG length);
+static BOOL JournalStartSnapshot(struct DocJournal *journal, struct TextDocument *doc);
+static BOOL JournalSnapshotSlice(struct DocJournal *journal, struct TextDocument *doc);
+static VOID JournalCancelSnapshot(struct DocJournal *journal);
+static VOID FormatHex(STRPTR out, ULONG value, ULONG digits);
+static ULONG StringLength(STRPTR text);
+static BOOL ReplayRecord(struct TextDocument *doc, BPTR file);
+static BOOL ReplayLines(struct TextDocument *doc, ULONG lineY, ULONG removed, struct TextLine *newLines, ULONG count);
+static BOOL RecoverJournal(struct TTXApplication *app, STRPTR path);
+
+/* ============================================================================
+ * Logging Edits
+ * ============================================================================ */
+
+/* Log an edit (same lineY/lineDelta convention as DocumentChanged) */
+VOID JournalChange(struct TextDocument *doc, ULONG lineY, LONG lineDelta)
+{
+    JournalLines(doc, lineY, (lineDelta < 0) ? (ULONG)(-lineDelta) : 0, (lineDelta > 0) ? (ULONG)lineDelta : 0);
+}
+
+/* Log an edit that replaced line lineY, removing the removed lines after it and putting inserted
+ * new ones there (lineY == DOC_CHANGE_ALL: the whole document was replaced) */
+VOID JournalLines(struct TextDocument *doc, ULONG lineY, ULONG removed, ULONG inserted)
+{
+    struct DocJournal *journal = NULL;
+    ULONG first = 0;
+    ULONG count = 0;
+    ULONG size = 0;
+    ULONG sum = 0;
+    ULONG recordStart = 0;
+    ULONG fields[4];
+    ULONG i = 0;
+    BOOL inPlace = FALSE;
+
+    if (g_journalReplaying || !doc || !doc->lines) {
+        return;
+    }
+
+    if (!doc->journal) {
+        doc->journal = JournalCreate(doc);
+        if (!doc->journal) {
+            return;
+        }
+    }
+    journal = doc->journal;
+    if (!journal->file) {
+        return;  /* Journaling failed for this document - retried after the next save */
+    }
+    if (journal->stale) {
+        return;  /* The snapshot on its way takes this edit along with the rest */
+    }
+
+    if (lineY == DOC_CHANGE_ALL) {
+        first = 0;
+        count = doc->lineCount;
+    } else {
+        /* Deleting the last line leaves lineY past the end */
+        if (lineY >= doc->lineCount) {
+            removed += lineY - (doc->lineCount - 1);
+            lineY = doc->lineCount - 1;
+        }
+        if (lineY + inserted >= doc->lineCount) {
+            inserted = doc->lineCount - 1 - lineY;
+        }
+        first = lineY;
+        count = inserted + 1;
+    }
+
+    /* Too much to write while the user waits - records stop, and the idle scheduler writes
+     * the document as it now is into a snapshot a slice at a time instead */
+    if (count > JOURNAL_SYNC_LINES) {
+        JournalCancelSnapshot(journal);
+        journal->stale = TRUE;
+        journal->lastRecord = JOURNAL_NO_RECORD;
+        return;
+    }
+
+    if (lineY == DOC_CHANGE_ALL) {
+        /* Replaced outright (reverted or recovered) - a reset record with every line */
+        fields[0] = JREC_RESET;
+        fields[1] = doc->lineCount;
+        size = 8;
+        sum = JournalSum(0, (UBYTE *)fields, 8);
+    } else {
+        inPlace = (BOOL)(removed == inserted);
+
+        /* Typing on one line, or at carets spread over the same lines - the new lines
+         * supersede the record of the previous keystroke */
+        if (inPlace && journal->lastRecord != JOURNAL_NO_RECORD &&
+            journal->lastLine == lineY && journal->lastCount == count) {
+            journal->logBytes -= journal->pendingLen - journal->lastRecord;
+            journal->pendingLen = journal->lastRecord;
+        }
+
+        fields[0] = JREC_LINES;
+        fields[1] = lineY;
+        fields[2] = removed;
+        fields[3] = inserted;
+        size = 16;
+        sum = JournalSum(0, (UBYTE *)fields, 16);
+    }
+
+    for (i = first; i < first + count; i++) {
+        size += 4 + doc->lines[i].length;
+        sum = JournalSum(sum, (UBYTE *)&doc->lines[i].length, 4);
+        sum = JournalSum(sum, (UBYTE *)doc->lines[i].text, doc->lines[i].length);
+    }
+
+    recordStart = journal->pendingLen;
+    journal->lastRecord = JOURNAL_NO_RECORD;
+    if (!JournalPutLong(journal, size) || !JournalPutLong(journal, sum) ||
+        !JournalPut(journal, fields, lineY == DOC_CHANGE_ALL ? 8 : 16)) {
+        JournalFail(journal);
+        return;
+    }
+    for (i = first; i < first + count; i++) {
+        if (!JournalPutLong(journal, doc->lines[i].length) ||
+            !JournalPut(journal, doc->lines[i].text, doc->lines[i].length)) {
+            JournalFail(journal);
+            return;
+        }
+    }
+    journal->logBytes += 8 + size;
+
+    /* The record can only be replaced while it is still entirely in memory */
+    if (inPlace && journal->pendingLen >= recordStart + 8 + size) {
+        journal->lastRecord = recordStart;
+        journal->lastLine = lineY;
+        journal->lastCount = count;
+    }
+}
+
+/* Document saved or closed - its journal is no longer needed */
+VOID JournalDiscard(struct TextDocument *doc)
+{
+    struct DocJournal *journal = NULL;
+
+    if (!doc || !doc->journal) {
+        return;
+    }
+
+    journal = doc->journal;
+    JournalCancelSnapshot(journal);
+    if (journal->file) {
+        Close(journal->file);
+        journal->file = 0;
+        DeleteFile(journal->path);
+    }
+    if (journal->pending) {
+        freeVec(journal->pending);
+    }
+    freeVec(journal);
+    doc->journal = NULL;
+    SetIoErr(0);
+}
+
+/* Idle slice for a document's journal - returns TRUE if it did any work */
+BOOL JournalIdle(struct TextDocument *doc)
+{
+    struct DocJournal *journal = NULL;
+    BOOL done = FALSE;
+
+    journal = doc ? doc->journal : NULL;
+    if (!journal || !journal->file) {
+        return FALSE;
+    }
+
+    /* Get logged edits onto the disk first */
+    if (journal->pendingLen > 0 || journal->unsynced) {
+        JournalFlush(journal);
+        return TRUE;
+    }
+
+    if (journal->snapFile) {
+        done = JournalSnapshotSlice(journal, doc);
+    } else if (journal->stale ||
+               (journal->logBytes > JOURNAL_COMPACT_SIZE && journal->logBytes > journal->baseBytes)) {
+        /* Records stopped for a large edit, or the log is larger than both the threshold
+         * and what it applies to */
+        done = JournalStartSnapshot(journal, doc);
+    } else {
+        return FALSE;
+    }
+
+    /* Without the snapshot a stale journal would recover the wrong text */
+    if (!done && journal->stale && journal->file) {
+        JournalFail(journal);
+    }
+    return done;
+}
+
+/* Open a new journal file for a document about to be modified */
+static struct DocJournal *JournalCreate(struct TextDocument *doc)
+{
+    struct DocJournal *journal = NULL;
+    struct FileInfoBlock *fib = NULL;
+    struct DateStamp stamp;
+    struct DateStamp baseDate;
+    BPTR lock = 0;
+    ULONG baseKind = JOURNAL_BASE_EMPTY;
+    ULONG baseSize = 0;
+    ULONG seconds = 0;
+    ULONG written = 0;
+    UBYTE fileName[32];
+
+    journal = (struct DocJournal *)allocVec(sizeof(struct DocJournal), MEMF_CLEAR);
+    if (!journal) {
+        return NULL;
+    }
+    journal->lastRecord = JOURNAL_NO_RECORD;
+    journal->pending = (UBYTE *)allocVec(JOURNAL_BUFFER_SIZE, MEMF_CLEAR);
+    if (!journal->pending) {
+        freeVec(journal);
+        return NULL;
+    }
+
+    /* Make sure the directory exists */
+    lock = Lock(JOURNAL_DIR, SHARED_LOCK);
+    if (!lock) {
+        lock = CreateDir(JOURNAL_DIR);
+    }
+    if (!lock) {
+        Printf("[JOURNAL] JournalCreate: FAIL (cannot create %s)\n", JOURNAL_DIR);
+        SetIoErr(0);
+        return journal;  /* Without a file - edits go unlogged until the next save */
+    }
+    UnLock(lock);
+
+    /* Name from the time and a serial number: <seconds>-<serial>.ttj */
+    DateStamp(&stamp);
+    seconds = stamp.ds_Days * 86400L + stamp.ds_Minute * 60L + stamp.ds_Tick / 50L;
+    FormatHex(fileName, seconds, 8);
+    fileName[8] = '-';
+    FormatHex(&fileName[9], g_journalSerial++, 4);
+    Strncpy(&fileName[13], ".ttj", sizeof(fileName) - 13);
+    Strncpy(journal->path, JOURNAL_DIR, JOURNAL_PATH_MAX);
+    AddPart(journal->path, fileName, JOURNAL_PATH_MAX);
+    Strncpy(journal->tempPath, journal->path, JOURNAL_PATH_MAX);
+    Strncpy(&journal->tempPath[StringLength(journal->tempPath) - 4], ".tmp", 5);
+
+    /* Records apply to the file as it is on disk now */
+    baseDate.ds_Days = 0;
+    baseDate.ds_Minute = 0;
+    baseDate.ds_Tick = 0;
+    if (doc->fileName) {
+        lock = Lock(doc->fileName, SHARED_LOCK);
+        if (lock) {
+            fib = (struct FileInfoBlock *)allocVec(sizeof(struct FileInfoBlock), MEMF_CLEAR);
+            if (fib && Examine(lock, fib) && fib->fib_DirEntryType < 0) {
+                baseKind = JOURNAL_BASE_FILE;
+                baseSize = fib->fib_Size;
+                baseDate = fib->fib_Date;
+            }
+            if (fib) {
+                freeVec(fib);
+            }
+            UnLock(lock);
+        }
+        SetIoErr(0);
+    }
+
+    journal->file = Open(journal->path, MODE_NEWFILE);
+    if (!journal->file) {
+        Printf("[JOURNAL] JournalCreate: FAIL (cannot open %s)\n", journal->path);
+        SetIoErr(0);
+        return journal;
+    }
+    if (!JournalWriteHeader(journal->file, doc, baseKind, baseSize, &baseDate, &written)) {
+        JournalFail(journal);
+        return journal;
+    }
+    journal->fileSize = written;
+    journal->baseBytes = baseSize;
+    journal->unsynced = TRUE;
+
+    Printf("[JOURNAL] JournalCreate: SUCCESS (%s, base=%s)\n", journal->path,
+           baseKind == JOURNAL_BASE_FILE ? doc->fileName : (STRPTR)"empty");
+    return journal;
+}
+
+/* Writing failed - a journal missing edits would recover the wrong text, so drop it */
+static VOID JournalFail(struct DocJournal *journal)
+{
+    Printf("[JOURNAL] JournalFail: journal %s disabled (error %ld)\n", journal->path, IoErr());
+    JournalCancelSnapshot(journal);
+    if (journal->file) {
+        Close(journal->file);
+        journal->file = 0;
+        DeleteFile(journal->path);
+    }
+    journal->pendingLen = 0;
+    journal->lastRecord = JOURNAL_NO_RECORD;
+    SetIoErr(0);
+}
+
+static BOOL JournalWriteHeader(BPTR file, struct TextDocument *doc, ULONG baseKind, ULONG baseSize, struct DateStamp *baseDate, ULONG *written)
+{
+    ULONG header[JOURNAL_HEADER_LONGS];
+    ULONG nameLen = StringLength(doc->fileName);
+
+    header[0] = JOURNAL_MAGIC;
+    header[1] = JOURNAL_VERSION;
+    header[2] = baseKind;
+    header[3] = baseSize;
+    header[4] = (ULONG)baseDate->ds_Days;
+    header[5] = (ULONG)baseDate->ds_Minute;
+    header[6] = (ULONG)baseDate->ds_Tick;
+    header[7] = nameLen;
+    if (Write(file, header, sizeof(header)) != sizeof(header)) {
+        return FALSE;
+    }
+    if (nameLen > 0 && Write(file, doc->fileName, nameLen) != (LONG)nameLen) {
+        return FALSE;
+    }
+    *written = sizeof(header) + nameLen;
+    return TRUE;
+}
+
+/* Append to the in-memory records, writing them out whenever the buffer fills */
+static BOOL JournalPut(struct DocJournal *journal, APTR data, ULONG length)
+{
+    UBYTE *source = (UBYTE *)data;
+    ULONG chunk = 0;
+
+    while (length > 0) {
+        if (journal->pendingLen == JOURNAL_BUFFER_SIZE) {
+            if (!JournalWritePending(journal)) {
+                return FALSE;
+            }
+        }
+        chunk = JOURNAL_BUFFER_SIZE - journal->pendingLen;
+        if (chunk > length) {
+            chunk = length;
+        }
+        CopyMem(source, &journal->pending[journal->pendingLen], chunk);
+        journal->pendingLen += chunk;
+        source += chunk;
+        length -= chunk;
+    }
+    return TRUE;
+}
+
+static BOOL JournalPutLong(struct DocJournal *journal, ULONG value)
+{
+    return JournalPut(journal, &value, 4);
+}
+
+static BOOL JournalWritePending(struct DocJournal *journal)
+{
+    if (journal->pendingLen > 0) {
+        if (Write(journal->file, journal->pending, journal->pendingLen) != (LONG)journal->pendingLen) {
+            return FALSE;
+        }
+        journal->fileSize += journal->pendingLen;
+        journal->pendingLen = 0;
+        journal->unsynced = TRUE;
+    }
+    journal->lastRecord = JOURNAL_NO_RECORD;
+    return TRUE;
+}
+
+/* Write pending records and have the file system commit them (AmigaDOS has no fsync - ACTION_FLUSH is the equivalent) */
+static VOID JournalFlush(struct DocJournal *journal)
+{
+    struct FileHandle *handle = NULL;
+
+    if (!JournalWritePending(journal)) {
+        JournalFail(journal);
+        return;
+    }
+    handle = (struct FileHandle *)BADDR(journal->file);
+    if (handle && handle->fh_Type) {
+        DoPkt(handle->fh_Type, ACTION_FLUSH, 0, 0, 0, 0, 0);
+    }
+    journal->unsynced = FALSE;
+    SetIoErr(0);
+}
+
+/* Checksum over a record's payload - a record torn by a crash fails it */
+static ULONG JournalSum(ULONG sum, UBYTE *data, ULONG length)
+{
+    ULONG i = 0;
+
+    for (i = 0; i < length; i++) {
+        sum = ((sum << 5) | (sum >> 27)) + data[i];
+    }
+    return sum;
+}
+
+/* ============================================================================
+ * Compaction
+ * ============================================================================ */
+
+/* Begin writing a snapshot: a header with an empty base and one JREC_RESET record */
+static BOOL JournalStartSnapshot(struct DocJournal *journal, struct TextDocument *doc)
+{
+    struct DateStamp noDate;
+    ULONG fields[2];
+    ULONG written = 0;
+
+    noDate.ds_Days = 0;
+    noDate.ds_Minute = 0;
+    noDate.ds_Tick = 0;
+
+    journal->snapFile = Open(journal->tempPath, MODE_NEWFILE);
+    if (!journal->snapFile) {
+        Printf("[JOURNAL] JournalStartSnapshot: FAIL (cannot open %s)\n", journal->tempPath);
+        SetIoErr(0);
+        journal->baseBytes = journal->logBytes;  /* Do not retry until the log doubles */
+        return FALSE;
+    }
+    if (!JournalWriteHeader(journal->snapFile, doc, JOURNAL_BASE_EMPTY, 0, &noDate, &written)) {
+        JournalCancelSnapshot(journal);
+        journal->baseBytes = journal->logBytes;
+        return FALSE;
+    }
+
+    /* Record size and checksum are patched in once all lines are written */
+    journal->snapRecord = written;
+    fields[0] = 0;
+    fields[1] = 0;
+    if (Write(journal->snapFile, fields, 8) != 8) {
+        JournalCancelSnapshot(journal);
+        journal->baseBytes = journal->logBytes;
+        return FALSE;
+    }
+
+    fields[0] = JREC_RESET;
+    fields[1] = doc->lineCount;
+    if (FWrite(journal->snapFile, fields, 8, 1) != 1) {
+        JournalFail(journal);
+        return FALSE;
+    }
+    journal->snapSize = 8;
+    journal->snapSum = JournalSum(0, (UBYTE *)fields, 8);
+    journal->snapLine = 0;
+    journal->snapChangeCount = doc->changeCount;
+
+    Printf("[JOURNAL] JournalStartSnapshot: %s (%lu lines, log=%lu bytes)\n", journal->tempPath, doc->lineCount, journal->logBytes);
+    return TRUE;
+}
+
+/* Add the next lines to the snapshot; swap it in for the journal when complete */
+static BOOL JournalSnapshotSlice(struct DocJournal *journal, struct TextDocument *doc)
+{
+    struct TextLine *line = NULL;
+    ULONG stopLine = 0;
+    ULONG fields[2];
+
+    /* Edited meanwhile - the snapshot no longer matches the log, start over */
+    if (doc->changeCount != journal->snapChangeCount) {
+        JournalCancelSnapshot(journal);
+        return TRUE;
+    }
+
+    stopLine = journal->snapLine + JOURNAL_SNAPSHOT_LINES;
+    if (stopLine > doc->lineCount) {
+        stopLine = doc->lineCount;
+    }
+    for (; journal->snapLine < stopLine; journal->snapLine++) {
+        line = &doc->lines[journal->snapLine];
+        if (FWrite(journal->snapFile, &line->length, 4, 1) != 1 ||
+            (line->length > 0 && FWrite(journal->snapFile, line->text, line->length, 1) != 1)) {
+            Printf("[JOURNAL] JournalSnapshotSlice: FAIL (write error)\n");
+            JournalCancelSnapshot(journal);
+            journal->baseBytes = journal->logBytes;
+            return FALSE;
+        }
+        journal->snapSum = JournalSum(journal->snapSum, (UBYTE *)&line->length, 4);
+        journal->snapSum = JournalSum(journal->snapSum, (UBYTE *)line->text, line->length);
+        journal->snapSize += 4 + line->length;
+    }
+    if (journal->snapLine < doc->lineCount) {
+        return TRUE;
+    }
+
+    /* Complete - patch the record header and commit the snapshot */
+    Flush(journal->snapFile);
+    fields[0] = journal->snapSize;
+    fields[1] = journal->snapSum;
+    if (Seek(journal->snapFile, journal->snapRecord, OFFSET_BEGINNING) < 0 || Write(journal->snapFile, fields, 8) != 8) {
+        JournalCancelSnapshot(journal);
+        journal->baseBytes = journal->logBytes;
+        return FALSE;
+    }
+    Close(journal->snapFile);
+    journal->snapFile = 0;
+
+    /* A crash between these steps leaves only the complete snapshot, which recovery picks up */
+    Close(journal->file);
+    journal->file = 0;
+    DeleteFile(journal->path);
+    if (!Rename(journal->tempPath, journal->path)) {
+        Printf("[JOURNAL] JournalSnapshotSlice: FAIL (rename failed)\n");
+        DeleteFile(journal->tempPath);
+        SetIoErr(0);
+        return FALSE;
+    }
+    journal->file = Open(journal->path, MODE_OLDFILE);
+    if (!journal->file || Seek(journal->file, 0, OFFSET_END) < 0) {
+        JournalFail(journal);
+        return FALSE;
+    }
+    journal->fileSize = journal->snapRecord + 8 + journal->snapSize;
+    journal->baseBytes = journal->snapSize;
+    journal->logBytes = 0;
+    journal->pendingLen = 0;
+    journal->lastRecord = JOURNAL_NO_RECORD;
+    journal->unsynced = TRUE;
+    journal->stale = FALSE;
+    SetIoErr(0);
+
+    Printf("[JOURNAL] JournalSnapshotSlice: compacted %s to %lu bytes\n", journal->path, journal->fileSize);
+    return TRUE;
+}
+
+static VOID JournalCancelSnapshot(struct DocJournal *journal)
+{
+    if (journal->snapFile) {
+        Close(journal->snapFile);
+        journal->snapFile = 0;
+        DeleteFile(journal->tempPath);
+        SetIoErr(0);
+    }
+}
+
+/* ============================================================================
+ * Recovery
+ * ============================================================================ */
+
+/* Replay journals left behind by a crash into new sessions - returns the number recovered */
+ULONG TTX_RecoverJournals(struct TTXApplication *app)
+{
+    struct JournalEntry *entries = NULL;
+    struct JournalEntry *entry = NULL;
+    struct FileInfoBlock *fib = NULL;
+    BPTR dirLock = 0;
+    BPTR lock = 0;
+    ULONG nameLen = 0;
+    ULONG recovered = 0;
+    UBYTE path[JOURNAL_PATH_MAX];
+    UBYTE otherPath[JOURNAL_PATH_MAX];
+
+    if (!app) {
+        return 0;
+    }
+
+    dirLock = Lock(JOURNAL_DIR, SHARED_LOCK);
+    if (!dirLock) {
+        SetIoErr(0);
+        return 0;  /* No journals were ever written */
+    }
+
+    /* Collect names first - the directory must not change while it is being scanned */
+    fib = (struct FileInfoBlock *)allocVec(sizeof(struct FileInfoBlock), MEMF_CLEAR);
+    if (fib && Examine(dirLock, fib)) {
+        while (ExNext(dirLock, fib)) {
+            nameLen = StringLength(fib->fib_FileName);
+            if (fib->fib_DirEntryType >= 0 || nameLen < 5 ||
+                (Stricmp(&fib->fib_FileName[nameLen - 4], ".ttj") != 0 && Stricmp(&fib->fib_FileName[nameLen - 4], ".tmp") != 0)) {
+                continue;
+            }
+            entry = (struct JournalEntry *)allocVec(sizeof(struct JournalEntry), MEMF_CLEAR);
+            if (!entry) {
+                break;
+            }
+            Strncpy(entry->name, fib->fib_FileName, sizeof(entry->name));
+            entry->next = entries;
+            entries = entry;
+        }
+    }
+    if (fib) {
+        freeVec(fib);
+    }
+    UnLock(dirLock);
+    SetIoErr(0);
+
+    /* A snapshot whose journal is gone was complete when the crash hit - promote it */
+    for (entry = entries; entry; entry = entry->next) {
+        nameLen = StringLength(entry->name);
+        if (Stricmp(&entry->name[nameLen - 4], ".tmp") != 0) {
+            continue;
+        }
+        Strncpy(path, JOURNAL_DIR, sizeof(path));
+        AddPart(path, entry->name, sizeof(path));
+        Strncpy(&entry->name[nameLen - 4], ".ttj", 5);
+        Strncpy(otherPath, JOURNAL_DIR, sizeof(otherPath));
+        AddPart(otherPath, entry->name, sizeof(otherPath));
+
+        lock = Lock(otherPath, SHARED_LOCK);
+        if (lock) {
+            UnLock(lock);
+            DeleteFile(path);
+            entry->name[0] = '\0';  /* The journal is listed (and recovered) on its own */
+        } else if (!Rename(path, otherPath)) {
+            entry->name[0] = '\0';
+        }
+        SetIoErr(0);
+    }
+
+    for (entry = entries; entry; entry = entry->next) {
+        if (entry->name[0] == '\0') {
+            continue;
+        }
+        Strncpy(path, JOURNAL_DIR, sizeof(path));
+        AddPart(path, entry->name, sizeof(path));
+        if (RecoverJournal(app, path)) {
+            recovered++;
+        }
+    }
+
+    while (entries) {
+        entry = entries->next;
+        freeVec(entries);
+        entries = entry;
+    }
+
+    if (recovered > 0) {
+        Printf("[JOURNAL] TTX_RecoverJournals: recovered %lu document(s)\n", recovered);
+    }
+    return recovered;
+}
+
+/* Rebuild one document from its journal, and keep the journal for it */
+static BOOL RecoverJournal(struct TTXApplication *app, STRPTR path)
+{
+    struct Session *session = NULL;
+    struct TextDocument *doc = NULL;
+    struct DocJournal *journal = NULL;
+    struct FileInfoBlock *fib = NULL;
+    BPTR file = 0;
+    BPTR lock = 0;
+    ULONG header[JOURNAL_HEADER_LONGS];
+    STRPTR fileName = NULL;
+    ULONG validEnd = 0;
+    ULONG records = 0;
+    BOOL baseMatches = FALSE;
+
+    Printf("[JOURNAL] RecoverJournal: START (%s)\n", path);
+
+    file = Open(path, MODE_OLDFILE);
+    if (!file) {
+        SetIoErr(0);
+        return FALSE;
+    }
+    if (FRead(file, header, sizeof(header), 1) != 1 ||
+        header[0] != JOURNAL_MAGIC || header[1] != JOURNAL_VERSION || header[7] >= JOURNAL_PATH_MAX * 4) {
+        Printf("[JOURNAL] RecoverJournal: FAIL (not a journal)\n");
+        Close(file);
+        SetIoErr(0);
+        return FALSE;
+    }
+    if (header[7] > 0) {
+        fileName = (STRPTR)allocVec(header[7] + 1, MEMF_CLEAR);
+        if (!fileName || FRead(file, fileName, header[7], 1) != 1) {
+            if (fileName) {
+                freeVec(fileName);
+            }
+            Close(file);
+            SetIoErr(0);
+            return FALSE;
+        }
+    }
+
+    /* The records only make sense on the file they were logged against */
+    if (header[2] == JOURNAL_BASE_FILE) {
+        lock = fileName ? Lock(fileName, SHARED_LOCK) : 0;
+        if (lock) {
+            fib = (struct FileInfoBlock *)allocVec(sizeof(struct FileInfoBlock), MEMF_CLEAR);
+            if (fib && Examine(lock, fib)) {
+                baseMatches = (BOOL)((ULONG)fib->fib_Size == header[3] &&
+                                     (ULONG)fib->fib_Date.ds_Days == header[4] &&
+                                     (ULONG)fib->fib_Date.ds_Minute == header[5] &&
+                                     (ULONG)fib->fib_Date.ds_Tick == header[6]);
+            }
+            if (fib) {
+                freeVec(fib);
+            }
+            UnLock(lock);
+        }
+        SetIoErr(0);
+        if (!baseMatches) {
+            Printf("[JOURNAL] RecoverJournal: FAIL (%s changed since the journal was started - kept %s)\n",
+                   fileName ? fileName : (STRPTR)"?", path);
+            if (fileName) {
+                freeVec(fileName);
+            }
+            Close(file);
+            return FALSE;
+        }
+    }
+
+    /* Open a session on the base: the file itself, or an empty document named after it */
+    if (!TTX_CreateSession(app, header[2] == JOURNAL_BASE_FILE ? fileName : NULL)) {
+        if (fileName) {
+            freeVec(fileName);
+        }
+        Close(file);
+        return FALSE;
+    }
+    session = app->sessions;
+    doc = session->buffer->doc;
+    if (doc->journal || doc->refCount > 1) {
+        /* Another journal already restored this file - leave this one for a later start */
+        Printf("[JOURNAL] RecoverJournal: FAIL (document already open - kept %s)\n", path);
+        TTX_DestroySession(app, session);
+        if (fileName) {
+            freeVec(fileName);
+        }
+        Close(file);
+        return FALSE;
+    }
+    if (header[2] != JOURNAL_BASE_FILE && fileName) {
+        session->docState.fileName = fileName;
+        fileName = NULL;
+        SetDocumentFileName(doc, session->docState.fileName);
+        if (session->window) {
+            SetWindowTitles(session->window, session->docState.fileName, (STRPTR)-1);
+        }
+    }
+    if (fileName) {
+        freeVec(fileName);
+        fileName = NULL;
+    }
+
+    /* Apply records up to the first one a crash tore */
+    g_journalReplaying = TRUE;
+    validEnd = (ULONG)Seek(file, 0, OFFSET_CURRENT);
+    while (ReplayRecord(doc, file)) {
+        records++;
+        validEnd = (ULONG)Seek(file, 0, OFFSET_CURRENT);
+    }
+    Close(file);
+    SetIoErr(0);
+
+    if (records == 0) {
+        /* Nothing was lost */
+        g_journalReplaying = FALSE;
+        DeleteFile(path);
+        SetIoErr(0);
+        TTX_DestroySession(app, session);
+        Printf("[JOURNAL] RecoverJournal: nothing to recover\n");
+        return FALSE;
+    }
+
+    session->buffer->cursorX = 0;
+    session->buffer->cursorY = 0;
+    session->buffer->scrollX = 0;
+    session->buffer->scrollY = 0;
+    session->buffer->needsFullRedraw = TRUE;
+    DocumentChanged(session->buffer, DOC_CHANGE_ALL, 0);
+    g_journalReplaying = FALSE;
+    session->docState.modified = TRUE;
+
+    /* Keep logging to the same journal, minus any torn tail */
+    journal = (struct DocJournal *)allocVec(sizeof(struct DocJournal), MEMF_CLEAR);
+    if (journal) {
+        journal->pending = (UBYTE *)allocVec(JOURNAL_BUFFER_SIZE, MEMF_CLEAR);
+        journal->lastRecord = JOURNAL_NO_RECORD;
+        Strncpy(journal->path, path, JOURNAL_PATH_MAX);
+        Strncpy(journal->tempPath, path, JOURNAL_PATH_MAX);
+        Strncpy(&journal->tempPath[StringLength(journal->tempPath) - 4], ".tmp", 5);
+        journal->file = Open(path, MODE_READWRITE);
+        if (!journal->pending || !journal->file ||
+            SetFileSize(journal->file, validEnd, OFFSET_BEGINNING) < 0 ||
+            Seek(journal->file, 0, OFFSET_END) < 0) {
+            JournalFail(journal);
+        } else {
+            journal->fileSize = validEnd;
+            journal->logBytes = validEnd;  /* Compacted at the next idle time if it is large */
+            journal->baseBytes = 0;
+        }
+        doc->journal = journal;
+        SetIoErr(0);
+    }
+
+    CalculateMaxScroll(session->buffer, session->window);
+    UpdateScrollBars(session);
+    RenderText(session->window, session->buffer);
+    UpdateCursor(session->window, session->buffer);
+
+    Printf("[JOURNAL] RecoverJournal: SUCCESS (%lu records, %lu lines)\n", records, doc->lineCount);
+    return TRUE;
+}
+
+/* Read one record and apply it - FALSE at the end of the journal or on a torn record */
+static BOOL ReplayRecord(struct TextDocument *doc, BPTR file)
+{
+    struct TextLine *newLines = NULL;
+    ULONG recordHead[2];  /* Payload size, checksum */
+    ULONG fields[4];
+    ULONG lineY = 0;
+    ULONG removed = 0;
+    ULONG count = 0;
+    ULONG remaining = 0;
+    ULONG sum = 0;
+    ULONG length = 0;
+    ULONG i = 0;
+    BOOL ok = FALSE;
+
+    if (FRead(file, recordHead, 8, 1) != 1 || recordHead[0] < 8 || FRead(file, fields, 8, 1) != 1) {
+        return FALSE;
+    }
+    remaining = recordHead[0] - 8;
+    sum = JournalSum(0, (UBYTE *)fields, 8);
+
+    if (fields[0] == JREC_LINES) {
+        if (remaining < 8 || FRead(file, &fields[2], 8, 1) != 1) {
+            return FALSE;
+        }
+        remaining -= 8;
+        sum = JournalSum(sum, (UBYTE *)&fields[2], 8);
+        lineY = fields[1];
+        removed = fields[2];
+        count = fields[3] + 1;
+    } else if (fields[0] == JREC_RESET) {
+        lineY = 0;
+        removed = 0xFFFFFFFFUL;
+        count = fields[1];
+    } else {
+        return FALSE;
+    }
+    if (count == 0 || count > remaining / 4) {
+        return FALSE;
+    }
+
+    newLines = (struct TextLine *)allocVec(count * sizeof(struct TextLine), MEMF_CLEAR);
+    if (!newLines) {
+        return FALSE;
+    }
+    for (i = 0; i < count; i++) {
+        if (remaining < 4 || FRead(file, &length, 4, 1) != 1) {
+            break;
+        }
+        remaining -= 4;
+        if (length > remaining) {
+            break;
+        }
+        newLines[i].allocated = (length + 1 + 15) & ~15UL;
+        newLines[i].text = (STRPTR)allocVec(newLines[i].allocated, MEMF_CLEAR);
+        if (!newLines[i].text || (length > 0 && FRead(file, newLines[i].text, length, 1) != 1)) {
+            break;
+        }
+        newLines[i].text[length] = '\0';
+        newLines[i].length = length;
+        remaining -= length;
+        sum = JournalSum(sum, (UBYTE *)&length, 4);
+        sum = JournalSum(sum, (UBYTE *)newLines[i].text, length);
+    }
+
+    if (i == count && remaining == 0 && sum == recordHead[1]) {
+        ok = ReplayLines(doc, lineY, removed, newLines, count);
+    }
+    if (!ok) {
+        for (i = 0; i < count; i++) {
+            if (newLines[i].text) {
+                freeVec(newLines[i].text);
+            }
+        }
+    }
+    freeVec(newLines);
+    return ok;
+}
+
+/* Replace line lineY and the removed lines after it with count new lines (which the document takes over) */
+static BOOL ReplayLines(struct TextDocument *doc, ULONG lineY, ULONG removed, struct TextLine *newLines, ULONG count)
+{
+    struct TextLine *grown = NULL;
+    ULONG newCount = 0;
+    ULONG newMax = 0;
+    ULONG oldTail = 0;
+    ULONG newTail = 0;
+    ULONG tail = 0;
+    ULONG i = 0;
+
+    if (lineY >= doc->lineCount) {
+        return FALSE;
+    }
+    if (removed > doc->lineCount - 1 - lineY) {
+        removed = doc->lineCount - 1 - lineY;
+    }
+    newCount = doc->lineCount - removed - 1 + count;
+
+    if (newCount > doc->maxLines) {
+        newMax = doc->maxLines;
+        while (newMax < newCount) {
+            newMax *= 2;
+        }
+        grown = (struct TextLine *)allocVec(newMax * sizeof(struct TextLine), MEMF_CLEAR);
+        if (!grown) {
+            return FALSE;
+        }
+        for (i = 0; i < doc->lineCount; i++) {
+            grown[i] = doc->lines[i];
+        }
+        freeVec(doc->lines);
+        doc->lines = grown;
+        doc->maxLines = newMax;
+    }
+
+    for (i = lineY; i <= lineY + removed; i++) {
+        if (doc->lines[i].text) {
+            freeVec(doc->lines[i].text);
+            doc->lines[i].text = NULL;
+        }
+    }
+
+    /* Move the lines after the replaced range into place */
+    oldTail = lineY + removed + 1;
+    newTail = lineY + count;
+    tail = doc->lineCount - oldTail;
+    if (newTail > oldTail) {
+        for (i = tail; i > 0; i--) {
+            doc->lines[newTail + i - 1] = doc->lines[oldTail + i - 1];
+        }
+    } else if (newTail < oldTail) {
+        for (i = 0; i < tail; i++) {
+            doc->lines[newTail + i] = doc->lines[oldTail + i];
+        }
+        for (i = newCount; i < doc->lineCount; i++) {
+            doc->lines[i].text = NULL;
+            doc->lines[i].length = 0;
+            doc->lines[i].allocated = 0;
+        }
+    }
+
+    for (i = 0; i < count; i++) {
+        doc->lines[lineY + i] = newLines[i];
+    }
+    doc->lineCount = newCount;
+    return TRUE;
+}
+
+/* ============================================================================
+ * Helpers
+ * ============================================================================ */
+
+static VOID FormatHex(STRPTR out, ULONG value, ULONG digits)
+{
+    ULONG i = 0;
+
+    for (i = digits; i > 0; i--) {
+        out[i - 1] = "0123456789abcdef"[value & 0x0F];
+        value >>= 4;
+    }
+    out[digits] = '\0';
+}
+
+static ULONG StringLength(STRPTR text)
+{
+    ULONG length = 0;
+
+    while (text && text[length] != '\0') {
+        length++;
+    }
+    return length;
+}
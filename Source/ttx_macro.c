@@ -0,0 +1,533 @@
+/*
+ * TTX - Keyboard Macros
+ *
+ * Copyright (c) 2025 amigazen project
+ * Licensed under BSD 2-Clause License
+ *
+ * A macro is recorded as bytecode. A command is an opcode followed by the
+ * index of the resolved command and its arguments inline; a run of typed
+ * characters is one text opcode followed by the characters. Playback walks
+ * the bytecode and calls each command through its table entry, so nothing is
+ * looked up by name. Playback runs inside an edit batch: the views are
+ * painted and the journal written once, when the macro ends. Saved macros
+ * name their commands and loading resolves each name once.
+ */
+
+#include "ttx.h"
+
+#define MACRO_MAGIC   0x5454584DUL  /* 'TTXM' */
+#define MACRO_VERSION 1
+
+/* Opcodes */
+#define MOP_END     0  /* End of the macro */
+#define MOP_COMMAND 1  /* Command index (2 bytes), argument count, NUL-terminated arguments */
+#define MOP_TEXT    2  /* Character count (2 bytes), typed characters ('\n' for Return) */
+
+/* In a saved macro, MOP_COMMAND is followed by the NUL-terminated command name instead of its index */
+
+#define MACRO_MAX_ARGS 16        /* Arguments kept per command */
+#define MACRO_MAX_RUN  0xFFFFUL  /* Characters in one text run */
+#define MACRO_GROW     256       /* Minimum bytes added when the bytecode grows */
+#define MACRO_NO_RUN   0xFFFFFFFFUL
+
+/* Forward declarations */
+static BOOL ReserveMacro(struct TTXMacro *macro, ULONG count);
+static BOOL RunMacroCode(struct TTXApplication *app, struct Session **session, UBYTE *code);
+static BOOL SessionOpen(struct TTXApplication *app, struct Session *session);
+static ULONG StringLength(STRPTR text);
+static STRPTR ReadMacroString(UBYTE *data, ULONG size, ULONG *pos);
+
+/* ============================================================================
+ * Building Macros
+ * ============================================================================ */
+
+/* Create an empty macro */
+struct TTXMacro *CreateMacro(VOID)
+{
+    struct TTXMacro *macro = NULL;
+
+    macro = (struct TTXMacro *)allocVec(sizeof(struct TTXMacro), MEMF_CLEAR);
+    if (!macro) {
+        return NULL;
+    }
+    macro->textRun = MACRO_NO_RUN;
+    if (!ReserveMacro(macro, 0)) {
+        freeVec(macro);
+        return NULL;
+    }
+    macro->code[0] = MOP_END;
+    return macro;
+}
+
+VOID FreeMacro(struct TTXMacro *macro)
+{
+    if (!macro) {
+        return;
+    }
+    if (macro->code) {
+        freeVec(macro->code);
+    }
+    freeVec(macro);
+}
+
+/* Make room for count more bytes plus the end opcode */
+static BOOL ReserveMacro(struct TTXMacro *macro, ULONG count)
+{
+    UBYTE *code = NULL;
+    ULONG size = 0;
+
+    if (macro->failed) {
+        return FALSE;
+    }
+    if (macro->code && macro->length + count + 1 <= macro->size) {
+        return TRUE;
+    }
+
+    size = macro->size * 2;
+    if (size < macro->length + count + 1 + MACRO_GROW) {
+        size = macro->length + count + 1 + MACRO_GROW;
+    }
+    code = (UBYTE *)allocVec(size, MEMF_CLEAR);
+    if (!code) {
+        macro->failed = TRUE;
+        return FALSE;
+    }
+    if (macro->code) {
+        CopyMem(macro->code, code, macro->length + 1);
+        freeVec(macro->code);
+    }
+    macro->code = code;
+    macro->size = size;
+    return TRUE;
+}
+
+/* Append a command by table index with its arguments */
+BOOL AddMacroCommand(struct TTXMacro *macro, ULONG index, STRPTR *args, ULONG argCount)
+{
+    UBYTE *code = NULL;
+    ULONG length = 0;
+    ULONG size = 4;
+    ULONG i = 0;
+
+    if (!macro) {
+        return FALSE;
+    }
+    if (argCount > MACRO_MAX_ARGS) {
+        argCount = MACRO_MAX_ARGS;
+    }
+    for (i = 0; i < argCount; i++) {
+        size += (args && args[i]) ? StringLength(args[i]) + 1 : 1;
+    }
+    if (!ReserveMacro(macro, size)) {
+        return FALSE;
+    }
+
+    code = macro->code;
+    length = macro->length;
+    code[length++] = MOP_COMMAND;
+    code[length++] = (UBYTE)(index >> 8);
+    code[length++] = (UBYTE)index;
+    code[length++] = (UBYTE)argCount;
+    for (i = 0; i < argCount; i++) {
+        if (args && args[i]) {
+            size = StringLength(args[i]) + 1;
+            CopyMem(args[i], &code[length], size);
+            length += size;
+        } else {
+            code[length++] = '\0';
+        }
+    }
+    code[length] = MOP_END;
+    macro->length = length;
+
+    /* Characters typed after the command start a new run */
+    macro->textRun = MACRO_NO_RUN;
+    return TRUE;
+}
+
+/* Append typed characters, extending the open text run */
+BOOL AddMacroText(struct TTXMacro *macro, UBYTE *text, ULONG length)
+{
+    UBYTE *run = NULL;
+    ULONG count = 0;
+    ULONG i = 0;
+
+    if (!macro) {
+        return FALSE;
+    }
+
+    for (i = 0; i < length; i++) {
+        if (macro->textRun != MACRO_NO_RUN) {
+            run = &macro->code[macro->textRun];
+            count = ((ULONG)run[1] << 8) | run[2];
+        }
+        if (macro->textRun == MACRO_NO_RUN || count == MACRO_MAX_RUN) {
+            if (!ReserveMacro(macro, 4)) {
+                return FALSE;
+            }
+            macro->textRun = macro->length;
+            macro->code[macro->length++] = MOP_TEXT;
+            macro->code[macro->length++] = 0;
+            macro->code[macro->length++] = 0;
+            count = 0;
+        } else if (!ReserveMacro(macro, 1)) {
+            return FALSE;
+        }
+
+        /* Reserving may have moved the bytecode */
+        run = &macro->code[macro->textRun];
+        count++;
+        run[1] = (UBYTE)(count >> 8);
+        run[2] = (UBYTE)count;
+        macro->code[macro->length++] = text[i];
+        macro->code[macro->length] = MOP_END;
+    }
+
+    return TRUE;
+}
+
+/* ============================================================================
+ * Recording
+ * ============================================================================ */
+
+/* Note a command that ran (ignored unless recording) */
+VOID RecordMacroCommand(struct TTXApplication *app, struct TTXCommand *command, STRPTR *args, ULONG argCount)
+{
+    if (!app || !app->recording || app->macroPlaying || !command) {
+        return;
+    }
+
+    /* Commands that drive the recorder are not part of the macro */
+    if (command->handler == TTX_Cmd_RecordMacro || command->handler == TTX_Cmd_EndMacro ||
+        command->handler == TTX_Cmd_PlayMacro || command->handler == TTX_Cmd_OpenMacro ||
+        command->handler == TTX_Cmd_SaveMacro) {
+        return;
+    }
+
+    AddMacroCommand(app->recording, TTX_CommandIndex(command), args, argCount);
+}
+
+/* Note a typed character (ignored unless recording) */
+VOID RecordMacroChar(struct TTXApplication *app, UBYTE ch)
+{
+    if (!app || !app->recording || app->macroPlaying) {
+        return;
+    }
+
+    AddMacroText(app->recording, &ch, 1);
+}
+
+/* ============================================================================
+ * Playback
+ * ============================================================================ */
+
+/* Play a macro repeat times - stops early when a command fails; returns the complete runs */
+ULONG PlayMacro(struct TTXApplication *app, struct Session *session, struct TTXMacro *macro, ULONG repeat)
+{
+    ULONG played = 0;
+
+    if (!app || !session || !macro || !macro->code || macro->length == 0) {
+        return 0;
+    }
+
+    app->macroPlaying = TRUE;
+    BeginEditBatch();
+    while (played < repeat) {
+        if (!RunMacroCode(app, &session, macro->code)) {
+            break;
+        }
+        played++;
+    }
+    EndEditBatch();
+    app->macroPlaying = FALSE;
+
+    TTX_RepaintSessions(app);
+    return played;
+}
+
+/* Run the bytecode once - FALSE when a command fails or there is no session left to run it in */
+static BOOL RunMacroCode(struct TTXApplication *app, struct Session **session, UBYTE *code)
+{
+    struct TTXCommand *command = NULL;
+    struct Session *active = NULL;
+    STRPTR args[MACRO_MAX_ARGS];
+    UBYTE *pc = code;
+    ULONG argCount = 0;
+    ULONG count = 0;
+    ULONG i = 0;
+    BOOL ok = FALSE;
+
+    for (;;) {
+        switch (*pc++) {
+            case MOP_END:
+                return TRUE;
+
+            case MOP_COMMAND:
+                command = TTX_GetCommand(((ULONG)pc[0] << 8) | pc[1]);
+                argCount = pc[2];
+                pc += 3;
+                for (i = 0; i < argCount; i++) {
+                    args[i] = (STRPTR)pc;
+                    while (*pc++ != '\0') {
+                    }
+                }
+                if (!command) {
+                    return FALSE;
+                }
+
+                active = app->activeSession;
+                ok = command->handler(app, *session, args, argCount);
+                /* Follow a command that switched documents; stop if it closed the one we were in */
+                if (app->activeSession != active) {
+                    *session = app->activeSession;
+                }
+                if (!SessionOpen(app, *session) || !(*session)->buffer) {
+                    return FALSE;
+                }
+                if (!ok) {
+                    return FALSE;
+                }
+                break;
+
+            case MOP_TEXT:
+                count = ((ULONG)pc[0] << 8) | pc[1];
+                pc += 2;
+                if ((*session)->docState.readOnly) {
+                    return FALSE;
+                }
+                for (i = 0; i < count; i++, pc++) {
+                    if (*pc == '\n') {
+                        InsertNewline((*session)->buffer, (*session)->cleanupStack);
+                    } else {
+                        InsertChar((*session)->buffer, *pc, (*session)->cleanupStack);
+                    }
+                }
+                (*session)->docState.modified = (*session)->buffer->doc->modified;
+                break;
+
+            default:
+                return FALSE;
+        }
+    }
+}
+
+/* TRUE if session is still in the session list */
+static BOOL SessionOpen(struct TTXApplication *app, struct Session *session)
+{
+    struct Session *scan = NULL;
+
+    for (scan = app->sessions; scan; scan = scan->next) {
+        if (scan == session) {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+/* ============================================================================
+ * Macro Files
+ * ============================================================================ */
+
+/* Write a macro with its commands named, so the file outlives changes to the command table */
+BOOL SaveMacro(struct TTXMacro *macro, STRPTR fileName)
+{
+    struct TTXMacro *image = NULL;
+    struct TTXCommand *command = NULL;
+    UBYTE *pc = NULL;
+    UBYTE *start = NULL;
+    ULONG header[2];
+    ULONG count = 0;
+    ULONG size = 0;
+    ULONG i = 0;
+    BPTR file = 0;
+    BOOL result = FALSE;
+
+    if (!macro || !macro->code || !fileName) {
+        return FALSE;
+    }
+
+    image = CreateMacro();
+    if (!image) {
+        return FALSE;
+    }
+
+    /* Build the whole file in memory and write it at once */
+    header[0] = MACRO_MAGIC;
+    header[1] = MACRO_VERSION;
+    if (ReserveMacro(image, 8)) {
+        CopyMem(header, image->code, 8);
+        image->length = 8;
+    }
+
+    pc = macro->code;
+    while (*pc != MOP_END && !image->failed) {
+        start = pc;
+        if (*pc == MOP_COMMAND) {
+            command = TTX_GetCommand(((ULONG)pc[1] << 8) | pc[2]);
+            count = pc[3];
+            pc += 4;
+            for (i = 0; i < count; i++) {
+                while (*pc++ != '\0') {
+                }
+            }
+            if (!command) {
+                continue;
+            }
+            size = StringLength(command->name) + 1;
+            if (ReserveMacro(image, 1 + size + (ULONG)(pc - start) - 3)) {
+                image->code[image->length++] = MOP_COMMAND;
+                CopyMem(command->name, &image->code[image->length], size);
+                image->length += size;
+                CopyMem(start + 3, &image->code[image->length], (ULONG)(pc - start) - 3);
+                image->length += (ULONG)(pc - start) - 3;
+            }
+        } else {
+            count = ((ULONG)pc[1] << 8) | pc[2];
+            pc += 3 + count;
+            if (ReserveMacro(image, 3 + count)) {
+                CopyMem(start, &image->code[image->length], 3 + count);
+                image->length += 3 + count;
+            }
+        }
+    }
+    if (image->failed) {
+        FreeMacro(image);
+        return FALSE;
+    }
+    image->code[image->length++] = MOP_END;
+
+    file = Open(fileName, MODE_NEWFILE);
+    if (file) {
+        result = (BOOL)(Write(file, image->code, image->length) == (LONG)image->length);
+        Close(file);
+        if (!result) {
+            DeleteFile(fileName);
+        }
+    }
+
+    FreeMacro(image);
+    return result;
+}
+
+/* Read a macro file, resolving its command names to table entries */
+struct TTXMacro *LoadMacro(STRPTR fileName)
+{
+    struct TTXMacro *macro = NULL;
+    struct TTXCommand *command = NULL;
+    STRPTR args[MACRO_MAX_ARGS];
+    STRPTR name = NULL;
+    UBYTE *data = NULL;
+    ULONG header[2];
+    ULONG pos = 8;
+    ULONG argCount = 0;
+    ULONG count = 0;
+    ULONG i = 0;
+    LONG size = 0;
+    BPTR file = 0;
+    BOOL ok = FALSE;
+
+    if (!fileName) {
+        return NULL;
+    }
+
+    file = Open(fileName, MODE_OLDFILE);
+    if (!file) {
+        return NULL;
+    }
+    if (Seek(file, 0, OFFSET_END) >= 0) {
+        size = Seek(file, 0, OFFSET_BEGINNING);
+    }
+    if (size >= 9) {
+        /* One extra zero byte so a string cut off by the end of the file still terminates */
+        data = (UBYTE *)allocVec((ULONG)size + 1, MEMF_CLEAR);
+    }
+    if (data && Read(file, data, size) != size) {
+        freeVec(data);
+        data = NULL;
+    }
+    Close(file);
+    if (!data) {
+        return NULL;
+    }
+
+    CopyMem(data, header, 8);
+    if (header[0] != MACRO_MAGIC || header[1] != MACRO_VERSION) {
+        Printf("[MACRO] LoadMacro: FAIL ('%s' is not a macro file)\n", fileName);
+        freeVec(data);
+        return NULL;
+    }
+
+    macro = CreateMacro();
+    ok = (BOOL)(macro != NULL);
+    while (ok && pos < (ULONG)size && data[pos] != MOP_END) {
+        if (data[pos] == MOP_COMMAND) {
+            pos++;
+            name = ReadMacroString(data, (ULONG)size, &pos);
+            if (!name || pos >= (ULONG)size) {
+                ok = FALSE;
+                break;
+            }
+            argCount = data[pos++];
+            ok = (BOOL)(argCount <= MACRO_MAX_ARGS);
+            for (i = 0; i < argCount && ok; i++) {
+                args[i] = ReadMacroString(data, (ULONG)size, &pos);
+                ok = (BOOL)(args[i] != NULL);
+            }
+            command = ok ? TTX_FindCommand(name) : NULL;
+            if (ok && !command) {
+                Printf("[MACRO] LoadMacro: FAIL (unknown command '%s')\n", name);
+                ok = FALSE;
+            }
+            if (ok) {
+                ok = AddMacroCommand(macro, TTX_CommandIndex(command), args, argCount);
+            }
+        } else if (data[pos] == MOP_TEXT && pos + 3 <= (ULONG)size) {
+            count = ((ULONG)data[pos + 1] << 8) | data[pos + 2];
+            pos += 3;
+            if (pos + count > (ULONG)size) {
+                ok = FALSE;
+                break;
+            }
+            /* Each run in the file stays a run of its own */
+            macro->textRun = MACRO_NO_RUN;
+            ok = AddMacroText(macro, &data[pos], count);
+            pos += count;
+        } else {
+            ok = FALSE;
+        }
+    }
+
+    freeVec(data);
+    if (!ok) {
+        Printf("[MACRO] LoadMacro: FAIL ('%s' is damaged or out of memory)\n", fileName);
+        FreeMacro(macro);
+        return NULL;
+    }
+    macro->textRun = MACRO_NO_RUN;
+    return macro;
+}
+
+/* String at pos in a macro file (NULL if it runs past the end); pos moves past it */
+static STRPTR ReadMacroString(UBYTE *data, ULONG size, ULONG *pos)
+{
+    ULONG start = *pos;
+
+    while (*pos < size && data[*pos] != '\0') {
+        (*pos)++;
+    }
+    if (*pos >= size) {
+        return NULL;
+    }
+    (*pos)++;
+    return (STRPTR)&data[start];
+}
+
+static ULONG StringLength(STRPTR text)
+{
+    ULONG length = 0;
+
+    while (text[length] != '\0') {
+        length++;
+    }
+    return length;
+}
@@ -0,0 +1,347 @@
+/*
+ * TTX - Markers
+ *
+ * Copyright (c) 2025 amigazen project
+ * Licensed under BSD 2-Clause License
+ *
+ * A marker is a document position that follows edits: a bookmark, the
+ * automark, the last change, a fold anchor. The markers of a document are
+ * kept in one tree, ordered by line then column and balanced as a treap
+ * (each marker has a random priority, and no marker is below one of lower
+ * priority).
+ *
+ * Lines inserted or removed move every marker below them. Rather than visit
+ * each one, the tree is split at the edit and the part below it is tagged
+ * with the change - lines to add, or (for markers on removed lines) a line to
+ * fall onto. The tag stays on the top marker of the part and is handed down a
+ * level whenever the tree is restructured under it, so an edit costs the same
+ * however many markers follow it. Since a tag is always newer than the tags
+ * of the markers below it, a marker's position is its own position with the
+ * tags of the markers above it applied, from its parent up.
+ *
+ * DocumentChanged() reports edits a line at a time, so markers move with
+ * their lines - a marker keeps its column, which is clamped to the line when
+ * the marker is read.
+ */
+
+#include "ttx.h"
+
+/* Source of marker priorities */
+static ULONG g_markerSeed = 0x2545F491UL;
+
+/* Forward declarations */
+static VOID InsertMarker(struct TextDocument *doc, struct Marker *marker);
+static VOID DetachMarker(struct TextDocument *doc, struct Marker *marker);
+static VOID SplitMarkers(struct Marker *root, ULONG y, ULONG x, struct Marker **below, struct Marker **above);
+static struct Marker *MergeMarkers(struct Marker *a, struct Marker *b);
+static VOID TagMarkers(struct Marker *root, BOOL collapse, ULONG collapseY, LONG shift);
+static VOID PushMarkerTags(struct Marker *marker);
+static VOID PushMarkerPath(struct Marker *marker);
+static VOID LinkMarker(struct Marker *marker);
+static VOID FreeMarkerTree(struct Marker *root);
+
+/* ============================================================================
+ * Markers
+ * ============================================================================ */
+
+/* Add a marker at a position - NULL if out of memory */
+struct Marker *AddMarker(struct TextDocument *doc, ULONG y, ULONG x, UWORD kind, UWORD id)
+{
+    struct Marker *marker = NULL;
+
+    if (!doc) {
+        return NULL;
+    }
+
+    marker = (struct Marker *)allocVec(sizeof(struct Marker), MEMF_CLEAR);
+    if (!marker) {
+        return NULL;
+    }
+    g_markerSeed = g_markerSeed * 1664525UL + 1013904223UL;
+    marker->priority = g_markerSeed;
+    marker->y = y;
+    marker->x = x;
+    marker->kind = kind;
+    marker->id = id;
+    InsertMarker(doc, marker);
+    return marker;
+}
+
+/* Take a marker out of its document and free it */
+VOID RemoveMarker(struct TextDocument *doc, struct Marker *marker)
+{
+    if (!doc || !marker) {
+        return;
+    }
+    DetachMarker(doc, marker);
+    freeVec(marker);
+}
+
+/* Put a marker at a new position */
+VOID MoveMarker(struct TextDocument *doc, struct Marker *marker, ULONG y, ULONG x)
+{
+    if (!doc || !marker) {
+        return;
+    }
+    DetachMarker(doc, marker);
+    marker->y = y;
+    marker->x = x;
+    InsertMarker(doc, marker);
+}
+
+/* Where a marker is now, kept inside the document */
+VOID GetMarkerPosition(struct TextDocument *doc, struct Marker *marker, ULONG *y, ULONG *x)
+{
+    struct Marker *above = NULL;
+    ULONG markerY = 0;
+    ULONG markerX = 0;
+
+    *y = 0;
+    *x = 0;
+    if (!doc || !marker || doc->lineCount == 0) {
+        return;
+    }
+
+    /* Tags still waiting above the marker, oldest (nearest) first */
+    markerY = marker->y;
+    markerX = marker->x;
+    for (above = marker->parent; above; above = above->parent) {
+        if (above->collapse) {
+            markerY = above->collapseY;
+            markerX = MARKER_EOL;
+        }
+        markerY = (ULONG)((LONG)markerY + above->shift);
+    }
+
+    if (markerY >= doc->lineCount) {
+        markerY = doc->lineCount - 1;
+    }
+    if (markerX > doc->lines[markerY].length) {
+        markerX = doc->lines[markerY].length;
+    }
+    *y = markerY;
+    *x = markerX;
+}
+
+/* Set one of the document's own marks (a bookmark, the automark, ...), adding it if it is not set yet */
+BOOL SetDocMark(struct TextDocument *doc, struct Marker **mark, UWORD kind, UWORD id, ULONG y, ULONG x)
+{
+    if (!doc || !mark) {
+        return FALSE;
+    }
+    if (*mark) {
+        MoveMarker(doc, *mark, y, x);
+    } else {
+        *mark = AddMarker(doc, y, x, kind, id);
+    }
+    return (BOOL)(*mark != NULL);
+}
+
+/* Clear one of the document's own marks */
+VOID ClearDocMark(struct TextDocument *doc, struct Marker **mark)
+{
+    if (!doc || !mark || !*mark) {
+        return;
+    }
+    RemoveMarker(doc, *mark);
+    *mark = NULL;
+}
+
+/* Follow lineDelta lines inserted (>0) or removed (<0) after lineY - markers on removed lines
+ * fall onto the end of lineY */
+VOID ShiftMarkers(struct TextDocument *doc, ULONG lineY, LONG lineDelta)
+{
+    struct Marker *head = NULL;
+    struct Marker *gone = NULL;
+    struct Marker *tail = NULL;
+
+    if (!doc || !doc->markers || lineDelta == 0 || lineY == DOC_CHANGE_ALL) {
+        return;
+    }
+
+    SplitMarkers(doc->markers, lineY, MARKER_EOL, &head, &tail);
+    if (lineDelta > 0) {
+        TagMarkers(tail, FALSE, 0, lineDelta);
+    } else {
+        SplitMarkers(tail, lineY + (ULONG)(-lineDelta), MARKER_EOL, &gone, &tail);
+        TagMarkers(gone, TRUE, lineY, 0);
+        TagMarkers(tail, FALSE, 0, lineDelta);
+        /* Still in order - what fell onto lineY sorts after what was on it */
+        head = MergeMarkers(head, gone);
+    }
+    doc->markers = MergeMarkers(head, tail);
+}
+
+/* Free every marker of a document */
+VOID FreeMarkers(struct TextDocument *doc)
+{
+    ULONG i = 0;
+
+    if (!doc) {
+        return;
+    }
+    FreeMarkerTree(doc->markers);
+    doc->markers = NULL;
+    for (i = 0; i < TTX_BOOKMARKS; i++) {
+        doc->bookmarks[i] = NULL;
+    }
+    doc->automark = NULL;
+    doc->lastChange = NULL;
+}
+
+/* ============================================================================
+ * Tree
+ * ============================================================================ */
+
+/* Add a detached marker in its place - after any at the same position */
+static VOID InsertMarker(struct TextDocument *doc, struct Marker *marker)
+{
+    struct Marker *below = NULL;
+    struct Marker *above = NULL;
+
+    marker->left = NULL;
+    marker->right = NULL;
+    marker->parent = NULL;
+    marker->shift = 0;
+    marker->collapse = FALSE;
+
+    SplitMarkers(doc->markers, marker->y, marker->x, &below, &above);
+    doc->markers = MergeMarkers(MergeMarkers(below, marker), above);
+}
+
+/* Take a marker out of the tree, leaving it at its true position */
+static VOID DetachMarker(struct TextDocument *doc, struct Marker *marker)
+{
+    struct Marker *parent = NULL;
+    struct Marker *rest = NULL;
+
+    PushMarkerPath(marker);
+    parent = marker->parent;
+    rest = MergeMarkers(marker->left, marker->right);
+    if (rest) {
+        rest->parent = parent;
+    }
+    if (!parent) {
+        doc->markers = rest;
+    } else if (parent->left == marker) {
+        parent->left = rest;
+    } else {
+        parent->right = rest;
+    }
+    marker->left = NULL;
+    marker->right = NULL;
+    marker->parent = NULL;
+}
+
+/* Split a tree into the markers at or before (y, x) and those after it */
+static VOID SplitMarkers(struct Marker *root, ULONG y, ULONG x, struct Marker **below, struct Marker **above)
+{
+    if (!root) {
+        *below = NULL;
+        *above = NULL;
+        return;
+    }
+
+    PushMarkerTags(root);
+    if (root->y < y || (root->y == y && root->x <= x)) {
+        SplitMarkers(root->right, y, x, &root->right, above);
+        LinkMarker(root);
+        *below = root;
+    } else {
+        SplitMarkers(root->left, y, x, below, &root->left);
+        LinkMarker(root);
+        *above = root;
+    }
+    /* Tops of the parts - the caller links them in, or they are roots */
+    if (*below) {
+        (*below)->parent = NULL;
+    }
+    if (*above) {
+        (*above)->parent = NULL;
+    }
+}
+
+/* Join two trees, every marker of a before every marker of b */
+static struct Marker *MergeMarkers(struct Marker *a, struct Marker *b)
+{
+    struct Marker *root = NULL;
+
+    if (!a) {
+        root = b;
+    } else if (!b) {
+        root = a;
+    } else if (a->priority > b->priority) {
+        PushMarkerTags(a);
+        a->right = MergeMarkers(a->right, b);
+        LinkMarker(a);
+        root = a;
+    } else {
+        PushMarkerTags(b);
+        b->left = MergeMarkers(a, b->left);
+        LinkMarker(b);
+        root = b;
+    }
+    if (root) {
+        root->parent = NULL;
+    }
+    return root;
+}
+
+/* Apply a change to the top marker of a tree and leave it pending for the rest */
+static VOID TagMarkers(struct Marker *root, BOOL collapse, ULONG collapseY, LONG shift)
+{
+    if (!root) {
+        return;
+    }
+    if (collapse) {
+        /* Replaces whatever was pending */
+        root->y = collapseY;
+        root->x = MARKER_EOL;
+        root->collapse = TRUE;
+        root->collapseY = collapseY;
+        root->shift = 0;
+    }
+    root->y = (ULONG)((LONG)root->y + shift);
+    root->shift += shift;
+}
+
+/* Hand a marker's pending change down to the markers below it */
+static VOID PushMarkerTags(struct Marker *marker)
+{
+    if (marker->collapse || marker->shift != 0) {
+        TagMarkers(marker->left, marker->collapse, marker->collapseY, marker->shift);
+        TagMarkers(marker->right, marker->collapse, marker->collapseY, marker->shift);
+        marker->collapse = FALSE;
+        marker->shift = 0;
+    }
+}
+
+/* Hand down every change pending above a marker, and its own */
+static VOID PushMarkerPath(struct Marker *marker)
+{
+    if (marker->parent) {
+        PushMarkerPath(marker->parent);
+    }
+    PushMarkerTags(marker);
+}
+
+/* Point a marker's children back at it */
+static VOID LinkMarker(struct Marker *marker)
+{
+    if (marker->left) {
+        marker->left->parent = marker;
+    }
+    if (marker->right) {
+        marker->right->parent = marker;
+    }
+}
+
+static VOID FreeMarkerTree(struct Marker *root)
+{
+    if (!root) {
+        return;
+    }
+    FreeMarkerTree(root->left);
+    FreeMarkerTree(root->right);
+    freeVec(root);
+}
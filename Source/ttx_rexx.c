@@ -0,0 +1,878 @@
+/*
+ * TTX - ARexx Host
+ *
+ * Copyright (c) 2025 amigazen project
+ * Licensed under BSD 2-Clause License
+ *
+ * The public port TTX_REXX_PORT_NAME takes ARexx command messages. A message
+ * carries one command line - the command name and its arguments, with quotes
+ * grouping words - and runs it through the same command table as keys and
+ * menus. A command with something to report leaves it with TTX_SetResult and
+ * it goes back as RESULT when the script asked for one.
+ *
+ * BATCH runs a sequence of commands from a single message, so a script that
+ * works through a whole file does not pay one round trip per command:
+ *
+ *     BATCH [STEM name] command ; command ; ...
+ *
+ * The commands run in order inside one edit batch (the views are painted
+ * once at the end) and stop at the first one that fails. Their results come
+ * back as a vector: in name.1 to name.n with the count in name.0 when STEM is
+ * given, otherwise as RESULT with one line per command.
+ *
+ * Scripts are started by sending a message to RexxMast's REXX port with this
+ * port as the host, so their commands come straight back here. The reply
+ * arrives at the same port once the script ends. Macro files are kept in an
+ * LRU cache: the source goes to ARexx as a string program, so a macro bound
+ * to a key is read from disk once rather than every time it runs. An entry
+ * is keyed by the full path of the file and its datestamp and size, so an
+ * edited macro is picked up on its next run. The cache holds at most
+ * rexxCacheBudget bytes (SetARexxCache); 0 turns it off.
+ */
+
+#include "ttx.h"
+
+#include <clib/alib_protos.h>
+
+#define REXX_MAX_WORDS  32   /* Command name plus arguments */
+#define REXX_VAR_MAX    64   /* Longest stem variable name (with its index) */
+#define REXX_RESULT_PAD 64   /* Spare bytes allocated with a result buffer */
+#define REXX_PATH_MAX   256  /* Longest macro path kept in the cache */
+#define REXX_EXTENSION  "ttx" /* Default extension of macro files */
+
+/* A macro file held in the cache (path and source follow the structure) */
+struct RexxCacheEntry {
+    struct RexxCacheEntry *next;  /* Towards the least recently used */
+    struct RexxCacheEntry *prev;
+    STRPTR path;                  /* Full path from NameFromLock */
+    ULONG stamp[4];               /* Size, days, minute, tick */
+    UBYTE *source;
+    ULONG length;
+    ULONG bytes;                  /* Charged against the cache budget */
+};
+
+/* Results of a batch collected for RESULT */
+struct RexxOutput {
+    UBYTE *text;
+    ULONG length;
+    ULONG size;
+    BOOL failed;
+};
+
+/* Forward declarations */
+static VOID HandleRexxCommand(struct TTXApplication *app, struct RexxMsg *rmsg);
+static BOOL RunRexxLine(struct TTXApplication *app, STRPTR line);
+static VOID RunRexxBatch(struct TTXApplication *app, struct RexxMsg *rmsg, STRPTR line);
+static VOID ReplyRexx(struct RexxMsg *rmsg, LONG rc, STRPTR result, ULONG length);
+static ULONG SplitRexxWords(STRPTR line, STRPTR *words, ULONG maxWords);
+static STRPTR NextRexxCommand(STRPTR *cursor);
+static STRPTR SkipSpaces(STRPTR text);
+static BOOL MatchKeyword(STRPTR *text, STRPTR keyword);
+static VOID SetStemVar(struct RexxMsg *rmsg, STRPTR stem, ULONG stemLength, ULONG index, STRPTR value, ULONG length);
+static VOID AppendOutput(struct RexxOutput *output, STRPTR text, ULONG length);
+static ULONG FormatNumber(ULONG value, UBYTE *out);
+static ULONG StringLength(STRPTR text);
+static BOOL SendRexxProgram(struct TTXApplication *app, STRPTR text, ULONG length, BOOL isString);
+static VOID FreeRexxReply(struct TTXApplication *app, struct RexxMsg *rmsg);
+static BOOL GetMacroStamp(STRPTR fileName, STRPTR path, ULONG pathSize, ULONG *stamp);
+static struct RexxCacheEntry *FindCacheEntry(struct TTXApplication *app, STRPTR path);
+static struct RexxCacheEntry *ReadCacheEntry(STRPTR path, ULONG *stamp);
+static VOID LinkCacheEntry(struct TTXApplication *app, struct RexxCacheEntry *entry);
+static VOID UnlinkCacheEntry(struct TTXApplication *app, struct RexxCacheEntry *entry);
+static VOID TrimRexxCache(struct TTXApplication *app, ULONG budget);
+static BOOL SamePath(STRPTR a, STRPTR b);
+
+/* ============================================================================
+ * Host Port
+ * ============================================================================ */
+
+/* Open the public ARexx port - only one program can own the name */
+BOOL TTX_SetupRexxPort(struct TTXApplication *app)
+{
+    struct MsgPort *existingPort = NULL;
+
+    Printf("[INIT] TTX_SetupRexxPort: START\n");
+    if (!app) {
+        Printf("[INIT] TTX_SetupRexxPort: FAIL (app=NULL)\n");
+        return FALSE;
+    }
+    app->rexxCacheBudget = TTX_REXX_CACHE_DEFAULT;
+
+    Forbid();
+    existingPort = FindPort(TTX_REXX_PORT_NAME);
+    Permit();
+    if (existingPort) {
+        Printf("[INIT] TTX_SetupRexxPort: WARN (port '%s' already exists, no ARexx host)\n", TTX_REXX_PORT_NAME);
+        return FALSE;
+    }
+
+    app->rexxPort = createMsgPort();
+    if (!app->rexxPort) {
+        Printf("[INIT] TTX_SetupRexxPort: FAIL (createMsgPort failed)\n");
+        return FALSE;
+    }
+
+    Forbid();
+    app->rexxPort->mp_Node.ln_Name = TTX_REXX_PORT_NAME;
+    app->rexxPort->mp_Node.ln_Pri = 0;
+    AddPort(app->rexxPort);
+    Permit();
+
+    Printf("[INIT] TTX_SetupRexxPort: SUCCESS (port=%lx, name=%s)\n", (ULONG)app->rexxPort, TTX_REXX_PORT_NAME);
+    return TRUE;
+}
+
+/* Turn away commands still queued at exit (the port itself is freed by the cleanup stack) */
+VOID TTX_CleanupRexxPort(struct TTXApplication *app)
+{
+    struct Message *msg = NULL;
+
+    if (!app) {
+        return;
+    }
+
+    if (app->rexxPort) {
+        /* Scripts we started reply to this port, so it has to outlive them */
+        if (app->rexxPending > 0) {
+            Printf("[REXX] TTX_CleanupRexxPort: waiting for %lu script(s) to end\n", app->rexxPending);
+        }
+        for (;;) {
+            while ((msg = GetMsg(app->rexxPort)) != NULL) {
+                if (msg->mn_Node.ln_Type == NT_REPLYMSG) {
+                    FreeRexxReply(app, (struct RexxMsg *)msg);
+                } else if (RexxSysBase && IsRexxMsg((struct RexxMsg *)msg)) {
+                    ReplyRexx((struct RexxMsg *)msg, RC_FATAL, NULL, 0);
+                } else {
+                    ReplyMsg(msg);
+                }
+            }
+            if (app->rexxPending == 0) {
+                break;
+            }
+            WaitPort(app->rexxPort);
+        }
+        app->rexxPort = NULL;
+    }
+
+    TrimRexxCache(app, 0);
+
+    if (app->resultBuffer) {
+        freeVec(app->resultBuffer);
+        app->resultBuffer = NULL;
+    }
+    app->result = NULL;
+    app->resultSize = 0;
+    app->resultLength = 0;
+    app->resultSet = FALSE;
+}
+
+/* Signal of the ARexx port (0 if there is none) */
+ULONG TTX_RexxSignal(struct TTXApplication *app)
+{
+    if (!app || !app->rexxPort) {
+        return 0;
+    }
+    return 1UL << app->rexxPort->mp_SigBit;
+}
+
+/* Run every command waiting at the ARexx port */
+VOID TTX_HandleRexxMessages(struct TTXApplication *app)
+{
+    struct Message *msg = NULL;
+    struct RexxMsg *rmsg = NULL;
+
+    if (!app || !app->rexxPort) {
+        return;
+    }
+
+    while ((msg = GetMsg(app->rexxPort)) != NULL) {
+        rmsg = (struct RexxMsg *)msg;
+        /* A script we started has ended */
+        if (msg->mn_Node.ln_Type == NT_REPLYMSG) {
+            FreeRexxReply(app, rmsg);
+            continue;
+        }
+        /* rexxsyslib is needed to tell ARexx messages apart and to build results */
+        if (!TTX_NeedLibrary(TTX_LIB_REXXSYS) || !IsRexxMsg(rmsg)) {
+            ReplyMsg(msg);
+            continue;
+        }
+        if ((rmsg->rm_Action & RXCODEMASK) != RXCOMM || !rmsg->rm_Args[0]) {
+            ReplyRexx(rmsg, RC_ERROR, NULL, 0);
+            continue;
+        }
+        HandleRexxCommand(app, rmsg);
+    }
+}
+
+/* Run the command line of one message and reply to it */
+static VOID HandleRexxCommand(struct TTXApplication *app, struct RexxMsg *rmsg)
+{
+    STRPTR line = NULL;
+    STRPTR text = NULL;
+    ULONG length = 0;
+    BOOL ok = FALSE;
+
+    /* Words are split in place, so work on a copy */
+    length = StringLength((STRPTR)rmsg->rm_Args[0]);
+    line = (STRPTR)allocVec(length + 1, MEMF_CLEAR);
+    if (!line) {
+        ReplyRexx(rmsg, RC_FATAL, NULL, 0);
+        return;
+    }
+    CopyMem(rmsg->rm_Args[0], line, length);
+    Printf("[REXX] HandleRexxCommand: '%s'\n", line);
+
+    text = SkipSpaces(line);
+    if (MatchKeyword(&text, "BATCH")) {
+        RunRexxBatch(app, rmsg, text);
+    } else {
+        ok = RunRexxLine(app, text);
+        ReplyRexx(rmsg, ok ? RC_OK : RC_ERROR, app->resultSet ? app->result : NULL, app->resultLength);
+    }
+
+    freeVec(line);
+}
+
+/* Run one command line in the active document (an empty line does nothing) */
+static BOOL RunRexxLine(struct TTXApplication *app, STRPTR line)
+{
+    struct TTXCommand *command = NULL;
+    STRPTR words[REXX_MAX_WORDS];
+    ULONG count = 0;
+
+    TTX_ClearResult(app);
+    count = SplitRexxWords(line, words, REXX_MAX_WORDS);
+    if (count == 0) {
+        return TRUE;
+    }
+
+    command = TTX_FindCommand(words[0]);
+    if (!command) {
+        Printf("[REXX] RunRexxLine: unknown command '%s'\n", words[0]);
+        return FALSE;
+    }
+
+    return TTX_RunCommand(app, app->activeSession, command, &words[1], count - 1);
+}
+
+/* Run the commands of a BATCH message and return their results as a vector */
+static VOID RunRexxBatch(struct TTXApplication *app, struct RexxMsg *rmsg, STRPTR line)
+{
+    struct RexxOutput output;
+    UBYTE stem[REXX_VAR_MAX];
+    STRPTR cursor = NULL;
+    STRPTR command = NULL;
+    ULONG stemLength = 0;
+    ULONG count = 0;
+    BOOL useStem = FALSE;
+    BOOL ok = TRUE;
+
+    output.text = NULL;
+    output.length = 0;
+    output.size = 0;
+    output.failed = FALSE;
+
+    /* STEM name - ARexx symbols are upper case, and the stem ends with a period */
+    cursor = SkipSpaces(line);
+    if (MatchKeyword(&cursor, "STEM")) {
+        cursor = SkipSpaces(cursor);
+        while (*cursor && *cursor != ' ' && *cursor != '\t' && stemLength < REXX_VAR_MAX - 16) {
+            stem[stemLength++] = (*cursor >= 'a' && *cursor <= 'z') ? (UBYTE)(*cursor - 'a' + 'A') : (UBYTE)*cursor;
+            cursor++;
+        }
+        if (stemLength == 0) {
+            ReplyRexx(rmsg, RC_ERROR, NULL, 0);
+            return;
+        }
+        if (stem[stemLength - 1] != '.') {
+            stem[stemLength++] = '.';
+        }
+        useStem = TRUE;
+    }
+
+    BeginEditBatch();
+    while ((command = NextRexxCommand(&cursor)) != NULL) {
+        ok = RunRexxLine(app, command);
+        if (!ok) {
+            break;
+        }
+        count++;
+        if (useStem) {
+            SetStemVar(rmsg, stem, stemLength, count, app->result, app->resultSet ? app->resultLength : 0);
+        } else {
+            if (count > 1) {
+                AppendOutput(&output, "\n", 1);
+            }
+            if (app->resultSet) {
+                AppendOutput(&output, app->result, app->resultLength);
+            }
+        }
+    }
+    EndEditBatch();
+    TTX_RepaintSessions(app);
+
+    Printf("[REXX] RunRexxBatch: %lu command(s) run%s\n", count, ok ? "" : ", stopped at a failure");
+    if (useStem) {
+        UBYTE number[12];
+
+        /* name.0 holds the count */
+        SetStemVar(rmsg, stem, stemLength, 0, number, FormatNumber(count, number));
+        ReplyRexx(rmsg, ok ? RC_OK : RC_ERROR, NULL, 0);
+    } else if (output.failed) {
+        ReplyRexx(rmsg, RC_FATAL, NULL, 0);
+    } else {
+        ReplyRexx(rmsg, ok ? RC_OK : RC_ERROR, output.text ? (STRPTR)output.text : "", output.length);
+    }
+
+    if (output.text) {
+        freeVec(output.text);
+    }
+}
+
+/* Reply with a return code - RESULT only goes back on success, and only if the script asked for it */
+static VOID ReplyRexx(struct RexxMsg *rmsg, LONG rc, STRPTR result, ULONG length)
+{
+    rmsg->rm_Result1 = rc;
+    rmsg->rm_Result2 = 0;
+    if (rc == RC_OK && result && (rmsg->rm_Action & RXFF_RESULT)) {
+        rmsg->rm_Result2 = (LONG)CreateArgstring(result, length);
+    }
+    ReplyMsg((struct Message *)rmsg);
+}
+
+/* ============================================================================
+ * Results
+ * ============================================================================ */
+
+/* Leave a result for the command being run (length bytes of text, which need not be NUL-terminated) */
+BOOL TTX_SetResult(struct TTXApplication *app, STRPTR text, ULONG length)
+{
+    STRPTR buffer = NULL;
+
+    if (!app || !text) {
+        return FALSE;
+    }
+
+    /* The buffer is kept from command to command and only grows */
+    if (length + 1 > app->resultSize) {
+        buffer = (STRPTR)allocVec(length + 1 + REXX_RESULT_PAD, MEMF_CLEAR);
+        if (!buffer) {
+            TTX_ClearResult(app);
+            return FALSE;
+        }
+        if (app->resultBuffer) {
+            freeVec(app->resultBuffer);
+        }
+        app->resultBuffer = buffer;
+        app->resultSize = length + 1 + REXX_RESULT_PAD;
+    }
+
+    CopyMem(text, app->resultBuffer, length);
+    app->resultBuffer[length] = '\0';
+    app->result = app->resultBuffer;
+    app->resultLength = length;
+    app->resultSet = TRUE;
+    return TRUE;
+}
+
+/* Leave text as the result without copying it - it is sent back before the next command
+ * runs, so a slice of line storage or of a view's scratch buffer can be passed directly */
+BOOL TTX_SetResultRef(struct TTXApplication *app, STRPTR text, ULONG length)
+{
+    if (!app || !text) {
+        return FALSE;
+    }
+    app->result = text;
+    app->resultLength = length;
+    app->resultSet = TRUE;
+    return TRUE;
+}
+
+/* Leave a NUL-terminated string as the result */
+BOOL TTX_SetResultString(struct TTXApplication *app, STRPTR text)
+{
+    if (!text) {
+        return FALSE;
+    }
+    return TTX_SetResult(app, text, StringLength(text));
+}
+
+/* Leave a number as the result */
+BOOL TTX_SetResultNumber(struct TTXApplication *app, ULONG value)
+{
+    UBYTE number[12];
+
+    return TTX_SetResult(app, (STRPTR)number, FormatNumber(value, number));
+}
+
+/* Forget the result of the previous command */
+VOID TTX_ClearResult(struct TTXApplication *app)
+{
+    if (!app) {
+        return;
+    }
+    app->resultLength = 0;
+    app->resultSet = FALSE;
+}
+
+/* Set stem.index to length bytes of value (an empty string if value is NULL) */
+static VOID SetStemVar(struct RexxMsg *rmsg, STRPTR stem, ULONG stemLength, ULONG index, STRPTR value, ULONG length)
+{
+    UBYTE name[REXX_VAR_MAX];
+
+    CopyMem(stem, name, stemLength);
+    FormatNumber(index, &name[stemLength]);
+
+    if (SetRexxVar((struct Message *)rmsg, name, value ? value : (STRPTR)"", (LONG)length) != 0) {
+        Printf("[REXX] SetStemVar: WARN (could not set %s)\n", name);
+    }
+}
+
+/* Add to the collected batch results */
+static VOID AppendOutput(struct RexxOutput *output, STRPTR text, ULONG length)
+{
+    UBYTE *buffer = NULL;
+    ULONG size = 0;
+
+    if (output->failed || length == 0) {
+        return;
+    }
+
+    if (output->length + length > output->size) {
+        size = output->size * 2;
+        if (size < output->length + length + REXX_RESULT_PAD) {
+            size = output->length + length + REXX_RESULT_PAD;
+        }
+        buffer = (UBYTE *)allocVec(size, MEMF_CLEAR);
+        if (!buffer) {
+            output->failed = TRUE;
+            return;
+        }
+        if (output->text) {
+            CopyMem(output->text, buffer, output->length);
+            freeVec(output->text);
+        }
+        output->text = buffer;
+        output->size = size;
+    }
+
+    CopyMem(text, &output->text[output->length], length);
+    output->length += length;
+}
+
+/* ============================================================================
+ * Command Lines
+ * ============================================================================ */
+
+/* Split a command line into words in place - quotes group words; returns the word count */
+static ULONG SplitRexxWords(STRPTR line, STRPTR *words, ULONG maxWords)
+{
+    STRPTR read = line;
+    STRPTR write = NULL;
+    UBYTE quote = 0;
+    ULONG count = 0;
+
+    for (;;) {
+        read = SkipSpaces(read);
+        if (*read == '\0' || count == maxWords) {
+            break;
+        }
+
+        /* Words are packed down as quotes are removed */
+        write = read;
+        words[count++] = write;
+        while (*read && (quote || (*read != ' ' && *read != '\t'))) {
+            if (quote && *read == quote) {
+                quote = 0;
+            } else if (!quote && (*read == '"' || *read == '\'')) {
+                quote = *read;
+            } else {
+                *write++ = *read;
+            }
+            read++;
+        }
+        if (*read) {
+            read++;
+        }
+        *write = '\0';
+    }
+
+    return count;
+}
+
+/* Next command of a batch, ended at a ';' outside quotes (NULL when there are no more) */
+static STRPTR NextRexxCommand(STRPTR *cursor)
+{
+    STRPTR start = NULL;
+    STRPTR scan = NULL;
+    UBYTE quote = 0;
+
+    while (**cursor) {
+        start = SkipSpaces(*cursor);
+        for (scan = start; *scan; scan++) {
+            if (quote) {
+                if (*scan == quote) {
+                    quote = 0;
+                }
+            } else if (*scan == '"' || *scan == '\'') {
+                quote = *scan;
+            } else if (*scan == ';') {
+                break;
+            }
+        }
+        if (*scan) {
+            *scan++ = '\0';
+        }
+        *cursor = scan;
+        /* Empty commands (';;' or a trailing ';') are skipped */
+        if (*start) {
+            return start;
+        }
+    }
+
+    return NULL;
+}
+
+static STRPTR SkipSpaces(STRPTR text)
+{
+    while (*text == ' ' || *text == '\t') {
+        text++;
+    }
+    return text;
+}
+
+/* If text starts with keyword as a whole word (any case), move text past it */
+static BOOL MatchKeyword(STRPTR *text, STRPTR keyword)
+{
+    ULONG length = StringLength(keyword);
+    UBYTE end = 0;
+
+    if (Strnicmp(*text, keyword, (LONG)length) != 0) {
+        return FALSE;
+    }
+    end = (*text)[length];
+    if (end != '\0' && end != ' ' && end != '\t') {
+        return FALSE;
+    }
+
+    *text += length;
+    return TRUE;
+}
+
+static ULONG StringLength(STRPTR text)
+{
+    ULONG length = 0;
+
+    while (text[length] != '\0') {
+        length++;
+    }
+    return length;
+}
+
+/* Write value in decimal with a NUL after it; returns the number of digits */
+static ULONG FormatNumber(ULONG value, UBYTE *out)
+{
+    ULONG digits = 0;
+    ULONG rest = value;
+
+    do {
+        digits++;
+        rest /= 10;
+    } while (rest > 0);
+
+    out[digits] = '\0';
+    rest = digits;
+    do {
+        out[--rest] = (UBYTE)('0' + value % 10);
+        value /= 10;
+    } while (rest > 0);
+
+    return digits;
+}
+
+/* ============================================================================
+ * Running Scripts
+ * ============================================================================ */
+
+/* Run a macro file - from the cache when it has not changed since it was read */
+BOOL TTX_ExecRexxMacro(struct TTXApplication *app, STRPTR fileName)
+{
+    struct RexxCacheEntry *entry = NULL;
+    UBYTE path[REXX_PATH_MAX];
+    ULONG stamp[4];
+    BOOL cached = FALSE;
+    BOOL result = FALSE;
+
+    if (!app || !fileName || !app->rexxPort || !TTX_NeedLibrary(TTX_LIB_REXXSYS)) {
+        Printf("[REXX] TTX_ExecRexxMacro: FAIL (no ARexx host port or rexxsyslib)\n");
+        return FALSE;
+    }
+
+    /* A name that does not lock is left to ARexx, which also looks in REXX: */
+    if (!GetMacroStamp(fileName, (STRPTR)path, REXX_PATH_MAX, stamp)) {
+        Printf("[REXX] TTX_ExecRexxMacro: '%s' not found here, passing the name to ARexx\n", fileName);
+        return SendRexxProgram(app, fileName, StringLength(fileName), FALSE);
+    }
+
+    entry = FindCacheEntry(app, (STRPTR)path);
+    if (entry && (entry->stamp[0] != stamp[0] || entry->stamp[1] != stamp[1] ||
+                  entry->stamp[2] != stamp[2] || entry->stamp[3] != stamp[3])) {
+        /* The file has changed since it was cached */
+        UnlinkCacheEntry(app, entry);
+        freeVec(entry);
+        entry = NULL;
+    }
+
+    if (entry) {
+        /* Most recently used goes to the front */
+        UnlinkCacheEntry(app, entry);
+        LinkCacheEntry(app, entry);
+        cached = TRUE;
+    } else {
+        entry = ReadCacheEntry((STRPTR)path, stamp);
+        if (!entry) {
+            Printf("[REXX] TTX_ExecRexxMacro: FAIL (could not read '%s')\n", path);
+            return FALSE;
+        }
+        if (entry->bytes <= app->rexxCacheBudget) {
+            TrimRexxCache(app, app->rexxCacheBudget - entry->bytes);
+            LinkCacheEntry(app, entry);
+            cached = TRUE;
+        }
+    }
+
+    Printf("[REXX] TTX_ExecRexxMacro: '%s' (%lu bytes, %s)\n", path, entry->length,
+           cached ? "cached" : "too big to cache");
+    result = SendRexxProgram(app, (STRPTR)entry->source, entry->length, TRUE);
+
+    if (!cached) {
+        freeVec(entry);
+    }
+    return result;
+}
+
+/* Run a line of ARexx source */
+BOOL TTX_ExecRexxString(struct TTXApplication *app, STRPTR text)
+{
+    if (!app || !text || !app->rexxPort || !TTX_NeedLibrary(TTX_LIB_REXXSYS)) {
+        Printf("[REXX] TTX_ExecRexxString: FAIL (no ARexx host port or rexxsyslib)\n");
+        return FALSE;
+    }
+    return SendRexxProgram(app, text, StringLength(text), TRUE);
+}
+
+/* Start a script with this port as its host; the reply comes back to TTX_HandleRexxMessages */
+static BOOL SendRexxProgram(struct TTXApplication *app, STRPTR text, ULONG length, BOOL isString)
+{
+    struct RexxMsg *rmsg = NULL;
+    struct MsgPort *rexxMast = NULL;
+
+    rmsg = CreateRexxMsg(app->rexxPort, REXX_EXTENSION, TTX_REXX_PORT_NAME);
+    if (!rmsg) {
+        return FALSE;
+    }
+    rmsg->rm_Args[0] = (STRPTR)CreateArgstring(text, length);
+    if (!rmsg->rm_Args[0]) {
+        DeleteRexxMsg(rmsg);
+        return FALSE;
+    }
+    rmsg->rm_Action = RXCOMM | (isString ? RXFF_STRING : 0);
+
+    Forbid();
+    rexxMast = FindPort(RXSDIR);
+    if (rexxMast) {
+        PutMsg(rexxMast, (struct Message *)rmsg);
+    }
+    Permit();
+
+    if (!rexxMast) {
+        Printf("[REXX] SendRexxProgram: FAIL (RexxMast is not running)\n");
+        ClearRexxMsg(rmsg, 1);
+        DeleteRexxMsg(rmsg);
+        return FALSE;
+    }
+
+    app->rexxPending++;
+    return TRUE;
+}
+
+/* Free a script message that ARexx has replied to */
+static VOID FreeRexxReply(struct TTXApplication *app, struct RexxMsg *rmsg)
+{
+    if (rmsg->rm_Result1 != RC_OK) {
+        Printf("[REXX] FreeRexxReply: script failed (rc=%ld, error=%ld)\n", rmsg->rm_Result1, rmsg->rm_Result2);
+    }
+    ClearRexxMsg(rmsg, 1);
+    DeleteRexxMsg(rmsg);
+    if (app->rexxPending > 0) {
+        app->rexxPending--;
+    }
+}
+
+/* ============================================================================
+ * Macro Cache
+ * ============================================================================ */
+
+/* Set the byte budget of the macro cache (0 empties it and turns it off) */
+VOID TTX_SetRexxCacheSize(struct TTXApplication *app, ULONG budget)
+{
+    if (!app) {
+        return;
+    }
+    app->rexxCacheBudget = budget;
+    TrimRexxCache(app, budget);
+    Printf("[REXX] TTX_SetRexxCacheSize: %lu bytes (%lu in use)\n", budget, app->rexxCacheBytes);
+}
+
+/* Drop every cached macro */
+VOID TTX_FlushRexxCache(struct TTXApplication *app)
+{
+    if (!app) {
+        return;
+    }
+    TrimRexxCache(app, 0);
+}
+
+/* Full path, size and date of a macro file (stamp: size, days, minute, tick) */
+static BOOL GetMacroStamp(STRPTR fileName, STRPTR path, ULONG pathSize, ULONG *stamp)
+{
+    BPTR lock = 0;
+    struct FileInfoBlock *fib = NULL;
+    BOOL result = FALSE;
+
+    lock = Lock(fileName, SHARED_LOCK);
+    if (!lock) {
+        SetIoErr(0);
+        return FALSE;
+    }
+    fib = (struct FileInfoBlock *)allocVec(sizeof(struct FileInfoBlock), MEMF_CLEAR);
+    if (fib && Examine(lock, fib) && fib->fib_DirEntryType < 0 && NameFromLock(lock, path, (LONG)pathSize)) {
+        stamp[0] = (ULONG)fib->fib_Size;
+        stamp[1] = (ULONG)fib->fib_Date.ds_Days;
+        stamp[2] = (ULONG)fib->fib_Date.ds_Minute;
+        stamp[3] = (ULONG)fib->fib_Date.ds_Tick;
+        result = TRUE;
+    }
+    if (fib) {
+        freeVec(fib);
+    }
+    UnLock(lock);
+    return result;
+}
+
+/* Cached copy of a macro file (NULL if it is not in the cache) */
+static struct RexxCacheEntry *FindCacheEntry(struct TTXApplication *app, STRPTR path)
+{
+    struct RexxCacheEntry *entry = NULL;
+
+    for (entry = app->rexxCache; entry; entry = entry->next) {
+        if (SamePath(entry->path, path)) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+/* Read a macro file into a new, unlinked entry (one allocation holds it all) */
+static struct RexxCacheEntry *ReadCacheEntry(STRPTR path, ULONG *stamp)
+{
+    struct RexxCacheEntry *entry = NULL;
+    BPTR file = 0;
+    ULONG pathLength = 0;
+    ULONG bytes = 0;
+
+    pathLength = StringLength(path);
+    bytes = sizeof(struct RexxCacheEntry) + pathLength + 1 + stamp[0];
+    entry = (struct RexxCacheEntry *)allocVec(bytes, MEMF_CLEAR);
+    if (!entry) {
+        return NULL;
+    }
+    entry->path = (STRPTR)(entry + 1);
+    entry->source = (UBYTE *)entry->path + pathLength + 1;
+    entry->length = stamp[0];
+    entry->bytes = bytes;
+    CopyMem(path, entry->path, pathLength);
+    CopyMem(stamp, entry->stamp, sizeof(entry->stamp));
+
+    file = Open(path, MODE_OLDFILE);
+    if (!file) {
+        freeVec(entry);
+        return NULL;
+    }
+    if (entry->length > 0 && Read(file, entry->source, (LONG)entry->length) != (LONG)entry->length) {
+        Close(file);
+        freeVec(entry);
+        return NULL;
+    }
+    Close(file);
+    return entry;
+}
+
+/* Put an entry at the front of the cache (most recently used) */
+static VOID LinkCacheEntry(struct TTXApplication *app, struct RexxCacheEntry *entry)
+{
+    entry->prev = NULL;
+    entry->next = app->rexxCache;
+    if (app->rexxCache) {
+        app->rexxCache->prev = entry;
+    } else {
+        app->rexxCacheTail = entry;
+    }
+    app->rexxCache = entry;
+    app->rexxCacheBytes += entry->bytes;
+    app->rexxCacheCount++;
+}
+
+/* Take an entry out of the cache without freeing it */
+static VOID UnlinkCacheEntry(struct TTXApplication *app, struct RexxCacheEntry *entry)
+{
+    if (entry->prev) {
+        entry->prev->next = entry->next;
+    } else {
+        app->rexxCache = entry->next;
+    }
+    if (entry->next) {
+        entry->next->prev = entry->prev;
+    } else {
+        app->rexxCacheTail = entry->prev;
+    }
+    entry->next = NULL;
+    entry->prev = NULL;
+    app->rexxCacheBytes -= entry->bytes;
+    app->rexxCacheCount--;
+}
+
+/* Drop least recently used macros until the cache holds at most budget bytes */
+static VOID TrimRexxCache(struct TTXApplication *app, ULONG budget)
+{
+    struct RexxCacheEntry *entry = NULL;
+
+    while (app->rexxCacheTail && app->rexxCacheBytes > budget) {
+        entry = app->rexxCacheTail;
+        UnlinkCacheEntry(app, entry);
+        freeVec(entry);
+    }
+}
+
+/* AmigaDOS paths compare without regard to case */
+static BOOL SamePath(STRPTR a, STRPTR b)
+{
+    UBYTE ca = 0;
+    UBYTE cb = 0;
+
+    do {
+        ca = (UBYTE)*a++;
+        cb = (UBYTE)*b++;
+        if (ca >= 'a' && ca <= 'z') {
+            ca = (UBYTE)(ca - 'a' + 'A');
+        }
+        if (cb >= 'a' && cb <= 'z') {
+            cb = (UBYTE)(cb - 'a' + 'A');
+        }
+        if (ca != cb) {
+            return FALSE;
+        }
+    } while (ca != '\0');
+    return TRUE;
+}
@@ -0,0 +1,541 @@
+/*
+ * TTX - Syntax Highlighting
+ *
+ * Copyright (c) 2025 amigazen project
+ * Licensed under BSD 2-Clause License
+ *
+ * Lexes lines on demand using rules from the SYNTAX section of the .dfn file.
+ * Each line stores the lexer state at its end; an edit only marks lines dirty
+ * and re-lexing stops as soon as a line ends in the same state as before.
+ */
+
+#include "ttx.h"
+
+/* Lines lexed past the bottom of the visible region */
+#define LEX_LOOKAHEAD_LINES 50
+
+/* Furthest back the lexer walks to find a trusted state before guessing */
+#define LEX_RESYNC_LINES 200
+
+/* Rules shared by all documents (NULL = no highlighting) */
+static struct SyntaxRules *g_syntaxRules = NULL;
+
+/* Forward declarations */
+static ULONG HashKeyword(STRPTR text, ULONG length);
+static UBYTE FoldCase(UBYTE ch, BOOL ignoreCase);
+static BOOL IsWordChar(UBYTE ch);
+static BOOL IsKeyword(struct SyntaxRules *rules, STRPTR text, ULONG length);
+static BOOL MatchDelimiter(STRPTR text, ULONG length, ULONG pos, UBYTE *delim);
+static ULONG DelimiterLength(UBYTE *delim);
+static BOOL IsQuoteChar(struct SyntaxRules *rules, UBYTE ch);
+static ULONG LexNextToken(struct SyntaxRules *rules, STRPTR text, ULONG length, ULONG pos, UBYTE *state, UBYTE *tokenClass);
+static UBYTE LexLineState(struct SyntaxRules *rules, struct TextLine *line, UBYTE state);
+static UBYTE LexLineIfNeeded(struct SyntaxRules *rules, struct TextDocument *doc, ULONG lineY, UBYTE state);
+
+/* ============================================================================
+ * Rules
+ * ============================================================================ */
+
+/* Create an empty rule set with default pens */
+struct SyntaxRules *CreateSyntaxRules(VOID)
+{
+    struct SyntaxRules *rules = NULL;
+
+    rules = (struct SyntaxRules *)allocVec(sizeof(struct SyntaxRules), MEMF_CLEAR);
+    if (!rules) {
+        Printf("[INIT] CreateSyntaxRules: FAIL (allocVec failed)\n");
+        return NULL;
+    }
+
+    /* Pen 1 is the text pen and pen 2 the background (see RenderText) */
+    rules->pens[SYNTAX_TOKEN_TEXT] = 1;
+    rules->pens[SYNTAX_TOKEN_KEYWORD] = 3;
+    rules->pens[SYNTAX_TOKEN_COMMENT] = 0;
+    rules->pens[SYNTAX_TOKEN_STRING] = 3;
+    rules->pens[SYNTAX_TOKEN_NUMBER] = 1;
+    rules->escapeChar = '\\';
+    rules->ignoreCase = FALSE;
+    return rules;
+}
+
+/* Free a rule set and its keywords */
+VOID FreeSyntaxRules(struct SyntaxRules *rules)
+{
+    struct SyntaxKeyword *keyword = NULL;
+    struct SyntaxKeyword *nextKeyword = NULL;
+    ULONG i = 0;
+
+    if (!rules) {
+        return;
+    }
+
+    if (!rules->packed) {
+        for (i = 0; i < SYNTAX_HASH_SIZE; i++) {
+            keyword = rules->keywords[i];
+            while (keyword) {
+                nextKeyword = keyword->next;
+                if (keyword->text) {
+                    freeVec(keyword->text);
+                }
+                freeVec(keyword);
+                keyword = nextKeyword;
+            }
+            rules->keywords[i] = NULL;
+        }
+    }
+
+    freeVec(rules);
+}
+
+/* Add a keyword (copied) */
+BOOL AddSyntaxKeyword(struct SyntaxRules *rules, STRPTR word)
+{
+    struct SyntaxKeyword *keyword = NULL;
+    ULONG length = 0;
+    ULONG bucket = 0;
+
+    if (!rules || !word) {
+        return FALSE;
+    }
+
+    while (word[length] != '\0') {
+        length++;
+    }
+    if (length == 0) {
+        return FALSE;
+    }
+
+    keyword = (struct SyntaxKeyword *)allocVec(sizeof(struct SyntaxKeyword), MEMF_CLEAR);
+    if (!keyword) {
+        return FALSE;
+    }
+    keyword->text = (STRPTR)allocVec(length + 1, MEMF_CLEAR);
+    if (!keyword->text) {
+        freeVec(keyword);
+        return FALSE;
+    }
+    CopyMem(word, keyword->text, length);
+    keyword->text[length] = '\0';
+    keyword->length = length;
+
+    bucket = HashKeyword(keyword->text, length);
+    keyword->next = rules->keywords[bucket];
+    rules->keywords[bucket] = keyword;
+    rules->keywordCount++;
+    return TRUE;
+}
+
+/* Install the rules used for highlighting (takes ownership, frees the previous set) */
+VOID SetSyntaxRules(struct SyntaxRules *rules)
+{
+    if (g_syntaxRules && g_syntaxRules != rules) {
+        FreeSyntaxRules(g_syntaxRules);
+    }
+    g_syntaxRules = rules;
+}
+
+/* Rules in use (NULL if highlighting is off) */
+struct SyntaxRules *GetSyntaxRules(VOID)
+{
+    return g_syntaxRules;
+}
+
+/* ============================================================================
+ * Lexer
+ * ============================================================================ */
+
+static UBYTE FoldCase(UBYTE ch, BOOL ignoreCase)
+{
+    if (ignoreCase && ch >= 'A' && ch <= 'Z') {
+        return (UBYTE)(ch + ('a' - 'A'));
+    }
+    return ch;
+}
+
+/* Bucket from first character and length - cheap and good enough for keyword lists. Always
+ * case-folded, so the bucket does not depend on IGNORE_CASE coming before or after the keywords. */
+static ULONG HashKeyword(STRPTR text, ULONG length)
+{
+    ULONG hash = 0;
+
+    hash = (ULONG)FoldCase((UBYTE)text[0], TRUE);
+    hash = hash * 31 + (ULONG)FoldCase((UBYTE)text[length - 1], TRUE);
+    hash = hash * 31 + length;
+    return hash % SYNTAX_HASH_SIZE;
+}
+
+static BOOL IsWordChar(UBYTE ch)
+{
+    return (BOOL)((ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') ||
+                  (ch >= '0' && ch <= '9') || ch == '_');
+}
+
+static BOOL IsKeyword(struct SyntaxRules *rules, STRPTR text, ULONG length)
+{
+    struct SyntaxKeyword *keyword = NULL;
+    ULONG i = 0;
+
+    if (rules->keywordCount == 0) {
+        return FALSE;
+    }
+
+    for (keyword = rules->keywords[HashKeyword(text, length)]; keyword; keyword = keyword->next) {
+        if (keyword->length != length) {
+            continue;
+        }
+        for (i = 0; i < length; i++) {
+            if (FoldCase((UBYTE)keyword->text[i], rules->ignoreCase) != FoldCase((UBYTE)text[i], rules->ignoreCase)) {
+                break;
+            }
+        }
+        if (i == length) {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+static ULONG DelimiterLength(UBYTE *delim)
+{
+    ULONG length = 0;
+
+    while (length < SYNTAX_DELIM_MAX && delim[length] != '\0') {
+        length++;
+    }
+    return length;
+}
+
+/* Does a (non-empty) delimiter start at pos? */
+static BOOL MatchDelimiter(STRPTR text, ULONG length, ULONG pos, UBYTE *delim)
+{
+    ULONG i = 0;
+    ULONG delimLen = DelimiterLength(delim);
+
+    if (delimLen == 0 || pos + delimLen > length) {
+        return FALSE;
+    }
+    for (i = 0; i < delimLen; i++) {
+        if ((UBYTE)text[pos + i] != delim[i]) {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+static BOOL IsQuoteChar(struct SyntaxRules *rules, UBYTE ch)
+{
+    ULONG i = 0;
+
+    for (i = 0; i < SYNTAX_DELIM_MAX && rules->quoteChars[i] != '\0'; i++) {
+        if (rules->quoteChars[i] == ch) {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+/* Lex one token starting at pos, updating the line state; returns the position after it */
+static ULONG LexNextToken(struct SyntaxRules *rules, STRPTR text, ULONG length, ULONG pos, UBYTE *state, UBYTE *tokenClass)
+{
+    ULONG end = pos;
+    UBYTE ch = 0;
+
+    /* Inside a block comment - runs to its end delimiter or the end of the line */
+    if (*state == LEX_STATE_COMMENT) {
+        *tokenClass = SYNTAX_TOKEN_COMMENT;
+        while (end < length) {
+            if (MatchDelimiter(text, length, end, rules->blockEnd)) {
+                *state = LEX_STATE_NORMAL;
+                return end + DelimiterLength(rules->blockEnd);
+            }
+            end++;
+        }
+        return length;
+    }
+
+    ch = (UBYTE)text[pos];
+
+    if (MatchDelimiter(text, length, pos, rules->lineComment)) {
+        *tokenClass = SYNTAX_TOKEN_COMMENT;
+        return length;
+    }
+
+    if (MatchDelimiter(text, length, pos, rules->blockStart)) {
+        *state = LEX_STATE_COMMENT;
+        *tokenClass = SYNTAX_TOKEN_COMMENT;
+        end = pos + DelimiterLength(rules->blockStart);
+        while (end < length) {
+            if (MatchDelimiter(text, length, end, rules->blockEnd)) {
+                *state = LEX_STATE_NORMAL;
+                return end + DelimiterLength(rules->blockEnd);
+            }
+            end++;
+        }
+        return length;
+    }
+
+    /* Strings end at the matching quote or the end of the line */
+    if (IsQuoteChar(rules, ch)) {
+        *tokenClass = SYNTAX_TOKEN_STRING;
+        end = pos + 1;
+        while (end < length) {
+            if (rules->escapeChar && (UBYTE)text[end] == rules->escapeChar && end + 1 < length) {
+                end += 2;
+                continue;
+            }
+            if ((UBYTE)text[end] == ch) {
+                return end + 1;
+            }
+            end++;
+        }
+        return length;
+    }
+
+    if (ch >= '0' && ch <= '9') {
+        *tokenClass = SYNTAX_TOKEN_NUMBER;
+        while (end < length && (IsWordChar((UBYTE)text[end]) || text[end] == '.')) {
+            end++;
+        }
+        return end;
+    }
+
+    if (IsWordChar(ch)) {
+        while (end < length && IsWordChar((UBYTE)text[end])) {
+            end++;
+        }
+        *tokenClass = IsKeyword(rules, &text[pos], end - pos) ? SYNTAX_TOKEN_KEYWORD : SYNTAX_TOKEN_TEXT;
+        return end;
+    }
+
+    /* Punctuation and spaces up to the next thing that could start a token */
+    *tokenClass = SYNTAX_TOKEN_TEXT;
+    end = pos + 1;
+    while (end < length) {
+        ch = (UBYTE)text[end];
+        if (IsWordChar(ch) || IsQuoteChar(rules, ch) ||
+            MatchDelimiter(text, length, end, rules->lineComment) ||
+            MatchDelimiter(text, length, end, rules->blockStart)) {
+            break;
+        }
+        end++;
+    }
+    return end;
+}
+
+/* Lexer state at the end of a line that starts in state */
+static UBYTE LexLineState(struct SyntaxRules *rules, struct TextLine *line, UBYTE state)
+{
+    ULONG pos = 0;
+    UBYTE tokenClass = 0;
+
+    if (!line->text) {
+        return state;
+    }
+    while (pos < line->length) {
+        pos = LexNextToken(rules, line->text, line->length, pos, &state, &tokenClass);
+    }
+    return state;
+}
+
+/* Re-lex a line only if it is dirty; a changed end state dirties the next line */
+static UBYTE LexLineIfNeeded(struct SyntaxRules *rules, struct TextDocument *doc, ULONG lineY, UBYTE state)
+{
+    struct TextLine *line = &doc->lines[lineY];
+    UBYTE newState = 0;
+
+    if ((line->lexFlags & LEX_FLAG_KNOWN) && !(line->lexFlags & LEX_FLAG_DIRTY)) {
+        return line->lexState;
+    }
+
+    newState = LexLineState(rules, line, state);
+    if (!(line->lexFlags & LEX_FLAG_KNOWN) || newState != line->lexState) {
+        /* Next line starts in a different state - it must be lexed again */
+        if (lineY + 1 < doc->lineCount) {
+            doc->lines[lineY + 1].lexFlags |= LEX_FLAG_DIRTY;
+        }
+    }
+    line->lexState = newState;
+    line->lexFlags = LEX_FLAG_KNOWN;
+    return newState;
+}
+
+/* ============================================================================
+ * Document Integration
+ * ============================================================================ */
+
+/* Mark lines an edit touched (same lineY/lineDelta convention as DocumentChanged) */
+VOID SyntaxLinesChanged(struct TextDocument *doc, ULONG lineY, LONG lineDelta)
+{
+    ULONG i = 0;
+
+    if (!doc || !doc->lines) {
+        return;
+    }
+
+    if (lineY == DOC_CHANGE_ALL) {
+        for (i = 0; i < doc->lineCount; i++) {
+            doc->lines[i].lexFlags = 0;
+        }
+        doc->lexDirtyFrom = 0;
+        return;
+    }
+    if (lineY >= doc->lineCount) {
+        return;
+    }
+
+    doc->lines[lineY].lexFlags |= LEX_FLAG_DIRTY;
+    if (lineDelta > 0) {
+        /* Inserted lines carry whatever the shifted slot held - never lexed */
+        for (i = lineY + 1; i <= lineY + (ULONG)lineDelta && i < doc->lineCount; i++) {
+            doc->lines[i].lexFlags = 0;
+        }
+    } else if (lineDelta < 0 && lineY + 1 < doc->lineCount) {
+        /* Line after the removed ones now follows a different line */
+        doc->lines[lineY + 1].lexFlags |= LEX_FLAG_DIRTY;
+    }
+
+    if (lineY < doc->lexDirtyFrom) {
+        doc->lexDirtyFrom = lineY;
+    }
+}
+
+/* Bring lexer states up to date for lines firstLine..endLine plus the look-ahead */
+/* Only dirty lines are lexed; clean lines between are skipped by a flag test */
+VOID HighlightLines(struct TextDocument *doc, ULONG firstLine, ULONG endLine)
+{
+    struct SyntaxRules *rules = g_syntaxRules;
+    ULONG lineY = 0;
+    ULONG stopLine = 0;
+    UBYTE state = LEX_STATE_NORMAL;
+    BOOL trusted = TRUE;
+
+    if (!rules || !doc || !doc->lines || doc->lineCount == 0) {
+        return;
+    }
+
+    stopLine = endLine + LEX_LOOKAHEAD_LINES;
+    if (stopLine > doc->lineCount) {
+        stopLine = doc->lineCount;
+    }
+    if (firstLine >= stopLine) {
+        return;
+    }
+
+    /* Everything up to stopLine already trusted */
+    if (doc->lexDirtyFrom >= stopLine) {
+        return;
+    }
+
+    lineY = doc->lexDirtyFrom;
+    if (lineY < firstLine && firstLine - lineY > LEX_RESYNC_LINES) {
+        /* Too far to walk (e.g. after a jump into a large file) - resync from a nearby guess */
+        lineY = firstLine - LEX_RESYNC_LINES;
+        trusted = FALSE;
+    }
+
+    if (lineY > 0 && (doc->lines[lineY - 1].lexFlags & LEX_FLAG_KNOWN)) {
+        state = doc->lines[lineY - 1].lexState;
+    } else {
+        state = LEX_STATE_NORMAL;
+    }
+
+    for (; lineY < stopLine; lineY++) {
+        state = LexLineIfNeeded(rules, doc, lineY, state);
+    }
+
+    /* Lines before stopLine are now consistent (unless we had to guess a starting state) */
+    if (trusted) {
+        doc->lexDirtyFrom = stopLine;
+    }
+}
+
+/* Lex up to maxLines trusted lines past lexDirtyFrom in idle time; TRUE if lines are left */
+BOOL LexAhead(struct TextDocument *doc, ULONG maxLines)
+{
+    struct SyntaxRules *rules = g_syntaxRules;
+    ULONG lineY = 0;
+    ULONG stopLine = 0;
+    UBYTE state = LEX_STATE_NORMAL;
+
+    if (!rules || !doc || !doc->lines || doc->lexDirtyFrom >= doc->lineCount) {
+        return FALSE;
+    }
+
+    lineY = doc->lexDirtyFrom;
+    stopLine = lineY + maxLines;
+    if (stopLine > doc->lineCount) {
+        stopLine = doc->lineCount;
+    }
+
+    if (lineY > 0 && (doc->lines[lineY - 1].lexFlags & LEX_FLAG_KNOWN)) {
+        state = doc->lines[lineY - 1].lexState;
+    }
+    for (; lineY < stopLine; lineY++) {
+        state = LexLineIfNeeded(rules, doc, lineY, state);
+    }
+    doc->lexDirtyFrom = stopLine;
+
+    return (BOOL)(stopLine < doc->lineCount);
+}
+
+/* Draw count characters of a line from start at x, coloured by token class */
+/* The lexer runs from the start of the line so state carried into the visible part is right */
+VOID DrawHighlightedText(struct RastPort *rp, struct TextDocument *doc, ULONG lineY, ULONG start, ULONG count, ULONG x, ULONG baseY)
+{
+    struct SyntaxRules *rules = g_syntaxRules;
+    struct TextLine *line = NULL;
+    ULONG pos = 0;
+    ULONG tokenEnd = 0;
+    ULONG stop = start + count;
+    ULONG runStart = start;  /* Pending run of characters sharing one pen */
+    ULONG runEnd = start;
+    UBYTE runPen = 0;
+    ULONG i = 0;
+    UBYTE state = LEX_STATE_NORMAL;
+    UBYTE tokenClass = SYNTAX_TOKEN_TEXT;
+
+    if (!rp || !doc || !doc->lines || lineY >= doc->lineCount || count == 0) {
+        return;
+    }
+    line = &doc->lines[lineY];
+    if (!line->text) {
+        return;
+    }
+
+    if (!rules) {
+        Move(rp, x, baseY);
+        Text(rp, &line->text[start], count);
+        return;
+    }
+
+    if (lineY > 0 && (doc->lines[lineY - 1].lexFlags & LEX_FLAG_KNOWN)) {
+        state = doc->lines[lineY - 1].lexState;
+    }
+
+    while (pos < line->length && pos < stop) {
+        tokenEnd = LexNextToken(rules, line->text, line->length, pos, &state, &tokenClass);
+        if (tokenEnd > start) {
+            /* Flush the pending run when the pen changes, so each colour is one Text() call */
+            if (runEnd > runStart && rules->pens[tokenClass] != runPen) {
+                SetAPen(rp, runPen);
+                Move(rp, x, baseY);
+                Text(rp, &line->text[runStart], runEnd - runStart);
+                for (i = runStart; i < runEnd; i++) {
+                    x += GetCharWidth(rp, (UBYTE)line->text[i]);
+                }
+                runStart = runEnd;
+            }
+            runPen = rules->pens[tokenClass];
+            runEnd = (tokenEnd < stop) ? tokenEnd : stop;
+        }
+        pos = tokenEnd;
+    }
+
+    if (runEnd > runStart) {
+        SetAPen(rp, runPen);
+        Move(rp, x, baseY);
+        Text(rp, &line->text[runStart], runEnd - runStart);
+    }
+
+    SetAPen(rp, 1);  /* Restore text pen */
+}
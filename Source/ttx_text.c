@@ -10,9 +10,18 @@
 /* Initial buffer size constant */
 #define INITIAL_BUFFER_SIZE 16384
 
-/* Initialize text buffer */
+/* Columns ShiftRight indents lines by, and both shifts move a column block by */
+#define SHIFT_WIDTH 4
+
+/* Glyph width cache - one table shared by every view drawn in the same font */
+static struct TextFont *g_glyphFont = NULL;
+static UWORD g_glyphWidths[256];
+
+/* Initialize text buffer - creates a new private document and attaches the buffer to it as a view */
 BOOL InitTextBuffer(struct TextBuffer *buffer, struct CleanupStack *stack)
 {
+    struct TextDocument *doc = NULL;
+    
     Printf("[INIT] InitTextBuffer: START (buffer=%lx)\n", (ULONG)buffer);
     if (!buffer || !stack) {
         Printf("[INIT] InitTextBuffer: FAIL (buffer=%lx, stack=%lx)\n", (ULONG)buffer, (ULONG)stack);
@@ -21,29 +30,18 @@ BOOL InitTextBuffer(struct TextBuffer *buffer, struct CleanupStack *stack)
     
     /* All buffer functions use the provided cleanup stack parameter */
     
-    /* Allocate initial line array using cleanup stack */
-    buffer->maxLines = 1000;
-    buffer->lines = (struct TextLine *)allocVec(buffer->maxLines * sizeof(struct TextLine), MEMF_CLEAR);
-    if (!buffer->lines) {
-        Printf("[INIT] InitTextBuffer: FAIL (allocVec lines failed)\n");
-        return FALSE;
-    }
-    Printf("[INIT] InitTextBuffer: lines=%lx (maxLines=%lu)\n", (ULONG)buffer->lines, buffer->maxLines);
-    
-    /* Initialize first line */
-    buffer->lines[0].allocated = 256;
-    buffer->lines[0].text = (STRPTR)allocVec(buffer->lines[0].allocated, MEMF_CLEAR);
-    if (!buffer->lines[0].text) {
-        Printf("[INIT] InitTextBuffer: FAIL (allocVec line[0].text failed)\n");
-        freeVec(buffer->lines);
-        buffer->lines = NULL;
+    /* Create the document holding the line storage */
+    buffer->doc = NULL;
+    buffer->nextView = NULL;
+    buffer->docChanged = FALSE;
+    buffer->wrap = NULL;
+    doc = CreateDocument(stack);
+    if (!doc) {
+        Printf("[INIT] InitTextBuffer: FAIL (CreateDocument failed)\n");
         return FALSE;
     }
-    Printf("[INIT] InitTextBuffer: line[0].text=%lx\n", (ULONG)buffer->lines[0].text);
-    buffer->lines[0].text[0] = '\0';
-    buffer->lines[0].length = 0;
+    AttachDocument(buffer, doc);
     
-    buffer->lineCount = 1;
     buffer->cursorX = 0;
     buffer->cursorY = 0;
     buffer->scrollX = 0;
@@ -55,7 +53,6 @@ BOOL InitTextBuffer(struct TextBuffer *buffer, struct CleanupStack *stack)
     buffer->maxScrollY = 0;  /* Will be calculated based on buffer content */
     buffer->scrollXShift = 0;  /* No scaling initially */
     buffer->scrollYShift = 0;  /* No scaling initially */
-    buffer->modified = FALSE;
     
     /* Initialize text selection/marking */
     buffer->marking.enabled = FALSE;
@@ -72,178 +69,237 @@ BOOL InitTextBuffer(struct TextBuffer *buffer, struct CleanupStack *stack)
     buffer->lastScrollY = 0;
     buffer->needsFullRedraw = TRUE;
     
-    Printf("[INIT] InitTextBuffer: SUCCESS\n");
+    /* Whole window until the window is split */
+    buffer->viewTop = 0;
+    buffer->viewHeight = 0;
+    buffer->dirtyStart = 0;
+    buffer->dirtyEnd = 0;
+    buffer->scratch = NULL;
+    buffer->scratchSize = 0;
+    buffer->carets = NULL;
+    buffer->caretCount = 0;
+    buffer->caretMax = 0;
+    
+    Printf("[INIT] InitTextBuffer: SUCCESS (doc=%lx)\n", (ULONG)doc);
     return TRUE;
 }
 
-/* Free text buffer */
+/* Free text buffer - detaches the view; the document is freed when its last view goes */
 VOID FreeTextBuffer(struct TextBuffer *buffer, struct CleanupStack *stack)
 {
-    ULONG i = 0;
-    struct CleanupStack *cleanupStack = NULL;
-    
     Printf("[CLEANUP] FreeTextBuffer: START (buffer=%lx)\n", (ULONG)buffer);
     if (!buffer) {
         Printf("[CLEANUP] FreeTextBuffer: DONE (buffer=NULL)\n");
         return;
     }
     
-    /* Use provided cleanup stack */
-    cleanupStack = stack;
+    if (buffer->doc && stack) {
+        DetachDocument(buffer, stack);
+    }
     
-    if (buffer->lines && cleanupStack) {
-        Printf("[CLEANUP] FreeTextBuffer: freeing %lu lines\n", buffer->lineCount);
-        for (i = 0; i < buffer->lineCount; i++) {
-            if (buffer->lines[i].text) {
-                Printf("[CLEANUP] FreeTextBuffer: freeing line[%lu].text=%lx\n", i, (ULONG)buffer->lines[i].text);
-                freeVec(buffer->lines[i].text);
-                buffer->lines[i].text = NULL;
-            }
-        }
-        Printf("[CLEANUP] FreeTextBuffer: freeing lines array=%lx\n", (ULONG)buffer->lines);
-        freeVec(buffer->lines);
-        buffer->lines = NULL;
+    if (buffer->scratch) {
+        freeVec(buffer->scratch);
+        buffer->scratch = NULL;
+        buffer->scratchSize = 0;
     }
+    FreeCarets(buffer);
+    FreeWrap(buffer);
     
-    buffer->lineCount = 0;
-    buffer->maxLines = 0;
     Printf("[CLEANUP] FreeTextBuffer: DONE\n");
 }
 
-/* Load file into text buffer */
-BOOL LoadFile(STRPTR fileName, struct TextBuffer *buffer, struct CleanupStack *stack)
+/* Start reading a file into a new document - a missing file gives an empty one */
+struct FileLoader *BeginLoadFile(STRPTR fileName, struct CleanupStack *stack)
 {
-    BPTR fileHandle = NULL;
-    UBYTE lineBuffer[MAX_LINE_LENGTH];
-    ULONG lineLen = 0;
-    ULONG i = 0;
-    BOOL result = FALSE;
+    struct FileLoader *loader = NULL;
     
-    if (!fileName || !buffer || !stack) {
+    if (!fileName || !stack) {
         SetIoErr(ERROR_REQUIRED_ARG_MISSING);
-        return FALSE;
+        return NULL;
+    }
+    
+    loader = (struct FileLoader *)allocVec(sizeof(struct FileLoader), MEMF_CLEAR);
+    if (!loader) {
+        return NULL;
     }
+    loader->lineCount = 0;
+    loader->failed = FALSE;
+    
+    /* Create the document the file is read into */
+    loader->doc = CreateDocument(stack);
+    if (!loader->doc) {
+        freeVec(loader);
+        return NULL;
+    }
+    /* Nothing read yet, so the layout cache starts out valid and is kept up as lines come in */
+    loader->doc->layoutValid = TRUE;
     
     /* Open file for reading using cleanup stack - if file doesn't exist, create empty buffer */
     /* Clear IoErr() before file operations to ensure clean state */
     SetIoErr(0);
-    fileHandle = openFile(fileName, MODE_OLDFILE);
-    if (!fileHandle) {
-        /* File doesn't exist or open failed - check error and clear it */
-        LONG errorCode = IoErr();
-        if (errorCode != 0) {
-            /* Clear error to prevent dos.library from being left in undefined state */
-            SetIoErr(0);
-        }
-        /* Create empty buffer - this is OK if file doesn't exist */
-        FreeTextBuffer(buffer, stack);
-        if (!InitTextBuffer(buffer, stack)) {
-            return FALSE;
-        }
-        return TRUE;
-    } else {
-        /* File opened successfully - clear any error code that may have been set */
-        SetIoErr(0);
-    }
+    loader->file = openFile(fileName, MODE_OLDFILE);
+    /* A missing file is OK - clear the error to prevent dos.library from being left in undefined state */
+    SetIoErr(0);
+    
+    return loader;
+}
+
+/* Read up to maxLines more lines - returns TRUE while the file has more */
+BOOL ContinueLoadFile(struct FileLoader *loader, ULONG maxLines)
+{
+    struct TextDocument *doc = NULL;
+    UBYTE lineBuffer[MAX_LINE_LENGTH];
+    ULONG lineLen = 0;
+    ULONG i = 0;
+    ULONG read = 0;
     
-    /* Clear existing buffer */
-    FreeTextBuffer(buffer, stack);
-    if (!InitTextBuffer(buffer, stack)) {
-        closeFile(fileHandle);
+    if (!loader || !loader->file || loader->failed) {
         return FALSE;
     }
+    doc = loader->doc;
+    /* Lines go on the end of the document as it is now - another view of it may have edited
+     * what was read so far. The first replaces the empty line the document starts out with. */
+    i = (loader->lineCount > 0) ? doc->lineCount : 0;
     
     /* Read file line by line */
     /* Clear IoErr() before reading to ensure clean state */
     SetIoErr(0);
-    while (FGets(fileHandle, lineBuffer, sizeof(lineBuffer) - 1) != NULL) {
+    while (read < maxLines) {
+        if (FGets(loader->file, lineBuffer, sizeof(lineBuffer) - 1) == NULL) {
+            /* FGets returns NULL on both EOF and error - either way the file is done */
+            SetIoErr(0);
+            closeFile(loader->file);
+            SetIoErr(0);
+            loader->file = NULL;
+            return FALSE;
+        }
         lineLen = 0;
         while (lineBuffer[lineLen] != '\0' && lineBuffer[lineLen] != '\n' && lineLen < sizeof(lineBuffer) - 1) {
             lineLen++;
         }
         
-        /* Remove trailing newline if present */
-        if (lineLen > 0 && lineBuffer[lineLen - 1] == '\n') {
-            lineLen--;
-        }
-        
         /* Expand line array if needed */
-        if (i >= buffer->maxLines) {
+        if (i >= doc->maxLines) {
             ULONG newMax = 0;
             ULONG copyIdx = 0;
             struct TextLine *newLines = NULL;
             
-            newMax = buffer->maxLines * 2;
+            newMax = doc->maxLines * 2;
             newLines = (struct TextLine *)allocVec(newMax * sizeof(struct TextLine), MEMF_CLEAR);
             if (!newLines) {
-                FreeTextBuffer(buffer, stack);
-                closeFile(fileHandle);
+                loader->failed = TRUE;
                 return FALSE;
             }
-            for (copyIdx = 0; copyIdx < buffer->lineCount; copyIdx++) {
-                newLines[copyIdx] = buffer->lines[copyIdx];
+            for (copyIdx = 0; copyIdx < i; copyIdx++) {
+                newLines[copyIdx] = doc->lines[copyIdx];
             }
-            freeVec(buffer->lines);
-            buffer->lines = newLines;
-            buffer->maxLines = newMax;
+            freeVec(doc->lines);
+            doc->lines = newLines;
+            doc->maxLines = newMax;
         }
         
-        /* Allocate line text buffer */
-        buffer->lines[i].allocated = lineLen + 256;
-        buffer->lines[i].text = (STRPTR)allocVec(buffer->lines[i].allocated, MEMF_CLEAR);
-        if (!buffer->lines[i].text) {
-            FreeTextBuffer(buffer, stack);
-            closeFile(fileHandle);
-            return FALSE;
+        /* Allocate line text buffer (line 0 was allocated by CreateDocument - a slot past the
+         * end may still hold the text of a line an edit moved down, so no other is reused) */
+        if (i > 0) {
+            doc->lines[i].text = NULL;
+        } else if (doc->lines[i].text && doc->lines[i].allocated < lineLen + 1) {
+            freeVec(doc->lines[i].text);
+            doc->lines[i].text = NULL;
+        }
+        if (!doc->lines[i].text) {
+            doc->lines[i].allocated = lineLen + 256;
+            doc->lines[i].text = (STRPTR)allocVec(doc->lines[i].allocated, MEMF_CLEAR);
+            if (!doc->lines[i].text) {
+                /* Line 0 always has text, so i > 0 here */
+                doc->lineCount = i;
+                loader->failed = TRUE;
+                return FALSE;
+            }
         }
         
         /* Copy line text */
         if (lineLen > 0) {
-            CopyMem(lineBuffer, buffer->lines[i].text, lineLen);
+            CopyMem(lineBuffer, doc->lines[i].text, lineLen);
         }
-        buffer->lines[i].text[lineLen] = '\0';
-        buffer->lines[i].length = lineLen;
-        
-        i++;
-        
-        /* Add new line if file continues */
-        if (i >= buffer->maxLines) {
-            break;
+        doc->lines[i].text[lineLen] = '\0';
+        doc->lines[i].length = lineLen;
+        if (lineLen > doc->maxLineLength) {
+            doc->maxLineLength = lineLen;
+            doc->maxLineIndex = i;
         }
         
-        buffer->lines[i].allocated = 256;
-        buffer->lines[i].text = (STRPTR)allocVec(buffer->lines[i].allocated, MEMF_CLEAR);
-        if (!buffer->lines[i].text) {
-            buffer->lineCount = i;
-            break;
-        }
-        buffer->lines[i].text[0] = '\0';
-        buffer->lines[i].length = 0;
+        i++;
+        read++;
+        doc->lineCount = i;
+        loader->lineCount++;
     }
     
-    /* FGets loop ended - clear any error codes to prevent dos.library corruption */
-    /* FGets returns NULL on both EOF and error, so we clear IoErr() regardless */
-    SetIoErr(0);
+    return TRUE;
+}
+
+/* Finish a load - returns FALSE if it ran out of memory (the document keeps what was read) */
+BOOL EndLoadFile(struct FileLoader *loader)
+{
+    BOOL result = FALSE;
     
-    buffer->lineCount = i;
-    if (buffer->lineCount == 0) {
-        buffer->lineCount = 1;
+    if (!loader) {
+        return FALSE;
     }
     
-    buffer->cursorX = 0;
-    buffer->cursorY = 0;
-    buffer->modified = FALSE;
-    
     /* Close file using cleanup stack */
     /* Clear IoErr() before closing to ensure clean state */
-    SetIoErr(0);
-    closeFile(fileHandle);
-    /* Clear IoErr() after closing to prevent dos.library from being left in undefined state */
-    SetIoErr(0);
-    result = TRUE;
+    if (loader->file) {
+        SetIoErr(0);
+        closeFile(loader->file);
+        /* Clear IoErr() after closing to prevent dos.library from being left in undefined state */
+        SetIoErr(0);
+        loader->file = NULL;
+    }
+    
+    if (loader->doc->lineCount == 0) {
+        loader->doc->lineCount = 1;
+    }
+    /* Reading lines never marks the document modified - an edit made meanwhile keeps it so */
+    
+    result = (BOOL)!loader->failed;
+    freeVec(loader);
     return result;
 }
 
+/* Load file into text buffer */
+/* The file is read into a fresh document which replaces the buffer's current one only on success */
+BOOL LoadFile(STRPTR fileName, struct TextBuffer *buffer, struct CleanupStack *stack)
+{
+    struct FileLoader *loader = NULL;
+    struct TextDocument *doc = NULL;
+    
+    if (!fileName || !buffer || !stack) {
+        SetIoErr(ERROR_REQUIRED_ARG_MISSING);
+        return FALSE;
+    }
+    
+    loader = BeginLoadFile(fileName, stack);
+    if (!loader) {
+        return FALSE;
+    }
+    doc = loader->doc;
+    while (ContinueLoadFile(loader, 0xFFFFFFFFUL)) {
+        /* Read in one go */
+    }
+    if (!EndLoadFile(loader)) {
+        FreeDocument(doc, stack);
+        return FALSE;
+    }
+    
+    /* Swap the loaded document in for the buffer's previous one */
+    DetachDocument(buffer, stack);
+    AttachDocument(buffer, doc);
+    buffer->cursorX = 0;
+    buffer->cursorY = 0;
+    ClearMarking(buffer);
+    return TRUE;
+}
+
 /* Save text buffer to file */
 BOOL SaveFile(STRPTR fileName, struct TextBuffer *buffer, struct CleanupStack *stack)
 {
@@ -263,15 +319,15 @@ BOOL SaveFile(STRPTR fileName, struct TextBuffer *buffer, struct CleanupStack *s
     }
     
     /* Write each line */
-    for (i = 0; i < buffer->lineCount; i++) {
-        if (buffer->lines[i].text && buffer->lines[i].length > 0) {
-            if (Write(fileHandle, buffer->lines[i].text, buffer->lines[i].length) != buffer->lines[i].length) {
+    for (i = 0; i < buffer->doc->lineCount; i++) {
+        if (buffer->doc->lines[i].text && buffer->doc->lines[i].length > 0) {
+            if (Write(fileHandle, buffer->doc->lines[i].text, buffer->doc->lines[i].length) != buffer->doc->lines[i].length) {
                 closeFile(fileHandle);
                 return FALSE;
             }
         }
         /* Write newline (except for last line if empty) */
-        if (i < buffer->lineCount - 1 || (buffer->lines[i].text && buffer->lines[i].length > 0)) {
+        if (i < buffer->doc->lineCount - 1 || (buffer->doc->lines[i].text && buffer->doc->lines[i].length > 0)) {
             if (Write(fileHandle, "\n", 1) != 1) {
                 closeFile(fileHandle);
                 return FALSE;
@@ -281,7 +337,8 @@ BOOL SaveFile(STRPTR fileName, struct TextBuffer *buffer, struct CleanupStack *s
     
     /* Close file using cleanup stack */
     closeFile(fileHandle);
-    buffer->modified = FALSE;
+    buffer->doc->modified = FALSE;
+    JournalDiscard(buffer->doc);
     result = TRUE;
     return result;
 }
@@ -293,11 +350,11 @@ BOOL InsertChar(struct TextBuffer *buffer, UBYTE ch, struct CleanupStack *stack)
     STRPTR newText = NULL;
     ULONG newAlloc = 0;
     
-    if (!buffer || !buffer->lines || buffer->cursorY >= buffer->lineCount || !stack) {
+    if (!buffer || !buffer->doc || !buffer->doc->lines || buffer->cursorY >= buffer->doc->lineCount || !stack) {
         return FALSE;
     }
     
-    line = &buffer->lines[buffer->cursorY];
+    line = &buffer->doc->lines[buffer->cursorY];
     
     /* Expand line buffer if needed */
     if (line->length + 1 >= line->allocated) {
@@ -333,7 +390,7 @@ BOOL InsertChar(struct TextBuffer *buffer, UBYTE ch, struct CleanupStack *stack)
     line->length++;
     line->text[line->length] = '\0';
     buffer->cursorX++;
-    buffer->modified = TRUE;
+    DocumentChanged(buffer, buffer->cursorY, 0);
     
     return TRUE;
 }
@@ -343,11 +400,11 @@ BOOL DeleteChar(struct TextBuffer *buffer, struct CleanupStack *stack)
 {
     struct TextLine *line = NULL;
     
-    if (!buffer || !buffer->lines || buffer->cursorY >= buffer->lineCount || !stack) {
+    if (!buffer || !buffer->doc || !buffer->doc->lines || buffer->cursorY >= buffer->doc->lineCount || !stack) {
         return FALSE;
     }
     
-    line = &buffer->lines[buffer->cursorY];
+    line = &buffer->doc->lines[buffer->cursorY];
     
     /* Delete character before cursor */
     if (buffer->cursorX > 0) {
@@ -358,11 +415,11 @@ BOOL DeleteChar(struct TextBuffer *buffer, struct CleanupStack *stack)
         line->length--;
         line->text[line->length] = '\0';
         buffer->cursorX--;
-        buffer->modified = TRUE;
+        DocumentChanged(buffer, buffer->cursorY, 0);
         return TRUE;
     } else if (buffer->cursorY > 0) {
         /* Merge with previous line */
-        struct TextLine *prevLine = &buffer->lines[buffer->cursorY - 1];
+        struct TextLine *prevLine = &buffer->doc->lines[buffer->cursorY - 1];
         ULONG prevLen = prevLine->length;
         ULONG currLen = line->length;
         STRPTR newText = NULL;
@@ -397,19 +454,19 @@ BOOL DeleteChar(struct TextBuffer *buffer, struct CleanupStack *stack)
         if (line->text) {
             freeVec(line->text);
         }
-        if (buffer->cursorY < buffer->lineCount - 1) {
+        if (buffer->cursorY < buffer->doc->lineCount - 1) {
             /* Move lines down - copy backwards for overlapping memory */
             ULONG moveCount = 0;
             ULONG i = 0;
-            moveCount = buffer->lineCount - buffer->cursorY - 1;
+            moveCount = buffer->doc->lineCount - buffer->cursorY - 1;
             for (i = 0; i < moveCount; i++) {
-                buffer->lines[buffer->cursorY + i] = buffer->lines[buffer->cursorY + i + 1];
+                buffer->doc->lines[buffer->cursorY + i] = buffer->doc->lines[buffer->cursorY + i + 1];
             }
         }
-        buffer->lineCount--;
+        buffer->doc->lineCount--;
         buffer->cursorY--;
         buffer->cursorX = prevLen;
-        buffer->modified = TRUE;
+        DocumentChanged(buffer, buffer->cursorY, -1);
         return TRUE;
     }
     
@@ -425,46 +482,46 @@ BOOL InsertNewline(struct TextBuffer *buffer, struct CleanupStack *stack)
     ULONG remainingLen = 0;
     ULONG i = 0;
     
-    if (!buffer || !buffer->lines || buffer->cursorY >= buffer->lineCount || !stack) {
+    if (!buffer || !buffer->doc || !buffer->doc->lines || buffer->cursorY >= buffer->doc->lineCount || !stack) {
         return FALSE;
     }
     
     /* Expand line array if needed */
-    if (buffer->lineCount >= buffer->maxLines) {
+    if (buffer->doc->lineCount >= buffer->doc->maxLines) {
         ULONG newMax = 0;
         struct TextLine *newLines = NULL;
         
-        newMax = buffer->maxLines * 2;
+        newMax = buffer->doc->maxLines * 2;
         newLines = (struct TextLine *)allocVec(newMax * sizeof(struct TextLine), MEMF_CLEAR);
         if (newLines) {
-            for (i = 0; i < buffer->lineCount; i++) {
-                newLines[i] = buffer->lines[i];
+            for (i = 0; i < buffer->doc->lineCount; i++) {
+                newLines[i] = buffer->doc->lines[i];
             }
-            freeVec(buffer->lines);
-            buffer->lines = newLines;
-            buffer->maxLines = newMax;
+            freeVec(buffer->doc->lines);
+            buffer->doc->lines = newLines;
+            buffer->doc->maxLines = newMax;
         } else {
             return FALSE;
         }
     }
     
-    line = &buffer->lines[buffer->cursorY];
+    line = &buffer->doc->lines[buffer->cursorY];
     splitPos = buffer->cursorX;
     remainingLen = line->length - splitPos;
     
     /* Shift lines down */
-    for (i = buffer->lineCount; i > buffer->cursorY + 1; i--) {
-        buffer->lines[i] = buffer->lines[i - 1];
+    for (i = buffer->doc->lineCount; i > buffer->cursorY + 1; i--) {
+        buffer->doc->lines[i] = buffer->doc->lines[i - 1];
     }
     
     /* Create new line */
-    newLine = &buffer->lines[buffer->cursorY + 1];
+    newLine = &buffer->doc->lines[buffer->cursorY + 1];
     newLine->allocated = remainingLen + 256;
     newLine->text = (STRPTR)allocVec(newLine->allocated, MEMF_CLEAR);
     if (!newLine->text) {
         /* Restore line array */
-        for (i = buffer->cursorY + 1; i < buffer->lineCount; i++) {
-            buffer->lines[i] = buffer->lines[i + 1];
+        for (i = buffer->cursorY + 1; i < buffer->doc->lineCount; i++) {
+            buffer->doc->lines[i] = buffer->doc->lines[i + 1];
         }
         return FALSE;
     }
@@ -480,10 +537,10 @@ BOOL InsertNewline(struct TextBuffer *buffer, struct CleanupStack *stack)
     line->text[splitPos] = '\0';
     line->length = splitPos;
     
-    buffer->lineCount++;
+    buffer->doc->lineCount++;
     buffer->cursorY++;
     buffer->cursorX = 0;
-    buffer->modified = TRUE;
+    DocumentChanged(buffer, buffer->cursorY - 1, 1);
     
     return TRUE;
 }
@@ -492,7 +549,8 @@ BOOL InsertNewline(struct TextBuffer *buffer, struct CleanupStack *stack)
 ULONG GetCharWidth(struct RastPort *rp, UBYTE ch)
 {
     struct TextFont *font = NULL;
-    ULONG width = 0;
+    ULONG i = 0;
+    UBYTE glyph = 0;
     
     if (!rp) {
         return 8;
@@ -503,9 +561,45 @@ ULONG GetCharWidth(struct RastPort *rp, UBYTE ch)
         return 8;
     }
     
-    /* Use TextLength for accurate width */
-    width = TextLength(rp, (STRPTR)&ch, 1);
-    return width;
+    /* Measure every glyph with TextLength once per font, then look widths up */
+    if (font != g_glyphFont) {
+        for (i = 0; i < 256; i++) {
+            glyph = (UBYTE)i;
+            g_glyphWidths[i] = (UWORD)TextLength(rp, (STRPTR)&glyph, 1);
+        }
+        g_glyphFont = font;
+    }
+    
+    return (ULONG)g_glyphWidths[ch];
+}
+
+/* Get the pixel rows of a view's pane: top is inclusive, bottom exclusive */
+VOID GetViewBounds(struct TextBuffer *buffer, struct Window *window, ULONG *top, ULONG *bottom)
+{
+    ULONG areaTop = 0;
+    ULONG areaBottom = 0;
+    
+    if (!buffer || !window || !top || !bottom) {
+        return;
+    }
+    
+    areaTop = window->BorderTop;
+    areaBottom = window->Height - window->BorderBottom;
+    
+    *top = areaTop + buffer->viewTop;
+    if (buffer->viewHeight > 0) {
+        *bottom = *top + buffer->viewHeight;
+    } else {
+        *bottom = areaBottom;
+    }
+    
+    /* Clamp to the text area (window may have shrunk since the last layout) */
+    if (*bottom > areaBottom) {
+        *bottom = areaBottom;
+    }
+    if (*top > *bottom) {
+        *top = *bottom;
+    }
 }
 
 /* Get line height in pixels */
@@ -533,22 +627,39 @@ VOID ScrollToCursor(struct TextBuffer *buffer, struct Window *window)
     ULONG visibleChars = 0;
     LONG cursorScreenX = 0;  /* Can be negative if cursor is to the left of visible area */
     LONG cursorScreenY = 0;  /* Can be negative if cursor is above visible area */
+    ULONG cursorRow = 0;
+    ULONG rowStart = 0;
+    ULONG pass = 0;
     ULONG i = 0;
+    ULONG viewTop = 0;
+    ULONG viewBottom = 0;
     
     if (!buffer || !window) {
         return;
     }
     
+    if (InEditBatch()) {
+        /* Followed once the edit batch ends */
+        return;
+    }
+    
     rp = window->RPort;
     if (!rp) {
         return;
     }
     
+    /* A cursor moved onto hidden lines opens the folds hiding them */
+    if (IsLineHidden(buffer->doc, buffer->cursorY)) {
+        RevealLine(buffer, buffer->cursorY);
+        CalculateMaxScroll(buffer, window);
+    }
+    
     lineHeight = GetLineHeight(rp);
     if (lineHeight == 0) {
         return;  /* Can't calculate without valid line height */
     }
-    visibleLines = (window->Height - window->BorderTop - window->BorderBottom) / lineHeight;
+    GetViewBounds(buffer, window, &viewTop, &viewBottom);
+    visibleLines = (viewBottom - viewTop) / lineHeight;
     if (visibleLines == 0) {
         visibleLines = 1;  /* At least one line visible */
     }
@@ -563,12 +674,17 @@ VOID ScrollToCursor(struct TextBuffer *buffer, struct Window *window)
     }
     
     /* Calculate cursor screen position (relative to visible area) */
-    /* cursorScreenY = cursor line - scroll position */
+    /* cursorScreenY = cursor row - scroll position row (a row is a line, unless folds are hidden or lines wrapped) */
     /* Negative means cursor is above visible area, >= visibleLines means below */
-    cursorScreenY = (LONG)buffer->cursorY - (LONG)buffer->scrollY;
-    if (buffer->lines && buffer->cursorY < buffer->lineCount) {
-        for (i = 0; i < buffer->cursorX && i < buffer->lines[buffer->cursorY].length; i++) {
-            cursorScreenX += GetCharWidth(rp, (UBYTE)buffer->lines[buffer->cursorY].text[i]);
+    ReflowView(buffer, window);
+    cursorRow = ViewLineToRow(buffer, buffer->cursorY);
+    if (buffer->wrap) {
+        cursorRow += GetWrapRowOf(buffer, rp, buffer->cursorY, buffer->cursorX, &rowStart);
+    }
+    cursorScreenY = (LONG)cursorRow - (LONG)ViewLineToRow(buffer, buffer->scrollY);
+    if (buffer->doc && buffer->doc->lines && buffer->cursorY < buffer->doc->lineCount) {
+        for (i = 0; i < buffer->cursorX && i < buffer->doc->lines[buffer->cursorY].length; i++) {
+            cursorScreenX += GetCharWidth(rp, (UBYTE)buffer->doc->lines[buffer->cursorY].text[i]);
         }
     }
     if (charWidth > 0) {
@@ -597,7 +713,24 @@ VOID ScrollToCursor(struct TextBuffer *buffer, struct Window *window)
     } else if (visibleLines > 0 && cursorScreenY >= (LONG)visibleLines) {
         /* Cursor is below visible area - scroll down to show cursor at bottom */
         ULONG oldScrollY = buffer->scrollY;
-        buffer->scrollY = buffer->cursorY - visibleLines + 1;
+        for (pass = 0; pass < 2; pass++) {
+            /* The first line wholly inside the page that ends on the cursor's row */
+            buffer->scrollY = ViewLineAfterRows(buffer, 0, cursorRow - visibleLines + 1);
+            if (buffer->scrollY > buffer->cursorY) {
+                /* A line taller than the view shows from its top */
+                buffer->scrollY = buffer->cursorY;
+            }
+            if (!buffer->wrap) {
+                break;
+            }
+            /* Rows of lines not measured yet were estimates - once they are, look again */
+            ReflowView(buffer, window);
+            cursorRow = ViewLineToRow(buffer, buffer->cursorY) +
+                        GetWrapRowOf(buffer, rp, buffer->cursorY, buffer->cursorX, &rowStart);
+            if (cursorRow - ViewLineToRow(buffer, buffer->scrollY) < visibleLines) {
+                break;
+            }
+        }
         if (buffer->scrollY < 0) {
             buffer->scrollY = 0;
         }
@@ -611,8 +744,10 @@ VOID ScrollToCursor(struct TextBuffer *buffer, struct Window *window)
         }
     }
     
-    /* Adjust horizontal scroll */
-    if (cursorScreenX < 0) {
+    /* Adjust horizontal scroll - a wrapped view has no use for it */
+    if (buffer->wrap) {
+        buffer->scrollX = 0;
+    } else if (cursorScreenX < 0) {
         buffer->scrollX = 0;
         if (buffer->cursorX > 0) {
             buffer->scrollX = buffer->cursorX - visibleChars / 2;
@@ -782,16 +917,28 @@ VOID RenderText(struct Window *window, struct TextBuffer *buffer)
     ULONG actualChars = 0;
     ULONG testX = 0;
     ULONG linesRendered = 0;
+    ULONG nextY = 0;
+    ULONG lineRows = 0;
+    ULONG rowStart = 0;
+    ULONG rowEnd = 0;
     BOOL useScrollLayer = FALSE;
     LONG scrollDeltaX = 0;
     LONG scrollDeltaY = 0;
     ULONG textAreaHeight = 0;  /* Text area height for calculating visible lines */
     ULONG maxY = 0;  /* Maximum Y coordinate for text (stops before bottom border) */
+    ULONG viewTop = 0;  /* First pixel row of this view's pane */
+    BOOL partial = FALSE;  /* Only repaint the stale lines another view's edit left */
+    struct SyntaxRules *rules = NULL;  /* Syntax highlighting rules (NULL = plain text) */
     
     if (!window || !buffer) {
         return;
     }
     
+    if (InEditBatch()) {
+        /* Painted once the edit batch ends */
+        return;
+    }
+    
     rp = window->RPort;
     if (!rp) {
         return;
@@ -811,7 +958,9 @@ VOID RenderText(struct Window *window, struct TextBuffer *buffer)
     /* Calculate maximum Y coordinate for text rendering - must stop before horizontal scroll bar */
     /* The horizontal scroll bar is positioned at the bottom border */
     /* maxY is the maximum Y coordinate where text can be rendered (exclusive) */
-    maxY = window->Height - window->BorderBottom;  /* Maximum Y coordinate for text (before scroll bar) */
+    /* In a split window both are limited to this view's pane */
+    GetViewBounds(buffer, window, &viewTop, &maxY);
+    partial = (!buffer->needsFullRedraw && buffer->dirtyStart != buffer->dirtyEnd);
     
     /* Calculate maximum characters per line (PageW) */
     /* PageW = (Width - BorderRight - (BorderLeft + leftMargin + 1)) / FontX - 1 */
@@ -835,7 +984,7 @@ VOID RenderText(struct Window *window, struct TextBuffer *buffer)
     
     /* Calculate visible lines - ensure we don't render into bottom border or scroll bar */
     /* Text area height = maxY - top border */
-    textAreaHeight = maxY - window->BorderTop;  /* Actual text area height */
+    textAreaHeight = maxY - viewTop;  /* Actual text area height */
     if (textAreaHeight < 0) {
         textAreaHeight = 0;
     }
@@ -844,10 +993,15 @@ VOID RenderText(struct Window *window, struct TextBuffer *buffer)
         visibleLines = 1;  /* At least show one line if there's any space */
     }
 
+    /* A wrapped view measures the lines it is about to show */
+    ReflowView(buffer, window);
     startY = buffer->scrollY;
-    endY = startY + visibleLines;
-    if (endY > buffer->lineCount) {
-        endY = buffer->lineCount;
+    endY = ViewLineAfterRows(buffer, startY, visibleLines);
+
+    /* Lex only what is about to be drawn (plus a look-ahead), never the whole document */
+    rules = GetSyntaxRules();
+    if (rules) {
+        HighlightLines(buffer->doc, startY, endY);
     }
 
     /* Set clipping rectangle to prevent rendering outside text area */
@@ -864,8 +1018,9 @@ VOID RenderText(struct Window *window, struct TextBuffer *buffer)
     SetAPen(rp, 2);  /* Also set A pen for compatibility */
     SetDrMd(rp, JAM2);  /* Fill mode - use background pen */
     /* Clear text area - use maxY to ensure we don't paint over scroll bar */
-    if (maxY > window->BorderTop) {
-        RectFill(rp, textStartX - 1, window->BorderTop,
+    /* A partial repaint clears each stale line as it is drawn instead */
+    if (!partial && maxY > viewTop) {
+        RectFill(rp, textStartX - 1, viewTop,
                  textEndX, maxY - 1);
     }
     SetDrMd(rp, JAM1);  /* Restore normal text mode */
@@ -875,17 +1030,37 @@ VOID RenderText(struct Window *window, struct TextBuffer *buffer)
     /* Stop rendering before bottom border to avoid painting over scroll bar */
     /* maxY was already calculated above */
     SetAPen(rp, 1);
-    y = window->BorderTop;
-    for (i = startY; i < endY && y < maxY; i++) {
-        if (i < buffer->lineCount) {
+    y = viewTop;
+    for (i = startY; i < endY && y < maxY; i = nextY) {
+        /* Lines of a hidden fold take no row - the next row shows the line after them */
+        nextY = ViewLineAfterRows(buffer, i, 1);
+        lineRows = buffer->wrap ? GetLineRows(buffer, i) : 1;
+        if (partial && (i < buffer->dirtyStart || i >= buffer->dirtyEnd)) {
+            /* Line still shows current text */
+            y += lineRows * lineHeight;
+            continue;
+        }
+        if (partial) {
+            ULONG clearBottom = y + lineRows * lineHeight - 1;
+            if (clearBottom >= maxY) {
+                clearBottom = maxY - 1;
+            }
+            SetBPen(rp, 2);
+            SetAPen(rp, 2);
+            SetDrMd(rp, JAM2);
+            RectFill(rp, textStartX - 1, y, textEndX, clearBottom);
+            SetDrMd(rp, JAM1);
+            SetAPen(rp, 1);
+        }
+        if (i < buffer->doc->lineCount) {
             ULONG selectStartX = 0;
             ULONG selectStopX = 0;
             BOOL lineHasSelection = FALSE;
             ULONG selectStartPixel = 0;
             ULONG selectStopPixel = 0;
             
-            lineText = buffer->lines[i].text;
-            lineLen = buffer->lines[i].length;
+            lineText = buffer->doc->lines[i].text;
+            lineLen = buffer->doc->lines[i].length;
             
             /* Check if this line has selection */
             if (buffer->marking.enabled) {
@@ -895,7 +1070,17 @@ VOID RenderText(struct Window *window, struct TextBuffer *buffer)
                 ULONG markStopX = buffer->marking.stopX;
                 
                 /* Normalize marking (ensure start is before stop) */
-                if (markStopY < markStartY || (markStopY == markStartY && markStopX < markStartX)) {
+                if (buffer->marking.column) {
+                    /* Column block - same columns on every line, ordered one axis at a time */
+                    if (markStopY < markStartY) {
+                        markStartY = buffer->marking.stopY;
+                        markStopY = buffer->marking.startY;
+                    }
+                    if (markStopX < markStartX) {
+                        markStartX = buffer->marking.stopX;
+                        markStopX = buffer->marking.startX;
+                    }
+                } else if (markStopY < markStartY || (markStopY == markStartY && markStopX < markStartX)) {
                     ULONG tempY = markStartY;
                     ULONG tempX = markStartX;
                     markStartY = markStopY;
@@ -906,7 +1091,13 @@ VOID RenderText(struct Window *window, struct TextBuffer *buffer)
                 
                 /* Check if this line is within selection */
                 if (i >= markStartY && i <= markStopY) {
-                    if (i == markStartY && i == markStopY) {
+                    if (buffer->marking.column) {
+                        if (markStartX < lineLen && markStopX > markStartX) {
+                            selectStartX = markStartX;
+                            selectStopX = (markStopX < lineLen) ? markStopX : lineLen;
+                            lineHasSelection = TRUE;
+                        }
+                    } else if (i == markStartY && i == markStopY) {
                         /* Single line selection */
                         if (markStartX < lineLen && markStopX > 0) {
                             selectStartX = markStartX;
@@ -942,169 +1133,191 @@ VOID RenderText(struct Window *window, struct TextBuffer *buffer)
                 }
             }
             
-            /* ScollX_PageW = ScrollX + PageW + 1 (maximum character index that should be visible) */
-            maxVisibleChar = 0;
-            if (buffer->pageW > 0 && buffer->scrollX + buffer->pageW + 1 < lineLen) {
-                maxVisibleChar = buffer->scrollX + buffer->pageW + 1;
-            } else {
-                maxVisibleChar = lineLen;
-            }
-            
-            /* Calculate starting X position (text starts at BorderLeft + leftMargin + 1) */
-            /* Calculate pixel offset for horizontal scroll */
-            {
-                ULONG scrollXPixels = 0;
-                ULONG charIdx = 0;
-                
-                /* Measure pixel width of scrolled characters */
-                for (charIdx = 0; charIdx < buffer->scrollX && charIdx < lineLen; charIdx++) {
-                    scrollXPixels += GetCharWidth(rp, (UBYTE)lineText[charIdx]);
+            /* A wrapped line is drawn a row at a time - each row as if scrolled to its first column */
+            for (rowStart = buffer->wrap ? 0 : buffer->scrollX; ; rowStart = rowEnd) {
+                rowEnd = buffer->wrap ? GetWrapBreak(rp, &buffer->doc->lines[i], rowStart, buffer->wrap->width) : lineLen;
+                    
+                /* ScollX_PageW = ScrollX + PageW + 1 (maximum character index that should be visible) */
+                maxVisibleChar = 0;
+                if (buffer->wrap) {
+                    maxVisibleChar = rowEnd;
+                } else if (buffer->pageW > 0 && rowStart + buffer->pageW + 1 < lineLen) {
+                    maxVisibleChar = rowStart + buffer->pageW + 1;
+                } else {
+                    maxVisibleChar = lineLen;
                 }
                 
-                /* Start text rendering at textStartX minus the scroll offset */
-                /* This allows horizontal scrolling by pixel offset */
-                if (scrollXPixels < textStartX) {
-                    textX = textStartX - scrollXPixels;
-                } else {
-                    /* Scrolled too far - text starts off-screen */
-                    textX = textStartX;
+                /* Calculate starting X position (text starts at BorderLeft + leftMargin + 1) */
+                /* Calculate pixel offset for horizontal scroll */
+                {
+                    ULONG scrollXPixels = 0;
+                    ULONG charIdx = 0;
+                    
+                    /* Measure pixel width of scrolled characters (a row of a wrapped line starts at the edge) */
+                    for (charIdx = 0; !buffer->wrap && charIdx < rowStart && charIdx < lineLen; charIdx++) {
+                        scrollXPixels += GetCharWidth(rp, (UBYTE)lineText[charIdx]);
+                    }
+                    
+                    /* Start text rendering at textStartX minus the scroll offset */
+                    /* This allows horizontal scrolling by pixel offset */
+                    if (scrollXPixels < textStartX) {
+                        textX = textStartX - scrollXPixels;
+                    } else {
+                        /* Scrolled too far - text starts off-screen */
+                        textX = textStartX;
+                    }
                 }
-            }
-            
-            /* Calculate how many characters to render */
-            renderStart = buffer->scrollX;
-            if (renderStart > lineLen) {
-                renderStart = lineLen;
-            }
-            
-            /* Clip to maximum visible character */
-            if (renderStart >= maxVisibleChar) {
-                /* All text is to the right of visible area - clear entire line */
-                charsToRender = 0;
-                textEndPixel = textStartX;
-            } else {
-                /* Calculate how many characters fit */
-                charsToRender = lineLen - renderStart;
-                if (renderStart + charsToRender > maxVisibleChar) {
-                    charsToRender = maxVisibleChar - renderStart;
+                
+                /* Calculate how many characters to render */
+                renderStart = rowStart;
+                if (renderStart > lineLen) {
+                    renderStart = lineLen;
                 }
                 
-                /* Render line text, clipping to boundary */
-                /* Render text up to PageW, then clear remaining area */
-                if (lineText && charsToRender > 0 && renderStart < lineLen) {
-                    /* Calculate actual characters to render by measuring pixel width */
-                    /* We need to ensure text never exceeds textEndX */
-                    actualChars = 0;
-                    testX = textX;
-                    
-                    /* Measure how many characters actually fit */
-                    for (charIdx = 0; charIdx < charsToRender && (renderStart + charIdx) < lineLen; charIdx++) {
-                        ULONG charW = GetCharWidth(rp, (UBYTE)lineText[renderStart + charIdx]);
-                        /* Check if adding this character would exceed boundary */
-                        if (testX + charW > textEndX) {
-                            /* Stop - this character would exceed boundary */
-                            break;
-                        }
-                        testX += charW;
-                        actualChars++;
+                /* Clip to maximum visible character */
+                if (renderStart >= maxVisibleChar) {
+                    /* All text is to the right of visible area - clear entire line */
+                    charsToRender = 0;
+                    textEndPixel = textStartX;
+                } else {
+                    /* Calculate how many characters fit */
+                    charsToRender = lineLen - renderStart;
+                    if (renderStart + charsToRender > maxVisibleChar) {
+                        charsToRender = maxVisibleChar - renderStart;
                     }
                     
-                    /* Render text in segments if there's a selection on this line */
-                    if (lineHasSelection && selectStartX < renderStart + actualChars && selectStopX > renderStart) {
-                        /* Render text with selection highlighting */
-                        ULONG segStart = renderStart;
-                        ULONG segEnd = renderStart + actualChars;
-                        ULONG currentX = textX;
-                        ULONG charIdx = 0;
+                    /* Render line text, clipping to boundary */
+                    /* Render text up to PageW, then clear remaining area */
+                    if (lineText && charsToRender > 0 && renderStart < lineLen) {
+                        /* Calculate actual characters to render by measuring pixel width */
+                        /* We need to ensure text never exceeds textEndX */
+                        actualChars = 0;
+                        testX = textX;
                         
-                        /* Segment 1: Before selection (if any) */
-                        if (selectStartX > renderStart) {
-                            ULONG beforeLen = (selectStartX < segEnd) ? (selectStartX - renderStart) : actualChars;
-                            if (beforeLen > 0) {
-                                SetAPen(rp, 1);  /* Black text */
-                                Move(rp, currentX, y + rp->Font->tf_Baseline);
-                                Text(rp, &lineText[renderStart], beforeLen);
-                                /* Calculate pixel position after this segment */
-                                for (charIdx = 0; charIdx < beforeLen; charIdx++) {
-                                    currentX += GetCharWidth(rp, (UBYTE)lineText[renderStart + charIdx]);
-                                }
+                        /* Measure how many characters actually fit */
+                        for (charIdx = 0; charIdx < charsToRender && (renderStart + charIdx) < lineLen; charIdx++) {
+                            ULONG charW = GetCharWidth(rp, (UBYTE)lineText[renderStart + charIdx]);
+                            /* Check if adding this character would exceed boundary */
+                            if (testX + charW > textEndX) {
+                                /* Stop - this character would exceed boundary */
+                                break;
                             }
+                            testX += charW;
+                            actualChars++;
                         }
                         
-                        /* Segment 2: Selection (inverted colors) */
-                        if (selectStopX > renderStart && selectStartX < segEnd) {
-                            ULONG selStart = (selectStartX > renderStart) ? selectStartX : renderStart;
-                            ULONG selEnd = (selectStopX < segEnd) ? selectStopX : segEnd;
-                            ULONG selLen = selEnd - selStart;
+                        /* Render text in segments if there's a selection on this line */
+                        if (lineHasSelection && selectStartX < renderStart + actualChars && selectStopX > renderStart) {
+                            /* Render text with selection highlighting */
+                            ULONG segStart = renderStart;
+                            ULONG segEnd = renderStart + actualChars;
+                            ULONG currentX = textX;
+                            ULONG charIdx = 0;
                             
-                            if (selLen > 0 && selStart < lineLen) {
-                                /* Draw selection background */
-                                ULONG selStartPixel = currentX;
-                                ULONG selStopPixel = currentX;
-                                ULONG measureIdx = 0;
-                                
-                                for (measureIdx = selStart; measureIdx < selEnd && measureIdx < lineLen; measureIdx++) {
-                                    selStopPixel += GetCharWidth(rp, (UBYTE)lineText[measureIdx]);
+                            /* Segment 1: Before selection (if any) */
+                            if (selectStartX > renderStart) {
+                                ULONG beforeLen = (selectStartX < segEnd) ? (selectStartX - renderStart) : actualChars;
+                                if (beforeLen > 0) {
+                                    SetAPen(rp, 1);  /* Black text */
+                                    Move(rp, currentX, y + rp->Font->tf_Baseline);
+                                    Text(rp, &lineText[renderStart], beforeLen);
+                                    /* Calculate pixel position after this segment */
+                                    for (charIdx = 0; charIdx < beforeLen; charIdx++) {
+                                        currentX += GetCharWidth(rp, (UBYTE)lineText[renderStart + charIdx]);
+                                    }
                                 }
+                            }
+                            
+                            /* Segment 2: Selection (inverted colors) */
+                            if (selectStopX > renderStart && selectStartX < segEnd) {
+                                ULONG selStart = (selectStartX > renderStart) ? selectStartX : renderStart;
+                                ULONG selEnd = (selectStopX < segEnd) ? selectStopX : segEnd;
+                                ULONG selLen = selEnd - selStart;
                                 
-                                SetBPen(rp, 1);  /* Black background */
-                                SetAPen(rp, 2);  /* Grey text */
-                                SetDrMd(rp, JAM2);
-                                RectFill(rp, selStartPixel, y, selStopPixel - 1, y + lineHeight - 1);
-                                
-                                /* Render selected text with inverted colors */
-                                SetAPen(rp, 2);  /* Grey text on black background */
-                                Move(rp, selStartPixel, y + rp->Font->tf_Baseline);
-                                Text(rp, &lineText[selStart], selLen);
-                                
-                                currentX = selStopPixel;
-                                SetAPen(rp, 1);  /* Restore black text */
-                                SetDrMd(rp, JAM1);
+                                if (selLen > 0 && selStart < lineLen) {
+                                    /* Draw selection background */
+                                    ULONG selStartPixel = currentX;
+                                    ULONG selStopPixel = currentX;
+                                    ULONG measureIdx = 0;
+                                    
+                                    for (measureIdx = selStart; measureIdx < selEnd && measureIdx < lineLen; measureIdx++) {
+                                        selStopPixel += GetCharWidth(rp, (UBYTE)lineText[measureIdx]);
+                                    }
+                                    
+                                    SetBPen(rp, 1);  /* Black background */
+                                    SetAPen(rp, 2);  /* Grey text */
+                                    SetDrMd(rp, JAM2);
+                                    RectFill(rp, selStartPixel, y, selStopPixel - 1, y + lineHeight - 1);
+                                    
+                                    /* Render selected text with inverted colors */
+                                    SetAPen(rp, 2);  /* Grey text on black background */
+                                    Move(rp, selStartPixel, y + rp->Font->tf_Baseline);
+                                    Text(rp, &lineText[selStart], selLen);
+                                    
+                                    currentX = selStopPixel;
+                                    SetAPen(rp, 1);  /* Restore black text */
+                                    SetDrMd(rp, JAM1);
+                                }
                             }
-                        }
-                        
-                        /* Segment 3: After selection (if any) */
-                        if (selectStopX < segEnd) {
-                            ULONG afterStart = selectStopX;
-                            ULONG afterLen = segEnd - afterStart;
-                            if (afterLen > 0 && afterStart < lineLen) {
-                                SetAPen(rp, 1);  /* Black text */
-                                Move(rp, currentX, y + rp->Font->tf_Baseline);
-                                Text(rp, &lineText[afterStart], afterLen);
-                                /* Calculate pixel position after this segment */
-                                for (charIdx = 0; charIdx < afterLen; charIdx++) {
-                                    currentX += GetCharWidth(rp, (UBYTE)lineText[afterStart + charIdx]);
+                            
+                            /* Segment 3: After selection (if any) */
+                            if (selectStopX < segEnd) {
+                                ULONG afterStart = selectStopX;
+                                ULONG afterLen = segEnd - afterStart;
+                                if (afterLen > 0 && afterStart < lineLen) {
+                                    SetAPen(rp, 1);  /* Black text */
+                                    Move(rp, currentX, y + rp->Font->tf_Baseline);
+                                    Text(rp, &lineText[afterStart], afterLen);
+                                    /* Calculate pixel position after this segment */
+                                    for (charIdx = 0; charIdx < afterLen; charIdx++) {
+                                        currentX += GetCharWidth(rp, (UBYTE)lineText[afterStart + charIdx]);
+                                    }
                                 }
                             }
-                        }
-                        
-                        textEndPixel = currentX;
-                    } else {
-                        /* No selection on this line - render normally */
-                        if (actualChars > 0) {
-                            Move(rp, textX, y + rp->Font->tf_Baseline);
-                            Text(rp, &lineText[renderStart], actualChars);
-                            textEndPixel = testX;  /* Use measured width */
+                            
+                            textEndPixel = currentX;
                         } else {
-                            textEndPixel = textStartX;
+                            /* No selection on this line - render normally */
+                            if (actualChars > 0 && rules) {
+                                DrawHighlightedText(rp, buffer->doc, i, renderStart, actualChars, textX, y + rp->Font->tf_Baseline);
+                                textEndPixel = testX;  /* Use measured width */
+                            } else if (actualChars > 0) {
+                                Move(rp, textX, y + rp->Font->tf_Baseline);
+                                Text(rp, &lineText[renderStart], actualChars);
+                                textEndPixel = testX;  /* Use measured width */
+                            } else {
+                                textEndPixel = textStartX;
+                            }
                         }
+                    } else {
+                        /* No text to render - start position is textStartX */
+                        textEndPixel = textStartX;
                     }
-                } else {
-                    /* No text to render - start position is textStartX */
-                    textEndPixel = textStartX;
                 }
+                
+                /* Clear remaining area after text to exact boundary */
+                /* Only clear if we haven't reached the right boundary */
+                if (textEndPixel <= textEndX) {
+                    SetBPen(rp, 2);  /* Background pen (grey) */
+                    SetAPen(rp, 2);
+                    SetDrMd(rp, JAM2);
+                    RectFill(rp, textEndPixel, y,
+                             textEndX, y + lineHeight - 1);
+                    SetDrMd(rp, JAM1);
+                    SetAPen(rp, 1);  /* Restore text pen */
+                }
+                    
+                if (rowEnd >= lineLen || y + lineHeight >= maxY) {
+                    break;
+                }
+                y += lineHeight;
             }
             
-            /* Clear remaining area after text to exact boundary */
-            /* Only clear if we haven't reached the right boundary */
-            if (textEndPixel <= textEndX) {
-                SetBPen(rp, 2);  /* Background pen (grey) */
-                SetAPen(rp, 2);
-                SetDrMd(rp, JAM2);
-                RectFill(rp, textEndPixel, y,
-                         textEndX, y + lineHeight - 1);
-                SetDrMd(rp, JAM1);
-                SetAPen(rp, 1);  /* Restore text pen */
+            /* Lines of a hidden fold follow - rule off the line they hide behind */
+            if (nextY > i + 1 && y + lineHeight <= maxY) {
+                SetAPen(rp, 1);
+                Move(rp, textStartX - 1, y + lineHeight - 1);
+                Draw(rp, textEndX, y + lineHeight - 1);
             }
         }
         y += lineHeight;
@@ -1137,60 +1350,101 @@ VOID RenderText(struct Window *window, struct TextBuffer *buffer)
         buffer->lastScrollY = buffer->scrollY;
         buffer->needsFullRedraw = FALSE;
     }
+    buffer->dirtyStart = 0;
+    buffer->dirtyEnd = 0;
 }
 
-/* Update cursor display */
-VOID UpdateCursor(struct Window *window, struct TextBuffer *buffer)
+/* Draw a caret at a text position, if it is inside the view's pane */
+static VOID DrawCaret(struct Window *window, struct TextBuffer *buffer, ULONG y, ULONG x,
+                      ULONG lineHeight, ULONG viewTop, ULONG viewBottom)
 {
-    struct RastPort *rp = NULL;
-    ULONG lineHeight = 0;
-    ULONG charWidth = 0;
+    struct RastPort *rp = window->RPort;
     ULONG i = 0;
     ULONG screenX = 0;
     ULONG screenY = 0;
     ULONG scrollOffset = 0;
+    ULONG row = 0;
+    ULONG rowStart = 0;
     
-    if (!window || !buffer) {
+    /* Scrolled out of this view's pane, or on a line a hidden fold takes off it - nothing to draw */
+    if (y < buffer->scrollY || IsLineHidden(buffer->doc, y)) {
         return;
     }
-    
-    rp = window->RPort;
-    if (!rp) {
+    row = ViewLineToRow(buffer, y) - ViewLineToRow(buffer, buffer->scrollY);
+    if (buffer->wrap) {
+        /* On the row of the line the column is on, counted from where that row starts */
+        row += GetWrapRowOf(buffer, rp, y, x, &rowStart);
+    }
+    if (viewTop + (row + 1) * lineHeight > viewBottom) {
         return;
     }
     
-    lineHeight = GetLineHeight(rp);
-    charWidth = GetCharWidth(rp, 'M');
+    /* Calculate caret screen position (text starts after the left margin) */
+    screenY = viewTop + row * lineHeight;
+    screenX = window->BorderLeft + buffer->leftMargin + 1;
     
-    /* Calculate text start position (accounting for left margin) */
-    {
-        ULONG textStartX = window->BorderLeft + buffer->leftMargin + 1;
-        
-        /* Calculate cursor screen position */
-        screenY = window->BorderTop + (buffer->cursorY - buffer->scrollY) * lineHeight;
-        screenX = textStartX;
-    
-    if (buffer->lines && buffer->cursorY < buffer->lineCount) {
-        /* Calculate X position of cursor in line */
-        for (i = 0; i < buffer->cursorX && i < buffer->lines[buffer->cursorY].length; i++) {
-            screenX += GetCharWidth(rp, (UBYTE)buffer->lines[buffer->cursorY].text[i]);
+    if (buffer->doc && buffer->doc->lines && y < buffer->doc->lineCount) {
+        /* Calculate X position of caret in line */
+        for (i = rowStart; i < x && i < buffer->doc->lines[y].length; i++) {
+            screenX += GetCharWidth(rp, (UBYTE)buffer->doc->lines[y].text[i]);
         }
         /* Account for horizontal scroll */
         if (buffer->scrollX > 0) {
             scrollOffset = 0;
-            for (i = 0; i < buffer->scrollX && i < buffer->lines[buffer->cursorY].length; i++) {
-                scrollOffset += GetCharWidth(rp, (UBYTE)buffer->lines[buffer->cursorY].text[i]);
+            for (i = 0; i < buffer->scrollX && i < buffer->doc->lines[y].length; i++) {
+                scrollOffset += GetCharWidth(rp, (UBYTE)buffer->doc->lines[y].text[i]);
             }
             screenX -= scrollOffset;
         }
     }
-    }  /* End textStartX scope */
+    
+    Move(rp, screenX, screenY);
+    Draw(rp, screenX, screenY + lineHeight - 1);
+}
+
+/* Update cursor display - and the view's other carets */
+VOID UpdateCursor(struct Window *window, struct TextBuffer *buffer)
+{
+    struct RastPort *rp = NULL;
+    ULONG lineHeight = 0;
+    ULONG viewTop = 0;
+    ULONG viewBottom = 0;
+    ULONG endY = 0;
+    ULONG i = 0;
+    
+    if (!window || !buffer) {
+        return;
+    }
+    
+    if (InEditBatch()) {
+        /* Placed once the edit batch ends */
+        return;
+    }
+    
+    rp = window->RPort;
+    if (!rp) {
+        return;
+    }
+    
+    lineHeight = GetLineHeight(rp);
+    GetViewBounds(buffer, window, &viewTop, &viewBottom);
     
     /* Draw cursor using XOR mode for visibility */
     SetDrMd(rp, JAM2);
     SetAPen(rp, 1);  /* Use pen 1 (black) for cursor */
-    Move(rp, screenX, screenY);
-    Draw(rp, screenX, screenY + lineHeight - 1);
+    DrawCaret(window, buffer, buffer->cursorY, buffer->cursorX, lineHeight, viewTop, viewBottom);
+    
+    /* Carets are in line order - skip those above the pane, stop at the first below it */
+    endY = ViewLineAfterRows(buffer, buffer->scrollY, (viewBottom - viewTop) / lineHeight);
+    for (i = 0; i < buffer->caretCount; i++) {
+        if (buffer->carets[i].y < buffer->scrollY) {
+            continue;
+        }
+        if (buffer->carets[i].y >= endY) {
+            break;
+        }
+        DrawCaret(window, buffer, buffer->carets[i].y, buffer->carets[i].x, lineHeight, viewTop, viewBottom);
+    }
     SetDrMd(rp, JAM1);
 }
 
@@ -1211,6 +1465,10 @@ VOID MouseToCursor(struct TextBuffer *buffer, struct Window *window, LONG mouseX
     ULONG pixelY = 0;
     ULONG i = 0;
     ULONG currentX = 0;
+    ULONG row = 0;
+    ULONG rowInLine = 0;
+    ULONG rowStart = 0;
+    ULONG rowEnd = 0;
     
     if (!buffer || !window || !cursorX || !cursorY) {
         return;
@@ -1226,9 +1484,12 @@ VOID MouseToCursor(struct TextBuffer *buffer, struct Window *window, LONG mouseX
     
     /* Calculate text area bounds (accounting for left margin) */
     textAreaX = window->BorderLeft + buffer->leftMargin + 1;  /* Text starts after left margin */
-    textAreaY = window->BorderTop;
     textAreaWidth = window->Width - window->BorderLeft - window->BorderRight - buffer->leftMargin - 1;
-    textAreaHeight = window->Height - window->BorderTop - window->BorderBottom;
+    {
+        ULONG viewBottom = 0;
+        GetViewBounds(buffer, window, &textAreaY, &viewBottom);
+        textAreaHeight = viewBottom - textAreaY;
+    }
     visibleLines = textAreaHeight / lineHeight;
     
     /* Convert mouse coordinates relative to text area */
@@ -1249,32 +1510,43 @@ VOID MouseToCursor(struct TextBuffer *buffer, struct Window *window, LONG mouseX
         }
     }
     
-    /* Calculate line index */
+    /* Calculate line index - the line on the row clicked (a row is a line, unless folds are hidden or lines wrapped) */
     {
-        LONG calcLine = (LONG)buffer->scrollY + ((LONG)pixelY / (LONG)lineHeight);
-        if (calcLine < 0) {
-            lineIndex = 0;
-        } else if ((ULONG)calcLine >= buffer->lineCount) {
-            lineIndex = buffer->lineCount > 0 ? buffer->lineCount - 1 : 0;
+        ULONG calcLine = 0;
+        
+        row = ViewLineToRow(buffer, buffer->scrollY) + pixelY / lineHeight;
+        calcLine = ViewRowToLine(buffer, row);
+        rowInLine = row - ViewLineToRow(buffer, calcLine);
+        if (calcLine >= buffer->doc->lineCount) {
+            lineIndex = buffer->doc->lineCount > 0 ? buffer->doc->lineCount - 1 : 0;
         } else {
-            lineIndex = (ULONG)calcLine;
+            lineIndex = calcLine;
         }
     }
     
     *cursorY = lineIndex;
     
     /* Calculate character index within line */
-    if (lineIndex < buffer->lineCount) {
-        /* Account for horizontal scroll */
-        pixelX += buffer->scrollX * charWidth;
+    if (lineIndex < buffer->doc->lineCount) {
+        if (buffer->wrap) {
+            /* Columns of the row clicked, measured from its left edge */
+            rowStart = GetWrapRowStart(buffer, rp, lineIndex, rowInLine, &rowEnd);
+            if (rowEnd < buffer->doc->lines[lineIndex].length && rowEnd > rowStart) {
+                rowEnd--;  /* The column it breaks at is on the next row */
+            }
+        } else {
+            /* Account for horizontal scroll */
+            pixelX += buffer->scrollX * charWidth;
+            rowEnd = buffer->doc->lines[lineIndex].length;
+        }
         
         /* Find character position by measuring text width */
         currentX = 0;
-        charIndex = 0;
+        charIndex = rowStart;
         
-        if (buffer->lines[lineIndex].text && buffer->lines[lineIndex].length > 0) {
-            for (i = 0; i < buffer->lines[lineIndex].length; i++) {
-                ULONG charW = GetCharWidth(rp, (UBYTE)buffer->lines[lineIndex].text[i]);
+        if (buffer->doc->lines[lineIndex].text && buffer->doc->lines[lineIndex].length > 0) {
+            for (i = rowStart; i < rowEnd; i++) {
+                ULONG charW = GetCharWidth(rp, (UBYTE)buffer->doc->lines[lineIndex].text[i]);
                 if (currentX + charW / 2 > pixelX) {
                     break;
                 }
@@ -1295,11 +1567,11 @@ BOOL DeleteForward(struct TextBuffer *buffer, struct CleanupStack *stack)
     struct TextLine *line = NULL;
     struct TextLine *nextLine = NULL;
     
-    if (!buffer || !buffer->lines || buffer->cursorY >= buffer->lineCount || !stack) {
+    if (!buffer || !buffer->doc || !buffer->doc->lines || buffer->cursorY >= buffer->doc->lineCount || !stack) {
         return FALSE;
     }
     
-    line = &buffer->lines[buffer->cursorY];
+    line = &buffer->doc->lines[buffer->cursorY];
     
     /* Delete character after cursor */
     if (buffer->cursorX < line->length) {
@@ -1309,16 +1581,16 @@ BOOL DeleteForward(struct TextBuffer *buffer, struct CleanupStack *stack)
         }
         line->length--;
         line->text[line->length] = '\0';
-        buffer->modified = TRUE;
+        DocumentChanged(buffer, buffer->cursorY, 0);
         return TRUE;
-    } else if (buffer->cursorY < buffer->lineCount - 1) {
+    } else if (buffer->cursorY < buffer->doc->lineCount - 1) {
         ULONG currLen = line->length;
         ULONG nextLen = 0;
         STRPTR newText = NULL;
         ULONG newAlloc = 0;
 
         /* Merge with next line */
-        nextLine = &buffer->lines[buffer->cursorY + 1];
+        nextLine = &buffer->doc->lines[buffer->cursorY + 1];
         nextLen = nextLine->length;
         
         if (currLen + nextLen + 1 > line->allocated) {
@@ -1350,17 +1622,17 @@ BOOL DeleteForward(struct TextBuffer *buffer, struct CleanupStack *stack)
         if (nextLine->text) {
                 freeVec(nextLine->text);
         }
-        if (buffer->cursorY + 1 < buffer->lineCount - 1) {
+        if (buffer->cursorY + 1 < buffer->doc->lineCount - 1) {
             /* Move lines up */
             ULONG moveCount = 0;
             ULONG i = 0;
-            moveCount = buffer->lineCount - buffer->cursorY - 2;
+            moveCount = buffer->doc->lineCount - buffer->cursorY - 2;
             for (i = 0; i < moveCount; i++) {
-                buffer->lines[buffer->cursorY + 1 + i] = buffer->lines[buffer->cursorY + 2 + i];
+                buffer->doc->lines[buffer->cursorY + 1 + i] = buffer->doc->lines[buffer->cursorY + 2 + i];
             }
         }
-        buffer->lineCount--;
-        buffer->modified = TRUE;
+        buffer->doc->lineCount--;
+        DocumentChanged(buffer, buffer->cursorY, -1);
         return TRUE;
     }
     
@@ -1377,12 +1649,12 @@ BOOL DeleteEOL(struct TextBuffer *buffer, struct CleanupStack *stack)
     ULONG startX = 0;
     ULONG endX = 0;
     
-    if (!buffer || buffer->cursorY >= buffer->lineCount || !stack) {
+    if (!buffer || buffer->cursorY >= buffer->doc->lineCount || !stack) {
         return FALSE;
     }
     
     startX = buffer->cursorX;
-    endX = buffer->lines[buffer->cursorY].length;
+    endX = buffer->doc->lines[buffer->cursorY].length;
     
     if (startX >= endX) {
         return FALSE;  /* Nothing to delete */
@@ -1401,7 +1673,7 @@ BOOL DeleteEOW(struct TextBuffer *buffer, struct CleanupStack *stack)
     ULONG endX = 0;
     ULONG endY = 0;
     
-    if (!buffer || buffer->cursorY >= buffer->lineCount || !stack) {
+    if (!buffer || buffer->cursorY >= buffer->doc->lineCount || !stack) {
         return FALSE;
     }
     
@@ -1434,7 +1706,7 @@ BOOL DeleteSOL(struct TextBuffer *buffer, struct CleanupStack *stack)
     ULONG startX = 0;
     ULONG endX = 0;
     
-    if (!buffer || buffer->cursorY >= buffer->lineCount || !stack) {
+    if (!buffer || buffer->cursorY >= buffer->doc->lineCount || !stack) {
         return FALSE;
     }
     
@@ -1463,7 +1735,7 @@ BOOL DeleteSOW(struct TextBuffer *buffer, struct CleanupStack *stack)
     ULONG endX = 0;
     ULONG endY = 0;
     
-    if (!buffer || buffer->cursorY >= buffer->lineCount || !stack) {
+    if (!buffer || buffer->cursorY >= buffer->doc->lineCount || !stack) {
         return FALSE;
     }
     
@@ -1495,49 +1767,49 @@ BOOL DeleteLine(struct TextBuffer *buffer, struct CleanupStack *stack)
     ULONG lineY = 0;
     ULONG i = 0;
     
-    if (!buffer || buffer->cursorY >= buffer->lineCount || !stack) {
+    if (!buffer || buffer->cursorY >= buffer->doc->lineCount || !stack) {
         return FALSE;
     }
     
     lineY = buffer->cursorY;
     
     /* Free line text */
-    if (buffer->lines[lineY].text) {
-        freeVec(buffer->lines[lineY].text);
-        buffer->lines[lineY].text = NULL;
+    if (buffer->doc->lines[lineY].text) {
+        freeVec(buffer->doc->lines[lineY].text);
+        buffer->doc->lines[lineY].text = NULL;
     }
     
     /* Shift lines up */
-    for (i = lineY; i < buffer->lineCount - 1; i++) {
-        buffer->lines[i] = buffer->lines[i + 1];
+    for (i = lineY; i < buffer->doc->lineCount - 1; i++) {
+        buffer->doc->lines[i] = buffer->doc->lines[i + 1];
     }
     
-    buffer->lineCount--;
+    buffer->doc->lineCount--;
     
     /* Ensure at least one empty line */
-    if (buffer->lineCount == 0) {
-        buffer->lines[0].allocated = 256;
-        buffer->lines[0].text = (STRPTR)allocVec(256, MEMF_CLEAR);
-        if (!buffer->lines[0].text) {
+    if (buffer->doc->lineCount == 0) {
+        buffer->doc->lines[0].allocated = 256;
+        buffer->doc->lines[0].text = (STRPTR)allocVec(256, MEMF_CLEAR);
+        if (!buffer->doc->lines[0].text) {
             return FALSE;
         }
-        buffer->lines[0].text[0] = '\0';
-        buffer->lines[0].length = 0;
-        buffer->lineCount = 1;
+        buffer->doc->lines[0].text[0] = '\0';
+        buffer->doc->lines[0].length = 0;
+        buffer->doc->lineCount = 1;
     }
     
     /* Adjust cursor */
-    if (buffer->cursorY >= buffer->lineCount) {
-        buffer->cursorY = buffer->lineCount - 1;
+    if (buffer->cursorY >= buffer->doc->lineCount) {
+        buffer->cursorY = buffer->doc->lineCount - 1;
     }
-    if (buffer->cursorY == lineY && buffer->cursorY < buffer->lineCount) {
+    if (buffer->cursorY == lineY && buffer->cursorY < buffer->doc->lineCount) {
         buffer->cursorX = 0;
-        if (buffer->cursorX > buffer->lines[buffer->cursorY].length) {
-            buffer->cursorX = buffer->lines[buffer->cursorY].length;
+        if (buffer->cursorX > buffer->doc->lines[buffer->cursorY].length) {
+            buffer->cursorX = buffer->doc->lines[buffer->cursorY].length;
         }
     }
     
-    buffer->modified = TRUE;
+    DocumentChanged(buffer, lineY, -1);
     return TRUE;
 }
 
@@ -1548,80 +1820,220 @@ BOOL DeleteLine(struct TextBuffer *buffer, struct CleanupStack *stack)
 /* Insert text string at cursor */
 BOOL InsertText(struct TextBuffer *buffer, STRPTR text, struct CleanupStack *stack)
 {
-    ULONG i = 0;
-    UBYTE ch = 0;
+    ULONG length = 0;
     
     if (!buffer || !text || !stack) {
         return FALSE;
     }
     
-    /* Insert each character */
-    i = 0;
-    while (text[i] != '\0') {
-        ch = (UBYTE)text[i];
-        if (ch == '\n') {
+    while (text[length] != '\0') {
+        length++;
+    }
+    
+    return InsertSpan(buffer, text, length, stack);
+}
+
+/* Insert length bytes at cursor ('\n' breaks the line) - each run between newlines goes
+ * into its line with one copy, so large pastes do not pay per character */
+BOOL InsertSpan(struct TextBuffer *buffer, STRPTR text, ULONG length, struct CleanupStack *stack)
+{
+    struct TextLine *line = NULL;
+    STRPTR newText = NULL;
+    ULONG newAlloc = 0;
+    ULONG run = 0;
+    ULONG pos = 0;
+    ULONG i = 0;
+    
+    if (!buffer || !buffer->doc || !buffer->doc->lines || !text || !stack) {
+        return FALSE;
+    }
+    
+    while (pos < length) {
+        if (text[pos] == '\n') {
             if (!InsertNewline(buffer, stack)) {
                 return FALSE;
             }
-        } else {
-            if (!InsertChar(buffer, ch, stack)) {
+            pos++;
+            continue;
+        }
+        
+        /* The run up to the next newline */
+        run = 0;
+        while (pos + run < length && text[pos + run] != '\n') {
+            run++;
+        }
+        
+        if (buffer->cursorY >= buffer->doc->lineCount) {
+            return FALSE;
+        }
+        line = &buffer->doc->lines[buffer->cursorY];
+        
+        /* Expand line buffer if needed */
+        if (line->length + run + 1 > line->allocated) {
+            newAlloc = line->allocated * 2;
+            if (newAlloc < 256) {
+                newAlloc = 256;
+            }
+            while (newAlloc < line->length + run + 1) {
+                newAlloc *= 2;
+            }
+            newText = (STRPTR)allocVec(newAlloc, MEMF_CLEAR);
+            if (!newText) {
                 return FALSE;
             }
+            if (line->text && line->length > 0) {
+                CopyMem(line->text, newText, line->length);
+            }
+            if (line->text) {
+                freeVec(line->text);
+            }
+            line->text = newText;
+            line->allocated = newAlloc;
+        }
+        
+        /* Shift the rest of the line right - copy backwards for overlapping memory */
+        if (buffer->cursorX < line->length) {
+            for (i = line->length; i > buffer->cursorX; i--) {
+                line->text[i - 1 + run] = line->text[i - 1];
+            }
         }
-        i++;
+        CopyMem(&text[pos], &line->text[buffer->cursorX], run);
+        line->length += run;
+        line->text[line->length] = '\0';
+        buffer->cursorX += run;
+        DocumentChanged(buffer, buffer->cursorY, 0);
+        pos += run;
     }
     
     return TRUE;
 }
 
+/* Make room for size bytes (NUL included) in a line, doubling its allocation */
+BOOL GrowLine(struct TextLine *line, ULONG size)
+{
+    STRPTR newText = NULL;
+    ULONG newAlloc = 0;
+    
+    if (size <= line->allocated) {
+        return TRUE;
+    }
+    newAlloc = line->allocated * 2;
+    if (newAlloc < 256) {
+        newAlloc = 256;
+    }
+    while (newAlloc < size) {
+        newAlloc *= 2;
+    }
+    newText = (STRPTR)allocVec(newAlloc, MEMF_CLEAR);
+    if (!newText) {
+        return FALSE;
+    }
+    if (line->text && line->length > 0) {
+        CopyMem(line->text, newText, line->length);
+    }
+    if (line->text) {
+        freeVec(line->text);
+    }
+    line->text = newText;
+    line->allocated = newAlloc;
+    return TRUE;
+}
+
 /* Get character at cursor */
 UBYTE GetCharAtCursor(struct TextBuffer *buffer)
 {
-    if (!buffer || buffer->cursorY >= buffer->lineCount) {
+    if (!buffer || buffer->cursorY >= buffer->doc->lineCount) {
         return 0;
     }
     
-    if (buffer->cursorX < buffer->lines[buffer->cursorY].length) {
-        return (UBYTE)buffer->lines[buffer->cursorY].text[buffer->cursorX];
+    if (buffer->cursorX < buffer->doc->lines[buffer->cursorY].length) {
+        return (UBYTE)buffer->doc->lines[buffer->cursorY].text[buffer->cursorX];
     }
     
     return 0;
 }
 
-/* Get current line text */
+/* Get current line text (a copy the caller frees) */
 STRPTR GetCurrentLine(struct TextBuffer *buffer, struct CleanupStack *stack)
 {
+    STRPTR text = NULL;
     STRPTR result = NULL;
     ULONG len = 0;
     
-    if (!buffer || buffer->cursorY >= buffer->lineCount || !stack) {
+    if (!buffer || !stack || !GetLineSpan(buffer, buffer->cursorY, &text, &len)) {
         return NULL;
     }
     
-    len = buffer->lines[buffer->cursorY].length;
     result = (STRPTR)allocVec(len + 1, MEMF_CLEAR);
     if (!result) {
         return NULL;
     }
     
     if (len > 0) {
-        CopyMem(buffer->lines[buffer->cursorY].text, result, len);
+        CopyMem(text, result, len);
     }
     result[len] = '\0';
     
     return result;
 }
 
+/* Text of a line in place - valid until the document changes, and not NUL-terminated */
+BOOL GetLineSpan(struct TextBuffer *buffer, ULONG line, STRPTR *text, ULONG *length)
+{
+    if (!buffer || !buffer->doc || line >= buffer->doc->lineCount || !text || !length) {
+        return FALSE;
+    }
+    
+    *text = buffer->doc->lines[line].text;
+    *length = buffer->doc->lines[line].length;
+    if (!*text) {
+        *text = "";
+        *length = 0;
+    }
+    return TRUE;
+}
+
+/* At least size bytes of the view's scratch space - kept between calls and grown (with its
+ * contents) only when too small, so repeated requests allocate nothing */
+UBYTE *GetScratch(struct TextBuffer *buffer, ULONG size)
+{
+    UBYTE *scratch = NULL;
+    ULONG newSize = 0;
+    
+    if (!buffer) {
+        return NULL;
+    }
+    
+    if (size > buffer->scratchSize) {
+        newSize = buffer->scratchSize ? buffer->scratchSize : 256;
+        while (newSize < size) {
+            newSize *= 2;
+        }
+        scratch = (UBYTE *)allocVec(newSize, MEMF_CLEAR);
+        if (!scratch) {
+            return NULL;
+        }
+        if (buffer->scratch) {
+            CopyMem(buffer->scratch, scratch, buffer->scratchSize);
+            freeVec(buffer->scratch);
+        }
+        buffer->scratch = scratch;
+        buffer->scratchSize = newSize;
+    }
+    
+    return buffer->scratch;
+}
+
 /* Set character at cursor */
 BOOL SetCharAtCursor(struct TextBuffer *buffer, UBYTE ch, struct CleanupStack *stack)
 {
-    if (!buffer || buffer->cursorY >= buffer->lineCount || !stack) {
+    if (!buffer || buffer->cursorY >= buffer->doc->lineCount || !stack) {
         return FALSE;
     }
     
-    if (buffer->cursorX < buffer->lines[buffer->cursorY].length) {
-        buffer->lines[buffer->cursorY].text[buffer->cursorX] = (char)ch;
-        buffer->modified = TRUE;
+    if (buffer->cursorX < buffer->doc->lines[buffer->cursorY].length) {
+        buffer->doc->lines[buffer->cursorY].text[buffer->cursorX] = (char)ch;
+        DocumentChanged(buffer, buffer->cursorY, 0);
         return TRUE;
     } else {
         /* Insert at end of line */
@@ -1635,7 +2047,7 @@ BOOL SwapChars(struct TextBuffer *buffer, struct CleanupStack *stack)
     UBYTE currCh = 0;
     UBYTE prevCh = 0;
     
-    if (!buffer || buffer->cursorY >= buffer->lineCount || !stack) {
+    if (!buffer || buffer->cursorY >= buffer->doc->lineCount || !stack) {
         return FALSE;
     }
     
@@ -1647,11 +2059,11 @@ BOOL SwapChars(struct TextBuffer *buffer, struct CleanupStack *stack)
     
     /* Get previous character */
     if (buffer->cursorX > 0) {
-        prevCh = (UBYTE)buffer->lines[buffer->cursorY].text[buffer->cursorX - 1];
+        prevCh = (UBYTE)buffer->doc->lines[buffer->cursorY].text[buffer->cursorX - 1];
     } else if (buffer->cursorY > 0) {
-        ULONG prevLen = buffer->lines[buffer->cursorY - 1].length;
+        ULONG prevLen = buffer->doc->lines[buffer->cursorY - 1].length;
         if (prevLen > 0) {
-            prevCh = (UBYTE)buffer->lines[buffer->cursorY - 1].text[prevLen - 1];
+            prevCh = (UBYTE)buffer->doc->lines[buffer->cursorY - 1].text[prevLen - 1];
         } else {
             return FALSE;
         }
@@ -1661,17 +2073,17 @@ BOOL SwapChars(struct TextBuffer *buffer, struct CleanupStack *stack)
     
     /* Swap */
     if (buffer->cursorX > 0) {
-        buffer->lines[buffer->cursorY].text[buffer->cursorX - 1] = (char)currCh;
-        buffer->lines[buffer->cursorY].text[buffer->cursorX] = (char)prevCh;
-        buffer->modified = TRUE;
+        buffer->doc->lines[buffer->cursorY].text[buffer->cursorX - 1] = (char)currCh;
+        buffer->doc->lines[buffer->cursorY].text[buffer->cursorX] = (char)prevCh;
+        DocumentChanged(buffer, buffer->cursorY, 0);
         return TRUE;
     } else {
         /* Cross-line swap - move cursor back, swap, move forward */
         ULONG prevLen = 0;
         buffer->cursorY--;
-        prevLen = buffer->lines[buffer->cursorY].length;
+        prevLen = buffer->doc->lines[buffer->cursorY].length;
         buffer->cursorX = prevLen - 1;
-        buffer->lines[buffer->cursorY].text[prevLen - 1] = (char)currCh;
+        buffer->doc->lines[buffer->cursorY].text[prevLen - 1] = (char)currCh;
         buffer->cursorY++;
         buffer->cursorX = 0;
         if (!InsertChar(buffer, prevCh, stack)) {
@@ -1692,7 +2104,7 @@ BOOL ToggleCharCase(struct TextBuffer *buffer, struct CleanupStack *stack)
     UBYTE ch = 0;
     UBYTE newCh = 0;
     
-    if (!buffer || buffer->cursorY >= buffer->lineCount || !stack) {
+    if (!buffer || buffer->cursorY >= buffer->doc->lineCount || !stack) {
         return FALSE;
     }
     
@@ -1716,53 +2128,23 @@ BOOL ToggleCharCase(struct TextBuffer *buffer, struct CleanupStack *stack)
  * Word Operations
  * ============================================================================ */
 
-/* Get word at cursor */
+/* Get word at cursor (a copy the caller frees) */
 STRPTR GetWordAtCursor(struct TextBuffer *buffer, struct CleanupStack *stack)
 {
-    ULONG startX = 0;
-    ULONG endX = 0;
-    ULONG wordLen = 0;
+    STRPTR text = NULL;
     STRPTR result = NULL;
-    ULONG savedX = 0;
-    ULONG savedY = 0;
-    
-    if (!buffer || buffer->cursorY >= buffer->lineCount || !stack) {
-        return NULL;
-    }
-    
-    savedX = buffer->cursorX;
-    savedY = buffer->cursorY;
+    ULONG wordLen = 0;
     
-    /* Find word boundaries */
-    if (!MoveStartOfWord(buffer)) {
-        buffer->cursorX = savedX;
-        buffer->cursorY = savedY;
+    if (!buffer || !stack || !GetWordSpan(buffer, &text, &wordLen)) {
         return NULL;
     }
-    startX = buffer->cursorX;
     
-    if (!MoveEndOfWord(buffer)) {
-        buffer->cursorX = savedX;
-        buffer->cursorY = savedY;
-        return NULL;
-    }
-    endX = buffer->cursorX;
-    
-    /* Restore cursor */
-    buffer->cursorX = savedX;
-    buffer->cursorY = savedY;
-    
-    if (startX >= endX || buffer->cursorY != savedY) {
-        return NULL;  /* Word spans multiple lines - not supported */
-    }
-    
-    wordLen = endX - startX;
     result = (STRPTR)allocVec(wordLen + 1, MEMF_CLEAR);
     if (!result) {
         return NULL;
     }
     
-    CopyMem(&buffer->lines[buffer->cursorY].text[startX], result, wordLen);
+    CopyMem(text, result, wordLen);
     result[wordLen] = '\0';
     
     return result;
@@ -1778,7 +2160,7 @@ BOOL ReplaceWordAtCursor(struct TextBuffer *buffer, STRPTR newWord, struct Clean
     ULONG newWordLen = 0;
     ULONG i = 0;
     
-    if (!buffer || buffer->cursorY >= buffer->lineCount || !newWord || !stack) {
+    if (!buffer || buffer->cursorY >= buffer->doc->lineCount || !newWord || !stack) {
         return FALSE;
     }
     
@@ -1872,15 +2254,15 @@ BOOL ConvertToUpper(struct TextBuffer *buffer, struct CleanupStack *stack)
     }
     
     /* Convert characters */
-    for (i = startY; i <= stopY && i < buffer->lineCount; i++) {
+    for (i = startY; i <= stopY && i < buffer->doc->lineCount; i++) {
         ULONG lineStart = (i == startY) ? startX : 0;
-        ULONG lineEnd = (i == stopY) ? stopX : buffer->lines[i].length;
+        ULONG lineEnd = (i == stopY) ? stopX : buffer->doc->lines[i].length;
         
-        for (j = lineStart; j < lineEnd && j < buffer->lines[i].length; j++) {
-            ch = (UBYTE)buffer->lines[i].text[j];
+        for (j = lineStart; j < lineEnd && j < buffer->doc->lines[i].length; j++) {
+            ch = (UBYTE)buffer->doc->lines[i].text[j];
             if (ch >= 'a' && ch <= 'z') {
-                buffer->lines[i].text[j] = (char)(ch - 'a' + 'A');
-                buffer->modified = TRUE;
+                buffer->doc->lines[i].text[j] = (char)(ch - 'a' + 'A');
+                DocumentChanged(buffer, i, 0);
             }
         }
     }
@@ -1923,15 +2305,15 @@ BOOL ConvertToLower(struct TextBuffer *buffer, struct CleanupStack *stack)
     }
     
     /* Convert characters */
-    for (i = startY; i <= stopY && i < buffer->lineCount; i++) {
+    for (i = startY; i <= stopY && i < buffer->doc->lineCount; i++) {
         ULONG lineStart = (i == startY) ? startX : 0;
-        ULONG lineEnd = (i == stopY) ? stopX : buffer->lines[i].length;
+        ULONG lineEnd = (i == stopY) ? stopX : buffer->doc->lines[i].length;
         
-        for (j = lineStart; j < lineEnd && j < buffer->lines[i].length; j++) {
-            ch = (UBYTE)buffer->lines[i].text[j];
+        for (j = lineStart; j < lineEnd && j < buffer->doc->lines[i].length; j++) {
+            ch = (UBYTE)buffer->doc->lines[i].text[j];
             if (ch >= 'A' && ch <= 'Z') {
-                buffer->lines[i].text[j] = (char)(ch - 'A' + 'a');
-                buffer->modified = TRUE;
+                buffer->doc->lines[i].text[j] = (char)(ch - 'A' + 'a');
+                DocumentChanged(buffer, i, 0);
             }
         }
     }
@@ -1956,6 +2338,11 @@ BOOL ShiftLeft(struct TextBuffer *buffer, struct CleanupStack *stack)
         return FALSE;
     }
     
+    /* A column block moves along its lines rather than being unindented */
+    if (buffer->marking.enabled && buffer->marking.column) {
+        return ShiftColumnBlock(buffer, -(LONG)SHIFT_WIDTH, stack);
+    }
+    
     if (buffer->marking.enabled) {
         startY = buffer->marking.startY;
         stopY = buffer->marking.stopY;
@@ -1970,21 +2357,21 @@ BOOL ShiftLeft(struct TextBuffer *buffer, struct CleanupStack *stack)
     }
     
     /* Remove leading spaces/tabs from each line */
-    for (i = startY; i <= stopY && i < buffer->lineCount; i++) {
+    for (i = startY; i <= stopY && i < buffer->doc->lineCount; i++) {
         removeCount = 0;
-        while (removeCount < buffer->lines[i].length &&
-               (buffer->lines[i].text[removeCount] == ' ' ||
-                buffer->lines[i].text[removeCount] == '\t')) {
+        while (removeCount < buffer->doc->lines[i].length &&
+               (buffer->doc->lines[i].text[removeCount] == ' ' ||
+                buffer->doc->lines[i].text[removeCount] == '\t')) {
             removeCount++;
         }
         
         if (removeCount > 0) {
             /* Shift characters left */
-            for (j = removeCount; j <= buffer->lines[i].length; j++) {
-                buffer->lines[i].text[j - removeCount] = buffer->lines[i].text[j];
+            for (j = removeCount; j <= buffer->doc->lines[i].length; j++) {
+                buffer->doc->lines[i].text[j - removeCount] = buffer->doc->lines[i].text[j];
             }
-            buffer->lines[i].length -= removeCount;
-            buffer->modified = TRUE;
+            buffer->doc->lines[i].length -= removeCount;
+            DocumentChanged(buffer, i, 0);
         }
     }
     
@@ -1998,7 +2385,7 @@ BOOL ShiftRight(struct TextBuffer *buffer, struct CleanupStack *stack)
     ULONG stopY = 0;
     ULONG i = 0;
     ULONG j = 0;
-    ULONG tabSize = 4;  /* Default tab size */
+    ULONG tabSize = SHIFT_WIDTH;
     STRPTR newText = NULL;
     ULONG newAlloc = 0;
     
@@ -2006,6 +2393,11 @@ BOOL ShiftRight(struct TextBuffer *buffer, struct CleanupStack *stack)
         return FALSE;
     }
     
+    /* A column block moves along its lines rather than being indented */
+    if (buffer->marking.enabled && buffer->marking.column) {
+        return ShiftColumnBlock(buffer, (LONG)tabSize, stack);
+    }
+    
     if (buffer->marking.enabled) {
         startY = buffer->marking.startY;
         stopY = buffer->marking.stopY;
@@ -2020,158 +2412,282 @@ BOOL ShiftRight(struct TextBuffer *buffer, struct CleanupStack *stack)
     }
     
     /* Add leading spaces to each line */
-    for (i = startY; i <= stopY && i < buffer->lineCount; i++) {
-        if (buffer->lines[i].length + tabSize >= buffer->lines[i].allocated) {
-            newAlloc = buffer->lines[i].allocated * 2;
-            if (newAlloc < buffer->lines[i].length + tabSize + 256) {
-                newAlloc = buffer->lines[i].length + tabSize + 256;
+    for (i = startY; i <= stopY && i < buffer->doc->lineCount; i++) {
+        if (buffer->doc->lines[i].length + tabSize >= buffer->doc->lines[i].allocated) {
+            newAlloc = buffer->doc->lines[i].allocated * 2;
+            if (newAlloc < buffer->doc->lines[i].length + tabSize + 256) {
+                newAlloc = buffer->doc->lines[i].length + tabSize + 256;
             }
             newText = (STRPTR)allocVec(newAlloc, MEMF_CLEAR);
             if (!newText) {
                 continue;
             }
-            if (buffer->lines[i].text && buffer->lines[i].length > 0) {
-                CopyMem(buffer->lines[i].text, newText, buffer->lines[i].length);
+            if (buffer->doc->lines[i].text && buffer->doc->lines[i].length > 0) {
+                CopyMem(buffer->doc->lines[i].text, newText, buffer->doc->lines[i].length);
             }
-            if (buffer->lines[i].text) {
-                freeVec(buffer->lines[i].text);
+            if (buffer->doc->lines[i].text) {
+                freeVec(buffer->doc->lines[i].text);
             }
-            buffer->lines[i].text = newText;
-            buffer->lines[i].allocated = newAlloc;
+            buffer->doc->lines[i].text = newText;
+            buffer->doc->lines[i].allocated = newAlloc;
         }
         
         /* Shift characters right */
-        for (j = buffer->lines[i].length; j > 0; j--) {
-            buffer->lines[i].text[j + tabSize - 1] = buffer->lines[i].text[j - 1];
+        for (j = buffer->doc->lines[i].length; j > 0; j--) {
+            buffer->doc->lines[i].text[j + tabSize - 1] = buffer->doc->lines[i].text[j - 1];
         }
         
         /* Add spaces */
         for (j = 0; j < tabSize; j++) {
-            buffer->lines[i].text[j] = ' ';
+            buffer->doc->lines[i].text[j] = ' ';
         }
         
-        buffer->lines[i].length += tabSize;
-        buffer->lines[i].text[buffer->lines[i].length] = '\0';
-        buffer->modified = TRUE;
+        buffer->doc->lines[i].length += tabSize;
+        buffer->doc->lines[i].text[buffer->doc->lines[i].length] = '\0';
+        DocumentChanged(buffer, i, 0);
     }
     
     return TRUE;
 }
 
-/* Convert tabs to spaces in selection */
-BOOL ConvertTabsToSpaces(struct TextBuffer *buffer, struct CleanupStack *stack)
+/* Top bit set in each byte of v that is zero, and in no other */
+static ULONG ZeroBytes(ULONG v)
+{
+    return ~(((v & 0x7F7F7F7FUL) + 0x7F7F7F7FUL) | v | 0x7F7F7F7FUL);
+}
+
+/* Might bytes start-end of a line change when converted? A tab always does; going to tabs,
+ * so may two spaces in a row. Looked through a longword at a time once aligned. */
+static BOOL HasBlanksToConvert(UBYTE *text, ULONG start, ULONG end, BOOL toTabs)
+{
+    UBYTE *p = text + start;
+    UBYTE *stop = text + end;
+    UBYTE prev = 0;
+    ULONG word = 0;
+    ULONG spaces = 0;
+    
+    while (p < stop && ((ULONG)p & 3) != 0) {
+        if (*p == '\t' || (toTabs && *p == ' ' && prev == ' ')) {
+            return TRUE;
+        }
+        prev = *p++;
+    }
+    while (p + 4 <= stop) {
+        word = *(ULONG *)p;
+        if (ZeroBytes(word ^ 0x09090909UL) != 0) {
+            return TRUE;
+        }
+        if (toTabs) {
+            /* Two neighbouring space bytes, or a space either side of the boundary */
+            spaces = ZeroBytes(word ^ 0x20202020UL);
+            if ((spaces & (spaces << 8)) != 0 || (prev == ' ' && p[0] == ' ')) {
+                return TRUE;
+            }
+        }
+        prev = p[3];
+        p += 4;
+    }
+    while (p < stop) {
+        if (*p == '\t' || (toTabs && *p == ' ' && prev == ' ')) {
+            return TRUE;
+        }
+        prev = *p++;
+    }
+    return FALSE;
+}
+
+/* Write a line to out with the blanks of bytes start-end converted, going by tab stops every
+ * tabSize columns from the start of the line - to spaces, or to tabs wherever a run of two or
+ * more blanks (or a tab) reaches a stop. Returns the new length; *newEnd is where end went. */
+static ULONG ConvertLineBlanks(UBYTE *out, struct TextLine *line, ULONG start, ULONG end,
+                               ULONG tabSize, BOOL toTabs, ULONG *newEnd)
+{
+    UBYTE *text = (UBYTE *)line->text;
+    ULONG column = 0;
+    ULONG runColumn = 0;
+    ULONG length = 0;
+    ULONG i = 0;
+    ULONG n = 0;
+    UBYTE ch = 0;
+    
+    /* Columns before the range still count towards the stops */
+    for (i = 0; i < start; i++) {
+        column = (text[i] == '\t') ? column + tabSize - column % tabSize : column + 1;
+        out[length++] = text[i];
+    }
+    
+    runColumn = column;
+    for (i = start; i < end; i++) {
+        ch = text[i];
+        if (!toTabs) {
+            if (ch == '\t') {
+                for (n = tabSize - column % tabSize; n > 0; n--) {
+                    out[length++] = ' ';
+                }
+                column += tabSize - column % tabSize;
+            } else {
+                out[length++] = ch;
+                column++;
+            }
+            continue;
+        }
+        
+        if (ch == ' ' || ch == '\t') {
+            column = (ch == '\t') ? column + tabSize - column % tabSize : column + 1;
+            if (column % tabSize == 0) {
+                /* A lone space reaching a stop stays a space */
+                out[length++] = (ch == '\t' || column - runColumn > 1) ? '\t' : ' ';
+                runColumn = column;
+            }
+            continue;
+        }
+        for (; runColumn < column; runColumn++) {
+            out[length++] = ' ';
+        }
+        out[length++] = ch;
+        column++;
+        runColumn = column;
+    }
+    for (; toTabs && runColumn < column; runColumn++) {
+        out[length++] = ' ';
+    }
+    
+    *newEnd = length;
+    for (i = end; i < line->length; i++) {
+        out[length++] = text[i];
+    }
+    return length;
+}
+
+/* Where offset x of a converted line went - after the range it moves with the text, inside it
+ * it stays where it was unless the range became shorter than that */
+static ULONG MapConvertedX(ULONG x, ULONG toX, ULONG newEnd)
 {
+    if (x >= toX) {
+        return x - toX + newEnd;
+    }
+    return (x > newEnd) ? newEnd : x;
+}
+
+/* Convert the blanks of the marked block (or the whole document) - lines with nothing to
+ * convert are passed over without being copied, the rest are built in the view's scratch
+ * space and put back into their own storage, and the document takes every change as one batch */
+static BOOL ConvertBlanks(struct TextBuffer *buffer, ULONG tabSize, BOOL toTabs)
+{
+    struct TextLine *line = NULL;
+    UBYTE *out = NULL;
     ULONG startY = 0;
     ULONG startX = 0;
     ULONG stopY = 0;
     ULONG stopX = 0;
+    ULONG fromX = 0;
+    ULONG toX = 0;
+    ULONG newLength = 0;
+    ULONG newEnd = 0;
+    ULONG blockStop = 0;
+    ULONG y = 0;
     ULONG i = 0;
-    ULONG j = 0;
-    ULONG tabSize = 4;
-    STRPTR newText = NULL;
-    ULONG newAlloc = 0;
-    ULONG newLen = 0;
-    ULONG tabCount = 0;
+    BOOL marked = FALSE;
+    BOOL kept = FALSE;
+    BOOL ok = TRUE;
     
-    if (!buffer || !stack) {
+    if (!buffer || !buffer->doc || !buffer->doc->lines || buffer->doc->lineCount == 0 ||
+        tabSize == 0 || tabSize > TAB_MAX_SIZE) {
         return FALSE;
     }
     
-    if (buffer->marking.enabled) {
-        startY = buffer->marking.startY;
-        startX = buffer->marking.startX;
-        stopY = buffer->marking.stopY;
-        stopX = buffer->marking.stopX;
-    } else {
+    marked = GetBlockBounds(buffer, &startY, &startX, &stopY, &stopX);
+    if (!marked) {
         startY = 0;
-        startX = 0;
-        stopY = buffer->lineCount - 1;
-        stopX = 0;
-    }
-    
-    /* Normalize */
-    if (stopY < startY || (stopY == startY && stopX < startX)) {
-        ULONG temp = startY;
-        startY = stopY;
-        stopY = temp;
-        temp = startX;
-        startX = stopX;
-        stopX = temp;
+        stopY = buffer->doc->lineCount - 1;
     }
     
-    /* Convert tabs to spaces */
-    for (i = startY; i <= stopY && i < buffer->lineCount; i++) {
-        ULONG lineStart = (i == startY) ? startX : 0;
-        ULONG lineEnd = (i == stopY) ? stopX : buffer->lines[i].length;
+    BeginEditBatch();
+    for (y = startY; y <= stopY; y++) {
+        line = &buffer->doc->lines[y];
+        if (marked) {
+            GetBlockLineRange(buffer, y, startY, startX, stopY, stopX, &fromX, &toX);
+        } else {
+            fromX = 0;
+            toX = line->length;
+        }
+        if (fromX >= toX || !HasBlanksToConvert((UBYTE *)line->text, fromX, toX, toTabs)) {
+            kept = TRUE;
+            continue;
+        }
         
-        /* Count tabs in this range */
-        tabCount = 0;
-        for (j = lineStart; j < lineEnd && j < buffer->lines[i].length; j++) {
-            if (buffer->lines[i].text[j] == '\t') {
-                tabCount++;
+        /* Going to spaces, each byte of the range becomes at most tabSize */
+        out = GetScratch(buffer, line->length + (toTabs ? 0 : (toX - fromX) * (tabSize - 1)) + 1);
+        if (!out) {
+            ok = FALSE;
+            break;
+        }
+        newLength = ConvertLineBlanks(out, line, fromX, toX, tabSize, toTabs, &newEnd);
+        if (newLength == line->length) {
+            for (i = 0; i < newLength && out[i] == (UBYTE)line->text[i]; i++) {
             }
+            if (i == newLength) {
+                kept = TRUE;
+                continue;
+            }
+        }
+        if (!GrowLine(line, newLength + 1)) {
+            ok = FALSE;
+            break;
         }
+        CopyMem(out, line->text, newLength);
+        line->length = newLength;
+        line->text[newLength] = '\0';
         
-        if (tabCount > 0) {
-            /* Calculate new length */
-            newLen = buffer->lines[i].length + (tabCount * (tabSize - 1));
-            
-            /* Allocate new buffer if needed */
-            if (newLen >= buffer->lines[i].allocated) {
-                newAlloc = newLen + 256;
-                newText = (STRPTR)allocVec(newAlloc, MEMF_CLEAR);
-                if (!newText) {
-                    continue;
-                }
-                if (buffer->lines[i].text && lineStart > 0) {
-                    CopyMem(buffer->lines[i].text, newText, lineStart);
-                }
-            } else {
-                newText = buffer->lines[i].text;
-                newAlloc = buffer->lines[i].allocated;
-            }
-            
-            /* Convert */
-            newLen = lineStart;
-            for (j = lineStart; j < lineEnd && j < buffer->lines[i].length; j++) {
-                if (buffer->lines[i].text[j] == '\t') {
-                    ULONG k = 0;
-                    for (k = 0; k < tabSize; k++) {
-                        newText[newLen++] = ' ';
-                    }
-                } else {
-                    newText[newLen++] = buffer->lines[i].text[j];
-                }
+        /* The view's own positions on the line - the document keeps those of its other views */
+        if (buffer->cursorY == y) {
+            buffer->cursorX = MapConvertedX(buffer->cursorX, toX, newEnd);
+        }
+        for (i = 0; i < buffer->caretCount; i++) {
+            if (buffer->carets[i].y == y) {
+                buffer->carets[i].x = MapConvertedX(buffer->carets[i].x, toX, newEnd);
             }
-            
-            /* Copy rest of line */
-            if (j < buffer->lines[i].length) {
-                ULONG restLen = 0;
-                restLen = buffer->lines[i].length - j;
-                CopyMem(&buffer->lines[i].text[j], &newText[newLen], restLen);
-                newLen += restLen;
+        }
+        if (marked && !buffer->marking.column) {
+            if (buffer->marking.startY == y) {
+                buffer->marking.startX = MapConvertedX(buffer->marking.startX, toX, newEnd);
             }
-            newText[newLen] = '\0';
-            
-            if (newText != buffer->lines[i].text) {
-                if (buffer->lines[i].text) {
-                    freeVec(buffer->lines[i].text);
-                }
-                buffer->lines[i].text = newText;
-                buffer->lines[i].allocated = newAlloc;
+            if (buffer->marking.stopY == y) {
+                buffer->marking.stopX = MapConvertedX(buffer->marking.stopX, toX, newEnd);
             }
-            buffer->lines[i].length = newLen;
-            buffer->modified = TRUE;
         }
+        /* A column block's stop column is shared, so it goes as far as the furthest line needs */
+        if (MapConvertedX(stopX, toX, newEnd) > blockStop) {
+            blockStop = MapConvertedX(stopX, toX, newEnd);
+        }
+        DocumentChanged(buffer, y, 0);
     }
+    EndEditBatch();
     
-    return TRUE;
+    if (marked && buffer->marking.column) {
+        if ((kept || !ok) && stopX > blockStop) {
+            blockStop = stopX;
+        }
+        buffer->marking.stopX = blockStop;
+    }
+    return ok;
 }
 
-/* Convert spaces to tabs in selection */
-BOOL ConvertSpacesToTabs(struct TextBuffer *buffer, struct CleanupStack *stack)
+/* Convert tabs to spaces in the marked block (or the whole document), each to the next of
+ * the tab stops every tabSize columns */
+BOOL ConvertTabsToSpaces(struct TextBuffer *buffer, ULONG tabSize, struct CleanupStack *stack)
 {
-    /* TODO: Implement spaces to tabs conversion */
-    /* This is more complex as it requires detecting tab stops */
-    return FALSE;
+    if (!buffer || !stack) {
+        return FALSE;
+    }
+    return ConvertBlanks(buffer, tabSize, FALSE);
+}
+
+/* Convert runs of spaces reaching a tab stop to tabs in the marked block (or the whole document) */
+BOOL ConvertSpacesToTabs(struct TextBuffer *buffer, ULONG tabSize, struct CleanupStack *stack)
+{
+    if (!buffer || !stack) {
+        return FALSE;
+    }
+    return ConvertBlanks(buffer, tabSize, TRUE);
 }
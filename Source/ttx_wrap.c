@@ -0,0 +1,893 @@
+/*
+ * TTX - Soft Wrap
+ *
+ * Copyright (c) 2025 amigazen project
+ * Licensed under BSD 2-Clause License
+ *
+ * A soft wrapped view breaks each line into rows no wider than its pane,
+ * after the last space that fits (or inside a word with no space to break
+ * at), going by the glyph widths of the view's font. The text itself is
+ * not changed.
+ *
+ * The view keeps an entry per line with the rows it takes - none for a
+ * line a hidden fold takes off the view. The entries are cut into chunks,
+ * and the chunks are the leaves of a tree where each node sums the lines
+ * and rows below it, so the row of a line, the line on a row and the rows
+ * of the whole document (what the scroll bars show) are found in
+ * O(log n) without looking at the text.
+ *
+ * Measuring a line means walking its glyphs, so lines are only measured
+ * when needed. Until then an entry holds an estimate from the line's length
+ * and is marked stale. An edit makes the lines it touched stale; a new
+ * width (a resized window or another font) makes every line stale. Before
+ * a view is drawn the stale lines it shows, and the cursor's, are measured;
+ * the rest are measured at idle time, and the scroll bars catch up once
+ * they are done.
+ */
+
+#include "ttx.h"
+
+/* Forward declarations */
+static struct WrapIndex *GetWrapIndex(struct TextBuffer *buffer);
+static BOOL ResetWrap(struct TextBuffer *buffer);
+static VOID UpdateWrapLines(struct TextBuffer *buffer, ULONG lineY, LONG lineDelta);
+static VOID FlushWrapBatch(struct TextBuffer *buffer);
+static struct RastPort *CheckWrapWidth(struct TextBuffer *buffer, struct Window *window);
+static VOID MeasureWrapLine(struct TextBuffer *buffer, struct RastPort *rp, ULONG y);
+static UWORD EstimateWrapRows(struct WrapIndex *index, ULONG length);
+static ULONG GetEntryRows(UWORD entry);
+static BOOL GrowWrapLines(struct WrapIndex *index, ULONG lineCount);
+static BOOL AppendWrapLines(struct WrapIndex *index, ULONG lineCount);
+static BOOL BuildWrapTree(struct WrapIndex *index);
+static VOID RecountWrapChunk(struct WrapIndex *index, ULONG chunk, ULONG startY);
+static VOID UpdateWrapPath(struct WrapIndex *index, ULONG chunk);
+static VOID AddWrapRows(struct WrapIndex *index, ULONG y, LONG delta);
+static ULONG FindWrapChunk(struct WrapIndex *index, ULONG y, ULONG *startY, ULONG *startRow);
+static ULONG FindWrapRow(struct WrapIndex *index, ULONG row, ULONG *rowInLine);
+static VOID MarkWrapHidden(struct TextBuffer *buffer, ULONG startY, ULONG endY);
+
+/* ============================================================================
+ * Soft Wrap
+ * ============================================================================ */
+
+/* Turn soft wrap on or off for a view - FALSE if out of memory */
+BOOL SetWrap(struct TextBuffer *buffer, struct Window *window, BOOL wrap)
+{
+    if (!buffer || !buffer->doc) {
+        return FALSE;
+    }
+    buffer->needsFullRedraw = TRUE;
+    if (!wrap) {
+        FreeWrap(buffer);
+        return TRUE;
+    }
+    if (buffer->wrap) {
+        return TRUE;
+    }
+
+    buffer->wrap = (struct WrapIndex *)allocVec(sizeof(struct WrapIndex), MEMF_CLEAR);
+    if (!buffer->wrap) {
+        return FALSE;
+    }
+    if (!ResetWrap(buffer)) {
+        FreeWrap(buffer);
+        return FALSE;
+    }
+    /* Rows never run off to the right */
+    buffer->scrollX = 0;
+    ReflowView(buffer, window);
+    return TRUE;
+}
+
+/* Measure the stale lines a view shows, and the cursor's - after laying every line out again
+ * if the pane is a new width */
+VOID ReflowView(struct TextBuffer *buffer, struct Window *window)
+{
+    struct WrapIndex *index = NULL;
+    struct RastPort *rp = NULL;
+    ULONG viewTop = 0;
+    ULONG viewBottom = 0;
+    ULONG lineHeight = 0;
+    ULONG rowsLeft = 0;
+    ULONG rows = 0;
+    ULONG y = 0;
+
+    rp = CheckWrapWidth(buffer, window);
+    if (!rp) {
+        return;
+    }
+    index = buffer->wrap;
+
+    lineHeight = GetLineHeight(rp);
+    GetViewBounds(buffer, window, &viewTop, &viewBottom);
+    rowsLeft = (lineHeight > 0 && viewBottom > viewTop) ? (viewBottom - viewTop) / lineHeight : 0;
+    if (rowsLeft == 0) {
+        rowsLeft = 1;
+    }
+
+    y = buffer->scrollY;
+    if (y < index->lineCount && (index->lines[y] & WRAP_HIDDEN)) {
+        y = RowToLine(buffer->doc, LineToRow(buffer->doc, y));
+    }
+    while (y < index->lineCount && rowsLeft > 0) {
+        if (index->lines[y] & WRAP_STALE) {
+            MeasureWrapLine(buffer, rp, y);
+        }
+        rows = GetEntryRows(index->lines[y]);
+        rowsLeft = (rows < rowsLeft) ? rowsLeft - rows : 0;
+        y = LineAfterRows(buffer->doc, y, 1);
+    }
+    if (buffer->cursorY < index->lineCount && (index->lines[buffer->cursorY] & WRAP_STALE)) {
+        MeasureWrapLine(buffer, rp, buffer->cursorY);
+    }
+}
+
+/* Measure up to maxLines more stale lines of a view - returns TRUE while more are left */
+BOOL ReflowSlice(struct TextBuffer *buffer, struct Window *window, ULONG maxLines)
+{
+    struct WrapIndex *index = NULL;
+    struct RastPort *rp = NULL;
+    ULONG n = 0;
+
+    rp = CheckWrapWidth(buffer, window);
+    if (!rp) {
+        return FALSE;
+    }
+    index = buffer->wrap;
+
+    /* Onwards from where the view was when the lines went stale, then round from the top */
+    for (n = 0; n < maxLines && index->staleCount > 0; n++) {
+        if (index->sweepLine >= index->lineCount) {
+            index->sweepLine = 0;
+        }
+        if (index->lines[index->sweepLine] & WRAP_STALE) {
+            MeasureWrapLine(buffer, rp, index->sweepLine);
+        }
+        index->sweepLine++;
+    }
+    return (BOOL)(index->staleCount > 0);
+}
+
+/* Where the row of a line starting at start ends - as many glyphs as fit in width pixels,
+ * taken back to after the last space among them if the line goes on */
+ULONG GetWrapBreak(struct RastPort *rp, struct TextLine *line, ULONG start, ULONG width)
+{
+    ULONG x = 0;
+    ULONG i = start;
+    ULONG charW = 0;
+    ULONG lastSpace = start;
+    UBYTE ch = 0;
+
+    while (i < line->length) {
+        ch = (UBYTE)line->text[i];
+        charW = GetCharWidth(rp, ch);
+        if (x + charW > width && i > start) {
+            break;
+        }
+        x += charW;
+        i++;
+        if (ch == ' ' || ch == '\t') {
+            lastSpace = i;
+        }
+    }
+    if (i >= line->length) {
+        return line->length;
+    }
+    if (line->text[i] == ' ' || line->text[i] == '\t') {
+        /* Spaces where the row ends hang past its edge rather than start the next one */
+        while (i < line->length && (line->text[i] == ' ' || line->text[i] == '\t')) {
+            i++;
+        }
+        return i;
+    }
+    return (lastSpace > start) ? lastSpace : i;
+}
+
+/* Row of a wrapped line that column x is on, and the column that row starts at */
+ULONG GetWrapRowOf(struct TextBuffer *buffer, struct RastPort *rp, ULONG y, ULONG x, ULONG *rowStart)
+{
+    struct TextLine *line = NULL;
+    ULONG start = 0;
+    ULONG end = 0;
+    ULONG row = 0;
+
+    *rowStart = 0;
+    if (!buffer || !buffer->wrap || !buffer->doc || y >= buffer->doc->lineCount) {
+        return 0;
+    }
+    line = &buffer->doc->lines[y];
+    while (start < line->length) {
+        end = GetWrapBreak(rp, line, start, buffer->wrap->width);
+        if (x < end || end >= line->length) {
+            break;
+        }
+        start = end;
+        row++;
+    }
+    *rowStart = start;
+    return row;
+}
+
+/* Column a row of a wrapped line starts at, and where it ends - the last row if the line has fewer */
+ULONG GetWrapRowStart(struct TextBuffer *buffer, struct RastPort *rp, ULONG y, ULONG row, ULONG *rowEnd)
+{
+    struct TextLine *line = NULL;
+    ULONG start = 0;
+    ULONG end = 0;
+
+    *rowEnd = 0;
+    if (!buffer || !buffer->wrap || !buffer->doc || y >= buffer->doc->lineCount) {
+        return 0;
+    }
+    line = &buffer->doc->lines[y];
+    end = GetWrapBreak(rp, line, 0, buffer->wrap->width);
+    for (; row > 0 && end < line->length; row--) {
+        start = end;
+        end = GetWrapBreak(rp, line, start, buffer->wrap->width);
+    }
+    *rowEnd = end;
+    return start;
+}
+
+/* Rows line y takes in a view - none if a hidden fold takes it off the view */
+ULONG GetLineRows(struct TextBuffer *buffer, ULONG y)
+{
+    struct WrapIndex *index = GetWrapIndex(buffer);
+
+    if (!index) {
+        return (buffer && IsLineHidden(buffer->doc, y)) ? 0 : 1;
+    }
+    return (y < index->lineCount) ? GetEntryRows(index->lines[y]) : 0;
+}
+
+/* Row of line y counted from the top of the document, in a view - a hidden line has the row of its fold */
+ULONG ViewLineToRow(struct TextBuffer *buffer, ULONG y)
+{
+    struct WrapIndex *index = GetWrapIndex(buffer);
+    ULONG startY = 0;
+    ULONG row = 0;
+
+    if (!index) {
+        return buffer ? LineToRow(buffer->doc, y) : y;
+    }
+    if (y >= index->lineCount) {
+        return index->nodes[1].rows;
+    }
+    if (index->lines[y] & WRAP_HIDDEN) {
+        y = RowToLine(buffer->doc, LineToRow(buffer->doc, y));
+    }
+    FindWrapChunk(index, y, &startY, &row);
+    for (; startY < y; startY++) {
+        row += GetEntryRows(index->lines[startY]);
+    }
+    return row;
+}
+
+/* Line on a row counted from the top of the document, in a view */
+ULONG ViewRowToLine(struct TextBuffer *buffer, ULONG row)
+{
+    struct WrapIndex *index = GetWrapIndex(buffer);
+    ULONG rowInLine = 0;
+
+    if (!index) {
+        return buffer ? RowToLine(buffer->doc, row) : row;
+    }
+    return FindWrapRow(index, row, &rowInLine);
+}
+
+/* Rows the document takes in a view */
+ULONG GetViewRowCount(struct TextBuffer *buffer)
+{
+    struct WrapIndex *index = GetWrapIndex(buffer);
+
+    if (!index) {
+        return buffer ? GetRowCount(buffer->doc) : 0;
+    }
+    return index->nodes[1].rows;
+}
+
+/* First line starting the given number of rows or more below the top of line y, in a view -
+ * lineCount once that is past the end */
+ULONG ViewLineAfterRows(struct TextBuffer *buffer, ULONG y, ULONG rows)
+{
+    struct WrapIndex *index = GetWrapIndex(buffer);
+    ULONG row = 0;
+    ULONG rowInLine = 0;
+
+    if (!index) {
+        return buffer ? LineAfterRows(buffer->doc, y, rows) : y + rows;
+    }
+    row = ViewLineToRow(buffer, y) + rows;
+    if (row >= index->nodes[1].rows) {
+        return buffer->doc->lineCount;
+    }
+    y = FindWrapRow(index, row, &rowInLine);
+    if (rowInLine > 0) {
+        /* The row is inside a line - the next line starts below it */
+        y = LineAfterRows(buffer->doc, y, 1);
+    }
+    return y;
+}
+
+/* Follow lineDelta lines inserted (>0) or removed (<0) after lineY - lineY and the inserted lines
+ * are measured again when next needed. Inside an edit batch the change is only noted, and
+ * laid out once the batch ends. */
+VOID WrapLinesChanged(struct TextBuffer *buffer, ULONG lineY, LONG lineDelta)
+{
+    if (!buffer || !buffer->wrap || !buffer->doc) {
+        return;
+    }
+    if (InEditBatch()) {
+        AddLineSpan(&buffer->wrap->batch, lineY, lineDelta);
+        return;
+    }
+    UpdateWrapLines(buffer, lineY, lineDelta);
+}
+
+/* Lay out the lines an edit batch changed, now that it has ended */
+VOID WrapBatchEnded(struct TextBuffer *buffer)
+{
+    if (!buffer || !buffer->wrap || !buffer->doc || !buffer->wrap->batch.changed) {
+        return;
+    }
+    FlushWrapBatch(buffer);
+}
+
+/* Lay out a change now - see WrapLinesChanged */
+static VOID UpdateWrapLines(struct TextBuffer *buffer, ULONG lineY, LONG lineDelta)
+{
+    struct WrapIndex *index = NULL;
+    struct TextDocument *doc = NULL;
+    struct WrapNode *leaf = NULL;
+    ULONG oldCount = 0;
+    ULONG chunk = 0;
+    ULONG next = 0;
+    ULONG chunkStart = 0;
+    ULONG startRow = 0;
+    ULONG removed = 0;
+    ULONG taken = 0;
+    ULONG y = 0;
+    BOOL rebuild = FALSE;
+
+    index = buffer->wrap;
+    doc = buffer->doc;
+    oldCount = (ULONG)((LONG)doc->lineCount - lineDelta);
+    if (lineY == DOC_CHANGE_ALL || lineY >= index->lineCount || index->lineCount != oldCount) {
+        /* A new document, or lines came in without an edit - lay it all out again */
+        if (!ResetWrap(buffer)) {
+            FreeWrap(buffer);
+        }
+        return;
+    }
+
+    if (lineDelta > 0 && !GrowWrapLines(index, doc->lineCount)) {
+        FreeWrap(buffer);
+        return;
+    }
+
+    chunk = FindWrapChunk(index, lineY, &chunkStart, &startRow);
+    if (lineDelta > 0) {
+        for (y = oldCount - 1; y > lineY; y--) {
+            index->lines[y + (ULONG)lineDelta] = index->lines[y];
+        }
+        for (y = lineY + 1; y <= lineY + (ULONG)lineDelta; y++) {
+            index->lines[y] = WRAP_STALE | EstimateWrapRows(index, doc->lines[y].length);
+            if (IsLineHidden(doc, y)) {
+                index->lines[y] |= WRAP_HIDDEN;
+            }
+        }
+        index->staleCount += (ULONG)lineDelta;
+        index->lineCount = doc->lineCount;
+        leaf = &index->nodes[index->leafCount + chunk];
+        leaf->lines += (ULONG)lineDelta;
+        if (leaf->lines > 2 * WRAP_CHUNK_LINES) {
+            rebuild = TRUE;
+        }
+    } else if (lineDelta < 0) {
+        removed = (ULONG)(-lineDelta);
+        for (y = lineY + 1; y <= lineY + removed; y++) {
+            if (index->lines[y] & WRAP_STALE) {
+                index->staleCount--;
+            }
+        }
+        for (y = lineY + 1; y + removed < oldCount; y++) {
+            index->lines[y] = index->lines[y + removed];
+        }
+        index->lineCount = doc->lineCount;
+
+        /* Lines after lineY in its own chunk first, then whole or leading parts of the next ones */
+        leaf = &index->nodes[index->leafCount + chunk];
+        taken = chunkStart + leaf->lines - (lineY + 1);
+        if (taken > removed) {
+            taken = removed;
+        }
+        leaf->lines -= taken;
+        removed -= taken;
+        for (next = chunk + 1; removed > 0 && next < index->chunkCount; next++) {
+            leaf = &index->nodes[index->leafCount + next];
+            taken = (leaf->lines < removed) ? leaf->lines : removed;
+            leaf->lines -= taken;
+            removed -= taken;
+            if (leaf->lines == 0) {
+                rebuild = TRUE;
+            }
+            /* What is left of it follows straight on from lineY */
+            RecountWrapChunk(index, next, lineY + 1);
+        }
+    }
+
+    if (!(index->lines[lineY] & WRAP_STALE)) {
+        index->staleCount++;
+    }
+    index->lines[lineY] = (UWORD)((index->lines[lineY] & WRAP_HIDDEN) | WRAP_STALE |
+                                  EstimateWrapRows(index, doc->lines[lineY].length));
+    if (rebuild) {
+        if (!BuildWrapTree(index)) {
+            FreeWrap(buffer);
+        }
+        return;
+    }
+    RecountWrapChunk(index, chunk, chunkStart);
+}
+
+/* Take in the span of lines edits changed while a batch was open - its first line and the lines
+ * it gained or lost as one edit, then the rest of it as lines to measure again (and to see
+ * which of them folds hide, as lines moved around inside it) */
+static VOID FlushWrapBatch(struct TextBuffer *buffer)
+{
+    struct WrapIndex *index = buffer->wrap;
+    struct TextDocument *doc = buffer->doc;
+    struct LineSpan span = index->batch;
+    ULONG chunk = 0;
+    ULONG chunkStart = 0;
+    ULONG startRow = 0;
+    ULONG y = 0;
+
+    index->batch.changed = FALSE;
+    UpdateWrapLines(buffer, span.first, span.delta);
+    index = buffer->wrap;
+    if (!index || span.first == DOC_CHANGE_ALL || span.first >= index->lineCount) {
+        return;
+    }
+    if (span.last >= index->lineCount) {
+        span.last = index->lineCount - 1;
+    }
+
+    for (y = span.first + 1; y <= span.last; y++) {
+        if (!(index->lines[y] & WRAP_STALE)) {
+            index->staleCount++;
+        }
+        index->lines[y] = (UWORD)((index->lines[y] & WRAP_HIDDEN) | WRAP_STALE |
+                                  EstimateWrapRows(index, doc->lines[y].length));
+    }
+    MarkWrapHidden(buffer, span.first, span.last);
+    chunk = FindWrapChunk(index, span.first, &chunkStart, &startRow);
+    for (; chunk < index->chunkCount && chunkStart <= span.last; chunk++) {
+        RecountWrapChunk(index, chunk, chunkStart);
+        chunkStart += index->nodes[index->leafCount + chunk].lines;
+    }
+}
+
+/* Follow folds of lines startY-endY being made, removed, hidden or shown */
+VOID WrapFoldsChanged(struct TextBuffer *buffer, ULONG startY, ULONG endY)
+{
+    struct WrapIndex *index = GetWrapIndex(buffer);
+    ULONG chunk = 0;
+    ULONG chunkStart = 0;
+    ULONG startRow = 0;
+
+    if (!index || startY >= index->lineCount) {
+        return;
+    }
+    if (endY >= index->lineCount) {
+        endY = index->lineCount - 1;
+    }
+    MarkWrapHidden(buffer, startY, endY);
+
+    chunk = FindWrapChunk(index, startY, &chunkStart, &startRow);
+    for (; chunk < index->chunkCount && chunkStart <= endY; chunk++) {
+        RecountWrapChunk(index, chunk, chunkStart);
+        chunkStart += index->nodes[index->leafCount + chunk].lines;
+    }
+}
+
+/* Free a view's soft wrap layout - its lines run off to the right again */
+VOID FreeWrap(struct TextBuffer *buffer)
+{
+    if (!buffer || !buffer->wrap) {
+        return;
+    }
+    if (buffer->wrap->lines) {
+        freeVec(buffer->wrap->lines);
+    }
+    if (buffer->wrap->nodes) {
+        freeVec(buffer->wrap->nodes);
+    }
+    freeVec(buffer->wrap);
+    buffer->wrap = NULL;
+    buffer->needsFullRedraw = TRUE;
+}
+
+/* ============================================================================
+ * Layout
+ * ============================================================================ */
+
+/* A view's wrap layout, taking in lines added to its document since - NULL if it is not wrapped */
+static struct WrapIndex *GetWrapIndex(struct TextBuffer *buffer)
+{
+    struct WrapIndex *index = NULL;
+    struct TextDocument *doc = NULL;
+    ULONG y = 0;
+    ULONG oldCount = 0;
+
+    if (!buffer || !buffer->wrap || !buffer->doc) {
+        return NULL;
+    }
+    if (buffer->wrap->batch.changed) {
+        /* Looked at inside an edit batch - take in its edits so far */
+        FlushWrapBatch(buffer);
+        if (!buffer->wrap) {
+            return NULL;
+        }
+    }
+    index = buffer->wrap;
+    doc = buffer->doc;
+    if (index->lineCount == doc->lineCount) {
+        return index;
+    }
+
+    /* A file still loading - the lines it read are laid out at the end */
+    if (index->lineCount < doc->lineCount && index->lineCount > 0) {
+        oldCount = index->lineCount;
+        if (GrowWrapLines(index, doc->lineCount)) {
+            for (y = oldCount; y < doc->lineCount; y++) {
+                index->lines[y] = WRAP_STALE | EstimateWrapRows(index, doc->lines[y].length);
+                if (IsLineHidden(doc, y)) {
+                    index->lines[y] |= WRAP_HIDDEN;
+                }
+            }
+            index->staleCount += doc->lineCount - oldCount;
+            if (AppendWrapLines(index, doc->lineCount)) {
+                return index;
+            }
+        }
+    } else if (ResetWrap(buffer)) {
+        return index;
+    }
+    FreeWrap(buffer);
+    return NULL;
+}
+
+/* Lay every line of a view's document out from its length, to be measured later - FALSE if out of memory */
+static BOOL ResetWrap(struct TextBuffer *buffer)
+{
+    struct WrapIndex *index = buffer->wrap;
+    struct TextDocument *doc = buffer->doc;
+    ULONG y = 0;
+
+    if (!GrowWrapLines(index, doc->lineCount)) {
+        return FALSE;
+    }
+    for (y = 0; y < doc->lineCount; y++) {
+        index->lines[y] = WRAP_STALE | EstimateWrapRows(index, doc->lines[y].length);
+    }
+    index->lineCount = doc->lineCount;
+    index->staleCount = doc->lineCount;
+    index->sweepLine = buffer->scrollY;
+    index->batch.changed = FALSE;
+    if (doc->lineCount > 0) {
+        MarkWrapHidden(buffer, 0, doc->lineCount - 1);
+    }
+    return BuildWrapTree(index);
+}
+
+/* The RastPort to measure a view's lines with, after laying every line out again if its pane
+ * is a new width - NULL if the view is not wrapped */
+static struct RastPort *CheckWrapWidth(struct TextBuffer *buffer, struct Window *window)
+{
+    struct WrapIndex *index = GetWrapIndex(buffer);
+    struct RastPort *rp = NULL;
+    ULONG textStartX = 0;
+    ULONG textEndX = 0;
+    ULONG width = 1;
+    ULONG y = 0;
+
+    if (!index || !window || !window->RPort) {
+        return NULL;
+    }
+    rp = window->RPort;
+
+    /* Glyphs are drawn from textStartX while they end at or before textEndX (see RenderText) */
+    textStartX = window->BorderLeft + buffer->leftMargin + 1;
+    textEndX = window->Width - (window->BorderRight + 1);
+    if (textEndX > textStartX) {
+        width = textEndX - textStartX;
+    }
+    if (width == index->width && rp->Font == index->font) {
+        return rp;
+    }
+
+    index->width = width;
+    index->font = rp->Font;
+    index->charWidth = GetCharWidth(rp, 'M');
+    for (y = 0; y < index->lineCount; y++) {
+        index->lines[y] = (UWORD)((index->lines[y] & WRAP_HIDDEN) | WRAP_STALE |
+                                  EstimateWrapRows(index, buffer->doc->lines[y].length));
+    }
+    index->staleCount = index->lineCount;
+    index->sweepLine = buffer->scrollY;
+    buffer->scrollX = 0;
+    buffer->needsFullRedraw = TRUE;
+    BuildWrapTree(index);  /* Same lines - the tree keeps its size */
+    return rp;
+}
+
+/* Count the rows line y wraps to */
+static VOID MeasureWrapLine(struct TextBuffer *buffer, struct RastPort *rp, ULONG y)
+{
+    struct WrapIndex *index = buffer->wrap;
+    struct TextLine *line = &buffer->doc->lines[y];
+    UWORD entry = index->lines[y];
+    ULONG rows = 0;
+    ULONG start = 0;
+
+    do {
+        start = GetWrapBreak(rp, line, start, index->width);
+        rows++;
+    } while (start < line->length && rows < WRAP_ROWS);
+
+    index->lines[y] = (UWORD)((entry & WRAP_HIDDEN) | rows);
+    if (entry & WRAP_STALE) {
+        index->staleCount--;
+    }
+    if (!(entry & WRAP_HIDDEN)) {
+        AddWrapRows(index, y, (LONG)rows - (LONG)(entry & WRAP_ROWS));
+    }
+}
+
+/* Rows a line of the given length likely wraps to - exact for a fixed width font, if no word is
+ * broken early */
+static UWORD EstimateWrapRows(struct WrapIndex *index, ULONG length)
+{
+    ULONG rows = 1;
+
+    if (index->width > 0 && length > 0) {
+        rows = (length * index->charWidth + index->width - 1) / index->width;
+        if (rows == 0) {
+            rows = 1;
+        } else if (rows > WRAP_ROWS) {
+            rows = WRAP_ROWS;
+        }
+    }
+    return (UWORD)rows;
+}
+
+/* Rows a line's entry counts */
+static ULONG GetEntryRows(UWORD entry)
+{
+    return (entry & WRAP_HIDDEN) ? 0 : (ULONG)(entry & WRAP_ROWS);
+}
+
+/* Room for the entries of lineCount lines */
+static BOOL GrowWrapLines(struct WrapIndex *index, ULONG lineCount)
+{
+    UWORD *lines = NULL;
+    ULONG lineMax = 0;
+
+    if (lineCount <= index->lineMax && index->lines) {
+        return TRUE;
+    }
+    lineMax = index->lineMax ? index->lineMax : 256;
+    while (lineMax < lineCount) {
+        lineMax *= 2;
+    }
+    lines = (UWORD *)allocVec(lineMax * sizeof(UWORD), MEMF_CLEAR);
+    if (!lines) {
+        return FALSE;
+    }
+    if (index->lines) {
+        if (index->lineCount > 0) {
+            CopyMem(index->lines, lines, index->lineCount * sizeof(UWORD));
+        }
+        freeVec(index->lines);
+    }
+    index->lines = lines;
+    index->lineMax = lineMax;
+    return TRUE;
+}
+
+/* Take entries added at the end into the tree, in new chunks while there is room for them */
+static BOOL AppendWrapLines(struct WrapIndex *index, ULONG lineCount)
+{
+    struct WrapNode *leaf = NULL;
+    ULONG chunk = index->chunkCount - 1;
+    ULONG y = index->lineCount;
+    ULONG taken = 0;
+
+    index->lineCount = lineCount;
+    while (y < lineCount) {
+        leaf = &index->nodes[index->leafCount + chunk];
+        if (leaf->lines >= WRAP_CHUNK_LINES) {
+            if (index->chunkCount == index->leafCount) {
+                return BuildWrapTree(index);
+            }
+            chunk = index->chunkCount++;
+            leaf = &index->nodes[index->leafCount + chunk];
+        }
+        taken = WRAP_CHUNK_LINES - leaf->lines;
+        if (taken > lineCount - y) {
+            taken = lineCount - y;
+        }
+        for (; taken > 0; taken--, y++) {
+            leaf->lines++;
+            leaf->rows += GetEntryRows(index->lines[y]);
+        }
+        UpdateWrapPath(index, chunk);
+    }
+    return TRUE;
+}
+
+/* Cut the entries into chunks again and sum them up - FALSE if out of memory */
+static BOOL BuildWrapTree(struct WrapIndex *index)
+{
+    struct WrapNode *leaf = NULL;
+    ULONG chunkCount = 0;
+    ULONG leafCount = 1;
+    ULONG chunk = 0;
+    ULONG y = 0;
+    ULONG i = 0;
+
+    chunkCount = (index->lineCount + WRAP_CHUNK_LINES - 1) / WRAP_CHUNK_LINES;
+    if (chunkCount == 0) {
+        chunkCount = 1;
+    }
+    while (leafCount < chunkCount) {
+        leafCount <<= 1;
+    }
+    if (!index->nodes || leafCount != index->leafCount) {
+        if (index->nodes) {
+            freeVec(index->nodes);
+        }
+        index->nodes = (struct WrapNode *)allocVec(2 * leafCount * sizeof(struct WrapNode), MEMF_CLEAR);
+        if (!index->nodes) {
+            index->leafCount = 0;
+            index->chunkCount = 0;
+            return FALSE;
+        }
+        index->leafCount = leafCount;
+    }
+
+    for (chunk = 0; chunk < leafCount; chunk++) {
+        leaf = &index->nodes[leafCount + chunk];
+        leaf->lines = 0;
+        leaf->rows = 0;
+        for (i = 0; i < WRAP_CHUNK_LINES && y < index->lineCount; i++, y++) {
+            leaf->lines++;
+            leaf->rows += GetEntryRows(index->lines[y]);
+        }
+    }
+    for (i = leafCount - 1; i >= 1; i--) {
+        index->nodes[i].lines = index->nodes[2 * i].lines + index->nodes[2 * i + 1].lines;
+        index->nodes[i].rows = index->nodes[2 * i].rows + index->nodes[2 * i + 1].rows;
+    }
+    index->chunkCount = chunkCount;
+    return TRUE;
+}
+
+/* Sum a chunk's entries again, and every node above it */
+static VOID RecountWrapChunk(struct WrapIndex *index, ULONG chunk, ULONG startY)
+{
+    struct WrapNode *leaf = &index->nodes[index->leafCount + chunk];
+    ULONG y = 0;
+
+    leaf->rows = 0;
+    for (y = startY; y < startY + leaf->lines; y++) {
+        leaf->rows += GetEntryRows(index->lines[y]);
+    }
+    UpdateWrapPath(index, chunk);
+}
+
+/* Sum a chunk again into every node above it */
+static VOID UpdateWrapPath(struct WrapIndex *index, ULONG chunk)
+{
+    ULONG node = (index->leafCount + chunk) >> 1;
+
+    for (; node >= 1; node >>= 1) {
+        index->nodes[node].lines = index->nodes[2 * node].lines + index->nodes[2 * node + 1].lines;
+        index->nodes[node].rows = index->nodes[2 * node].rows + index->nodes[2 * node + 1].rows;
+    }
+}
+
+/* Add to the rows of the chunk holding line y, and of every node above it */
+static VOID AddWrapRows(struct WrapIndex *index, ULONG y, LONG delta)
+{
+    ULONG node = 1;
+
+    for (;;) {
+        index->nodes[node].rows = (ULONG)((LONG)index->nodes[node].rows + delta);
+        if (node >= index->leafCount) {
+            return;
+        }
+        if (y < index->nodes[2 * node].lines) {
+            node = 2 * node;
+        } else {
+            y -= index->nodes[2 * node].lines;
+            node = 2 * node + 1;
+        }
+    }
+}
+
+/* Chunk holding line y, with the line and row it starts at */
+static ULONG FindWrapChunk(struct WrapIndex *index, ULONG y, ULONG *startY, ULONG *startRow)
+{
+    ULONG node = 1;
+
+    *startY = 0;
+    *startRow = 0;
+    while (node < index->leafCount) {
+        if (y < *startY + index->nodes[2 * node].lines) {
+            node = 2 * node;
+        } else {
+            *startY += index->nodes[2 * node].lines;
+            *startRow += index->nodes[2 * node].rows;
+            node = 2 * node + 1;
+        }
+    }
+    return node - index->leafCount;
+}
+
+/* Line on a row, and which of its rows that is - the last row if the document has fewer */
+static ULONG FindWrapRow(struct WrapIndex *index, ULONG row, ULONG *rowInLine)
+{
+    ULONG node = 1;
+    ULONG y = 0;
+    ULONG rows = 0;
+
+    *rowInLine = 0;
+    if (index->nodes[1].rows == 0) {
+        return 0;
+    }
+    if (row >= index->nodes[1].rows) {
+        row = index->nodes[1].rows - 1;
+    }
+    while (node < index->leafCount) {
+        if (row < index->nodes[2 * node].rows) {
+            node = 2 * node;
+        } else {
+            row -= index->nodes[2 * node].rows;
+            y += index->nodes[2 * node].lines;
+            node = 2 * node + 1;
+        }
+    }
+    for (;; y++) {
+        rows = GetEntryRows(index->lines[y]);
+        if (row < rows) {
+            *rowInLine = row;
+            return y;
+        }
+        row -= rows;
+    }
+}
+
+/* Set which of lines startY-endY a hidden fold takes off the view */
+static VOID MarkWrapHidden(struct TextBuffer *buffer, ULONG startY, ULONG endY)
+{
+    struct WrapIndex *index = buffer->wrap;
+    struct TextDocument *doc = buffer->doc;
+    ULONG y = startY;
+    ULONG nextY = 0;
+
+    /* From each line shown to the next, the lines between are hidden - only the first line
+     * looked at may be a hidden one (a fold ending where the range starts) */
+    while (y <= endY) {
+        if (IsLineHidden(doc, y)) {
+            index->lines[y] |= WRAP_HIDDEN;
+        } else {
+            index->lines[y] &= (UWORD)~WRAP_HIDDEN;
+        }
+        nextY = LineAfterRows(doc, y, 1);
+        for (y++; y < nextY && y <= endY; y++) {
+            index->lines[y] |= WRAP_HIDDEN;
+        }
+    }
+}